@@ -0,0 +1,441 @@
+/*
+ * Microbenchmarks of the harness' own hot paths
+ *
+ *    ffi_call/rank<r>          - libffi dispatch of a no-op kernel with one
+ *                                rank r memref argument (flattened the way
+ *                                execute_with_parameters passes it)
+ *    event_counter/construct   - perf::EventCounter with the default metrics
+ *    event_counter/start_stop  - one counter window on an opened counter
+ *    event_counter/result      - reading the values of that window
+ *    tensor_fuzzer/<profile>   - TensorFuzzer::fill_data of a 4 MiB f32
+ *                                buffer, single threaded
+ *    memref_arg/rank<r>        - MemRefArg construction from its metadata
+ *    result_writer/write       - synchronous ResultWriter::write of a
+ *                                result CSV
+ *    result_writer/enqueue     - the same through the writer thread, as the
+ *                                measurement thread pays it
+ *    json/load_metadata        - load_json_from_file of a kernel's metadata
+ *
+ * Each case is calibrated to batches of at least --min-time seconds and
+ * reports the median time per operation over --repetitions batches. With
+ * --json the results are written for tracking, with --baseline they are
+ * checked against an earlier --json file and the exit code is 1 if any case
+ * got more than --tolerance slower.
+ */
+#include "argparse/argparse.hpp"
+#include "nlohmann/json.hpp"
+#include "perfcpp/event_counter.h"
+#include "result_writer.h"
+#include "statistics.h"
+#include "tensor_fuzzer.h"
+#include "utils.h"
+
+#include <chrono>
+#include <ffi.h>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace fs = std::filesystem;
+using json = nlohmann::json;
+
+namespace {
+struct CaseResult {
+  double ns_per_op = 0.0;
+  double min_ns_per_op = 0.0;
+  double bytes_per_second = 0.0; // 0 if the case moves no data
+  uint64_t iterations = 0;       // per batch
+};
+
+struct BenchConfig {
+  double min_time = 0.01;
+  unsigned int repetitions = 5;
+  std::string filter;
+};
+} // namespace
+
+// Keeps the compiler from dropping work whose result is unused
+template <typename T> static inline void keep(const T &value) {
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+// No-op kernels of every rank: base, aligned, offset, sizes, strides
+extern "C" {
+__attribute__((noinline)) void bench_rank0(void *, void *, int64_t) {
+  asm volatile("");
+}
+__attribute__((noinline)) void bench_rank1(void *, void *, int64_t, int64_t,
+                                           int64_t) {
+  asm volatile("");
+}
+__attribute__((noinline)) void bench_rank2(void *, void *, int64_t, int64_t,
+                                           int64_t, int64_t, int64_t) {
+  asm volatile("");
+}
+__attribute__((noinline)) void bench_rank3(void *, void *, int64_t, int64_t,
+                                           int64_t, int64_t, int64_t, int64_t,
+                                           int64_t) {
+  asm volatile("");
+}
+__attribute__((noinline)) void bench_rank4(void *, void *, int64_t, int64_t,
+                                           int64_t, int64_t, int64_t, int64_t,
+                                           int64_t, int64_t, int64_t) {
+  asm volatile("");
+}
+}
+
+/*
+ * Runs `op` in batches, doubling the batch until it takes min_time, then
+ * times `repetitions` batches of that size
+ */
+template <typename Op>
+static CaseResult run_case(const BenchConfig &config, Op &&op,
+                           double bytes_per_op = 0.0) {
+  auto time_batch = [&op](uint64_t iterations) {
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < iterations; i++)
+      op();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                         start)
+        .count();
+  };
+
+  uint64_t iterations = 1;
+  double seconds = time_batch(iterations);
+  while (seconds < config.min_time && iterations < (uint64_t(1) << 40)) {
+    iterations *= 2;
+    seconds = time_batch(iterations);
+  }
+
+  std::vector<double> ns_per_op;
+  for (unsigned int r = 0; r < config.repetitions; r++)
+    ns_per_op.push_back(time_batch(iterations) * 1e9 / iterations);
+
+  CaseResult result;
+  result.ns_per_op = Statistics::median(ns_per_op);
+  result.min_ns_per_op = *std::min_element(ns_per_op.begin(), ns_per_op.end());
+  result.bytes_per_second =
+      bytes_per_op > 0.0 ? bytes_per_op / (result.ns_per_op * 1e-9) : 0.0;
+  result.iterations = iterations;
+  return result;
+}
+
+static JSONArgument memref_metadata(size_t rank) {
+  JSONArgument argument;
+  argument.dtype = "f32";
+  argument.rank = rank;
+  static const uint64_t dims[] = {1, 64, 56, 56};
+  argument.shape.assign(dims + 4 - rank, dims + 4);
+  return argument;
+}
+
+static void bench_ffi(const BenchConfig &config,
+                      std::map<std::string, CaseResult> &results) {
+  static void (*const kernels[])() = {
+      reinterpret_cast<void (*)()>(bench_rank0),
+      reinterpret_cast<void (*)()>(bench_rank1),
+      reinterpret_cast<void (*)()>(bench_rank2),
+      reinterpret_cast<void (*)()>(bench_rank3),
+      reinterpret_cast<void (*)()>(bench_rank4)};
+  std::vector<float> data(64 * 56 * 56);
+
+  for (size_t rank = 0; rank <= 4; rank++) {
+    MemRefArg arg(memref_metadata(rank));
+    arg.setData(data.data());
+
+    std::vector<ffi_type *> types = {&ffi_type_pointer, &ffi_type_pointer,
+                                     &ffi_type_sint64};
+    std::vector<void *> values = {&arg.m_desc->base_ptr,
+                                  &arg.m_desc->aligned_ptr,
+                                  &arg.m_desc->offset};
+    for (size_t d = 0; d < rank; d++) {
+      types.push_back(&ffi_type_sint64);
+      values.push_back(&arg.m_desc->dimension[d]);
+    }
+    for (size_t d = 0; d < rank; d++) {
+      types.push_back(&ffi_type_sint64);
+      values.push_back(&arg.m_desc->strides[d]);
+    }
+
+    ffi_cif cif;
+    if (ffi_prep_cif(&cif, FFI_DEFAULT_ABI, types.size(), &ffi_type_void,
+                     types.data()) != FFI_OK) {
+      std::cerr << "ffi_prep_cif failed for rank " << rank << "\n";
+      continue;
+    }
+    results["ffi_call/rank" + std::to_string(rank)] =
+        run_case(config, [&cif, &values, rank]() {
+          ffi_call(&cif, FFI_FN(kernels[rank]), nullptr, values.data());
+        });
+  }
+}
+
+static void bench_event_counter(const BenchConfig &config,
+                                std::map<std::string, CaseResult> &results) {
+  // Same defaults as --sample-metrics
+  const std::vector<std::string> metrics = {"seconds", "cycles",
+                                            "instructions", "cache-misses"};
+  try {
+    perf::EventCounter probe;
+    probe.add(metrics);
+    probe.open();
+    probe.close();
+  } catch (const std::exception &err) {
+    std::cerr << "Counters unavailable (" << err.what()
+              << "), skipping event_counter\n";
+    return;
+  }
+
+  results["event_counter/construct"] = run_case(config, [&metrics]() {
+    perf::EventCounter counter;
+    counter.add(metrics);
+    keep(counter);
+  });
+
+  perf::EventCounter counter;
+  counter.add(metrics);
+  counter.open();
+  results["event_counter/start_stop"] = run_case(config, [&counter]() {
+    counter.start();
+    counter.stop();
+  });
+  results["event_counter/result"] = run_case(config, [&counter]() {
+    perf::CounterResult result = counter.result();
+    keep(result);
+  });
+  counter.close();
+}
+
+static void bench_tensor_fuzzer(const BenchConfig &config,
+                                std::map<std::string, CaseResult> &results) {
+  const uint64_t elem_count = uint64_t(1) << 20;
+  std::vector<float> buffer(elem_count);
+  TensorFuzzer::configure(1, -1);
+
+  for (DataProfile profile :
+       {DataProfile::TEST, DataProfile::RANDOM, DataProfile::RANDOM_NORM,
+        DataProfile::ZEROS, DataProfile::SPARSE, DataProfile::DENORMAL,
+        DataProfile::MIXED_SPECIAL, DataProfile::LARGE_MAGNITUDE}) {
+    DataFormatInfo info(profile, profile == DataProfile::SPARSE ? 0.9f : 0.f);
+    info.setElemCount(elem_count);
+    info.setElemType(ElementType::F32);
+    info.setRowLength(64);
+    info.setSeed(1);
+    results["tensor_fuzzer/" + TensorFuzzer::describe(profile)] = run_case(
+        config,
+        [&info, &buffer]() {
+          TensorFuzzer::fill_data(info, buffer.data());
+          keep(buffer.front());
+        },
+        elem_count * sizeof(float));
+  }
+}
+
+static void bench_memref_arg(const BenchConfig &config,
+                             std::map<std::string, CaseResult> &results) {
+  for (size_t rank : {1, 4}) {
+    JSONArgument metadata = memref_metadata(rank);
+    results["memref_arg/rank" + std::to_string(rank)] =
+        run_case(config, [&metadata]() {
+          MemRefArg arg(metadata);
+          keep(arg.m_desc);
+        });
+  }
+}
+
+static void bench_result_writer(const BenchConfig &config,
+                                const fs::path &scratch,
+                                std::map<std::string, CaseResult> &results) {
+  // A result CSV of 100 samples of the default metrics
+  std::ostringstream csv;
+  csv << "seconds,instructions,cycles,cache-misses\n";
+  for (int i = 0; i < 100; i++)
+    csv << 1.5e-4 + i * 1e-7 << "," << 1234567 + i << "," << 456789 + i << ","
+        << 1234 + i << "\n";
+  const std::string contents = csv.str();
+  fs::path filepath = fs::path(scratch).append("result.csv");
+
+  results["result_writer/write"] = run_case(
+      config, [&]() { ResultWriter::write(filepath, contents); },
+      contents.size());
+
+  ResultWriter::start(-1, 0.0);
+  results["result_writer/enqueue"] = run_case(
+      config, [&]() { ResultWriter::write(filepath, contents); },
+      contents.size());
+  ResultWriter::stop();
+}
+
+static void bench_json(const BenchConfig &config, const fs::path &scratch,
+                       std::map<std::string, CaseResult> &results) {
+  // Metadata of a convolution, as the metadata pass writes it
+  json metadata;
+  json &call = metadata["kernel_call"];
+  for (const auto &shape : std::vector<std::vector<uint64_t>>{
+           {1, 64, 56, 56}, {64, 64, 3, 3}, {64}})
+    call["args"].push_back(
+        {{"dtype", "f32"}, {"rank", shape.size()}, {"shape", shape}});
+  call["returns"].push_back(
+      {{"dtype", "f32"}, {"rank", 4}, {"shape", {1, 64, 56, 56}}});
+  metadata["op"] = {{"name", "torch.aten.convolution"},
+                    {"stride", {1, 1}},
+                    {"padding", {1, 1}},
+                    {"dilation", {1, 1}},
+                    {"groups", 1}};
+  fs::path filepath = fs::path(scratch).append("metadata.json");
+  std::ofstream(filepath) << metadata.dump(2);
+  double bytes = static_cast<double>(fs::file_size(filepath));
+
+  results["json/load_metadata"] = run_case(
+      config,
+      [&filepath]() {
+        json loaded = load_json_from_file(filepath);
+        keep(loaded);
+      },
+      bytes);
+}
+
+static json to_json(const std::map<std::string, CaseResult> &results) {
+  json cases = json::object();
+  for (const auto &[name, result] : results)
+    cases[name] = {{"ns_per_op", result.ns_per_op},
+                   {"min_ns_per_op", result.min_ns_per_op},
+                   {"bytes_per_second", result.bytes_per_second},
+                   {"iterations", result.iterations}};
+  return {{"cases", cases}};
+}
+
+// Cases more than `tolerance` slower than the baseline, printed
+static size_t compare_to_baseline(
+    const std::map<std::string, CaseResult> &results,
+    const json &baseline, double tolerance) {
+  size_t regressions = 0;
+  json cases = baseline.value("cases", json::object());
+  for (const auto &[name, result] : results) {
+    if (!cases.contains(name))
+      continue;
+    double before = cases[name].value("ns_per_op", 0.0);
+    if (before <= 0.0)
+      continue;
+    double ratio = result.ns_per_op / before;
+    if (ratio > 1.0 + tolerance) {
+      std::cerr << "Regression: " << name << " " << before << " -> "
+                << result.ns_per_op << " ns/op (" << ratio << "x)\n";
+      regressions++;
+    }
+  }
+  return regressions;
+}
+
+int main(int argc, char **args) {
+  argparse::ArgumentParser program("HarnessBench");
+
+  program.add_argument("--filter")
+      .help("Only this group (ffi_call, tensor_fuzzer, ...) or case "
+            "(tensor_fuzzer/sparse)")
+      .default_value(std::string(""));
+
+  program.add_argument("--min-time")
+      .help("Minimum seconds per timed batch")
+      .default_value(0.01)
+      .scan<'g', double>();
+
+  program.add_argument("--repetitions")
+      .help("Timed batches per case, the median is reported")
+      .default_value(5)
+      .scan<'i', int>();
+
+  program.add_argument("--json")
+      .help("Writes the results to this file")
+      .default_value(std::string(""));
+
+  program.add_argument("--baseline")
+      .help("Results of an earlier --json run to compare against")
+      .default_value(std::string(""));
+
+  program.add_argument("--tolerance")
+      .help("Relative slowdown against --baseline counted as a regression")
+      .default_value(0.1)
+      .scan<'g', double>();
+
+  try {
+    program.parse_args(argc, args);
+  } catch (const std::exception &err) {
+    std::cerr << err.what() << std::endl;
+    std::cerr << program;
+    return 1;
+  }
+
+  BenchConfig config;
+  config.min_time = program.get<double>("--min-time");
+  config.repetitions = std::max(1, program.get<int>("--repetitions"));
+  config.filter = program.get<std::string>("--filter");
+
+  fs::path scratch = fs::temp_directory_path().append(
+      "harness_bench_" + std::to_string(getpid()));
+  fs::create_directories(scratch);
+
+  std::map<std::string, CaseResult> results;
+  auto wanted = [&config](const std::string &group) {
+    return config.filter.empty() ||
+           group.find(config.filter) != std::string::npos ||
+           config.filter.rfind(group + "/", 0) == 0;
+  };
+  if (wanted("ffi_call"))
+    bench_ffi(config, results);
+  if (wanted("event_counter"))
+    bench_event_counter(config, results);
+  if (wanted("tensor_fuzzer"))
+    bench_tensor_fuzzer(config, results);
+  if (wanted("memref_arg"))
+    bench_memref_arg(config, results);
+  if (wanted("result_writer"))
+    bench_result_writer(config, scratch, results);
+  if (wanted("json"))
+    bench_json(config, scratch, results);
+  fs::remove_all(scratch);
+  std::erase_if(results, [&config](const auto &result) {
+    return result.first.find(config.filter) == std::string::npos;
+  });
+
+  std::printf("%-32s %14s %14s %12s\n", "case", "ns/op", "min ns/op",
+              "GB/s");
+  for (const auto &[name, result] : results)
+    std::printf("%-32s %14.1f %14.1f %12.2f\n", name.c_str(),
+                result.ns_per_op, result.min_ns_per_op,
+                result.bytes_per_second / 1e9);
+
+  if (std::string json_filepath = program.get<std::string>("--json");
+      !json_filepath.empty()) {
+    std::ofstream out(json_filepath);
+    if (!out.is_open()) {
+      std::cerr << "Error: Could not open " << json_filepath
+                << " for writing.\n";
+      return 1;
+    }
+    out << to_json(results).dump(2) << "\n";
+  }
+
+  if (std::string baseline_filepath = program.get<std::string>("--baseline");
+      !baseline_filepath.empty()) {
+    if (!fs::exists(baseline_filepath)) {
+      std::cerr << "No baseline at " << baseline_filepath << "\n";
+      return 1;
+    }
+    size_t regressions =
+        compare_to_baseline(results, load_json_from_file(baseline_filepath),
+                            program.get<double>("--tolerance"));
+    if (regressions) {
+      std::cerr << regressions << " cases slower than the baseline\n";
+      return 1;
+    }
+    std::cout << "No regressions against " << baseline_filepath << "\n";
+  }
+  return 0;
+}
@@ -13,6 +13,7 @@ sudo ./build/Debug/WrapperModule \
   --output-dir="$(pwd)/baseline_output" \
   --cc="/usr/bin/clang++" \
   --pipeline="$(pwd)/baseline_pipeline.json" \
+  --record-outputs \
 alexnet_torch.mlir 
 
 
@@ -23,6 +24,7 @@ sudo ./build/Debug/WrapperModule \
   --output-dir="$(pwd)/o2_output" \
   --cc="/usr/bin/clang++" \
   --pipeline="$(pwd)/o2_pipeline.json" \
+  --verify-against="$(pwd)/baseline_output" \
 alexnet_torch.mlir 
 
 
@@ -0,0 +1,72 @@
+#!/usr/bin/env python3
+import os
+import glob
+import argparse
+import pandas as pd
+import matplotlib.pyplot as plt
+
+MARKS = [0.5, 0.9, 0.99, 0.999, 0.9999]
+
+def parse_args():
+    parser = argparse.ArgumentParser(description="Compare the per-call latency distributions of --call-latency runs per kernel, one line per pipeline.")
+    parser.add_argument("--output-dirs", type=str, nargs="+", required=True, help="Benchmark output directories run with --call-latency, e.g. one per pipeline.")
+    parser.add_argument("--labels", type=str, nargs="*", default=None, help="Legend labels for the output directories (default: directory names).")
+    parser.add_argument("--kernels", type=str, nargs="*", default=None, help="Only plot kernels whose file name contains one of these strings.")
+    parser.add_argument("--graphs-dir", type=str, default="graphs/call_latency", help="Folder to save generated graphs.")
+    return parser.parse_args()
+
+def ensure_dir(path):
+    os.makedirs(path, exist_ok=True)
+
+def find_histograms(output_dir):
+    """Kernel name -> call_latency/<op>/<kernel>.hist.csv of the output directory."""
+    histograms = {}
+    for path in glob.glob(os.path.join(output_dir, "call_latency", "*", "*.hist.csv")):
+        op_type = os.path.basename(os.path.dirname(path))
+        kernel = os.path.basename(path)[:-len(".hist.csv")]
+        histograms[f"{op_type}/{kernel}"] = path
+    return histograms
+
+def plot_kernel(kernel, frames, save_path):
+    """Latency against percentile on a 1 / (1 - p) axis, so the tail gets the room."""
+    plt.figure(figsize=(10, 6))
+    for label, df in frames:
+        # The last bucket holds p100, which the axis can't show
+        df = df[df["percentile"] < 1.0]
+        plt.step(1.0 / (1.0 - df["percentile"]), df["high_ns"], where="post", label=label)
+    plt.xscale("log")
+    plt.xticks([1.0 / (1.0 - p) for p in MARKS], [f"p{p * 100:g}" for p in MARKS])
+    plt.xlabel("Percentile")
+    plt.ylabel("Call latency (ns)")
+    plt.title(kernel)
+    plt.grid(True, which="major", linestyle=":", linewidth=0.5)
+    plt.legend()
+    plt.tight_layout()
+    plt.savefig(save_path, dpi=300)
+    plt.close()
+    print(f"✅ Saved call latency graph for {kernel} → {save_path}")
+
+def main():
+    args = parse_args()
+    ensure_dir(args.graphs_dir)
+
+    runs = []
+    for i, output_dir in enumerate(args.output_dirs):
+        label = args.labels[i] if args.labels and i < len(args.labels) else os.path.basename(os.path.normpath(output_dir))
+        histograms = find_histograms(output_dir)
+        if not histograms:
+            print(f"⚠️ Skipping {output_dir}: no .hist.csv files (run with --call-latency)")
+            continue
+        runs.append((label, histograms))
+
+    kernels = sorted(set().union(*(histograms.keys() for _, histograms in runs))) if runs else []
+    for kernel in kernels:
+        if args.kernels and not any(k in kernel for k in args.kernels):
+            continue
+        frames = [(label, pd.read_csv(histograms[kernel])) for label, histograms in runs if kernel in histograms]
+        frames = [(label, df) for label, df in frames if not df.empty]
+        if frames:
+            plot_kernel(kernel, frames, os.path.join(args.graphs_dir, kernel.replace("/", "_") + ".png"))
+
+if __name__ == "__main__":
+    main()
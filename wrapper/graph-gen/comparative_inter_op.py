@@ -1,9 +1,11 @@
 #!/usr/bin/env python3
 import os
+import re
 import glob
 import argparse
 import pandas as pd
 import matplotlib.pyplot as plt
+from results_store import has_store, kernel_averages
 
 def parse_args():
     parser = argparse.ArgumentParser(description="Compare aggregated perf metrics between two benchmark outputs.")
@@ -20,29 +22,64 @@ def ensure_dir(path):
 def get_timings_dir(base_dir):
     """Return the timings subdirectory path if it exists."""
     timings_path = os.path.join(base_dir, "timings")
-    if not os.path.isdir(timings_path):
-        raise FileNotFoundError(f"Missing 'timings' directory in: {base_dir}")
+    if not os.path.isdir(timings_path) and not has_store(base_dir):
+        raise FileNotFoundError(f"Missing 'results.sqlite' or 'timings' directory in: {base_dir}")
     return timings_path
 
+# Per kernel side files: cold cache, warmup, per-core counters, swept layouts and thread counts
+VARIANT_PATTERN = re.compile(r"\.(cold|warmup|cores|stats|layout-[\w-]+|threads-\d+|density-[\d.e-]+|profile-[\w-]+|shape-[\w.-]+|order-\w+)\.csv$")
+
+def is_variant(csv_path):
+    """Only the main <kernel>.csv of each kernel is compared."""
+    return VARIANT_PATTERN.search(csv_path) is not None
+
 def get_optype_dirs(timings_dir):
     """Return list of subdirectories inside 'timings/' (like `ls -d timings/*/`)."""
     return [d for d in glob.glob(os.path.join(timings_dir, "*/")) if os.path.isdir(d)]
 
+RATE_METRICS = {"gflops", "bandwidth_gbs", "ipc", "arith_intensity", "ci95",
+                # --metric-group columns
+                "frontend_bound", "backend_bound", "bad_speculation", "retiring",
+                "memory_bound", "core_bound", "l1d_mpki", "llc_mpki", "dtlb_mpki",
+                "fetch_latency", "fetch_bandwidth", "l1i_mpki", "itlb_mpki",
+                # --energy
+                "power_pkg_w", "gflops_per_j",
+                # --vectorization-report
+                "vec_fraction",
+                # --dram-traffic
+                "dram_bandwidth_gbs", "dram_intensity", "dram_traffic_ratio"}
+
 def load_dataset(timings_dir, metric):
     """Aggregate average metric for each operator CSV grouped by op_type."""
+    stored = kernel_averages(os.path.dirname(timings_dir), metric)
+    if stored is not None:
+        data = stored[["op_type", metric, "invalid"]].astype({"invalid": int}).to_dict("records")
+    else:
+        data = load_csvs(timings_dir, metric)
+    df = pd.DataFrame(data)
+    if df.empty:
+        return df
+    # Rates and ratios don't add up across kernels
+    aggregation = "mean" if metric in RATE_METRICS else "sum"
+    return df.groupby("op_type").agg({metric: aggregation, "invalid": "sum"}).reset_index()
+
+def load_csvs(timings_dir, metric):
     data = []
     for op_path in get_optype_dirs(timings_dir):
         op_type = os.path.basename(os.path.normpath(op_path))
         for csv_path in glob.glob(os.path.join(op_path, "*.csv")):
+            if is_variant(csv_path):
+                continue
             df = pd.read_csv(csv_path)
             if metric not in df.columns:
                 continue
             avg_value = df[metric].mean()
-            data.append({"op_type": op_type, metric: avg_value})
-    df = pd.DataFrame(data)
-    if df.empty:
-        return df
-    return df.groupby("op_type")[metric].sum().reset_index()
+            data.append({"op_type": op_type, metric: avg_value, "invalid": is_invalid(df)})
+    return data
+
+def is_invalid(df):
+    """Kernels which failed --verify-against carry verified = 0."""
+    return int("verified" in df.columns and (df["verified"] < 1).any())
 
 def plot_comparison(df1, df2, metric, labels, save_path):
     merged = pd.merge(df1, df2, on="op_type", suffixes=("_v1", "_v2"))
@@ -56,10 +93,17 @@ def plot_comparison(df1, df2, metric, labels, save_path):
 
     plt.figure(figsize=(10, 6))
     plt.bar([i - width/2 for i in x], merged[f"{metric}_v1"], width=width, label=labels[0])
-    plt.bar([i + width/2 for i in x], merged[f"{metric}_v2"], width=width, label=labels[1])
+    bars = plt.bar([i + width/2 for i in x], merged[f"{metric}_v2"], width=width, label=labels[1])
 
-    plt.xticks(x, merged["op_type"], rotation=45, ha="right")
-    plt.ylabel(f"Total {metric}")
+    # Op types with kernels that failed verification are hatched and flagged
+    invalid = merged["invalid_v1"] + merged["invalid_v2"]
+    for bar, count in zip(bars, invalid):
+        if count:
+            bar.set_hatch("//")
+            bar.set_edgecolor("red")
+    tick_labels = [f"{op} ({int(n)} invalid)" if n else op for op, n in zip(merged["op_type"], invalid)]
+    plt.xticks(x, tick_labels, rotation=45, ha="right")
+    plt.ylabel(f"{'Mean' if metric in RATE_METRICS else 'Total'} {metric}")
     plt.title(f"Inter-OpType Comparison ({metric})")
     plt.legend()
     plt.tight_layout()
@@ -1,8 +1,10 @@
 import os
+import re
 import glob
 import argparse
 import pandas as pd
 import matplotlib.pyplot as plt
+from results_store import has_store, kernel_averages, op_types
 
 def parse_args():
     parser = argparse.ArgumentParser(description="Compare perf metrics within each op_type across two benchmark outputs.")
@@ -18,25 +20,42 @@ def ensure_dir(path):
 
 def get_timings_dir(base_dir):
     timings_path = os.path.join(base_dir, "timings")
-    if not os.path.isdir(timings_path):
-        raise FileNotFoundError(f"Missing 'timings' directory in: {base_dir}")
+    if not os.path.isdir(timings_path) and not has_store(base_dir):
+        raise FileNotFoundError(f"Missing 'results.sqlite' or 'timings' directory in: {base_dir}")
     return timings_path
 
+# Per kernel side files: cold cache, warmup, per-core counters, swept layouts and thread counts
+VARIANT_PATTERN = re.compile(r"\.(cold|warmup|cores|stats|layout-[\w-]+|threads-\d+|density-[\d.e-]+|profile-[\w-]+|shape-[\w.-]+|order-\w+)\.csv$")
+
+def is_variant(csv_path):
+    """Only the main <kernel>.csv of each kernel is compared."""
+    return VARIANT_PATTERN.search(csv_path) is not None
+
 def get_optype_dirs(timings_dir):
+    if has_store(os.path.dirname(timings_dir)):
+        return [os.path.join(timings_dir, op_type) for op_type in op_types(os.path.dirname(timings_dir))]
     return [d for d in glob.glob(os.path.join(timings_dir, "*/")) if os.path.isdir(d)]
 
 def load_optype_data(timings_dir, op_type, metric):
+    stored = kernel_averages(os.path.dirname(timings_dir), metric)
+    if stored is not None:
+        return stored[stored["op_type"] == op_type][["operator", metric, "invalid"]]
+
     op_path = os.path.join(timings_dir, op_type)
     if not os.path.isdir(op_path):
         return pd.DataFrame()
 
     data = []
     for csv_path in glob.glob(os.path.join(op_path, "*.csv")):
+        if is_variant(csv_path):
+            continue
         df = pd.read_csv(csv_path)
         if metric not in df.columns:
             continue
         avg_value = df[metric].mean()
-        data.append({"operator": os.path.splitext(os.path.basename(csv_path))[0], metric: avg_value})
+        # Kernels which failed --verify-against carry verified = 0
+        invalid = "verified" in df.columns and (df["verified"] < 1).any()
+        data.append({"operator": os.path.splitext(os.path.basename(csv_path))[0], metric: avg_value, "invalid": invalid})
     return pd.DataFrame(data)
 
 def plot_within_optype(op_type, df1, df2, metric, labels, save_path):
@@ -51,9 +70,16 @@ def plot_within_optype(op_type, df1, df2, metric, labels, save_path):
 
     plt.figure(figsize=(10, 6))
     plt.bar([i - width/2 for i in x], merged[f"{metric}_v1"], width=width, label=labels[0])
-    plt.bar([i + width/2 for i in x], merged[f"{metric}_v2"], width=width, label=labels[1])
-
-    plt.xticks(x, merged["operator"], rotation=45, ha="right")
+    bars = plt.bar([i + width/2 for i in x], merged[f"{metric}_v2"], width=width, label=labels[1])
+
+    # A speedup of a miscompiled kernel means nothing, flag it
+    invalid = merged["invalid_v1"] | merged["invalid_v2"]
+    for bar, flagged in zip(bars, invalid):
+        if flagged:
+            bar.set_hatch("//")
+            bar.set_edgecolor("red")
+    tick_labels = [f"{op} (invalid)" if flagged else op for op, flagged in zip(merged["operator"], invalid)]
+    plt.xticks(x, tick_labels, rotation=45, ha="right")
     plt.ylabel(f"Average {metric}")
     plt.title(f"Intra-OpType Comparison for '{op_type}' ({metric})")
     plt.legend()
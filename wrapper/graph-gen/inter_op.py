@@ -3,6 +3,7 @@ import os
 import pandas as pd
 import matplotlib.pyplot as plt
 import argparse
+from results_store import kernel_averages, output_dir_of
 
 def parse_args():
     parser = argparse.ArgumentParser(description="Compare perf metrics within each op_type.")
@@ -14,10 +15,15 @@ def parse_args():
 args = parse_args()
 TIMING_DIR = args.timing_dir
 METRIC = args.metric
+# results.sqlite of the run, None for CSV-only outputs
+STORED = kernel_averages(output_dir_of(TIMING_DIR), METRIC)
 
 
 def load_data(op_type):
     """Load all CSVs for a specific op_type."""
+    if STORED is not None:
+        return STORED[STORED["op_type"] == op_type][["operator", METRIC]]
+
     op_path = os.path.join(TIMING_DIR, op_type)
     if not os.path.isdir(op_path):
         print(f"No directory found for {op_type}")
@@ -56,7 +62,10 @@ def plot_within_optype(op_type, df):
     plt.show()
 
 def main():
-    op_types = [d for d in os.listdir(TIMING_DIR) if os.path.isdir(os.path.join(TIMING_DIR, d))]
+    if STORED is not None:
+        op_types = sorted(STORED["op_type"].unique())
+    else:
+        op_types = [d for d in os.listdir(TIMING_DIR) if os.path.isdir(os.path.join(TIMING_DIR, d))]
     for op_type in op_types:
         df = load_data(op_type)
         if df.empty:
@@ -3,6 +3,7 @@ import os
 import argparse
 import pandas as pd
 import matplotlib.pyplot as plt
+from results_store import kernel_averages, output_dir_of
 
 def parse_args():
     parser = argparse.ArgumentParser(description="Analyze perf timing CSVs by op_type.")
@@ -21,6 +22,10 @@ def parse_args():
     return parser.parse_args()
 
 def load_data(timing_dir, metric):
+    stored = kernel_averages(output_dir_of(timing_dir), metric)
+    if stored is not None:
+        return stored.rename(columns={"operator": "file"})[["op_type", "file", metric]]
+
     data = []
     for op_type in os.listdir(timing_dir):
         op_path = os.path.join(timing_dir, op_type)
@@ -0,0 +1,77 @@
+#!/usr/bin/env python3
+import os
+import glob
+import argparse
+import numpy as np
+import pandas as pd
+import matplotlib.pyplot as plt
+
+LEVELS = ["l1", "l2", "llc", "dram", "remote_dram", "other"]
+
+def parse_args():
+    parser = argparse.ArgumentParser(description="Compare the load latency histograms of `--profile latency` runs per kernel, one panel per pipeline.")
+    parser.add_argument("--output-dirs", type=str, nargs="+", required=True, help="Benchmark output directories run with --profile latency, e.g. one per pipeline.")
+    parser.add_argument("--labels", type=str, nargs="*", default=None, help="Titles for the output directories (default: directory names).")
+    parser.add_argument("--kernels", type=str, nargs="*", default=None, help="Only plot kernels whose file name contains one of these strings.")
+    parser.add_argument("--graphs-dir", type=str, default="graphs/latency", help="Folder to save generated graphs.")
+    return parser.parse_args()
+
+def ensure_dir(path):
+    os.makedirs(path, exist_ok=True)
+
+def find_histograms(output_dir):
+    """Kernel name -> <kernel>.latency.csv below the output directory."""
+    histograms = {}
+    for path in glob.glob(os.path.join(output_dir, "**", "*.latency.csv"), recursive=True):
+        op_type = os.path.basename(os.path.dirname(path))
+        kernel = os.path.basename(path)[:-len(".latency.csv")]
+        histograms[f"{op_type}/{kernel}"] = path
+    return histograms
+
+def plot_kernel(kernel, frames, save_path):
+    """Stacked bars of loads per latency bucket, split by the level that served them."""
+    fig, axes = plt.subplots(1, len(frames), figsize=(6 * len(frames), 5), sharey=True, squeeze=False)
+    for ax, (label, df) in zip(axes[0], frames):
+        x = np.arange(len(df))
+        bottom = np.zeros(len(df))
+        for level in LEVELS:
+            share = df[level] / max(df["loads"].sum(), 1)
+            ax.bar(x, share, bottom=bottom, label=level)
+            bottom += share
+        ax.set_xticks(x)
+        ax.set_xticklabels([f"{lo}-{hi}" for lo, hi in zip(df["latency_min"], df["latency_max"])], rotation=60, fontsize=7)
+        dram = df[["dram", "remote_dram"]].to_numpy().sum() / max(df["loads"].sum(), 1)
+        ax.set_title(f"{label} ({dram * 100:.1f}% from DRAM)")
+        ax.set_xlabel("Load latency (cycles)")
+    axes[0][0].set_ylabel("Share of sampled loads")
+    axes[0][-1].legend(fontsize=8)
+    fig.suptitle(kernel)
+    fig.tight_layout()
+    fig.savefig(save_path, dpi=300)
+    plt.close(fig)
+    print(f"✅ Saved latency histogram for {kernel} → {save_path}")
+
+def main():
+    args = parse_args()
+    ensure_dir(args.graphs_dir)
+
+    runs = []
+    for i, output_dir in enumerate(args.output_dirs):
+        label = args.labels[i] if args.labels and i < len(args.labels) else os.path.basename(os.path.normpath(output_dir))
+        histograms = find_histograms(output_dir)
+        if not histograms:
+            print(f"⚠️ Skipping {output_dir}: no .latency.csv files (run with --profile latency)")
+            continue
+        runs.append((label, histograms))
+
+    kernels = sorted(set().union(*(histograms.keys() for _, histograms in runs))) if runs else []
+    for kernel in kernels:
+        if args.kernels and not any(k in kernel for k in args.kernels):
+            continue
+        frames = [(label, pd.read_csv(histograms[kernel])) for label, histograms in runs if kernel in histograms]
+        frames = [(label, df) for label, df in frames if not df.empty]
+        if frames:
+            plot_kernel(kernel, frames, os.path.join(args.graphs_dir, kernel.replace("/", "_") + ".png"))
+
+if __name__ == "__main__":
+    main()
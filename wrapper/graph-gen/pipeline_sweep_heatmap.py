@@ -0,0 +1,107 @@
+#!/usr/bin/env python3
+import os
+import argparse
+import numpy as np
+import pandas as pd
+import matplotlib.pyplot as plt
+
+FIXED_COLUMNS = ["op_type", "kernel", "multiplicity", "pipeline", "metric", "value", "relative_to_primary"]
+
+def parse_args():
+    parser = argparse.ArgumentParser(description="Plot the primary metric of a --pipeline-sweep run over its template parameters, one graph per op type.")
+    parser.add_argument("--output-dir", type=str, required=True, help="Benchmark output directory run with --pipeline-sweep.")
+    parser.add_argument("--x", type=str, default=None, help="Parameter on the x axis (default: the first one).")
+    parser.add_argument("--y", type=str, default=None, help="Parameter on the y axis (default: the second one, if any).")
+    parser.add_argument("--relative", action="store_true", help="Plot the metric relative to the primary --pipeline instead of its value.")
+    parser.add_argument("--graphs-dir", type=str, default="graphs/pipeline_sweep", help="Folder to save generated graphs.")
+    return parser.parse_args()
+
+def ensure_dir(path):
+    os.makedirs(path, exist_ok=True)
+
+def sort_key(value):
+    """Numeric parameter values in numeric order, the others as text."""
+    try:
+        return (0, float(value), "")
+    except ValueError:
+        return (1, 0.0, str(value))
+
+def op_totals(df, parameters, relative):
+    """Occurrence weighted metric of every op type and grid point, or its ratio to the primary --pipeline's."""
+    df = df.assign(weighted=df["value"] * df["multiplicity"],
+                   primary=df["value"] / df["relative_to_primary"].replace(0, np.nan) * df["multiplicity"])
+    totals = df.groupby(["op_type", "pipeline"] + parameters, as_index=False)[["weighted", "primary"]].sum()
+    if relative:
+        totals["weighted"] = totals["weighted"] / totals["primary"]
+    return totals.drop(columns="primary")
+
+def plot_line(op_type, df, x, label, save_path):
+    best = df.groupby(x)["weighted"].min()
+    order = sorted(best.index, key=sort_key)
+    fig, ax = plt.subplots(figsize=(7, 4))
+    ax.plot([str(v) for v in order], [best[v] for v in order], marker="o")
+    ax.set_xlabel(x)
+    ax.set_ylabel(label)
+    ax.set_title(op_type)
+    fig.tight_layout()
+    fig.savefig(save_path, dpi=300)
+    plt.close(fig)
+    print(f"✅ Saved sweep of {op_type} → {save_path}")
+
+def plot_heatmap(op_type, df, x, y, label, save_path):
+    """Best value over the other parameters at every (x, y)."""
+    grid = df.groupby([y, x])["weighted"].min().unstack(x)
+    grid = grid.reindex(index=sorted(grid.index, key=sort_key), columns=sorted(grid.columns, key=sort_key))
+    fig, ax = plt.subplots(figsize=(1.2 * len(grid.columns) + 3, 0.8 * len(grid.index) + 2))
+    image = ax.imshow(grid.to_numpy(dtype=float), cmap="viridis_r", aspect="auto")
+    ax.set_xticks(range(len(grid.columns)))
+    ax.set_xticklabels([str(v) for v in grid.columns], rotation=45)
+    ax.set_yticks(range(len(grid.index)))
+    ax.set_yticklabels([str(v) for v in grid.index])
+    for i in range(len(grid.index)):
+        for j in range(len(grid.columns)):
+            value = grid.iat[i, j]
+            if not np.isnan(value):
+                ax.text(j, i, f"{value:.3g}", ha="center", va="center", color="white", fontsize=7)
+    ax.set_xlabel(x)
+    ax.set_ylabel(y)
+    ax.set_title(op_type)
+    fig.colorbar(image, ax=ax, label=label)
+    fig.tight_layout()
+    fig.savefig(save_path, dpi=300)
+    plt.close(fig)
+    print(f"✅ Saved heatmap of {op_type} → {save_path}")
+
+def main():
+    args = parse_args()
+    ensure_dir(args.graphs_dir)
+
+    csv_path = os.path.join(args.output_dir, "pipeline_sweep.csv")
+    if not os.path.exists(csv_path):
+        print(f"⚠️ No pipeline_sweep.csv in {args.output_dir} (run with --pipeline-sweep)")
+        return
+    df = pd.read_csv(csv_path, dtype={"pipeline": str})
+    if df.empty:
+        print(f"⚠️ {csv_path} has no measured kernels")
+        return
+
+    parameters = [c for c in df.columns if c not in FIXED_COLUMNS]
+    if not parameters:
+        print(f"⚠️ {csv_path} has no swept parameters")
+        return
+    for c in parameters:
+        df[c] = df[c].astype(str)
+    x = args.x or parameters[0]
+    y = args.y or (next((p for p in parameters if p != x), None))
+    label = f"{df['metric'].iloc[0]} relative to primary" if args.relative else df["metric"].iloc[0]
+
+    totals = op_totals(df, parameters, args.relative)
+    for op_type, op_df in totals.groupby("op_type"):
+        save_path = os.path.join(args.graphs_dir, f"{op_type}.png")
+        if y is None:
+            plot_line(op_type, op_df, x, label, save_path)
+        else:
+            plot_heatmap(op_type, op_df, x, y, label, save_path)
+
+if __name__ == "__main__":
+    main()
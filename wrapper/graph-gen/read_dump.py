@@ -0,0 +1,58 @@
+#!/usr/bin/env python3
+import os
+import io
+import gzip
+import json
+import argparse
+import subprocess
+import numpy as np
+
+
+def parse_args():
+    parser = argparse.ArgumentParser(description="Summarise a binary run log (<kernel>.tensors/) written by --output-logs.")
+    parser.add_argument("dump_dir", type=str, help="Path to a <kernel>.tensors directory")
+    parser.add_argument("--tensor", type=str, default=None, help="Only show this tensor (e.g. input0, output0)")
+    parser.add_argument("--print-elements", type=int, default=0, help="Print the first N elements of each tensor")
+    return parser.parse_args()
+
+
+def read_bytes(path):
+    """Raw .npy bytes, decompressing .gz / .zst dumps."""
+    if path.endswith(".gz"):
+        with gzip.open(path, "rb") as f:
+            return f.read()
+    if path.endswith(".zst"):
+        return subprocess.run(["zstd", "-dc", path], check=True, capture_output=True).stdout
+    with open(path, "rb") as f:
+        return f.read()
+
+
+def load_tensor(dump_dir, entry):
+    array = np.load(io.BytesIO(read_bytes(os.path.join(dump_dir, entry["file"]))))
+    # bf16 is stored as its raw bits, widen to float32
+    if entry["dtype"] == "bf16":
+        array = (array.astype(np.uint32) << 16).view(np.float32)
+    return array
+
+
+def main():
+    args = parse_args()
+    with open(os.path.join(args.dump_dir, "manifest.json")) as f:
+        manifest = json.load(f)
+
+    print(f"Kernel: {manifest['kernel']} ({manifest['compression']})")
+    for entry in manifest["tensors"]:
+        if args.tensor and entry["name"] != args.tensor:
+            continue
+
+        array = load_tensor(args.dump_dir, entry)
+        values = array.astype(np.float64) if array.size else np.zeros(1)
+        print(f"{entry['name']:>10}: {entry['dtype']} {tuple(entry['shape'])} "
+              f"strides={tuple(entry['strides'])} offset={entry['offset']}  "
+              f"min={values.min():.6g} max={values.max():.6g} mean={values.mean():.6g}")
+        if args.print_elements:
+            print("            ", array.reshape(-1)[:args.print_elements])
+
+
+if __name__ == "__main__":
+    main()
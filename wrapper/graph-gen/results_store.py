@@ -0,0 +1,57 @@
+#!/usr/bin/env python3
+"""Reads the main samples of a run back from its results.sqlite (see include/results_store.h)."""
+import json
+import os
+import sqlite3
+import pandas as pd
+
+def store_path(output_dir):
+    return os.path.join(output_dir, "results.sqlite")
+
+def has_store(output_dir):
+    return os.path.isfile(store_path(output_dir))
+
+def output_dir_of(timings_dir):
+    """Scripts taking --timings-dir find the store one level up."""
+    return os.path.dirname(os.path.normpath(timings_dir))
+
+def op_types(output_dir):
+    """Op types with stored samples, sorted."""
+    with sqlite3.connect(f"file:{store_path(output_dir)}?mode=ro", uri=True) as db:
+        return [row[0] for row in db.execute("SELECT DISTINCT op_type FROM kernels ORDER BY op_type")]
+
+def kernel_averages(output_dir, metric):
+    """
+    One row per kernel occurrence (op_type, operator, <metric>, invalid), like one
+    timings CSV per kernel: the primary pipeline's main samples from the latest run
+    that measured the kernel, without --outlier-rejection's rejected samples,
+    repeated for each of its deduplicated copies.
+    None if the run has no store.
+    """
+    if not has_store(output_dir):
+        return None
+    with sqlite3.connect(f"file:{store_path(output_dir)}?mode=ro", uri=True) as db:
+        samples = pd.read_sql_query(
+            "SELECT s.run, s.op_type, s.kernel, s.metric, s.value FROM samples s "
+            "JOIN runs r ON r.run = s.run AND r.primary_pipeline = s.pipeline "
+            "WHERE s.variant = '' AND s.metric IN (?, 'verified') AND s.run = "
+            "(SELECT MAX(run) FROM samples l WHERE l.op_type = s.op_type AND "
+            "l.kernel = s.kernel AND l.variant = '') AND NOT EXISTS (SELECT 1 FROM "
+            "rejected x WHERE x.run = s.run AND x.pipeline = s.pipeline AND "
+            "x.op_type = s.op_type AND x.kernel = s.kernel AND x.variant = '' AND "
+            "x.sample = s.sample)", db, params=(metric,))
+        kernels = pd.read_sql_query("SELECT run, op_type, kernel, duplicates FROM kernels", db)
+
+    data = []
+    for (run, op_type, kernel), rows in samples.groupby(["run", "op_type", "kernel"]):
+        values = rows[rows["metric"] == metric]["value"]
+        if values.empty:
+            continue
+        verified = rows[rows["metric"] == "verified"]["value"]
+        invalid = bool((verified < 1).any())
+        duplicates = kernels[(kernels["run"] == run) & (kernels["op_type"] == op_type) &
+                             (kernels["kernel"] == kernel)]["duplicates"]
+        names = [kernel] + (json.loads(duplicates.iloc[0]) if not duplicates.empty else [])
+        for name in names:
+            data.append({"op_type": op_type, "operator": name, metric: values.mean(), "invalid": invalid})
+    return pd.DataFrame(data, columns=["op_type", "operator", metric, "invalid"])
@@ -0,0 +1,65 @@
+#!/usr/bin/env python3
+import os
+import json
+import argparse
+import numpy as np
+import pandas as pd
+import matplotlib.pyplot as plt
+
+def parse_args():
+    parser = argparse.ArgumentParser(description="Plot the kernels of one or more runs on a roofline chart, one chart per pipeline.")
+    parser.add_argument("--output-dirs", type=str, nargs="+", required=True, help="Benchmark output directories after `WrapperModule roofline` (each contains roofline.csv and machine_peaks.json).")
+    parser.add_argument("--labels", type=str, nargs="*", default=None, help="Titles for the output directories (default: directory names).")
+    parser.add_argument("--annotate", type=int, default=5, help="Number of kernels farthest from the roof to label.")
+    parser.add_argument("--graphs-dir", type=str, default="graphs/roofline", help="Folder to save generated graphs.")
+    return parser.parse_args()
+
+def ensure_dir(path):
+    os.makedirs(path, exist_ok=True)
+
+def plot_roofline(df, peaks, title, annotate, save_path):
+    """Kernels as points under min(peak compute, intensity * peak bandwidth), coloured by op type."""
+    intensity = np.logspace(np.log10(max(df["arith_intensity"].min() / 4, 1e-3)), np.log10(max(df["arith_intensity"].max() * 4, peaks["ridge_point"] * 4)), 200)
+    roof = np.minimum(peaks["gflops"], intensity * peaks["bandwidth_gbs"])
+
+    plt.figure(figsize=(10, 6))
+    plt.plot(intensity, roof, color="k", linewidth=2, label=f"roof ({peaks['gflops']:.0f} GFLOP/s, {peaks['bandwidth_gbs']:.0f} GB/s)")
+    plt.axvline(peaks["ridge_point"], color="k", linestyle=":", linewidth=1)
+    for op_type, odf in df.groupby("op_type"):
+        plt.scatter(odf["arith_intensity"], odf["gflops"], alpha=0.7, label=op_type)
+
+    # roofline.csv is sorted farthest from the roof first
+    for _, row in df.head(annotate).iterrows():
+        plt.annotate(f"{row['kernel']} ({row['percent_of_peak']:.0f}%)", (row["arith_intensity"], row["gflops"]), fontsize=7, xytext=(4, -8), textcoords="offset points")
+
+    plt.xscale("log")
+    plt.yscale("log")
+    plt.xlabel("Arithmetic intensity (FLOP/byte)")
+    plt.ylabel("GFLOP/s")
+    plt.title(f"Roofline: {title}")
+    plt.legend(fontsize=8)
+    plt.tight_layout()
+    plt.savefig(save_path, dpi=300)
+    plt.close()
+    print(f"✅ Saved roofline for {title} → {save_path}")
+
+def main():
+    args = parse_args()
+    ensure_dir(args.graphs_dir)
+
+    for i, output_dir in enumerate(args.output_dirs):
+        csv_path = os.path.join(output_dir, "roofline.csv")
+        peaks_path = os.path.join(output_dir, "machine_peaks.json")
+        if not os.path.isfile(csv_path) or not os.path.isfile(peaks_path):
+            print(f"⚠️ Skipping {output_dir}: run `WrapperModule roofline {output_dir}` first")
+            continue
+        df = pd.read_csv(csv_path)
+        if df.empty:
+            continue
+        with open(peaks_path) as f:
+            peaks = json.load(f)
+        title = args.labels[i] if args.labels and i < len(args.labels) else os.path.basename(os.path.normpath(output_dir))
+        plot_roofline(df, peaks, title, args.annotate, os.path.join(args.graphs_dir, f"{title}_roofline.png"))
+
+if __name__ == "__main__":
+    main()
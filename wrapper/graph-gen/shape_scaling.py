@@ -0,0 +1,72 @@
+#!/usr/bin/env python3
+import os
+import argparse
+import pandas as pd
+import matplotlib.pyplot as plt
+
+def parse_args():
+    parser = argparse.ArgumentParser(description="Plot shape scaling curves and per-element cost from a --shape-sweep run.")
+    parser.add_argument("--output-dir", type=str, required=True, help="Benchmark output directory (contains shape_scaling.csv).")
+    parser.add_argument("--graphs-dir", type=str, default="graphs/shape_scaling", help="Folder to save generated graphs.")
+    parser.add_argument("--top", type=int, default=8, help="Kernels per op type plotted (heaviest at model shapes first).")
+    return parser.parse_args()
+
+def ensure_dir(path):
+    os.makedirs(path, exist_ok=True)
+
+def load_scaling(output_dir):
+    csv_path = os.path.join(output_dir, "shape_scaling.csv")
+    if not os.path.isfile(csv_path):
+        raise FileNotFoundError(f"Missing shape_scaling.csv in: {output_dir}")
+    return pd.read_csv(csv_path)
+
+def plot_op_type(df, op_type, top, save_path):
+    """Metric and relative per-element cost against the input size, one line per kernel and axis."""
+    base = df[df["variant"] == "model"].sort_values("value", ascending=False)
+    kernels = base["kernel"].head(top).tolist()
+    metric = df["metric"].iloc[0]
+
+    fig, (ax_value, ax_cost) = plt.subplots(1, 2, figsize=(14, 6))
+    for kernel in kernels:
+        kdf = df[df["kernel"] == kernel]
+        model = kdf[kdf["variant"] == "model"]
+        for axis, adf in (("batch", kdf[kdf["spatial_scale"] == 1]), ("hw", kdf[kdf["batch_scale"] == 1])):
+            adf = adf.sort_values("input_elements")
+            if len(adf) < 2 and adf.equals(model):
+                continue
+            style = "-" if axis == "batch" else "--"
+            ax_value.plot(adf["input_elements"], adf["value"], style, marker="o", label=f"{kernel} ({axis})")
+            ax_cost.plot(adf["input_elements"], adf["relative_per_element"], style, marker="o", label=f"{kernel} ({axis})")
+
+    ax_value.set_xscale("log", base=2)
+    ax_value.set_yscale("log", base=2)
+    ax_value.set_xlabel("Input elements")
+    ax_value.set_ylabel(metric)
+    ax_value.set_title(f"{op_type}: {metric} vs input size")
+
+    ax_cost.axhline(1.0, color="k", linestyle=":")
+    ax_cost.set_xscale("log", base=2)
+    ax_cost.set_xlabel("Input elements")
+    ax_cost.set_ylabel("Per-element cost relative to model shapes")
+    ax_cost.set_title(f"{op_type}: per-element cost")
+    ax_cost.legend(fontsize="small")
+
+    plt.tight_layout()
+    plt.savefig(save_path, dpi=300)
+    plt.close()
+    print(f"✅ Saved shape scaling graph for {op_type} → {save_path}")
+
+def main():
+    args = parse_args()
+    ensure_dir(args.graphs_dir)
+
+    df = load_scaling(args.output_dir)
+    if df.empty:
+        print("❌ Error: shape_scaling.csv is empty.")
+        return
+
+    for op_type, odf in df.groupby("op_type"):
+        plot_op_type(odf, op_type, args.top, os.path.join(args.graphs_dir, f"{op_type}_shape_scaling.png"))
+
+if __name__ == "__main__":
+    main()
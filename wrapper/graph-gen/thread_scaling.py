@@ -0,0 +1,89 @@
+#!/usr/bin/env python3
+import os
+import argparse
+import pandas as pd
+import matplotlib.pyplot as plt
+
+def parse_args():
+    parser = argparse.ArgumentParser(description="Plot speedup and parallel efficiency curves from a --thread-sweep run.")
+    parser.add_argument("--output-dir", type=str, required=True, help="Benchmark output directory (contains thread_scaling.csv).")
+    parser.add_argument("--graphs-dir", type=str, default="graphs/thread_scaling", help="Folder to save generated graphs.")
+    parser.add_argument("--top", type=int, default=8, help="Kernels per op type plotted individually (slowest single thread first).")
+    return parser.parse_args()
+
+def ensure_dir(path):
+    os.makedirs(path, exist_ok=True)
+
+def load_scaling(output_dir):
+    csv_path = os.path.join(output_dir, "thread_scaling.csv")
+    if not os.path.isfile(csv_path):
+        raise FileNotFoundError(f"Missing thread_scaling.csv in: {output_dir}")
+    return pd.read_csv(csv_path)
+
+def plot_op_type(df, op_type, top, save_path):
+    """Speedup and efficiency of the heaviest kernels of one op type."""
+    base = df[df["threads"] == df["threads"].min()].sort_values("seconds", ascending=False)
+    kernels = base["kernel"].head(top).tolist()
+    threads = sorted(df["threads"].unique())
+
+    fig, (ax_speedup, ax_efficiency) = plt.subplots(1, 2, figsize=(14, 6))
+    for kernel in kernels:
+        kdf = df[df["kernel"] == kernel].sort_values("threads")
+        ax_speedup.plot(kdf["threads"], kdf["speedup"], marker="o", label=kernel)
+        ax_efficiency.plot(kdf["threads"], kdf["efficiency"], marker="o", label=kernel)
+
+    ax_speedup.plot(threads, [t / threads[0] for t in threads], "k--", label="ideal")
+    ax_speedup.set_xscale("log", base=2)
+    ax_speedup.set_yscale("log", base=2)
+    ax_speedup.set_xlabel("Threads")
+    ax_speedup.set_ylabel("Speedup")
+    ax_speedup.set_title(f"{op_type}: speedup")
+
+    ax_efficiency.axhline(1.0, color="k", linestyle="--")
+    ax_efficiency.set_xscale("log", base=2)
+    ax_efficiency.set_ylim(0, 1.1)
+    ax_efficiency.set_xlabel("Threads")
+    ax_efficiency.set_ylabel("Parallel efficiency")
+    ax_efficiency.set_title(f"{op_type}: efficiency")
+    ax_efficiency.legend(fontsize="small")
+
+    plt.tight_layout()
+    plt.savefig(save_path, dpi=300)
+    plt.close()
+    print(f"✅ Saved scaling graph for {op_type} → {save_path}")
+
+def plot_summary(df, save_path):
+    """Median speedup over the kernels of each op type."""
+    summary = df.groupby(["op_type", "threads"])["speedup"].median().reset_index()
+    threads = sorted(df["threads"].unique())
+
+    plt.figure(figsize=(10, 6))
+    for op_type, odf in summary.groupby("op_type"):
+        plt.plot(odf["threads"], odf["speedup"], marker="o", label=op_type)
+    plt.plot(threads, [t / threads[0] for t in threads], "k--", label="ideal")
+    plt.xscale("log", base=2)
+    plt.yscale("log", base=2)
+    plt.xlabel("Threads")
+    plt.ylabel("Median speedup")
+    plt.title("Thread Scaling per OpType")
+    plt.legend()
+    plt.tight_layout()
+    plt.savefig(save_path, dpi=300)
+    plt.close()
+    print(f"✅ Saved scaling summary → {save_path}")
+
+def main():
+    args = parse_args()
+    ensure_dir(args.graphs_dir)
+
+    df = load_scaling(args.output_dir)
+    if df.empty:
+        print("❌ Error: thread_scaling.csv is empty.")
+        return
+
+    for op_type, odf in df.groupby("op_type"):
+        plot_op_type(odf, op_type, args.top, os.path.join(args.graphs_dir, f"{op_type}_scaling.png"))
+    plot_summary(df, os.path.join(args.graphs_dir, "optype_scaling.png"))
+
+if __name__ == "__main__":
+    main()
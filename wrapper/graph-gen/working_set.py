@@ -0,0 +1,69 @@
+#!/usr/bin/env python3
+import os
+import argparse
+import pandas as pd
+import matplotlib.pyplot as plt
+
+def parse_args():
+    parser = argparse.ArgumentParser(description="Plot throughput against working-set size from --working-set-sweep runs, one line per pipeline.")
+    parser.add_argument("--output-dirs", type=str, nargs="+", required=True, help="Benchmark output directories (each contains working_set.csv), e.g. one per pipeline.")
+    parser.add_argument("--labels", type=str, nargs="*", default=None, help="Legend labels for the output directories (default: directory names).")
+    parser.add_argument("--graphs-dir", type=str, default="graphs/working_set", help="Folder to save generated graphs.")
+    return parser.parse_args()
+
+def ensure_dir(path):
+    os.makedirs(path, exist_ok=True)
+
+def load_runs(output_dirs, labels):
+    frames = []
+    for i, output_dir in enumerate(output_dirs):
+        csv_path = os.path.join(output_dir, "working_set.csv")
+        if not os.path.isfile(csv_path):
+            print(f"⚠️ Skipping {output_dir}: no working_set.csv")
+            continue
+        df = pd.read_csv(csv_path)
+        df["pipeline"] = labels[i] if labels and i < len(labels) else os.path.basename(os.path.normpath(output_dir))
+        frames.append(df)
+    return pd.concat(frames, ignore_index=True) if frames else pd.DataFrame()
+
+def plot_op_type(df, op_type, save_path):
+    """Median throughput per working-set bucket and pipeline, cache sizes as vertical lines."""
+    use_gbs = df["gb_per_s"].notna().any()
+    column = "gb_per_s" if use_gbs else "value"
+    ylabel = "GB/s (working set / seconds)" if use_gbs else df["metric"].iloc[0]
+
+    plt.figure(figsize=(10, 6))
+    for pipeline, pdf in df.groupby("pipeline"):
+        points = pdf.dropna(subset=[column]).sort_values("working_set_bytes")
+        plt.plot(points["working_set_bytes"], points[column], marker="o", linestyle="", alpha=0.6, label=pipeline)
+        trend = points.groupby("working_set_bytes")[column].median().rolling(3, min_periods=1, center=True).median()
+        plt.plot(trend.index, trend.values, linewidth=1.5)
+
+    for level, cache in df[df["cache_level"] > 0].groupby("cache_level")["cache_bytes"].first().items():
+        plt.axvline(cache, color="k", linestyle=":", linewidth=1)
+        plt.text(cache, plt.ylim()[1], f" L{level}", va="top")
+
+    plt.xscale("log", base=2)
+    plt.xlabel("Working set (bytes)")
+    plt.ylabel(ylabel)
+    plt.title(f"{op_type}: throughput vs working set")
+    plt.legend()
+    plt.tight_layout()
+    plt.savefig(save_path, dpi=300)
+    plt.close()
+    print(f"✅ Saved working-set graph for {op_type} → {save_path}")
+
+def main():
+    args = parse_args()
+    ensure_dir(args.graphs_dir)
+
+    df = load_runs(args.output_dirs, args.labels)
+    if df.empty:
+        print("❌ Error: no working_set.csv found.")
+        return
+
+    for op_type, odf in df.groupby("op_type"):
+        plot_op_type(odf, op_type, os.path.join(args.graphs_dir, f"{op_type}_working_set.png"))
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "command_manager.h"
+#include "tensor_fuzzer.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+/*
+ * Activation statistics of a real model run (FROM_STATS inputs)
+ *
+ * activation_stats.py runs the PyTorch model once under a TorchDispatchMode
+ * and records every aten call with the shape, zero fraction, mean/std, range
+ * and histogram of each tensor operand:
+ *    { "records": [ { "op": "convolution",
+ *                     "args": [ { "shape": [1, 64, 55, 55], ... }, ...] } ] }
+ *
+ * Every isolated kernel is matched on its op type, its argument shapes and
+ * its occurrence: the n-th kernel of an op and shapes in model order (see
+ * model_layers.h) gets the n-th recorded call of them, so repeated layers
+ * keep their own statistics. The record is written next to its metadata as
+ * <kernel>.mlir.stats.json. Kernels without a matching call get no stats
+ * file, with a warning.
+ */
+class ActivationStats {
+public:
+  /*
+   * Runs the recording script in the embedded interpreter. model is
+   * "module:callable" returning the nn.Module, input_shape "1,3,224,224".
+   */
+  static bool record(const fs::path &script, const std::string &model,
+                     const std::string &input_shape,
+                     const fs::path &stats_filepath);
+
+  // Writes the stats file of every matched task, returns the match count
+  static size_t attach(const fs::path &stats_filepath,
+                       const std::vector<KernelTask> &tasks);
+
+  // <kernel>.mlir.stats.json next to <kernel>.mlir.json
+  static fs::path kernel_stats_filepath(const fs::path &json_filepath);
+
+  // Per argument statistics of a kernel, nullptr for unrecorded arguments
+  static std::vector<std::shared_ptr<const TensorStats>>
+  load(const fs::path &json_filepath);
+};
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "utils.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/*
+ * Heap usage of a counter window
+ *
+ * peak_live_bytes is relative to the live heap at the start of the window,
+ * so buffers returned by earlier samples don't count.
+ */
+struct AllocationStats {
+  uint64_t allocations = 0;
+  uint64_t frees = 0;
+  uint64_t bytes_allocated = 0;
+  uint64_t peak_live_bytes = 0;
+};
+
+/*
+ * Kernel allocation instrumentation
+ *
+ * instrument_ll() redirects the kernel's malloc, aligned_alloc and free calls
+ * (memref.alloc / memref.dealloc after finalize-memref-to-llvm) to forwarders
+ * appended to the .ll. The forwarders call through a hook table,
+ *
+ *    [3 x ptr] mlir_bench_alloc_hooks = { malloc, aligned_alloc, free }
+ *
+ * which install() points at the counting functions below once the kernel is
+ * loaded. Until then, the forwarders call libc directly. Harness allocations
+ * are never counted, only the ones made by kernel code.
+ */
+class AllocationTracker {
+public:
+  static const char *HOOK_TABLE_SYMBOL;
+
+  // Returns false (leaving the file untouched) if nothing was instrumented
+  static bool instrument_ll(const fs::path &ll_filepath);
+
+  // Fills a mlir_bench_alloc_hooks table resolved from a loaded kernel
+  static void install(void *hook_table);
+
+  // Starts a new window: counters are cleared, the live heap is the baseline
+  static void begin_window();
+  static AllocationStats window_stats();
+
+  // Frees a buffer the kernel allocated through the hooks (e.g. a returned
+  // result), keeping the live heap balanced
+  static void release(void *ptr);
+
+private:
+  static void *tracked_malloc(size_t size);
+  static void *tracked_aligned_alloc(size_t alignment, size_t size);
+  static void tracked_free(void *ptr);
+  static void record_allocation(void *ptr, size_t size);
+
+  static std::atomic<uint64_t> allocations;
+  static std::atomic<uint64_t> frees;
+  static std::atomic<uint64_t> bytes_allocated;
+  static std::atomic<int64_t> live_bytes;
+  static std::atomic<int64_t> window_base_live_bytes;
+  static std::atomic<int64_t> peak_live_bytes;
+};
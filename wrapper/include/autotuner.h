@@ -0,0 +1,95 @@
+#pragma once
+
+#include "command_manager.h"
+#include "nlohmann/json.hpp"
+#include "pipeline_template.h"
+
+#include <filesystem>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+using json = nlohmann::json;
+
+enum class TuneScope { OP_TYPE, KERNEL };
+enum class TuneSearch { RANDOM, BAYESIAN };
+
+struct AutotuneConfig {
+  fs::path template_json;
+  TuneScope scope = TuneScope::OP_TYPE;
+  TuneSearch search = TuneSearch::BAYESIAN;
+  unsigned int trials = 30;        // candidates per scope, baseline excluded
+  unsigned int samples = 5;        // samples of a full measurement
+  unsigned int probe_samples = 2;  // samples deciding on early stopping
+  double early_stop = 1.2;         // stop candidates this much slower
+  unsigned int jobs = 1;
+  int measure_cpu = -1;
+  uint64_t seed = 1;
+};
+
+/*
+ * Pipeline autotuning (--autotune <template.json>)
+ *
+ * The template format is described in pipeline_template.h. Each scope (op
+ * type, or kernel) is measured under the primary --pipeline first, then
+ * under `trials` candidates drawn at random or by a tree-structured Parzen
+ * estimator: after the random startup trials, the observed candidates are
+ * split into the best quarter and the rest, and the next candidate is the
+ * one of 24 draws from the best quarter's per parameter frequencies that
+ * maximises the good over bad likelihood ratio.
+ *
+ * Candidates are probed with `probe_samples` samples per kernel first and
+ * abandoned once their running cost exceeds early_stop x the best cost seen.
+ * Identical candidates are measured once, compilation goes through the
+ * compile cache.
+ *
+ * Output in <output-dir>/autotune/:
+ *    trials.csv          every candidate: scope, parameters, status, cost
+ *    summary.csv         baseline and best cost and speedup per scope
+ *    <scope>.json        best pipeline of each scope (kernel scopes are
+ *                        <op_type>/<kernel>.json)
+ */
+class Autotuner {
+public:
+  // Mean primary metric of `samples` runs of the lowered kernel, false if the
+  // kernel failed
+  using MeasureFn = std::function<bool(KernelTask &task, const fs::path &ll,
+                                       unsigned int samples, double &value)>;
+
+  Autotuner(CommandManager &manager, const AutotuneConfig &config);
+
+  // Reads and validates the template, false (with a message) if unusable
+  bool load_template();
+
+  bool run(std::vector<KernelTask> &tasks, const MeasureFn &measure,
+           const fs::path &output_dir);
+
+private:
+  struct Trial {
+    std::vector<size_t> choice; // value index per dimension
+    double cost = 0.0;
+    bool complete = false;
+  };
+
+  CommandManager &m_manager; // compiles the candidates
+  AutotuneConfig m_config;
+  PipelineTemplate m_template;
+  std::mt19937_64 m_rng;
+
+  std::vector<size_t> random_choice();
+  std::vector<size_t> suggest(const std::vector<Trial> &trials);
+
+  // Compiles the scope's kernels under `pipeline_json`, false if none built
+  bool compile(std::vector<KernelTask *> &scope, const fs::path &pipeline_json,
+               std::vector<fs::path> &ll_filepaths);
+  /*
+   * Multiplicity weighted cost of the scope, stopped early (complete false)
+   * once it exceeds `bound`
+   */
+  bool evaluate(std::vector<KernelTask *> &scope,
+                const std::vector<fs::path> &ll_filepaths,
+                const MeasureFn &measure, double bound, double &cost,
+                bool &complete);
+};
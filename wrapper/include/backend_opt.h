@@ -0,0 +1,55 @@
+#pragma once
+
+#include "nlohmann/json.hpp"
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+using json = nlohmann::json;
+
+/*
+ * LLVM backend optimisation of a pipeline
+ *
+ * Read from the optional "llvm_opt" section of the pipeline JSON
+ *    "llvm_opt": {
+ *      "level":  "O0" | "O1" | "O2" | "O3" | "Os" | "Oz",   (default: O0)
+ *      "passes": ["instcombine", "loop-vectorize", ...],     (default: none)
+ *      "lto":    false
+ *    }
+ *
+ * The .ll produced by the MLIR pipeline is run through `opt` with either the
+ * custom pass list or default<level>, then compiled with the same level for
+ * code generation only (the middle end is not run twice).
+ */
+struct BackendOptSpec {
+  std::string level = "O0";
+  std::vector<std::string> passes;
+  bool lto = false;
+};
+
+class BackendOpt {
+public:
+  static BackendOptSpec from_pipeline_json(const json &pipeline);
+
+  // False for plain O0 without custom passes, i.e. nothing for opt to do
+  static bool needs_opt(const BackendOptSpec &spec);
+
+  // Value of opt's -passes= option
+  static std::string opt_pipeline(const BackendOptSpec &spec);
+
+  static std::string opt_command(const BackendOptSpec &spec,
+                                 const fs::path &opt_exec,
+                                 const fs::path &input_ll,
+                                 const fs::path &output_ll);
+
+  // -O / -flto flags for the final compile
+  static std::string compile_flags(const BackendOptSpec &spec);
+
+  // 0-3 codegen optimisation level for in-memory compilation (ORC JIT)
+  static int codegen_level(const BackendOptSpec &spec);
+
+  // Stable description used in cache keys and result CSVs
+  static std::string describe(const BackendOptSpec &spec);
+};
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "nlohmann/json.hpp"
+
+#include <atomic>
+#include <filesystem>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+using json = nlohmann::json;
+
+struct ServerConfig {
+  fs::path socket_path;
+  fs::path workspace; // job outputs in <workspace>/<id>, shared input cache
+  std::vector<std::string> default_args; // prepended to every job's args
+};
+
+/*
+ * Benchmark daemon (WrapperModule serve)
+ *
+ * Listens on a Unix socket for jobs, one JSON object per line:
+ *    {"id": "conv-fusion", "model": "conv.mlir",
+ *     "pipeline": "o2_pipeline.json" (or a list to compare),
+ *     "args": ["--sample-count", "10"]}
+ * and runs each one as a BenchmarkSession in this process, so the MLIR
+ * context, the ORC JIT, the compile cache and the input cache stay warm
+ * between jobs. Every job runs with --output-dir <workspace>/<id> and, unless
+ * it sets its own, --input-cache <workspace>/inputs and --isolation-cache
+ * <workspace>/isolation. Each session starts from reset process state, and
+ * --help or a usage error only fails the job. Relative paths (the model, the
+ * pipelines and arguments naming existing files) are taken from the job's
+ * "cwd", else from the working directory of the connected client.
+ *
+ * Replies are JSON lines tagged with the job id:
+ *    {"event": "queued"}     accepted, waiting for earlier jobs
+ *    {"event": "started"}
+ *    {"event": "kernel", "kernel", "status", "averages"}
+ *                            streamed from kernel_manifest.json as each
+ *                            kernel finishes
+ *    {"event": "done", "status", "seconds", "output_dir"}
+ *    {"event": "error", "message"}
+ * {"command": "shutdown"} stops the server once running jobs are done.
+ *
+ * Connections are served concurrently, jobs run one at a time (see
+ * benchmark_session.h).
+ */
+class BenchmarkServer {
+public:
+  explicit BenchmarkServer(const ServerConfig &config);
+
+  // Accepts connections until shut down, false if the socket can't be bound
+  bool serve();
+
+private:
+  ServerConfig m_config;
+  std::atomic<bool> m_running{true};
+  std::atomic<unsigned int> m_job_count{0};
+  int m_listen_fd = -1;
+  std::mutex m_clients_mutex;
+  std::set<int> m_clients;
+
+  // Stops accepting jobs and closes the idle connections
+  void stop();
+  void handle_connection(int fd);
+  void run_job(int fd, const json &job);
+};
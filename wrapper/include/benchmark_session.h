@@ -0,0 +1,48 @@
+#pragma once
+
+#include "command_manager.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+/*
+ * Library entry point of the benchmark
+ *
+ * Everything but main() is built into the MLIRBench library (premake5.lua),
+ * so other programs (a CI service, a test harness) can run benchmarks in
+ * process:
+ *    BenchmarkSession session({"-B", build, "--pipeline", "o2_pipeline.json",
+ *                              "--output-dir", out, "model.mlir"});
+ *    int status = session.run();
+ * A session takes the WrapperModule command line (including the "roofline"
+ * subcommand) and returns its exit status.
+ *
+ * The compiler and measurement settings belong to the session
+ * (CommandManagerSettings): each run starts them from their defaults and
+ * hands them to its own CommandManager, so two sessions never see each
+ * other's configuration. The compile cache, the result writer, the results
+ * store and the counter sessions are still process wide, so sessions can be
+ * created and run from any thread but their runs are serialised on a
+ * process wide lock, and each run first clears what a previous one left in
+ * them (the pass prefix trie, the linalg structures).
+ */
+class BenchmarkSession {
+public:
+  // program_name is argv[0]: the default --worker-binary for --workers
+  explicit BenchmarkSession(std::vector<std::string> arguments,
+                            std::string program_name = "WrapperModule");
+
+  const std::vector<std::string> &arguments() const;
+
+  /*
+   * Runs the benchmark, blocking while another session runs. on_start is
+   * called once this session's turn has come.
+   */
+  int run(const std::function<void()> &on_start = {});
+
+private:
+  std::string m_program_name;
+  std::vector<std::string> m_arguments;
+  CommandManagerSettings m_settings;
+};
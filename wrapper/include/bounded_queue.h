@@ -0,0 +1,46 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <queue>
+
+/*
+ * Blocking, fixed capacity FIFO queue
+ *
+ * push() blocks while the queue is full, which provides back-pressure from
+ * the consumer (measurement) to the producers (compile workers).
+ */
+template <typename T> class BoundedQueue {
+  std::queue<T> m_items;
+  size_t m_capacity;
+
+  std::mutex m_mutex;
+  std::condition_variable m_not_full;
+  std::condition_variable m_not_empty;
+
+public:
+  explicit BoundedQueue(size_t capacity)
+      : m_capacity(capacity ? capacity : 1) {}
+
+  void push(T item) {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_not_full.wait(lock, [this]() { return m_items.size() < m_capacity; });
+      m_items.push(std::move(item));
+    }
+    m_not_empty.notify_one();
+  }
+
+  T pop() {
+    T item;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_not_empty.wait(lock, [this]() { return !m_items.empty(); });
+      item = std::move(m_items.front());
+      m_items.pop();
+    }
+    m_not_full.notify_one();
+    return item;
+  }
+};
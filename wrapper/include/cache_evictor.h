@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// One data (or unified) cache level of a CPU
+struct CacheLevel {
+  int level = 0;
+  uint64_t bytes = 0;
+};
+
+/*
+ * Cold cache measurements: streams through a buffer larger than the last
+ * level cache, so that kernel inputs, outputs and code only start out in
+ * memory. Eviction happens outside the counter window.
+ */
+class CacheEvictor {
+public:
+  // buffer_bytes = 0 sizes the buffer at twice the last level cache
+  explicit CacheEvictor(uint64_t buffer_bytes = 0);
+
+  // Reads and writes one byte per cache line of the whole buffer
+  void evict();
+
+  uint64_t buffer_bytes() const { return m_buffer.size(); }
+
+  // Size of the largest cache level of CPU 0 in bytes (sysfs, sysconf or a
+  // 32 MiB guess)
+  static uint64_t last_level_cache_bytes();
+
+  // Data and unified caches of the CPU from sysfs, L1 first. Empty if sysfs
+  // doesn't describe them.
+  static std::vector<CacheLevel> cache_levels(int cpu = 0);
+
+private:
+  std::vector<uint8_t> m_buffer;
+};
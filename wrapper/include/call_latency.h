@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+/*
+ * Per-call latency histogram (--call-latency)
+ *
+ * The counted samples average many calls per window, which hides the slow
+ * ones an online service sees as its tail. After the main samples, the
+ * kernel is called back to back, each call timed on its own by the TSC
+ * (tsc_clock.h, a few nanoseconds per read) and recorded here.
+ *
+ * HDR style buckets: values below 2^SUB_BUCKET_BITS nanoseconds are exact,
+ * above that every power of two is split into 2^(SUB_BUCKET_BITS - 1)
+ * equal buckets, so a bucket is never wider than 1/128 of its values. The
+ * memory is fixed whatever the range, and percentiles report the upper edge
+ * of their bucket (the maximum is exact).
+ */
+class LatencyHistogram {
+public:
+  static constexpr unsigned int SUB_BUCKET_BITS = 8;
+
+  LatencyHistogram();
+
+  void record(uint64_t nanoseconds);
+
+  uint64_t count() const { return m_count; }
+  uint64_t min() const { return m_count ? m_min : 0; }
+  uint64_t max() const { return m_max; }
+  double mean() const;
+
+  // Upper edge of the bucket holding the `fraction` quantile, in [0, 1]
+  uint64_t percentile(double fraction) const;
+
+  // Sample columns of summary()
+  static std::vector<std::string> columns();
+
+  // call_p50_ns, call_p99_ns, call_p999_ns, call_max_ns, call_mean_ns and
+  // call_latency_calls
+  std::map<std::string, double> summary() const;
+
+  /*
+   * Non-empty buckets in ascending order, for comparing runs:
+   *    low_ns,high_ns,count,percentile
+   * percentile is the share of calls up to and including the bucket.
+   */
+  std::string to_csv() const;
+
+  // <output>/call_latency/<op_type>/<kernel>.hist.csv
+  static fs::path histogram_path(const fs::path &output_root,
+                                 const std::string &op_type,
+                                 const std::string &kernel);
+
+private:
+  static size_t index(uint64_t value);
+  static uint64_t lowest(size_t index);
+  static uint64_t highest(size_t index);
+
+  std::vector<uint64_t> m_counts;
+  uint64_t m_count = 0;
+  uint64_t m_min = 0;
+  uint64_t m_max = 0;
+  double m_sum = 0.0;
+};
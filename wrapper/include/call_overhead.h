@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+enum class CallOverheadMode { OFF, MEASURE, SUBTRACT };
+
+// Per call cost of an empty call in one metric, over the calibration windows
+struct OverheadStats {
+  double median = 0.0;
+  double mad = 0.0;
+  double p5 = 0.0;
+  double p95 = 0.0;
+};
+
+/*
+ * Measurement overhead calibration (--call-overhead)
+ *
+ * Before a kernel's samples, the kernel is swapped for an empty function and
+ * WINDOWS counter windows are run through the same path as the samples: the
+ * same counters, inner repetitions, libffi call interface (argument and
+ * result types of the kernel) or trampoline pointer. What remains per call is
+ * the fixed cost of measuring, which dominates kernels of a few
+ * microseconds. The descriptor unpacking inside a generated trampoline is
+ * part of the kernel and is not calibrated.
+ *
+ * Every sample gets, per requested perf metric:
+ *    overhead_<metric>       median per call of the empty windows
+ *    overhead_<metric>_mad   their median absolute deviation
+ * With SUBTRACT, <metric> holds the value minus the median (never below 0)
+ * and <metric>_raw the value as counted. Derived columns (ipc, bandwidth,
+ * gflops) follow the corrected values.
+ */
+class CallOverhead {
+public:
+  static const unsigned int WINDOWS = 50;
+
+  static bool parse(const std::string &name, CallOverheadMode &mode);
+  static std::string describe(CallOverheadMode mode);
+
+  // Stand-ins for kernel_call and its trampoline, doing nothing
+  static void empty_kernel();
+  static void empty_trampoline(void **args, void *results);
+
+  // `windows` are per call metric values of the empty windows
+  static std::map<std::string, OverheadStats>
+  summarize(const std::vector<std::map<std::string, double>> &windows,
+            const std::vector<std::string> &metrics);
+
+  // Adds the overhead columns to a sample, subtracting with SUBTRACT
+  static void apply(const std::map<std::string, OverheadStats> &overhead,
+                    CallOverheadMode mode,
+                    std::map<std::string, double> &sample);
+
+  static std::vector<std::string>
+  columns(const std::vector<std::string> &metrics, CallOverheadMode mode);
+
+  // "cycles 41 (39-60), instructions 112 (112-112)", median and p5-p95
+  static std::string
+  describe(const std::map<std::string, OverheadStats> &overhead);
+};
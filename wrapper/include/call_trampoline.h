@@ -0,0 +1,53 @@
+#pragma once
+
+#include "utils.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+ * Kernel call interface
+ *
+ * FFI        - libffi call with the flattened base/aligned/offset/sizes/
+ *              strides argument list (original behaviour)
+ * TRAMPOLINE - The pipeline requests MLIR's C interface
+ *              (llvm-request-c-wrappers) and a generated typed trampoline
+ *              calls _mlir_ciface_kernel_call directly
+ */
+enum CallInterface { FFI, TRAMPOLINE };
+
+/*
+ * Generated call trampolines
+ *
+ * Every kernel gets an LLVM IR function appended to its .ll:
+ *
+ *    void kernel_call_trampoline(void **args, void *results)
+ *
+ * args[i] points to a packed descriptor (see pack_descriptor) of argument i,
+ * results to the packed descriptors of all returns, laid out back to back as
+ * _mlir_ciface_ expects for single and multiple results. Being plain IR, the
+ * trampoline works for both the shared object and the ORC JIT engines.
+ */
+class CallTrampoline {
+public:
+  using Function = void (*)(void **args, void *results);
+
+  static std::string trampoline_symbol(const std::string &kernel_symbol);
+
+  // MLIR pass which emits _mlir_ciface_ wrappers (before convert-func-to-llvm)
+  static void request_c_interface(std::vector<std::string> &pass_list);
+
+  static std::string generate_ir(size_t arg_count, size_t return_count);
+
+  /*
+   * Appends the trampoline to the .ll. Returns false (leaving the file
+   * untouched) if the module has no C interface entry point.
+   */
+  static bool append_to_ll(const fs::path &ll_filepath, size_t arg_count,
+                           size_t return_count);
+
+  // In memory layout of a ranked MemRef descriptor: 3 + 2 * rank i64 slots
+  static size_t descriptor_slots(int64_t rank);
+  static std::vector<int64_t> pack_descriptor(MemRefArg &arg);
+};
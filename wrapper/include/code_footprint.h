@@ -0,0 +1,63 @@
+#pragma once
+
+#include "command_manager.h"
+
+#include <filesystem>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+/*
+ * Static code footprint of a kernel's shared object (--code-footprint)
+ *
+ * Unrolling and loop peeling grow kernels past what the L1 instruction
+ * cache holds, which hurts most when a model runs many kernels back to
+ * back. Each per kernel object is read once it is built, and the result is
+ * written next to the .ll as <kernel>.footprint.json. It also becomes
+ * columns of every sample:
+ *    code_text_bytes      size of the object's .text section
+ *    code_kernel_bytes    size of its functions, without the crt helpers
+ *    code_functions       number of those functions
+ *    code_instructions    instructions of those functions
+ *    code_basic_blocks    blocks: function entries, branch targets and the
+ *                         instructions after branches and returns
+ *    code_branch, code_call, code_load, code_store, code_simd, code_other
+ *                         static instruction mix; simd counts instructions
+ *                         on vector/FP registers (xmm/ymm/zmm, q/z)
+ *
+ * The instruction level columns disassemble with LLVM's MC layer and are
+ * only available with the LLVM libraries linked (premake5 --with-mlir=...,
+ * MLIR_BENCH_ORC_JIT). Without them the sizes come from the ELF headers,
+ * the instruction columns are NaN and a warning is printed once.
+ *
+ * write_correlation lists every measured kernel's footprint next to its L1
+ * instruction cache misses and reports how strongly the two correlate.
+ */
+class CodeFootprint {
+public:
+  // Whether instructions can be disassembled, sizes always can
+  static bool disassembler_available();
+
+  static fs::path filepath(const fs::path &ll_filepath);
+
+  // Reads the shared object and writes the JSON of the .ll
+  static bool analyse(const fs::path &so_filepath,
+                      const fs::path &ll_filepath);
+
+  // Sample columns from an existing JSON, empty without one
+  static std::map<std::string, double> columns(const fs::path &ll_filepath);
+  static std::vector<std::string> column_names();
+
+  /*
+   * One row per measured kernel with a footprint:
+   *    op_type,kernel,code_kernel_bytes,code_instructions,
+   *    code_basic_blocks,<icache metric>
+   * The icache metric is L1-icache-load-misses, or l1i_mpki from
+   * --metric-group frontend. The Pearson and Spearman correlations of the
+   * kernel bytes with it are printed. False if nothing was written.
+   */
+  static bool write_correlation(const std::vector<KernelTask> &tasks,
+                                const fs::path &csv_filepath);
+};
@@ -1,20 +1,315 @@
 #pragma once
 
 #include "nlohmann/json_fwd.hpp"
+#include <map>
+#include <memory>
 #include <string>
+#include <vector>
 
+#include "backend_opt.h"
+#include "call_overhead.h"
+#include "call_trampoline.h"
+#include "compile_profile.h"
+#include "constant_args.h"
+#include "counter_scheduler.h"
+#include "counter_session.h"
+#include "energy_counter.h"
+#include "gpu_runtime.h"
+#include "jit_engine.h"
+#include "kernel_profiler.h"
+#include "memref_layout.h"
+#include "metric_groups.h"
+#include "mlir_engine.h"
+#include "noise_monitor.h"
+#include "output_verifier.h"
+#include "parallel_runtime.h"
+#include "report_metric.h"
 #include "perfcpp/event_counter.h"
+#include "shape_sweep.h"
+#include "sparse_encoding.h"
+#include "statistics.h"
+#include "target_spec.h"
+#include "tensor_arena.h"
+#include "tensor_fuzzer.h"
+#include "torch_baseline.h"
 #include "utils.h"
 
 namespace fs = std::filesystem;
 using json = nlohmann::json;
 
-// TODO: Use this instead of all the static bullshit you fucking doofus!!
+/*
+ * Shared object linking granularity (SHARED_OBJECT engine only)
+ *
+ * PER_KERNEL - One kernel_call.so per kernel (original behaviour)
+ * OP_TYPE    - Every kernel of an op type folder is linked into one object
+ * MODEL      - Every kernel of the model is linked into one object
+ *
+ * Batched kernels get their kernel_call entry point renamed to a unique
+ * symbol, which is then resolved with dlsym.
+ */
+enum LinkMode { PER_KERNEL, OP_TYPE, MODEL };
+
+/*
+ * Handle to a compiled kernel entry point, produced by one of the execution
+ * engines (see jit_engine.h)
+ */
+struct KernelHandle {
+  void *function = nullptr; // Address of kernel_call
+
+  // Typed C interface trampoline (CallInterface::TRAMPOLINE), null if the
+  // kernel has to be called through libffi
+  void *trampoline = nullptr;
+
+  // mlir_bench_alloc_hooks of instrumented kernels (see allocation_tracker.h)
+  void *alloc_hooks = nullptr;
+
+  // mlir_bench_gpu_hooks of GPU kernels (see gpu_runtime.h)
+  void *gpu_hooks = nullptr;
+
+  // SHARED_OBJECT engine
+  void *so_handle = nullptr;
+  fs::path so_filepath;
+
+  // ORC_JIT engine
+  uint64_t jit_resource_key = 0;
+
+  // Time taken to turn the .ll into a callable function (compile + load)
+  double compile_seconds = 0.0;
+
+  // Shared object is owned by the compile cache and must not be removed
+  bool so_from_cache = false;
+
+  // Batched object shared with the other kernels of its batch, closed (and
+  // removed) once the last of them is unloaded
+  std::shared_ptr<void> batch_object;
+  std::string symbol = "kernel_call";
+};
+
+/*
+ * Warmup runs executed before sampling, never part of the averages
+ *
+ * A fixed number of runs is always executed. With auto_detect, warmup
+ * continues until the coefficient of variation of the primary metric over the
+ * last `window` runs drops below cv_threshold, or max_runs is reached.
+ */
+struct WarmupConfig {
+  unsigned int runs = 0;
+  bool auto_detect = false;
+  unsigned int window = 5;
+  double cv_threshold = 0.02;
+  unsigned int max_runs = 100;
+};
+
+/*
+ * Adaptive sampling
+ *
+ * With target_ci > 0, sampling continues past perf_run_count until the 95%
+ * confidence interval of the primary metric is within +-target_ci of its mean
+ * (or max_samples is reached). max_seconds bounds the sampling time of a
+ * kernel in every mode.
+ */
+struct SamplingConfig {
+  double target_ci = 0.0; // Relative, 0.01 = 1%
+  double max_seconds = 0.0;
+  unsigned int max_samples = 10000;
+
+  // Inner repetition: each counter window wraps K back to back calls, with K
+  // calibrated so that a window lasts at least min_window_seconds (0 = off).
+  // Reported metrics are per call.
+  double min_window_seconds = 0.0;
+  unsigned int max_inner_repetitions = 1000000;
+};
+
+/*
+ * Cache state of the kernel's data at the start of each sample
+ *
+ * WARM - Back to back runs on the same inputs (original behaviour)
+ * COLD - The caches are flushed before every sample
+ * BOTH - Warm samples followed by cold samples, reported separately
+ */
+enum CacheMode { WARM, COLD, BOTH };
+
+/*
+ * Build settings resolved from one pipeline JSON. Several --pipeline files
+ * are compared within one run, the first (primary) one drives the normal
+ * results and the others are measured interleaved with it.
+ */
+struct PipelineSpec {
+  std::string label; // file stem, made unique
+  fs::path pipeline_json;
+  TargetSpec target;
+  BackendOptSpec backend_opt;
+  ParallelRuntimeKind parallel_runtime = ParallelRuntimeKind::SERIAL_RUNTIME;
+  // Results become out-params written to preallocated buffers (--out-params)
+  bool out_params = false;
+  // Objects are rebuilt with a profile of a training run (--pgo)
+  bool pgo = false;
+};
+
+/*
+ * Wall clock record of a kernel's path through the scheduler. Start times are
+ * seconds since the scheduler started.
+ */
+struct KernelTimeline {
+  double compile_start = 0.0;
+  double compile_seconds = 0.0;
+  double queue_wait_seconds = 0.0; // Ready to run, waiting for measurement
+  double measure_start = 0.0;
+  double measure_seconds = 0.0;
+};
+
+/*
+ * A single isolated kernel travelling through the benchmark stages
+ *    prepare (metadata, lowering, object build) -> measure -> report
+ */
+struct KernelTask {
+  std::string op_type;
+  fs::path mlir_filepath;
+  fs::path json_filepath;
+  fs::path ll_filepath;
+  // Relocatable object of a cross target (see target_spec.h), compiled by
+  // the coordinator and linked on the worker that measures it
+  fs::path cross_object;
+
+  KernelHandle kernel;
+  bool metadata_ready = false;
+  bool prepared = false;
+  bool measured = false;
+  // --time-budget ran out before the kernel was compiled or measured
+  bool skipped_budget = false;
+  // Why the sandboxed measurement died (see kernel_sandbox.h), empty if fine
+  std::string failure;
+
+  // Structural deduplication (see kernel_dedup.h)
+  std::string kernel_hash;
+  unsigned int multiplicity = 1;
+  std::vector<fs::path> duplicate_filepaths;
+
+  // --shape-sweep variant (see shape_sweep.h), empty for the model's kernels
+  std::string shape_variant;
+  ShapeScale shape_scale;
+  fs::path shape_parent; // mlir_filepath of the kernel it was derived from
+  // --data-order-sweep variants: order of their boundary tensors
+  DataOrder data_order = DataOrder::NCHW;
+  // --isolate-granularity subgraph of several ops (see subgraph_isolation.h)
+  bool fused = false;
+  // --dynamic-shapes kernel, compiled once with dynamic activations: the
+  // metadata of every swept shape it also runs, by shape variant name
+  bool dynamic = false;
+  std::map<std::string, fs::path> dynamic_shapes;
+  // --const-args kernel: arguments inlined as constants, 0 for the others
+  unsigned int const_args = 0;
+  // --sparse-args kernel: its encoded arguments ("1:csr"), empty otherwise
+  std::string sparse_args;
+
+  // --workers: host that measured the kernel and its hardware fingerprint
+  // (see distributed.h), empty for local measurements
+  std::string node;
+  std::string node_fingerprint;
+
+  // --cost-model prediction of the model's metric, 0 without one
+  double predicted_cost = 0.0;
+  // Expected weight in the model (see kernel_priority.h), 0 if not assigned
+  double priority = 0.0;
+
+  // Per metric average over the collected samples
+  std::map<std::string, double> average_metrics;
+  // Robust statistics of the main samples per metric, and the samples
+  // --outlier-rejection left out per variant suffix ("" for the main ones):
+  // 1-based sample number and its primary metric value
+  std::map<std::string, SampleSummary> sample_summaries;
+  std::map<std::string, std::vector<std::pair<size_t, double>>>
+      rejected_samples;
+  // CSVs written for the kernel (see kernel_manifest.h)
+  std::vector<fs::path> result_filepaths;
+
+  // Discarded warmup runs, reported on their own
+  std::vector<std::map<std::string, double>> warmup_results;
+
+  // Cold cache samples of --cache-mode=both, and their averages
+  std::vector<std::map<std::string, double>> cold_results;
+  std::map<std::string, double> cold_average_metrics;
+
+  // --layout-sweep samples and averages, keyed by layout name
+  std::map<std::string, std::vector<std::map<std::string, double>>>
+      layout_results;
+  std::map<std::string, std::map<std::string, double>> layout_average_metrics;
+
+  // --thread-sweep samples and averages, keyed by thread count
+  std::map<unsigned int, std::vector<std::map<std::string, double>>>
+      thread_results;
+  std::map<unsigned int, std::map<std::string, double>> thread_average_metrics;
+
+  // --density-sweep samples and averages, keyed by density
+  std::map<std::string, std::vector<std::map<std::string, double>>>
+      density_results;
+  std::map<std::string, std::map<std::string, double>> density_average_metrics;
+
+  // --profile-sweep samples and averages, keyed by data profile name
+  std::map<std::string, std::vector<std::map<std::string, double>>>
+      profile_results;
+  std::map<std::string, std::map<std::string, double>> profile_average_metrics;
+
+  // Comparison pipelines: lowered kernel, samples and averages by label
+  std::map<std::string, fs::path> pipeline_ll_filepaths;
+  std::map<std::string, std::vector<std::map<std::string, double>>>
+      pipeline_results;
+  std::map<std::string, std::map<std::string, double>> pipeline_average_metrics;
+
+  // --torch-baseline samples and averages, keyed by torch mode
+  std::map<std::string, std::vector<std::map<std::string, double>>>
+      baseline_results;
+  std::map<std::string, std::map<std::string, double>> baseline_average_metrics;
+
+  // --contention samples and averages, keyed by contention profile name
+  std::map<std::string, std::vector<std::map<std::string, double>>>
+      contention_results;
+  std::map<std::string, std::map<std::string, double>>
+      contention_average_metrics;
+
+  // --dynamic-shapes samples and averages of the swept shapes, by name
+  std::map<std::string, std::vector<std::map<std::string, double>>>
+      dynamic_shape_results;
+  std::map<std::string, std::map<std::string, double>>
+      dynamic_shape_average_metrics;
+
+  // --replicas samples of all replicas together, and their averages, by
+  // replica count
+  std::map<unsigned int, std::vector<std::map<std::string, double>>>
+      replica_results;
+  std::map<unsigned int, std::map<std::string, double>>
+      replica_average_metrics;
+
+  // --replay samples over every layer of the kernel, and their averages
+  std::vector<std::map<std::string, double>> replay_results;
+  std::map<std::string, double> replay_average_metrics;
+
+  // --compile-profile: compile cost of the kernel, and of it under every
+  // comparison pipeline by label
+  CompileProfile compile_profile;
+  std::map<std::string, CompileProfile> pipeline_compile_profiles;
+
+  KernelTimeline timeline;
+};
+
+/*
+ * Configuration of a CommandManager. A BenchmarkSession owns one and hands
+ * it to the manager of each of its runs; the setters below write it. The
+ * sweeps and pipeline comparisons switch a few of these while measuring
+ * (use_pipeline, set_input_layout, ...), for the rest of the run.
+ */
 struct CommandManagerSettings {
-  std::string compiler;
+  std::string compiler = "/usr/bin/clang++";
   fs::path outputFolder;
   fs::path loweringFolder;
-  bool enableLogFiles;
+  // Transient artifacts, outputFolder unless --scratch-dir
+  fs::path scratchFolder;
+  // Text of the isolated model, a print of bytecode models
+  fs::path modelTextFilepath;
+  bool loadFromMemory = false;
+  bool enableLogFiles = false;
+  bool enableRunLogs = false;
+  unsigned int perf_run_count = 0;
 
   fs::path torch_mlir_install_path;
   fs::path llvm_install_path;
@@ -22,6 +317,52 @@ struct CommandManagerSettings {
   fs::path mlir_opt_exec;
   fs::path llvm_lib_path;
   fs::path pipeline_json;
+  // Pipeline of kernels with sparse_tensor encodings (see sparse_encoding.h)
+  fs::path sparse_pipeline_json = "sparse_pipeline.json";
+
+  std::vector<std::string> perf_metrics;
+  std::vector<MetricGroup> metric_groups;
+  WarmupConfig warmup;
+  SamplingConfig sampling;
+  OutlierConfig outlier_config;
+  NoiseConfig noise_config;
+  CallOverheadMode call_overhead = CallOverheadMode::MEASURE;
+  EnergyConfig energy_config;
+  bool vectorization_report = false;
+  bool code_footprint = false;
+  bool dram_traffic = false;
+  CounterMode counter_mode = CounterMode::SESSION;
+  // PMU events per counter batch, 0 = one window (see counter_scheduler.h)
+  unsigned int counter_batch_size = 0;
+  ThreadScope thread_scope = ThreadScope::CALLING_THREAD;
+  CacheMode cache_mode = CacheMode::WARM;
+  bool track_allocations = false;
+  ProfileConfig profile;
+  ArenaConfig arena_config;
+  LayoutKind input_layout = LayoutKind::DENSE;
+  fs::path tensor_source_dir;
+  fs::path replay_output_dir;
+  fs::path input_cache_dir;
+  fs::path isolation_cache_dir;
+  uint64_t input_seed = 0;
+  InputProfile input_profile;
+  bool record_outputs = false;
+  unsigned int call_latency_calls = 0;
+  fs::path verify_reference_dir;
+  Tolerance verify_tolerance;
+  CallInterface call_interface = CallInterface::TRAMPOLINE;
+  int measure_cpu = -1;
+  bool realtime_scheduling = false;
+  bool ftz_daz = false;
+  LoweringEngine lowering_engine = LoweringEngine::POPEN;
+  ExecutionEngine execution_engine = ExecutionEngine::SHARED_OBJECT;
+  LinkMode link_mode = LinkMode::PER_KERNEL;
+  std::vector<fs::path> comparison_pipeline_jsons;
+  bool out_params_variant = false;
+  bool pgo_variant = false;
+  std::vector<TorchMode> torch_baselines;
+  unsigned int thread_budget = 0;
+  fs::path llvm_opt_exec;
 };
 
 /*
@@ -29,63 +370,337 @@ struct CommandManagerSettings {
  */
 
 class CommandManager {
-  static std::string compiler;
-  static fs::path outputFolder;
-  static fs::path loweringFolder;
-  static bool enableLogFiles;
-  static bool enableRunLogs;
-  // static perf::EventCounter perf_event_counter;
-  static unsigned int perf_run_count;
-
-  static fs::path torch_mlir_install_path;
-  static fs::path llvm_install_path;
-  static fs::path torch_opt_exec;
-  static fs::path mlir_opt_exec;
-  static fs::path llvm_lib_path;
-  static fs::path pipeline_json;
-
-  static std::vector<std::string> perf_metrics;
+  CommandManagerSettings &settings;
+
+  // State of the run: the resolved pipelines with the active one's build
+  // settings, the input arenas and the measured idle power
+  std::map<std::string, double> idle_watts;
+  std::unique_ptr<TensorArena> tensor_arena;
+  std::unique_ptr<DeviceArena> device_arena;
+  std::string isolation_key; // Entry of this run's model, if cached
+  bool isolation_restored = false;
+  TargetSpec target;
+  BackendOptSpec backend_opt;
+  ParallelRuntimeKind parallel_runtime = ParallelRuntimeKind::SERIAL_RUNTIME;
+  PipelineSpec primary_pipeline;
+  std::vector<PipelineSpec> comparison_pipelines;
+  std::string active_pipeline;
+  bool out_params = false;
+  bool pgo = false;
+
+  // Disassembles profiled kernels through exec()
+  friend class KernelProfiler;
 
 private:
   /*
    * Routine to read input from the executed command
    */
   static std::string exec(const std::string &cmd);
-  static bool verifyParameters();
+  bool verifyParameters();
+
+  /*
+   * torch -> linalg -> LLVM dialect -> <kernel>.llvm.ll through
+   * torch-mlir-opt, mlir-opt and mlir-translate. The MLIR stages are piped
+   * as bytecode; --pass-logs keeps them as <kernel>.linalg.mlirbc and
+   * <kernel>.llvm.mlirbc. Compile profiles count the ops of the linalg
+   * stage, which is then kept as text (<kernel>.linalg.mlir). `profile`
+   * adds the profiling flags to this lowering.
+   */
+  fs::path lower_to_llvm_ir(const fs::path &mlirFilePath,
+                            bool profile = CompileProfiler::is_enabled());
 
-  static fs::path lower_to_llvm_dialect(const fs::path &mlirFilePath);
+  // Lowering without consulting the compile cache
+  fs::path
+  generate_ll_file_uncached(const fs::path &mlirFilePath,
+                            bool profile = CompileProfiler::is_enabled());
 
-  static fs::path compile_llvm_dialect(const fs::path &llvm_mlir_filepath);
+  /*
+   * Runs the pipeline's llvm_opt stage on the .ll in place. The unoptimised
+   * IR is kept as <kernel>.llvm.noopt.ll when pass logs are enabled.
+   */
+  bool optimize_ll_file(const fs::path &ll_filepath);
+
+  // --compile-profile: reads the pass log of the kernel's lowering
+  void collect_compile_profile(KernelTask &task, double lowering_seconds);
+
+  /*
+   * Identity strings used in compile cache keys
+   */
+  std::string get_toolchain_identity();
+  std::string get_compiler_identity();
+  std::string get_compile_flags();
+
+  /*
+   * Compiles and loads the kernel_call entry point of the .ll file using the
+   * selected execution engine
+   */
+  bool load_kernel(const fs::path &ll_object_filepath, KernelHandle &kernel);
+
+  /*
+   * Builds (or fetches from the compile cache) the shared object of the .ll
+   * file. Thread safe, every kernel gets its own <kernel>.so
+   */
+  bool build_kernel_object(const fs::path &ll_object_filepath,
+                           KernelHandle &kernel);
+
+  /*
+   * Compiles the .ll for a cross target into <kernel>.o, which
+   * build_kernel_object links on a host of that architecture
+   */
+  bool build_cross_object(KernelTask &task);
+  void unload_kernel(KernelHandle &kernel);
+
+  /*
+   * Writes <kernel>.vectorization.json (see vector_coverage.h) from the .ll
+   * and, for per kernel shared objects, the object's disassembly
+   */
+  bool analyse_vectorization(const fs::path &ll_object_filepath,
+                             const KernelHandle &kernel);
+
+  /*
+   * Renames kernel_call in every member's .ll, links all of them into a
+   * single shared object and resolves each member's entry point
+   */
+  bool link_kernel_batch(const std::vector<KernelTask *> &batch,
+                         const fs::path &so_filepath);
 
 public:
-  static void set_llvm_install_path(const fs::path &path);
-  static void set_torch_install_path(const fs::path &path);
-  static void set_compiler_executable(const fs::path &binary);
-  static void set_perf_metrics(const std::vector<std::string> &metrics);
-  static void set_pass_log_flag(bool flag);
-  static void set_run_log_flag(bool flag);
-  static void set_perf_sample_run_count(const unsigned int &count);
+  explicit CommandManager(CommandManagerSettings &settings);
+  CommandManager(const CommandManager &) = delete;
+  CommandManager &operator=(const CommandManager &) = delete;
 
-  static void set_output_folder(const fs::path &output);
-  static void set_pipeline_json_filepath(const fs::path &filepath);
-  static fs::path get_output_folder();
-  static fs::path get_lowering_folder();
+  void set_llvm_install_path(const fs::path &path);
+  void set_torch_install_path(const fs::path &path);
+  void set_compiler_executable(const fs::path &binary);
+  void set_perf_metrics(const std::vector<std::string> &metrics);
+  void set_metric_groups(const std::vector<MetricGroup> &groups);
+  void set_pass_log_flag(bool flag);
+  void set_run_log_flag(bool flag);
+  void set_perf_sample_run_count(const unsigned int &count);
+  void set_warmup_config(const WarmupConfig &config);
+  void set_sampling_config(const SamplingConfig &config);
+  void set_outlier_config(const OutlierConfig &config);
+  const OutlierConfig &get_outlier_config();
+  void set_noise_config(const NoiseConfig &config);
+  void set_call_overhead(CallOverheadMode mode);
+  void set_energy_config(const EnergyConfig &config);
+  /*
+   * --energy: idle power of the package of `cpu` (-1: the current one) over
+   * a sleep of the configured length. Called once per session before any
+   * kernel runs, sandboxed workers inherit it.
+   */
+  void measure_idle_power(int cpu);
+  void set_vectorization_report(bool flag);
+  void set_code_footprint(bool flag);
+  void set_dram_traffic(bool flag);
+  void set_counter_mode(const CounterMode &mode);
+  void set_counter_batch_size(unsigned int counters);
+  void set_thread_scope(const ThreadScope &scope);
+  void set_cache_mode(const CacheMode &mode);
+  void set_track_allocations(bool flag);
+  void set_profile_config(const ProfileConfig &config);
+  void set_arena_config(const ArenaConfig &config);
+  // The next kernel maps a fresh arena, placed for the measurement CPU then
+  void release_tensor_arena();
+  void set_input_layout(const LayoutKind &layout);
+  // Directory of .npy/.safetensors inputs, empty for generated data only
+  void set_tensor_source(const fs::path &directory);
+  // Directory the next kernel's outputs are written to as output<r>.npy,
+  // for --replay (see model_replay.h), empty = off
+  void set_replay_outputs(const fs::path &directory);
+  // Directory of shared generated inputs (see input_cache.h), empty = off
+  void set_input_cache(const fs::path &directory);
+  // Directory of cached isolations (see isolation_cache.h), empty = off
+  void set_isolation_cache(const fs::path &directory);
+  // Whether isolate_torch_kernels copied the kernels from the cache
+  bool isolation_from_cache();
+  // Adds the tasks' metadata to the cached isolation of the model
+  void store_isolation_metadata(const std::vector<KernelTask> &tasks);
+  // Run seed of the generated inputs (see TensorFuzzer::stream_seed)
+  void set_input_seed(uint64_t seed);
+  void set_input_profile(const InputProfile &profile);
 
-  static std::map<std::string, double>
-  aggregate_metrics(std::vector<std::map<std::string, double>> &metrics);
+  // Cross pipeline verification (see output_verifier.h): store the results
+  // as a reference, or compare them against a reference run's output folder
+  void set_record_outputs(bool flag);
+  void set_verification(const fs::path &reference_dir,
+                        const Tolerance &tolerance);
+  bool is_verifying();
+  // Timed back to back calls after the main samples (see call_latency.h),
+  // 0 disables the histogram
+  void set_call_latency(unsigned int calls);
+  void set_call_interface(const CallInterface &interface);
 
-  static void initialise_environment();
-  static void isolate_torch_kernels(const std::string &filename);
-  static std::vector<std::string> get_operation_types();
-  static std::string extract_pipeline();
+  // CPU reserved for measurements, -1 selects the last online CPU
+  void set_measure_cpu(int cpu);
+  int get_measure_cpu();
+  void set_realtime_scheduling(bool flag);
+  // Flush-to-zero / denormals-are-zero while sampling, IEEE otherwise
+  void set_ftz_daz(bool flag);
+  // Threads of the following kernel runs (see parallel_runtime.h), 0 leaves
+  // the thread count to the runtime
+  void set_thread_budget(unsigned int threads);
+  void set_lowering_engine(const LoweringEngine &engine);
+  void set_execution_engine(const ExecutionEngine &engine);
+  void set_link_mode(const LinkMode &mode);
+  LinkMode get_link_mode();
 
-  static std::vector<std::string> get_file_list(const fs::path &folderPath);
+  void set_output_folder(const fs::path &output);
+  /*
+   * --scratch-dir (see scratch_space.h): the lowerings folder and the logs
+   * move to `folder`, objects are loaded from memfds if load_from_memory
+   */
+  void set_scratch_folder(const fs::path &folder, bool load_from_memory);
+  void set_pipeline_json_filepath(const fs::path &filepath);
+  void set_sparse_pipeline(const fs::path &filepath);
+  // Further pipelines measured interleaved with the primary one
+  void set_comparison_pipelines(const std::vector<fs::path> &filepaths);
+  const PipelineSpec &get_primary_pipeline();
+  const std::vector<PipelineSpec> &get_comparison_pipelines();
+  /*
+   * --out-params: the primary pipeline is compared against itself with
+   * buffer-results-to-out-params, whose kernel_call takes its results as
+   * arguments after the inputs. Those buffers are allocated once from the
+   * tensor arena and reused by every call, so the difference to the primary
+   * pipeline is what allocating and first touching the results costs.
+   */
+  void set_out_params_variant(bool flag);
+  /*
+   * --pgo: the primary pipeline is compared against itself with profile
+   * guided objects, trained on the kernel's own inputs right before they
+   * are measured (see pgo_profile.h)
+   */
+  void set_pgo_variant(bool flag);
+  /*
+   * --torch-baseline: after the samples of the main measurement, the
+   * equivalent torch op is measured on the same inputs by the same counter
+   * sessions, once per mode (see torch_baseline.h)
+   */
+  void set_torch_baselines(const std::vector<TorchMode> &modes);
+  // Lowering, compilation and annotations follow `pipeline` from now on
+  void use_pipeline(const PipelineSpec &pipeline);
+  // Target, backend and runtime of a pipeline JSON (`native` resolved)
+  PipelineSpec resolve_pipeline(const fs::path &pipeline_json);
+  fs::path get_output_folder();
+  fs::path get_lowering_folder();
+  fs::path get_model_text_filepath();
+
+  /*
+   * Columns reported for every sample run: the requested perf metrics
+   * followed by the harness' own metrics (e.g. compile_seconds)
+   */
+  std::vector<std::string> get_report_metrics();
+  // The same columns, each with how it combines over kernels
+  std::vector<ReportMetric> get_report_metric_definitions();
+
+  // Metric driving steady state detection, the first requested perf metric
+  std::string get_primary_metric();
 
-  static void generate_metadata_json(const std::string &mlir_filepath,
-                                     const std::string &json_filename,
-                                     const std::string &log_filename = "");
+  /*
+   * Constant columns appended to every row of the result CSVs, describing
+   * how the kernels were built (target CPU, features, ...)
+   */
+  std::vector<std::pair<std::string, std::string>> get_run_annotations();
+  const TargetSpec &get_target();
 
-  static fs::path generate_ll_file(const fs::path &mlirFilePath);
+  /*
+   * Hash of everything besides the LLVM IR that shapes a kernel's samples:
+   * build flags, inputs (seed, profile, layout), cache mode and the
+   * sampling, warmup and outlier settings
+   */
+  std::string get_measurement_hash();
+
+  void initialise_environment();
+  // Isolates the model's kernels and writes their index (kernel_index.h)
+  void isolate_torch_kernels(const std::string &filename);
+  /*
+   * Passes lowering `kernel` after the torch backend pipeline. Kernels with
+   * sparse encodings take the sparse pipeline, others (or none given) the
+   * active one.
+   */
+  std::string extract_pipeline(const fs::path &kernel = fs::path());
+  std::vector<std::string>
+  extract_pass_list(const fs::path &kernel = fs::path());
+
+  void generate_metadata_json(const std::string &mlir_filepath,
+                              const std::string &json_filename,
+                              const std::string &log_filename = "");
+
+  fs::path generate_ll_file(const fs::path &mlirFilePath);
+
+  /*
+   * Runs every compilation stage of a kernel: metadata extraction, lowering
+   * to LLVM IR and (for the shared object engine) the object build.
+   * Thread safe, used by the --jobs worker pool.
+   */
+  bool prepare_kernel(KernelTask &task);
+
+  // Metadata extraction stage on its own (needed before deduplication)
+  bool prepare_metadata(KernelTask &task);
+
+  /*
+   * Lowers a copy of the task's kernel under the active comparison pipeline
+   * (see use_pipeline) into <op folder>/pipelines/<label>/, recorded in
+   * task.pipeline_ll_filepaths. The object is built once to fill the
+   * compilation cache and released again.
+   */
+  bool prepare_pipeline_variant(KernelTask &task, const PipelineSpec &pipeline);
+
+  /*
+   * Shape scaled copy of an isolated kernel, refined by torch-mlir-opt and
+   * written to <op folder>/shapes/<variant>/ with its metadata. The variant
+   * task is ready for prepare_kernel.
+   */
+  bool generate_shape_variant(const KernelTask &task, const ShapeScale &scale,
+                              KernelTask &variant);
+
+  /*
+   * Copy of an isolated kernel with arguments inlined as constants (see
+   * constant_args.h), written to <op folder>/shapes/const/ with its
+   * metadata. `weights` are the model's literals of the kernel's arguments
+   * by index, the listed indices of `constants` get the values the kernel
+   * is measured on. False if nothing could be inlined.
+   */
+  bool generate_const_variant(const KernelTask &task,
+                              const ConstantArgsSpec &constants,
+                              const std::map<size_t, std::string> &weights,
+                              KernelTask &variant);
+
+  /*
+   * Copy of an isolated kernel with the listed arguments sparse_tensor
+   * encoded (see sparse_encoding.h), written to <op folder>/shapes/sparse/
+   * with its metadata, whose encoded arguments are tagged with "sparse".
+   * Arguments the format doesn't fit stay dense. False if none is left.
+   */
+  bool
+  generate_sparse_variant(const KernelTask &task,
+                          const std::map<size_t, SparseArgument> &arguments,
+                          KernelTask &variant);
+
+  /*
+   * Copy of an isolated kernel taking and returning its activations in
+   * `order` (see data_order.h), written to <op folder>/orders/<order>/ with
+   * its metadata. Converted arguments are tagged with "data_order".
+   */
+  bool generate_order_variant(const KernelTask &task, DataOrder order,
+                              KernelTask &variant);
+
+  /*
+   * Copy of an isolated kernel with dynamic activation dimensions (see
+   * ShapeSweep::relax_kernel), refined by torch-mlir-opt and written to
+   * <op folder>/shapes/dynamic/. It keeps the kernel's metadata, whose
+   * shapes the runtime dimensions come from, and lists the metadata of the
+   * `scales` variants to run on the same object.
+   */
+  bool generate_dynamic_variant(const KernelTask &task,
+                                const std::vector<ShapeScale> &scales,
+                                KernelTask &variant);
+
+  /*
+   * Batched linking stage, run once every kernel has been lowered. Kernels of
+   * a batch which fails to link fall back to their own shared object.
+   */
+  void link_kernel_batches(std::vector<KernelTask> &tasks);
   /*
    * Routine used to execute a command in the terminal, and collect its
    * outputs as an array of strings We will need a delimiter to seperate
@@ -97,7 +712,19 @@ public:
   // static void execute_with_python(fs::path json_filepath,
   //                                 const std::string &op_type);
 
-  static std::vector<std::map<std::string, double>>
-  execute_with_parameters(const fs::path &ll_object_filepath,
-                          const fs::path &json_filepath);
+  /*
+   * Runs the configured warmup followed by perf_run_count (or, with adaptive
+   * sampling, as many as needed) measured samples.
+   * Warmup runs are returned through warmup_results when given.
+   * With --cache-mode=both the warm samples are returned and the cold ones go
+   * to cold_results. --torch-baseline samples go to baseline_results, keyed
+   * by TorchCall::describe.
+   */
+  std::vector<std::map<std::string, double>> execute_with_parameters(
+      const fs::path &ll_object_filepath, const fs::path &json_filepath,
+      KernelHandle *prepared_kernel = nullptr,
+      std::vector<std::map<std::string, double>> *warmup_results = nullptr,
+      std::vector<std::map<std::string, double>> *cold_results = nullptr,
+      std::map<std::string, std::vector<std::map<std::string, double>>>
+          *baseline_results = nullptr);
 };
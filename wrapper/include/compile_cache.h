@@ -0,0 +1,80 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+struct CompileCacheCounts {
+  uint64_t lowering_hits = 0;
+  uint64_t lowering_misses = 0;
+  uint64_t object_hits = 0;
+  uint64_t object_misses = 0;
+};
+
+/*
+ * Persistent, content addressed compilation cache
+ *
+ * Layout:
+ *    <cache-dir>/lowering/<key>/kernel.ll          (+ kernel.llvm.mlirbc)
+ *    <cache-dir>/objects/<key>/kernel_call.so
+ *
+ * Lowering keys hash the kernel MLIR contents, the extract_pipeline() pass
+ * string and the identity of the lowering toolchain. Object keys hash the
+ * produced .ll contents, the compiler path/version and the compile flags, so
+ * identical LLVM IR coming from different kernels or pipelines shares one
+ * object.
+ *
+ * Entries are written to a temporary directory and renamed into place, so
+ * concurrent runs sharing a cache directory never observe partial entries.
+ */
+class CompileCache {
+  static bool enabled;
+  static fs::path cache_dir;
+
+  static std::atomic<uint64_t> lowering_hits;
+  static std::atomic<uint64_t> lowering_misses;
+  static std::atomic<uint64_t> object_hits;
+  static std::atomic<uint64_t> object_misses;
+
+  static bool commit_entry(const fs::path &staging_dir,
+                           const fs::path &entry_dir);
+
+public:
+  static void set_enabled(bool flag);
+  static void set_cache_dir(const fs::path &path);
+  static bool is_enabled();
+
+  // Default: $XDG_CACHE_HOME/mlir-bench or ~/.cache/mlir-bench
+  static fs::path default_cache_dir();
+
+  static std::string lowering_key(const fs::path &mlir_filepath,
+                                  const std::string &pipeline,
+                                  const std::string &toolchain_id);
+  static std::string object_key(const fs::path &ll_filepath,
+                                const std::string &compiler_id,
+                                const std::string &compile_flags);
+  // Object key of several .ll files linked into one shared object
+  static std::string object_key(const std::vector<fs::path> &ll_filepaths,
+                                const std::string &compiler_id,
+                                const std::string &compile_flags);
+
+  /*
+   * Restores a cached lowering into the expected output paths.
+   * Returns false on a miss.
+   */
+  static bool fetch_lowering(const std::string &key, const fs::path &ll_filepath,
+                             const fs::path &llvm_mlir_filepath);
+  static void store_lowering(const std::string &key, const fs::path &ll_filepath,
+                             const fs::path &llvm_mlir_filepath);
+
+  // Path of the cached shared object, or an empty path on a miss
+  static fs::path lookup_object(const std::string &key);
+  static void store_object(const std::string &key, const fs::path &so_filepath);
+
+  static CompileCacheCounts counts();
+  static void print_statistics();
+};
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <istream>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// One pass instance of the pipeline JSON, in execution order
+struct PassProfile {
+  std::string name; // pass argument ("affine-loop-fusion") when known
+  double wall_ms = 0.0;
+  size_t ops_before = 0;
+  size_t ops_after = 0;
+};
+
+// Compile cost of one kernel under one pipeline
+struct CompileProfile {
+  bool collected = false;
+  std::vector<PassProfile> passes;
+  double lowering_seconds = 0.0; // torch to .ll, opt included
+  double mlir_opt_seconds = 0.0; // pipeline JSON passes, parse and print
+  double object_seconds = 0.0;   // .ll to shared object
+  size_t linalg_ops = 0;         // ops entering the pipeline
+  size_t llvm_ops = 0;           // ops leaving it
+  uintmax_t ll_bytes = 0;
+  uintmax_t object_bytes = 0;
+};
+
+/*
+ * Per pass compile time and IR size profiling (--compile-profile)
+ *
+ * The pipeline JSON's mlir-opt run additionally gets
+ *    -mlir-timing -mlir-timing-display=tree      wall time per pass instance
+ *    -mlir-print-ir-after-all -mlir-print-ir-module-scope
+ *                                                the module after every pass
+ *    -mlir-disable-threading                     needed for module scope
+ * with its stderr sent to <kernel>.passes.log. The ops of every dump are
+ * counted (lines starting with a dialect qualified op name, plus the short
+ * form `return` and `module`), the log is removed unless --pass-logs is set.
+ *
+ * Profiling bypasses compile cache lookups, so that every kernel is actually
+ * lowered and built, and the in-process lowering engine, whose passes run
+ * without a timing report.
+ */
+class CompileProfiler {
+  static bool enabled;
+
+public:
+  static void set_enabled(bool flag);
+  static bool is_enabled();
+
+  // Flags appended to the mlir-opt command, stderr redirected to `log`
+  static std::string mlir_opt_flags(const fs::path &log);
+  static fs::path log_filepath(const fs::path &mlir_filepath);
+
+  static size_t count_ops(std::istream &ir);
+  static size_t count_ops(const fs::path &mlir_filepath);
+
+  /*
+   * Reads the passes and the mlir-opt total of a log written with
+   * mlir_opt_flags(), starting from `input_ops` ops. False if the log has no
+   * timing report.
+   */
+  static bool parse_log(const fs::path &log, size_t input_ops,
+                        CompileProfile &profile);
+};
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+/*
+ * Arguments inlined by --const-args: "weights" takes every argument the
+ * model feeds from a torch.vtensor.literal, with the model's values. Listed
+ * argument indices are inlined with the values the kernel would be measured
+ * on (their --tensor-source file, else the generated ones).
+ */
+struct ConstantArgsSpec {
+  bool weights = false;
+  std::set<size_t> indices;
+
+  bool empty() const { return !weights && indices.empty(); }
+};
+
+/*
+ * Constant specialized kernels (--const-args)
+ *
+ * In the deployed model the weights are constants, which the pipeline can
+ * fold, pack and relayout at compile time. Isolation turns them into
+ * arguments. The specialized variant of a kernel takes them out of the
+ * kernel_call signature again and defines each as
+ *    %argN = torch.vtensor.literal(dense<"0x..."> : tensor<...>) : !torch...
+ * at the top of the body, so nothing else of the kernel changes. Values are
+ * written as hex DenseElementsAttr rather than dense_resource blobs, which
+ * the folders can look into.
+ *
+ * The variant is written to <op folder>/shapes/const/ and lowered and
+ * measured like the shape variants (CommandManager::generate_const_variant).
+ */
+class ConstantArgs {
+public:
+  // "weights", "<i>[,<j>...]" or both, e.g. "weights,0"
+  static bool parse(const std::string &spec, ConstantArgsSpec &constants);
+
+  /*
+   * Literal attributes of the model's weights that reach the kernels of
+   * `layers` (layer indices of model_layers.json), by layer and argument
+   * index. The model text has to carry its weights, a bytecode model is
+   * printed in full first. Elided weights are skipped.
+   */
+  static std::map<size_t, std::map<size_t, std::string>>
+  model_weights(const fs::path &model_text_filepath,
+                const std::set<std::string> &op_types,
+                const std::set<size_t> &layers);
+
+  /*
+   * Hex DenseElementsAttr of `bytes` raw values for a kernel argument type
+   * (!torch.vtensor<[64,3,11,11],f32>). Empty for types without a builtin
+   * tensor equivalent, and for i1 whose dense storage is packed.
+   */
+  static std::string dense_literal(const std::string &vtensor_type,
+                                   const void *data, size_t bytes);
+
+  /*
+   * The kernel with the arguments of `literals` (by argument index) inlined.
+   * A literal whose tensor type doesn't match its argument is left out.
+   * False if no argument was inlined.
+   */
+  static bool specialize(const std::string &kernel_text,
+                         const std::map<size_t, std::string> &literals,
+                         std::string &specialized, size_t &inlined);
+
+  // Argument types of kernel_call, in order
+  static std::vector<std::string>
+  argument_types(const std::string &kernel_text);
+};
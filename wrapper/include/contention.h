@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ * Co-running stressor of a contention profile
+ *
+ * BANDWIDTH - streams reads and writes through a buffer of several LLC
+ *             sizes, saturating the memory controllers
+ * LLC       - touches random lines of an LLC sized buffer, evicting the
+ *             kernel's lines from the shared cache
+ * SPIN      - dependent integer and FP arithmetic, competing for the
+ *             execution ports of an SMT sibling
+ */
+enum class StressorKind { BANDWIDTH, LLC, SPIN };
+
+/*
+ * CPUs the stressor threads run on, relative to the measurement CPU
+ *
+ * SMT    - its SMT siblings
+ * CORE   - one CPU of the nearest other core on the same socket
+ * SOCKET - every other CPU of the socket outside its own core
+ */
+enum class StressorPlacement { SMT, CORE, SOCKET };
+
+struct ContentionProfile {
+  StressorKind kind = StressorKind::SPIN;
+  StressorPlacement placement = StressorPlacement::CORE;
+
+  // "bandwidth-socket", used for the result suffix and the summary
+  std::string name() const;
+};
+
+/*
+ * Noisy neighbours for the duration of a measurement (--contention)
+ *
+ * One stressor thread per placement CPU, pinned, started before the
+ * kernel's measurement and stopped after it. Buffers are touched before
+ * start() returns, so the measurement never sees their page faults. The
+ * threads are created before any counter is opened, so inherited counting
+ * does not follow them. System wide per-core counting does count them.
+ */
+class ContentionGenerator {
+public:
+  ContentionGenerator(const ContentionProfile &profile, int measure_cpu);
+  ~ContentionGenerator();
+
+  ContentionGenerator(const ContentionGenerator &) = delete;
+  ContentionGenerator &operator=(const ContentionGenerator &) = delete;
+
+  // False if the placement has no CPU on this machine
+  bool start();
+  void stop();
+
+  const std::vector<int> &cpus() const { return m_cpus; }
+
+  /*
+   * --contention entries, comma separated "<kind>[@<placement>]" with kinds
+   * bandwidth, llc, spin and placements smt, core (default), socket.
+   * False on an unknown entry.
+   */
+  static bool parse(const std::string &list,
+                    std::vector<ContentionProfile> &profiles);
+
+  static std::vector<int> placement_cpus(StressorPlacement placement,
+                                         int measure_cpu);
+
+private:
+  void run(int cpu, size_t index);
+
+  ContentionProfile m_profile;
+  std::vector<int> m_cpus;
+  std::vector<std::vector<uint64_t>> m_buffers;
+  std::vector<std::thread> m_threads;
+  std::atomic<bool> m_stop{false};
+  std::atomic<size_t> m_ready{0};
+};
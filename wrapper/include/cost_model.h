@@ -0,0 +1,84 @@
+#pragma once
+
+#include "command_manager.h"
+#include "nlohmann/json.hpp"
+#include "results_store.h"
+
+#include <filesystem>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+using json = nlohmann::json;
+
+// What the cost model knows about a kernel before measuring it
+struct CostFeatures {
+  std::string op_type;
+  std::string pipeline;         // Pipeline JSON label
+  std::string structural_class; // See linalg_structure.h, "" if unknown
+  double flops = 0.0;           // KernelCosts::estimate
+  double bytes_moved = 0.0;     // Arguments read once, results written once
+  int num_loops = 0, num_parallel = 0, num_reduction = 0;
+};
+
+/*
+ * Learned per kernel cost (cost-model subcommand, --cost-model)
+ *
+ * A ridge regression in log space: log(metric) from log FLOPs, log bytes
+ * moved, the main generic's loop counts and one-hot op type, structural
+ * class and pipeline. It is trained on the kernel averages of finished
+ * runs' results stores and saved as JSON, the weights keyed by feature
+ * name ("log_flops", "op_type=convolution", "pipeline=o2", ...) so that
+ * categories it never saw simply weigh nothing:
+ *    { "metric": "cycles", "weights": { "bias": ..., ... },
+ *      "residual_std": 0.21, "r2": 0.93, "kernels": 812, "sources": [...] }
+ * residual_std is the standard deviation of the training residuals in
+ * natural log units.
+ *
+ * A benchmark run with --cost-model measures its kernels in order of
+ * predicted cost times multiplicity, so a --time-budget is spent on the
+ * kernels that weigh most in the model, and flags measurements whose
+ * distance to the prediction exceeds --cost-model-tolerance residual
+ * deviations (and a factor of 2) as likely noise or miscompilation.
+ */
+class CostModel {
+public:
+  const std::string &metric() const { return m_metric; }
+  double residual_std() const { return m_residual_std; }
+  bool empty() const { return m_weights.empty(); }
+
+  // Kernel averages of every store in output_dirs, false without data
+  bool train(const std::vector<fs::path> &output_dirs,
+             const std::string &metric, double ridge);
+  bool load(const fs::path &json_filepath);
+  bool save(const fs::path &json_filepath) const;
+
+  // Predicted metric, 0 for an empty model
+  double predict(const CostFeatures &features) const;
+  // Distance of measured from predicted, in residual deviations
+  double deviation(double predicted, double measured) const;
+
+  static CostFeatures features_of(const KernelTask &task,
+                                  const std::string &pipeline);
+  static CostFeatures features_of(const StoredKernel &kernel,
+                                  const std::string &pipeline);
+
+  /*
+   * One row per predicted kernel, the largest deviations first:
+   *    op_type,kernel,predicted,measured,ratio,deviation,flagged
+   * Flagged kernels are also listed on stderr. Returns the flagged count.
+   */
+  size_t write_check(const std::vector<KernelTask> &tasks, double tolerance,
+                     const fs::path &csv_filepath) const;
+
+private:
+  std::string m_metric;
+  std::map<std::string, double> m_weights;
+  double m_residual_std = 0.0;
+  double m_r2 = 0.0;
+  size_t m_kernels = 0;
+  std::vector<std::string> m_sources;
+
+  static std::map<std::string, double> encode(const CostFeatures &features);
+};
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+/*
+ * Counter batches (--counter-batches)
+ *
+ * More PMU events than the CPU has counters make the kernel multiplex them,
+ * and the scaled values of short kernels come out noisy or zero. Instead,
+ * the events are split into batches that each fit the counters, every batch
+ * gets its own counter window per sample, and the windows are merged by
+ * event. Every batch also counts the anchor event (cycles, else
+ * instructions, else the first PMU event), whose spread across the windows
+ * of a sample is reported as anchor_drift.
+ *
+ * Time metrics and software events don't take a counter and stay in the
+ * first batch, which is the one reporting them.
+ */
+class CounterScheduler {
+public:
+  // General purpose counters per hardware thread: 6 on AMD, 4 otherwise
+  static unsigned int default_counters();
+
+  /*
+   * Batches of at most `counters` PMU events, the anchor included. A single
+   * batch (the metrics unchanged) if they already fit.
+   */
+  static std::vector<std::vector<std::string>>
+  partition(const std::vector<std::string> &metrics, unsigned int counters,
+            std::string &anchor);
+
+  // False for time metrics and software events
+  static bool uses_counter(const std::string &metric);
+};
@@ -0,0 +1,122 @@
+#pragma once
+
+#include "perfcpp/event_counter.h"
+
+#include <chrono>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+/*
+ * Counter session modes
+ *
+ * PER_SAMPLE - A new perf::EventCounter (and perf file descriptors) for every
+ *              sample (original behaviour)
+ * SESSION    - Counters are opened once per kernel and only enabled/disabled
+ *              around each sample
+ * LIVE       - Counters run for the whole kernel and are read from user space
+ *              via rdpmc (perf::LiveEventCounter). Time metrics are taken
+ *              from the steady clock. x86 only, falls back to SESSION.
+ */
+enum CounterMode { PER_SAMPLE, SESSION, LIVE };
+
+/*
+ * Threads covered by the counters (parallel kernels, e.g. lowered with
+ * convert-scf-to-openmp or the async runtime)
+ *
+ * CALLING_THREAD - Only the thread calling the kernel (original behaviour)
+ * INHERIT        - The calling thread plus every thread it spawns while the
+ *                  counters are open, aggregated by the kernel
+ * PER_CORE       - One system wide counter per online CPU, giving a per core
+ *                  breakdown of parallel kernels. Needs perf_event_paranoid
+ *                  <= 0 (or root). Time metrics come from the steady clock.
+ */
+enum ThreadScope { CALLING_THREAD, INHERIT, PER_CORE };
+
+/*
+ * Counter session of a single kernel
+ *
+ * The session owns the metric names, the CounterResults it returns refer to
+ * them and must not outlive it. Every entry of event_groups is opened as one
+ * perf group on top of the metrics (e.g. topdown events and their leader).
+ *
+ * tsc-nanoseconds is read from the time stamp counter (see tsc_clock.h)
+ * around the perf window, in every mode and scope. When perf can't be
+ * opened, a session with TSC metrics carries on with those alone.
+ */
+class CounterSession {
+public:
+  CounterSession(CounterMode mode, const std::vector<std::string> &metrics,
+                 ThreadScope scope = ThreadScope::CALLING_THREAD,
+                 const std::vector<std::vector<std::string>> &event_groups =
+                     {});
+  ~CounterSession();
+
+  CounterSession(const CounterSession &) = delete;
+  CounterSession &operator=(const CounterSession &) = delete;
+
+  // Opens the counters (SESSION/LIVE). Returns false on failure.
+  bool open();
+  void start();
+  void stop();
+
+  // Counter values of the last start/stop window, divided by normalization
+  // (e.g. the number of kernel calls inside the window)
+  perf::CounterResult result(uint64_t normalization = 1) const;
+
+  /*
+   * Median of `iterations` empty start/stop windows for every metric, i.e.
+   * the cost of a read which can be subtracted from kernel measurements
+   */
+  std::map<std::string, double> measure_overhead(unsigned int iterations);
+
+  /*
+   * Per CPU values of the last window (PER_CORE only), indexed like
+   * core_ids()
+   */
+  std::vector<std::map<std::string, double>>
+  core_results(uint64_t normalization = 1) const;
+  const std::vector<int> &core_ids() const { return m_core_ids; }
+
+  CounterMode mode() const { return m_mode; }
+  ThreadScope scope() const { return m_scope; }
+
+  static bool is_time_metric(const std::string &metric);
+  // Length of one unit of a time metric in seconds (0 for other metrics)
+  static double seconds_per_unit(const std::string &metric);
+
+private:
+  // Perf side of start/stop/result, inside the TSC reads
+  void start_perf();
+  void stop_perf();
+  perf::CounterResult perf_result(uint64_t normalization) const;
+
+  double elapsed_in_unit(const std::string &metric) const;
+  perf::Config counter_config() const;
+  void add_events(perf::EventCounter &counter,
+                  const std::vector<std::string> &metrics) const;
+  bool open_per_core();
+
+  CounterMode m_mode;
+  ThreadScope m_scope;
+  std::vector<std::string> m_metrics;
+  std::vector<std::vector<std::string>> m_event_groups;
+  // Without perf metrics (or perf) only the TSC is read
+  bool m_perf = true;
+  std::unique_ptr<perf::EventCounter> m_counter;
+  std::unique_ptr<perf::LiveEventCounter> m_live;
+
+  // PER_CORE counters, hardware metrics only
+  std::vector<std::unique_ptr<perf::EventCounter>> m_core_counters;
+  std::vector<int> m_core_ids;
+
+  // LIVE and PER_CORE wall clock window
+  std::chrono::steady_clock::time_point m_start;
+  std::chrono::steady_clock::time_point m_stop;
+
+  // TSC metrics and the ticks of the last window
+  std::vector<std::string> m_tsc_metrics;
+  uint64_t m_tsc_start = 0;
+  uint64_t m_tsc_stop = 0;
+};
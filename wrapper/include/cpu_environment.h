@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+/*
+ * Host state affecting measurement stability: frequency governor, turbo and
+ * real time scheduling of the measurement thread. Linux only, other platforms
+ * report "unknown".
+ */
+class CPUEnvironment {
+public:
+  // scaling_governor of the CPU, e.g. "performance" or "powersave"
+  static std::string governor(int cpu);
+
+  // "on", "off" or "unknown" (intel_pstate/no_turbo or cpufreq/boost)
+  static std::string turbo_state();
+
+  // Current frequency of the CPU in MHz, 0 if unavailable
+  static double current_frequency_mhz(int cpu);
+
+  // Warns about settings known to make results drift
+  static void check_measurement_cpu(int cpu);
+};
+
+/*
+ * Runs the calling thread under SCHED_FIFO while in scope and restores the
+ * previous policy afterwards. Requires CAP_SYS_NICE (i.e. sudo).
+ */
+class ScopedRealtimePriority {
+public:
+  explicit ScopedRealtimePriority(bool enable, int priority = 1);
+  ~ScopedRealtimePriority();
+
+  ScopedRealtimePriority(const ScopedRealtimePriority &) = delete;
+  ScopedRealtimePriority &operator=(const ScopedRealtimePriority &) = delete;
+
+  bool active() const { return m_active; }
+
+private:
+  bool m_active = false;
+  int m_previous_policy = 0;
+  int m_previous_priority = 0;
+};
+
+/*
+ * Denormal handling of the calling thread while in scope, restored afterwards:
+ * flush_denormals sets flush-to-zero and denormals-are-zero (MXCSR FTZ and
+ * DAZ on x86-64, FPCR.FZ on AArch64), otherwise both are cleared for IEEE
+ * gradual underflow. Threads created in scope inherit the mode, runtime
+ * workers started before don't.
+ */
+class ScopedFloatMode {
+public:
+  explicit ScopedFloatMode(bool flush_denormals);
+  ~ScopedFloatMode();
+
+  ScopedFloatMode(const ScopedFloatMode &) = delete;
+  ScopedFloatMode &operator=(const ScopedFloatMode &) = delete;
+
+private:
+  bool m_active = false;
+  uint64_t m_previous = 0;
+};
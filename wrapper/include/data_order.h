@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+ * Memory order of a rank 4 activation, whose logical dimensions are always
+ * N, C, H, W (the order torch ops are written in):
+ *    NCHW    - [N, C, H, W], torch's own
+ *    NCWH    - [N, C, W, H]
+ *    NHWC    - [N, H, W, C], channels last
+ *    NCHW8C  - [N, C/8, H, W, 8], channel blocks of 8 innermost
+ *    NCHW16C - [N, C/16, H, W, 16]
+ */
+enum DataOrder { NCHW, NCWH, NHWC, NCHW8C, NCHW16C };
+
+/*
+ * Data order variants of isolated kernels
+ *
+ * torch operators only take NCHW, so a variant keeps the op and changes its
+ * boundary: rank 4 kernel_call arguments shaped like the first one, and rank
+ * 4 results of the same batch, are stored in the variant's order.
+ * torch.aten.permute (and torch.aten.reshape for blocked orders) converts
+ * them into and out of NCHW right at the kernel entry and return, where the
+ * lowering can fuse or fold them into the op's loops. Tensors whose channels
+ * don't divide into the block stay NCHW.
+ */
+class DataOrders {
+public:
+  // "nchw", "ncwh", "nhwc", "nchw8c", "nchw16c"
+  static bool parse(const std::string &name, DataOrder &order);
+  static std::string describe(DataOrder order);
+
+  // Comma separated orders, unknown names are reported and skipped
+  static std::vector<DataOrder> parse_list(const std::string &spec);
+
+  // Stored shape of a logical [N, C, H, W] shape, false if not expressible
+  static bool stored_shape(DataOrder order,
+                           const std::vector<uint64_t> &logical,
+                           std::vector<uint64_t> &stored);
+  // Inverse of stored_shape
+  static bool logical_shape(DataOrder order,
+                            const std::vector<uint64_t> &stored,
+                            std::vector<uint64_t> &logical);
+
+  // Element offset of logical element (n, c, h, w) in the stored tensor
+  static uint64_t stored_index(DataOrder order,
+                               const std::vector<uint64_t> &logical,
+                               uint64_t n, uint64_t c, uint64_t h, uint64_t w);
+
+  /*
+   * Kernel with its boundary tensors in `order`. converted_args lists the
+   * kernel_call arguments stored in that order. False if no argument or
+   * result could be converted.
+   */
+  static bool rewrite_kernel(const std::string &mlir_text, DataOrder order,
+                             std::string &rewritten,
+                             std::vector<size_t> &converted_args);
+};
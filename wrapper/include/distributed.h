@@ -0,0 +1,84 @@
+#pragma once
+
+#include "kernel_sandbox.h"
+#include "nlohmann/json.hpp"
+
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+using json = nlohmann::json;
+
+struct DistributedConfig {
+  std::vector<std::string> hosts; // ssh destinations, e.g. user@node1
+  fs::path remote_dir = "/tmp/wrapper-worker";
+  std::string remote_binary; // WrapperModule on the workers
+  unsigned int shard_size = 8;
+  // Consecutive failed shards before a node is dropped
+  unsigned int max_node_failures = 2;
+  // Command line of the coordinator, minus the distributed flags,
+  // --output-dir and --pipeline
+  std::vector<std::string> forwarded_args;
+  std::string model_file; // among forwarded_args, never shipped
+};
+
+/*
+ * Distributed benchmarking (--workers)
+ *
+ * The coordinator isolates, deduplicates and generates variants as usual,
+ * then ships shards of kernels (MLIR, metadata JSON, activation statistics
+ * and the pipeline) over scp to `WrapperModule ... --worker <shard>` runs on
+ * the worker hosts. A worker compiles and measures its shard with the
+ * forwarded flags and writes one serialized SandboxResult (or the failure)
+ * per kernel under <shard>/results, next to its hardware fingerprint.
+ *
+ * With a cross target (a pipeline "target_triple" of another architecture,
+ * see target_spec.h) the coordinator compiles every kernel to an object for
+ * that triple and ships it along; the worker only links it and measures.
+ * Kernels no worker took are failures then, the coordinator can't run them.
+ *
+ * Every run has its own folder <remote_dir>/<output name>-<run id> on the
+ * workers, so coordinators sharing a worker never overwrite each other.
+ * Forwarded flags naming local files or folders are shipped into it and
+ * rewritten to point there.
+ *
+ * Results are reported into the coordinator's output tree like local ones,
+ * every row tagged with the node and its fingerprint. A shard whose worker
+ * fails (ssh/scp errors, results missing) goes back to the queue for the
+ * other nodes, never to one that already failed it; if every live node has,
+ * the coordinator measures it. A node is dropped after max_node_failures
+ * failed shards in a row. Kernels failing on a worker are failures like in a
+ * local run and aren't retried.
+ */
+class Distributed {
+public:
+  // Called for every finished kernel, result is null if it failed (see
+  // task.failure). Calls are serialized.
+  using ReportFn = std::function<void(KernelTask &, const SandboxResult *)>;
+
+  /*
+   * Measures `tasks` on the workers. Returns the indices of the tasks no
+   * node could take, for the caller to measure locally.
+   */
+  static std::vector<size_t> coordinate(std::vector<KernelTask> &tasks,
+                                        const DistributedConfig &config,
+                                        const fs::path &output_dir,
+                                        const fs::path &pipeline_json,
+                                        const ReportFn &report);
+
+  // --worker: the kernels of <shard_dir>/manifest.json
+  static bool read_shard(const fs::path &shard_dir,
+                         std::vector<KernelTask> &tasks);
+
+  // <shard_dir>/results/<index>.samples, or .failure with result null
+  static bool write_worker_result(const fs::path &shard_dir, size_t index,
+                                  const SandboxResult *result,
+                                  const std::string &failure);
+
+  // CPU model, cores, caches, memory and kernel release of this host
+  static json fingerprint();
+  // Short stable id of a fingerprint
+  static std::string fingerprint_id(const json &fingerprint);
+};
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "report_metric.h"
+
+namespace fs = std::filesystem;
+
+/*
+ * DRAM traffic of the measuring CPU's package (--dram-traffic)
+ *
+ * Core events like cache-misses count what one core asks for, not what the
+ * memory controllers serve. This opens the uncore IMC PMUs
+ * (/sys/bus/event_source/devices/uncore_imc*) system wide on the CPU their
+ * cpumask lists for the package, like `perf stat -a -e
+ * uncore_imc_0/cas_count_read/`: cas_count_read and cas_count_write on
+ * server parts, data_reads and data_writes on client parts, summed over
+ * every channel. Needs perf_event_paranoid <= 0 or CAP_PERFMON, and Intel
+ * uncore support in the kernel; otherwise nothing is available.
+ *
+ * The controllers serve the whole package, so anything else running on it
+ * is counted as well.
+ */
+class DramCounter {
+public:
+  // IMC channels of the package of `cpu`, none if unreadable
+  explicit DramCounter(int cpu);
+  ~DramCounter();
+
+  DramCounter(const DramCounter &) = delete;
+  DramCounter &operator=(const DramCounter &) = delete;
+
+  bool available() const { return !m_events.empty(); }
+  size_t channels() const { return m_channels; }
+
+  void start();
+  void stop();
+
+  /*
+   * Per call columns of a window of `calls` kernel calls:
+   *    dram_read_bytes, dram_write_bytes, dram_bytes
+   *    dram_bandwidth_gbs  bytes over the window's length
+   */
+  std::map<std::string, double> window_columns(uint64_t calls) const;
+
+  /*
+   * The columns above and, from the kernel's cost (see kernel_cost.h):
+   *    dram_intensity      FLOPs per DRAM byte
+   *    dram_traffic_ratio  DRAM bytes over the bytes its tensors hold;
+   *                        below 1 the data is served from the caches
+   * The byte counts add up over kernels, the rest don't.
+   */
+  static std::vector<ReportMetric> columns();
+
+private:
+  struct Event {
+    bool write = false;
+    int fd = -1;
+    double bytes_per_count = 64.0;
+    uint64_t start = 0, stop = 0;
+  };
+  std::vector<Event> m_events;
+  size_t m_channels = 0;
+  std::chrono::steady_clock::time_point m_start, m_stop;
+
+  void open_pmu(const fs::path &pmu, int package);
+  uint64_t read(const Event &event) const;
+};
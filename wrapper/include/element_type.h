@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+ * Tensor element types the harness can generate and decode
+ *
+ * Names follow the torch / builtin dialects: f32, f16, bf16, f64, i1, si8 /
+ * i8, ui8, si16 / i16, si32 / i32 and si64 / i64. Storage is the natural C
+ * layout, i1 takes a byte per element as in MLIR memrefs.
+ */
+enum ElementType { F32, F16, BF16, F64, I1, I8, U8, I16, I32, I64 };
+
+class ElementTypes {
+public:
+  // Unknown names are reported and treated as f32
+  static ElementType parse(const std::string &dtype);
+  static std::string describe(ElementType type);
+  static size_t size(ElementType type);
+  static bool is_floating_point(ElementType type);
+
+  // Column used for the per dtype traffic of a kernel ("bytes_f32", ...)
+  static std::string bytes_column(ElementType type);
+  static const std::vector<ElementType> &all();
+
+  // IEEE half and bfloat16 conversions, round to nearest even
+  static uint16_t float_to_half(float value);
+  static float half_to_float(uint16_t bits);
+  static uint16_t float_to_bfloat16(float value);
+  static float bfloat16_to_float(uint16_t bits);
+
+  // Element i of a buffer of the given type
+  static void store(void *buffer, int64_t index, ElementType type,
+                    double value);
+  static double load(const void *buffer, int64_t index, ElementType type);
+};
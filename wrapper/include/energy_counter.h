@@ -0,0 +1,93 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "report_metric.h"
+
+namespace fs = std::filesystem;
+
+struct EnergyConfig {
+  bool enabled = false;
+  // RAPL counters update about every millisecond, shorter windows are
+  // raised to this through inner repetitions
+  double min_window_seconds = 0.01;
+  // Idle window measured before each kernel's samples, 0 = none
+  double idle_seconds = 0.05;
+};
+
+/*
+ * RAPL energy of the measuring CPU's package (--energy)
+ *
+ * Domains come from the perf power PMU (power/energy-pkg, energy-cores,
+ * energy-ram, energy-psys), opened system wide on the CPU the PMU's cpumask
+ * lists for the package, like `perf stat -a -e power/energy-pkg/`. That needs
+ * perf_event_paranoid <= 0 or CAP_PERFMON. Without it the powercap files
+ * (/sys/class/powercap/intel-rapl:<package>[:<n>]/energy_uj) are read
+ * instead, with their wraparound.
+ *
+ * The counters cover the whole package and tick about once a millisecond,
+ * so a window is only meaningful when it is long compared to that: sampling
+ * raises the inner repetitions until a window lasts min_window_seconds and
+ * reports joules per call. The package's idle power, taken from a sleeping
+ * window before the samples, is what the rest of the system burns meanwhile;
+ * energy_net_j subtracts it.
+ */
+class EnergyCounter {
+public:
+  // Domains of the package of `cpu`, none if RAPL is unreadable
+  explicit EnergyCounter(int cpu);
+  ~EnergyCounter();
+
+  EnergyCounter(const EnergyCounter &) = delete;
+  EnergyCounter &operator=(const EnergyCounter &) = delete;
+
+  bool available() const { return !m_domains.empty(); }
+  // "perf" or "powercap"
+  const std::string &source() const { return m_source; }
+
+  void start();
+  void stop();
+  // Joules of every domain ("pkg", "cores", "ram", "psys") in the last
+  // window, and its length
+  std::map<std::string, double> joules() const;
+  double seconds() const;
+
+  // Watts per domain over `seconds` of sleep
+  std::map<std::string, double> measure_idle(double seconds);
+
+  /*
+   * Per call columns of a window of `calls` kernel calls:
+   *    energy_pkg_j, energy_cores_j, energy_ram_j, energy_psys_j
+   *    energy_net_j  pkg + ram minus their idle power over the window
+   *    power_pkg_w   average package power during the window
+   * Domains the package doesn't have are 0.
+   */
+  std::map<std::string, double>
+  window_columns(uint64_t calls,
+                 const std::map<std::string, double> &idle_watts) const;
+
+  // The columns above and gflops_per_j, the energies add up over kernels
+  static std::vector<ReportMetric> columns();
+
+private:
+  struct Domain {
+    std::string name;
+    int fd = -1;       // perf
+    double scale = 0;  // Joules per count
+    fs::path filepath; // powercap energy_uj
+    uint64_t range = 0;
+    uint64_t start = 0, stop = 0;
+  };
+  std::vector<Domain> m_domains;
+  std::string m_source;
+  std::chrono::steady_clock::time_point m_start, m_stop;
+
+  bool open_perf(int package);
+  bool open_powercap(int package);
+  uint64_t read(const Domain &domain) const;
+};
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <sys/types.h>
+
+/*
+ * Forking measurement workers from a multithreaded process
+ *
+ * A forked worker only has the thread that forked it. A lock that any other
+ * thread held at that moment (the JIT's, a pool's queue, the telemetry sink)
+ * stays locked in the worker for good, and the worker hangs on it. Work that
+ * takes such locks runs inside a ForkGate::Section: ThreadPool tasks, the
+ * result writer's jobs and the telemetry threads. fork() stops new sections
+ * from opening, waits for the open ones to end and forks with none of them
+ * running. The compilation pool therefore only pauses for the kernels it is
+ * in the middle of.
+ *
+ * Sections of the forking thread itself don't hold it up, and a worker starts
+ * with a gate of its own.
+ */
+class ForkGate {
+public:
+  class Section {
+  public:
+    Section();
+    ~Section();
+    Section(const Section &) = delete;
+    Section &operator=(const Section &) = delete;
+  };
+
+  // ::fork() while no other thread is inside a section
+  static pid_t fork();
+};
@@ -0,0 +1,127 @@
+#pragma once
+
+#include "parallel_runtime.h"
+#include "utils.h"
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+/*
+ * Device side of CUDA_RUNTIME / ROCM_RUNTIME kernels
+ *
+ * The driver (libcuda.so.1 or libamdhip64.so) is loaded with dlopen when the
+ * first GPU kernel runs, so the harness builds and runs without either. It
+ * is used for the device copies of the arguments and for event timing, the
+ * launches themselves go through the MLIR runtime wrappers linked into the
+ * kernel. Both use the primary context of device 0.
+ *
+ * instrument_ll() redirects the kernel's mgpuLaunchKernel calls to a
+ * forwarder appended to the .ll, which calls through a hook table
+ *
+ *    [2 x ptr] mlir_bench_gpu_hooks = { launch_begin, launch_end }
+ *
+ * around the real launch, passing the launch stream. Inside a window, the
+ * hooks record a pair of events on that stream, so device time covers the
+ * kernels only: not the module load, stream creation or synchronisation of
+ * the host code. Launches are expected from the calling thread only.
+ */
+class GpuRuntime {
+public:
+  static const char *HOOK_TABLE_SYMBOL;
+
+  // Loads the driver and makes device 0 current, false if not available
+  static bool open(ParallelRuntimeKind kind);
+
+  static void *allocate(uint64_t bytes);
+  static void release(void *device_ptr);
+  static bool copy_to_device(void *device_ptr, const void *host_ptr,
+                             uint64_t bytes);
+  static bool copy_to_host(void *host_ptr, const void *device_ptr,
+                           uint64_t bytes);
+
+  // Returns false (leaving the file untouched) if nothing was instrumented
+  static bool instrument_ll(const fs::path &ll_filepath);
+
+  /*
+   * Chip of device 0 ("sm_80", "gfx90a"), empty without one. Read through
+   * nvidia-smi or the KFD topology in sysfs, so that no driver is
+   * initialised in a process that forks measurement workers later.
+   */
+  static std::string device_chip(ParallelRuntimeKind kind);
+  // "8.0" (nvidia-smi's compute_cap) -> "sm_80"
+  static std::string cuda_chip(const std::string &compute_capability);
+  // KFD gfx_target_version 90010 -> "gfx90a"
+  static std::string rocm_chip(unsigned int gfx_target_version);
+
+  // Sets the chip of nvvm-/rocdl-attach-target unless the pass names one
+  static void apply_to_pass_list(const std::string &chip,
+                                 std::vector<std::string> &pass_list);
+
+  // Passes up to and including gpu-kernel-outlining, 0 without it
+  static size_t outlined_depth(const std::vector<std::string> &pass_list);
+
+  /*
+   * First memory access left in the host code of outlined IR (text): a
+   * memref alloc, copy, load or store, a vector or affine access, a linalg
+   * op or an unmapped scf.parallel outside the gpu.modules. Such code would
+   * work on the device buffers from the host. Empty if there is none.
+   */
+  static std::string host_memory_access(const fs::path &outlined_mlir);
+
+  // Fills a mlir_bench_gpu_hooks table resolved from a loaded kernel
+  static void install(void *hook_table);
+
+  // Starts recording launch events, recycling the ones of the last window
+  static void begin_window();
+
+  /*
+   * Stops recording and waits for the last event. Per call, over `calls`:
+   *    device_seconds   summed kernel time between the launch events
+   *    device_launches  number of kernel launches
+   */
+  static std::map<std::string, double> window_columns(uint64_t calls);
+
+  // Window columns plus the argument transfers of the harness
+  //    h2d_bytes / h2d_seconds  inputs (and out-params) copied to the device
+  //    d2h_bytes / d2h_seconds  out-params copied back after sampling
+  static std::vector<std::string> columns();
+
+private:
+  static void launch_begin(void *stream);
+  static void launch_end(void *stream);
+  static void *next_event();
+};
+
+/*
+ * Device buffer arena
+ *
+ * Device counterpart of TensorArena: arguments are placed in large device
+ * slabs with a bump allocator and reset() recycles them between kernels.
+ * Slabs are only returned to the driver when the arena is destroyed.
+ */
+class DeviceArena {
+public:
+  static const uint64_t ALIGNMENT = 256;
+
+  DeviceArena() = default;
+  ~DeviceArena();
+
+  DeviceArena(const DeviceArena &) = delete;
+  DeviceArena &operator=(const DeviceArena &) = delete;
+
+  // nullptr if no slab could be allocated
+  void *allocate(uint64_t bytes);
+  void reset();
+
+private:
+  struct Slab {
+    uint8_t *base = nullptr;
+    uint64_t size = 0;
+    uint64_t used = 0;
+  };
+
+  std::vector<Slab> m_slabs;
+  size_t m_current = 0;
+};
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "nlohmann/json.hpp"
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+using json = nlohmann::json;
+
+/*
+ * Self-contained HTML report (report subcommand, --html-report)
+ *
+ * Reads one or more output directories' results stores, the first being the
+ * baseline, and writes
+ *    report.json  per set: kernels matched by hash with the statistics of
+ *                 every metric, derived rates and the primary metric's
+ *                 samples; op type and structural class totals (weighted
+ *                 by multiplicity, rate metrics averaged like graph-gen's
+ *                 inter-op comparison)
+ *    report.html  the same JSON embedded with a small script: metric picker,
+ *                 op type or structural class comparison (see
+ *                 linalg_structure.h), sortable and filterable kernel table
+ *                 drawn a page at a time, per kernel drill-down with a strip
+ *                 plot of the samples. No network access or Python needed.
+ */
+class HtmlReport {
+public:
+  // Metrics that are averaged, not summed, over an op type
+  static bool is_rate_metric(const std::string &metric);
+
+  // False if a directory has no results store
+  static bool build(const std::vector<fs::path> &output_dirs,
+                    const std::vector<std::string> &labels, json &report);
+
+  static bool write(const json &report, const fs::path &folder);
+};
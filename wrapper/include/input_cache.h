@@ -0,0 +1,44 @@
+#pragma once
+
+#include "tensor_fuzzer.h"
+#include "utils.h"
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+/*
+ * Generated inputs shared across kernels (--input-cache)
+ *
+ * Every generated tensor is a file <dir>/<key>.bin, keyed by everything that
+ * determines its contents: element type and count, profile, sparsity, data
+ * order and seed. The seed is the one used without the cache, so the cache
+ * never changes the inputs; the pipelines of a kernel, and later runs with
+ * the same --seed, read the file instead of generating it again.
+ *
+ * Files live on disk (or tmpfs) rather than in the process, since every
+ * measurement runs in a forked worker (see kernel_sandbox.h). Their contents
+ * are copied into a buffer of the caller, taken from the tensor arena, so
+ * cached inputs keep the arena's alignment, huge pages and NUMA placement.
+ * Misses are generated into that buffer and written to a temporary file,
+ * published by an atomic rename.
+ */
+class InputCache {
+public:
+  explicit InputCache(const fs::path &directory);
+
+  // Content key of the tensor `info` describes
+  static std::string key(const DataFormatInfo &info);
+
+  /*
+   * Copies the `bytes` cached under `key` into `destination`. On a miss,
+   * `fill` generates them there and they are added to the cache. False only
+   * if `fill` fails; a file that can't be read or written just costs the
+   * generation.
+   */
+  bool load(const std::string &key, void *destination, uint64_t bytes,
+            const std::function<bool(void *)> &fill, bool &hit);
+
+private:
+  fs::path m_directory;
+};
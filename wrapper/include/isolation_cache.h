@@ -0,0 +1,42 @@
+#pragma once
+
+#include "command_manager.h"
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+/*
+ * Isolated kernels of a model kept across runs (--isolation-cache)
+ *
+ * Isolation runs torch-opt over the whole model, and kernels whose signature
+ * can't be read get a metadata pass each. Runs of the same model with the
+ * same torch-opt, such as the jobs of the benchmark server, copy both from
+ * <dir>/<key>/ instead:
+ *    kernel_index.json
+ *    <op>/<kernel>.mlir        the isolated kernels
+ *    <op>/<kernel>.mlir.json   their argument metadata, once generated
+ * The key hashes the model's contents and torch-opt's path and mtime. An
+ * entry is published by renaming a temporary folder, the metadata files are
+ * added to it (each through its own rename) once the first run has them.
+ */
+class IsolationCache {
+public:
+  static std::string key(const fs::path &model_filepath,
+                         const fs::path &torch_opt_exec);
+
+  // Copies the entry into the lowering folder, false if there is none
+  static bool restore(const fs::path &cache_dir, const std::string &key,
+                      const fs::path &lowering_folder);
+
+  // Publishes the index and isolated kernels of the lowering folder
+  static bool store(const fs::path &cache_dir, const std::string &key,
+                    const fs::path &lowering_folder);
+
+  // Adds the metadata of the tasks that have it to an existing entry
+  static void store_metadata(const fs::path &cache_dir, const std::string &key,
+                             const fs::path &lowering_folder,
+                             const std::vector<KernelTask> &tasks);
+};
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+/*
+ * Kernel execution engine selection
+ *
+ * SHARED_OBJECT - Compile the .ll with the configured compiler (--cc) into a
+ *                 shared object and dlopen it (original behaviour)
+ * ORC_JIT       - Compile the .ll in memory with LLVM's LLJIT and resolve
+ *                 kernel_call directly
+ */
+enum ExecutionEngine { SHARED_OBJECT, ORC_JIT };
+
+/*
+ * ORC JIT backend
+ *
+ * A single LLJIT instance is kept for the whole run. The MLIR runner utility
+ * libraries are loaded once into its main JITDylib, and each kernel gets its
+ * own JITDylib so that every kernel can export the same `kernel_call` symbol
+ * and be released independently once it has been measured.
+ *
+ * Compiled in together with the in-process lowering engine
+ * (premake5 --with-mlir=...), which defines MLIR_BENCH_ORC_JIT.
+ */
+class JITEngine {
+public:
+  static bool available();
+
+  /*
+   * Creates the LLJIT instance and loads the MLIR runtime libraries from
+   * llvm_lib_path. Safe to call multiple times.
+   *
+   * An empty or "native" target_cpu compiles for the host. A non-zero
+   * vector_width is attached to every kernel function as
+   * "prefer-vector-width". codegen_opt_level (0-3) selects the backend
+   * optimisation level. runtime_libraries (e.g. libomp.so) are loaded from
+   * llvm_lib_path as well.
+   */
+  static bool
+  initialise(const fs::path &llvm_lib_path, const std::string &target_cpu = "",
+             const std::vector<std::string> &target_features = {},
+             unsigned int vector_width = 0, int codegen_opt_level = 2,
+             const std::vector<std::string> &runtime_libraries = {});
+
+  /*
+   * Parses the LLVM IR file, compiles it and returns the address of `symbol`.
+   * resource_key identifies the kernel for release().
+   *
+   * Returns nullptr on failure.
+   */
+  static void *load_kernel(const fs::path &ll_filepath,
+                           const std::string &symbol, uint64_t &resource_key);
+
+  // Address of another symbol of an already loaded kernel, nullptr if absent
+  static void *lookup(uint64_t resource_key, const std::string &symbol);
+
+  // Frees all the code and data emitted for the kernel
+  static void release(uint64_t resource_key);
+};
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "nlohmann/json.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using json = nlohmann::json;
+
+/*
+ * Arithmetic work of one kernel call
+ *
+ * iterations is the size of the op's linalg loop nest: its parallel extent
+ * (elements of the first result) times its reduction extent (the dims
+ * --generate-linalg-generics-metrics reports as reduction loops). The loop
+ * counts are that pass's num_parallel and num_reduction (num_loops is their
+ * sum).
+ */
+struct KernelCost {
+  double iterations = 0.0;
+  double flops = 0.0;
+  int num_parallel = 0;
+  int num_reduction = 0;
+  // false: the metadata has no args or results (all 0), or the op type has
+  // no model (iterations and flops NaN)
+  bool modelled = false;
+};
+
+/*
+ * Static FLOP counts of isolated kernels
+ *
+ * Loop nests are reconstructed from the op type and the argument and result
+ * shapes of the metadata JSON, the reduction extent per op family:
+ *    convolution, conv2d  - weight elements / output channels (Cin/g*kh*kw)
+ *    linear, addmm        - the contracted (last) dim of the weight / lhs
+ *    matmul, mm, bmm      - the last dim of the lhs
+ *    max/avg_pool2d       - the window, read from the kernel's kernel_size
+ *                           list (input / output elements if it isn't
+ *                           constant)
+ *    reductions           - input elements / result elements
+ *    elementwise ops      - 1, with 1 FLOP per iteration (more for
+ *                           normalisations, softmax and the like)
+ * Any other op type is unmodelled: its FLOPs are NaN, not a guess.
+ * Multiply-accumulate loops count 2 FLOPs per iteration, plus one per result
+ * element for a bias. Pure data movement (views, permutes, copies) has none.
+ */
+class KernelCosts {
+public:
+  static KernelCost estimate(const std::string &op_type, const json &metadata,
+                             const std::string &mlir_text);
+
+  // Integer list operand `operand` of the first torch.aten.<op> in the kernel
+  static std::vector<int64_t> int_list_operand(const std::string &mlir_text,
+                                               const std::string &op,
+                                               size_t operand);
+};
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "command_manager.h"
+
+#include <string>
+#include <vector>
+
+/*
+ * Structural deduplication of isolated kernels
+ *
+ * Real models repeat the same operator configuration many times (identical
+ * conv shapes across blocks, relu on identical shapes...). Kernels are
+ * grouped by a hash of their normalized MLIR text (locations, comments and
+ * formatting stripped) together with their argument metadata JSON. Only one
+ * representative per group is lowered and measured. Its results stand for
+ * every occurrence, weighted by the group's multiplicity.
+ */
+class KernelDedup {
+public:
+  static std::string normalize_kernel(const std::string &mlir_text);
+
+  // Hash of the normalized kernel and its metadata (requires the JSON)
+  static std::string kernel_signature(const KernelTask &task);
+
+  /*
+   * Collapses identical kernels. Returns one representative per group, in
+   * first-occurrence order, with multiplicity and duplicate_filepaths filled
+   */
+  static std::vector<KernelTask> deduplicate(std::vector<KernelTask> &tasks);
+
+  // One row per group: hash, representative, multiplicity, occurrences
+  static bool write_groups(const std::vector<KernelTask> &unique_tasks,
+                           const fs::path &csv_filepath);
+
+  /*
+   * Model and per-op-type totals of each metric's average, weighted by
+   * kernel multiplicity
+   */
+  static bool write_weighted_totals(const std::vector<KernelTask> &unique_tasks,
+                                    const std::vector<std::string> &metrics,
+                                    const fs::path &csv_filepath);
+};
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "command_manager.h"
+#include "nlohmann/json.hpp"
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+using json = nlohmann::json;
+
+/*
+ * Index of the isolated kernels (<lowerings>/kernel_index.json)
+ *
+ * Written once at the end of isolation, in op type and then file name
+ * order:
+ *    { "kernels": [ { "op_type":  "aten.convolution",
+ *                     "kernel":   "aten.convolution/<name>.mlir",
+ *                     "location": "model.py:12:8",
+ *                     "args":     ["1x3x224x224xf32", ...],
+ *                     "returns":  ["1x64x55x55xf32"],
+ *                     "hash":     <normalized MLIR, see kernel_dedup.h> },
+ *                   ... ] }
+ * Kernel paths are relative to the lowerings folder. Location is the first
+ * source location of the kernel, shapes are empty if its signature could not
+ * be read.
+ *
+ * Only isolated kernels are indexed: the .linalg / .llvm stages,
+ * side-cars and objects that later stages write next to them, as well as the
+ * variant subfolders, are never mistaken for kernels on reruns.
+ */
+class KernelIndex {
+public:
+  static fs::path filepath(const fs::path &lowering_folder);
+
+  // True for <name>.mlir files as written by isolation
+  static bool is_isolated_kernel(const fs::path &filepath);
+
+  // Scans the op type folders once and writes the index
+  static bool build(const fs::path &lowering_folder);
+
+  // One task per indexed kernel, false (with a message) if there is no index
+  static bool load(const fs::path &lowering_folder,
+                   std::vector<KernelTask> &tasks);
+};
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "command_manager.h"
+#include "nlohmann/json.hpp"
+
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+using json = nlohmann::json;
+
+/*
+ * Per kernel progress of a run (<output-dir>/kernel_manifest.json)
+ *
+ * Every finished kernel gets an entry keyed by its MLIR path below the
+ * lowerings folder:
+ *    source_hash    normalized MLIR and metadata (see kernel_dedup.h)
+ *    ll_hash        lowered LLVM IR, empty if lowered on a worker
+ *    pipeline_hash  contents of the pipeline JSON
+ *    measurement_hash  build flags, inputs, cache mode and sampling settings
+ *                   (CommandManager::get_measurement_hash)
+ *    status         "measured" or "failed"
+ *    layers         model layers it stands for (see model_layers.h)
+ *    results        CSVs written for it, relative to the output folder
+ *    averages       its average metrics, for the summaries of later runs
+ * The file is rewritten through a temporary and renamed after every kernel,
+ * so a run that dies leaves the entries of everything it finished.
+ *
+ * --resume skips kernels measured with the same source, pipeline and
+ * measurement hash. --only-changed lowers every kernel but only measures
+ * those whose LLVM IR or measurement hash differs from the previous run, the
+ * others reuse its CSVs.
+ */
+class KernelManifest {
+public:
+  // Loads the entries of `filepath` if it exists
+  KernelManifest(const fs::path &filepath, const fs::path &lowering_folder,
+                 const std::string &pipeline_hash,
+                 const std::string &measurement_hash,
+                 const std::vector<std::string> &columns);
+
+  static std::string pipeline_hash(const fs::path &pipeline_json);
+  static std::string ll_hash(const fs::path &ll_filepath);
+
+  // Stores the task's outcome and rewrites the manifest
+  void record(const KernelTask &task, const fs::path &output_folder);
+
+  /*
+   * --resume: true (with the averages restored) if the task was already
+   * measured with the same source, pipeline and measurement settings
+   */
+  bool restore(KernelTask &task) const;
+
+  /*
+   * --only-changed: true if the prepared task lowered to the same LLVM IR
+   * as in this (previous) run and was measured the same way. Its CSVs are copied below `output_folder`
+   * and its averages restored.
+   */
+  bool reuse(KernelTask &task, const fs::path &previous_output,
+             const fs::path &output_folder) const;
+
+private:
+  fs::path m_filepath;
+  fs::path m_lowering_folder;
+  std::string m_pipeline_hash;
+  std::string m_measurement_hash;
+  json m_manifest;
+  mutable std::mutex m_mutex;
+
+  std::string key(const KernelTask &task) const;
+  // Entry of the task if it was measured, null otherwise
+  const json *measured_entry(const KernelTask &task) const;
+};
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "command_manager.h"
+
+#include <string>
+#include <vector>
+
+/*
+ * Metadata source selection
+ *
+ * ISOLATION - Argument/return metadata of every kernel is emitted in the
+ *             isolation stage, straight from the kernel_call signature of the
+ *             isolated files (no extra process launches)
+ * PASS      - One torch-mlir-opt --generate-param-metadata launch per kernel
+ *             (original behaviour)
+ */
+enum MetadataSource { ISOLATION, PASS };
+
+/*
+ * Signature based metadata extraction
+ *
+ * Produces the same JSON layout as --generate-param-metadata:
+ *    { "kernel_call": { "args":    [ {dtype, rank, shape}, ... ],
+ *                       "returns": [ {dtype, rank, shape}, ... ] } }
+ *
+ * Understands !torch.vtensor<[d0,d1,...],dtype> and tensor<d0xd1x...xdtype>.
+ * Static strided<[...], offset: N> memref layouts add "strides" and "offset".
+ * Kernels with non-tensor or dynamically shaped arguments are rejected, so
+ * that they fall back to the metadata pass. The isolated op and its
+ * constant operands are added under "op" (see torch_baseline.h).
+ */
+class KernelMetadata {
+public:
+  static bool parse_tensor_type(const std::string &type, json &argument);
+  static bool extract_from_kernel(const fs::path &mlir_filepath,
+                                  json &metadata);
+
+  /*
+   * The aten op of an isolated torch kernel and its operands, in call order:
+   * {"arg": i} for kernel argument i, constants (torch.constant.* and
+   * torch.prim.ListConstruct of them) as JSON values. False for kernels
+   * without an aten op or with operands computed inside the kernel.
+   */
+  static bool extract_op(const fs::path &mlir_filepath, json &op);
+
+  /*
+   * Writes the <kernel>.json side-car of every task and a single manifest
+   * mapping kernel paths to their metadata. Tasks whose metadata was written
+   * are marked metadata_ready. Returns the number of kernels handled.
+   */
+  static size_t emit_for_isolated_kernels(std::vector<KernelTask> &tasks,
+                                          const fs::path &manifest_filepath);
+};
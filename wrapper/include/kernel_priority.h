@@ -0,0 +1,55 @@
+#pragma once
+
+#include "command_manager.h"
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+/*
+ * Kernel selection and ordering for quick runs
+ *
+ * --ops conv,matmul keeps the op types whose name, without "aten.", starts
+ * with one of the entries (aten.convolution, aten.matmul). It applies right
+ * after isolation, so nothing else is extracted or lowered.
+ *
+ * The priority of a kernel is its expected weight in the model:
+ *    prior  its primary metric in an earlier run (--priority-from
+ *           <output-dir>, whose kernel_manifest.json is read), matched by
+ *           source hash and then by kernel path
+ *    flops  its estimated FLOPs (see kernel_cost.h)
+ * times its multiplicity. With a prior run, kernels it did not measure are
+ * given their FLOPs scaled by the metric per FLOP of the ones it did.
+ *
+ * --max-kernels-per-op keeps the unique kernels of every op type with the
+ * highest priority. Under a --time-budget, or with --priority-from,
+ * kernels are measured by descending priority (a --cost-model prediction
+ * takes precedence), so a short run covers what matters most.
+ */
+class KernelPriority {
+public:
+  // Comma separated, empty for every op type
+  static std::vector<std::string> parse_ops(const std::string &list);
+  static bool op_selected(const std::string &op_type,
+                          const std::vector<std::string> &ops);
+
+  /*
+   * Sets the priority of every task with metadata, returns the basis
+   * ("prior <metric>" or "flops"). Prior kernels are matched by path
+   * relative to `lowering_folder`.
+   */
+  static std::string assign(std::vector<KernelTask> &tasks,
+                            const fs::path &prior_output,
+                            const std::string &metric,
+                            const fs::path &lowering_folder);
+
+  // Stable, so kernels of equal priority keep the index order
+  static void order(std::vector<KernelTask> &tasks);
+
+  // Drops all but the `max_per_op` highest priority kernels of each op type,
+  // returns how many were dropped
+  static size_t cap_per_op(std::vector<KernelTask> &tasks,
+                           unsigned int max_per_op);
+};
@@ -0,0 +1,145 @@
+#pragma once
+
+#include "perfcpp/sample.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+/*
+ * --profile: sampled on its own after the measured samples, so that no
+ * counter window carries the sampling overhead
+ */
+struct ProfileConfig {
+  bool hotspots = false;
+  bool flamegraph = false;
+  bool memory = false;
+  // Load latency histogram from the same samples as the memory profile
+  bool latency = false;
+  // LBR branch stacks: loop trip counts and mispredicted branches
+  bool branches = false;
+  // <kernel>.perf.data (and .memory.perf.data) for perf report and friends
+  bool perf_data = false;
+  double seconds = 0.5;
+  // Cycles between samples, prime so that it doesn't beat with loop periods
+  uint64_t period = 1000003;
+  // Loads (or IBS ops) between data address samples
+  uint64_t memory_period = 4001;
+};
+
+/*
+ * An input buffer the memory profile attributes data addresses to
+ */
+struct TensorRegion {
+  std::string name;        // input<i>
+  std::string description; // dtype and shape, e.g. f32[1x64x56x56]
+  uintptr_t base = 0;
+  size_t bytes = 0;
+};
+
+/*
+ * Instruction level sampling of a loaded kernel
+ *
+ * A perf::Sampler on cycles records the instruction pointer of every sample
+ * while the kernel runs back to back. IPs are resolved against the loaded
+ * objects (/proc/self/maps and their ELF symbol tables) with
+ * perf::SymbolResolver. Kernels JIT compiled in memory have no object to
+ * resolve against and are reported by raw address. With flame graphs on, the
+ * samples carry their callchain as well.
+ *
+ * The memory profile is a second run on load latency events (mem-loads on
+ * Intel, IBS op on AMD) that records the data address, source and latency of
+ * every sampled access, for perf::analyzer::MemoryAccess to attribute to the
+ * kernel's input tensors.
+ *
+ * The branch profile is a third run that records the last branch record
+ * (conditional user branches) with every cycles sample, from which loop trip
+ * counts and mispredicting branches are reconstructed.
+ *
+ * With perf_data on, each sampler also writes its raw samples in perf.data
+ * format (perf::RecordFileWriter), with mmap records of the loaded objects so
+ * `perf report`, hotspot or the Firefox Profiler resolve kernel_call.so.
+ */
+class KernelProfiler {
+public:
+  explicit KernelProfiler(const ProfileConfig &config);
+
+  // Calls `invoke` under each requested sampler for config.seconds (at least
+  // once). False if none of them could be opened. With config.perf_data the
+  // samples go to <prefix>.perf.data and <prefix>.memory.perf.data as well.
+  bool profile(const std::function<void()> &invoke,
+               const fs::path &prefix = fs::path());
+
+  /*
+   * <prefix>.hotspots.txt: sample share of every symbol, and of every
+   * instruction of the hottest ones next to their objdump disassembly.
+   * Must run while the kernel is still loaded.
+   */
+  bool write_hotspots(const fs::path &prefix) const;
+
+  /*
+   * Folded stacks ("root;...;leaf weight") for flamegraph.pl or speedscope,
+   * resolved by perf::analyzer::FlameGraphGenerator. Weights are cycles per
+   * call, so kernels profiled for the same time stay comparable.
+   */
+  bool write_folded_stacks(const fs::path &filepath) const;
+
+  /*
+   * <prefix>.memory.csv: per input tensor, sampled loads and stores, where
+   * loads were served from (L1, L2, LLC, local or remote DRAM) and their
+   * average latency in cycles. Accesses outside the inputs (results,
+   * temporaries, stack) are reported as 'other'.
+   */
+  bool write_memory_access(const fs::path &prefix,
+                           const std::vector<TensorRegion> &regions) const;
+
+  /*
+   * <prefix>.latency.csv: sampled loads per power of two latency bucket (in
+   * cycles), each split by the level that served it (L1, L2, LLC, local or
+   * remote DRAM, other)
+   */
+  bool write_latency_histogram(const fs::path &prefix) const;
+
+  /*
+   * <prefix>.loops.csv: every hot loop, i.e. backward conditional branch in
+   * the branch stacks, with its nesting depth and trip count distribution.
+   * A loop instance is the run of its back edge between branches from
+   * outside its body; instances cut off by the start of the stack only give
+   * a lower bound and are counted as censored.
+   * <prefix>.mispredicts.csv: conditional branches by mispredictions.
+   * num_loops/num_parallel of the op's linalg nest are printed alongside.
+   */
+  bool write_branches(const fs::path &prefix, int num_parallel,
+                      int num_reduction) const;
+
+  // <output>/flamegraphs/<op_type>/<kernel>.folded
+  static fs::path flamegraph_path(const fs::path &output_root,
+                                  const std::string &op_type,
+                                  const std::string &kernel);
+
+  /*
+   * Sums per kernel folded stacks into one model level file, each scaled by
+   * its weight (the kernel's multiplicity) and rooted at "<op_type>;<kernel>"
+   */
+  static bool
+  merge_folded_stacks(const std::vector<std::pair<fs::path, double>> &inputs,
+                      const fs::path &filepath);
+
+  uint64_t calls() const { return m_calls; }
+  size_t sample_count() const { return m_samples.size(); }
+  size_t memory_sample_count() const { return m_memory_samples.size(); }
+
+private:
+  ProfileConfig m_config;
+  std::vector<perf::Sample> m_samples;
+  uint64_t m_calls = 0;
+  std::vector<perf::Sample> m_memory_samples;
+  uint64_t m_memory_calls = 0;
+  std::vector<perf::Sample> m_branch_samples;
+  uint64_t m_branch_calls = 0;
+};
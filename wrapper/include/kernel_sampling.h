@@ -0,0 +1,113 @@
+#pragma once
+
+#include "command_manager.h"
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// A unique kernel of the model and whether it stands in for its stratum
+struct SampledKernel {
+  std::string op_type;
+  fs::path kernel;
+  std::string stratum;
+  double size = 0.0; // FLOPs, or bytes moved for kernels without any
+  unsigned int multiplicity = 1;
+  bool sampled = false;
+  bool certain = false; // Weighs too much to be extrapolated
+};
+
+struct SamplePlan {
+  std::vector<SampledKernel> kernels;
+  size_t strata = 0;
+  size_t sampled = 0;
+};
+
+// Model total of the metric over a scope, with 95% bounds
+struct Extrapolation {
+  std::string scope; // "model", an op type or a stratum
+  size_t kernels = 0;
+  size_t measured = 0;
+  double estimate = 0.0;
+  double low = 0.0;
+  double high = 0.0;
+  bool bounded = true; // false: too few measurements for a variance
+};
+
+/*
+ * Representative kernel sampling (--sample-kernels)
+ *
+ * Deduplication leaves too many kernels of a large model for a per commit
+ * run. Sampling measures a subset and extrapolates the model's total of
+ * the primary metric. The unique kernels are stratified by
+ *    <op type>|<argument dtypes and ranks>|p<parallel loops>r<reductions>
+ * before anything is lowered, so strata group kernels that differ in their
+ * sizes only. The budget (a fraction of the unique kernels, or a count)
+ * gives every stratum one kernel, in order of weight while it lasts, and
+ * the rest in proportion to each stratum's size times multiplicity. Kernels
+ * weighing more than their share are measured with certainty. The others
+ * are picked at evenly spaced ranks of their size, so the same model gets
+ * the same sample on every run.
+ *
+ * Each stratum's total is a ratio estimate: metric per FLOP (or per byte)
+ * of its measured kernels times the size of all of them, with the usual
+ * finite population variance of the residuals. Strata with one measured
+ * kernel borrow the pooled relative variance, strata without any borrow
+ * their op type's ratio (else the model's). Op type and model totals add
+ * the strata up. Results go to sample_extrapolation.csv.
+ *
+ * Every --sample-validate-every-th sampled run of a model (and its first)
+ * measures every kernel instead, extrapolates from the sample alone and
+ * writes the error against the full total to sample_validation.csv. The
+ * run count and past errors are kept in kernel_sampling.json next to the
+ * output folder.
+ */
+class KernelSampling {
+public:
+  // "0.2" samples a fraction of the unique kernels, "40" a count of them
+  static bool parse(const std::string &spec, double &fraction,
+                    size_t &count);
+
+  // Plans the sample of the tasks with metadata
+  static SamplePlan plan(const std::vector<KernelTask> &tasks,
+                         double fraction, size_t count);
+
+  // Drops the tasks the plan doesn't sample, returns how many
+  static size_t apply(const SamplePlan &plan, std::vector<KernelTask> &tasks);
+
+  /*
+   * Model, op type and stratum totals of the metric from the sampled
+   * kernels among the measured `tasks`, the model first
+   */
+  static std::vector<Extrapolation>
+  extrapolate(const SamplePlan &plan, const std::vector<KernelTask> &tasks,
+              const std::string &metric);
+
+  static bool write_extrapolation(const std::vector<Extrapolation> &totals,
+                                  const std::string &metric,
+                                  const fs::path &csv_filepath);
+
+  // Whether this run of the model is a validation run
+  static bool validation_due(const fs::path &state_filepath,
+                             const std::string &model, unsigned int every);
+
+  /*
+   * Sets the extrapolation against the full totals of the measured `tasks`:
+   *    level,scope,kernels,measured,metric,estimate,low,high,actual,error,
+   *    within
+   * `error` is the model's relative error, NaN without a full total.
+   */
+  static bool validate(const std::vector<Extrapolation> &totals,
+                       const SamplePlan &plan,
+                       const std::vector<KernelTask> &tasks,
+                       const std::string &metric, const fs::path &csv_filepath,
+                       double &error, bool &within);
+
+  // Counts the run in the state, `error` NaN for a sampled run
+  static bool record_run(const fs::path &state_filepath,
+                         const std::string &model,
+                         const fs::path &output_dir, double error,
+                         bool within);
+};
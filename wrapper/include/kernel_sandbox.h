@@ -0,0 +1,80 @@
+#pragma once
+
+#include "command_manager.h"
+
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+using SampleList = std::vector<std::map<std::string, double>>;
+
+/*
+ * Everything a measurement produces, passed back from the worker process
+ */
+struct SandboxResult {
+  SampleList samples;
+  SampleList warmup;
+  SampleList cold;
+  std::map<std::string, SampleList> layouts;
+  std::map<unsigned int, SampleList> threads;
+  std::map<std::string, SampleList> densities;
+  std::map<std::string, SampleList> profiles;
+  std::map<std::string, SampleList> pipelines;
+  std::map<std::string, SampleList> baselines;
+  std::map<std::string, SampleList> contentions;
+  std::map<std::string, SampleList> shapes;
+  std::map<unsigned int, SampleList> replicas;
+};
+
+/*
+ * Crash isolated kernel execution
+ *
+ * The measurement (input generation, dlopen, warmup and sampling) runs in a
+ * forked worker process. Results travel back through a shared anonymous
+ * mapping, so the counters still only see the kernel. A worker that crashes,
+ * exits early or runs past the timeout is reported through the failure
+ * string and killed, the parent carries on with the next kernel.
+ *
+ * Workers are forked through ForkGate (see fork_gate.h), so no other thread
+ * holds a lock the worker inherits. Several workers at once are started one
+ * after the other from a single thread, then finished.
+ */
+class KernelSandbox {
+public:
+  using MeasureFn = std::function<SandboxResult()>;
+
+  // A started worker process and the mapping its results come back in
+  struct Worker {
+    pid_t pid = -1;
+    void *shared = nullptr;
+    std::chrono::steady_clock::time_point start;
+  };
+
+  // timeout_seconds <= 0 waits forever. Returns false on a failed worker.
+  static bool run(const MeasureFn &measure, double timeout_seconds,
+                  SandboxResult &result, std::string &failure);
+
+  // Forks a worker running `measure`, false if it could not be started
+  static bool start(const MeasureFn &measure, Worker &worker,
+                    std::string &failure);
+  // Collects a started worker, the timeout counting from its start
+  static bool finish(Worker &worker, double timeout_seconds,
+                     SandboxResult &result, std::string &failure);
+  // Whether a started worker has exited or is past the timeout
+  static bool is_finished(const Worker &worker, double timeout_seconds);
+
+  // <output>/failures/<op_type>/<kernel>.json
+  static bool write_failure_record(const KernelTask &task,
+                                   const std::string &failure,
+                                   const fs::path &output_folder);
+
+  // Text form of a result, also what --worker nodes send back
+  static std::string serialize(const SandboxResult &result);
+  static bool deserialize(const std::string &text, SandboxResult &result);
+};
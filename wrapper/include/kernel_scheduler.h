@@ -0,0 +1,54 @@
+#pragma once
+
+#include "command_manager.h"
+
+#include <functional>
+#include <vector>
+
+/*
+ * Scheduling modes
+ *
+ * PHASED    - Compile every kernel first, then measure them one by one.
+ *             Compilation can never overlap with a measurement.
+ * PIPELINED - Compile workers fill a bounded queue of ready-to-run kernels
+ *             which the measurement thread drains, so that kernel N+1
+ *             compiles while kernel N is being measured.
+ */
+enum ScheduleMode { PHASED, PIPELINED };
+
+/*
+ * Compile/measure scheduler
+ *
+ * Compilation (the manager's prepare_kernel) runs on a ThreadPool whose
+ * workers never use the reserved measurement CPU. Measurement runs on a single
+ * dedicated thread pinned to that CPU. Every kernel gets a timeline record
+ * (see KernelTimeline) which can be dumped with write_timeline().
+ */
+class KernelScheduler {
+public:
+  // Called on the measurement thread for every successfully prepared kernel
+  using MeasureFn = std::function<void(KernelTask &)>;
+
+  KernelScheduler(CommandManager &manager, ScheduleMode mode,
+                  unsigned int jobs, unsigned int queue_depth, int measure_cpu);
+
+  /*
+   * Once `seconds` have passed since run() started, no further kernel is
+   * compiled or measured. Those get skipped_budget instead. 0 = no budget.
+   */
+  void set_time_budget(double seconds) { m_time_budget = seconds; }
+
+  void run(std::vector<KernelTask> &tasks, const MeasureFn &measure);
+
+  // Writes one row per kernel: compile/queue/measure start times and durations
+  static bool write_timeline(const std::vector<KernelTask> &tasks,
+                             const fs::path &csv_filepath);
+
+private:
+  CommandManager &m_manager;
+  ScheduleMode m_mode;
+  unsigned int m_jobs;
+  unsigned int m_queue_depth;
+  int m_measure_cpu;
+  double m_time_budget = 0.0;
+};
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "command_manager.h"
+
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// Loop structure of one linalg.generic, the columns of
+// --generate-linalg-generics-metrics' metrics.csv
+struct LinalgGeneric {
+  int num_loops = 0;
+  int num_parallel = 0;
+  int num_reduction = 0;
+  // none, inner (reductions after every parallel loop), outer (before every
+  // parallel loop) or mixed
+  std::string reduction_format = "none";
+  std::string reduction_dims; // Loop positions, "4 5 6"
+};
+
+// A kernel's structure: its main generic and how many it lowers to
+struct LinalgStructure {
+  LinalgGeneric main;
+  int generics = 0;
+
+  // no-reduction, inner-reduction, outer-reduction or mixed-reduction
+  std::string structural_class() const;
+};
+
+/*
+ * Structural features of isolated kernels, from their own lowering
+ *
+ * After its metadata, every kernel is lowered to linalg-on-tensors and its
+ * named ops generalised (mlir-opt --linalg-generalize-named-ops), the input
+ * run_structural_pass.sh gives --generate-linalg-generics-metrics. The
+ * iterator types of each linalg.generic are written next to the kernel,
+ * keyed like its timings:
+ *    <kernel>.structure.csv
+ *       generic,num_loops,num_parallel,num_reduction,reduction_format,
+ *       reduction_dims
+ * The kernel's main generic is the one with the most reduction loops, then
+ * the most loops (the contraction rather than its fill or bias add), and it
+ * goes into the result CSVs, the results store and the kernel manifest
+ * along with its structural class. structure_classes.csv and the HTML
+ * report then group the kernels' cost by class.
+ */
+class LinalgStructures {
+  static std::map<std::string, LinalgStructure> kernel_structures;
+  static std::mutex mutex;
+
+public:
+  static fs::path filepath(const fs::path &kernel_filepath);
+
+  // Every linalg.generic of generalised linalg IR, in order
+  static std::vector<LinalgGeneric> parse(const std::string &linalg_text);
+  static LinalgGeneric describe(const std::vector<std::string> &iterators);
+
+  // Parses the kernel's generalised linalg IR and writes its structure.csv
+  static bool analyse(const fs::path &kernel_filepath,
+                      const std::string &linalg_text);
+
+  // Read back from structure.csv when the kernel was analysed by an earlier
+  // run, nullptr if it never was
+  static const LinalgStructure *find(const fs::path &kernel_filepath);
+  // Forgets the analysed kernels, for a new session
+  static void clear();
+
+  // The CSV annotation columns, empty values without a structure
+  static std::vector<std::pair<std::string, std::string>>
+  annotations(const fs::path &kernel_filepath);
+  static json to_json(const fs::path &kernel_filepath);
+
+  /*
+   * One row per structural class with its kernels (by multiplicity), the
+   * sum of their averages of metric and its share of all kernels' sum
+   *    class,kernels,<metric>,share
+   */
+  static bool write_classes(const std::vector<KernelTask> &tasks,
+                            const std::string &metric,
+                            const fs::path &csv_filepath);
+};
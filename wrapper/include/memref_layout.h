@@ -0,0 +1,38 @@
+#pragma once
+
+#include "utils.h"
+
+#include <string>
+#include <vector>
+
+/*
+ * Input layouts for layout experiments
+ *
+ * DENSE      - Row major, offset 0 (or whatever the metadata JSON specifies)
+ * PADDED     - Rows of the innermost dimension padded to a multiple of 16
+ *              elements, plus 16, which breaks power of two strides
+ * TRANSPOSED - The two innermost dimensions are swapped in memory (column
+ *              major matrices)
+ * OFFSET     - Dense, but starting one element into the buffer, so the first
+ *              element is not vector aligned (a slice of a larger tensor)
+ *
+ * Kernels only honour non-identity layouts if the pipeline bufferizes function
+ * boundaries with dynamic layout maps, e.g.
+ *    one-shot-bufferize="bufferize-function-boundaries
+ *                        function-boundary-type-conversion=fully-dynamic-layout-map"
+ * With identity layouts the kernel assumes dense strides regardless.
+ */
+enum LayoutKind { DENSE, PADDED, TRANSPOSED, OFFSET };
+
+class MemRefLayout {
+public:
+  static std::string describe(LayoutKind kind);
+
+  // Comma separated layout names. Unknown names are reported and skipped.
+  static std::vector<LayoutKind> parse_list(const std::string &names);
+
+  // Rewrites the strides/offset of the argument. DENSE keeps explicit ones.
+  static void apply(JSONArgument &argument, LayoutKind kind);
+
+  static std::vector<int64_t> dense_strides(const std::vector<uint64_t> &shape);
+};
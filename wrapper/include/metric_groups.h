@@ -0,0 +1,50 @@
+#pragma once
+
+#include "perfcpp/metric.h"
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+/*
+ * Events and derived columns of one --metric-group on this host
+ *
+ * events are scheduled like --sample-metrics, every entry of event_groups is
+ * opened as a single perf group (Intel's topdown events must be read
+ * together with their `slots` leader).
+ */
+struct MetricGroup {
+  std::string name;
+  std::vector<std::string> events;
+  std::vector<std::vector<std::string>> event_groups;
+  std::vector<std::string> columns;
+  std::vector<std::shared_ptr<perf::FormulaMetric>> formulas;
+};
+
+/*
+ * Built-in metric groups (--metric-group)
+ *
+ * topdown-l1   - frontend_bound, backend_bound, bad_speculation and retiring
+ *                in percent of the issue slots (top-down level 1)
+ * memory-bound - memory_bound and core_bound percent of the slots where the
+ *                CPU has top-down level 2, plus l1d/llc/dtlb misses per
+ *                thousand instructions
+ * frontend     - fetch_latency and fetch_bandwidth percent of the slots where
+ *                available, plus l1i/itlb misses per thousand instructions
+ *
+ * Each part of a group has alternatives, tried in order: Intel perf-metrics
+ * (Icelake and later), the older topdown-* sysfs events, then generic perf
+ * events. A part the CPU has no events for is left out.
+ */
+class MetricGroups {
+public:
+  static std::vector<std::string> names();
+
+  // False for an unknown group or if the CPU has none of its events
+  static bool resolve(const std::string &name, MetricGroup &group);
+
+  // Adds the group's columns to the counter values of a sample
+  static void evaluate(const MetricGroup &group,
+                       std::map<std::string, double> &values);
+};
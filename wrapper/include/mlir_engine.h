@@ -0,0 +1,79 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+/*
+ * Lowering engine selection
+ *
+ * POPEN      - Shell out to torch-mlir-opt / mlir-opt / mlir-translate for
+ *              every kernel (original behaviour, always available)
+ * IN_PROCESS - Run the same passes in-process through MLIREngine
+ */
+enum LoweringEngine { POPEN, IN_PROCESS };
+
+/*
+ * In-process MLIR lowering engine
+ *
+ * Keeps a single MLIRContext alive for the whole run, with every upstream and
+ * Torch-MLIR dialect registered once. Each kernel is parsed once and then kept
+ * in memory through
+ *    torch -> linalg-on-tensors -> (pipeline JSON passes) -> LLVM IR
+ * instead of paying a process launch, a dialect registration and a text
+ * re-parse at every step.
+ *
+ * The engine is only compiled in when the wrapper is built with
+ *    premake5 --with-mlir=<torch-mlir-build-path> gmake
+ * which defines MLIR_BENCH_INPROCESS. Without it available() returns false and
+ * CommandManager keeps using the popen path.
+ */
+class MLIREngine {
+public:
+  static bool available();
+
+  /*
+   * Creates the shared context and registers all dialects, translations and
+   * passes. Safe to call multiple times, only the first call does any work.
+   * The context allows unregistered dialects from the start, since parallel
+   * lowerings share it and can't toggle the flag.
+   */
+  static void initialise();
+
+  /*
+   * Lowers a torch dialect kernel down to a textual LLVM IR file (.ll).
+   *
+   * The stages stay in memory. If keep_intermediates is set (--pass-logs),
+   * the .linalg.mlirbc and .llvm.mlirbc stages are also written next to the
+   * kernel as bytecode (same names as the popen path).
+   */
+  static bool lower_kernel(const fs::path &torch_filepath,
+                           const std::vector<std::string> &pass_list,
+                           const fs::path &ll_filepath,
+                           bool keep_intermediates = false);
+
+  /*
+   * Rewrites a model file (see model_source.h) as bytecode, or as text with
+   * debug info and elements attributes/resources over elide_bytes elided.
+   * Bytecode resources are parsed in place from the mapped input, so the
+   * weights of a bytecode model are not copied.
+   */
+  static bool convert_model(const fs::path &model_filepath,
+                            const fs::path &output_filepath, bool bytecode,
+                            size_t elide_bytes);
+
+  /*
+   * Converts the mlir-opt style pass list of the pipeline JSON
+   *    ["canonicalize", "affine-loop-tile=\"tile-size=32\"", ...]
+   * into a textual PassManager pipeline
+   *    builtin.module(canonicalize,affine-loop-tile{tile-size=32},...)
+   *
+   * "allow-unregistered-dialect" is an mlir-opt flag rather than a pass, so it
+   * is dropped from the pipeline and reported through allow_unregistered.
+   */
+  static std::string
+  build_pipeline_string(const std::vector<std::string> &pass_list,
+                        bool &allow_unregistered);
+};
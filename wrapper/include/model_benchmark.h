@@ -0,0 +1,47 @@
+#pragma once
+
+#include "command_manager.h"
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+/*
+ * End-to-end model benchmark (--end-to-end)
+ *
+ * Isolated kernels miss what happens between ops: the consumer finding its
+ * input still in cache, fusion across op boundaries, buffers reused by the
+ * next op. The whole model is lowered through the same pipeline JSON and
+ * measured with the same counters as one more task:
+ *    <lowerings>/model/<model>.mlir
+ * a copy of the model whose public entry function (forward) is renamed to
+ * @kernel_call, so metadata, lowering and execution treat it like any
+ * isolated kernel. Its samples are stored under the op type "model".
+ * Bytecode models (see model_source.h) are printed to text first.
+ *
+ * model_vs_kernels.csv then puts it beside the sum of the isolated kernels
+ * (weighted by multiplicity, as in model_totals.csv):
+ *    metric,end_to_end,kernel_sum,gap,ratio
+ * gap = end_to_end - kernel_sum: negative where cross-op effects help the
+ * model (fusion work pays off), positive where the kernels lose something
+ * in isolation that per-kernel tuning won't recover.
+ */
+class ModelBenchmark {
+public:
+  static constexpr const char *OP_TYPE = "model";
+
+  /*
+   * Writes the renamed copy of the model and its metadata, false (with a
+   * message) if the model has no public function or its signature can't be
+   * read
+   */
+  static bool prepare(const fs::path &model_filepath,
+                      const fs::path &lowering_folder, KernelTask &task);
+
+  static bool write_comparison(const KernelTask &model_task,
+                               const std::vector<KernelTask> &kernel_tasks,
+                               const std::vector<std::string> &metrics,
+                               const fs::path &csv_filepath);
+};
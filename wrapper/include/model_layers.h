@@ -0,0 +1,79 @@
+#pragma once
+
+#include "command_manager.h"
+#include "nlohmann/json.hpp"
+
+#include <filesystem>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+using json = nlohmann::json;
+
+// One torch op of the model, in model order
+struct ModelLayer {
+  size_t index = 0;     // Position among the model's torch ops
+  std::string name;     // Name location of the op, else <op>#<n>
+  std::string op;       // torch.aten.convolution
+  std::string location; // file:line:col, empty without debug info
+};
+
+/*
+ * Attribution of isolated kernels to the model ops they came from
+ * (<lowerings>/model_layers.json)
+ *
+ * Isolation prints debug info, so every kernel keeps the loc(...) of its op.
+ * After isolation the model's torch ops are listed in order with their
+ * resolved locations (#loc aliases, name and call site locations) and every
+ * kernel is paired with the first unclaimed op of its type at the same
+ * location, in natural file name order. Ops whose source line is shared
+ * (nn.Sequential, loops) are told apart by that order; kernels without a
+ * location are paired by order alone.
+ *    { "model": <path>,
+ *      "layers": [ { "index": 0, "name": "features.0", "op": ...,
+ *                    "location": "model.py:12:8",
+ *                    "kernel": "aten.convolution/0.mlir" }, ... ] }
+ * kernel is empty for ops no kernel was isolated from. Ops without a loc(...)
+ * in the model get the position MLIR's parser gives them, model.mlir:line:col,
+ * which is what their kernels then carry. File names are kept without their
+ * directories. The model is mapped rather than read, and its trailing
+ * {-# dialect_resources #-} (the weights) is never looked at.
+ *
+ * The layer of each kernel then goes into the result CSVs (layer_index,
+ * layer_name), the results store, the kernel manifest and layer_timeline.csv.
+ */
+class ModelLayers {
+  // By kernel path
+  static std::map<std::string, ModelLayer> kernel_layers;
+  static std::vector<ModelLayer> layers;
+
+public:
+  static fs::path filepath(const fs::path &lowering_folder);
+
+  /*
+   * Parses the model's text (the model itself, or a print of a bytecode
+   * model) and the indexed kernels, writes model_layers.json
+   */
+  static bool build(const fs::path &model_filepath,
+                    const fs::path &model_text_filepath,
+                    const fs::path &lowering_folder);
+
+  // nullptr for kernels without a layer (variants, end-to-end model)
+  static const ModelLayer *find(const fs::path &kernel_filepath);
+  static json to_json(const ModelLayer &layer);
+  // The representative's layer followed by its duplicates'
+  static json layers_of(const KernelTask &task);
+
+  /*
+   * One row per layer in model order with its kernel's average of metric,
+   * the running sum and its share of the layers' sum. With a measured model
+   * run an end_to_end row closes it: the model's value, the layers' sum and
+   * that sum's share of the model's value.
+   *    index,layer,op,location,kernel,<metric>,cumulative,share
+   */
+  static bool write_timeline(const std::vector<KernelTask> &tasks,
+                             const std::string &metric,
+                             const KernelTask *model_task,
+                             const fs::path &csv_filepath);
+};
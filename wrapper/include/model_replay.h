@@ -0,0 +1,81 @@
+#pragma once
+
+#include "command_manager.h"
+
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// One model layer run again on its producers' outputs
+struct ReplayedLayer {
+  size_t index = 0;  // Layer index, as in model_layers.json
+  std::string name;  // Layer name
+  std::string op;    // torch.aten.convolution
+  KernelTask *task = nullptr;
+  size_t chained = 0;   // Arguments bound to an upstream kernel's output
+  size_t arguments = 0; // Traced arguments of the op
+  std::vector<std::map<std::string, double>> samples;
+};
+
+/*
+ * Producer-consumer replay (--replay)
+ *
+ * Isolated kernels run on generated inputs, so they never see the values,
+ * layout and cache state their producers would leave behind. After the
+ * measurement every layer of model_layers.json with a measured kernel (the
+ * representative, for duplicates) runs again, in model order, with each
+ * argument that an earlier layer's kernel computed bound to that kernel's
+ * returned memref.
+ *
+ * The arguments of each op are traced through the model's forward function
+ * (SubgraphIsolation::kernel_inputs). Outputs are handed on as files under
+ * <output>/replay/, so that the sandboxed worker processes can share them:
+ *    layers/<index>/output<r>.npy - outputs of a replayed layer, deleted
+ *                                   once its last consumer ran
+ *    bind/<kernel>/arg<i>.npy     - links to the producers' outputs, and to
+ *                                   the --tensor-source .npy files of the
+ *                                   other arguments
+ * bind/ is the tensor source while a layer runs, so the usual checks apply:
+ * outputs whose shape or dtype doesn't match the argument, and arguments
+ * coming from function arguments, weights or ops that were not isolated,
+ * are generated as usual.
+ *
+ * The replayed samples of a kernel go to its .replay CSV, and
+ * replay_vs_isolated.csv sets every layer against its isolated measurement.
+ */
+class ModelReplay {
+public:
+  // Measures a kernel with the current input settings, false if it failed
+  using Measure = std::function<bool(
+      const KernelTask &task, std::vector<std::map<std::string, double>> &)>;
+
+  static fs::path folder(const fs::path &output_folder);
+
+  /*
+   * Replays the layers of the measured `tasks`, whose samples are also
+   * appended to each task's replay_results. op_types are the isolated op
+   * types (aten.convolution, ...), tensor_source the --tensor-source
+   * directory, restored on `manager` afterwards.
+   */
+  static std::vector<ReplayedLayer>
+  run(CommandManager &manager, std::vector<KernelTask> &tasks,
+      const std::set<std::string> &op_types,
+      const fs::path &model_text_filepath, const fs::path &tensor_source,
+      const fs::path &output_folder, const Measure &measure);
+
+  /*
+   * One row per replayed layer in model order with the average of metric
+   * isolated and replayed, and their ratio. A model row closes it with the
+   * sums over the layers both runs measured.
+   *    index,layer,op,kernel,chained,arguments,metric,isolated,replayed,
+   *    ratio
+   */
+  static bool write_comparison(const std::vector<ReplayedLayer> &layers,
+                               const std::string &metric,
+                               const fs::path &csv_filepath);
+};
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <string_view>
+
+namespace fs = std::filesystem;
+
+// Read only mapping of a whole file, invalid if it can't be mapped
+class MappedFile {
+public:
+  explicit MappedFile(const fs::path &filepath);
+  ~MappedFile();
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  bool valid() const { return m_data != nullptr; }
+  std::string_view view() const { return {m_data, m_bytes}; }
+
+private:
+  const char *m_data = nullptr;
+  size_t m_bytes = 0;
+};
+
+/*
+ * Model files, textual MLIR or MLIR bytecode (`convert-model`)
+ *
+ * A text model is mostly its weights, hex strings in the trailing
+ * {-# dialect_resources #-} section that the parser decodes into fresh
+ * buffers. Bytecode stores them as raw blobs, and a bytecode parse keeps
+ * referring to them in the mapped file instead of copying, so weights are
+ * only paged in where something reads them. Every MLIR tool reads both
+ * formats, isolation included, which is why the model file is handed over
+ * as is.
+ *
+ * What this tool reads of the model itself goes through text views:
+ * ModelLayers gets a print with the weights elided (ELIDE_BYTES), the
+ * end-to-end run (ModelBenchmark) a full one since the model computes with
+ * them. Conversion and printing run in process through MLIREngine when it
+ * is built in, else through torch-mlir-opt.
+ */
+class ModelSource {
+  static fs::path torch_opt_exec;
+
+public:
+  // Weights and constants above this many bytes are left out of views
+  static constexpr size_t ELIDE_BYTES = 64;
+
+  static void set_torch_opt(const fs::path &exec);
+
+  // Checks the "ML\xefR" magic
+  static bool is_bytecode(const fs::path &filepath);
+
+  // Writes the model as bytecode
+  static bool convert(const fs::path &model_filepath,
+                      const fs::path &bytecode_filepath);
+
+  /*
+   * Prints the model with its debug info, eliding elements attributes and
+   * resources over elide_bytes (0 keeps everything)
+   */
+  static bool write_text(const fs::path &model_filepath,
+                         const fs::path &text_filepath, size_t elide_bytes);
+};
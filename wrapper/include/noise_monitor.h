@@ -0,0 +1,91 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+enum class NoiseAction { OFF, MARK, RETRY };
+
+/*
+ * What makes a sample noisy (--noise-*). A negative limit is not checked.
+ * Context switches and migrations only count for single threaded kernels,
+ * whose calling thread has no reason to be descheduled.
+ */
+struct NoiseConfig {
+  NoiseAction action = NoiseAction::OFF;
+  unsigned int retries = 3;       // Extra windows per sample with RETRY
+  double max_irqs = 0.0;          // Device interrupts on the core per window
+  double max_freq_drop = 0.03;    // Below the kernel's fastest window so far
+  double max_temp_c = -1.0;       // Package temperature at the window's end
+  double max_page_faults = -1.0;  // Per window, kernels may fault by design
+  bool count_switches = true;
+};
+
+// Counters read right before and right after a counter window
+struct NoiseSnapshot {
+  std::chrono::steady_clock::time_point time;
+  int cpu = -1;
+  uint64_t irqs = 0;       // /proc/interrupts of the core, local timer aside
+  uint64_t timer_irqs = 0; // LOC
+  long page_faults = 0;    // Minor and major, of the calling thread
+  long switches = 0;       // Voluntary and involuntary, of the calling thread
+  uint64_t aperf = 0, mperf = 0;
+};
+
+/*
+ * System noise around every sample (--noise-monitor mark|retry)
+ *
+ * Each counter window is bracketed by two snapshots of the measuring core,
+ * and the window gets these columns:
+ *    noise_irqs        device interrupts the core took (not the local timer)
+ *    noise_timer_irqs  local timer ticks
+ *    noise_page_faults page faults of the measuring thread
+ *    noise_switches    context switches of the measuring thread
+ *    noise_migrations  1 if the thread ended on another CPU
+ *    noise_mhz         effective frequency, APERF over the window's wall
+ *                      time (/dev/cpu/<n>/msr, needs the msr module and
+ *                      read access), else scaling_cur_freq at its end
+ *    noise_temp_c      package temperature at its end (x86_pkg_temp,
+ *                      coretemp or k10temp), 0 if unavailable
+ *    noisy             1 if a NoiseConfig limit was exceeded
+ *    noise_retries     windows thrown away for this sample (retry only)
+ * The snapshots read procfs and sysfs outside the window, so they cost
+ * sampling time but never show up in the counters.
+ *
+ * With mark, noisy samples are kept and flagged. With retry, a noisy window
+ * is run again up to NoiseConfig::retries times and the last one is kept,
+ * flagged if it was still noisy.
+ */
+class NoiseMonitor {
+public:
+  // Watches the CPU the calling thread is pinned to
+  explicit NoiseMonitor(const NoiseConfig &config);
+  ~NoiseMonitor();
+
+  NoiseMonitor(const NoiseMonitor &) = delete;
+  NoiseMonitor &operator=(const NoiseMonitor &) = delete;
+
+  NoiseSnapshot snapshot();
+
+  // Adds the noise_* columns and noisy, true if the window was noisy
+  bool record(const NoiseSnapshot &before, const NoiseSnapshot &after,
+              std::map<std::string, double> &sample);
+
+  static std::vector<std::string> columns();
+  static std::string describe(NoiseAction action);
+  static bool parse(const std::string &name, NoiseAction &action);
+
+private:
+  NoiseConfig m_config;
+  int m_cpu = -1;
+  int m_msr_fd = -1;
+  int m_interrupts_fd = -1;
+  int m_temperature_fd = -1;
+  // Fastest window of the kernel so far, the frequency drop's reference
+  double m_peak_mhz = 0.0;
+
+  void read_interrupts(NoiseSnapshot &snapshot);
+  double read_temperature();
+};
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/*
+ * Placement of the input tensor arena on NUMA systems
+ *
+ * FIRST_TOUCH - Kernel default: pages land on the node of the thread which
+ *               first writes them (the measurement thread fills the inputs)
+ * LOCAL_NODE  - Bound to the node of the measurement CPU
+ * INTERLEAVE  - Interleaved across every online node
+ * REMOTE_NODE - Bound to a node other than the measurement CPU's, an explicit
+ *               remote memory scenario. Falls back to the local node on
+ *               single node machines.
+ */
+enum NumaPolicy { FIRST_TOUCH, LOCAL_NODE, INTERLEAVE, REMOTE_NODE };
+
+/*
+ * NUMA topology and memory policy helpers
+ *
+ * Topology comes from /sys/devices/system/node, binding uses the mbind system
+ * call directly, so there is no dependency on libnuma. Non-Linux platforms
+ * report a single node 0 and never bind.
+ */
+class NumaPlacement {
+public:
+  static std::vector<int> online_nodes();
+  static int node_of_cpu(int cpu);
+  // CPUs of a node, every online CPU if the topology can't be read
+  static std::vector<int> cpus_of_node(int node);
+
+  // Nodes the arena is bound to under `policy` when measuring on `cpu`,
+  // empty for FIRST_TOUCH
+  static std::vector<int> target_nodes(NumaPolicy policy, int cpu);
+
+  // Applies the policy to a not yet touched mapping
+  static bool bind(void *addr, size_t bytes, NumaPolicy policy,
+                   const std::vector<int> &nodes);
+
+  static std::string describe(NumaPolicy policy);
+  // "0;1", or "any" for an empty list
+  static std::string describe_nodes(const std::vector<int> &nodes);
+};
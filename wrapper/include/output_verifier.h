@@ -0,0 +1,67 @@
+#pragma once
+
+#include "element_type.h"
+#include "utils.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+/*
+ * Element wise tolerance: |actual - expected| <= atol + rtol * |expected|.
+ * NaNs only match NaNs, integers and i1 must match exactly.
+ */
+struct Tolerance {
+  double rtol = 1e-4;
+  double atol = 1e-5;
+};
+
+struct VerificationResult {
+  bool passed = true;
+  uint64_t elements = 0;
+  uint64_t mismatches = 0;
+  double max_abs_error = 0.0;
+  double max_rel_error = 0.0;
+  double max_ulp_error = 0.0; // In units of the element type (f32 for f32)
+  std::string error;          // Set if the outputs could not be compared
+
+  // Worst of both, over several results of a kernel
+  void merge(const VerificationResult &other);
+};
+
+/*
+ * Cross pipeline output verification
+ *
+ * A reference run (--record-outputs, usually baseline_pipeline.json) stores
+ * the results of every kernel as
+ *    <output>/references/<op>/<kernel>.results.json   dtype and shape per result
+ *    <output>/references/<op>/<kernel>.result<r>.bin  dense, row major data
+ *
+ * A candidate run (--verify-against <reference output>) compares its results
+ * against them. Both runs generate inputs from a seed derived from the kernel
+ * name, so they see bit identical inputs.
+ *
+ * compare() works on contiguous blocks converted to float/double, written so
+ * that the compiler vectorises the error reductions; multi-MB tensors take
+ * milliseconds.
+ */
+class OutputVerifier {
+public:
+  static fs::path reference_prefix(const fs::path &reference_root,
+                                   const std::string &op_type,
+                                   const std::string &kernel);
+
+  static bool
+  write_reference(const fs::path &prefix,
+                  const std::vector<std::unique_ptr<MemRefArg>> &results);
+
+  static VerificationResult
+  verify(const fs::path &prefix,
+         const std::vector<std::unique_ptr<MemRefArg>> &results,
+         const Tolerance &tolerance);
+
+  static VerificationResult compare(const void *actual, const void *expected,
+                                    uint64_t count, ElementType type,
+                                    const Tolerance &tolerance);
+};
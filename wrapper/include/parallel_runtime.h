@@ -0,0 +1,76 @@
+#pragma once
+
+#include "nlohmann/json.hpp"
+
+#include <string>
+#include <vector>
+
+using json = nlohmann::json;
+
+/*
+ * Threading runtime the pipeline lowers parallel loops to
+ *
+ * SERIAL_RUNTIME - No parallel loops (default)
+ * OPENMP_RUNTIME - convert-scf-to-openmp, kernels call into libomp
+ * ASYNC_RUNTIME  - async-parallel-for, kernels call into the MLIR async
+ *                  runtime (libmlir_async_runtime)
+ * CUDA_RUNTIME   - gpu dialect lowered to NVVM, kernels launch through the
+ *                  MLIR CUDA runtime wrappers (libmlir_cuda_runtime)
+ * ROCM_RUNTIME   - gpu dialect lowered to ROCDL, kernels launch through the
+ *                  MLIR ROCm runtime wrappers (libmlir_rocm_runtime)
+ *
+ * Read from the optional "parallel_runtime" field of the pipeline JSON
+ *    "parallel_runtime": "openmp" | "async" | "cuda" | "rocm"
+ */
+enum ParallelRuntimeKind {
+  SERIAL_RUNTIME,
+  OPENMP_RUNTIME,
+  ASYNC_RUNTIME,
+  CUDA_RUNTIME,
+  ROCM_RUNTIME
+};
+
+/*
+ * Thread budget of a kernel run (--thread-sweep)
+ *
+ * A budget of N pins the measurement thread to N consecutive online CPUs,
+ * starting at the measurement CPU. Worker threads inherit that mask:
+ *    - libomp gets OMP_NUM_THREADS=N, OMP_PROC_BIND=close and
+ *      OMP_PLACES=threads, i.e. one thread bound to each CPU of the mask
+ *    - the async runtime sizes its worker pool from the affinity mask
+ *
+ * Both runtimes only read these when they start, which is why every budget
+ * of the sweep runs in a fresh worker process.
+ */
+class ParallelRuntime {
+public:
+  static ParallelRuntimeKind from_pipeline_json(const json &pipeline);
+
+  // Kernels run on a device, see gpu_runtime.h
+  static bool is_gpu(ParallelRuntimeKind kind);
+
+  // Extra compiler / linker flags of the kernel objects
+  static std::string link_flags(ParallelRuntimeKind kind);
+
+  // Runtime libraries the ORC JIT must load next to the runner utils
+  static std::vector<std::string> runtime_libraries(ParallelRuntimeKind kind);
+
+  // Applies a thread budget to the calling thread, before the kernel loads
+  static bool apply_thread_budget(unsigned int threads, int first_cpu);
+
+  /*
+   * Resizes an already started OpenMP runtime, no-op for the others.
+   * library_handle is the kernel's dlopen handle (libomp is one of its
+   * dependencies), nullptr searches the global scope (ORC JIT).
+   */
+  static void set_worker_count(ParallelRuntimeKind kind, unsigned int threads,
+                               void *library_handle);
+
+  /*
+   * Thread counts of a sweep: a comma separated list ("1,2,4,16") or "pow2"
+   * for 1, 2, 4 ... up to the online CPU count (which is always included)
+   */
+  static std::vector<unsigned int> parse_sweep(const std::string &spec);
+
+  static std::string describe(ParallelRuntimeKind kind);
+};
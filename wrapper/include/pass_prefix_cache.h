@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+/*
+ * Shared pass prefixes of the pipelines of a run
+ *
+ * Every pipeline starts with the same Torch to Linalg lowering, and most
+ * pass lists share their first passes (canonicalize, cse, ...), more so the
+ * candidates of an autotuning template. The pass lists of the registered
+ * pipelines form a trie. Its root is the Linalg IR, and a node is the IR
+ * after the passes on its path. A node on the path of at least two
+ * pipelines is shared. Where shared paths branch (or a pipeline ends), the
+ * first lowering of a kernel that passes the node writes the IR there as
+ * bytecode, and the lowerings after it start from the deepest such node
+ * they find. Shared nodes inside a chain are not written: every pipeline
+ * through them reaches the branch point below.
+ *
+ * Nodes are files <folder>/<key>.mlirbc, the key hashing the kernel's
+ * contents, the toolchain and the passes of the prefix, so copies of a
+ * kernel (pipeline variants) share them. A run with one pipeline has no
+ * shared node and lowers as before.
+ */
+class PassPrefixCache {
+public:
+  struct Plan {
+    // IR to start from and how many passes it has been through, empty to
+    // start with the Torch lowering
+    fs::path start;
+    size_t start_depth = 0;
+    // Shared nodes further down the path, written by this lowering
+    struct Store {
+      size_t depth = 0;
+      fs::path filepath;
+      fs::path staging;
+    };
+    std::vector<Store> stores;
+  };
+
+  static void set_enabled(bool flag);
+  static bool is_enabled();
+
+  // Thread safe, registering the same pass list again has no effect
+  static void add_pipeline(const std::vector<std::string> &pass_list);
+
+  // Where the lowering of `kernel` through `pass_list` starts and stores
+  static Plan plan(const fs::path &kernel,
+                   const std::vector<std::string> &pass_list,
+                   const std::string &toolchain_id, const fs::path &folder);
+
+  // Publishes the nodes of a successful lowering, drops them otherwise
+  static void commit(const Plan &plan, bool success);
+
+  static void print_statistics();
+  // Forgets the registered pipelines and statistics, for a new session
+  static void reset();
+
+private:
+  struct Node {
+    std::map<std::string, size_t> children;
+    unsigned int pipelines = 0;
+  };
+
+  static bool enabled;
+  static std::mutex mutex;
+  static std::vector<Node> trie;
+  static std::set<std::vector<std::string>> registered;
+
+  static std::atomic<uint64_t> passes_skipped;
+  static std::atomic<uint64_t> lowerings_reused;
+  static std::atomic<uint64_t> nodes_stored;
+};
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "utils.h"
+
+#include <string>
+
+/*
+ * Profile guided rebuild of kernel objects (--pgo)
+ *
+ * The kernel of a pgo pipeline is first built with -fprofile-generate. Once
+ * it is loaded, a training run of TRAINING_CALLS calls on the generated
+ * inputs flushes its counters to <kernel>.profraw/, which llvm-profdata
+ * merges into <kernel>.profdata. The object is then rebuilt with
+ * -fprofile-use and only that one is measured.
+ *
+ * A profile is reused while it is newer than the kernel's .ll, so
+ * interleaved rounds and unchanged re-runs train once. PGO objects never
+ * go through the compile cache, whose key does not cover the profile.
+ *
+ * compiler-rt's profile writers are hidden in the object they are linked
+ * into, so the instrumented object is built with <kernel>.pgo_hook.ll,
+ * which exports
+ *
+ *    i32 mlir_bench_profile_dump()  ->  __llvm_profile_dump()
+ *
+ * The dump also stops the runtime from writing the counters a second time
+ * when the object is closed.
+ */
+class PgoProfile {
+public:
+  static const unsigned int TRAINING_CALLS = 20;
+  static const char *DUMP_SYMBOL;
+
+  static fs::path profile_path(const fs::path &ll_filepath);
+  static fs::path raw_folder(const fs::path &ll_filepath);
+  static fs::path hook_path(const fs::path &ll_filepath);
+
+  // A profile written after the .ll was last lowered
+  static bool is_current(const fs::path &ll_filepath);
+
+  // -fprofile-use with a current profile, otherwise -fprofile-generate and
+  // the hook, which write_hook() must have written
+  static std::string compile_flags(const fs::path &ll_filepath);
+
+  // Writes the hook of an instrumented build next to the .ll
+  static bool write_hook(const fs::path &ll_filepath);
+
+  // Flushes the counters of a loaded instrumented object (its dlopen
+  // handle) into an emptied raw folder
+  static bool write_raw(void *so_handle, const fs::path &ll_filepath);
+
+  // llvm-profdata command merging the raw folder into the profile
+  static std::string merge_command(const fs::path &llvm_profdata,
+                                   const fs::path &ll_filepath);
+};
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "nlohmann/json.hpp"
+
+#include <filesystem>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+using json = nlohmann::json;
+
+/*
+ * Parameterized pipeline JSON (--autotune, --pipeline-sweep)
+ *
+ * A pipeline JSON plus a "parameters" object of value lists. `${name}` in
+ * any string (pass options, llvm_opt level...) is replaced by the
+ * parameter's value, and "pass" may hold two kinds of objects besides plain
+ * passes:
+ *    {"permute": ["pass-a", "pass-b", ...]}  tried in every order (up to 5
+ *                                            passes, 120 sampled orders
+ *                                            beyond that)
+ *    {"pass": "affine-loop-fusion", "if": "fusion"}  only if the boolean
+ *                                            parameter is set
+ *
+ * A choice picks one value index per dimension: the parameters in file
+ * order, then one "order.<n>" dimension per permute group.
+ */
+class PipelineTemplate {
+public:
+  struct Dimension {
+    std::string name;         // parameter name, or "order.<group>"
+    std::vector<json> values; // parameter values, or pass orders
+  };
+
+  // Reads and validates the template, false (with a message) if unusable
+  bool load(const fs::path &template_json, std::mt19937_64 &rng);
+
+  const std::vector<Dimension> &dimensions() const;
+  // Number of distinct pipelines, saturating at 2^32
+  size_t size() const;
+  // Every choice, the first dimension varying slowest
+  std::vector<std::vector<size_t>> grid() const;
+
+  // Pipeline JSON of a choice
+  json render(const std::vector<size_t> &choice) const;
+  // "tile=32 fusion=true order.0=1-0"
+  std::string describe(const std::vector<size_t> &choice) const;
+  // File name safe form, "tile-32_fusion-true_order.0-1-0"
+  std::string label(const std::vector<size_t> &choice) const;
+  /*
+   * Labels of several choices, unique among them: distinct values that
+   * read the same once made file name safe ([4,4] and "4-4") get "_2",
+   * "_3", ... appended in order
+   */
+  std::vector<std::string>
+  labels(const std::vector<std::vector<size_t>> &choices) const;
+  // Value of every dimension as text, in dimension order
+  std::vector<std::string> values(const std::vector<size_t> &choice) const;
+
+private:
+  json m_template;
+  std::vector<Dimension> m_dimensions;
+};
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+/*
+ * Throughput under load (--replicas)
+ *
+ * `count` copies of a kernel's measurement run at once, each in its own
+ * forked worker pinned to a CPU of its own physical core. The workers are
+ * forked one after the other from the calling thread and collected as they
+ * end. Cores are taken
+ * from the measurement CPU's NUMA node first, then from the other nodes in
+ * turn. Every worker generates its inputs after pinning, in its own arena,
+ * so they are private and first touched on (or bound to, under
+ * --numa-policy) the node of its core.
+ *
+ * Replicas wait for each other before their warmup. A replica that has its
+ * samples keeps calling the kernel until every replica has them, so no
+ * sample is taken on a partly idle machine. Each replica counts its own
+ * thread, exactly like a single measurement.
+ */
+class ReplicaGroup {
+public:
+  using Samples = std::vector<std::map<std::string, double>>;
+
+  /*
+   * One CPU per physical core, the measurement CPU first. Fewer than
+   * `count` if the machine has fewer cores.
+   */
+  static std::vector<int> replica_cpus(unsigned int count, int measure_cpu);
+
+  /*
+   * Runs `measure` on every CPU of `cpus` at once, given the worker's CPU
+   * so it can place a fresh input arena there. The samples of all replicas
+   * are concatenated, each tagged with replica, replica_cpu and
+   * replica_node. False (with the reasons) if any replica failed.
+   */
+  static bool run(const std::vector<int> &cpus,
+                  const std::function<Samples(int cpu)> &measure,
+                  double timeout_seconds, Samples &samples,
+                  std::string &failure);
+
+  // Within a replica worker only, no-ops otherwise
+  // Waits until every replica has its kernel loaded and inputs generated
+  static void arrive();
+  // Calls `call` until every replica has its samples
+  static void hold(const std::function<void()> &call);
+
+private:
+  // Shared by the replica workers of one run
+  struct Barrier {
+    std::atomic<unsigned int> arrived{0};
+    std::atomic<unsigned int> done{0};
+    // Replicas that died, they hold up nobody
+    std::atomic<unsigned int> failed{0};
+    unsigned int count = 0;
+  };
+
+  static bool wait_for(const std::atomic<unsigned int> &counter,
+                       double timeout_seconds);
+
+  static Barrier *barrier;
+};
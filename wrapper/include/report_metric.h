@@ -0,0 +1,19 @@
+#pragma once
+
+#include <string>
+
+/*
+ * How a report column combines over the kernels of a model
+ *
+ * SUM        - an amount per call (seconds, flops, bytes, joules, counter
+ *              events). The model total weighs each kernel by how often the
+ *              model calls it and adds them up (model_totals.csv).
+ * PER_KERNEL - a rate, ratio, statistic or flag of one kernel (gflops, ipc,
+ *              ci95, verified), whose sum over kernels means nothing
+ */
+enum class MetricAggregation { SUM, PER_KERNEL };
+
+struct ReportMetric {
+  std::string name;
+  MetricAggregation aggregation;
+};
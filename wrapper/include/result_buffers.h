@@ -0,0 +1,63 @@
+#pragma once
+
+#include "tensor_arena.h"
+
+#include <cstdint>
+#include <vector>
+
+/*
+ * Ownership of kernel returned buffers
+ *
+ * Every call of a kernel hands back freshly allocated result buffers
+ * (memref.alloc in the kernel, so malloc or aligned_alloc). capture() records
+ * the base pointers of one call from the packed result descriptors. It only
+ * appends to a reserved vector, so calling it inside a counter window is
+ * cheap. release() frees everything captured so far, outside the window.
+ *
+ * Buffers which are not the kernel's to give away are never freed:
+ *    - null pointers and the 0xdeadbeef marker of memref.get_global
+ *    - input buffers returned as is (they live in the TensorArena, or in
+ *      ranges passed to exclude(), e.g. mapped tensor files)
+ *    - the same allocation returned as several results
+ *
+ * With allocation tracking the tracker's free is used, so its live heap stays
+ * balanced.
+ */
+class ResultBuffers {
+public:
+  ResultBuffers(const std::vector<int64_t> &result_ranks,
+                const TensorArena *input_arena, bool tracked);
+  ~ResultBuffers();
+
+  ResultBuffers(const ResultBuffers &) = delete;
+  ResultBuffers &operator=(const ResultBuffers &) = delete;
+
+  // Buffers in [begin, begin + bytes) are never freed
+  void exclude(const void *begin, uint64_t bytes);
+
+  // Room for `calls` captures without reallocating
+  void reserve(uint64_t calls);
+
+  // Records the buffers of one call, `results` as filled in by the kernel
+  void capture(const void *results) {
+    const int64_t *slot = static_cast<const int64_t *>(results);
+    for (size_t offset : m_base_slots)
+      m_pending.push_back(reinterpret_cast<void *>(slot[offset]));
+  }
+
+  // Frees every captured buffer. keep_latest leaves the buffers of the last
+  // call alive, e.g. so that they can still be logged.
+  void release(bool keep_latest = false);
+
+  uint64_t released_buffers() const { return m_released; }
+
+private:
+  bool is_owned(void *ptr) const;
+
+  std::vector<size_t> m_base_slots; // i64 slot of each result's base_ptr
+  const TensorArena *m_input_arena;
+  std::vector<std::pair<const uint8_t *, uint64_t>> m_excluded;
+  bool m_tracked;
+  std::vector<void *> m_pending;
+  uint64_t m_released = 0;
+};
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "results_store.h"
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+enum class SignificanceTest { MANN_WHITNEY, BOOTSTRAP };
+// Adjustment of the p-values of one metric across the kernels
+enum class PCorrection { NONE, HOLM, BENJAMINI_HOCHBERG };
+
+struct CompareConfig {
+  // Empty: the baseline's primary metric
+  std::vector<std::string> metrics;
+  SignificanceTest test = SignificanceTest::MANN_WHITNEY;
+  PCorrection correction = PCorrection::HOLM;
+  double alpha = 0.05;
+  // Relative slowdown of a significant regression that fails the comparison
+  double threshold = 0.05;
+  unsigned int bootstrap_resamples = 2000;
+};
+
+// One kernel and metric present in both result sets
+struct KernelComparison {
+  std::string op_type;
+  std::string kernel;
+  std::string candidate_kernel;
+  std::string hash;
+  int multiplicity = 1;
+  std::string metric;
+  size_t baseline_samples = 0;
+  size_t candidate_samples = 0;
+  double baseline_median = 0.0;
+  double candidate_median = 0.0;
+  // Relative slowdown of the candidate, positive is worse whichever way the
+  // metric goes
+  double change = 0.0;
+  double p_value = 1.0;
+  // p_value after the correction across the kernels of this metric
+  double adjusted_p = 1.0;
+  // Cliff's delta of candidate against baseline, positive is worse
+  double effect = 0.0;
+  // "regression", "speedup" or "unchanged"
+  std::string verdict;
+};
+
+/*
+ * Regression check between two result sets (compare subcommand)
+ *
+ *    torch-metric-collector compare <baseline-dir> <candidate-dir>
+ *
+ * Both are output directories with a results.sqlite. Kernels are matched by
+ * source hash, so the same kernel matches whatever its file name and however
+ * the graph around it changed; each side uses its primary pipeline's main
+ * samples from the latest run that measured the kernel, without rejected
+ * samples. Per kernel and metric the samples go through a two sided
+ * Mann-Whitney U test (or a bootstrap test of the medians). With hundreds
+ * of kernels some of them pass at alpha by chance, so the p-values of each
+ * metric are adjusted across the kernels (Holm by default, or
+ * Benjamini-Hochberg), and a change is a speedup or a regression when the
+ * adjusted p < alpha. Its size is the ratio of the medians and Cliff's
+ * delta.
+ *
+ * comparison.csv has one row per kernel and metric; the summary weights the
+ * medians by the baseline's multiplicity like model_totals.csv. A
+ * significant regression slower than the threshold fails the comparison.
+ */
+class ResultCompare {
+public:
+  // Metrics where a larger value is better: rates of work (GFLOP/s, GB/s,
+  // per second, per joule) and ipc
+  static bool higher_is_better(const std::string &metric);
+
+  static std::vector<KernelComparison> compare(const StoredRun &baseline,
+                                               const StoredRun &candidate,
+                                               const CompareConfig &config);
+
+  // Per metric weighted totals and verdict counts, to stdout
+  static void print_summary(const std::vector<KernelComparison> &comparisons,
+                            const StoredRun &baseline,
+                            const StoredRun &candidate,
+                            const CompareConfig &config);
+
+  static bool write_csv(const std::vector<KernelComparison> &comparisons,
+                        const fs::path &csv_filepath);
+
+  // Significant regressions slower than the threshold
+  static size_t count_failures(const std::vector<KernelComparison> &comparisons,
+                               const CompareConfig &config);
+};
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <filesystem>
+#include <functional>
+#include <string>
+
+namespace fs = std::filesystem;
+
+/*
+ * Background result writer
+ *
+ * Result CSVs, .metric dumps, the kernel manifest and the results store
+ * commits are queued here instead of being written between (or during) timed
+ * regions on the measurement thread. The queue is a lock-free multi producer
+ * list, so a producer pays one atomic exchange and no syscall; a single
+ * writer thread, kept off the measurement CPU, drains it in submission order.
+ * Files written since the last sync are fsync'ed every --fsync-interval
+ * seconds, so a crash loses at most that much of what was already reported.
+ *
+ * Before start() (and in a forked sandbox worker, which has no writer thread)
+ * every call writes synchronously. Write errors are printed by the writer and
+ * counted, stop() returns false if there were any.
+ */
+class ResultWriter {
+public:
+  // reserved_cpu < 0 lets the writer run anywhere, fsync_interval <= 0 only
+  // syncs on flush() and stop()
+  static void start(int reserved_cpu, double fsync_interval);
+  // Drains the queue, syncs and joins the writer. No-op when not running.
+  static bool stop();
+  static bool is_running();
+
+  // Replaces the file's contents, creating its parent directories
+  static void write(const fs::path &filepath, std::string data);
+  // Through a synced sibling .tmp and a rename: a reader (or --resume after a
+  // crash) sees either the old or the new file
+  static void replace(const fs::path &filepath, std::string data);
+  // Runs on the writer thread in queue order (results store commits)
+  static void call(std::function<void()> fn);
+
+  // Blocks until everything queued so far is written and synced
+  static void flush();
+};
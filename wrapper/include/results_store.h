@@ -0,0 +1,158 @@
+#pragma once
+
+#include "command_manager.h"
+
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+struct sqlite3;
+
+// One kernel's main samples, as read back from a store
+struct StoredKernel {
+  std::string op_type;
+  std::string kernel;
+  std::map<std::string, double> averages;
+  // Filled by load_samples only
+  std::string hash;
+  int multiplicity = 1;
+  std::string layers; // JSON, see ModelLayers::layers_of
+  std::string structure; // JSON, see LinalgStructures::to_json
+  std::map<std::string, std::vector<double>> samples;
+};
+
+// The latest measurement of every kernel in a store (load_samples)
+struct StoredRun {
+  std::string primary_metric;
+  std::string primary_pipeline;
+  std::vector<StoredKernel> kernels;
+};
+
+/*
+ * Columnar results store (<output-dir>/results.sqlite)
+ *
+ * Every sample of every kernel in one SQLite file, one row per value:
+ *    samples(run, pipeline, op_type, kernel, variant, sample, metric, value)
+ *    statistics(run, pipeline, op_type, kernel, variant, metric, samples,
+ *               mean, median, min, max, p90, p99, stddev, mad, ci95_low,
+ *               ci95_high)   of the samples kept by --outlier-rejection
+ *    rejected(run, pipeline, op_type, kernel, variant, sample, method)
+ *    kernels(run, op_type, kernel, multiplicity, duplicates, node, hash,
+ *            layers)
+ *    pipelines(run, pipeline, annotations)  build settings as JSON
+ *    runs(run, started, model, primary_pipeline, primary_metric)
+ * kernel is the isolated kernel's file stem, variant the suffix its timings
+ * CSV would carry without the dot ("" for the main samples, "cold",
+ * "warmup", "layout-<l>", "threads-<n>", "shape-<s>", ...). Comparison
+ * pipeline samples are main samples under their own pipeline label.
+ * Deduplicated kernels are stored once, with their duplicates' file stems.
+ * hash is the kernel's source signature (see KernelDedup), which is what
+ * matches a kernel across two result sets (compare). layers are the model
+ * layers the kernel and its duplicates came from (see model_layers.h).
+ *
+ * Rows are buffered and inserted one transaction per batch (at the latest
+ * after each kernel, see flush), so a run that dies loses at most the kernel
+ * it was on. --resume appends a new run to the same file. The per-kernel
+ * timings CSVs are an optional export on top (--csv-export).
+ */
+class ResultsStore {
+  static sqlite3 *db;
+  static long long run_id;
+  static std::string primary_pipeline;
+  static std::string outlier_method;
+  static bool csv_export;
+  static std::mutex mutex;
+
+  struct StatisticsRow {
+    std::string pipeline;
+    std::string op_type;
+    std::string kernel;
+    std::string variant;
+    std::string metric;
+    SampleSummary summary;
+  };
+  struct RejectedRow {
+    std::string pipeline;
+    std::string op_type;
+    std::string kernel;
+    std::string variant;
+    size_t sample;
+    std::string method;
+  };
+  static std::vector<StatisticsRow> pending_statistics;
+  static std::vector<RejectedRow> pending_rejected;
+
+  struct SampleRow {
+    std::string pipeline;
+    std::string op_type;
+    std::string kernel;
+    std::string variant;
+    int sample;
+    std::string metric;
+    double value;
+  };
+  static std::vector<SampleRow> pending;
+
+  static bool execute(const std::string &sql);
+  static bool flush_locked();
+
+public:
+  static fs::path filepath(const fs::path &output_dir);
+
+  static void set_csv_export(bool flag);
+  static bool is_csv_export();
+
+  /*
+   * Opens (or creates) the store and starts a new run in it. outlier_method
+   * (see Statistics::describe) tags the rejected samples.
+   */
+  static bool open(const fs::path &output_dir, const std::string &model,
+                   const std::string &primary_pipeline,
+                   const std::string &primary_metric,
+                   const std::string &outlier_method);
+  static bool is_open();
+  // Flushes what is left
+  static void close();
+
+  /*
+   * Buffers one value per metric of every sample. variant is the timings CSV
+   * suffix (".cold", ".pipeline-<label>", ...), annotations how the active
+   * pipeline built the kernel, stored once per pipeline
+   */
+  static void record_samples(
+      const KernelTask &task, const std::string &variant,
+      const std::vector<std::map<std::string, double>> &samples,
+      const std::vector<std::pair<std::string, std::string>> &annotations);
+  static void record_statistics(
+      const KernelTask &task, const std::string &variant,
+      const std::map<std::string, SampleSummary> &summaries,
+      const std::vector<std::pair<size_t, double>> &rejected);
+  static void record_kernel(const KernelTask &task);
+  static bool flush();
+
+  /*
+   * --only-changed: the kernel's rows of the latest run in a previous output
+   * directory, copied into the current run
+   */
+  static bool copy_kernel(const fs::path &previous_output_dir,
+                          const KernelTask &task);
+
+  /*
+   * Main sample averages of the primary pipeline, without rejected samples,
+   * per kernel from the latest run that measured it. False if there is no
+   * store in output_dir.
+   */
+  static bool load_averages(const fs::path &output_dir,
+                            std::vector<StoredKernel> &kernels);
+
+  /*
+   * Same selection as load_averages, with every kept sample value, the hash
+   * and the multiplicity of each kernel
+   */
+  static bool load_samples(const fs::path &output_dir, StoredRun &run);
+};
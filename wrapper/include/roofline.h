@@ -0,0 +1,47 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+/*
+ * Measured compute and memory roofs of the host
+ */
+struct MachinePeaks {
+  double gflops = 0.0;        // FMA throughput, single precision
+  double bandwidth_gbs = 0.0; // STREAM triad, bytes read and written
+  int threads = 1;
+  std::string isa; // vector extension of the FMA microkernel
+};
+
+/*
+ * Roofline placement of benchmarked kernels (`WrapperModule roofline`)
+ *
+ * The peaks come from built-in microkernels run on `threads` threads pinned
+ * from the measurement CPU on: independent FMA chains on the widest vector
+ * unit the CPU has (AVX-512, AVX2+FMA, SSE) and a STREAM triad over arrays
+ * four times the last level cache. Every kernel's gflops and
+ * arith_intensity (see kernel_cost.h) are then set against
+ *    attainable = min(peak gflops, arith_intensity * peak bandwidth)
+ * Kernels measured with --dram-traffic are classified by the share of each
+ * roof they achieve: compute (gflops), dram (dram_bandwidth_gbs against the
+ * triad) or cache when both shares are below one half.
+ */
+class Roofline {
+public:
+  static MachinePeaks measure_peaks(int first_cpu, int threads);
+
+  static bool write_peaks(const MachinePeaks &peaks, const fs::path &filepath);
+  static bool read_peaks(const fs::path &filepath, MachinePeaks &peaks);
+
+  /*
+   * <output_dir>/roofline.csv from the main samples of a run (its
+   * results.sqlite, else its timings/<op>/<kernel>.csv), farthest from the
+   * roof first, and the peaks next to it in
+   * machine_peaks.json. Returns the number of kernels placed.
+   */
+  static size_t write_roofline(const fs::path &output_dir,
+                               const MachinePeaks &peaks);
+};
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+
+namespace fs = std::filesystem;
+
+/*
+ * Transient artifacts off the output disk (--scratch-dir)
+ *
+ * Isolation, lowering and compilation write several files per kernel into
+ * the lowerings folder, which is slow on the network disks of CI runners.
+ * With a scratch directory the lowerings folder (and the isolation log) go
+ * to <scratch>/mlir-bench-scratch-<pid> instead; `memory` picks /dev/shm.
+ * At the end of the run persist() copies what the run reported per kernel
+ * (profiles, dumps, side-car reports, the kernel index and model layers)
+ * to <output>/lowerings, leaving out the build artifacts: kernel MLIR and
+ * metadata, LLVM IR, objects and raw logs. The scratch directory is then
+ * removed, unless --pass-logs asks to keep the intermediates.
+ *
+ * In `memory` mode, kernel objects are dlopen()ed from a memfd copy,
+ * so nothing stays mapped from the scratch files.
+ */
+class ScratchSpace {
+public:
+  // Creates the per run directory under root ("memory" for /dev/shm)
+  static fs::path create(const std::string &root);
+
+  // True for files only the build needs, which persist() leaves out
+  static bool is_build_artifact(const fs::path &filepath);
+
+  // Copies everything else below scratch_folder, returns the file count
+  static size_t persist(const fs::path &scratch_folder,
+                        const fs::path &output_folder);
+
+  /*
+   * dlopen() of a copy of the object in an anonymous memfd, through
+   * /proc/self/fd/<n>. nullptr with dlerror() set on failure.
+   */
+  static void *dlopen_from_memory(const fs::path &so_filepath, int flags);
+};
+
+/*
+ * Removes a per run directory (the scratch directory, a temporary input
+ * cache) when it goes out of scope, so a run that returns early leaves
+ * nothing behind either. keep() leaves the directory in place.
+ */
+class ScopedDirectory {
+public:
+  // An empty folder removes nothing
+  explicit ScopedDirectory(const fs::path &folder) : m_folder(folder) {}
+  ~ScopedDirectory();
+
+  ScopedDirectory(const ScopedDirectory &) = delete;
+  ScopedDirectory &operator=(const ScopedDirectory &) = delete;
+
+  void keep() { m_folder.clear(); }
+
+private:
+  fs::path m_folder;
+};
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "cache_evictor.h"
+
+#include "nlohmann/json.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+using json = nlohmann::json;
+
+/*
+ * One --shape-sweep variant of a kernel: batch multiplies the leading
+ * dimension of the activations, spatial their H and W (NCHW). Scaled
+ * dimensions are rounded and kept at 1 or more.
+ */
+struct ShapeScale {
+  std::string name; // "batch-2", "hw-0.5", "ws-l2-above"
+  double batch = 1.0;
+  double spatial = 1.0;
+  // --working-set-sweep variants: targeted cache level and working set
+  int cache_level = 0;
+  uint64_t target_bytes = 0;
+};
+
+/*
+ * Shape scaling of isolated kernels
+ *
+ * Activations are the first kernel_call argument plus every argument of the
+ * same rank and leading dimension (the other operand of elementwise ops or
+ * batched matmuls). H and W are only scaled for rank 4 arguments shaped
+ * exactly like the first one. Weights keep their shapes.
+ *
+ * Every other tensor type of the kernel (results and intermediates) is made
+ * dynamic with the same rank, and torch shape refinement recomputes it from
+ * the new arguments (CommandManager::generate_shape_variant). Kernels that
+ * spell shapes as constants (view, reshape) fail refinement and are skipped.
+ */
+class ShapeSweep {
+public:
+  /*
+   * "batch=1,2,4,8;hw=0.5,2". Each axis is swept on its own with the other
+   * one left at 1, factors of 1 are the model's shapes and dropped.
+   */
+  static std::vector<ShapeScale> parse(const std::string &spec);
+
+  /*
+   * Rewritten torch kernel for `scale`. False for kernels with dynamic or
+   * non-tensor arguments, or if no argument would change.
+   */
+  static bool rewrite_kernel(const std::string &mlir_text,
+                             const ShapeScale &scale, std::string &rewritten);
+
+  /*
+   * --dynamic-shapes: the kernel with every argument dimension a scale can
+   * change made dynamic (?), the leading one of the activations and H and W
+   * of the rank 4 ones, so that one object runs every swept shape. False
+   * under the same conditions as rewrite_kernel.
+   */
+  static bool relax_kernel(const std::string &mlir_text,
+                           std::string &rewritten);
+
+  /*
+   * Variants whose working set lands just below (0.75x) and just above
+   * (1.5x) every cache level. Rank 4 kernels are scaled in H and W, others
+   * in the leading dimension. Results are assumed to scale with the
+   * activations, weights are fixed. Levels the kernel can't reach are
+   * skipped.
+   */
+  static std::vector<ShapeScale>
+  for_working_sets(const json &metadata,
+                   const std::vector<CacheLevel> &caches);
+
+  // Total elements of the kernel arguments in a metadata JSON
+  static uint64_t input_elements(const fs::path &json_filepath);
+
+  // Bytes of every argument and result, i.e. the working set of one call
+  static uint64_t working_set_bytes(const fs::path &json_filepath);
+};
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "element_type.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+enum class SparseFormat { CSR, COO, BSR };
+
+// Storage of one --sparse-args argument
+struct SparseArgument {
+  SparseFormat format = SparseFormat::CSR;
+  unsigned int block = 0; // BSR block edge
+};
+
+// One buffer of a compressed argument, as the kernel takes it
+struct SparseBuffer {
+  ElementType type = ElementType::I64;
+  uint64_t count = 0;
+  std::vector<uint8_t> data;
+};
+
+/*
+ * sparse_tensor encoded kernel variants (--sparse-args)
+ *
+ * The SPARSE profile feeds dense kernels sparse data. Sparse code proper
+ * comes from the sparsifier: selected kernel arguments get an encoding on
+ * their !torch.vtensor type, which the linalg lowering carries over, and
+ * the kernel is lowered by the sparse pipeline (--sparse-pipeline, whatever
+ * the --pipeline) instead of the dense one. Formats, for a rank r tensor:
+ *    csr    - leading dimensions dense, the last one compressed
+ *    coo    - the first dimension compressed (non unique), the others
+ *             singletons with one coordinate array each
+ *    bsr<b> - rank 2 only, dense b x b blocks (default 4) in a CSR of
+ *             block rows. Both dimensions have to divide by b.
+ *
+ * The sparse assembler gives the kernel's public signature one rank 1
+ * memref per buffer in place of each encoded argument: values first, then
+ * positions and coordinates level by level (index, i.e. i64, entries):
+ *    csr    - values, positions (rows + 1), column coordinates
+ *    coo    - values, positions ([0, nnz]), one coordinate array per
+ *             dimension
+ *    bsr<b> - values (b * b per block), positions (block rows + 1), block
+ *             column coordinates
+ * The metadata keeps the dense argument tagged with "sparse": "<format>".
+ * Its input is generated as usual (the same values the dense kernel gets)
+ * and compressed before the call.
+ */
+class SparseEncoding {
+public:
+  // "csr", "coo", "bsr" or "bsr<b>"
+  static bool parse_format(const std::string &name, SparseArgument &argument);
+  static std::string describe(const SparseArgument &argument);
+
+  // "<index>:<format>[,<index>:<format>...]", e.g. "1:csr" or "0:bsr8"
+  static bool parse(const std::string &spec,
+                    std::map<size_t, SparseArgument> &arguments);
+
+  // #sparse_tensor.encoding of the format for a tensor of `shape`, empty if
+  // the format doesn't fit it
+  static std::string encoding(const SparseArgument &argument,
+                              const std::vector<uint64_t> &shape);
+
+  /*
+   * The kernel with the listed arguments' types encoded in its signature
+   * and at their uses, the encodings defined as aliases at the top.
+   * `shapes` are the arguments' shapes. Arguments the format doesn't fit
+   * are left dense and dropped from `arguments`. False if none is left.
+   */
+  static bool annotate(const std::string &kernel_text,
+                       const std::vector<std::vector<uint64_t>> &shapes,
+                       std::map<size_t, SparseArgument> &arguments,
+                       std::string &annotated);
+
+  // Memrefs the assembler passes for an encoded argument of `rank`
+  static size_t buffer_count(const SparseArgument &argument, size_t rank);
+
+  // Whether the kernel has encoded types and needs the sparse pipeline
+  static bool is_sparse_kernel(const fs::path &mlir_filepath);
+
+  /*
+   * The buffers of a row major dense tensor in the order described above.
+   * Entries equal to zero are not stored.
+   */
+  static bool compress(const SparseArgument &argument,
+                       const std::vector<uint64_t> &shape, ElementType type,
+                       const void *dense, std::vector<SparseBuffer> &buffers);
+};
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+ * Outlier rejection of a kernel's samples, on its primary metric
+ *
+ * NONE - every sample counts (default)
+ * MAD  - modified z-score 0.6745 * |x - median| / MAD above the threshold
+ *        (default 3.5)
+ * IQR  - outside [Q1 - k * IQR, Q3 + k * IQR] (default k = 1.5)
+ *
+ * A rejected sample is left out of every metric's averages and statistics,
+ * since a descheduled run is off in all its counters at once.
+ */
+enum class OutlierMethod { NONE, MAD, IQR };
+
+struct OutlierConfig {
+  OutlierMethod method = OutlierMethod::NONE;
+  double threshold = 0.0; // 0 = the method's default
+  unsigned int bootstrap_resamples = 1000;
+};
+
+// Robust summary of one metric's samples
+struct SampleSummary {
+  size_t count = 0;
+  double mean = 0.0;
+  double median = 0.0;
+  double min = 0.0;
+  double max = 0.0;
+  double p90 = 0.0;
+  double p99 = 0.0;
+  double stddev = 0.0;
+  double mad = 0.0; // unscaled median absolute deviation
+  // Percentile bootstrap 95% interval of the mean
+  double ci95_low = 0.0;
+  double ci95_high = 0.0;
+};
+
+/*
+ * Sample statistics used by the measurement loop (warmup detection, adaptive
+ * sampling) and the reports
+ */
+class Statistics {
+public:
+  static double mean(const std::vector<double> &values);
+
+  // Sample (n - 1) standard deviation, 0 for less than 2 values
+  static double stddev(const std::vector<double> &values);
+
+  // stddev / mean, 0 if the mean is 0
+  static double coefficient_of_variation(const std::vector<double> &values);
+
+  // CV of the last `window` values only
+  static double window_cv(const std::vector<double> &values, size_t window);
+
+  // Two sided 95% Student-t critical value for `degrees` degrees of freedom
+  static double t_critical_95(size_t degrees);
+
+  /*
+   * Half width of the 95% confidence interval of the mean, relative to the
+   * mean (0.01 = +-1%). Infinite for less than 2 values.
+   */
+  static double relative_ci_95(const std::vector<double> &values);
+
+  static double median(const std::vector<double> &values);
+
+  // Linearly interpolated, `fraction` in [0, 1]
+  static double percentile(const std::vector<double> &values,
+                           double fraction);
+
+  // Median absolute deviation from the median
+  static double mad(const std::vector<double> &values);
+
+  /*
+   * Percentile bootstrap interval of the mean, from `resamples` resamples
+   * drawn with a fixed seed so reruns report the same interval
+   */
+  static void bootstrap_ci_95(const std::vector<double> &values,
+                              unsigned int resamples, double &low,
+                              double &high);
+
+  static SampleSummary summarize(const std::vector<double> &values,
+                                 unsigned int bootstrap_resamples);
+
+  /*
+   * True for every value the configured method rejects. Nothing is rejected
+   * below 4 values, without any spread, or if the method would reject more
+   * than half of them.
+   */
+  static std::vector<bool> find_outliers(const std::vector<double> &values,
+                                         const OutlierConfig &config);
+
+  static std::string describe(OutlierMethod method);
+  static bool parse(const std::string &name, OutlierMethod &method);
+
+  /*
+   * Two sided Mann-Whitney U test of a against b, normal approximation with
+   * tie correction. `u` is a's statistic (pairs where a wins, ties counting
+   * half). 1 if either side has no values.
+   */
+  static double mann_whitney_p(const std::vector<double> &a,
+                               const std::vector<double> &b, double &u);
+
+  /*
+   * Two sided bootstrap test of a difference between the medians of a and b,
+   * from `resamples` resamples with a fixed seed
+   */
+  static double bootstrap_p(const std::vector<double> &a,
+                            const std::vector<double> &b,
+                            unsigned int resamples);
+
+  /*
+   * Multiple comparison adjusted p-values, in the order of `p_values`.
+   * Holm's step-down bounds the family-wise error rate, Benjamini-Hochberg's
+   * step-up the false discovery rate. An adjusted p below alpha is
+   * significant at alpha for the whole family.
+   */
+  static std::vector<double> holm(const std::vector<double> &p_values);
+  static std::vector<double>
+  benjamini_hochberg(const std::vector<double> &p_values);
+
+  // P(a > b) - P(a < b) over all pairs, in [-1, 1]
+  static double cliffs_delta(const std::vector<double> &a,
+                             const std::vector<double> &b);
+
+  // Correlation of paired values in [-1, 1], 0 if either side is constant
+  static double pearson(const std::vector<double> &x,
+                        const std::vector<double> &y);
+  // Pearson of the ranks, ties ranked at their average
+  static double spearman(const std::vector<double> &x,
+                         const std::vector<double> &y);
+};
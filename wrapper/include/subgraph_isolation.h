@@ -0,0 +1,109 @@
+#pragma once
+
+#include "command_manager.h"
+#include "nlohmann/json.hpp"
+
+#include <filesystem>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+using json = nlohmann::json;
+
+/*
+ * Granularity of the isolated kernels:
+ *    OP      - single torch ops, as --isolate-torch-ops cuts them
+ *    PAIR    - every producer-consumer pair of ops
+ *    WINDOW  - `window` consecutive ops, each after the first consuming a
+ *              result of an earlier one
+ *    PATTERN - chains of the listed op names, "convolution+relu" is a
+ *              convolution whose result feeds a relu
+ */
+enum class FusionGranularity { OP, PAIR, WINDOW, PATTERN };
+
+struct FusionSpec {
+  FusionGranularity granularity = FusionGranularity::OP;
+  unsigned int window = 2;
+  std::vector<std::vector<std::string>> patterns;
+};
+
+// Origin of a kernel argument of an isolated op
+struct KernelInput {
+  std::string value; // %12, as the model writes it
+  // Layer index of the isolated op computing it, -1 for function arguments,
+  // weights and results of other ops
+  long producer = -1;
+  unsigned int result = 0; // Result number of the producer
+};
+
+/*
+ * Multi-op subgraph isolation (--isolate-granularity)
+ *
+ * Single op kernels keep fusion passes such as linalg-fuse-elementwise-ops
+ * from ever seeing a conv+relu or matmul+add. Besides the single op kernels,
+ * the model's forward function is cut into subgraphs of the isolated op
+ * types, each written as its own kernel_call:
+ *    - tensors from outside the subgraph (activations, weights of
+ *      torch.vtensor.literal) become arguments,
+ *    - the scalar and list operands they are built from (torch.constant.*,
+ *      torch.prim.ListConstruct) are copied in,
+ *    - results used after the subgraph, or not at all, are returned.
+ * Subgraphs that need a non-tensor value from an isolated op, or hand one
+ * on, are skipped. Identical subgraphs (same ops and shapes) are written
+ * once, to <lowerings>/subgraphs/<ops>/<n>.mlir, and listed in
+ * <lowerings>/subgraphs.json with the model ops of each occurrence:
+ *    { "granularity": "pair",
+ *      "subgraphs": [ { "kernel": "subgraphs/convolution+relu/0.mlir",
+ *                       "ops": ["aten.convolution", "aten.relu"],
+ *                       "occurrences": [ [ {"op": "torch.aten.convolution",
+ *                                           "occurrence": 0}, ... ] ] } ] }
+ * occurrence counts the ops of that type in model order, as model layers
+ * do (see model_layers.h).
+ *
+ * The subgraphs are lowered and measured like the shape variants, and
+ * write_opportunities sets each against the sum of its ops' kernels.
+ */
+class SubgraphIsolation {
+public:
+  // "op", "pair", "window:<k>" or "pattern:<a+b>[,<c+d>...]"
+  static bool parse(const std::string &spec, FusionSpec &fusion);
+  static std::string describe(const FusionSpec &fusion);
+
+  static fs::path manifest_filepath(const fs::path &lowering_folder);
+
+  /*
+   * Writes the subgraphs of the model's text (the model, or the print of a
+   * bytecode model) and the manifest. One task per distinct subgraph, with
+   * its metadata, ready for prepare_kernel. op_types are the isolated op
+   * types (aten.convolution, ...).
+   */
+  static std::vector<KernelTask>
+  isolate(const fs::path &model_text_filepath,
+          const std::set<std::string> &op_types, const FusionSpec &fusion,
+          const fs::path &lowering_folder);
+
+  /*
+   * Arguments of every op of op_types in model order (the layer order of
+   * model_layers.json), as the single op kernels take them. An op whose
+   * arguments can't be traced gets an empty list.
+   */
+  static std::vector<std::vector<KernelInput>>
+  kernel_inputs(const fs::path &model_text_filepath,
+                const std::set<std::string> &op_types);
+
+  /*
+   * One row per measured subgraph, by total savings:
+   *    rank,subgraph,kernel,occurrences,layers,metric,fused,parts,saved,
+   *    saved_total,speedup
+   * parts is the sum of the metric over the single op kernels of an
+   * occurrence's layers, averaged over the occurrences, saved is parts -
+   * fused per call and saved_total that times the occurrences. The top
+   * opportunities are printed. False if nothing was written.
+   */
+  static bool write_opportunities(const std::vector<KernelTask> &tasks,
+                                  const std::vector<KernelTask> &variants,
+                                  const std::string &metric,
+                                  const fs::path &lowering_folder,
+                                  const fs::path &csv_filepath);
+};
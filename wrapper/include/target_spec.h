@@ -0,0 +1,70 @@
+#pragma once
+
+#include "nlohmann/json.hpp"
+
+#include <string>
+#include <vector>
+
+using json = nlohmann::json;
+
+/*
+ * Code generation target of a pipeline
+ *
+ * Read from the optional pipeline JSON fields
+ *    "target_cpu":      "native" | "skylake-avx512" | ...   (default: native)
+ *    "target_features": "+avx2,+fma,-avx512f"               (default: none)
+ *    "vector_width":    256                                 (default: backend)
+ *    "target_triple":   "aarch64-linux-gnu" | ...           (default: host)
+ *    "gpu_chip":        "sm_90" | "gfx942" | ...            (default: device)
+ *
+ * `native` is resolved to the host CPU name through the compiler driver, so
+ * that every result CSV records the actual target instead of the alias.
+ * A triple for another architecture than the host's makes the target a
+ * cross target: kernels are compiled to relocatable objects for it and
+ * measured on --workers of that architecture (see distributed.h), and
+ * `native` means the architecture's generic CPU. GPU pipelines without a
+ * gpu_chip compile for the GPU of this host (see GpuRuntime::device_chip).
+ */
+struct TargetSpec {
+  std::string requested_cpu = "native";
+  std::string cpu = "native"; // Resolved name
+  std::vector<std::string> features;
+  unsigned int vector_width = 0;
+  std::string triple; // Empty for the host
+  std::string gpu_chip; // Empty for the host's GPU
+};
+
+class TargetInfo {
+public:
+  static TargetSpec from_pipeline_json(const json &pipeline);
+
+  /*
+   * Extracts the value of "-target-cpu" from a `<cc> -march=native -###`
+   * driver dump. Returns an empty string if it is not present.
+   */
+  static std::string parse_driver_target_cpu(const std::string &driver_output);
+
+  // True if the host (CPUID) or the requested features provide AVX2/AVX-512
+  static bool has_x86_vector_extensions(const TargetSpec &target);
+
+  // "x86_64", "aarch64", ... of the triple, or of the host without one
+  static std::string architecture(const TargetSpec &target);
+  static std::string host_architecture();
+  // Compiled on this host, measured on another architecture
+  static bool is_cross(const TargetSpec &target);
+
+  /*
+   * --target/-march (-mcpu on AArch64)/-mprefer-vector-width/-target-feature
+   * flags for the final compile
+   */
+  static std::string compile_flags(const TargetSpec &target);
+
+  /*
+   * Adjusts target dependent lowering passes, e.g. enables the x86vector
+   * lowering of convert-vector-to-llvm when the target supports it
+   */
+  static void apply_to_pass_list(const TargetSpec &target,
+                                 std::vector<std::string> &pass_list);
+
+  static std::string features_string(const TargetSpec &target);
+};
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "command_manager.h"
+
+#include <string>
+
+struct TelemetryConfig {
+  // JSON lines: a file path (appended to), or unix:<path> of a listening
+  // socket. Empty: off.
+  std::string progress;
+  // [host:]port of the Prometheus endpoint, host defaults to 127.0.0.1.
+  // Empty: off.
+  std::string metrics_listen;
+  double interval_seconds = 10.0;
+};
+
+/*
+ * Live progress of a run (--progress, --metrics-listen)
+ *
+ * Counters are bumped as kernels move through the run and published two ways:
+ *    --progress        one JSON object per line,
+ *                      {"event": "start", "run", "time"}
+ *                      {"event": "stage", "stage", "time", "elapsed"}
+ *                      {"event": "kernel", "kernel", "op_type", "status",
+ *                       "samples", "elapsed"}   as each kernel finishes
+ *                      {"event": "progress", ...} every --progress-interval:
+ *                        kernels total/done/measured/failed/reused/
+ *                        skipped_budget/ *                        compiled/compile_failed, samples, per stage
+ *                        throughput over the interval (kernels compiled/s,
+ *                        kernels measured/s, samples/s), eta_seconds and
+ *                        compile cache hit rates
+ *                      {"event": "finished", "status", "elapsed"}
+ *    --metrics-listen  GET /metrics in Prometheus' text format (mlir_bench_*
+ *                      gauges and counters), GET /progress the latest
+ *                      progress object
+ * The ETA divides the kernels left by the rate at which kernels finished
+ * since the first one did. Status is "measured", "failed" (the sandboxed
+ * measurement died), "compile_failed", "reused" (--resume, --only-changed)
+ * or "skipped_budget" (--time-budget ran out before it was compiled or
+ * measured).
+ *
+ * Everything runs on one thread kept off the measurement CPU. Calls are cheap
+ * no-ops while telemetry is not started, e.g. in --worker processes.
+ */
+class Telemetry {
+public:
+  // False (with a message) if a sink can't be opened, the others still run
+  static bool start(const TelemetryConfig &config, int reserved_cpu,
+                    const std::string &run);
+  // Final progress and "finished" event; no-op if not started
+  static void stop(const std::string &status);
+  static bool is_running();
+
+  static void stage(const std::string &name);
+  static void set_total(size_t kernels);
+  static void compiled(bool ok);
+  static void kernel_done(const KernelTask &task, const std::string &status,
+                          size_t samples);
+};
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "numa_placement.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+ * Backing pages of the arena
+ *
+ * NONE    - Regular 4 KiB pages
+ * THP     - Transparent huge pages (madvise(MADV_HUGEPAGE))
+ * HUGETLB - Explicit 2 MiB huge pages (MAP_HUGETLB), which need
+ *           vm.nr_hugepages to be set. Falls back to regular pages.
+ */
+enum HugePageMode { NONE, THP, HUGETLB };
+
+struct ArenaConfig {
+  uint64_t alignment = 64; // Alignment of every tensor buffer
+  HugePageMode huge_pages = HugePageMode::NONE;
+  NumaPolicy numa_policy = NumaPolicy::FIRST_TOUCH;
+  std::vector<int> numa_nodes; // See NumaPlacement::target_nodes
+};
+
+/*
+ * Tensor buffer arena
+ *
+ * Hands out aligned buffers for kernel inputs from large, 2 MiB aligned slabs.
+ * Buffers are never freed one by one. reset() recycles the whole arena
+ * between kernels, so a long model run doesn't keep growing the heap and every
+ * kernel sees the same buffer placement.
+ *
+ * Slabs are bound to the configured NUMA nodes right after mapping, before
+ * any page is touched.
+ *
+ * allocate_untouched() maps a separate region that the host never writes
+ * (lazily zeroed "zeros" inputs). The kernel's first write to a page faults
+ * in a zeroed page, while reads of untouched pages all hit the kernel's
+ * shared zero page. These regions are unmapped by reset() rather than
+ * recycled, so every kernel starts from untouched pages.
+ */
+class TensorArena {
+public:
+  explicit TensorArena(const ArenaConfig &config = ArenaConfig());
+  ~TensorArena();
+
+  TensorArena(const TensorArena &) = delete;
+  TensorArena &operator=(const TensorArena &) = delete;
+
+  // nullptr if no slab could be mapped
+  void *allocate(uint64_t bytes);
+  void *allocate_untouched(uint64_t bytes);
+  void reset();
+
+  // True if ptr points into one of the slabs or untouched regions
+  bool contains(const void *ptr) const;
+
+  const ArenaConfig &config() const { return m_config; }
+  uint64_t reserved_bytes() const;
+
+  static std::string describe(HugePageMode mode);
+
+private:
+  struct Slab {
+    void *mapping = nullptr; // As returned by mmap
+    uint64_t mapping_bytes = 0;
+    uint8_t *base = nullptr; // 2 MiB aligned start inside the mapping
+    uint64_t size = 0;
+    uint64_t used = 0;
+  };
+
+  bool add_slab(uint64_t min_bytes);
+  void release_untouched();
+
+  ArenaConfig m_config;
+  std::vector<Slab> m_slabs;
+  std::vector<Slab> m_untouched; // One mapping each, never recycled
+  size_t m_current = 0;
+};
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "element_type.h"
+#include "utils.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+ * Compression applied to dumped tensors, through the gzip / zstd command
+ * line tools (which replace <file>.npy by <file>.npy.gz / .npy.zst)
+ */
+enum DumpCompression { UNCOMPRESSED, GZIP, ZSTD };
+
+/*
+ * One tensor of a dump: a dense, row major copy of the data plus the layout
+ * the kernel saw it in
+ */
+struct DumpedTensor {
+  std::string name; // input<i> / output<r>
+  ElementType type = ElementType::F32;
+  std::vector<int64_t> shape;
+  std::vector<int64_t> strides;
+  int64_t offset = 0;
+  std::vector<uint8_t> data;
+
+  static DumpedTensor from(const std::string &name, MemRefArg &tensor);
+};
+
+/*
+ * Binary run logs (--output-logs)
+ *
+ * Every kernel gets a <kernel>.tensors/ directory holding one .npy per input
+ * and output and a manifest.json with name, file, dtype, shape, strides and
+ * offset of each. bf16 has no numpy dtype and is stored as its raw uint16
+ * bits ('<u2'), the manifest keeps the real dtype. graph-gen/read_dump.py
+ * loads and summarises dumps.
+ *
+ * Tensors are copied after the timed region and written on a background
+ * thread, which is kept off the measurement CPU. flush() waits for pending
+ * dumps and must run before the process exits.
+ */
+class TensorDump {
+public:
+  static void configure(DumpCompression compression, int reserved_cpu);
+
+  static void submit(const fs::path &directory, const std::string &kernel,
+                     std::vector<DumpedTensor> tensors);
+  static void flush();
+
+  // Writes a single .npy (v1.0) file
+  static bool write_npy(const fs::path &filepath, const DumpedTensor &tensor);
+  static std::string npy_descr(ElementType type);
+  static std::string describe(DumpCompression compression);
+
+private:
+  static void write_dump(const fs::path &directory, const std::string &kernel,
+                         const std::vector<DumpedTensor> &tensors);
+
+  static DumpCompression compression;
+  static int reserved_cpu;
+};
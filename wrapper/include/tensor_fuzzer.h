@@ -1,11 +1,50 @@
 #pragma once
 
+#include "data_order.h"
+#include "element_type.h"
+
+#include "nlohmann/json.hpp"
+
 #include <cmath>
 #include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
 
-enum DataProfile { TEST, RANDOM, RANDOM_NORM, ZEROS, SPARSE };
-enum DataOrder { NCHW, NCWH };
+using json = nlohmann::json;
 
+/*
+ * ZEROS            - Lazily zeroed pages the host never touches (see
+ *                    TensorArena::allocate_untouched). Page faults land in
+ *                    the kernel's first call.
+ * ZEROS_PREFAULTED - Zeros written by the host, every page is faulted in
+ *                    before the kernel runs
+ *
+ * Special value profiles (floating point element types, integer inputs fall
+ * back to RANDOM_NORM):
+ * DENORMAL         - Every value subnormal in the element type, either sign
+ * MIXED_SPECIAL    - RANDOM_NORM values with about 1 in 11 replaced by NaN,
+ *                    +-inf, -0 or a subnormal
+ * LARGE_MAGNITUDE  - Either sign, magnitudes in [max / 256, max] of the
+ *                    element type, so that sums and products overflow
+ *
+ * FROM_STATS       - Zero fraction and histogram recorded from a real run of
+ *                    the model (see activation_stats.h). Arguments without
+ *                    recorded statistics fall back to RANDOM_NORM.
+ */
+enum DataProfile {
+  TEST,
+  RANDOM,
+  RANDOM_NORM,
+  ZEROS,
+  SPARSE,
+  ZEROS_PREFAULTED,
+  DENORMAL,
+  MIXED_SPECIAL,
+  LARGE_MAGNITUDE,
+  FROM_STATS
+};
 /*
  * TODO: Implement Distribution detection
  *
@@ -27,15 +66,64 @@ enum SparsityDist {
   UNSTRUCTURED_DIAGONALS, // Diagonals are selected at random and pruned
 };
 
+/*
+ * Pruning units of the distributions, over the buffer viewed as rows of
+ * m_row_length elements (block = row_block_size / col_block_size):
+ *    STRUCTURED_ROW_WISE    - `block` consecutive rows
+ *    STRUCTURED_COL_WISE    - `block` consecutive columns
+ *    UNSTRUCTURED_PURE      - single elements
+ *    UNSTRUCTURED_TILE_1D   - `block` consecutive elements
+ *    UNSTRUCTURED_TILE_2D   - block x block tiles
+ *    UNSTRUCTURED_DIAGONALS - `block` adjacent (wrapping) diagonals
+ *
+ * Exactly round(sparsity_percentage * units) units are pruned, picked by the
+ * seeded generator. Patterns of more than 16M units (single elements, fine
+ * tiles) prune every unit independently with that probability instead.
+ */
 struct SparsityProfile {
-  SparsityDist distribution_type;
+  SparsityDist distribution_type = SparsityDist::UNSTRUCTURED_PURE;
   union {
     uint8_t col_block_size;
     uint8_t row_block_size =
         1; // Default: Single rows/cols at random are set to zeros
   };
-  float sparsity_percentage; // Probability of selecting data unit for data
-                             // pruning
+  float sparsity_percentage = 0.f; // Probability of selecting data unit for
+                                   // data pruning
+};
+
+/*
+ * Recorded distribution of one kernel argument (FROM_STATS). The histogram
+ * counts the non zero values in equal width bins over
+ * [histogram_min, histogram_max].
+ */
+struct TensorStats {
+  double zero_fraction = 0.0;
+  double mean = 0.0;
+  double stddev = 0.0;
+  double min = 0.0;
+  double max = 0.0;
+  double histogram_min = 0.0;
+  double histogram_max = 0.0;
+  std::vector<double> histogram;
+};
+
+/*
+ * Input data of a run: the pipeline JSON's optional "inputs" section, which
+ * the --input-* flags override
+ *    "inputs": {
+ *      "profile":      "random-norm" | "random" | "zeros"
+ *                      | "zeros-prefaulted" | "sparse" | "denormal"
+ *                      | "mixed-special" | "large-magnitude"
+ *                      | "from-stats",
+ *      "density":      0.1,             (sparse only, fraction of non zeros)
+ *      "distribution": "unstructured" | "row" | "col" | "tile1d" | "tile2d"
+ *                      | "diagonal",
+ *      "block":        4
+ *    }
+ */
+struct InputProfile {
+  DataProfile profile = DataProfile::RANDOM_NORM;
+  SparsityProfile sparsity;
 };
 
 // TODO: Complete fuzzer feature
@@ -53,6 +141,14 @@ public:
 
   F32Range m_range_bounds;
   uint64_t m_elem_count;
+  uint64_t m_row_length = 0; // Innermost extent of the buffer, 0 = one row
+  ElementType m_elem_type = ElementType::F32;
+  uint64_t m_seed = 0; // 0 seeds from the clock, anything else reproduces
+  // Memory order of a rank 4 tensor and its stored shape. Values are drawn
+  // in logical NCHW order, so every order holds the same tensor.
+  DataOrder m_order = DataOrder::NCHW;
+  std::vector<uint64_t> m_stored_dims;
+  std::shared_ptr<const TensorStats> m_stats; // FROM_STATS only
 
   // Default setting: RANDOM_NORM profile
   DataFormatInfo(const DataProfile &profile = DataProfile::RANDOM_NORM,
@@ -61,21 +157,84 @@ public:
   F32Range getRange();
   void setRange(const float &vmin, const float &vmax);
   void setElemCount(const uint64_t &elem_count);
+  void setElemType(const ElementType &elem_type);
+  void setRowLength(const uint64_t &row_length);
+  void setSeed(const uint64_t &seed);
   void setProfile(const DataProfile &profile);
-
-  // TODO: Add sparsity support;
-  // void setSparsityDensity(float percentage);
-  // void setSparsityDist();
+  void setSparsity(const SparsityProfile &sparsity);
+  void setInputProfile(const InputProfile &input);
+  void setDataOrder(const DataOrder &order,
+                    const std::vector<uint64_t> &stored_dims);
+  void setStats(const std::shared_ptr<const TensorStats> &stats);
 };
 
+/*
+ * Data generation is dispatched on m_elem_type. The generators are templated
+ * on the storage type and values are converted once per element, f16 and
+ * bf16 through their IEEE bit patterns (see element_type.h). Integer types
+ * draw normalised values from [0, 16) so that index tensors stay small.
+ *
+ * Random values come from a counter based generator: element i is a hash of
+ * (stream key, i), so any split of the buffer produces the same data. Large
+ * buffers are filled in blocks the compiler vectorises, by worker threads on
+ * the measurement CPU's NUMA node (first touch keeps the pages local).
+ */
 class TensorFuzzer {
-  static float *generate_random_data(DataFormatInfo info);
-  static float *generate_test_data(DataFormatInfo info);
-  static float *generate_random_data_norm(DataFormatInfo info);
-  static float *generate_zero_data(DataFormatInfo info);
-  // static float *generate_sparse_data(const uint64_t &elem_count,
-  // const float &sparse_percentage);
+  static unsigned int worker_count;
+  static int reserved_cpu;
+
+  template <typename T>
+  static void generate_random_data(DataFormatInfo info, T *array);
+  template <typename T>
+  static void generate_test_data(DataFormatInfo info, T *array);
+  template <typename T>
+  static void generate_random_data_norm(DataFormatInfo info, T *array);
+  static void generate_zero_data(DataFormatInfo info, void *array);
+  template <typename T>
+  static void generate_sparse_data(DataFormatInfo info, T *array);
+  template <typename T>
+  static void generate_special_data(DataFormatInfo info, T *array);
+  template <typename T>
+  static void generate_stats_data(DataFormatInfo info, T *array);
+
+  template <typename T>
+  static bool fill_typed(DataFormatInfo dataInfo, T *array);
+
+  // Runs fill(begin, end) over [0, count), split across the workers
+  static void
+  parallel_fill(uint64_t count,
+                const std::function<void(uint64_t, uint64_t)> &fill);
 
 public:
-  static float *generate_data(DataFormatInfo dataInfo);
+  /*
+   * threads = 0 uses every CPU of reserved_cpu's node, the calling thread
+   * (pinned to reserved_cpu) takes a share as well
+   */
+  static void configure(unsigned int threads, int reserved_cpu);
+
+  /*
+   * Seed of one argument's stream, derived from the run seed (--seed), the
+   * kernel's content hash and the argument index. Never 0 for a non-zero
+   * run seed.
+   */
+  static uint64_t stream_seed(uint64_t run_seed, uint64_t kernel_hash,
+                              size_t arg_index);
+
+  // malloc'd buffer of m_elem_count values, owned by the caller
+  static void *generate_data(DataFormatInfo dataInfo);
+
+  // Same, into a caller provided buffer (e.g. from a TensorArena)
+  static bool fill_data(DataFormatInfo dataInfo, void *array);
+
+  // Profiles whose buffers are handed out untouched instead of filled
+  static bool is_untouched(DataProfile profile);
+
+  // Profile names as used by the pipeline JSON and the CLI
+  static bool parse_profile(const std::string &name, DataProfile &profile);
+  static bool parse_distribution(const std::string &name,
+                                 SparsityDist &distribution);
+  static std::string describe(DataProfile profile);
+  static std::string describe(SparsityDist distribution);
+
+  static InputProfile from_pipeline_json(const json &pipeline);
 };
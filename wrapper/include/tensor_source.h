@@ -0,0 +1,71 @@
+#pragma once
+
+#include "element_type.h"
+#include "utils.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+ * A tensor file mapped into memory
+ *
+ * data points straight into the mapping, which is private (copy on write):
+ * kernels writing to their inputs never touch the file.
+ */
+struct MappedTensor {
+  void *data = nullptr;
+  ElementType type = ElementType::F32;
+  std::vector<uint64_t> shape;
+  uint64_t bytes = 0;
+};
+
+/*
+ * Real tensor inputs (--tensor-source <dir>)
+ *
+ * Argument i of kernel <kernel> (the metadata JSON stem) is bound to the
+ * first of
+ *    <dir>/<kernel>/arg<i>.npy
+ *    <dir>/<kernel>.safetensors, tensor "arg<i>"
+ *
+ * Files are mmap'd, never read or copied, so multi-GB weights cost no extra
+ * memory. Shape and dtype must match the metadata, and only C ordered, dense
+ * layouts can be bound. Arguments without a file are generated as usual.
+ * Every mapping lives as long as the TensorSource.
+ */
+class TensorSource {
+public:
+  explicit TensorSource(const fs::path &directory);
+  ~TensorSource();
+
+  TensorSource(const TensorSource &) = delete;
+  TensorSource &operator=(const TensorSource &) = delete;
+
+  /*
+   * Maps the tensor bound to argument `index`. Returns false if there is no
+   * file for it, or (with a message) if it doesn't match `expected`.
+   */
+  bool bind(const std::string &kernel, size_t index,
+            const JSONArgument &expected, MappedTensor &tensor);
+
+  uint64_t mapped_bytes() const { return m_mapped_bytes; }
+
+private:
+  struct Mapping {
+    void *address = nullptr;
+    uint64_t bytes = 0;
+  };
+
+  // nullptr if the file can't be mapped, cached per file
+  const Mapping *map_file(const fs::path &filepath);
+
+  static bool parse_npy(const Mapping &mapping, MappedTensor &tensor,
+                        std::string &error);
+  static bool parse_safetensors(const Mapping &mapping,
+                                const std::string &name, MappedTensor &tensor,
+                                std::string &error);
+
+  fs::path m_directory;
+  std::vector<std::pair<fs::path, Mapping>> m_mappings;
+  uint64_t m_mapped_bytes = 0;
+};
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+/*
+ * Fixed size worker pool used for the compilation stages (metadata generation,
+ * lowering, object builds).
+ *
+ * Workers can optionally be kept off a reserved CPU, so that the measurement
+ * thread pinned to that CPU is never disturbed by compilation work.
+ */
+class ThreadPool {
+  std::vector<std::thread> m_workers;
+  std::queue<std::function<void()>> m_tasks;
+
+  std::mutex m_mutex;
+  std::condition_variable m_task_available;
+  std::condition_variable m_all_done;
+
+  uint64_t m_pending = 0; // Queued + currently running tasks
+  bool m_stopping = false;
+
+  void worker_loop(int reserved_cpu);
+
+public:
+  ThreadPool() = delete;
+
+  // reserved_cpu < 0 means workers may run on any CPU
+  ThreadPool(unsigned int worker_count, int reserved_cpu = -1);
+  ~ThreadPool();
+
+  void submit(std::function<void()> task);
+
+  // Blocks until every submitted task has finished
+  void wait();
+
+  unsigned int size() const;
+};
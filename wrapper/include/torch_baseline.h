@@ -0,0 +1,58 @@
+#pragma once
+
+#include "utils.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+enum class TorchMode { EAGER, COMPILE };
+
+/*
+ * PyTorch baseline of an isolated kernel (--torch-baseline eager,compile)
+ *
+ * The isolated torch kernel holds a single aten op whose non-tensor operands
+ * (stride, padding, dilation, ...) are constants. Its metadata records them
+ * under "op" (see KernelMetadata::extract_op):
+ *    { "name": "aten.convolution",
+ *      "operands": [ {"arg": 0}, {"arg": 1}, {"arg": 2}, [4, 4], [2, 2],
+ *                    [1, 1], false, [0, 0], 1 ] }
+ *
+ * A TorchCall binds torch.ops.<name> to the kernel's own input buffers
+ * (zero copy tensors with the same strides) through the embedded interpreter,
+ * eager or wrapped in torch.compile, so that it can stand in for the kernel
+ * in the same counter windows. The interpreter is initialised on first use
+ * and stays up, like for the activation statistics. torch runs on as many
+ * threads as the kernel may use (1 for serial kernels).
+ */
+class TorchCall {
+public:
+  // Comma separated "eager" / "compile", empty or "none" for no baseline
+  static bool parse(const std::string &list, std::vector<TorchMode> &modes);
+  // "torch-eager" / "torch-compile", the variant name of the samples
+  static std::string describe(TorchMode mode);
+
+  /*
+   * Returns nullptr (and prints why) if torch is missing or the op can't be
+   * bound. The bound op is called once, which compiles it in COMPILE mode.
+   */
+  static std::unique_ptr<TorchCall> bind(const json &op, TorchMode mode,
+                                         const std::vector<MemRefArg *> &args,
+                                         unsigned int threads);
+  ~TorchCall();
+
+  TorchCall(const TorchCall &) = delete;
+  TorchCall &operator=(const TorchCall &) = delete;
+
+  // One call of the op, its result is dropped right away
+  bool call();
+  // Binding time, including torch.compile
+  double compile_seconds() const { return m_compile_seconds; }
+
+private:
+  TorchCall() = default;
+
+  void *m_callable = nullptr; // PyObject *
+  int m_gil_state = 0;        // PyGILState_STATE
+  double m_compile_seconds = 0.0;
+};
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "command_manager.h"
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// What a run was measured with, one row of the trend store's runs table
+struct TrendRun {
+  std::string date;
+  std::string output_dir;
+  std::string model;
+  std::string torch_mlir_commit;
+  std::string torch_mlir_branch;
+  std::string llvm_commit;
+  std::string pipeline;
+  std::string pipeline_hash;
+  std::string host;             // Distributed::fingerprint_id
+  std::string host_fingerprint; // Distributed::fingerprint as JSON
+  std::string primary_metric;
+};
+
+struct TrendQuery {
+  std::string metric;        // Empty: the latest run's primary metric
+  std::string model;         // Empty: the latest run's, "all": any
+  std::string host;          // Same
+  std::string pipeline_hash; // Same
+  std::string op_type;       // Empty: every op type
+  size_t top_kernels = 10;   // Kernel steps listed
+};
+
+/*
+ * Performance trend store (--trend-db, default <output-dir>/../trends.sqlite)
+ *
+ * Output folders are one timestamped directory per run, so comparing the
+ * toolchain over time means remembering which folder came from which build.
+ * Every finished run appends itself to one persistent SQLite file instead:
+ *    runs(run, date, output_dir, model, torch_mlir_commit, torch_mlir_branch,
+ *         llvm_commit, pipeline, pipeline_hash, host, host_fingerprint,
+ *         primary_metric)
+ *    kernels(run, op_type, kernel, hash, multiplicity, metric, samples,
+ *            mean, median, ci95_low, ci95_high)
+ * The commits are read from the torch-mlir source tree behind --build-path
+ * (its CMakeCache.txt), LLVM's from externals/llvm-project or the build's
+ * VCSRevision.h. A dirty tree gets a "-dirty" suffix.
+ *
+ * The trend subcommand lines the runs of one model, host and pipeline hash
+ * up by commit (the latest run per commit pair, oldest first):
+ *    trend_op_types.csv  commit, llvm_commit, date, op_type, total
+ *    trend_kernels.csv   commit, llvm_commit, date, op_type, kernel, hash,
+ *                        multiplicity, median
+ * with the op type and model totals weighted by multiplicity, and prints the
+ * largest per kernel steps between consecutive commits: the commit range to
+ * bisect.
+ */
+class TrendStore {
+public:
+  // Commits of the torch-mlir build, "unknown" where they can't be read
+  static void read_toolchain(const fs::path &build_path, TrendRun &run);
+
+  static bool record(const fs::path &db_filepath, const TrendRun &run,
+                     const std::vector<KernelTask> &tasks,
+                     const std::vector<std::string> &metrics);
+
+  // The report, CSVs to output_dir. False without runs to compare.
+  static bool report(const fs::path &db_filepath, const TrendQuery &query,
+                     const fs::path &output_dir);
+};
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+/*
+ * Time stamp counter clock (the "tsc-nanoseconds" sample metric)
+ *
+ * Reads the invariant TSC in user space, a few nanoseconds per read and no
+ * perf file descriptor, so timing-only sweeps also run where
+ * perf_event_paranoid forbids hardware counters. The start read is ordered
+ * after the preceding instructions (lfence; rdtsc) and the stop read after
+ * the kernel's (rdtscp; lfence), so neither drifts into the window.
+ *
+ * x86 calibrates the tick length once against the steady clock. AArch64
+ * reads the virtual counter (cntvct_el0) at its architected frequency
+ * (cntfrq_el0). Other targets fall back to the steady clock.
+ */
+class TscClock {
+public:
+  static constexpr const char *METRIC = "tsc-nanoseconds";
+
+  static bool is_metric(const std::string &metric) { return metric == METRIC; }
+
+  // False without an invariant TSC (the counter then follows the core clock
+  // and tsc-nanoseconds drifts with frequency changes)
+  static bool invariant();
+
+  // Nanoseconds per tick, calibrated on the first call
+  static double ns_per_tick();
+
+  static inline uint64_t start() {
+#if defined(__x86_64__) || defined(__i386__)
+    uint32_t low, high;
+    asm volatile("lfence\n\trdtsc" : "=a"(low), "=d"(high)::"memory");
+    return (static_cast<uint64_t>(high) << 32) | low;
+#elif defined(__aarch64__)
+    uint64_t ticks;
+    asm volatile("isb\n\tmrs %0, cntvct_el0" : "=r"(ticks)::"memory");
+    return ticks;
+#else
+    return steady_ticks();
+#endif
+  }
+
+  static inline uint64_t stop() {
+#if defined(__x86_64__) || defined(__i386__)
+    uint32_t low, high, aux;
+    asm volatile("rdtscp\n\tlfence"
+                 : "=a"(low), "=d"(high), "=c"(aux)::"memory");
+    return (static_cast<uint64_t>(high) << 32) | low;
+#elif defined(__aarch64__)
+    uint64_t ticks;
+    asm volatile("isb\n\tmrs %0, cntvct_el0\n\tisb" : "=r"(ticks)::"memory");
+    return ticks;
+#else
+    return steady_ticks();
+#endif
+  }
+
+private:
+  static inline uint64_t steady_ticks() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+};
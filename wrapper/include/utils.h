@@ -1,5 +1,6 @@
 #pragma once
 
+#include "element_type.h"
 #include "nlohmann/json.hpp"
 #include <cassert>
 #include <cstdint>
@@ -25,6 +26,15 @@ struct JSONArgument {
   std::string dtype;
   uint64_t rank;
   std::vector<uint64_t> shape;
+
+  // Optional explicit layout (in elements). Empty strides mean row major.
+  std::vector<int64_t> strides;
+  int64_t offset = 0;
+  std::string layout; // Layout attribute as written in the IR, if any
+  // Memory order of --data-order-sweep variant arguments (see data_order.h)
+  std::string data_order;
+  // Format of --sparse-args variant arguments (see sparse_encoding.h)
+  std::string sparse_format;
 };
 
 /*
@@ -60,17 +70,22 @@ struct MemRefDescriptor {
  * This wrapper encapsulates the descriptor, and provides methods for populating
  * it.
  *
- * Currently assuming data is always aligned.
- * That is,
- *    aligned_ptr = base_ptr, offset = 0
- *  (I have not yet encountered a scenario where this changes. TODO: Explore
- * cases where this may happen for our use case)
+ * Inputs honour explicit strides and offset from the metadata JSON (see
+ * memref_layout.h), the buffer then spans get_buffer_elem_count() elements.
+ * aligned_ptr = base_ptr for inputs. Returned descriptors are taken as is.
+ *
+ * No data buffer is allocated up front. Buffers passed to setData are only
+ * freed by the MemRefArg if it was asked to take ownership of them (inputs
+ * normally live in a TensorArena, results belong to the kernel).
  * */
 struct MemRefArg {
   int64_t m_tensor_rank;
   int64_t m_tensor_elem_count; // Total data elements stored in the tensor
+  int64_t m_buffer_elem_count; // Elements the buffer spans (padding included)
   int64_t m_desc_alignment;    // Alignment of the descriptor
   int64_t m_desc_size;         // Total descriptor size in bytes
+  bool m_owns_data = false;    // base_ptr was malloc'd and is ours to free
+  ElementType m_elem_type = ElementType::F32;
 
   MemRefDescriptor *m_desc;
 
@@ -78,21 +93,41 @@ struct MemRefArg {
   MemRefArg(const int &tensor_rank);
   MemRefArg(std::initializer_list<uint64_t> dimension_list);
   MemRefArg(const JSONArgument &argument_data);
+  ~MemRefArg();
+
+  MemRefArg(const MemRefArg &) = delete;
+  MemRefArg &operator=(const MemRefArg &) = delete;
 
   // Methods
   void printState();
 
   // NOTE: This is not doing a safety check on the data pointer passed in right
   // now. This could lead security issues. Fix this later
-  void setData(void *data, const uint64_t &offset = 0);
+  void setData(void *data, const uint64_t &offset = 0,
+               bool take_ownership = false);
   void *getData();
   void *getDataAligned();
 
   void updateWithFFITemplate(const ffi_type *ffi_return_type_template);
   bool extractDescFromFFIPtr(void *ffi_returned_ptr);
 
+  // Sanity checks a kernel returned descriptor against the expected shape:
+  // non null buffers, aligned_ptr inside the allocation, non negative offset
+  // and strides
+  bool validate_descriptor(const std::vector<uint64_t> &expected_shape,
+                           std::string &error);
+
   int get_tensor_elem_count();
+  int64_t get_buffer_elem_count();
+  size_t get_elem_size();
   int64_t get_tensor_rank();
+
+  // Position of the i-th element (row major order) relative to aligned_ptr,
+  // honouring offset and strides
+  int64_t get_element_position(int64_t linear_index);
+
+  // Row major copy of the tensor's elements, whatever its layout
+  std::vector<uint8_t> dense_copy();
 };
 
 /*
@@ -105,3 +140,47 @@ json load_json_from_file(const fs::path &filePath);
 
 // Time stamp generator
 std::string get_timestamp_string();
+
+// Seconds of "600", "90s", "10m" or "1.5h", negative if unreadable
+double parse_duration(const std::string &text);
+
+/*
+ * Content hashing (64-bit FNV-1a)
+ *
+ * Used to build content addressed keys for cached artifacts. The seed allows
+ * chaining multiple inputs into one key:
+ *    hash_string(b, hash_string(a))
+ */
+uint64_t hash_string(const std::string &data,
+                     uint64_t seed = 0xcbf29ce484222325ULL);
+uint64_t hash_file_contents(const fs::path &filepath,
+                            uint64_t seed = 0xcbf29ce484222325ULL);
+std::string hash_to_hex(uint64_t hash);
+
+/*
+ * CPU affinity helpers (no-ops returning false on non-Linux platforms)
+ */
+int get_online_cpu_count();
+// Ids of the online CPUs in ascending order, which need not be contiguous
+std::vector<int> get_online_cpus();
+bool pin_current_thread(int cpu);
+// Allows the calling thread to run on every online CPU except `cpu`
+bool pin_current_thread_excluding(int cpu);
+// Allows the calling thread to run on `count` consecutive online CPUs
+// starting at `first_cpu` (or the next online one), wrapping around
+bool pin_current_thread_range(int first_cpu, int count);
+// Allows the calling thread to run on any of `cpus`
+bool pin_current_thread_to(const std::vector<int> &cpus);
+
+/*
+ * sysfs helpers
+ */
+// First line of a file, empty if it can't be read
+std::string read_line(const fs::path &filepath);
+// Physical package of a CPU, 0 if unknown
+int package_of(int cpu);
+// CPUs of a sysfs CPU list, "0,28" or "0-3,8-11"
+std::vector<int> parse_cpu_list(const std::string &list);
+
+// Resident set size of the process in bytes (0 on non-Linux platforms)
+uint64_t current_rss_bytes();
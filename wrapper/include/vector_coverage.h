@@ -0,0 +1,52 @@
+#pragma once
+
+#include "nlohmann/json.hpp"
+
+#include <filesystem>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+using json = nlohmann::json;
+
+/*
+ * Vectorization coverage of a compiled kernel (--vectorization-report)
+ *
+ * Two static views of what the pipeline produced, written next to the .ll
+ * as <kernel>.vectorization.json:
+ *    ir        floating point ops of the LLVM IR (fadd, fsub, fmul, fdiv,
+ *              frem, fneg and llvm.* FP intrinsic calls such as fma and
+ *              fmuladd) on vector or scalar types, vector loads and stores,
+ *              and the widest vector type in bits
+ *    object    the same split of the shared object's FP instructions in
+ *              objdump -d: packed vs scalar SSE/AVX/AVX-512 (x86-64) or
+ *              NEON/SVE vs scalar (AArch64), and the widest register used
+ *    hot_loop  the instruction mix of the innermost loop with the most FP
+ *              instructions, a backward branch and its target: vector and
+ *              scalar FP, vector and scalar memory accesses, branches and
+ *              the rest
+ * Without a per kernel object (ORC JIT, batched linking) only the IR is
+ * analysed. The JSON's numbers also become columns of every sample:
+ *    vec_ir_vector_fp, vec_ir_scalar_fp, vec_ir_max_bits,
+ *    vec_obj_vector_fp, vec_obj_scalar_fp, vec_obj_max_bits,
+ *    vec_fraction (vector share of the object's FP instructions, of the
+ *    IR's without an object), vec_loop_vector_fp, vec_loop_scalar_fp,
+ *    vec_loop_instructions
+ */
+class VectorCoverage {
+public:
+  static fs::path filepath(const fs::path &ll_filepath);
+
+  static json analyse_ir(const std::string &ll_text);
+  // objdump -d --no-show-raw-insn output
+  static json analyse_object(const std::string &disassembly);
+
+  // Writes the JSON of the .ll and, if given, the object's disassembly
+  static bool write(const fs::path &ll_filepath,
+                    const std::string &disassembly);
+
+  // Sample columns from an existing JSON, empty without one
+  static std::map<std::string, double> columns(const fs::path &ll_filepath);
+  static std::vector<std::string> column_names();
+};
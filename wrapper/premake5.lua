@@ -1,3 +1,9 @@
+newoption {
+   trigger = "with-mlir",
+   value = "path",
+   description = "Link the in-process lowering engine and ORC JIT against the Torch-MLIR build at <path> (e.g. ../torch-mlir/build)"
+}
+
 workspace "MLIR_Benchmark"
   configurations { "Debug", "Release" }
 
@@ -15,7 +21,12 @@ end
 python_include_path = os.getenv('CONDA_PREFIX') .. "/include/python3.11"
 python_lib_path = os.getenv('CONDA_PREFIX') .. "/lib"
 numpy_include_path = python_lib_path .. "/python3.11/site-packages/numpy/_core/include"
-libffi_lib_path = "/usr/lib/x86_64-linux-gnu"
+-- Debian multiarch directory of the host (x86_64-linux-gnu, aarch64-linux-gnu)
+multiarch = capture_cmd("gcc -print-multiarch 2>/dev/null"):gsub("%s+", "")
+if multiarch == "" then
+    multiarch = capture_cmd("uname -m"):gsub("%s+", "") .. "-linux-gnu"
+end
+libffi_lib_path = "/usr/lib/" .. multiarch
 
 
 -- For MacOS, meaningless now (Since perf is not supported)
@@ -61,18 +72,71 @@ project "ext_build"
     rebuildcommands { "echo Rebuilding external lib: "  }
     cleancommands { "rm -rf build/ext" }
 
+-- In-process lowering engine and ORC JIT (see include/mlir_engine.h, include/jit_engine.h)
+function use_mlir()
+   if not _OPTIONS["with-mlir"] then
+      return
+   end
+   local mlir_build = path.getabsolute(_OPTIONS["with-mlir"])
+   local torch_src = path.getdirectory(mlir_build)
+   local llvm_src = torch_src .. "/externals/llvm-project"
+
+   defines { "MLIR_BENCH_INPROCESS", "MLIR_BENCH_ORC_JIT" }
+   includedirs {
+      llvm_src .. "/llvm/include", llvm_src .. "/mlir/include", torch_src .. "/include",
+      mlir_build .. "/include", mlir_build .. "/tools/mlir/include", mlir_build .. "/tools/torch-mlir/include"
+   }
+   libdirs { mlir_build .. "/lib" }
+
+   -- Static MLIR/Torch-MLIR archives have circular dependencies, so they
+   -- are linked as one group instead of listing them in dependency order
+   local mlir_archives = os.matchfiles(mlir_build .. "/lib/libTorchMLIR*.a")
+   for _, lib in ipairs(os.matchfiles(mlir_build .. "/lib/libMLIR*.a")) do table.insert(mlir_archives, lib) end
+   for _, lib in ipairs(os.matchfiles(mlir_build .. "/lib/libLLVM*.a")) do table.insert(mlir_archives, lib) end
+   linkoptions { "-Wl,--start-group " .. table.concat(mlir_archives, " ") .. " -Wl,--end-group", "-lz", "-lzstd", "-lpthread" }
+end
+
+function use_configurations()
+   filter "configurations:Debug"
+      buildoptions { "--std=c++20", "-g" } 
+      defines { "DEBUG" }
+      symbols "On"
+
+   filter "configurations:Release"
+      buildoptions { "--std=c++20" } 
+      defines { "NDEBUG" }
+      optimize "On"
+
+   filter {}
+end
+
+-- Everything but main(), embeddable through BenchmarkSession (include/benchmark_session.h)
+project "MLIRBench"
+   kind "StaticLib"
+   language "C++"
+   targetdir "lib"
+   dependson {"ext_build"}
+
+   includedirs { "./include/", numpy_include_path, python_include_path }
+
+   files { "include/**.h", "src/**.cpp" }
+   removefiles { "src/wrapper.cpp" }
+
+   use_mlir()
+   use_configurations()
+
 project "WrapperModule"
    kind "ConsoleApp"
    language "C++"
    targetdir "build/%{cfg.buildcfg}"
-   dependson {"ext_build"}
+   dependson {"ext_build", "MLIRBench"}
 
 
    
    includedirs { "./include/", numpy_include_path, python_include_path }
    libdirs { "./lib", python_lib_path , libffi_lib_path }
 
-   links { "dl", "ffi", "python3.11" }
+   links { "MLIRBench", "dl", "ffi", "python3.11", "sqlite3" }
 
 
     -- This was for MacOS, but since perf is not supported here, this is meaningless 
@@ -80,14 +144,43 @@ project "WrapperModule"
    linkoptions { "-Wl,-rpath," .. python_lib_path, "-lperf-cpp" }
 
 
-   files { "include/**.h", "src/**.cpp" }
+   files { "src/wrapper.cpp" }
 
-   filter "configurations:Debug"
-      buildoptions { "--std=c++20", "-g" } 
-      defines { "DEBUG" }
-      symbols "On"
+   use_mlir()
+   use_configurations()
 
-   filter "configurations:Release"
-      buildoptions { "--std=c++20" } 
-      defines { "NDEBUG" }
-      optimize "On"
+-- Microbenchmarks of the harness' own hot paths (bench/harness_bench.cpp)
+project "HarnessBench"
+   kind "ConsoleApp"
+   language "C++"
+   targetdir "build/%{cfg.buildcfg}"
+   dependson {"ext_build", "MLIRBench"}
+
+   includedirs { "./include/", numpy_include_path, python_include_path }
+   libdirs { "./lib", python_lib_path , libffi_lib_path }
+
+   links { "MLIRBench", "dl", "ffi", "python3.11", "sqlite3" }
+   linkoptions { "-Wl,-rpath," .. python_lib_path, "-lperf-cpp" }
+
+   files { "bench/**.cpp" }
+
+   use_mlir()
+   use_configurations()
+
+-- Behaviour tests of the harness' logic (tests/harness_tests.cpp)
+project "HarnessTests"
+   kind "ConsoleApp"
+   language "C++"
+   targetdir "build/%{cfg.buildcfg}"
+   dependson {"ext_build", "MLIRBench"}
+
+   includedirs { "./include/", "./tests/", numpy_include_path, python_include_path }
+   libdirs { "./lib", python_lib_path , libffi_lib_path }
+
+   links { "MLIRBench", "dl", "ffi", "python3.11", "sqlite3" }
+   linkoptions { "-Wl,-rpath," .. python_lib_path, "-lperf-cpp" }
+
+   files { "tests/**.h", "tests/**.cpp" }
+
+   use_mlir()
+   use_configurations()
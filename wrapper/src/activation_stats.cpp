@@ -0,0 +1,172 @@
+#include "activation_stats.h"
+#include "model_layers.h"
+#include "utils.h"
+
+#include <Python.h>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+
+#include "nlohmann/json.hpp"
+
+static std::vector<uint64_t> argument_shape(const json &argument) {
+  return argument.value("shape", std::vector<uint64_t>());
+}
+
+// Op and argument shapes, "" if an argument was not recorded
+static std::string call_key(const std::string &op, const json &args) {
+  std::string key = op;
+  for (const json &arg : args) {
+    if (arg.is_null())
+      return "";
+    key += "|";
+    for (uint64_t dim : argument_shape(arg))
+      key += std::to_string(dim) + "x";
+  }
+  return key;
+}
+
+bool ActivationStats::record(const fs::path &script, const std::string &model,
+                             const std::string &input_shape,
+                             const fs::path &stats_filepath) {
+  if (!fs::exists(script)) {
+    std::cerr << "Activation stats script " << script << " not found\n";
+    return false;
+  }
+  fs::remove(stats_filepath);
+
+  // JSON strings and arrays are valid Python literals. argparse errors raise
+  // SystemExit, which must not end the harness.
+  json argv = {script.generic_string(), "--model",     model,
+               "--input-shape",         input_shape, "--output",
+               stats_filepath.generic_string()};
+  std::string code =
+      "import runpy, sys\n"
+      "sys.argv = " +
+      argv.dump() +
+      "\n"
+      "try:\n"
+      "    runpy.run_path(sys.argv[0], run_name='__main__')\n"
+      "except SystemExit as e:\n"
+      "    if e.code not in (0, None):\n"
+      "        raise RuntimeError('activation stats exited with %s'\n"
+      "                           % e.code)\n";
+
+  std::cout << "Recording activation statistics of " << model << "\n";
+  if (!Py_IsInitialized())
+    Py_Initialize();
+  // The interpreter stays up, torch's thread pools don't survive finalising
+  int status = PyRun_SimpleString(code.c_str());
+  if (status != 0 || !fs::exists(stats_filepath)) {
+    std::cerr << "Recording activation statistics failed\n";
+    return false;
+  }
+  return true;
+}
+
+size_t ActivationStats::attach(const fs::path &stats_filepath,
+                               const std::vector<KernelTask> &tasks) {
+  std::ifstream stats_file(stats_filepath);
+  json stats = json::parse(stats_file, nullptr, false);
+  if (stats.is_discarded() || !stats.contains("records")) {
+    std::cerr << "Unreadable activation stats " << stats_filepath << "\n";
+    return 0;
+  }
+  const json &records = stats["records"];
+
+  // Records of each op and argument shapes, in call order
+  std::map<std::string, std::vector<const json *>> calls;
+  for (const json &record : records)
+    if (std::string key = call_key(record.value("op", ""), record["args"]);
+        !key.empty())
+      calls[key].push_back(&record);
+
+  // Kernels of each op and argument shapes in model order, duplicates
+  // included: the n-th of them ran the n-th call. Kernels without a model
+  // layer follow in isolation order.
+  struct Occurrence {
+    size_t position;
+    const KernelTask *task; // nullptr for duplicates
+  };
+  std::map<std::string, std::vector<Occurrence>> occurrences;
+  // Past any layer index
+  size_t unplaced = size_t(1) << 32;
+  for (const KernelTask &task : tasks) {
+    if (!task.metadata_ready)
+      continue;
+    json metadata = load_json_from_file(task.json_filepath);
+    std::string key = call_key(task.op_type, metadata["kernel_call"]["args"]);
+    auto position = [&unplaced](const fs::path &kernel) {
+      const ModelLayer *layer = ModelLayers::find(kernel);
+      return layer ? layer->index : unplaced++;
+    };
+    occurrences[key].push_back({position(task.mlir_filepath), &task});
+    for (const fs::path &duplicate : task.duplicate_filepaths)
+      occurrences[key].push_back({position(duplicate), nullptr});
+  }
+
+  size_t matched = 0, unmatched = 0;
+  for (auto &[key, kernels] : occurrences) {
+    std::stable_sort(kernels.begin(), kernels.end(),
+                     [](const Occurrence &a, const Occurrence &b) {
+                       return a.position < b.position;
+                     });
+    auto call = calls.find(key);
+    for (size_t n = 0; n < kernels.size(); n++) {
+      if (!kernels[n].task)
+        continue;
+      fs::path stats_filepath = ActivationStats::kernel_stats_filepath(
+          kernels[n].task->json_filepath);
+      // Another op's or another layer's statistics would be wrong inputs
+      if (call == calls.end() || n >= call->second.size()) {
+        fs::remove(stats_filepath);
+        unmatched++;
+        continue;
+      }
+      std::ofstream(stats_filepath) << call->second[n]->dump(2);
+      matched++;
+    }
+  }
+  if (unmatched)
+    std::cerr << "Warning: " << unmatched
+              << " kernels have no recorded call of their op and argument "
+                 "shapes, their inputs fall back to random-norm\n";
+  return matched;
+}
+
+fs::path ActivationStats::kernel_stats_filepath(const fs::path &json_filepath) {
+  return fs::path(json_filepath).replace_extension(".stats.json");
+}
+
+std::vector<std::shared_ptr<const TensorStats>>
+ActivationStats::load(const fs::path &json_filepath) {
+  std::vector<std::shared_ptr<const TensorStats>> arguments;
+  fs::path stats_filepath =
+      ActivationStats::kernel_stats_filepath(json_filepath);
+  if (!fs::exists(stats_filepath))
+    return arguments;
+
+  std::ifstream stats_file(stats_filepath);
+  json record = json::parse(stats_file, nullptr, false);
+  if (record.is_discarded() || !record.contains("args"))
+    return arguments;
+  for (const json &arg : record["args"]) {
+    if (arg.is_null()) {
+      arguments.push_back(nullptr);
+      continue;
+    }
+    auto stats = std::make_shared<TensorStats>();
+    stats->zero_fraction = arg.value("zero_fraction", 0.0);
+    stats->mean = arg.value("mean", 0.0);
+    stats->stddev = arg.value("std", 0.0);
+    stats->min = arg.value("min", 0.0);
+    stats->max = arg.value("max", 0.0);
+    stats->histogram_min = arg.value("histogram_min", stats->min);
+    stats->histogram_max = arg.value("histogram_max", stats->max);
+    stats->histogram = arg.value("histogram", std::vector<double>());
+    arguments.push_back(stats);
+  }
+  return arguments;
+}
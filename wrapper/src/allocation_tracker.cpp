@@ -0,0 +1,208 @@
+#include "allocation_tracker.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <malloc.h>
+#include <sstream>
+#include <vector>
+
+const char *AllocationTracker::HOOK_TABLE_SYMBOL = "mlir_bench_alloc_hooks";
+
+std::atomic<uint64_t> AllocationTracker::allocations{0};
+std::atomic<uint64_t> AllocationTracker::frees{0};
+std::atomic<uint64_t> AllocationTracker::bytes_allocated{0};
+std::atomic<int64_t> AllocationTracker::live_bytes{0};
+std::atomic<int64_t> AllocationTracker::window_base_live_bytes{0};
+std::atomic<int64_t> AllocationTracker::peak_live_bytes{0};
+
+namespace {
+struct HookedFunction {
+  const char *symbol;
+  const char *forwarder;
+  const char *return_type;
+  std::vector<std::string> parameter_types;
+  int slot; // Index into the hook table
+};
+
+const std::vector<HookedFunction> HOOKED_FUNCTIONS = {
+    {"malloc", "mlir_bench_malloc", "ptr", {"i64"}, 0},
+    {"aligned_alloc", "mlir_bench_aligned_alloc", "ptr", {"i64", "i64"}, 1},
+    {"free", "mlir_bench_free", "void", {"ptr"}, 2},
+};
+
+bool is_symbol_char(char c) {
+  return std::isalnum((unsigned char)c) || c == '_' || c == '.' || c == '$';
+}
+
+// Renames every whole "@from" reference, returns how many there were
+size_t rename_symbol(std::string &ir, const std::string &from,
+                     const std::string &to) {
+  size_t count = 0;
+  for (size_t pos = ir.find(from); pos != std::string::npos;
+       pos = ir.find(from, pos)) {
+    size_t end = pos + from.size();
+    if (end < ir.size() && is_symbol_char(ir[end])) {
+      pos = end;
+      continue;
+    }
+    ir.replace(pos, from.size(), to);
+    pos += to.size();
+    count++;
+  }
+  return count;
+}
+
+/*
+ * Forwarder for one hooked function plus the libc declaration it falls back
+ * to. linkonce_odr lets batched objects carry the same definitions once per
+ * kernel.
+ */
+std::string forwarder_ir(const HookedFunction &hooked) {
+  std::string parameters, declaration_types;
+  for (size_t i = 0; i < hooked.parameter_types.size(); i++) {
+    const std::string &type = hooked.parameter_types[i];
+    std::string separator = i ? ", " : "";
+    parameters += separator + type + " %a" + std::to_string(i);
+    declaration_types += separator + type;
+  }
+
+  std::string return_type = hooked.return_type;
+  bool returns_void = return_type == "void";
+  auto call = [&](const std::string &callee, const std::string &result) {
+    if (returns_void)
+      return "  call void " + callee + "(" + parameters + ")\n  ret void\n";
+    return "  %" + result + " = call " + return_type + " " + callee + "(" +
+           parameters + ")\n  ret " + return_type + " %" + result + "\n";
+  };
+
+  std::ostringstream ir;
+  ir << "\ndefine linkonce_odr " << return_type << " @" << hooked.forwarder
+     << "(" << parameters << ") {\n"
+     << "  %slot = getelementptr [3 x ptr], ptr @"
+     << AllocationTracker::HOOK_TABLE_SYMBOL << ", i64 0, i64 " << hooked.slot
+     << "\n"
+     << "  %hook = load ptr, ptr %slot\n"
+     << "  %unhooked = icmp eq ptr %hook, null\n"
+     << "  br i1 %unhooked, label %direct, label %hooked\n"
+     << "direct:\n"
+     << call(std::string("@") + hooked.symbol, "direct_result")
+     << "hooked:\n"
+     << call("%hook", "hooked_result") << "}\n"
+     << "declare " << return_type << " @" << hooked.symbol << "("
+     << declaration_types << ")\n";
+  return ir.str();
+}
+} // namespace
+
+bool AllocationTracker::instrument_ll(const fs::path &ll_filepath) {
+  std::ifstream ll_stream(ll_filepath);
+  std::ostringstream contents;
+  contents << ll_stream.rdbuf();
+  ll_stream.close();
+
+  std::string ir = contents.str();
+  // Restored lowerings may already be instrumented
+  if (ir.find(std::string("@") + HOOK_TABLE_SYMBOL) != std::string::npos)
+    return true;
+
+  // Original declarations are replaced by the ones of the forwarders
+  std::istringstream lines(ir);
+  std::ostringstream kept;
+  std::string line;
+  while (std::getline(lines, line)) {
+    bool hooked_declaration = false;
+    if (line.rfind("declare ", 0) == 0)
+      for (const HookedFunction &hooked : HOOKED_FUNCTIONS)
+        if (line.find(std::string("@") + hooked.symbol + "(") !=
+            std::string::npos)
+          hooked_declaration = true;
+    if (!hooked_declaration)
+      kept << line << "\n";
+  }
+  ir = kept.str();
+
+  size_t redirected = 0;
+  for (const HookedFunction &hooked : HOOKED_FUNCTIONS)
+    redirected += rename_symbol(ir, std::string("@") + hooked.symbol,
+                                std::string("@") + hooked.forwarder);
+  if (redirected == 0)
+    return false;
+
+  std::ostringstream hooks;
+  hooks << "\n@" << HOOK_TABLE_SYMBOL
+        << " = linkonce_odr global [3 x ptr] zeroinitializer\n";
+  for (const HookedFunction &hooked : HOOKED_FUNCTIONS)
+    hooks << forwarder_ir(hooked);
+
+  std::ofstream out(ll_filepath, std::ios::trunc);
+  out << ir << hooks.str();
+  return out.good();
+}
+
+void AllocationTracker::install(void *hook_table) {
+  if (!hook_table)
+    return;
+  void **slots = static_cast<void **>(hook_table);
+  slots[0] = reinterpret_cast<void *>(&AllocationTracker::tracked_malloc);
+  slots[1] =
+      reinterpret_cast<void *>(&AllocationTracker::tracked_aligned_alloc);
+  slots[2] = reinterpret_cast<void *>(&AllocationTracker::tracked_free);
+}
+
+void AllocationTracker::begin_window() {
+  AllocationTracker::allocations = 0;
+  AllocationTracker::frees = 0;
+  AllocationTracker::bytes_allocated = 0;
+  int64_t live = AllocationTracker::live_bytes;
+  AllocationTracker::window_base_live_bytes = live;
+  AllocationTracker::peak_live_bytes = live;
+}
+
+AllocationStats AllocationTracker::window_stats() {
+  AllocationStats stats;
+  stats.allocations = AllocationTracker::allocations;
+  stats.frees = AllocationTracker::frees;
+  stats.bytes_allocated = AllocationTracker::bytes_allocated;
+  int64_t peak = AllocationTracker::peak_live_bytes -
+                 AllocationTracker::window_base_live_bytes;
+  stats.peak_live_bytes = peak > 0 ? peak : 0;
+  return stats;
+}
+
+void AllocationTracker::release(void *ptr) {
+  AllocationTracker::tracked_free(ptr);
+}
+
+void AllocationTracker::record_allocation(void *ptr, size_t size) {
+  if (!ptr)
+    return;
+  AllocationTracker::allocations++;
+  AllocationTracker::bytes_allocated += size;
+
+  // Usable size, so that frees (which only know the pointer) balance out
+  int64_t live = AllocationTracker::live_bytes += malloc_usable_size(ptr);
+  int64_t peak = AllocationTracker::peak_live_bytes;
+  while (live > peak &&
+         !AllocationTracker::peak_live_bytes.compare_exchange_weak(peak, live))
+    ;
+}
+
+void *AllocationTracker::tracked_malloc(size_t size) {
+  void *ptr = std::malloc(size);
+  AllocationTracker::record_allocation(ptr, size);
+  return ptr;
+}
+
+void *AllocationTracker::tracked_aligned_alloc(size_t alignment, size_t size) {
+  void *ptr = std::aligned_alloc(alignment, size);
+  AllocationTracker::record_allocation(ptr, size);
+  return ptr;
+}
+
+void AllocationTracker::tracked_free(void *ptr) {
+  if (!ptr)
+    return;
+  AllocationTracker::frees++;
+  AllocationTracker::live_bytes -= malloc_usable_size(ptr);
+  std::free(ptr);
+}
@@ -0,0 +1,263 @@
+#include "autotuner.h"
+#include "pass_prefix_cache.h"
+#include "thread_pool.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <numeric>
+#include <set>
+
+static const size_t TPE_DRAWS = 24;
+static const double TPE_GOOD_SHARE = 0.25;
+
+Autotuner::Autotuner(CommandManager &manager, const AutotuneConfig &config)
+    : m_manager(manager), m_config(config), m_rng(config.seed) {}
+
+bool Autotuner::load_template() {
+  if (!m_template.load(m_config.template_json, m_rng))
+    return false;
+  std::cout << "Autotuning " << m_template.dimensions().size()
+            << " dimensions, " << m_template.size()
+            << " candidate pipelines\n";
+  return true;
+}
+
+std::vector<size_t> Autotuner::random_choice() {
+  std::vector<size_t> choice;
+  for (const auto &dimension : m_template.dimensions())
+    choice.push_back(std::uniform_int_distribution<size_t>(
+        0, dimension.values.size() - 1)(m_rng));
+  return choice;
+}
+
+std::vector<size_t> Autotuner::suggest(const std::vector<Trial> &trials) {
+  size_t startup = std::max<size_t>(5, m_template.dimensions().size() + 1);
+  if (m_config.search == TuneSearch::RANDOM || trials.size() < startup)
+    return random_choice();
+
+  // Early stopped candidates only have a lower bound, they count as bad
+  std::vector<const Trial *> ranked;
+  for (const Trial &trial : trials)
+    ranked.push_back(&trial);
+  std::sort(ranked.begin(), ranked.end(), [](const Trial *a, const Trial *b) {
+    if (a->complete != b->complete)
+      return a->complete;
+    return a->cost < b->cost;
+  });
+  size_t good_count = std::max<size_t>(
+      1, static_cast<size_t>(TPE_GOOD_SHARE * ranked.size()));
+
+  // Per dimension value densities of the good and bad trials, add-one smoothed
+  std::vector<std::vector<double>> good(m_template.dimensions().size()),
+      bad(m_template.dimensions().size());
+  for (size_t d = 0; d < m_template.dimensions().size(); d++) {
+    good[d].assign(m_template.dimensions()[d].values.size(), 1.0);
+    bad[d].assign(m_template.dimensions()[d].values.size(), 1.0);
+  }
+  for (size_t r = 0; r < ranked.size(); r++)
+    for (size_t d = 0; d < m_template.dimensions().size(); d++)
+      (r < good_count ? good : bad)[d][ranked[r]->choice[d]] += 1.0;
+
+  std::vector<size_t> best_choice = random_choice();
+  double best_score = -std::numeric_limits<double>::infinity();
+  for (size_t draw = 0; draw < TPE_DRAWS; draw++) {
+    std::vector<size_t> choice;
+    double score = 0.0;
+    for (size_t d = 0; d < m_template.dimensions().size(); d++) {
+      std::discrete_distribution<size_t> from_good(good[d].begin(),
+                                                   good[d].end());
+      size_t value = from_good(m_rng);
+      double good_total = std::accumulate(good[d].begin(), good[d].end(), 0.0);
+      double bad_total = std::accumulate(bad[d].begin(), bad[d].end(), 0.0);
+      score += std::log(good[d][value] / good_total) -
+               std::log(bad[d][value] / bad_total);
+      choice.push_back(value);
+    }
+    if (score > best_score) {
+      best_score = score;
+      best_choice = choice;
+    }
+  }
+  return best_choice;
+}
+
+bool Autotuner::compile(std::vector<KernelTask *> &scope,
+                        const fs::path &pipeline_json,
+                        std::vector<fs::path> &ll_filepaths) {
+  PipelineSpec pipeline = m_manager.resolve_pipeline(pipeline_json);
+  m_manager.use_pipeline(pipeline);
+  PassPrefixCache::add_pipeline(m_manager.extract_pass_list());
+  {
+    ThreadPool compile_pool(m_config.jobs, m_config.measure_cpu);
+    for (KernelTask *task : scope)
+      compile_pool.submit([this, task, &pipeline]() {
+        m_manager.prepare_pipeline_variant(*task, pipeline);
+      });
+    compile_pool.wait();
+  }
+
+  ll_filepaths.clear();
+  bool any = false;
+  for (KernelTask *task : scope) {
+    auto ll = task->pipeline_ll_filepaths.find(pipeline.label);
+    ll_filepaths.push_back(ll == task->pipeline_ll_filepaths.end()
+                               ? fs::path()
+                               : ll->second);
+    any |= !ll_filepaths.back().empty();
+    if (ll != task->pipeline_ll_filepaths.end())
+      task->pipeline_ll_filepaths.erase(ll);
+    task->pipeline_compile_profiles.erase(pipeline.label);
+  }
+  return any;
+}
+
+bool Autotuner::evaluate(std::vector<KernelTask *> &scope,
+                         const std::vector<fs::path> &ll_filepaths,
+                         const MeasureFn &measure, double bound,
+                         double &cost, bool &complete) {
+  cost = 0.0;
+  complete = false;
+  // Probe every kernel first, so a slow kernel late in the scope still stops
+  // the candidate before the full measurements
+  std::vector<double> probes(scope.size(), 0.0);
+  for (size_t k = 0; k < scope.size(); k++) {
+    if (ll_filepaths[k].empty() ||
+        !measure(*scope[k], ll_filepaths[k], m_config.probe_samples,
+                 probes[k]))
+      return false;
+    cost += scope[k]->multiplicity * probes[k];
+    if (cost > bound)
+      return true;
+  }
+
+  cost = 0.0;
+  for (size_t k = 0; k < scope.size(); k++) {
+    double value = 0.0;
+    if (!measure(*scope[k], ll_filepaths[k], m_config.samples, value))
+      return false;
+    cost += scope[k]->multiplicity * value;
+  }
+  complete = true;
+  return true;
+}
+
+bool Autotuner::run(std::vector<KernelTask> &tasks, const MeasureFn &measure,
+                    const fs::path &output_dir) {
+  fs::path tune_dir = fs::path(output_dir).append("autotune");
+  fs::path candidate_dir = fs::path(tune_dir).append("candidates");
+  fs::create_directories(candidate_dir);
+
+  // Scopes in first occurrence order
+  std::vector<std::pair<std::string, std::vector<KernelTask *>>> scopes;
+  for (KernelTask &task : tasks) {
+    if (!task.metadata_ready || !task.shape_variant.empty())
+      continue;
+    std::string name =
+        m_config.scope == TuneScope::OP_TYPE
+            ? task.op_type
+            : task.op_type + "/" + task.mlir_filepath.stem().string();
+    auto scope = std::find_if(scopes.begin(), scopes.end(),
+                              [&](const auto &s) { return s.first == name; });
+    if (scope == scopes.end())
+      scopes.push_back({name, {&task}});
+    else
+      scope->second.push_back(&task);
+  }
+
+  std::ofstream trials_csv(fs::path(tune_dir).append("trials.csv"));
+  std::ofstream summary_csv(fs::path(tune_dir).append("summary.csv"));
+  if (!trials_csv.is_open() || !summary_csv.is_open()) {
+    std::cerr << "Error: Could not write to " << tune_dir << "\n";
+    return false;
+  }
+  trials_csv << "scope,trial,pipeline,parameters,status,cost,speedup\n";
+  summary_csv << "scope,kernels,trials,baseline_cost,best_cost,speedup,"
+                 "best_parameters,best_pipeline\n";
+
+  const PipelineSpec primary = m_manager.get_primary_pipeline();
+  for (auto &[name, scope] : scopes) {
+    std::cout << "Autotuning " << name << " (" << scope.size()
+              << " kernels)\n";
+    std::vector<fs::path> ll_filepaths;
+    double baseline = 0.0;
+    bool baseline_complete = false;
+    if (!compile(scope, primary.pipeline_json, ll_filepaths) ||
+        !evaluate(scope, ll_filepaths, measure,
+                  std::numeric_limits<double>::infinity(), baseline,
+                  baseline_complete)) {
+      std::cerr << "Skipping " << name
+                << ": the primary pipeline could not measure it\n";
+      continue;
+    }
+    trials_csv << name << ",0," << primary.pipeline_json.generic_string()
+               << ",baseline,complete," << baseline << ",1\n";
+
+    double best = baseline;
+    std::string best_parameters = "baseline";
+    json best_pipeline = load_json_from_file(primary.pipeline_json);
+    std::vector<Trial> trials;
+    std::set<std::vector<size_t>> seen;
+    for (unsigned int t = 1; t <= m_config.trials; t++) {
+      std::vector<size_t> choice;
+      // The space may be smaller than the budget
+      for (size_t attempt = 0; attempt < 100; attempt++) {
+        choice = suggest(trials);
+        if (!seen.count(choice))
+          break;
+      }
+      if (!seen.insert(choice).second)
+        break;
+
+      json pipeline = m_template.render(choice);
+      std::string parameters = m_template.describe(choice);
+      fs::path pipeline_json = fs::path(candidate_dir).append(
+          "tune-" + hash_to_hex(hash_string(pipeline.dump())) + ".json");
+      std::ofstream(pipeline_json) << pipeline.dump(2) << "\n";
+
+      Trial trial{choice};
+      const char *status = "failed";
+      if (compile(scope, pipeline_json, ll_filepaths) &&
+          evaluate(scope, ll_filepaths, measure, best * m_config.early_stop,
+                   trial.cost, trial.complete))
+        status = trial.complete ? "complete" : "early_stopped";
+      else
+        trial.cost = std::numeric_limits<double>::infinity();
+      trials.push_back(trial);
+
+      trials_csv << name << "," << t << "," << pipeline_json.generic_string()
+                 << ",\"" << parameters << "\"," << status << ","
+                 << trial.cost << ","
+                 << (trial.complete && trial.cost > 0.0 ? baseline / trial.cost
+                                                        : 0.0)
+                 << "\n";
+      trials_csv.flush();
+      std::cout << "Trial " << t << " [" << parameters << "]: " << status
+                << ", cost " << trial.cost << "\n";
+      if (trial.complete && trial.cost < best) {
+        best = trial.cost;
+        best_parameters = parameters;
+        best_pipeline = pipeline;
+      }
+    }
+    m_manager.use_pipeline(primary);
+
+    fs::path best_json = fs::path(tune_dir).append(name + ".json");
+    fs::create_directories(best_json.parent_path());
+    std::ofstream(best_json) << best_pipeline.dump(2) << "\n";
+    summary_csv << name << "," << scope.size() << "," << trials.size() << ","
+                << baseline << "," << best << ","
+                << (best > 0.0 ? baseline / best : 0.0) << ",\""
+                << best_parameters << "\"," << best_json.generic_string()
+                << "\n";
+    summary_csv.flush();
+    std::cout << "Best pipeline for " << name << ": " << best_parameters
+              << ", speedup " << (best > 0.0 ? baseline / best : 0.0)
+              << " -> " << best_json << "\n";
+  }
+  return true;
+}
@@ -0,0 +1,88 @@
+#include "backend_opt.h"
+
+#include <algorithm>
+#include <iostream>
+
+BackendOptSpec BackendOpt::from_pipeline_json(const json &pipeline) {
+  BackendOptSpec spec;
+  if (!pipeline.contains("llvm_opt"))
+    return spec;
+
+  const json &llvm_opt = pipeline["llvm_opt"];
+  if (llvm_opt.contains("level")) {
+    spec.level = llvm_opt["level"].get<std::string>();
+    // Accept both "O2" and "2"
+    if (!spec.level.empty() && spec.level.front() != 'O')
+      spec.level = "O" + spec.level;
+  }
+  if (llvm_opt.contains("passes"))
+    spec.passes = llvm_opt["passes"].get<std::vector<std::string>>();
+  if (llvm_opt.contains("lto"))
+    spec.lto = llvm_opt["lto"].get<bool>();
+
+  static const std::vector<std::string> levels = {"O0", "O1", "O2",
+                                                  "O3", "Os", "Oz"};
+  if (std::find(levels.begin(), levels.end(), spec.level) == levels.end()) {
+    std::cerr << "Unknown llvm_opt level '" << spec.level
+              << "', using O0\n";
+    spec.level = "O0";
+  }
+  return spec;
+}
+
+bool BackendOpt::needs_opt(const BackendOptSpec &spec) {
+  return spec.level != "O0" || !spec.passes.empty();
+}
+
+std::string BackendOpt::opt_pipeline(const BackendOptSpec &spec) {
+  if (spec.passes.empty())
+    return "default<" + spec.level + ">";
+
+  std::string pipeline;
+  for (const std::string &pass : spec.passes)
+    pipeline += (pipeline.empty() ? "" : ",") + pass;
+  return pipeline;
+}
+
+std::string BackendOpt::opt_command(const BackendOptSpec &spec,
+                                    const fs::path &opt_exec,
+                                    const fs::path &input_ll,
+                                    const fs::path &output_ll) {
+  return opt_exec.generic_string() + " -S -passes=\"" +
+         BackendOpt::opt_pipeline(spec) + "\" " + input_ll.generic_string() +
+         " -o " + output_ll.generic_string();
+}
+
+std::string BackendOpt::compile_flags(const BackendOptSpec &spec) {
+  std::string flags = " -" + spec.level;
+  // The IR has already been through opt, only code generation is left
+  if (BackendOpt::needs_opt(spec))
+    flags += " -Xclang -disable-llvm-passes";
+  if (spec.lto)
+    flags += " -flto -fuse-ld=lld";
+  return flags;
+}
+
+int BackendOpt::codegen_level(const BackendOptSpec &spec) {
+  if (spec.level == "O0")
+    return 0;
+  if (spec.level == "O1")
+    return 1;
+  if (spec.level == "O3")
+    return 3;
+  return 2; // O2, Os, Oz
+}
+
+std::string BackendOpt::describe(const BackendOptSpec &spec) {
+  std::string description = spec.level;
+  // ';' separated so that the description stays a single CSV field
+  if (!spec.passes.empty()) {
+    description += "[";
+    for (size_t i = 0; i < spec.passes.size(); i++)
+      description += (i ? ";" : "") + spec.passes[i];
+    description += "]";
+  }
+  if (spec.lto)
+    description += "+lto";
+  return description;
+}
@@ -0,0 +1,281 @@
+#include "benchmark_server.h"
+#include "benchmark_session.h"
+#include "mlir_engine.h"
+#include "utils.h"
+
+#include <cctype>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
+// How often a running job's kernel manifest is checked for new kernels
+static const std::chrono::milliseconds MANIFEST_POLL(100);
+
+namespace {
+// Reply stream of one connection, written by the job and the manifest poller
+struct Connection {
+  int fd;
+  std::mutex mutex;
+
+  explicit Connection(int fd) : fd(fd) {}
+
+  bool send(const std::string &id, json reply) {
+    if (!id.empty())
+      reply["id"] = id;
+    std::string line = reply.dump() + "\n";
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t sent = 0; sent < line.size();) {
+      ssize_t n = ::send(fd, line.data() + sent, line.size() - sent,
+                         MSG_NOSIGNAL);
+      if (n <= 0)
+        return false;
+      sent += n;
+    }
+    return true;
+  }
+};
+} // namespace
+
+BenchmarkServer::BenchmarkServer(const ServerConfig &config)
+    : m_config(config) {
+  // Jobs run with other working directories in mind
+  m_config.workspace = fs::absolute(m_config.workspace);
+}
+
+bool BenchmarkServer::serve() {
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  std::string socket_path = m_config.socket_path.string();
+  if (socket_path.size() >= sizeof(address.sun_path)) {
+    std::cerr << "Socket path " << socket_path << " is too long\n";
+    return false;
+  }
+  std::strncpy(address.sun_path, socket_path.c_str(),
+               sizeof(address.sun_path) - 1);
+
+  m_listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  std::error_code error;
+  fs::remove(m_config.socket_path, error); // left over from a killed server
+  if (m_listen_fd < 0 ||
+      bind(m_listen_fd, reinterpret_cast<sockaddr *>(&address),
+           sizeof(address)) != 0 ||
+      listen(m_listen_fd, 16) != 0) {
+    std::cerr << "Could not listen on " << socket_path << ": "
+              << std::strerror(errno) << "\n";
+    if (m_listen_fd >= 0)
+      close(m_listen_fd);
+    return false;
+  }
+  fs::create_directories(m_config.workspace, error);
+
+  // Paid once here instead of by the first job
+  if (MLIREngine::available())
+    MLIREngine::initialise();
+  std::cout << "Serving benchmark jobs on " << socket_path << ", outputs in "
+            << m_config.workspace << std::endl;
+
+  std::vector<std::thread> connections;
+  while (m_running) {
+    int fd = accept(m_listen_fd, nullptr, nullptr);
+    if (fd < 0) {
+      if (errno == EINTR)
+        continue;
+      break; // closed by shutdown
+    }
+    connections.emplace_back(&BenchmarkServer::handle_connection, this, fd);
+  }
+  for (std::thread &connection : connections)
+    connection.join();
+  close(m_listen_fd);
+  fs::remove(m_config.socket_path, error);
+  std::cout << "Benchmark server stopped after " << m_job_count << " jobs\n";
+  return true;
+}
+
+void BenchmarkServer::stop() {
+  m_running = false;
+  // Wakes up accept() and the idle connections, running jobs finish first
+  shutdown(m_listen_fd, SHUT_RDWR);
+  std::lock_guard<std::mutex> lock(m_clients_mutex);
+  for (int client : m_clients)
+    shutdown(client, SHUT_RD);
+}
+
+void BenchmarkServer::handle_connection(int fd) {
+  {
+    std::lock_guard<std::mutex> lock(m_clients_mutex);
+    m_clients.insert(fd);
+  }
+  std::string buffer;
+  char chunk[4096];
+  while (m_running) {
+    ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+    if (n <= 0)
+      break;
+    buffer.append(chunk, n);
+    for (size_t end = buffer.find('\n'); end != std::string::npos;
+         end = buffer.find('\n')) {
+      std::string line = buffer.substr(0, end);
+      buffer.erase(0, end + 1);
+      if (line.find_first_not_of(" \t\r") == std::string::npos)
+        continue;
+      json job = json::parse(line, nullptr, false);
+      if (job.is_discarded() || !job.is_object()) {
+        Connection{fd}.send("", {{"event", "error"},
+                                 {"message", "jobs are one JSON object per "
+                                             "line"}});
+        continue;
+      }
+      if (job.value("command", "") == "shutdown") {
+        Connection{fd}.send("", {{"event", "shutdown"}});
+        stop();
+        break;
+      }
+      run_job(fd, job);
+    }
+  }
+  {
+    std::lock_guard<std::mutex> lock(m_clients_mutex);
+    m_clients.erase(fd);
+  }
+  close(fd);
+}
+
+/*
+ * Directory the client's relative paths are meant from: the job's "cwd",
+ * else the working directory of the connected process, else the server's
+ */
+static fs::path client_directory(int fd, const json &job) {
+  if (job.contains("cwd") && job["cwd"].is_string())
+    return fs::absolute(job["cwd"].get<std::string>());
+  ucred peer{};
+  socklen_t length = sizeof(peer);
+  std::error_code error;
+  if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &peer, &length) == 0 &&
+      peer.pid > 0) {
+    fs::path cwd = fs::read_symlink(
+        "/proc/" + std::to_string(peer.pid) + "/cwd", error);
+    if (!error)
+      return cwd;
+  }
+  return fs::current_path();
+}
+
+// Makes a job argument naming a file of the client absolute
+static std::string resolve_argument(const std::string &arg,
+                                    const fs::path &cwd) {
+  std::string prefix, value = arg;
+  if (arg.rfind("-", 0) == 0) {
+    size_t equals = arg.find('=');
+    if (equals == std::string::npos)
+      return arg;
+    prefix = arg.substr(0, equals + 1);
+    value = arg.substr(equals + 1);
+  }
+  std::error_code error;
+  if (value.empty() || fs::path(value).is_absolute() ||
+      !fs::exists(cwd / value, error))
+    return arg;
+  return prefix + (cwd / value).lexically_normal().string();
+}
+
+// Job ids name output folders
+static std::string folder_name(std::string id) {
+  for (char &c : id)
+    if (!std::isalnum(static_cast<unsigned char>(c)) && c != '-' && c != '_' &&
+        c != '.')
+      c = '_';
+  return id;
+}
+
+void BenchmarkServer::run_job(int fd, const json &job) {
+  Connection connection{fd};
+  unsigned int number = ++m_job_count;
+  std::string id = job.value("id", "job-" + std::to_string(number));
+  if (!job.contains("model") || !job["model"].is_string()) {
+    connection.send(id, {{"event", "error"}, {"message", "no \"model\""}});
+    return;
+  }
+
+  fs::path output_dir =
+      m_config.workspace / (folder_name(id) + "-" + std::to_string(number));
+  fs::path cwd = client_directory(fd, job);
+  std::vector<std::string> args = m_config.default_args;
+  bool own_input_cache = false, own_isolation_cache = false;
+  for (const json &arg : job.value("args", json::array())) {
+    args.push_back(resolve_argument(
+        arg.is_string() ? arg.get<std::string>() : arg.dump(), cwd));
+    own_input_cache |= args.back().rfind("--input-cache", 0) == 0;
+    own_isolation_cache |= args.back().rfind("--isolation-cache", 0) == 0;
+  }
+  json pipelines = job.value("pipeline", json::array());
+  if (pipelines.is_string())
+    pipelines = json::array({pipelines});
+  for (const json &pipeline : pipelines) {
+    args.push_back("--pipeline");
+    args.push_back((cwd / pipeline.get<std::string>()).string());
+  }
+  if (!own_input_cache) {
+    args.push_back("--input-cache");
+    args.push_back((m_config.workspace / "inputs").string());
+  }
+  // Jobs on the same model skip isolation and metadata generation
+  if (!own_isolation_cache) {
+    args.push_back("--isolation-cache");
+    args.push_back((m_config.workspace / "isolation").string());
+  }
+  args.push_back("--output-dir");
+  args.push_back(output_dir.string());
+  args.push_back((cwd / job["model"].get<std::string>()).string());
+
+  connection.send(id, {{"event", "queued"}});
+  std::atomic<bool> finished{false};
+  // Streams kernels as the run records them
+  std::thread poller([&]() {
+    fs::path manifest = output_dir / "kernel_manifest.json";
+    std::set<std::string> reported;
+    auto report_new = [&]() {
+      if (!fs::exists(manifest))
+        return;
+      json kernels;
+      try {
+        kernels = load_json_from_file(manifest).value("kernels",
+                                                      json::object());
+      } catch (const std::exception &) {
+        return; // read again on the next poll
+      }
+      for (const auto &[kernel, entry] : kernels.items())
+        if (reported.insert(kernel).second) {
+          json averages = entry.value("averages", json::object());
+          connection.send(id, {{"event", "kernel"},
+                               {"kernel", kernel},
+                               {"status", entry.value("status", "")},
+                               {"averages", averages.value("main", json())}});
+        }
+    };
+    while (!finished) {
+      std::this_thread::sleep_for(MANIFEST_POLL);
+      report_new();
+    }
+    report_new();
+  });
+
+  auto start = std::chrono::steady_clock::now();
+  int status = BenchmarkSession(args).run(
+      [&]() { connection.send(id, {{"event", "started"}}); });
+  finished = true;
+  poller.join();
+  connection.send(
+      id, {{"event", "done"},
+           {"status", status},
+           {"seconds", std::chrono::duration<double>(
+                           std::chrono::steady_clock::now() - start)
+                           .count()},
+           {"output_dir", output_dir.string()}});
+}
@@ -0,0 +1,4602 @@
+#include "nlohmann/json_fwd.hpp"
+#include <Python.h>
+#include <algorithm>
+#include <argparse/argparse.hpp>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <initializer_list>
+#include <iostream>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <numeric>
+#include <optional>
+#include <random>
+#include <set>
+// #include <numpy/arrayobject.h>
+// #include <numpy/ndarraytypes.h>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+
+#include "activation_stats.h"
+#include "autotuner.h"
+#include "benchmark_server.h"
+#include "benchmark_session.h"
+#include "cache_evictor.h"
+#include "call_latency.h"
+#include "code_footprint.h"
+#include "command_manager.h"
+#include "compile_cache.h"
+#include "compile_profile.h"
+#include "constant_args.h"
+#include "contention.h"
+#include "cost_model.h"
+#include "counter_scheduler.h"
+#include "data_order.h"
+#include "distributed.h"
+#include "html_report.h"
+#include "kernel_dedup.h"
+#include "kernel_index.h"
+#include "kernel_manifest.h"
+#include "kernel_metadata.h"
+#include "kernel_priority.h"
+#include "kernel_sampling.h"
+#include "kernel_sandbox.h"
+#include "linalg_structure.h"
+#include "kernel_scheduler.h"
+#include "memref_layout.h"
+#include "metric_groups.h"
+#include "mlir_engine.h"
+#include "model_benchmark.h"
+#include "model_layers.h"
+#include "model_replay.h"
+#include "model_source.h"
+#include "parallel_runtime.h"
+#include "pass_prefix_cache.h"
+#include "replica_group.h"
+#include "pipeline_template.h"
+#include "result_compare.h"
+#include "result_writer.h"
+#include "results_store.h"
+#include "roofline.h"
+#include "scratch_space.h"
+#include "shape_sweep.h"
+#include "sparse_encoding.h"
+#include "statistics.h"
+#include "subgraph_isolation.h"
+#include "tensor_dump.h"
+#include "telemetry.h"
+#include "tensor_fuzzer.h"
+#include "thread_pool.h"
+#include "trend_store.h"
+#include "utils.h"
+
+namespace fs = std::filesystem;
+
+// Type Alias
+using json = nlohmann::json;
+
+/*
+ * <output-dir>/run_manifest.json: what is needed to reproduce the run's
+ * inputs, read back by --verify-against
+ */
+static bool write_run_manifest(const fs::path &manifest_filepath,
+                               uint64_t seed, const std::string &pipeline,
+                               const std::string &model) {
+  std::ofstream manifest(manifest_filepath);
+  if (!manifest.is_open()) {
+    std::cerr << "Error: Could not open " << manifest_filepath
+              << " for writing.\n";
+    return false;
+  }
+  manifest << json({{"seed", seed}, {"pipeline", pipeline}, {"model", model}})
+                  .dump(2)
+           << "\n";
+  return true;
+}
+
+/*
+ * Parses the arguments of a subcommand without exiting the process, which
+ * serves the jobs of the benchmark server. The exit status to return when
+ * there is nothing to run (--help, --version or a usage error), otherwise
+ * nullopt
+ */
+static std::optional<int> parse_arguments(argparse::ArgumentParser &program,
+                                          int argc, char **args) {
+  try {
+    program.parse_args(argc, args);
+  } catch (const std::exception &err) {
+    if (program["--help"] == true || program["--version"] == true)
+      return 0;
+    std::cerr << err.what() << std::endl;
+    std::cerr << program;
+    return 1;
+  }
+  if (program["--help"] == true || program["--version"] == true)
+    return 0;
+  return std::nullopt;
+}
+
+// Seed of a previous run, 0 if it has no manifest
+static uint64_t read_manifest_seed(const fs::path &output_dir) {
+  fs::path manifest_filepath = fs::path(output_dir).append("run_manifest.json");
+  if (!fs::exists(manifest_filepath))
+    return 0;
+  json manifest = load_json_from_file(manifest_filepath);
+  return manifest.value("seed", uint64_t(0));
+}
+
+/*
+ * Cold over warm ratio of the primary metric per kernel. Kernels far above 1
+ * are memory bound once their data is not already cached.
+ */
+static bool write_cache_sensitivity(const std::vector<KernelTask> &tasks,
+                                    const std::string &metric,
+                                    const fs::path &csv_filepath) {
+  std::ofstream csv(csv_filepath);
+  if (!csv.is_open()) {
+    std::cerr << "Error: Could not open " << csv_filepath
+              << " for writing.\n";
+    return false;
+  }
+
+  csv << "op_type,kernel,metric,warm,cold,cold_over_warm\n";
+  for (const KernelTask &task : tasks) {
+    auto warm = task.average_metrics.find(metric);
+    auto cold = task.cold_average_metrics.find(metric);
+    if (warm == task.average_metrics.end() ||
+        cold == task.cold_average_metrics.end())
+      continue;
+
+    csv << task.op_type << ","
+        << fs::path(task.mlir_filepath).filename().generic_string() << ","
+        << metric << "," << warm->second << "," << cold->second << ","
+        << (warm->second > 0.0 ? cold->second / warm->second : 0.0) << "\n";
+  }
+  return true;
+}
+
+/*
+ * Verification verdict of every measured kernel (--verify-against)
+ */
+static bool write_verification_summary(const std::vector<KernelTask> &tasks,
+                                       const fs::path &csv_filepath) {
+  std::ofstream csv(csv_filepath);
+  if (!csv.is_open()) {
+    std::cerr << "Error: Could not open " << csv_filepath
+              << " for writing.\n";
+    return false;
+  }
+
+  unsigned int invalid = 0;
+  csv << "op_type,kernel,status,mismatches,max_rel_error,max_ulp_error\n";
+  for (const KernelTask &task : tasks) {
+    auto verified = task.average_metrics.find("verified");
+    if (!task.measured || verified == task.average_metrics.end())
+      continue;
+
+    bool valid = verified->second >= 1.0;
+    invalid += !valid;
+    csv << task.op_type << ","
+        << fs::path(task.mlir_filepath).filename().generic_string() << ","
+        << (valid ? "valid" : "invalid") << ","
+        << task.average_metrics.at("mismatches") << ","
+        << task.average_metrics.at("max_rel_error") << ","
+        << task.average_metrics.at("max_ulp_error") << "\n";
+  }
+
+  if (invalid)
+    std::cerr << "Warning: " << invalid << " kernels failed verification, "
+              << "see " << csv_filepath << "\n";
+  return true;
+}
+
+/*
+ * Robust statistics of every measured kernel's main samples, one row per
+ * kernel and metric
+ */
+static bool write_sample_statistics(const std::vector<KernelTask> &tasks,
+                                    const fs::path &csv_filepath) {
+  std::ofstream csv(csv_filepath);
+  if (!csv.is_open()) {
+    std::cerr << "Error: Could not open " << csv_filepath
+              << " for writing.\n";
+    return false;
+  }
+
+  csv << "op_type,kernel,metric,samples,rejected,mean,median,min,max,p90,"
+         "p99,stddev,mad,ci95_low,ci95_high\n";
+  for (const KernelTask &task : tasks) {
+    auto rejected = task.rejected_samples.find("");
+    size_t rejected_count =
+        rejected == task.rejected_samples.end() ? 0 : rejected->second.size();
+    for (const auto &[metric, s] : task.sample_summaries)
+      csv << task.op_type << ","
+          << fs::path(task.mlir_filepath).filename().generic_string() << ","
+          << metric << "," << s.count << "," << rejected_count << ","
+          << s.mean << "," << s.median << "," << s.min << "," << s.max << ","
+          << s.p90 << "," << s.p99 << "," << s.stddev << "," << s.mad << ","
+          << s.ci95_low << "," << s.ci95_high << "\n";
+  }
+  return true;
+}
+
+/*
+ * Every sample --outlier-rejection left out, with its primary metric value
+ */
+static bool write_rejected_samples(const std::vector<KernelTask> &tasks,
+                                   const std::string &metric,
+                                   const fs::path &csv_filepath) {
+  std::ofstream csv(csv_filepath);
+  if (!csv.is_open()) {
+    std::cerr << "Error: Could not open " << csv_filepath
+              << " for writing.\n";
+    return false;
+  }
+
+  size_t rejected_count = 0;
+  csv << "op_type,kernel,variant,sample," << metric << "\n";
+  for (const KernelTask &task : tasks)
+    for (const auto &[variant, rejected] : task.rejected_samples)
+      for (const auto &[sample, value] : rejected) {
+        csv << task.op_type << ","
+            << fs::path(task.mlir_filepath).filename().generic_string() << ","
+            << (variant.empty() ? "" : variant.substr(1)) << "," << sample
+            << "," << value << "\n";
+        rejected_count++;
+      }
+  std::cout << rejected_count << " outlier samples rejected, see "
+            << csv_filepath << "\n";
+  return true;
+}
+
+/*
+ * Primary metric of every swept layout relative to the main input layout
+ */
+static bool write_layout_sensitivity(const std::vector<KernelTask> &tasks,
+                                     const std::string &metric,
+                                     const fs::path &csv_filepath) {
+  std::ofstream csv(csv_filepath);
+  if (!csv.is_open()) {
+    std::cerr << "Error: Could not open " << csv_filepath
+              << " for writing.\n";
+    return false;
+  }
+
+  csv << "op_type,kernel,metric,layout,value,relative_to_main\n";
+  for (const KernelTask &task : tasks) {
+    auto main = task.average_metrics.find(metric);
+    if (main == task.average_metrics.end())
+      continue;
+    for (const auto &[layout, averages] : task.layout_average_metrics) {
+      auto value = averages.find(metric);
+      if (value == averages.end())
+        continue;
+      csv << task.op_type << ","
+          << fs::path(task.mlir_filepath).filename().generic_string() << ","
+          << metric << "," << layout << "," << value->second << ","
+          << (main->second > 0.0 ? value->second / main->second : 0.0)
+          << "\n";
+    }
+  }
+  return true;
+}
+
+/*
+ * Primary metric of every comparison pipeline relative to the first
+ * --pipeline, per kernel, per op type and for the whole model (weighted by
+ * occurrences)
+ */
+static bool write_pipeline_comparison(const std::vector<KernelTask> &tasks,
+                                      const std::string &metric,
+                                      const fs::path &csv_filepath) {
+  std::ofstream csv(csv_filepath);
+  if (!csv.is_open()) {
+    std::cerr << "Error: Could not open " << csv_filepath
+              << " for writing.\n";
+    return false;
+  }
+
+  csv << "op_type,kernel,metric,pipeline,value,relative_to_primary\n";
+  std::map<std::string, std::pair<double, double>> model_totals;
+  std::map<std::pair<std::string, std::string>, std::pair<double, double>>
+      op_totals;
+  for (const KernelTask &task : tasks) {
+    auto main = task.average_metrics.find(metric);
+    if (main == task.average_metrics.end())
+      continue;
+    for (const auto &[pipeline, averages] : task.pipeline_average_metrics) {
+      auto value = averages.find(metric);
+      if (value == averages.end())
+        continue;
+      csv << task.op_type << ","
+          << fs::path(task.mlir_filepath).filename().generic_string() << ","
+          << metric << "," << pipeline << "," << value->second << ","
+          << (main->second > 0.0 ? value->second / main->second : 0.0)
+          << "\n";
+      // Only kernels measured under both count towards the model
+      model_totals[pipeline].first += task.multiplicity * value->second;
+      model_totals[pipeline].second += task.multiplicity * main->second;
+      auto &op = op_totals[{task.op_type, pipeline}];
+      op.first += task.multiplicity * value->second;
+      op.second += task.multiplicity * main->second;
+    }
+  }
+  for (const auto &[key, totals] : op_totals)
+    csv << key.first << ",total," << metric << "," << key.second << ","
+        << totals.first << ","
+        << (totals.second > 0.0 ? totals.first / totals.second : 0.0) << "\n";
+  for (const auto &[pipeline, totals] : model_totals)
+    csv << "model,total," << metric << "," << pipeline << "," << totals.first
+        << "," << (totals.second > 0.0 ? totals.first / totals.second : 0.0)
+        << "\n";
+  return true;
+}
+
+/*
+ * --torch-baseline: primary metric of the torch op next to the kernel's,
+ * speedup being how many times faster the MLIR pipeline is, per kernel and
+ * for the whole model (weighted by occurrences)
+ */
+static bool write_torch_baseline(const std::vector<KernelTask> &tasks,
+                                 const std::string &metric,
+                                 const fs::path &csv_filepath) {
+  std::ofstream csv(csv_filepath);
+  if (!csv.is_open()) {
+    std::cerr << "Error: Could not open " << csv_filepath
+              << " for writing.\n";
+    return false;
+  }
+
+  csv << "op_type,kernel,metric,baseline,mlir,torch,speedup\n";
+  std::map<std::string, std::pair<double, double>> model_totals;
+  for (const KernelTask &task : tasks) {
+    auto main = task.average_metrics.find(metric);
+    if (main == task.average_metrics.end())
+      continue;
+    for (const auto &[baseline, averages] : task.baseline_average_metrics) {
+      auto value = averages.find(metric);
+      if (value == averages.end())
+        continue;
+      csv << task.op_type << ","
+          << fs::path(task.mlir_filepath).filename().generic_string() << ","
+          << metric << "," << baseline << "," << main->second << ","
+          << value->second << ","
+          << (main->second > 0.0 ? value->second / main->second : 0.0)
+          << "\n";
+      // Only kernels torch ran count towards the model
+      model_totals[baseline].first += task.multiplicity * main->second;
+      model_totals[baseline].second += task.multiplicity * value->second;
+    }
+  }
+  for (const auto &[baseline, totals] : model_totals) {
+    double speedup = totals.first > 0.0 ? totals.second / totals.first : 0.0;
+    csv << "model,total," << metric << "," << baseline << "," << totals.first
+        << "," << totals.second << "," << speedup << "\n";
+    std::cout << "Model speedup over " << baseline << ": " << speedup
+              << "x\n";
+  }
+  return true;
+}
+
+/*
+ * Primary metric of every --pipeline-sweep grid point per kernel, with the
+ * point's template parameters as columns (graph-gen/pipeline_sweep_heatmap.py)
+ */
+static bool write_pipeline_sweep(
+    const std::vector<KernelTask> &tasks, const std::string &metric,
+    const PipelineTemplate &sweep,
+    const std::map<std::string, std::vector<std::string>> &points,
+    const fs::path &csv_filepath) {
+  std::ofstream csv(csv_filepath);
+  if (!csv.is_open()) {
+    std::cerr << "Error: Could not open " << csv_filepath
+              << " for writing.\n";
+    return false;
+  }
+
+  csv << "op_type,kernel,multiplicity,pipeline";
+  for (const PipelineTemplate::Dimension &dimension : sweep.dimensions())
+    csv << "," << dimension.name;
+  csv << ",metric,value,relative_to_primary\n";
+  for (const KernelTask &task : tasks) {
+    auto main = task.average_metrics.find(metric);
+    if (main == task.average_metrics.end())
+      continue;
+    for (const auto &[pipeline, averages] : task.pipeline_average_metrics) {
+      auto point = points.find(pipeline);
+      auto value = averages.find(metric);
+      if (point == points.end() || value == averages.end())
+        continue;
+      csv << task.op_type << ","
+          << fs::path(task.mlir_filepath).filename().generic_string() << ","
+          << task.multiplicity << "," << pipeline;
+      // Values may be lists ("4,4" tile sizes)
+      for (const std::string &parameter : point->second)
+        csv << ",\"" << parameter << "\"";
+      csv << "," << metric << "," << value->second << ","
+          << (main->second > 0.0 ? value->second / main->second : 0.0)
+          << "\n";
+    }
+  }
+  return true;
+}
+
+/*
+ * --compile-profile: compile_profile.csv (one row per kernel and pipeline)
+ * and compile_passes.csv (one row per pass instance of each). `primary` is
+ * the label of the primary --pipeline.
+ */
+static bool write_compile_profile(const std::vector<KernelTask> &tasks,
+                                  const std::string &primary,
+                                  const fs::path &output_folder) {
+  fs::path summary_filepath =
+      fs::path(output_folder).append("compile_profile.csv");
+  fs::path passes_filepath =
+      fs::path(output_folder).append("compile_passes.csv");
+  std::ofstream summary(summary_filepath);
+  std::ofstream passes(passes_filepath);
+  if (!summary.is_open() || !passes.is_open()) {
+    std::cerr << "Error: Could not write the compile profile to "
+              << output_folder << "\n";
+    return false;
+  }
+
+  summary << "op_type,kernel,multiplicity,pipeline,lowering_seconds,"
+             "mlir_opt_seconds,object_seconds,linalg_ops,llvm_ops,ll_bytes,"
+             "object_bytes,slowest_pass,slowest_pass_ms\n";
+  passes << "op_type,kernel,pipeline,index,pass,wall_ms,ops_before,ops_after,"
+            "ops_growth\n";
+  for (const KernelTask &task : tasks) {
+    std::vector<std::pair<std::string, const CompileProfile *>> profiles = {
+        {primary, &task.compile_profile}};
+    for (const auto &[label, profile] : task.pipeline_compile_profiles)
+      profiles.push_back({label, &profile});
+
+    std::string kernel =
+        fs::path(task.mlir_filepath).filename().generic_string();
+    for (const auto &[label, profile] : profiles) {
+      if (!profile->collected)
+        continue;
+      const PassProfile *slowest = nullptr;
+      for (size_t i = 0; i < profile->passes.size(); i++) {
+        const PassProfile &pass = profile->passes[i];
+        if (!slowest || pass.wall_ms > slowest->wall_ms)
+          slowest = &pass;
+        // Pass options hold commas and quotes
+        std::string name = pass.name;
+        std::replace(name.begin(), name.end(), '"', '\'');
+        passes << task.op_type << "," << kernel << "," << label << "," << i
+               << ",\"" << name << "\"," << pass.wall_ms << ","
+               << pass.ops_before << "," << pass.ops_after << ","
+               << static_cast<long long>(pass.ops_after) -
+                      static_cast<long long>(pass.ops_before)
+               << "\n";
+      }
+      summary << task.op_type << "," << kernel << "," << task.multiplicity
+              << "," << label << "," << profile->lowering_seconds << ","
+              << profile->mlir_opt_seconds << "," << profile->object_seconds
+              << "," << profile->linalg_ops << "," << profile->llvm_ops << ","
+              << profile->ll_bytes << "," << profile->object_bytes << ",\""
+              << (slowest ? slowest->name : "") << "\","
+              << (slowest ? slowest->wall_ms : 0.0) << "\n";
+    }
+  }
+  std::cout << "Compile profile written to " << summary_filepath << " and "
+            << passes_filepath << "\n";
+  return true;
+}
+
+/*
+ * Primary metric at every swept input density relative to the main inputs
+ */
+static bool write_density_sensitivity(const std::vector<KernelTask> &tasks,
+                                      const std::string &metric,
+                                      const fs::path &csv_filepath) {
+  std::ofstream csv(csv_filepath);
+  if (!csv.is_open()) {
+    std::cerr << "Error: Could not open " << csv_filepath
+              << " for writing.\n";
+    return false;
+  }
+
+  csv << "op_type,kernel,metric,density,value,relative_to_main\n";
+  for (const KernelTask &task : tasks) {
+    auto main = task.average_metrics.find(metric);
+    if (main == task.average_metrics.end())
+      continue;
+    for (const auto &[density, averages] : task.density_average_metrics) {
+      auto value = averages.find(metric);
+      if (value == averages.end())
+        continue;
+      csv << task.op_type << ","
+          << fs::path(task.mlir_filepath).filename().generic_string() << ","
+          << metric << "," << density << "," << value->second << ","
+          << (main->second > 0.0 ? value->second / main->second : 0.0)
+          << "\n";
+    }
+  }
+  return true;
+}
+
+/*
+ * Primary metric of every --shape-sweep variant next to its model kernel.
+ * Cost per input element relative to the model shapes shows cache cliffs:
+ * it stays near 1 while the working set scales with the hierarchy, and jumps
+ * where it falls out of a cache level.
+ */
+static bool write_shape_scaling(const std::vector<KernelTask> &tasks,
+                                const std::vector<KernelTask> &shape_tasks,
+                                const std::string &metric,
+                                const fs::path &csv_filepath) {
+  std::ofstream csv(csv_filepath);
+  if (!csv.is_open()) {
+    std::cerr << "Error: Could not open " << csv_filepath
+              << " for writing.\n";
+    return false;
+  }
+
+  std::map<fs::path, const KernelTask *> parents;
+  for (const KernelTask &task : tasks)
+    parents[task.mlir_filepath] = &task;
+
+  csv << "op_type,kernel,variant,batch_scale,spatial_scale,input_elements,"
+         "metric,value,per_element,relative_per_element\n";
+  auto write_row = [&](const KernelTask &task, const std::string &variant,
+                       double base_per_element) {
+    auto value = task.average_metrics.find(metric);
+    uint64_t elements = ShapeSweep::input_elements(task.json_filepath);
+    if (value == task.average_metrics.end() || elements == 0)
+      return 0.0;
+    double per_element = value->second / elements;
+    csv << task.op_type << ","
+        << fs::path(task.mlir_filepath).filename().generic_string() << ","
+        << variant << "," << task.shape_scale.batch << ","
+        << task.shape_scale.spatial << "," << elements << "," << metric
+        << "," << value->second << "," << per_element << ","
+        << (base_per_element > 0.0 ? per_element / base_per_element : 1.0)
+        << "\n";
+    return per_element;
+  };
+
+  std::map<fs::path, double> base_per_element;
+  for (const KernelTask &variant : shape_tasks) {
+    auto parent = parents.find(variant.shape_parent);
+    if (parent == parents.end() || variant.shape_scale.cache_level > 0 ||
+        variant.data_order != DataOrder::NCHW || variant.dynamic ||
+        variant.const_args || !variant.sparse_args.empty())
+      continue;
+    if (!base_per_element.count(variant.shape_parent))
+      base_per_element[variant.shape_parent] =
+          write_row(*parent->second, "model", 0.0);
+    write_row(variant, variant.shape_variant,
+              base_per_element[variant.shape_parent]);
+  }
+  return true;
+}
+
+/*
+ * --dynamic-shapes: primary metric of every kernel and swept shape,
+ * specialized (its own static object) and dynamic (the one object with
+ * dynamic activations), and overhead = dynamic / static. The model row of
+ * each kernel is the model's shapes.
+ */
+static bool write_shape_specialization(
+    const std::vector<KernelTask> &tasks,
+    const std::vector<KernelTask> &shape_tasks, const std::string &metric,
+    const fs::path &csv_filepath) {
+  std::ofstream csv(csv_filepath);
+  if (!csv.is_open()) {
+    std::cerr << "Error: Could not open " << csv_filepath
+              << " for writing.\n";
+    return false;
+  }
+
+  std::map<fs::path, const KernelTask *> parents;
+  for (const KernelTask &task : tasks)
+    parents[task.mlir_filepath] = &task;
+  std::map<std::pair<fs::path, std::string>, const KernelTask *> statics;
+  for (const KernelTask &variant : shape_tasks)
+    if (!variant.dynamic)
+      statics[{variant.shape_parent, variant.shape_variant}] = &variant;
+  auto average = [&metric](const std::map<std::string, double> &averages) {
+    auto value = averages.find(metric);
+    return value == averages.end() ? -1.0 : value->second;
+  };
+
+  csv << "op_type,kernel,shape,metric,static,dynamic,overhead\n";
+  double static_total = 0.0, dynamic_total = 0.0;
+  size_t shapes = 0, objects = 0;
+  for (const KernelTask &dynamic : shape_tasks) {
+    auto parent = parents.find(dynamic.shape_parent);
+    if (!dynamic.dynamic || parent == parents.end())
+      continue;
+    objects++;
+    auto write_row = [&](const std::string &shape, double static_value,
+                         double dynamic_value) {
+      if (static_value < 0.0 || dynamic_value < 0.0)
+        return false;
+      csv << dynamic.op_type << ","
+          << dynamic.mlir_filepath.filename().generic_string() << ","
+          << shape << "," << metric << "," << static_value << ","
+          << dynamic_value << ",";
+      if (static_value > 0.0)
+        csv << dynamic_value / static_value;
+      csv << "\n";
+      shapes++;
+      return true;
+    };
+
+    double static_value = average(parent->second->average_metrics);
+    double dynamic_value = average(dynamic.average_metrics);
+    if (write_row("model", static_value, dynamic_value)) {
+      static_total += static_value * dynamic.multiplicity;
+      dynamic_total += dynamic_value * dynamic.multiplicity;
+    }
+    for (const auto &[shape, averages] :
+         dynamic.dynamic_shape_average_metrics) {
+      auto specialized = statics.find({dynamic.shape_parent, shape});
+      if (specialized != statics.end())
+        write_row(shape, average(specialized->second->average_metrics),
+                  average(averages));
+    }
+  }
+
+  std::cout << "Dynamic shapes: " << shapes << " shapes ran on " << objects
+            << " dynamic objects";
+  if (static_total > 0.0)
+    std::cout << ", " << metric << " at the model's shapes "
+              << dynamic_total / static_total << "x of the specialized ones";
+  std::cout << "\n";
+  return true;
+}
+
+/*
+ * --const-args: primary metric, compile time and object size of every
+ * kernel, generic (arguments) and specialized (inlined constants), with
+ * speedup = generic / specialized. The model row weighs the kernels by
+ * their multiplicity.
+ */
+static bool write_const_specialization(
+    const std::vector<KernelTask> &tasks,
+    const std::vector<KernelTask> &shape_tasks, const std::string &metric,
+    const fs::path &csv_filepath) {
+  std::ofstream csv(csv_filepath);
+  if (!csv.is_open()) {
+    std::cerr << "Error: Could not open " << csv_filepath
+              << " for writing.\n";
+    return false;
+  }
+
+  std::map<fs::path, const KernelTask *> parents;
+  for (const KernelTask &task : tasks)
+    parents[task.mlir_filepath] = &task;
+  auto average = [&metric](const KernelTask &task) {
+    auto value = task.average_metrics.find(metric);
+    return value == task.average_metrics.end() ? -1.0 : value->second;
+  };
+  auto object_bytes = [](const KernelTask &task) -> int64_t {
+    std::error_code ec;
+    uintmax_t bytes = fs::file_size(task.kernel.so_filepath, ec);
+    return ec ? -1 : static_cast<int64_t>(bytes);
+  };
+
+  csv << "op_type,kernel,inlined,metric,generic,specialized,speedup,"
+         "generic_compile_seconds,specialized_compile_seconds,"
+         "generic_object_bytes,specialized_object_bytes\n";
+  double generic_total = 0.0, specialized_total = 0.0;
+  size_t kernels = 0;
+  for (const KernelTask &specialized : shape_tasks) {
+    auto parent = parents.find(specialized.shape_parent);
+    if (!specialized.const_args || parent == parents.end())
+      continue;
+    const KernelTask &generic = *parent->second;
+    double generic_value = average(generic);
+    double specialized_value = average(specialized);
+    if (generic_value < 0.0 || specialized_value < 0.0)
+      continue;
+    csv << specialized.op_type << ","
+        << specialized.mlir_filepath.filename().generic_string() << ","
+        << specialized.const_args << "," << metric << "," << generic_value
+        << "," << specialized_value << ",";
+    if (specialized_value > 0.0)
+      csv << generic_value / specialized_value;
+    csv << "," << generic.timeline.compile_seconds << ","
+        << specialized.timeline.compile_seconds << "," << object_bytes(generic)
+        << "," << object_bytes(specialized) << "\n";
+    generic_total += generic_value * specialized.multiplicity;
+    specialized_total += specialized_value * specialized.multiplicity;
+    kernels++;
+  }
+  if (specialized_total > 0.0)
+    csv << "model,all,,," << metric << "," << generic_total << ","
+        << specialized_total << "," << generic_total / specialized_total
+        << ",,,,\n";
+
+  std::cout << "Constant arguments: " << kernels
+            << " specialized kernels measured";
+  if (specialized_total > 0.0)
+    std::cout << ", " << metric << " over the model "
+              << generic_total / specialized_total
+              << "x faster with constants";
+  std::cout << "\n";
+  return true;
+}
+
+/*
+ * --sparse-args: primary metric of every kernel at every --density-sweep
+ * density, dense (the model kernel) and sparse (its encoded variant on the
+ * same inputs), with speedup = dense / sparse. The "all" rows of an op type
+ * weigh its kernels by their multiplicity, its "crossover" row is the
+ * density below which the sparse kernels win, interpolated between the
+ * densities around it.
+ */
+static bool write_sparse_crossover(const std::vector<KernelTask> &tasks,
+                                   const std::vector<KernelTask> &shape_tasks,
+                                   const std::string &metric,
+                                   const fs::path &csv_filepath) {
+  std::ofstream csv(csv_filepath);
+  if (!csv.is_open()) {
+    std::cerr << "Error: Could not open " << csv_filepath
+              << " for writing.\n";
+    return false;
+  }
+
+  std::map<fs::path, const KernelTask *> parents;
+  for (const KernelTask &task : tasks)
+    parents[task.mlir_filepath] = &task;
+  auto average = [&metric](const KernelTask &task, const std::string &name) {
+    auto averages = task.density_average_metrics.find(name);
+    if (averages == task.density_average_metrics.end())
+      return -1.0;
+    auto value = averages->second.find(metric);
+    return value == averages->second.end() ? -1.0 : value->second;
+  };
+
+  csv << "op_type,kernel,format,density,metric,dense,sparse,speedup\n";
+  // Dense and sparse totals of every op type, by density
+  std::map<std::string, std::map<double, std::pair<double, double>>> totals;
+  size_t kernels = 0;
+  for (const KernelTask &sparse : shape_tasks) {
+    auto parent = parents.find(sparse.shape_parent);
+    if (sparse.sparse_args.empty() || parent == parents.end())
+      continue;
+    bool measured = false;
+    for (const auto &[name, averages] : sparse.density_average_metrics) {
+      double dense_value = average(*parent->second, name);
+      double sparse_value = average(sparse, name);
+      if (dense_value < 0.0 || sparse_value < 0.0)
+        continue;
+      csv << sparse.op_type << ","
+          << sparse.mlir_filepath.filename().generic_string() << ",\""
+          << sparse.sparse_args << "\"," << name << "," << metric << ","
+          << dense_value << "," << sparse_value << ",";
+      if (sparse_value > 0.0)
+        csv << dense_value / sparse_value;
+      csv << "\n";
+      auto &[dense_total, sparse_total] =
+          totals[sparse.op_type][std::stod(name)];
+      dense_total += dense_value * sparse.multiplicity;
+      sparse_total += sparse_value * sparse.multiplicity;
+      measured = true;
+    }
+    kernels += measured;
+  }
+
+  std::cout << "Sparse kernels: " << kernels << " measured against dense";
+  for (const auto &[op_type, densities] : totals) {
+    double previous_density = -1.0, previous_speedup = 0.0;
+    double crossover = -1.0;
+    bool sparse_wins = false, dense_wins = false;
+    for (const auto &[density, total] : densities) {
+      const auto &[dense_total, sparse_total] = total;
+      if (sparse_total <= 0.0)
+        continue;
+      double speedup = dense_total / sparse_total;
+      csv << op_type << ",all,," << density << "," << metric << ","
+          << dense_total << "," << sparse_total << "," << speedup << "\n";
+      // Sparse wins at low densities, the first loss after a win crosses
+      if (crossover < 0.0 && previous_density >= 0.0 &&
+          previous_speedup >= 1.0 && speedup < 1.0)
+        crossover = previous_density + (previous_speedup - 1.0) /
+                                           (previous_speedup - speedup) *
+                                           (density - previous_density);
+      previous_density = density;
+      previous_speedup = speedup;
+      (speedup >= 1.0 ? sparse_wins : dense_wins) = true;
+    }
+    if (crossover >= 0.0) {
+      csv << op_type << ",crossover,," << crossover << "," << metric
+          << ",,,1\n";
+      std::cout << ", " << op_type << " sparse below density " << crossover;
+    } else if (sparse_wins != dense_wins) {
+      std::cout << ", " << op_type << (sparse_wins ? " sparse" : " dense")
+                << " at every density";
+    }
+  }
+  std::cout << "\n";
+  return true;
+}
+
+/*
+ * --working-set-sweep: throughput of every kernel and its cache targeted
+ * variants against the working set of one call. GB/s needs the seconds
+ * metric, otherwise only the primary metric is listed.
+ */
+static bool write_working_set_sweep(const std::vector<KernelTask> &tasks,
+                                    const std::vector<KernelTask> &shape_tasks,
+                                    const std::vector<CacheLevel> &caches,
+                                    const std::string &metric,
+                                    const fs::path &csv_filepath) {
+  std::ofstream csv(csv_filepath);
+  if (!csv.is_open()) {
+    std::cerr << "Error: Could not open " << csv_filepath
+              << " for writing.\n";
+    return false;
+  }
+
+  std::map<int, uint64_t> cache_bytes;
+  for (const CacheLevel &cache : caches)
+    cache_bytes[cache.level] = cache.bytes;
+  std::map<fs::path, const KernelTask *> parents;
+  for (const KernelTask &task : tasks)
+    parents[task.mlir_filepath] = &task;
+
+  csv << "op_type,kernel,variant,cache_level,cache_bytes,working_set_bytes,"
+         "metric,value,gb_per_s\n";
+  auto write_row = [&](const KernelTask &task, const std::string &variant) {
+    auto value = task.average_metrics.find(metric);
+    uint64_t working_set = ShapeSweep::working_set_bytes(task.json_filepath);
+    if (value == task.average_metrics.end() || working_set == 0)
+      return;
+    auto seconds = task.average_metrics.find("seconds");
+    int level = task.shape_scale.cache_level;
+    csv << task.op_type << ","
+        << fs::path(task.mlir_filepath).filename().generic_string() << ","
+        << variant << "," << level << ","
+        << (level ? cache_bytes[level] : 0) << "," << working_set << ","
+        << metric << "," << value->second << ",";
+    if (seconds != task.average_metrics.end() && seconds->second > 0.0)
+      csv << working_set / seconds->second / 1e9;
+    csv << "\n";
+  };
+
+  std::set<fs::path> written;
+  for (const KernelTask &variant : shape_tasks) {
+    auto parent = parents.find(variant.shape_parent);
+    if (parent == parents.end() || variant.shape_scale.cache_level == 0)
+      continue;
+    if (written.insert(variant.shape_parent).second)
+      write_row(*parent->second, "model");
+    write_row(variant, variant.shape_variant);
+  }
+  return true;
+}
+
+/*
+ * --data-order-sweep: every data order variant next to its NCHW kernel, with
+ * the same logical tensors. The conversions at the kernel boundary are part
+ * of the variant, so a ratio below 1 means the op's loops prefer the order
+ * enough to pay for them.
+ */
+static bool write_data_order_sweep(const std::vector<KernelTask> &tasks,
+                                   const std::vector<KernelTask> &shape_tasks,
+                                   const std::string &metric,
+                                   const fs::path &csv_filepath) {
+  std::ofstream csv(csv_filepath);
+  if (!csv.is_open()) {
+    std::cerr << "Error: Could not open " << csv_filepath
+              << " for writing.\n";
+    return false;
+  }
+
+  std::map<fs::path, const KernelTask *> parents;
+  for (const KernelTask &task : tasks)
+    parents[task.mlir_filepath] = &task;
+
+  csv << "op_type,kernel,order,metric,value,relative_to_nchw\n";
+  std::set<fs::path> written;
+  for (const KernelTask &variant : shape_tasks) {
+    auto parent = parents.find(variant.shape_parent);
+    if (parent == parents.end() || variant.data_order == DataOrder::NCHW)
+      continue;
+    const KernelTask &base = *parent->second;
+    auto base_value = base.average_metrics.find(metric);
+    auto value = variant.average_metrics.find(metric);
+    if (base_value == base.average_metrics.end() ||
+        value == variant.average_metrics.end())
+      continue;
+
+    std::string kernel =
+        fs::path(base.mlir_filepath).filename().generic_string();
+    if (written.insert(variant.shape_parent).second)
+      csv << base.op_type << "," << kernel << ",nchw," << metric << ","
+          << base_value->second << ",1\n";
+    csv << base.op_type << "," << kernel << ","
+        << DataOrders::describe(variant.data_order) << "," << metric << ","
+        << value->second << ","
+        << (base_value->second > 0.0 ? value->second / base_value->second
+                                     : 1.0)
+        << "\n";
+  }
+  return true;
+}
+
+/*
+ * Metric of every --profile-sweep profile relative to the main inputs.
+ * Cycles are compared when sampled (the primary metric otherwise), and
+ * kernels moving by more than `threshold` either way are flagged as data
+ * dependent.
+ */
+static bool write_profile_sensitivity(const std::vector<KernelTask> &tasks,
+                                      const std::string &primary_metric,
+                                      double threshold,
+                                      const fs::path &csv_filepath) {
+  std::ofstream csv(csv_filepath);
+  if (!csv.is_open()) {
+    std::cerr << "Error: Could not open " << csv_filepath
+              << " for writing.\n";
+    return false;
+  }
+
+  csv << "op_type,kernel,metric,profile,value,relative_to_main,flagged\n";
+  std::vector<std::string> flagged_kernels;
+  for (const KernelTask &task : tasks) {
+    std::string metric = task.average_metrics.count("cycles")
+                             ? "cycles"
+                             : primary_metric;
+    auto main = task.average_metrics.find(metric);
+    if (main == task.average_metrics.end())
+      continue;
+    std::string kernel =
+        fs::path(task.mlir_filepath).filename().generic_string();
+
+    std::string worst_profile;
+    double worst_ratio = 1.0;
+    for (const auto &[profile, averages] : task.profile_average_metrics) {
+      auto value = averages.find(metric);
+      if (value == averages.end())
+        continue;
+      double ratio = main->second > 0.0 ? value->second / main->second : 0.0;
+      bool flagged = std::abs(ratio - 1.0) > threshold;
+      csv << task.op_type << "," << kernel << "," << metric << "," << profile
+          << "," << value->second << "," << ratio << ","
+          << (flagged ? 1 : 0) << "\n";
+      if (flagged && std::abs(ratio - 1.0) > std::abs(worst_ratio - 1.0)) {
+        worst_ratio = ratio;
+        worst_profile = profile;
+      }
+    }
+    if (!worst_profile.empty())
+      flagged_kernels.push_back(kernel + " (" + worst_profile + " x" +
+                                std::to_string(worst_ratio) + ")");
+  }
+
+  if (!flagged_kernels.empty()) {
+    std::cout << flagged_kernels.size()
+              << " kernel(s) with data dependent performance:\n";
+    for (const std::string &kernel : flagged_kernels)
+      std::cout << "  " << kernel << "\n";
+  }
+  return true;
+}
+
+/*
+ * --contention: primary metric of every kernel next to each stressor
+ * profile, slowdown being how many times slower than the quiet
+ * measurement, per kernel, per op type and for the whole model (weighted
+ * by occurrences)
+ */
+static bool write_contention_slowdown(const std::vector<KernelTask> &tasks,
+                                      const std::string &metric,
+                                      const fs::path &csv_filepath) {
+  std::ofstream csv(csv_filepath);
+  if (!csv.is_open()) {
+    std::cerr << "Error: Could not open " << csv_filepath
+              << " for writing.\n";
+    return false;
+  }
+
+  csv << "op_type,kernel,metric,contention,quiet,contended,slowdown\n";
+  std::map<std::pair<std::string, std::string>, std::pair<double, double>>
+      op_totals, model_totals;
+  for (const KernelTask &task : tasks) {
+    auto main = task.average_metrics.find(metric);
+    if (main == task.average_metrics.end())
+      continue;
+    for (const auto &[contention, averages] :
+         task.contention_average_metrics) {
+      auto value = averages.find(metric);
+      if (value == averages.end())
+        continue;
+      csv << task.op_type << ","
+          << fs::path(task.mlir_filepath).filename().generic_string() << ","
+          << metric << "," << contention << "," << main->second << ","
+          << value->second << ","
+          << (main->second > 0.0 ? value->second / main->second : 0.0)
+          << "\n";
+      for (auto *totals : {&op_totals[{task.op_type, contention}],
+                           &model_totals[{"model", contention}]}) {
+        totals->first += task.multiplicity * main->second;
+        totals->second += task.multiplicity * value->second;
+      }
+    }
+  }
+  for (const auto *totals_by_key : {&op_totals, &model_totals})
+    for (const auto &[key, totals] : *totals_by_key) {
+      double slowdown =
+          totals.first > 0.0 ? totals.second / totals.first : 0.0;
+      csv << key.first << ",total," << metric << "," << key.second << ","
+          << totals.first << "," << totals.second << "," << slowdown << "\n";
+      if (totals_by_key == &model_totals)
+        std::cout << "Model slowdown under " << key.second << ": x"
+                  << slowdown << "\n";
+    }
+  return true;
+}
+
+/*
+ * --profile-sweep profiles, an empty list for an unknown name
+ */
+static std::vector<DataProfile> parse_profile_list(const std::string &spec) {
+  std::vector<DataProfile> profiles;
+  std::stringstream ss(spec);
+  std::string name;
+  while (std::getline(ss, name, ',')) {
+    if (name.empty())
+      continue;
+    DataProfile profile;
+    if (!TensorFuzzer::parse_profile(name, profile)) {
+      std::cerr << "Unknown --profile-sweep profile '" << name << "'\n";
+      return {};
+    }
+    profiles.push_back(profile);
+  }
+  return profiles;
+}
+
+/*
+ * --density-sweep values, keyed by their printed form ("0.1")
+ */
+static std::vector<std::pair<std::string, float>>
+parse_density_list(const std::string &spec) {
+  std::vector<std::pair<std::string, float>> densities;
+  std::stringstream ss(spec);
+  std::string value;
+  while (std::getline(ss, value, ',')) {
+    if (value.empty())
+      continue;
+    try {
+      float density = std::stof(value);
+      if (density < 0.f || density > 1.f)
+        throw std::out_of_range(value);
+      std::ostringstream name;
+      name << density;
+      densities.emplace_back(name.str(), density);
+    } catch (const std::exception &) {
+      std::cerr << "Invalid density '" << value
+                << "' (0 to 1), skipping it\n";
+    }
+  }
+  return densities;
+}
+
+/*
+ * Wall clock scaling of every kernel over the --thread-sweep counts. Speedup
+ * is relative to the smallest swept count (normally 1 thread), efficiency is
+ * the speedup divided by the thread ratio.
+ */
+static bool write_thread_scaling(const std::vector<KernelTask> &tasks,
+                                 const fs::path &csv_filepath) {
+  std::ofstream csv(csv_filepath);
+  if (!csv.is_open()) {
+    std::cerr << "Error: Could not open " << csv_filepath
+              << " for writing.\n";
+    return false;
+  }
+
+  csv << "op_type,kernel,threads,seconds,speedup,efficiency\n";
+  for (const KernelTask &task : tasks) {
+    double base_seconds = 0.0;
+    unsigned int base_threads = 0;
+    for (const auto &[threads, averages] : task.thread_average_metrics) {
+      auto seconds = averages.find("seconds");
+      if (seconds == averages.end() || seconds->second <= 0.0)
+        continue;
+      // Counts are sorted, the first valid one is the baseline
+      if (!base_threads) {
+        base_threads = threads;
+        base_seconds = seconds->second;
+      }
+
+      double speedup = base_seconds / seconds->second;
+      csv << task.op_type << ","
+          << fs::path(task.mlir_filepath).filename().generic_string() << ","
+          << threads << "," << seconds->second << "," << speedup << ","
+          << speedup * base_threads / threads << "\n";
+    }
+  }
+  return true;
+}
+
+/*
+ * --call-latency: the per-call percentiles of every kernel, with the tail
+ * ratio p99 / p50. The histograms themselves are under call_latency/.
+ */
+static bool write_call_latency(const std::vector<KernelTask> &tasks,
+                               const fs::path &csv_filepath) {
+  std::ofstream csv(csv_filepath);
+  if (!csv.is_open()) {
+    std::cerr << "Error: Could not open " << csv_filepath
+              << " for writing.\n";
+    return false;
+  }
+
+  csv << "op_type,kernel,calls,mean_ns,p50_ns,p99_ns,p999_ns,max_ns,"
+         "tail_ratio\n";
+  for (const KernelTask &task : tasks) {
+    auto calls = task.average_metrics.find("call_latency_calls");
+    if (!task.shape_variant.empty() || calls == task.average_metrics.end() ||
+        calls->second <= 0.0)
+      continue;
+    csv << task.op_type << ","
+        << fs::path(task.mlir_filepath).filename().generic_string();
+    for (const std::string &column : LatencyHistogram::columns()) {
+      auto value = task.average_metrics.find(column);
+      csv << ",";
+      if (value != task.average_metrics.end())
+        csv << value->second;
+    }
+    auto p50 = task.average_metrics.find("call_p50_ns");
+    auto p99 = task.average_metrics.find("call_p99_ns");
+    csv << ",";
+    if (p50 != task.average_metrics.end() &&
+        p99 != task.average_metrics.end() && p50->second > 0.0)
+      csv << p99->second / p50->second;
+    csv << "\n";
+  }
+  return true;
+}
+
+/*
+ * --replicas: aggregate throughput of every kernel at each replica count.
+ * calls_per_second sums 1 / seconds over the replicas, speedup is relative
+ * to the kernel's own single core measurement and efficiency divides it by
+ * the replica count. cycles is the replicas' mean per call. An "all" row
+ * per op type and count averages the efficiency of its kernels, weighted by
+ * multiplicity: where it drops, the op type saturates a shared resource.
+ */
+static bool write_replica_scaling(const std::vector<KernelTask> &tasks,
+                                  const fs::path &csv_filepath) {
+  std::ofstream csv(csv_filepath);
+  if (!csv.is_open()) {
+    std::cerr << "Error: Could not open " << csv_filepath
+              << " for writing.\n";
+    return false;
+  }
+
+  csv << "op_type,kernel,replicas,cycles,calls_per_second,speedup,"
+         "efficiency\n";
+  // Efficiency sum and weight by op type and replica count
+  std::map<std::pair<std::string, unsigned int>, std::pair<double, double>>
+      op_efficiency;
+  bool timed = false;
+  for (const KernelTask &task : tasks) {
+    auto base = task.average_metrics.find("seconds");
+    for (const auto &[replicas, samples] : task.replica_results) {
+      // Per replica means of seconds, summed as rates
+      std::map<double, std::pair<double, size_t>> seconds_of;
+      double cycles = 0.0;
+      size_t cycle_samples = 0;
+      for (const std::map<std::string, double> &sample : samples) {
+        auto replica = sample.find("replica");
+        auto seconds = sample.find("seconds");
+        if (replica != sample.end() && seconds != sample.end()) {
+          seconds_of[replica->second].first += seconds->second;
+          seconds_of[replica->second].second++;
+        }
+        if (auto cycle = sample.find("cycles"); cycle != sample.end()) {
+          cycles += cycle->second;
+          cycle_samples++;
+        }
+      }
+      double calls_per_second = 0.0;
+      for (const auto &[replica, sum] : seconds_of)
+        if (sum.first > 0.0)
+          calls_per_second += sum.second / sum.first;
+
+      csv << task.op_type << ","
+          << fs::path(task.mlir_filepath).filename().generic_string() << ","
+          << replicas << ",";
+      if (cycle_samples)
+        csv << cycles / cycle_samples;
+      csv << ",";
+      if (calls_per_second > 0.0) {
+        timed = true;
+        csv << calls_per_second;
+        if (base != task.average_metrics.end() && base->second > 0.0) {
+          double speedup = calls_per_second * base->second;
+          csv << "," << speedup << "," << speedup / replicas;
+          auto &[sum, weight] = op_efficiency[{task.op_type, replicas}];
+          sum += speedup / replicas * task.multiplicity;
+          weight += task.multiplicity;
+        } else {
+          csv << ",,";
+        }
+      } else {
+        csv << ",,";
+      }
+      csv << "\n";
+    }
+  }
+  for (const auto &[key, efficiency] : op_efficiency)
+    if (efficiency.second > 0.0)
+      csv << key.first << ",all," << key.second << ",,,,"
+          << efficiency.first / efficiency.second << "\n";
+  if (!timed)
+    std::cerr << "replica_scaling.csv needs the seconds metric for "
+                 "throughput, only cycles were written\n";
+  return true;
+}
+
+/*
+ * Prints the per-run table for a kernel and records its samples in the
+ * results store. With --csv-export they are also written to
+ * <output-dir>/timings/<op_type>/<kernel><variant>.csv. Variants are ".cold"
+ * for the cold cache samples of --cache-mode=both, ".layout-<name>" for
+ * --layout-sweep, ".threads-<n>" for --thread-sweep, ".density-<d>" for
+ * --density-sweep and ".profile-<name>" for --profile-sweep. Averages go to
+ * `averages` (task.average_metrics if null). The outlier settings, primary
+ * metric and build annotations are those of `manager`.
+ */
+static bool report_kernel_results(
+    CommandManager &manager, KernelTask &task,
+    const std::vector<std::map<std::string, double>> &results,
+    const std::vector<std::string> &report_metrics,
+    const std::string &outputFolderPath, const std::string &variant = "",
+    std::map<std::string, double> *averages_out = nullptr) {
+  std::map<std::string, double> &averages =
+      averages_out ? *averages_out : task.average_metrics;
+  const std::string csv_extension = variant + ".csv";
+  if (!variant.empty())
+    std::cout << "Samples of " << variant.substr(1) << ":\n";
+
+  // Each run
+
+  std::cout << std::left << std::setw(6) << "Run";
+  for (const auto &e : report_metrics)
+    std::cout << std::setw(20) << e;
+  std::cout << "\n";
+
+  for (size_t i = 0; i < results.size(); ++i) {
+    std::cout << std::left << std::setw(6) << (i + 1);
+    for (const auto &e : report_metrics) {
+      double val = results[i].count(e) ? results[i].at(e) : 0.0;
+      std::cout << std::setw(20) << val;
+    }
+    std::cout << "\n";
+  }
+
+  // --- Compute and print averages ---
+  std::cout << std::string(6 + 20 * report_metrics.size(), '-') << "\n";
+  std::cout << std::left << std::setw(6) << "Avg";
+
+  // --outlier-rejection looks at the primary metric, a rejected sample is
+  // left out of every metric's average and statistics
+  const OutlierConfig &outliers = manager.get_outlier_config();
+  const std::string primary_metric = manager.get_primary_metric();
+  std::vector<double> primary_values;
+  for (const auto &r : results)
+    primary_values.push_back(r.count(primary_metric) ? r.at(primary_metric)
+                                                     : 0.0);
+  std::vector<bool> rejected =
+      Statistics::find_outliers(primary_values, outliers);
+  std::vector<std::pair<size_t, double>> rejected_samples;
+  for (size_t i = 0; i < results.size(); ++i)
+    if (rejected[i])
+      rejected_samples.emplace_back(i + 1, primary_values[i]);
+  task.rejected_samples.erase(variant);
+  if (!rejected_samples.empty())
+    task.rejected_samples[variant] = rejected_samples;
+
+  // Adaptive sampling makes the sample count vary per kernel
+  size_t sample_count =
+      std::max<size_t>(1, results.size() - rejected_samples.size());
+  std::map<std::string, double> sums;
+  std::map<std::string, std::vector<double>> kept;
+  for (size_t i = 0; i < results.size(); ++i)
+    if (!rejected[i])
+      for (const auto &kv : results[i]) {
+        sums[kv.first] += kv.second;
+        kept[kv.first].push_back(kv.second);
+      }
+
+  for (const auto &e : report_metrics) {
+    averages[e] = sums[e] / sample_count;
+    std::cout << std::setw(20) << averages[e];
+  }
+  std::cout << "\n";
+
+  std::map<std::string, SampleSummary> summaries;
+  for (const auto &e : report_metrics)
+    summaries[e] =
+        Statistics::summarize(kept[e], outliers.bootstrap_resamples);
+  for (auto [label, statistic] :
+       std::initializer_list<std::pair<const char *, double SampleSummary::*>>{
+           {"Med", &SampleSummary::median},
+           {"Min", &SampleSummary::min},
+           {"P90", &SampleSummary::p90},
+           {"P99", &SampleSummary::p99},
+           {"Std", &SampleSummary::stddev},
+           {"MAD", &SampleSummary::mad}}) {
+    std::cout << std::setw(6) << label;
+    for (const auto &e : report_metrics)
+      std::cout << std::setw(20) << summaries[e].*statistic;
+    std::cout << "\n";
+  }
+  const SampleSummary &primary = summaries[primary_metric];
+  std::cout << "95% bootstrap interval of the mean " << primary_metric
+            << ": [" << primary.ci95_low << ", " << primary.ci95_high
+            << "]\n";
+  if (!rejected_samples.empty()) {
+    std::cout << "Rejected by " << Statistics::describe(outliers.method)
+              << ":";
+    for (const auto &[sample, value] : rejected_samples)
+      std::cout << " #" << sample << " (" << value << ")";
+    std::cout << "\n";
+  }
+  if (!averages_out)
+    task.sample_summaries = summaries;
+  if (task.multiplicity > 1)
+    std::cout << "Occurrences in model: " << task.multiplicity << "\n";
+
+  const std::vector<std::pair<std::string, std::string>> build =
+      manager.get_run_annotations();
+  ResultsStore::record_samples(task, variant, results, build);
+  ResultsStore::record_statistics(task, variant, summaries, rejected_samples);
+  if (variant.empty() && !task.warmup_results.empty())
+    ResultsStore::record_samples(task, ".warmup", task.warmup_results, build);
+  if (!ResultsStore::is_csv_export()) {
+    std::cout << "\n\n";
+    return true;
+  }
+
+  // --- Write results to CSV ---
+  fs::path csvOutputPath = fs::path(outputFolderPath)
+                               .append("timings")
+                               .append(task.op_type)
+                               .append(fs::path(task.mlir_filepath)
+                                           .replace_extension()
+                                           .filename()
+                                           .generic_string())
+                               .replace_extension(csv_extension);
+  // Build configuration, repeated on every row
+  std::vector<std::pair<std::string, std::string>> annotations = build;
+  if (variant.rfind(".layout-", 0) == 0)
+    for (auto &[column, value] : annotations)
+      if (column == "input_layout")
+        value = variant.substr(8);
+  if (!task.node.empty()) {
+    annotations.emplace_back("node", task.node);
+    annotations.emplace_back("node_fingerprint", task.node_fingerprint);
+  }
+
+  // Rendered here, written (and its folder created) by the result writer.
+  // Deduplicated kernels share the samples but keep their own model layer.
+  bool rejecting = outliers.method != OutlierMethod::NONE;
+  auto render_csv = [&](const fs::path &kernel_filepath) {
+    std::vector<std::pair<std::string, std::string>> row_annotations =
+        annotations;
+    const ModelLayer *layer = ModelLayers::find(kernel_filepath);
+    row_annotations.emplace_back(
+        "layer_index", layer ? std::to_string(layer->index) : "");
+    row_annotations.emplace_back("layer_name", layer ? layer->name : "");
+    if (task.predicted_cost > 0.0)
+      row_annotations.emplace_back("predicted_cost",
+                                   std::to_string(task.predicted_cost));
+    // Duplicates have the same structure, they hash the same
+    for (auto &column : LinalgStructures::annotations(task.mlir_filepath))
+      row_annotations.push_back(column);
+
+    std::ostringstream csv;
+    // Header
+    csv << "Run";
+    for (const auto &e : report_metrics)
+      csv << "," << e;
+    if (rejecting)
+      csv << ",rejected";
+    for (const auto &[column, value] : row_annotations)
+      csv << "," << column;
+    csv << "\n";
+
+    // Data rows
+    for (size_t i = 0; i < results.size(); ++i) {
+      csv << (i + 1);
+      for (const auto &e : report_metrics) {
+        double val = results[i].count(e) ? results[i].at(e) : 0.0;
+        csv << "," << val;
+      }
+      if (rejecting)
+        csv << "," << (rejected[i] ? 1 : 0);
+      for (const auto &[column, value] : row_annotations)
+        csv << "," << value;
+      csv << "\n";
+    }
+
+    // Average row
+    csv << "Average";
+    for (const auto &e : report_metrics)
+      csv << "," << (sums[e] / sample_count);
+    if (rejecting)
+      csv << "," << rejected_samples.size();
+    for (const auto &[column, value] : row_annotations)
+      csv << "," << value;
+    csv << "\n";
+    return csv.str();
+  };
+
+  ResultWriter::write(csvOutputPath, render_csv(task.mlir_filepath));
+  task.result_filepaths.push_back(csvOutputPath);
+  std::cout << "\nResults queued for " + csvOutputPath.generic_string() +
+                   " ✅\n";
+
+  // Robust statistics of the kept samples, one row per metric
+  fs::path statsCsvPath = fs::path(csvOutputPath)
+                              .replace_extension()
+                              .concat(".stats.csv");
+  std::ostringstream stats_csv;
+  stats_csv << "metric,samples,mean,median,min,max,p90,p99,stddev,mad,"
+               "ci95_low,ci95_high\n";
+  for (const auto &[metric, s] : summaries)
+    stats_csv << metric << "," << s.count << "," << s.mean << "," << s.median
+              << "," << s.min << "," << s.max << "," << s.p90 << "," << s.p99
+              << "," << s.stddev << "," << s.mad << "," << s.ci95_low << ","
+              << s.ci95_high << "\n";
+  ResultWriter::write(statsCsvPath, stats_csv.str());
+  task.result_filepaths.push_back(statsCsvPath);
+
+  // Warmup runs are kept out of the averages above
+  if (variant.empty() && !task.warmup_results.empty()) {
+    fs::path warmupCsvPath =
+        fs::path(csvOutputPath).replace_extension(".warmup.csv");
+    std::ostringstream warmup_csv;
+    warmup_csv << "Warmup";
+    for (const auto &e : manager.get_report_metrics())
+      warmup_csv << "," << e;
+    warmup_csv << "\n";
+    for (size_t i = 0; i < task.warmup_results.size(); ++i) {
+      warmup_csv << (i + 1);
+      for (const auto &e : manager.get_report_metrics())
+        warmup_csv << ","
+                   << (task.warmup_results[i].count(e)
+                           ? task.warmup_results[i].at(e)
+                           : 0.0);
+      warmup_csv << "\n";
+    }
+    ResultWriter::write(warmupCsvPath, warmup_csv.str());
+    task.result_filepaths.push_back(warmupCsvPath);
+    std::cout << task.warmup_results.size() << " warmup runs written to "
+              << warmupCsvPath.generic_string() << "\n";
+  }
+
+  // Per CPU averages of parallel kernels (--thread-counting=per-core)
+  std::map<int, std::map<std::string, double>> core_averages;
+  for (const auto &[key, sum] : sums) {
+    size_t at = key.find("@cpu");
+    if (at != std::string::npos)
+      core_averages[std::stoi(key.substr(at + 4))][key.substr(0, at)] =
+          sum / sample_count;
+  }
+  if (!core_averages.empty()) {
+    fs::path coresCsvPath =
+        fs::path(csvOutputPath).replace_extension(".cores.csv");
+    std::ostringstream cores_csv;
+    const std::map<std::string, double> &first = core_averages.begin()->second;
+    cores_csv << "cpu";
+    for (const auto &[metric, value] : first)
+      cores_csv << "," << metric;
+    cores_csv << "\n";
+    for (const auto &[core, averages] : core_averages) {
+      cores_csv << core;
+      for (const auto &[metric, value] : first)
+        cores_csv << ","
+                  << (averages.count(metric) ? averages.at(metric) : 0.0);
+      cores_csv << "\n";
+    }
+    ResultWriter::write(coresCsvPath, cores_csv.str());
+    task.result_filepaths.push_back(coresCsvPath);
+    std::cout << "Per CPU breakdown written to "
+              << coresCsvPath.generic_string() << "\n";
+  }
+
+  // Deduplicated kernels share the representative's results
+  for (const fs::path &duplicate : task.duplicate_filepaths) {
+    fs::path duplicateCsvPath =
+        fs::path(csvOutputPath)
+            .replace_filename(
+                fs::path(duplicate).replace_extension().filename())
+            .replace_extension(csv_extension);
+    ResultWriter::write(duplicateCsvPath, render_csv(duplicate));
+    task.result_filepaths.push_back(duplicateCsvPath);
+  }
+  std::cout << "\n\n";
+  return true;
+}
+
+// Every sample a kernel's measurement collected, for progress reports
+static size_t sample_count(const SandboxResult &measured) {
+  size_t count =
+      measured.samples.size() + measured.warmup.size() + measured.cold.size();
+  for (const auto *variants :
+       {&measured.layouts, &measured.densities, &measured.profiles,
+        &measured.pipelines, &measured.baselines, &measured.contentions,
+        &measured.shapes})
+    for (const auto &[name, samples] : *variants)
+      count += samples.size();
+  for (const auto &[threads, samples] : measured.threads)
+    count += samples.size();
+  for (const auto &[replicas, samples] : measured.replicas)
+    count += samples.size();
+  return count;
+}
+
+/*
+ * Samples of the primary and the comparison pipelines (--pipeline given more
+ * than once), alternating in rounds that each take an equal share of the
+ * samples. Odd rounds run the pipelines in reverse order (A B, B A, ...), so
+ * frequency and thermal drift hit all of them alike. Adaptive stopping is
+ * off, every pipeline gets the same sample count.
+ */
+static void measure_interleaved(CommandManager &manager, KernelTask &task,
+                                SandboxResult &measured,
+                                unsigned int sample_count, unsigned int rounds,
+                                const SamplingConfig &sampling) {
+  rounds = rounds ? std::min(rounds, sample_count) : sample_count;
+  rounds = std::max(1u, rounds);
+  unsigned int per_round = (sample_count + rounds - 1) / rounds;
+  SamplingConfig fixed = sampling;
+  fixed.target_ci = 0.0;
+  fixed.max_seconds = 0.0;
+  manager.set_sampling_config(fixed);
+  manager.set_perf_sample_run_count(per_round);
+
+  // Pipelines that failed to compile the kernel sit out
+  std::vector<const PipelineSpec *> order = {&manager.get_primary_pipeline()};
+  for (const PipelineSpec &pipeline : manager.get_comparison_pipelines())
+    if (task.pipeline_ll_filepaths.count(pipeline.label))
+      order.push_back(&pipeline);
+
+  for (unsigned int round = 0; round < rounds; round++) {
+    std::cout << "Round " << (round + 1) << "/" << rounds << "\n";
+    for (size_t k = 0; k < order.size(); k++) {
+      const PipelineSpec &pipeline =
+          *order[round % 2 ? order.size() - 1 - k : k];
+      bool primary = &pipeline == order.front();
+      manager.use_pipeline(pipeline);
+      // The prepared kernel and the warmup only serve the first round
+      SampleList cold;
+      SampleList samples =
+          primary ? manager.execute_with_parameters(
+                        task.ll_filepath, task.json_filepath,
+                        round ? nullptr : &task.kernel,
+                        round ? nullptr : &measured.warmup, &cold,
+                        round ? nullptr : &measured.baselines)
+                  : manager.execute_with_parameters(
+                        task.pipeline_ll_filepaths.at(pipeline.label),
+                        task.json_filepath);
+      SampleList &target =
+          primary ? measured.samples : measured.pipelines[pipeline.label];
+      target.insert(target.end(), samples.begin(), samples.end());
+      if (primary)
+        measured.cold.insert(measured.cold.end(), cold.begin(), cold.end());
+    }
+  }
+
+  manager.use_pipeline(manager.get_primary_pipeline());
+  manager.set_sampling_config(sampling);
+  manager.set_perf_sample_run_count(sample_count);
+}
+
+/*
+ * `roofline` subcommand: measures the machine peaks once and places the
+ * kernels of finished runs (one output directory per pipeline) under them
+ */
+static int run_roofline(int argc, char **args) {
+  argparse::ArgumentParser program("roofline", "1.0",
+                                   argparse::default_arguments::all, false);
+
+  program.add_argument("output-dirs")
+      .help("Output directories of finished runs, e.g. one per pipeline")
+      .nargs(argparse::nargs_pattern::at_least_one);
+
+  program.add_argument("--measure-cpu")
+      .help("First CPU the peak microkernels are pinned to (-1 = last "
+            "online CPU)")
+      .default_value(-1)
+      .scan<'i', int>();
+
+  program.add_argument("--threads")
+      .help("Threads running the peak microkernels, on consecutive CPUs. "
+            "Match the kernels' thread count")
+      .default_value(1)
+      .scan<'i', int>();
+
+  program.add_argument("--peaks")
+      .help("machine_peaks.json of an earlier measurement to reuse instead "
+            "of measuring")
+      .default_value(std::string(""));
+
+  if (std::optional<int> status = parse_arguments(program, argc, args))
+    return *status;
+
+  MachinePeaks peaks;
+  std::string peaks_filepath = program.get<std::string>("--peaks");
+  if (!peaks_filepath.empty()) {
+    if (!Roofline::read_peaks(peaks_filepath, peaks)) {
+      std::cerr << "Could not read machine peaks from " << peaks_filepath
+                << "\n";
+      return 1;
+    }
+  } else {
+    int cpu = program.get<int>("--measure-cpu");
+    if (cpu < 0 || cpu >= get_online_cpu_count())
+      cpu = get_online_cpu_count() - 1;
+    peaks = Roofline::measure_peaks(cpu, program.get<int>("--threads"));
+  }
+
+  size_t placed = 0;
+  for (const std::string &output_dir :
+       program.get<std::vector<std::string>>("output-dirs"))
+    placed += Roofline::write_roofline(output_dir, peaks);
+  return placed ? 0 : 1;
+}
+
+// serve [--socket <path>] [--workspace <dir>] [-- <arguments of every job>]
+static int run_server(int argc, char **args) {
+  argparse::ArgumentParser program("serve", "1.0",
+                                   argparse::default_arguments::all, false);
+
+  program.add_argument("--socket")
+      .help("Unix socket to accept jobs on")
+      .default_value(std::string("/tmp/mlir-bench.sock"));
+
+  program.add_argument("--workspace")
+      .help("Folder of the jobs' outputs and of the shared input cache")
+      .default_value(fs::current_path().append("server").string());
+
+  ServerConfig config;
+  int server_argc = argc;
+  for (int i = 1; i < argc; i++)
+    if (std::string(args[i]) == "--") {
+      config.default_args.assign(args + i + 1, args + argc);
+      server_argc = i;
+      break;
+    }
+
+  if (std::optional<int> status = parse_arguments(program, server_argc, args))
+    return *status;
+
+  config.socket_path = program.get<std::string>("--socket");
+  config.workspace = program.get<std::string>("--workspace");
+  return BenchmarkServer(config).serve() ? 0 : 1;
+}
+
+/*
+ * `compare` subcommand: significance test of every kernel present in two
+ * result sets. Exits 2 when a regression fails the threshold, so it can gate
+ * a pass change.
+ */
+static int run_compare(int argc, char **args) {
+  argparse::ArgumentParser program("compare", "1.0",
+                                   argparse::default_arguments::all, false);
+
+  program.add_argument("baseline")
+      .help("Output directory of the baseline run");
+
+  program.add_argument("candidate")
+      .help("Output directory of the run to check against it");
+
+  program.add_argument("--metrics")
+      .help("Metrics to compare (default: the baseline's primary metric)")
+      .nargs(argparse::nargs_pattern::any)
+      .default_value(std::vector<std::string>{});
+
+  program.add_argument("--test")
+      .help("Significance test per kernel and metric")
+      .default_value(std::string("mann-whitney"))
+      .choices("mann-whitney", "bootstrap");
+
+  program.add_argument("--correction")
+      .help("Adjustment of each metric's p-values across the kernels: holm "
+            "(family-wise error), bh (Benjamini-Hochberg false discovery "
+            "rate) or none")
+      .default_value(std::string("holm"))
+      .choices("holm", "bh", "none");
+
+  program.add_argument("--alpha")
+      .help("Significance level")
+      .default_value(0.05)
+      .scan<'g', double>();
+
+  program.add_argument("--threshold")
+      .help("Relative slowdown (0.05 = 5%) of a significant regression that "
+            "fails the comparison")
+      .default_value(0.05)
+      .scan<'g', double>();
+
+  program.add_argument("--bootstrap-resamples")
+      .help("Resamples of the bootstrap test")
+      .default_value(2000)
+      .scan<'i', int>();
+
+  program.add_argument("--output")
+      .help("Per kernel CSV (default: <candidate>/comparison.csv)")
+      .default_value(std::string(""));
+
+  if (std::optional<int> status = parse_arguments(program, argc, args))
+    return *status;
+
+  CompareConfig config;
+  config.metrics = program.get<std::vector<std::string>>("--metrics");
+  config.test = program.get<std::string>("--test") == "bootstrap"
+                    ? SignificanceTest::BOOTSTRAP
+                    : SignificanceTest::MANN_WHITNEY;
+  std::string correction = program.get<std::string>("--correction");
+  config.correction = correction == "bh"     ? PCorrection::BENJAMINI_HOCHBERG
+                      : correction == "none" ? PCorrection::NONE
+                                             : PCorrection::HOLM;
+  config.alpha = program.get<double>("--alpha");
+  config.threshold = program.get<double>("--threshold");
+  config.bootstrap_resamples =
+      std::max(1, program.get<int>("--bootstrap-resamples"));
+
+  StoredRun baseline, candidate;
+  for (auto [dir, run] :
+       {std::pair<std::string, StoredRun *>{
+            program.get<std::string>("baseline"), &baseline},
+        {program.get<std::string>("candidate"), &candidate}})
+    if (!ResultsStore::load_samples(dir, *run)) {
+      std::cerr << "No results store in " << dir << "\n";
+      return 1;
+    }
+
+  std::vector<KernelComparison> comparisons =
+      ResultCompare::compare(baseline, candidate, config);
+  ResultCompare::print_summary(comparisons, baseline, candidate, config);
+
+  std::string csv_filepath = program.get<std::string>("--output");
+  if (csv_filepath.empty())
+    csv_filepath = fs::path(program.get<std::string>("candidate"))
+                       .append("comparison.csv")
+                       .string();
+  if (!ResultCompare::write_csv(comparisons, csv_filepath))
+    return 1;
+
+  size_t failures = ResultCompare::count_failures(comparisons, config);
+  if (failures) {
+    std::cerr << failures << " significant regressions above "
+              << config.threshold * 100.0 << "%\n";
+    return 2;
+  }
+  return 0;
+}
+
+// report <output-dir>...: report.html and report.json from results stores
+static int run_report(int argc, char **args) {
+  argparse::ArgumentParser program("report", "1.0",
+                                   argparse::default_arguments::all, false);
+
+  program.add_argument("output-dirs")
+      .help("Output directories of finished runs, the first is the baseline")
+      .nargs(argparse::nargs_pattern::at_least_one);
+
+  program.add_argument("--labels")
+      .help("Names of the output directories (default: folder names)")
+      .nargs(argparse::nargs_pattern::any)
+      .default_value(std::vector<std::string>{});
+
+  program.add_argument("--output")
+      .help("Folder of the report (default: the first output directory)")
+      .default_value(std::string(""));
+
+  if (std::optional<int> status = parse_arguments(program, argc, args))
+    return *status;
+
+  std::vector<fs::path> output_dirs;
+  for (const std::string &dir :
+       program.get<std::vector<std::string>>("output-dirs"))
+    output_dirs.push_back(fs::path(dir).lexically_normal());
+  json report;
+  if (!HtmlReport::build(output_dirs,
+                         program.get<std::vector<std::string>>("--labels"),
+                         report))
+    return 1;
+  std::string folder = program.get<std::string>("--output");
+  return HtmlReport::write(report, folder.empty() ? output_dirs.front()
+                                                  : fs::path(folder))
+             ? 0
+             : 1;
+}
+
+// trend [--db <trends.sqlite>]: a model's performance over toolchain commits
+static int run_trend(int argc, char **args) {
+  argparse::ArgumentParser program("trend", "1.0",
+                                   argparse::default_arguments::all, false);
+
+  program.add_argument("--db")
+      .help("Trend store the runs recorded themselves in (--trend-db)")
+      .default_value(fs::current_path().append("trends.sqlite").string());
+
+  program.add_argument("--metric")
+      .help("Metric to follow (default: the latest run's primary metric)")
+      .default_value(std::string(""));
+
+  program.add_argument("--model")
+      .help("Model name, \"all\" for any (default: the latest run's)")
+      .default_value(std::string(""));
+
+  program.add_argument("--host")
+      .help("Host fingerprint id, \"all\" for any (default: the latest "
+            "run's)")
+      .default_value(std::string(""));
+
+  program.add_argument("--pipeline-hash")
+      .help("Pipeline JSON hash, \"all\" for any (default: the latest "
+            "run's)")
+      .default_value(std::string(""));
+
+  program.add_argument("--op-type")
+      .help("Only this op type's kernels")
+      .default_value(std::string(""));
+
+  program.add_argument("--top")
+      .help("Kernel slowdowns between consecutive commits to list")
+      .default_value(10)
+      .scan<'i', int>();
+
+  program.add_argument("--output-dir")
+      .help("Folder of trend_op_types.csv and trend_kernels.csv")
+      .default_value(fs::current_path().string());
+
+  if (std::optional<int> status = parse_arguments(program, argc, args))
+    return *status;
+
+  TrendQuery query;
+  query.metric = program.get<std::string>("--metric");
+  query.model = program.get<std::string>("--model");
+  query.host = program.get<std::string>("--host");
+  query.pipeline_hash = program.get<std::string>("--pipeline-hash");
+  query.op_type = program.get<std::string>("--op-type");
+  query.top_kernels = std::max(0, program.get<int>("--top"));
+  return TrendStore::report(program.get<std::string>("--db"), query,
+                            program.get<std::string>("--output-dir"))
+             ? 0
+             : 1;
+}
+
+// cost-model <output-dir>...: trains a cost model on finished runs
+static int run_cost_model(int argc, char **args) {
+  argparse::ArgumentParser program("cost-model", "1.0",
+                                   argparse::default_arguments::all, false);
+
+  program.add_argument("output-dirs")
+      .help("Output directories of finished runs to learn from")
+      .nargs(argparse::nargs_pattern::at_least_one);
+
+  program.add_argument("--metric")
+      .help("Metric to predict")
+      .default_value(std::string("cycles"));
+
+  program.add_argument("--ridge")
+      .help("L2 penalty of the weights (the bias is not penalised)")
+      .default_value(1.0)
+      .scan<'g', double>();
+
+  program.add_argument("--output")
+      .help("Model JSON to write, the input of --cost-model")
+      .default_value(fs::current_path().append("cost_model.json").string());
+
+  if (std::optional<int> status = parse_arguments(program, argc, args))
+    return *status;
+
+  std::vector<fs::path> output_dirs;
+  for (const std::string &dir :
+       program.get<std::vector<std::string>>("output-dirs"))
+    output_dirs.push_back(fs::path(dir).lexically_normal());
+  CostModel model;
+  if (!model.train(output_dirs, program.get<std::string>("--metric"),
+                   std::max(0.0, program.get<double>("--ridge"))))
+    return 1;
+  return model.save(program.get<std::string>("--output")) ? 0 : 1;
+}
+
+// convert-model <model> [-o <bytecode>]: one time bytecode conversion
+static int run_convert_model(int argc, char **args) {
+  argparse::ArgumentParser program("convert-model", "1.0",
+                                   argparse::default_arguments::all, false);
+
+  program.add_argument("model-file").help("Textual Torch-MLIR model");
+
+  program.add_argument("-B", "--build-path")
+      .help("Path to a Torch MLIR build, for torch-mlir-opt")
+      .default_value(std::string(""));
+
+  program.add_argument("-o", "--output")
+      .help("Bytecode to write (default: the model with .mlirbc)")
+      .default_value(std::string(""));
+
+  if (std::optional<int> status = parse_arguments(program, argc, args))
+    return *status;
+
+  fs::path model_filepath = program.get<std::string>("model-file");
+  if (ModelSource::is_bytecode(model_filepath)) {
+    std::cerr << model_filepath << " already is bytecode\n";
+    return 1;
+  }
+  fs::path bytecode_filepath = program.get<std::string>("--output");
+  if (bytecode_filepath.empty())
+    bytecode_filepath = fs::path(model_filepath).replace_extension(".mlirbc");
+  fs::path build_path = program.get<std::string>("--build-path");
+  ModelSource::set_torch_opt(build_path.append("bin/torch-mlir-opt"));
+  if (!ModelSource::convert(model_filepath, bytecode_filepath))
+    return 1;
+  std::error_code ec;
+  std::cout << "Wrote " << bytecode_filepath << " ("
+            << fs::file_size(bytecode_filepath, ec) / (1024 * 1024)
+            << " MiB, from " << fs::file_size(model_filepath, ec) / (1024 * 1024)
+            << " MiB of text)\n";
+  return 0;
+}
+
+/*
+ * A benchmark run of a model, in the steps run_benchmark takes them:
+ * parse_options reads the command line and configures the modules,
+ * prepare_kernels isolates the model and builds the task list (variants,
+ * selection, resumed and distributed kernels), compile_and_measure hands
+ * the tasks to the KernelScheduler and report_results writes the model
+ * wide summaries. Compilation and measurement share a step since the
+ * scheduler pipelines them. What more than one step needs is a member.
+ * The options configure `manager`, which builds and measures the kernels.
+ */
+class BenchmarkRun {
+public:
+  explicit BenchmarkRun(CommandManager &manager) : manager(manager) {}
+
+  // A status when the run ends here (help, bad options), nullopt to go on
+  std::optional<int> parse_options(int argc, char **args);
+  // --worker: measures a coordinator's shard instead of a model
+  bool is_worker() const { return !worker_shard.empty(); }
+  int measure_shard();
+  std::optional<int> prepare_kernels();
+  void compile_and_measure();
+  int report_results();
+
+  double fsync_interval() { return program.get<double>("--fsync-interval"); }
+
+private:
+  // Measures a prepared kernel, false (with task.failure) if its sandboxed
+  // worker process died
+  bool measure_task(KernelTask &task, SandboxResult &measured);
+  void report_task(KernelTask &task, SandboxResult &measured);
+
+  CommandManager &manager;
+  argparse::ArgumentParser program{"torch-metric-collector", "1.0",
+                                   argparse::default_arguments::all, false};
+
+  // Options, read once by parse_options
+  std::string buildPath;
+  std::string model_file;
+  std::string outputFolderPath;
+  std::string pipelineJsonPath;
+  std::vector<fs::path> comparison_pipelines;
+  bool out_params = false;
+  bool pgo = false;
+  PipelineTemplate sweep;
+  std::map<std::string, std::vector<std::string>> sweep_points;
+  std::string resume_dir;
+  std::string only_changed;
+  fs::path worker_shard;
+  DistributedConfig distributed;
+  MetadataSource metadata_source;
+  ScheduleMode schedule_mode;
+  int jobs = 1;
+  int queue_depth = 1;
+  bool isolate_kernels = false;
+  double kernel_timeout = 0.0;
+  bool enable_dedup = true;
+  int sample_run_count = 0;
+  unsigned int interleave_rounds = 0;
+  SamplingConfig sampling;
+  OutlierConfig outlier_config;
+  ProfileConfig profile_config;
+  CacheMode cache_mode;
+  LayoutKind input_layout;
+  InputProfile input_profile;
+  uint64_t input_seed = 0;
+  unsigned int call_latency_calls = 0;
+  std::vector<TorchMode> torch_baselines;
+  fs::path scratch_folder;
+
+  // Sweeps and kernel variants
+  std::vector<LayoutKind> layout_sweep;
+  std::vector<unsigned int> thread_sweep;
+  std::vector<unsigned int> replica_sweep;
+  std::vector<std::pair<std::string, float>> density_sweep;
+  std::vector<DataProfile> profile_sweep;
+  std::vector<ContentionProfile> contention_profiles;
+  std::vector<ShapeScale> shape_sweep;
+  bool dynamic_shapes = false;
+  std::vector<CacheLevel> caches;
+  std::set<std::string> working_set_ops;
+  std::vector<DataOrder> data_order_sweep;
+  std::set<std::string> data_order_ops;
+  ConstantArgsSpec const_args;
+  std::map<size_t, SparseArgument> sparse_args;
+  std::set<std::string> sparse_ops;
+  FusionSpec fusion;
+
+  // Removed with the run, on every return
+  std::unique_ptr<ScopedDirectory> temporary_input_cache;
+  std::unique_ptr<ScopedDirectory> scratch_cleanup;
+
+  std::vector<std::string> report_metrics;
+  std::unique_ptr<KernelManifest> kernel_manifest;
+  std::unique_ptr<KernelManifest> previous_manifest;
+
+  // Kernels, from prepare_kernels on
+  std::vector<KernelTask> tasks;
+  std::set<std::string> operation_types;
+  int measure_cpu = -1;
+  double time_budget = 0.0;
+  bool sample_kernels = false;
+  SamplePlan sample_plan;
+  bool sample_validation = false;
+  fs::path sampling_state;
+  std::string sampling_model;
+  CostModel cost_model;
+  std::vector<KernelTask> resumed_tasks;
+  // Positions in tasks of the kernels measured on this machine
+  std::vector<size_t> local_indices;
+  std::vector<KernelTask> local_tasks;
+  bool reporting_failed = false;
+};
+
+std::optional<int> BenchmarkRun::parse_options(int argc, char **args) {
+  program.add_argument("-B", "--build-path")
+      .help("Path to a Torch MLIR build")
+      .required();
+
+  program.add_argument("--output-dir")
+      .help("Folder path to contain the output produced by the tool. "
+            "Must be an absolute path")
+      .default_value(fs::current_path().append(get_timestamp_string()));
+
+  program.add_argument("--pass-logs")
+      .help("Enables Pass lowering output in temp folder")
+      .default_value(false);
+
+  program.add_argument("--sample-count")
+      .help("No of sample runs for each kernel for aggregation. With "
+            "--target-ci this is the minimum sample count")
+      .default_value(8)
+      .scan<'i', int>();
+
+  program.add_argument("--target-ci")
+      .help("Keep sampling until the 95% confidence interval of the primary "
+            "metric is within this relative width, e.g. '1%' or 0.01")
+      .default_value(std::string("0"));
+
+  program.add_argument("--max-samples")
+      .help("Upper bound on samples per kernel with --target-ci")
+      .default_value(10000)
+      .scan<'i', int>();
+
+  program.add_argument("--min-window-ms")
+      .help("Calibrates an inner repetition count so that every counter "
+            "window lasts at least this long (0 = one call per window). "
+            "Metrics are reported per call")
+      .default_value(0.0)
+      .scan<'g', double>();
+
+  program.add_argument("--max-inner-repetitions")
+      .help("Upper bound on calls per counter window with --min-window-ms")
+      .default_value(1000000)
+      .scan<'i', int>();
+
+  program.add_argument("--outlier-rejection")
+      .help("Leaves samples out of the averages when their primary metric is "
+            "an outlier: 'mad' (modified z-score) or 'iqr' (Tukey fences). "
+            "Rejected samples are listed in rejected_samples.csv")
+      .default_value(std::string("none"))
+      .choices("none", "mad", "iqr");
+
+  program.add_argument("--outlier-threshold")
+      .help("Modified z-score above which 'mad' rejects (default 3.5), or "
+            "IQRs beyond the quartiles for 'iqr' (default 1.5)")
+      .default_value(0.0)
+      .scan<'g', double>();
+
+  program.add_argument("--bootstrap-resamples")
+      .help("Resamples behind the bootstrap confidence interval of every "
+            "metric's mean (0 = off)")
+      .default_value(1000)
+      .scan<'i', int>();
+
+  program.add_argument("--call-overhead")
+      .help("Calibrates the cost of one measured call with an empty kernel "
+            "called the same way: 'measure' records it next to every "
+            "sample, 'subtract' also takes it off the perf metrics and "
+            "keeps the counted values as <metric>_raw")
+      .default_value(std::string("measure"))
+      .choices("off", "measure", "subtract");
+
+  program.add_argument("--noise-monitor")
+      .help("Records interrupts, page faults, context switches, effective "
+            "frequency and package temperature around every sample: 'mark' "
+            "flags samples past the --noise-* limits, 'retry' runs them again")
+      .default_value(std::string("off"))
+      .choices("off", "mark", "retry");
+
+  program.add_argument("--noise-retries")
+      .help("Extra windows per noisy sample with --noise-monitor retry")
+      .default_value(3)
+      .scan<'i', int>();
+
+  program.add_argument("--noise-max-irqs")
+      .help("Device interrupts on the measuring core per window before a "
+            "sample is noisy (negative = unchecked)")
+      .default_value(0.0)
+      .scan<'g', double>();
+
+  program.add_argument("--noise-max-freq-drop")
+      .help("Relative drop of the effective frequency below the kernel's "
+            "fastest window before a sample is noisy (negative = unchecked)")
+      .default_value(0.03)
+      .scan<'g', double>();
+
+  program.add_argument("--noise-max-temp")
+      .help("Package temperature in degrees C above which a sample is noisy "
+            "(negative = unchecked)")
+      .default_value(-1.0)
+      .scan<'g', double>();
+
+  program.add_argument("--noise-max-page-faults")
+      .help("Page faults per window before a sample is noisy (negative = "
+            "unchecked)")
+      .default_value(-1.0)
+      .scan<'g', double>();
+
+  program.add_argument("--energy")
+      .help("Records RAPL package, core and DRAM energy per kernel call and "
+            "GFLOP/J (perf power PMU, else powercap)")
+      .flag();
+
+  program.add_argument("--energy-min-window-ms")
+      .help("Shortest energy window with --energy, kernel calls are repeated "
+            "inside a sample until it is reached")
+      .default_value(10.0)
+      .scan<'g', double>();
+
+  program.add_argument("--energy-idle-ms")
+      .help("Idle window before each kernel's samples whose power "
+            "energy_net_j subtracts (0 = none)")
+      .default_value(50.0)
+      .scan<'g', double>();
+
+  program.add_argument("--dram-traffic")
+      .help("Count DRAM reads and writes on the package's uncore memory "
+            "controllers around every sample (dram_* columns)")
+      .flag();
+
+  program.add_argument("--vectorization-report")
+      .help("Count vector vs scalar FP ops in each kernel's LLVM IR and "
+            "object, with the hot loop's instruction mix, as vec_* columns "
+            "and <kernel>.vectorization.json")
+      .flag();
+
+  program.add_argument("--code-footprint")
+      .help("Record each kernel object's .text size, basic blocks and static "
+            "instruction mix as code_* columns and correlate them with "
+            "L1-icache-load-misses in code_footprint.csv")
+      .flag();
+
+  program.add_argument("--html-report")
+      .help("Write report.html and report.json to the output folder once "
+            "the run is done (see the report subcommand)")
+      .flag();
+
+  program.add_argument("--trend-db")
+      .help("Trend store the finished run is recorded in, with its "
+            "toolchain commits (default: trends.sqlite next to the output "
+            "folder, \"none\" to skip)")
+      .default_value(std::string(""));
+
+  program.add_argument("--fsync-interval")
+      .help("Seconds between syncs of the result files written in the "
+            "background (0 = only at the end of the run)")
+      .default_value(1.0)
+      .scan<'g', double>();
+
+  program.add_argument("--progress")
+      .help("Progress events as JSON lines: a file to append to, or "
+            "unix:<path> of a listening socket")
+      .default_value(std::string(""));
+
+  program.add_argument("--progress-interval")
+      .help("Seconds between progress events")
+      .default_value(10.0)
+      .scan<'g', double>();
+
+  program.add_argument("--metrics-listen")
+      .help("[address:]port serving Prometheus metrics (/metrics) and the "
+            "latest progress event (/progress) during the run")
+      .default_value(std::string(""));
+
+  program.add_argument("--cost-model")
+      .help("Cost model JSON (see the cost-model subcommand): kernels are "
+            "measured by predicted cost first and checked against it")
+      .default_value(std::string(""));
+
+  program.add_argument("--cost-model-tolerance")
+      .help("Residual deviations between a measurement and its prediction "
+            "before the kernel is flagged")
+      .default_value(3.0)
+      .scan<'g', double>();
+
+  program.add_argument("--time-budget")
+      .help("Compilation and measurement time (600, 90s, 10m, 1h) after "
+            "which the remaining kernels are skipped, the kernels with the "
+            "highest priority go first (0 = unlimited)")
+      .default_value(std::string("0"));
+
+  program.add_argument("--ops")
+      .help("Comma separated op types to benchmark, each matching the op "
+            "names it starts (conv,matmul), default all")
+      .default_value(std::string(""));
+
+  program.add_argument("--max-kernels-per-op")
+      .help("Unique kernels of each op type to benchmark, those with the "
+            "highest priority (0 = all)")
+      .default_value(0)
+      .scan<'i', int>();
+
+  program.add_argument("--priority-from")
+      .help("Output directory of an earlier run, whose measurements "
+            "prioritise the kernels instead of their FLOPs")
+      .default_value(std::string(""));
+
+  program.add_argument("--sample-kernels")
+      .help("Benchmarks a representative sample of the unique kernels, a "
+            "fraction (0.2) or a count (40), and extrapolates the model "
+            "totals with 95% bounds (sample_extrapolation.csv)")
+      .default_value(std::string(""));
+
+  program.add_argument("--sample-validate-every")
+      .help("Every this many --sample-kernels runs of a model measure all "
+            "kernels and report the extrapolation's error "
+            "(sample_validation.csv), 0 never")
+      .default_value(10)
+      .scan<'i', int>();
+
+  program.add_argument("--max-time-per-kernel")
+      .help("Sampling time budget per kernel in seconds (0 = unlimited)")
+      .default_value(0.0)
+      .scan<'g', double>();
+
+  program.add_argument("--measure-cpu")
+      .help("CPU the measurement thread is pinned to. Compilation workers "
+            "never use it (-1 = last online CPU)")
+      .default_value(-1)
+      .scan<'i', int>();
+
+  program.add_argument("--sched-fifo")
+      .help("Runs the measurement thread under SCHED_FIFO while sampling "
+            "(requires root)")
+      .flag();
+
+  program.add_argument("--call-interface")
+      .help("'trampoline' calls kernels through a generated typed wrapper "
+            "around MLIR's C interface, 'ffi' through libffi")
+      .default_value(std::string("trampoline"))
+      .choices("trampoline", "ffi");
+
+  program.add_argument("--counter-mode")
+      .help("'session' opens counters once per kernel, 'live' reads them "
+            "from user space via rdpmc, 'per-sample' opens new counters for "
+            "every sample")
+      .default_value(std::string("session"))
+      .choices("session", "live", "per-sample");
+
+  program.add_argument("--counter-batches")
+      .help("Split more PMU events than the CPU has counters into batches, "
+            "each counted in its own window per sample and anchored on "
+            "cycles: 'off' (the kernel multiplexes them), 'auto' (the "
+            "CPU's general purpose counters) or a number of counters")
+      .default_value(std::string("off"));
+
+  program.add_argument("--thread-counting")
+      .help("Threads the counters cover: 'calling' (the calling thread), "
+            "'inherit' (plus threads spawned by the kernel) or 'per-core' "
+            "(system wide counters per CPU, reports load imbalance)")
+      .default_value(std::string("calling"))
+      .choices("calling", "inherit", "per-core");
+
+  program.add_argument("--cache-mode")
+      .help("'warm' reruns kernels on cached inputs, 'cold' flushes the "
+            "caches before every sample, 'both' reports both")
+      .default_value(std::string("warm"))
+      .choices("warm", "cold", "both");
+
+  program.add_argument("--isolation")
+      .help("'fork' measures every kernel in a forked worker so that a "
+            "crashing kernel doesn't end the run, 'none' measures in process")
+      .default_value(std::string("fork"))
+      .choices("fork", "none");
+
+  program.add_argument("--kernel-timeout")
+      .help("Seconds a forked measurement may take before it is killed "
+            "(0 = no limit)")
+      .default_value(600.0)
+      .scan<'g', double>();
+
+  program.add_argument("--track-allocations")
+      .help("Instruments the kernels' malloc/aligned_alloc/free calls and "
+            "reports allocation count, bytes, peak live bytes and page "
+            "faults per run")
+      .flag();
+
+  program.add_argument("--profile")
+      .help("Comma separated sampling profiles run after every kernel's "
+            "measured samples: 'hotspots' writes <kernel>.hotspots.txt "
+            "(sample shares per symbol and annotated disassembly), "
+            "'flamegraph' writes folded call stacks under flamegraphs/ and "
+            "a model level flamegraphs/model.folded, 'memory' samples load "
+            "latency events and writes <kernel>.memory.csv (cache level and "
+            "latency of the accesses to each input), 'latency' writes a "
+            "load latency histogram per memory level to "
+            "<kernel>.latency.csv, 'branches' samples LBR branch stacks "
+            "and writes loop trip counts to <kernel>.loops.csv and "
+            "mispredicted branches to <kernel>.mispredicts.csv, "
+            "'perf-data' writes the "
+            "samples to <kernel>.perf.data for perf report")
+      .default_value(std::string("none"));
+
+  program.add_argument("--profile-seconds")
+      .help("Seconds each kernel runs under the --profile sampler")
+      .default_value(0.5)
+      .scan<'g', double>();
+
+  program.add_argument("--profile-period")
+      .help("Cycles between two --profile samples")
+      .default_value(1000003)
+      .scan<'i', int>();
+
+  program.add_argument("--profile-memory-period")
+      .help("Loads between two --profile memory samples")
+      .default_value(4001)
+      .scan<'i', int>();
+
+  program.add_argument("--buffer-alignment")
+      .help("Alignment in bytes of every input tensor buffer (power of two, "
+            "up to 2 MiB)")
+      .default_value(64)
+      .scan<'i', int>();
+
+  program.add_argument("--huge-pages")
+      .help("Pages backing the input tensor arena: 'none', 'thp' "
+            "(transparent huge pages) or 'hugetlb' (MAP_HUGETLB)")
+      .default_value(std::string("none"))
+      .choices("none", "thp", "hugetlb");
+
+  program.add_argument("--numa-policy")
+      .help("NUMA placement of the input tensor arena: 'first-touch' "
+            "(kernel default), 'local' or 'remote' (bound to the measurement "
+            "CPU's node or another one) or 'interleave' (all nodes)")
+      .default_value(std::string("first-touch"))
+      .choices("first-touch", "local", "interleave", "remote");
+
+  program.add_argument("--input-threads")
+      .help("Threads generating input data, 0 uses every CPU of the "
+            "measurement CPU's NUMA node")
+      .default_value(0)
+      .scan<'i', int>();
+
+  program.add_argument("--input-profile")
+      .help("Generated input data: 'random-norm' (default), 'random', 'zeros' "
+            "(untouched zero pages), 'zeros-prefaulted', 'sparse', a special "
+            "value profile or 'from-stats' (see --activation-stats). "
+            "Overrides the pipeline JSON's inputs section")
+      .default_value(std::string(""));
+
+  program.add_argument("--activation-stats")
+      .help("Activation statistics JSON written by activation_stats.py, "
+            "sampled by --input-profile from-stats")
+      .default_value(std::string(""));
+
+  program.add_argument("--stats-model")
+      .help("Records the activation statistics first, by running this "
+            "PyTorch model (module:callable, e.g. torchvision.models:alexnet) "
+            "once in the embedded interpreter")
+      .default_value(std::string(""));
+
+  program.add_argument("--stats-input-shape")
+      .help("Shape of the random input --stats-model is run on")
+      .default_value(std::string("1,3,224,224"));
+
+  program.add_argument("--stats-script")
+      .help("Recording script run for --stats-model")
+      .default_value(std::string("activation_stats.py"));
+
+  program.add_argument("--input-density")
+      .help("Fraction of non zero elements of 'sparse' inputs")
+      .default_value(-1.0)
+      .scan<'g', double>();
+
+  program.add_argument("--sparsity-dist")
+      .help("Zeroed units of 'sparse' inputs: 'unstructured' (elements), "
+            "'row', 'col', 'tile1d', 'tile2d' or 'diagonal'")
+      .default_value(std::string(""));
+
+  program.add_argument("--sparsity-block")
+      .help("Rows, columns, diagonals or tile edge zeroed together (1-255)")
+      .default_value(0)
+      .scan<'i', int>();
+
+  program.add_argument("--density-sweep")
+      .help("Also benchmarks every kernel with sparse inputs at these "
+            "densities (comma separated fractions of non zeros)")
+      .default_value(std::string(""))
+      .implicit_value(std::string("0.5,0.25,0.1,0.05,0.01"));
+
+  program.add_argument("--shape-sweep")
+      .help("Also lowers and benchmarks every kernel with scaled activation "
+            "shapes, e.g. \"batch=2,4,8;hw=0.5,2\" (batch and H/W factors)")
+      .default_value(std::string(""))
+      .implicit_value(std::string("batch=2,4,8;hw=0.5,2"));
+
+  program.add_argument("--working-set-sweep")
+      .help("Also benchmarks elementwise, transpose and matmul kernels at "
+            "shapes whose working set lands just below and above every "
+            "cache level")
+      .flag();
+
+  program.add_argument("--working-set-ops")
+      .help("Op types (comma separated) included in --working-set-sweep")
+      .default_value(std::string(
+          "relu,add,sub,mul,div,sigmoid,tanh,transpose,matmul,mm,bmm,linear"));
+
+  program.add_argument("--dynamic-shapes")
+      .help("Also lowers every kernel once with dynamic activation "
+            "dimensions and runs the model's and every swept shape through "
+            "that one object (shape_specialization.csv)")
+      .flag();
+
+  program.add_argument("--const-args")
+      .help("Also benchmarks every kernel with arguments inlined as dense "
+            "constants: 'weights' (the model's own), argument indices "
+            "(comma separated) or both (const_specialization.csv)")
+      .default_value(std::string(""))
+      .implicit_value(std::string("weights"));
+
+  program.add_argument("--sparse-args")
+      .help("Also benchmarks --sparse-ops kernels with these arguments "
+            "sparse_tensor encoded and lowered by the sparsifier, e.g. "
+            "\"1:csr\" or \"0:coo,1:bsr8\" (argument:csr|coo|bsr<b>), at "
+            "every --density-sweep density (sparse_crossover.csv)")
+      .default_value(std::string(""))
+      .implicit_value(std::string("0:csr"));
+
+  program.add_argument("--sparse-ops")
+      .help("Op types (comma separated) included in --sparse-args")
+      .default_value(std::string("mm,matmul,bmm,linear,addmm"));
+
+  program.add_argument("--sparse-pipeline")
+      .help("Pipeline JSON lowering --sparse-args kernels, which need the "
+            "sparse assembler and the sparsifier")
+      .default_value(
+          fs::current_path().append("sparse_pipeline.json").string());
+
+  program.add_argument("--isolate-granularity")
+      .help("Also isolates subgraphs of several ops and ranks them by what "
+            "fusing them saves: op (default), pair (producer-consumer "
+            "pairs), window:<k> (k connected consecutive ops) or "
+            "pattern:<a+b>[,<c+d>...] (chains of the named ops)")
+      .default_value(std::string("op"));
+
+  program.add_argument("--data-order-sweep")
+      .help("Also benchmarks convolution and pooling kernels with their "
+            "activations stored in these orders (comma separated: nhwc, "
+            "ncwh, nchw8c, nchw16c)")
+      .default_value(std::string(""))
+      .implicit_value(std::string("nhwc,nchw8c,nchw16c"));
+
+  program.add_argument("--data-order-ops")
+      .help("Op types (comma separated) included in --data-order-sweep")
+      .default_value(std::string(
+          "convolution,conv2d,max_pool2d,max_pool2d_with_indices,avg_pool2d,"
+          "adaptive_avg_pool2d"));
+
+  program.add_argument("--profile-sweep")
+      .help("Also benchmarks every kernel with these input profiles (comma "
+            "separated) and flags kernels whose cycles depend on the data")
+      .default_value(std::string(""))
+      .implicit_value(
+          std::string("random-norm,denormal,mixed-special,large-magnitude"));
+
+  program.add_argument("--contention")
+      .help("Also benchmarks every kernel next to co-running stressors, one "
+            "measurement per comma separated <kind>[@<placement>] entry: "
+            "bandwidth, llc or spin on the smt sibling, a neighbouring core "
+            "(default) or the rest of the socket")
+      .default_value(std::string(""));
+
+  program.add_argument("--replay")
+      .help("After the measurement, runs the kernels again in model order "
+            "with every input an earlier kernel computed bound to that "
+            "kernel's output (replay_vs_isolated.csv)")
+      .default_value(false)
+      .implicit_value(true);
+
+  program.add_argument("--profile-threshold")
+      .help("Relative change a --profile-sweep kernel is flagged at")
+      .default_value(0.1)
+      .scan<'g', double>();
+
+  program.add_argument("--ftz-daz")
+      .help("Flush-to-zero and denormals-are-zero while the kernel runs")
+      .default_value(std::string("off"))
+      .choices("on", "off");
+
+  program.add_argument("--tensor-source")
+      .help("Directory of real input tensors: <kernel>/arg<i>.npy or "
+            "<kernel>.safetensors (tensors arg<i>), memory mapped without "
+            "copies instead of generated data")
+      .default_value(std::string(""));
+
+  program.add_argument("--scratch-dir")
+      .help("Directory for the transient artifacts (lowerings, objects, "
+            "logs), 'memory' without a value for /dev/shm. Only results and "
+            "reports are written to --output-dir")
+      .default_value(std::string(""))
+      .implicit_value(std::string("memory"));
+
+  program.add_argument("--input-cache")
+      .help("Generates each input once for all pipelines of a kernel. "
+            "Without a value they live in tmpfs for this run, a directory "
+            "keeps them across runs")
+      .default_value(std::string(""))
+      .implicit_value(std::string("memory"));
+
+  program.add_argument("--isolation-cache")
+      .help("Directory keeping the isolated kernels of a model and their "
+            "metadata, later runs of the same model copy them from it")
+      .default_value(std::string(""));
+
+  program.add_argument("--seed")
+      .help("Seed of the generated inputs (decimal or 0x hex). Every kernel "
+            "argument gets its own stream from (seed, kernel hash, argument "
+            "index). Defaults to the reference run's seed with "
+            "--verify-against, and to a random seed otherwise; the seed used "
+            "is written to <output-dir>/run_manifest.json")
+      .default_value(std::string(""));
+
+  program.add_argument("--record-outputs")
+      .help("Store every kernel's results under <output-dir>/references, as "
+            "the reference for --verify-against")
+      .flag();
+
+  program.add_argument("--verify-against")
+      .help("Output directory of a --record-outputs run (e.g. the baseline "
+            "pipeline). Results are compared on identical inputs and kernels "
+            "out of tolerance are marked invalid")
+      .default_value(std::string(""));
+
+  program.add_argument("--verify-rtol")
+      .help("Relative tolerance of --verify-against")
+      .default_value(1e-4)
+      .scan<'g', double>();
+
+  program.add_argument("--verify-atol")
+      .help("Absolute tolerance of --verify-against")
+      .default_value(1e-5)
+      .scan<'g', double>();
+
+  program.add_argument("--input-layout")
+      .help("Layout of the input tensors: 'dense' (row major, or as given in "
+            "the metadata JSON), 'padded', 'transposed' or 'offset'")
+      .default_value(std::string("dense"))
+      .choices("dense", "padded", "transposed", "offset");
+
+  program.add_argument("--layout-sweep")
+      .help("Also benchmarks every kernel under these input layouts (comma "
+            "separated, all of them if no list is given)")
+      .default_value(std::string(""))
+      .implicit_value(std::string("dense,padded,transposed,offset"));
+
+  program.add_argument("--replicas")
+      .help("Also runs every kernel as this many replicas at once, one per "
+            "core with private inputs on its own NUMA node (comma separated, "
+            "or 'pow2' for 1, 2, 4 ... all online CPUs)")
+      .default_value(std::string(""))
+      .implicit_value(std::string("pow2"));
+
+  program.add_argument("--call-latency")
+      .help("After the samples, times this many back to back calls of every "
+            "kernel one by one into a latency histogram (p50/p99/p99.9/max), "
+            "0 to disable")
+      .default_value(0)
+      .scan<'i', int>();
+
+  program.add_argument("--thread-sweep")
+      .help("Also benchmarks every kernel at these thread counts (comma "
+            "separated, or 'pow2' for 1, 2, 4 ... all online CPUs). Needs a "
+            "pipeline with a parallel_runtime")
+      .default_value(std::string(""))
+      .implicit_value(std::string("pow2"));
+
+  program.add_argument("--warmup")
+      .help("Discarded runs before sampling: a fixed count, or 'auto' to run "
+            "until the primary metric reaches a steady state")
+      .default_value(std::string("0"));
+
+  program.add_argument("--warmup-window")
+      .help("Sliding window (runs) used by --warmup=auto")
+      .default_value(5)
+      .scan<'i', int>();
+
+  program.add_argument("--warmup-cv")
+      .help("Coefficient of variation below which --warmup=auto considers "
+            "the kernel steady")
+      .default_value(0.02)
+      .scan<'g', double>();
+
+  program.add_argument("--max-warmup")
+      .help("Upper bound on warmup runs in --warmup=auto")
+      .default_value(100)
+      .scan<'i', int>();
+
+  program.add_argument("--sample-metrics")
+      .help("List of metrics to be collected for sample runs")
+      .default_value(std::vector<std::string>(
+          {"seconds", "cycles", "instructions", "cache-misses"}));
+
+  program.add_argument("--metric-group")
+      .help("Comma separated built-in metric groups counted next to "
+            "--sample-metrics: 'topdown-l1' (frontend/backend bound, bad "
+            "speculation and retiring percent of the issue slots), "
+            "'memory-bound' (memory/core bound percent, l1d/llc/dtlb MPKI), "
+            "'frontend' (fetch latency/bandwidth percent, l1i/itlb MPKI)")
+      .default_value(std::string("none"));
+
+  program.add_argument("--output-logs")
+      .help("Dump every kernel's inputs and outputs as .npy files under "
+            "<kernel>.tensors/ (see graph-gen/read_dump.py)")
+      .flag();
+
+  program.add_argument("--output-logs-compression")
+      .help("Compression of --output-logs dumps, through the gzip / zstd "
+            "command line tools")
+      .default_value(std::string("none"))
+      .choices("none", "gzip", "zstd");
+  // program.add_argument("--torch-mlir-build-path")
+  // .help("Path to a Torch MLIR build")
+  // .required();
+
+  program.add_argument("--cc")
+      .help("Path to compiler to be used for object file generation")
+      .default_value("/usr/bin/clang++");
+
+  program.add_argument("--lowering-engine")
+      .help("Lowering backend: 'inprocess' keeps one MLIRContext alive and "
+            "runs passes in memory, 'popen' shells out to torch-mlir-opt / "
+            "mlir-opt for each kernel")
+      .default_value(std::string(MLIREngine::available() ? "inprocess"
+                                                         : "popen"))
+      .choices("inprocess", "popen");
+
+  program.add_argument("--exec-engine")
+      .help("Kernel execution backend: 'jit' compiles the .ll in memory with "
+            "LLVM ORC, 'so' builds and dlopens a shared object per kernel")
+      .default_value(std::string("so"))
+      .choices("jit", "so");
+
+  program.add_argument("--link-mode")
+      .help("Shared object granularity: 'kernel' builds one object per "
+            "kernel, 'op-type' and 'model' link every kernel of an op type "
+            "(or of the whole model) into a single object")
+      .default_value(std::string("kernel"))
+      .choices("kernel", "op-type", "model");
+
+  program.add_argument("--cache-dir")
+      .help("Directory of the persistent compilation cache")
+      .default_value(CompileCache::default_cache_dir().generic_string());
+
+  program.add_argument("--no-cache")
+      .help("Disables the persistent compilation cache")
+      .flag();
+
+  program.add_argument("--no-prefix-cache")
+      .help("Lowers every pipeline from the Torch IR, instead of starting "
+            "from the IR of pass prefixes shared with other pipelines")
+      .flag();
+
+  program.add_argument("--end-to-end")
+      .help("Also lowers and measures the whole model through the same "
+            "pipeline, next to the sum of its isolated kernels in "
+            "model_vs_kernels.csv")
+      .flag();
+
+  program.add_argument("--csv-export")
+      .help("Also writes every kernel's samples to "
+            "timings/<op_type>/<kernel>.csv, next to results.sqlite")
+      .flag();
+
+  program.add_argument("--compile-profile")
+      .help("Records per pass wall time and op counts of every lowering, "
+            "plus .ll and object sizes, to compile_profile.csv and "
+            "compile_passes.csv. Bypasses the compilation cache")
+      .flag();
+
+  program.add_argument("-j", "--jobs")
+      .help("Number of worker threads used to generate metadata, lower and "
+            "compile kernels in parallel. Measurement always stays serialised")
+      .default_value(1)
+      .scan<'i', int>();
+
+  program.add_argument("--schedule")
+      .help("'phased' compiles every kernel before measuring any of them, "
+            "'pipelined' measures kernel N while kernel N+1 compiles")
+      .default_value(std::string("phased"))
+      .choices("phased", "pipelined");
+
+  program.add_argument("--queue-depth")
+      .help("Maximum number of compiled kernels waiting for measurement in "
+            "pipelined scheduling")
+      .default_value(2)
+      .scan<'i', int>();
+
+  program.add_argument("--metadata-source")
+      .help("'isolation' emits every kernel's argument metadata in the "
+            "isolation stage, 'pass' runs --generate-param-metadata once per "
+            "kernel")
+      .default_value(std::string("isolation"))
+      .choices("isolation", "pass");
+
+  program.add_argument("--no-dedup")
+      .help("Benchmarks every isolated kernel, even when structurally "
+            "identical kernels were already measured")
+      .flag();
+
+  program.add_argument("--resume")
+      .help("Continues the run in the given output directory, skipping the "
+            "kernels its kernel_manifest.json lists as measured with the "
+            "same source and pipeline")
+      .default_value(std::string(""));
+
+  program.add_argument("--only-changed")
+      .help("Output directory of a previous run: lowers every kernel but "
+            "only measures those whose LLVM IR changed, the others reuse "
+            "its results")
+      .default_value(std::string(""));
+
+  program.add_argument("--workers")
+      .help("Comma separated ssh destinations (e.g. user@node1,node2) that "
+            "measure shards of the kernels with this build, see "
+            "--worker-binary")
+      .default_value(std::string(""));
+
+  program.add_argument("--worker-binary")
+      .help("WrapperModule on the worker hosts (default: this binary's path)")
+      .default_value(std::string(""));
+
+  program.add_argument("--worker-dir")
+      .help("Scratch directory for shards on the worker hosts")
+      .default_value(std::string("/tmp/wrapper-worker"));
+
+  program.add_argument("--shard-size")
+      .help("Kernels per shard sent to a worker")
+      .default_value(8)
+      .scan<'i', int>();
+
+  program.add_argument("--worker")
+      .help("Worker mode, started by a coordinator over ssh: measures the "
+            "kernels of the given shard directory")
+      .default_value(std::string(""));
+
+  program.add_argument("--pipeline")
+      .help("Path to pipeline specified in JSON file. Repeat it to compare "
+            "pipelines in one run: the kernels are isolated once, compiled "
+            "per pipeline and measured interleaved with the first one")
+      .default_value(std::vector<std::string>(
+          {fs::current_path().append("pipeline.json").string()}))
+      .append();
+
+  program.add_argument("--autotune")
+      .help("Pipeline template with parameter ranges (see autotuner.h): "
+            "searches the best pipeline per op type or kernel instead of "
+            "benchmarking, results go to <output-dir>/autotune")
+      .default_value(std::string(""));
+
+  program.add_argument("--autotune-scope")
+      .help("Tune one pipeline per 'op-type' or per 'kernel'")
+      .default_value(std::string("op-type"))
+      .choices("op-type", "kernel");
+
+  program.add_argument("--autotune-search")
+      .help("'bayesian' (tree-structured Parzen estimator after random "
+            "startup trials) or 'random'")
+      .default_value(std::string("bayesian"))
+      .choices("bayesian", "random");
+
+  program.add_argument("--autotune-trials")
+      .help("Candidate pipelines per scope")
+      .default_value(30)
+      .scan<'i', int>();
+
+  program.add_argument("--autotune-early-stop")
+      .help("Abandons candidates whose probe samples are this many times "
+            "slower than the best candidate so far")
+      .default_value(1.2)
+      .scan<'g', double>();
+
+  program.add_argument("--pipeline-sweep")
+      .help("Pipeline template with parameter ranges (see "
+            "pipeline_template.h): every combination is compared with the "
+            "first --pipeline, per kernel results go to pipeline_sweep.csv")
+      .default_value(std::string(""));
+
+  program.add_argument("--out-params")
+      .help("Also measures every kernel lowered with its results as "
+            "out-params, preallocated once instead of allocated by every "
+            "call (pipeline 'out-params' in pipeline_comparison.csv)")
+      .default_value(false)
+      .implicit_value(true);
+
+  program.add_argument("--pgo")
+      .help("Also measures every kernel rebuilt with -fprofile-use, from a "
+            "training run of its instrumented object on the same inputs "
+            "(pipeline 'pgo' in pipeline_comparison.csv)")
+      .default_value(false)
+      .implicit_value(true);
+
+  program.add_argument("--torch-baseline")
+      .help("Comma separated torch modes ('eager', 'compile') measured on "
+            "every kernel's inputs after it, through the embedded Python. "
+            "Per kernel and model speedups go to torch_baseline.csv")
+      .default_value(std::string("none"));
+
+  program.add_argument("--interleave-rounds")
+      .help("Rounds alternating between the pipelines per kernel, each "
+            "taking an equal share of the samples (0 = one sample per "
+            "round)")
+      .default_value(0)
+      .scan<'i', int>();
+
+  program.add_argument("model-file")
+      .help("Torch-MLIR file for the model to be benchmarked, text or "
+            "bytecode (see convert-model)")
+      .required();
+
+  if (std::optional<int> status = parse_arguments(program, argc, args))
+    return *status;
+
+  // For now, the torch and llvm setup are being built into the same build, so
+  // seperation at the interface level can be skipped for now
+  buildPath = program.get<std::string>("--build-path");
+  std::vector<std::string> perf_metrics =
+      program.get<std::vector<std::string>>("--sample-metrics");
+  std::vector<std::string> pipeline_paths =
+      program.get<std::vector<std::string>>("--pipeline");
+  pipelineJsonPath = pipeline_paths.front();
+  comparison_pipelines.assign(pipeline_paths.begin() + 1,
+                              pipeline_paths.end());
+  out_params = program.get<bool>("--out-params");
+  pgo = program.get<bool>("--pgo");
+
+  outputFolderPath = program.get<std::string>("--output-dir");
+  resume_dir = program.get<std::string>("--resume");
+  if (!resume_dir.empty())
+    outputFolderPath = resume_dir;
+  only_changed = program.get<std::string>("--only-changed");
+
+  // --pipeline-sweep: every grid point of the template becomes a comparison
+  // pipeline, measured interleaved with the first --pipeline
+  if (std::string sweep_template = program.get<std::string>("--pipeline-sweep");
+      !sweep_template.empty()) {
+    const size_t max_sweep_pipelines = 1024;
+    // Fixed seed, reruns sample the same orders of long permute groups
+    std::mt19937_64 sweep_rng(1);
+    if (!sweep.load(sweep_template, sweep_rng))
+      return 1;
+    if (sweep.size() > max_sweep_pipelines) {
+      std::cerr << sweep_template << " spans " << sweep.size()
+                << " pipelines, more than " << max_sweep_pipelines
+                << " to sweep. Narrow it or search it with --autotune\n";
+      return 1;
+    }
+    fs::path sweep_dir = fs::path(outputFolderPath).append("pipeline_sweep");
+    fs::create_directories(sweep_dir);
+    json grid = json::object();
+    std::vector<std::vector<size_t>> choices = sweep.grid();
+    std::vector<std::string> labels = sweep.labels(choices);
+    for (size_t c = 0; c < choices.size(); c++) {
+      const std::vector<size_t> &choice = choices[c];
+      const std::string &label = labels[c];
+      fs::path pipeline_json = fs::path(sweep_dir).append(label + ".json");
+      std::ofstream(pipeline_json) << sweep.render(choice).dump(2) << "\n";
+      comparison_pipelines.push_back(pipeline_json);
+      sweep_points[label] = sweep.values(choice);
+      for (size_t d = 0; d < sweep.dimensions().size(); d++)
+        grid[label][sweep.dimensions()[d].name] = sweep_points[label][d];
+    }
+    std::ofstream(fs::path(sweep_dir).append("grid.json"))
+        << grid.dump(2) << "\n";
+    std::cout << "Sweeping " << sweep_points.size() << " pipelines of "
+              << sweep_template << "\n";
+  }
+
+  sample_run_count = program.get<int>("--sample-count");
+  WarmupConfig warmup;
+  std::string warmup_value = program.get<std::string>("--warmup");
+  if (warmup_value == "auto") {
+    warmup.auto_detect = true;
+  } else {
+    try {
+      warmup.runs = std::max(0, std::stoi(warmup_value));
+    } catch (const std::exception &) {
+      std::cerr << "--warmup expects a run count or 'auto'\n";
+      return 1;
+    }
+  }
+  warmup.window = std::max(2, program.get<int>("--warmup-window"));
+  warmup.cv_threshold = program.get<double>("--warmup-cv");
+  warmup.max_runs = std::max(0, program.get<int>("--max-warmup"));
+
+  std::string counter_mode_name = program.get<std::string>("--counter-mode");
+  CounterMode counter_mode = counter_mode_name == "live" ? CounterMode::LIVE
+                             : counter_mode_name == "per-sample"
+                                 ? CounterMode::PER_SAMPLE
+                                 : CounterMode::SESSION;
+
+  unsigned int counter_batch_size = 0;
+  std::string counter_batches = program.get<std::string>("--counter-batches");
+  if (counter_batches == "auto") {
+    counter_batch_size = CounterScheduler::default_counters();
+  } else if (counter_batches != "off") {
+    try {
+      counter_batch_size = std::max(2, std::stoi(counter_batches));
+    } catch (const std::exception &) {
+      std::cerr << "--counter-batches must be 'off', 'auto' or a number\n";
+      return 1;
+    }
+  }
+
+  std::string thread_counting = program.get<std::string>("--thread-counting");
+  ThreadScope thread_scope = thread_counting == "inherit" ? ThreadScope::INHERIT
+                             : thread_counting == "per-core"
+                                 ? ThreadScope::PER_CORE
+                                 : ThreadScope::CALLING_THREAD;
+
+  std::string cache_mode_name = program.get<std::string>("--cache-mode");
+  cache_mode = cache_mode_name == "cold"   ? CacheMode::COLD
+               : cache_mode_name == "both" ? CacheMode::BOTH
+                                           : CacheMode::WARM;
+
+  ArenaConfig arena_config;
+  arena_config.alignment = std::max(1, program.get<int>("--buffer-alignment"));
+  std::string huge_pages = program.get<std::string>("--huge-pages");
+  arena_config.huge_pages = huge_pages == "thp"       ? HugePageMode::THP
+                            : huge_pages == "hugetlb" ? HugePageMode::HUGETLB
+                                                      : HugePageMode::NONE;
+  std::string numa_policy = program.get<std::string>("--numa-policy");
+  arena_config.numa_policy =
+      numa_policy == "local"        ? NumaPolicy::LOCAL_NODE
+      : numa_policy == "interleave" ? NumaPolicy::INTERLEAVE
+      : numa_policy == "remote"     ? NumaPolicy::REMOTE_NODE
+                                    : NumaPolicy::FIRST_TOUCH;
+
+  std::vector<LayoutKind> input_layouts =
+      MemRefLayout::parse_list(program.get<std::string>("--input-layout"));
+  input_layout =
+      input_layouts.empty() ? LayoutKind::DENSE : input_layouts[0];
+  layout_sweep =
+      MemRefLayout::parse_list(program.get<std::string>("--layout-sweep"));
+  // Identity layout maps bake dense strides into the kernel, whatever the
+  // descriptors say
+  if (!layout_sweep.empty() || input_layout != LayoutKind::DENSE) {
+    std::ifstream pipeline_file(pipelineJsonPath);
+    std::string pipeline_text((std::istreambuf_iterator<char>(pipeline_file)),
+                              std::istreambuf_iterator<char>());
+    if (pipeline_text.find("identity-layout-map") != std::string::npos)
+      std::cerr << "Warning: " << pipelineJsonPath
+                << " bufferizes with identity layout maps, its kernels "
+                   "ignore input layouts (see strided_pipeline.json)\n";
+  }
+  thread_sweep =
+      ParallelRuntime::parse_sweep(program.get<std::string>("--thread-sweep"));
+  replica_sweep =
+      ParallelRuntime::parse_sweep(program.get<std::string>("--replicas"));
+
+  // Input data: the pipeline's inputs section, then the --input-* flags
+  input_profile =
+      TensorFuzzer::from_pipeline_json(load_json_from_file(pipelineJsonPath));
+  std::string profile_name = program.get<std::string>("--input-profile");
+  if (!profile_name.empty() &&
+      !TensorFuzzer::parse_profile(profile_name, input_profile.profile)) {
+    std::cerr << "Unknown --input-profile '" << profile_name << "'\n";
+    return 1;
+  }
+  std::string distribution = program.get<std::string>("--sparsity-dist");
+  if (!distribution.empty() &&
+      !TensorFuzzer::parse_distribution(
+          distribution, input_profile.sparsity.distribution_type)) {
+    std::cerr << "Unknown --sparsity-dist '" << distribution << "'\n";
+    return 1;
+  }
+  if (double density = program.get<double>("--input-density"); density >= 0.0)
+    input_profile.sparsity.sparsity_percentage =
+        1.f - static_cast<float>(std::min(1.0, density));
+  if (int block = program.get<int>("--sparsity-block"); block > 0)
+    input_profile.sparsity.row_block_size = std::min(block, 255);
+  density_sweep =
+      parse_density_list(program.get<std::string>("--density-sweep"));
+  shape_sweep = ShapeSweep::parse(program.get<std::string>("--shape-sweep"));
+  bool working_set_sweep = program.get<bool>("--working-set-sweep");
+  dynamic_shapes = program.get<bool>("--dynamic-shapes");
+  if (!ConstantArgs::parse(program.get<std::string>("--const-args"),
+                           const_args)) {
+    std::cerr << "Unreadable --const-args \""
+              << program.get<std::string>("--const-args")
+              << "\", expected 'weights' and/or argument indices\n";
+    return 1;
+  }
+  if (!SparseEncoding::parse(program.get<std::string>("--sparse-args"),
+                             sparse_args)) {
+    std::cerr << "Unreadable --sparse-args \""
+              << program.get<std::string>("--sparse-args")
+              << "\", expected <argument>:<csr|coo|bsr<b>>[,...]\n";
+    return 1;
+  }
+  {
+    std::stringstream ss(program.get<std::string>("--sparse-ops"));
+    std::string op;
+    while (std::getline(ss, op, ','))
+      sparse_ops.insert(op);
+  }
+  // The crossover needs densities to cross over
+  if (!sparse_args.empty() && density_sweep.empty()) {
+    density_sweep = parse_density_list("0.01,0.05,0.1,0.25,0.5");
+    std::cout << "--sparse-args without --density-sweep, sweeping densities "
+                 "0.01 to 0.5\n";
+  }
+  {
+    std::stringstream ss(program.get<std::string>("--working-set-ops"));
+    std::string op;
+    while (std::getline(ss, op, ','))
+      working_set_ops.insert(op);
+  }
+  data_order_sweep =
+      DataOrders::parse_list(program.get<std::string>("--data-order-sweep"));
+  {
+    std::stringstream ss(program.get<std::string>("--data-order-ops"));
+    std::string op;
+    while (std::getline(ss, op, ','))
+      data_order_ops.insert(op);
+  }
+  if (!SubgraphIsolation::parse(
+          program.get<std::string>("--isolate-granularity"), fusion))
+    return 1;
+  if (working_set_sweep) {
+    caches = CacheEvictor::cache_levels(manager.get_measure_cpu());
+    if (caches.empty())
+      std::cerr << "No cache sizes in sysfs, --working-set-sweep is off\n";
+    for (const CacheLevel &cache : caches)
+      std::cout << "L" << cache.level << " cache: " << (cache.bytes >> 10)
+                << " KiB\n";
+  }
+  std::string profile_spec = program.get<std::string>("--profile-sweep");
+  profile_sweep = parse_profile_list(profile_spec);
+  if (!profile_spec.empty() && profile_sweep.empty())
+    return 1;
+  if (!ContentionGenerator::parse(program.get<std::string>("--contention"),
+                                  contention_profiles)) {
+    std::cerr << "Unknown --contention entry, expected "
+                 "bandwidth|llc|spin[@smt|core|socket]\n";
+    return 1;
+  }
+
+  CallInterface call_interface =
+      program.get<std::string>("--call-interface") == "ffi"
+          ? CallInterface::FFI
+          : CallInterface::TRAMPOLINE;
+
+  try {
+    std::string target_ci = program.get<std::string>("--target-ci");
+    bool percent = !target_ci.empty() && target_ci.back() == '%';
+    sampling.target_ci = std::stod(target_ci) / (percent ? 100.0 : 1.0);
+  } catch (const std::exception &) {
+    std::cerr << "--target-ci expects a relative width such as '1%' or 0.01\n";
+    return 1;
+  }
+  sampling.max_samples = std::max(1, program.get<int>("--max-samples"));
+  sampling.max_seconds = program.get<double>("--max-time-per-kernel");
+  sampling.min_window_seconds =
+      std::max(0.0, program.get<double>("--min-window-ms")) / 1000.0;
+  sampling.max_inner_repetitions =
+      std::max(1, program.get<int>("--max-inner-repetitions"));
+
+  Statistics::parse(program.get<std::string>("--outlier-rejection"),
+                    outlier_config.method);
+  outlier_config.threshold =
+      std::max(0.0, program.get<double>("--outlier-threshold"));
+  outlier_config.bootstrap_resamples =
+      std::max(0, program.get<int>("--bootstrap-resamples"));
+  manager.set_outlier_config(outlier_config);
+
+  NoiseConfig noise_config;
+  NoiseMonitor::parse(program.get<std::string>("--noise-monitor"),
+                      noise_config.action);
+  noise_config.retries = std::max(0, program.get<int>("--noise-retries"));
+  noise_config.max_irqs = program.get<double>("--noise-max-irqs");
+  noise_config.max_freq_drop = program.get<double>("--noise-max-freq-drop");
+  noise_config.max_temp_c = program.get<double>("--noise-max-temp");
+  noise_config.max_page_faults =
+      program.get<double>("--noise-max-page-faults");
+  manager.set_noise_config(noise_config);
+  CallOverheadMode call_overhead = CallOverheadMode::MEASURE;
+  CallOverhead::parse(program.get<std::string>("--call-overhead"),
+                      call_overhead);
+  manager.set_call_overhead(call_overhead);
+
+  EnergyConfig energy_config;
+  energy_config.enabled = program.get<bool>("--energy");
+  energy_config.min_window_seconds =
+      std::max(0.0, program.get<double>("--energy-min-window-ms")) / 1000.0;
+  energy_config.idle_seconds =
+      std::max(0.0, program.get<double>("--energy-idle-ms")) / 1000.0;
+  // RAPL ticks about once a millisecond, so the windows must be long
+  if (energy_config.enabled)
+    sampling.min_window_seconds =
+        std::max(sampling.min_window_seconds, energy_config.min_window_seconds);
+  manager.set_energy_config(energy_config);
+  manager.set_vectorization_report(program.get<bool>("--vectorization-report"));
+  manager.set_code_footprint(program.get<bool>("--code-footprint"));
+  manager.set_dram_traffic(program.get<bool>("--dram-traffic"));
+
+  isolate_kernels = program.get<std::string>("--isolation") == "fork";
+  kernel_timeout = program.get<double>("--kernel-timeout");
+  jobs = std::max(1, program.get<int>("--jobs"));
+  queue_depth = std::max(1, program.get<int>("--queue-depth"));
+  interleave_rounds = std::max(0, program.get<int>("--interleave-rounds"));
+  enable_dedup = !program.get<bool>("--no-dedup");
+  worker_shard = program.get<std::string>("--worker");
+  std::stringstream worker_list(program.get<std::string>("--workers"));
+  for (std::string host; std::getline(worker_list, host, ',');)
+    if (!host.empty())
+      distributed.hosts.push_back(host);
+  distributed.remote_dir = program.get<std::string>("--worker-dir");
+  distributed.remote_binary = program.get<std::string>("--worker-binary");
+  if (distributed.remote_binary.empty())
+    distributed.remote_binary = fs::absolute(args[0]).string();
+  distributed.shard_size = std::max(1, program.get<int>("--shard-size"));
+  if (!distributed.hosts.empty() &&
+      !program.get<std::string>("--only-changed").empty())
+    std::cerr << "--only-changed needs the LLVM IR of every kernel, workers "
+                 "measure all the kernels they get\n";
+  // Workers get the same flags, with their own shard, output and pipeline
+  const std::set<std::string> coordinator_flags = {
+      "--workers",      "--worker-binary", "--worker-dir",
+      "--shard-size",   "--worker",        "--output-dir",
+      "--pipeline",     "--resume",        "--only-changed",
+      "--pipeline-sweep"};
+  for (int i = 1; i < argc; i++) {
+    std::string arg = args[i];
+    std::string flag = arg.substr(0, arg.find('='));
+    if (!coordinator_flags.count(flag))
+      distributed.forwarded_args.push_back(arg);
+    else if (flag == arg)
+      i++; // its value
+  }
+  distributed.model_file = program.get<std::string>("model-file");
+  metadata_source =
+      program.get<std::string>("--metadata-source") == "pass"
+          ? MetadataSource::PASS
+          : MetadataSource::ISOLATION;
+  schedule_mode =
+      program.get<std::string>("--schedule") == "pipelined"
+          ? ScheduleMode::PIPELINED
+          : ScheduleMode::PHASED;
+  std::string link_mode_name = program.get<std::string>("--link-mode");
+  LinkMode link_mode = link_mode_name == "op-type" ? LinkMode::OP_TYPE
+                       : link_mode_name == "model" ? LinkMode::MODEL
+                                                   : LinkMode::PER_KERNEL;
+  std::string compiler_path = program.get<std::string>("--cc");
+  model_file = program.get<std::string>("model-file");
+  LoweringEngine lowering_engine =
+      program.get<std::string>("--lowering-engine") == "inprocess"
+          ? LoweringEngine::IN_PROCESS
+          : LoweringEngine::POPEN;
+  ExecutionEngine execution_engine =
+      program.get<std::string>("--exec-engine") == "jit"
+          ? ExecutionEngine::ORC_JIT
+          : ExecutionEngine::SHARED_OBJECT;
+  // Every pipeline's kernel is loaded on its own, built with its own flags
+  if (!comparison_pipelines.empty() || out_params || pgo) {
+    if (execution_engine == ExecutionEngine::ORC_JIT) {
+      std::cerr << "Comparing pipelines needs per pipeline objects, "
+                   "switching to --exec-engine=so\n";
+      execution_engine = ExecutionEngine::SHARED_OBJECT;
+    }
+    if (link_mode != LinkMode::PER_KERNEL) {
+      std::cerr << "Comparing pipelines needs per kernel objects, "
+                   "switching to --link-mode=kernel\n";
+      link_mode = LinkMode::PER_KERNEL;
+    }
+    if (!distributed.hosts.empty())
+      std::cerr << "--workers only measure the first --pipeline\n";
+  }
+
+  // Setting up the Command Manager
+  manager.set_llvm_install_path(buildPath);
+  manager.set_torch_install_path(buildPath);
+  manager.set_compiler_executable(compiler_path);
+  manager.set_output_folder(outputFolderPath);
+  manager.set_pipeline_json_filepath(pipelineJsonPath);
+  manager.set_sparse_pipeline(program.get<std::string>("--sparse-pipeline"));
+  manager.set_comparison_pipelines(comparison_pipelines);
+  manager.set_out_params_variant(out_params);
+  manager.set_pgo_variant(pgo);
+  if (!TorchCall::parse(program.get<std::string>("--torch-baseline"),
+                        torch_baselines)) {
+    std::cerr << "Unknown --torch-baseline mode, expected eager and/or "
+                 "compile\n";
+    return 1;
+  }
+  manager.set_torch_baselines(torch_baselines);
+  // Kernels for another architecture are only compiled here, workers of that
+  // architecture link and measure them with their own PMU events
+  const TargetSpec &primary_target = manager.get_primary_pipeline().target;
+  if (TargetInfo::is_cross(primary_target)) {
+    if (distributed.hosts.empty()) {
+      std::cerr << "Error: " << primary_target.triple
+                << " kernels can only be measured on --workers of that "
+                   "architecture\n";
+      return 1;
+    }
+    if (!comparison_pipelines.empty())
+      std::cerr << "Comparison pipelines are not compiled for "
+                << primary_target.triple << ", use one run per target\n";
+  }
+  manager.set_perf_sample_run_count(sample_run_count);
+  manager.set_perf_metrics(perf_metrics);
+  manager.set_warmup_config(warmup);
+  manager.set_sampling_config(sampling);
+  manager.set_counter_mode(counter_mode);
+  manager.set_counter_batch_size(counter_batch_size);
+  manager.set_thread_scope(thread_scope);
+  manager.set_cache_mode(cache_mode);
+  manager.set_input_layout(input_layout);
+  manager.set_input_profile(input_profile);
+  manager.set_tensor_source(program.get<std::string>("--tensor-source"));
+  // tmpfs backed for "memory", removed once the run is done
+  fs::path input_cache_dir = program.get<std::string>("--input-cache");
+  fs::path temporary_input_cache_dir;
+  if (input_cache_dir == "memory")
+    input_cache_dir = temporary_input_cache_dir =
+        fs::path(fs::is_directory("/dev/shm") ? "/dev/shm"
+                                              : fs::temp_directory_path())
+            .append("mlir-bench-inputs-" + std::to_string(getpid()));
+  temporary_input_cache =
+      std::make_unique<ScopedDirectory>(temporary_input_cache_dir);
+  manager.set_input_cache(input_cache_dir);
+  manager.set_isolation_cache(program.get<std::string>("--isolation-cache"));
+  std::string seed_value = program.get<std::string>("--seed");
+  input_seed = 0;
+  if (!seed_value.empty()) {
+    try {
+      input_seed = std::stoull(seed_value, nullptr, 0);
+    } catch (const std::exception &) {
+      std::cerr << "--seed expects an unsigned integer\n";
+      return 1;
+    }
+  } else if (!program.get<std::string>("--verify-against").empty()) {
+    input_seed =
+        read_manifest_seed(program.get<std::string>("--verify-against"));
+    if (!input_seed)
+      std::cerr << "Warning: the --verify-against run has no seed in its "
+                   "run_manifest.json, pass the reference run's --seed\n";
+  } else if (!resume_dir.empty() || !only_changed.empty()) {
+    // Same inputs as the kernels measured before
+    input_seed =
+        read_manifest_seed(resume_dir.empty() ? only_changed : resume_dir);
+  }
+  // 0 would seed every tensor from the clock
+  while (!input_seed)
+    input_seed = (uint64_t(std::random_device{}()) << 32) ^
+                 std::random_device{}();
+  manager.set_input_seed(input_seed);
+  manager.set_record_outputs(program.get<bool>("--record-outputs"));
+  call_latency_calls = std::max(0, program.get<int>("--call-latency"));
+  manager.set_call_latency(call_latency_calls);
+  manager.set_verification(program.get<std::string>("--verify-against"),
+                           {program.get<double>("--verify-rtol"),
+                            program.get<double>("--verify-atol")});
+  manager.set_track_allocations(program.get<bool>("--track-allocations"));
+  {
+    std::stringstream ss(program.get<std::string>("--profile"));
+    for (std::string kind; std::getline(ss, kind, ',');) {
+      if (kind == "hotspots")
+        profile_config.hotspots = true;
+      else if (kind == "flamegraph")
+        profile_config.flamegraph = true;
+      else if (kind == "memory")
+        profile_config.memory = true;
+      else if (kind == "latency")
+        profile_config.latency = true;
+      else if (kind == "branches")
+        profile_config.branches = true;
+      else if (kind == "perf-data")
+        profile_config.perf_data = true;
+      else if (kind != "none" && !kind.empty()) {
+        std::cerr << "Unknown --profile '" << kind
+                  << "', expected hotspots, flamegraph, memory, latency, "
+                     "branches or perf-data\n";
+        return 1;
+      }
+    }
+  }
+  profile_config.seconds =
+      std::max(0.0, program.get<double>("--profile-seconds"));
+  profile_config.period = std::max(1, program.get<int>("--profile-period"));
+  profile_config.memory_period =
+      std::max(1, program.get<int>("--profile-memory-period"));
+  manager.set_profile_config(profile_config);
+  std::string scratch_root = program.get<std::string>("--scratch-dir");
+  if (!scratch_root.empty()) {
+    scratch_folder = ScratchSpace::create(scratch_root);
+    if (scratch_folder.empty())
+      return 1;
+    // perf resolves the symbols of profiled kernels through their files
+    bool profiling = profile_config.hotspots || profile_config.flamegraph ||
+                     profile_config.memory || profile_config.latency ||
+                     profile_config.branches || profile_config.perf_data;
+    manager.set_scratch_folder(scratch_folder,
+                               scratch_root == "memory" && !profiling);
+  }
+  // Removed on every return, kept with its intermediates for --pass-logs
+  scratch_cleanup = std::make_unique<ScopedDirectory>(scratch_folder);
+  if (program.get<bool>("--pass-logs"))
+    scratch_cleanup->keep();
+  std::vector<MetricGroup> metric_groups;
+  {
+    std::stringstream ss(program.get<std::string>("--metric-group"));
+    for (std::string name; std::getline(ss, name, ',');) {
+      if (name == "none" || name.empty())
+        continue;
+      std::vector<std::string> known = MetricGroups::names();
+      if (std::find(known.begin(), known.end(), name) == known.end()) {
+        std::cerr << "Unknown --metric-group '" << name
+                  << "', expected topdown-l1, memory-bound or frontend\n";
+        return 1;
+      }
+      MetricGroup group;
+      if (MetricGroups::resolve(name, group))
+        metric_groups.push_back(group);
+      else
+        std::cerr << "Metric group " << name
+                  << " has no events on this CPU, skipping it\n";
+    }
+  }
+  manager.set_metric_groups(metric_groups);
+  manager.set_call_interface(call_interface);
+  manager.set_measure_cpu(program.get<int>("--measure-cpu"));
+  // NUMA nodes follow the measurement CPU
+  arena_config.numa_nodes = NumaPlacement::target_nodes(
+      arena_config.numa_policy, manager.get_measure_cpu());
+  manager.set_arena_config(arena_config);
+  manager.set_run_log_flag(program.get<bool>("--output-logs"));
+  std::string dump_compression =
+      program.get<std::string>("--output-logs-compression");
+  DumpCompression compression =
+      dump_compression == "gzip"   ? DumpCompression::GZIP
+      : dump_compression == "zstd" ? DumpCompression::ZSTD
+                                   : DumpCompression::UNCOMPRESSED;
+  // The dump thread stays off the measurement CPU
+  TensorDump::configure(compression, manager.get_measure_cpu());
+  TensorFuzzer::configure(std::max(0, program.get<int>("--input-threads")),
+                          manager.get_measure_cpu());
+  manager.set_realtime_scheduling(program.get<bool>("--sched-fifo"));
+  manager.set_ftz_daz(program.get<std::string>("--ftz-daz") == "on");
+  manager.set_lowering_engine(lowering_engine);
+  manager.set_execution_engine(execution_engine);
+  manager.set_link_mode(link_mode);
+  CompileCache::set_cache_dir(program.get<std::string>("--cache-dir"));
+  CompileCache::set_enabled(!program.get<bool>("--no-cache"));
+  PassPrefixCache::set_enabled(!program.get<bool>("--no-prefix-cache"));
+  CompileProfiler::set_enabled(program.get<bool>("--compile-profile"));
+  ResultsStore::set_csv_export(program.get<bool>("--csv-export"));
+  manager.initialise_environment();
+  write_run_manifest(fs::path(outputFolderPath).append("run_manifest.json"),
+                     input_seed, pipelineJsonPath, model_file);
+
+  std::cout << "Pipeline path: " << pipelineJsonPath << std::endl;
+  std::cout << "Input seed: " << input_seed << std::endl;
+
+  // Perf metrics plus harness metrics such as compile_seconds
+  report_metrics = manager.get_report_metrics();
+
+  // Kernel progress, kept from the run being resumed
+  fs::path kernel_manifest_filepath =
+      fs::path(outputFolderPath).append("kernel_manifest.json");
+  if (resume_dir.empty())
+    fs::remove(kernel_manifest_filepath);
+  kernel_manifest = std::make_unique<KernelManifest>(
+      kernel_manifest_filepath, manager.get_lowering_folder(),
+      KernelManifest::pipeline_hash(pipelineJsonPath),
+      manager.get_measurement_hash(), report_metrics);
+  if (!only_changed.empty())
+    previous_manifest = std::make_unique<KernelManifest>(
+        fs::path(only_changed).append("kernel_manifest.json"),
+        manager.get_lowering_folder(),
+        KernelManifest::pipeline_hash(pipelineJsonPath),
+        manager.get_measurement_hash(), report_metrics);
+
+  // A batch can only be linked once all of its kernels are lowered
+  if (link_mode != LinkMode::PER_KERNEL &&
+      schedule_mode == ScheduleMode::PIPELINED) {
+    std::cerr << "Batched linking requires phased scheduling, switching to "
+                 "--schedule=phased\n";
+    schedule_mode = ScheduleMode::PHASED;
+  }
+  // Swept thread counts take CPUs that compilation workers would use
+  if (!thread_sweep.empty() && schedule_mode == ScheduleMode::PIPELINED) {
+    std::cerr << "Thread sweeps need idle CPUs, switching to "
+                 "--schedule=phased\n";
+    schedule_mode = ScheduleMode::PHASED;
+  }
+  // Compilation workers would be noise on top of the stressors
+  if ((!contention_profiles.empty() || !replica_sweep.empty()) &&
+      schedule_mode == ScheduleMode::PIPELINED) {
+    std::cerr << "Contention and replica measurements need controlled "
+                 "neighbours, "
+                 "switching to --schedule=phased\n";
+    schedule_mode = ScheduleMode::PHASED;
+  }
+  // Interleaving and reporting switch the global build settings between
+  // pipelines (use_pipeline), which compilation workers read
+  if (!manager.get_comparison_pipelines().empty() &&
+      schedule_mode == ScheduleMode::PIPELINED) {
+    std::cerr << "Pipeline comparisons switch the build settings while "
+                 "measuring, switching to --schedule=phased\n";
+    schedule_mode = ScheduleMode::PHASED;
+  }
+  // RAPL counts the whole package, compilation workers included
+  if (energy_config.enabled && schedule_mode == ScheduleMode::PIPELINED) {
+    std::cerr << "Package energy counts every core, switching to "
+                 "--schedule=phased\n";
+    schedule_mode = ScheduleMode::PHASED;
+  }
+  // The memory controllers serve the whole package as well
+  if (program.get<bool>("--dram-traffic") &&
+      schedule_mode == ScheduleMode::PIPELINED) {
+    std::cerr << "DRAM traffic counts every core, switching to "
+                 "--schedule=phased\n";
+    schedule_mode = ScheduleMode::PHASED;
+  }
+  // System wide counters on every CPU count the compilation workers too
+  if (thread_scope == ThreadScope::PER_CORE &&
+      schedule_mode == ScheduleMode::PIPELINED) {
+    std::cerr << "Per core counting covers every CPU, switching to "
+                 "--schedule=phased\n";
+    schedule_mode = ScheduleMode::PHASED;
+  }
+  // Before anything runs next to it
+  manager.measure_idle_power(manager.get_measure_cpu());
+
+  return std::nullopt;
+}
+
+bool BenchmarkRun::measure_task(KernelTask &task, SandboxResult &measured) {
+  std::cout << "Starting Execution: \n";
+  auto measure = [this, &task]() {
+    SandboxResult measured;
+    // Tails of the model's own shapes only
+    manager.set_call_latency(
+        task.shape_variant.empty() ? call_latency_calls : 0);
+    if (task.pipeline_ll_filepaths.empty())
+      measured.samples = manager.execute_with_parameters(
+          task.ll_filepath, task.json_filepath, &task.kernel,
+          &measured.warmup, &measured.cold, &measured.baselines);
+    else
+      measure_interleaved(manager, task, measured, sample_run_count,
+                          interleave_rounds, sampling);
+    // A dynamic shape kernel runs every swept shape on the same object,
+    // the runtime dimensions come from each shape's metadata
+    for (const auto &[shape, json_filepath] : task.dynamic_shapes) {
+      if (!fs::exists(json_filepath))
+        continue;
+      std::cout << "Shape " << shape << " (dynamic):\n";
+      measured.shapes[shape] = manager.execute_with_parameters(
+          task.ll_filepath, json_filepath);
+    }
+    // Sparse inputs at every swept density, with the configured
+    // distribution and block size
+    auto sweep_densities = [&]() {
+      for (const auto &[name, density] : density_sweep) {
+        std::cout << "Density " << name << ":\n";
+        InputProfile swept = input_profile;
+        swept.profile = DataProfile::SPARSE;
+        swept.sparsity.sparsity_percentage = 1.f - density;
+        manager.set_input_profile(swept);
+        measured.densities[name] = manager.execute_with_parameters(
+            task.ll_filepath, task.json_filepath);
+      }
+      manager.set_input_profile(input_profile);
+    };
+    // Sparse variants are compared to their model kernel at each density
+    if (!task.sparse_args.empty())
+      sweep_densities();
+    // Shape and data order variants only feed their own summaries
+    if (!task.shape_variant.empty())
+      return measured;
+
+    // Every swept layout loads its own copy of the kernel, since the
+    // prepared one was released by the run above
+    for (LayoutKind layout : layout_sweep) {
+      if (layout == input_layout)
+        continue;
+      std::cout << "Layout " << MemRefLayout::describe(layout) << ":\n";
+      manager.set_input_layout(layout);
+      measured.layouts[MemRefLayout::describe(layout)] =
+          manager.execute_with_parameters(task.ll_filepath, task.json_filepath);
+    }
+    manager.set_input_layout(input_layout);
+    sweep_densities();
+
+    // Value dependent slowdowns (denormals, NaN, inf), the main profile
+    // is already measured
+    for (DataProfile profile : profile_sweep) {
+      if (profile == input_profile.profile)
+        continue;
+      std::string name = TensorFuzzer::describe(profile);
+      std::cout << "Profile " << name << ":\n";
+      InputProfile swept = input_profile;
+      swept.profile = profile;
+      manager.set_input_profile(swept);
+      measured.profiles[name] = manager.execute_with_parameters(
+          task.ll_filepath, task.json_filepath);
+    }
+    manager.set_input_profile(input_profile);
+
+    // The same measurement again next to each profile's stressors, which
+    // only run while this kernel is measured
+    for (const ContentionProfile &profile : contention_profiles) {
+      ContentionGenerator stressors(profile, manager.get_measure_cpu());
+      if (!stressors.start()) {
+        std::cerr << "No CPU for contention " << profile.name()
+                  << " next to CPU " << manager.get_measure_cpu()
+                  << ", skipping it\n";
+        continue;
+      }
+      std::cout << "Contention " << profile.name() << " on "
+                << stressors.cpus().size() << " CPU(s):\n";
+      measured.contentions[profile.name()] =
+          manager.execute_with_parameters(task.ll_filepath, task.json_filepath);
+    }
+
+    // Each thread count runs in its own worker process, since the OpenMP
+    // and async runtimes size their thread pools only once
+    for (unsigned int threads : thread_sweep) {
+      std::cout << "Threads " << threads << ":\n";
+      manager.set_thread_budget(threads);
+      SandboxResult swept;
+      std::string failure;
+      if (KernelSandbox::run(
+              [this, &task]() {
+                SandboxResult result;
+                result.samples = manager.execute_with_parameters(
+                    task.ll_filepath, task.json_filepath);
+                return result;
+              },
+              kernel_timeout, swept, failure))
+        measured.threads[threads] = swept.samples;
+      else
+        std::cerr << "Thread count " << threads << " failed: " << failure
+                  << std::endl;
+    }
+    manager.set_thread_budget(0);
+
+    // Replicas of the kernel on their own cores, all loaded at once
+    for (unsigned int count : replica_sweep) {
+      std::vector<int> cpus =
+          ReplicaGroup::replica_cpus(count, manager.get_measure_cpu());
+      if (cpus.size() < count) {
+        std::cerr << "Only " << cpus.size() << " cores for " << count
+                  << " replicas, skipping them\n";
+        continue;
+      }
+      std::cout << "Replicas " << count << ":\n";
+      std::vector<std::map<std::string, double>> samples;
+      std::string failure;
+      if (ReplicaGroup::run(
+              cpus,
+              [this, &task](int cpu) {
+                // A fresh arena, placed for this replica's CPU
+                manager.set_measure_cpu(cpu);
+                manager.release_tensor_arena();
+                return manager.execute_with_parameters(
+                    task.ll_filepath, task.json_filepath);
+              },
+              kernel_timeout, samples, failure))
+        measured.replicas[count] = samples;
+      else
+        std::cerr << count << " replicas failed: " << failure
+                  << std::endl;
+    }
+    return measured;
+  };
+
+  if (!isolate_kernels) {
+    measured = measure();
+    return true;
+  }
+  return KernelSandbox::run(measure, kernel_timeout, measured,
+                            task.failure);
+}
+
+void BenchmarkRun::report_task(KernelTask &task, SandboxResult &measured) {
+  std::vector<std::map<std::string, double>> &results = measured.samples;
+  task.warmup_results = measured.warmup;
+  task.cold_results = measured.cold;
+  task.layout_results = measured.layouts;
+  task.thread_results = measured.threads;
+  task.density_results = measured.densities;
+  task.profile_results = measured.profiles;
+  task.pipeline_results = measured.pipelines;
+  task.baseline_results = measured.baselines;
+  task.contention_results = measured.contentions;
+  task.dynamic_shape_results = measured.shapes;
+  task.replica_results = measured.replicas;
+
+  if (!report_kernel_results(manager, task, results, report_metrics,
+                             outputFolderPath,
+                             task.shape_variant.empty() ? ""
+                             : task.fused   ? ".fused"
+                             : task.dynamic ? ".dynamic"
+                             : task.const_args ? ".const"
+                             : !task.sparse_args.empty() ? ".sparse"
+                             : task.data_order != DataOrder::NCHW
+                                 ? ".order-" + task.shape_variant
+                                 : ".shape-" + task.shape_variant))
+    reporting_failed = true;
+  if (!task.cold_results.empty() &&
+      !report_kernel_results(manager, task, task.cold_results,
+                             report_metrics, outputFolderPath, ".cold",
+                             &task.cold_average_metrics))
+    reporting_failed = true;
+  for (const auto &[layout, layout_samples] : task.layout_results)
+    if (!report_kernel_results(manager, task, layout_samples, report_metrics,
+                               outputFolderPath, ".layout-" + layout,
+                               &task.layout_average_metrics[layout]))
+      reporting_failed = true;
+  // Sparse variants share the model kernel's file name
+  for (const auto &[density, density_samples] : task.density_results)
+    if (!report_kernel_results(
+            manager, task, density_samples, report_metrics, outputFolderPath,
+            (task.sparse_args.empty() ? "" : ".sparse") +
+                std::string(".density-") + density,
+            &task.density_average_metrics[density]))
+      reporting_failed = true;
+  for (const auto &[profile, profile_samples] : task.profile_results)
+    if (!report_kernel_results(manager, task, profile_samples,
+                               report_metrics, outputFolderPath,
+                               ".profile-" + profile,
+                               &task.profile_average_metrics[profile]))
+      reporting_failed = true;
+  for (const auto &[threads, thread_samples] : task.thread_results)
+    if (!report_kernel_results(manager, task, thread_samples, report_metrics,
+                               outputFolderPath,
+                               ".threads-" + std::to_string(threads),
+                               &task.thread_average_metrics[threads]))
+      reporting_failed = true;
+  // Annotated with the comparison pipeline's own build settings
+  for (const PipelineSpec &pipeline : manager.get_comparison_pipelines()) {
+    auto samples = task.pipeline_results.find(pipeline.label);
+    if (samples == task.pipeline_results.end())
+      continue;
+    manager.use_pipeline(pipeline);
+    if (!report_kernel_results(
+            manager, task, samples->second, report_metrics, outputFolderPath,
+            ".pipeline-" + pipeline.label,
+            &task.pipeline_average_metrics[pipeline.label]))
+      reporting_failed = true;
+  }
+  manager.use_pipeline(manager.get_primary_pipeline());
+  for (const auto &[baseline, baseline_samples] : task.baseline_results)
+    if (!report_kernel_results(manager, task, baseline_samples,
+                               report_metrics, outputFolderPath, "." + baseline,
+                               &task.baseline_average_metrics[baseline]))
+      reporting_failed = true;
+  for (const auto &[contention, contention_samples] :
+       task.contention_results)
+    if (!report_kernel_results(
+            manager, task, contention_samples, report_metrics,
+            outputFolderPath, ".contention-" + contention,
+            &task.contention_average_metrics[contention]))
+      reporting_failed = true;
+  for (const auto &[replicas, replica_samples] : task.replica_results)
+    if (!report_kernel_results(manager, task, replica_samples,
+                               report_metrics, outputFolderPath,
+                               ".replicas-" + std::to_string(replicas),
+                               &task.replica_average_metrics[replicas]))
+      reporting_failed = true;
+  for (const auto &[shape, shape_samples] : task.dynamic_shape_results)
+    if (!report_kernel_results(manager, task, shape_samples, report_metrics,
+                               outputFolderPath, ".dynamic-" + shape,
+                               &task.dynamic_shape_average_metrics[shape]))
+      reporting_failed = true;
+  // Committed before the manifest lists the kernel as measured, both on
+  // the result writer's thread
+  ResultsStore::record_kernel(task);
+  ResultWriter::call([]() { ResultsStore::flush(); });
+  kernel_manifest->record(task, outputFolderPath);
+  Telemetry::kernel_done(task, "measured", sample_count(measured));
+}
+
+int BenchmarkRun::measure_shard() {
+  std::vector<KernelTask> tasks;
+  if (!Distributed::read_shard(worker_shard, tasks))
+    return 1;
+  KernelScheduler scheduler(manager, schedule_mode, jobs, queue_depth,
+                            manager.get_measure_cpu());
+  std::vector<uint8_t> written(tasks.size(), 0);
+  scheduler.run(tasks, [&](KernelTask &task) {
+    size_t index = &task - tasks.data();
+    SandboxResult measured;
+    bool ok = measure_task(task, measured);
+    written[index] = Distributed::write_worker_result(
+        worker_shard, index, ok ? &measured : nullptr, task.failure);
+  });
+  for (size_t t = 0; t < tasks.size(); t++)
+    if (!written[t])
+      Distributed::write_worker_result(worker_shard, t, nullptr,
+                                       "compilation failed on the worker");
+  std::ofstream(fs::path(worker_shard).append("results").append(
+      "fingerprint.json"))
+      << Distributed::fingerprint().dump(2) << "\n";
+  return 0;
+}
+
+std::optional<int> BenchmarkRun::prepare_kernels() {
+  TelemetryConfig telemetry;
+  telemetry.progress = program.get<std::string>("--progress");
+  telemetry.metrics_listen = program.get<std::string>("--metrics-listen");
+  telemetry.interval_seconds = program.get<double>("--progress-interval");
+  Telemetry::start(telemetry, manager.get_measure_cpu(),
+                   fs::path(outputFolderPath).filename().string());
+
+  // Lowering the model
+  Telemetry::stage("isolation");
+  manager.isolate_torch_kernels(model_file);
+
+  // Collect every isolated kernel, grouped by operator type
+  if (!KernelIndex::load(manager.get_lowering_folder(), tasks))
+    return 1;
+  if (std::vector<std::string> ops =
+          KernelPriority::parse_ops(program.get<std::string>("--ops"));
+      !ops.empty()) {
+    size_t isolated = tasks.size();
+    tasks.erase(std::remove_if(tasks.begin(), tasks.end(),
+                               [&ops](const KernelTask &task) {
+                                 return !KernelPriority::op_selected(
+                                     task.op_type, ops);
+                               }),
+                tasks.end());
+    std::cout << "--ops keeps " << tasks.size() << " of " << isolated
+              << " kernels\n";
+  }
+  for (const KernelTask &task : tasks)
+    if (operation_types.insert(task.op_type).second)
+      std::cout << "Operation Types: " << task.op_type << std::endl;
+
+  // Measurements run on a reserved CPU which compilation workers never use
+  measure_cpu = manager.get_measure_cpu();
+
+  // Tasks
+  //  1. Extract argument metadata     (parallel, --jobs workers)
+  //  2. Deduplicate identical kernels
+  //  3. Lower to LLVM-IR              (parallel, --jobs workers)
+  //  4. Create executable             (parallel, --jobs workers)
+  //  5. Execute and Time it           (serialised on the reserved CPU)
+  //  6. Generate aggregate and comparative results
+  if (metadata_source == MetadataSource::ISOLATION)
+    KernelMetadata::emit_for_isolated_kernels(
+        tasks, manager.get_lowering_folder().append(
+                   "metadata_manifest.json"));
+  // A cached isolation brings the metadata its first run generated
+  if (manager.isolation_from_cache())
+    for (KernelTask &task : tasks)
+      if (!task.metadata_ready && fs::exists(task.json_filepath))
+        task.metadata_ready = true;
+
+  // Remaining kernels (or all of them with --metadata-source=pass)
+  Telemetry::stage("metadata");
+  {
+    ThreadPool metadata_pool(jobs, measure_cpu);
+    for (KernelTask &task : tasks)
+      if (!task.metadata_ready)
+        metadata_pool.submit(
+            [this, &task]() { manager.prepare_metadata(task); });
+    metadata_pool.wait();
+  }
+  manager.store_isolation_metadata(tasks);
+
+  if (enable_dedup)
+    tasks = KernelDedup::deduplicate(tasks);
+
+  time_budget = parse_duration(program.get<std::string>("--time-budget"));
+  if (time_budget < 0.0) {
+    std::cerr << "Unreadable --time-budget \""
+              << program.get<std::string>("--time-budget") << "\"\n";
+    return 1;
+  }
+  fs::path priority_from = program.get<std::string>("--priority-from");
+  int max_kernels_per_op = program.get<int>("--max-kernels-per-op");
+  bool prioritised =
+      time_budget > 0.0 || !priority_from.empty() || max_kernels_per_op > 0;
+  std::string priority_basis;
+  if (prioritised) {
+    priority_basis = KernelPriority::assign(tasks, priority_from,
+                                            manager.get_primary_metric(),
+                                            manager.get_lowering_folder());
+    if (max_kernels_per_op > 0)
+      std::cout << "--max-kernels-per-op drops "
+                << KernelPriority::cap_per_op(tasks, max_kernels_per_op)
+                << " kernels with lower " << priority_basis << "\n";
+  }
+
+  // Representatives of the strata stand in for the rest, unless this run
+  // validates the extrapolation against all of them
+  double sample_fraction = 0.0;
+  size_t sample_count = 0;
+  if (!KernelSampling::parse(program.get<std::string>("--sample-kernels"),
+                             sample_fraction, sample_count)) {
+    std::cerr << "Unreadable --sample-kernels \""
+              << program.get<std::string>("--sample-kernels")
+              << "\", expected a fraction below 1 or a kernel count\n";
+    return 1;
+  }
+  sample_kernels = sample_fraction > 0.0 || sample_count > 0;
+  sample_validation = false;
+  sampling_state =
+      fs::path(outputFolderPath).parent_path().append("kernel_sampling.json");
+  sampling_model = fs::path(model_file).stem().string();
+  if (sample_kernels) {
+    sample_plan =
+        KernelSampling::plan(tasks, sample_fraction, sample_count);
+    sample_validation = KernelSampling::validation_due(
+        sampling_state, sampling_model,
+        std::max(0, program.get<int>("--sample-validate-every")));
+    std::cout << "--sample-kernels picks " << sample_plan.sampled << " of "
+              << sample_plan.kernels.size() << " unique kernels in "
+              << sample_plan.strata << " strata";
+    if (sample_validation)
+      std::cout << ", all are measured to validate the extrapolation\n";
+    else
+      std::cout << ", " << KernelSampling::apply(sample_plan, tasks)
+                << " are skipped\n";
+  }
+
+  // FROM_STATS inputs: recorded (or given) statistics next to the metadata
+  fs::path activation_stats = program.get<std::string>("--activation-stats");
+  if (std::string stats_model = program.get<std::string>("--stats-model");
+      !stats_model.empty()) {
+    if (activation_stats.empty())
+      activation_stats =
+          fs::path(outputFolderPath).append("activation_stats.json");
+    if (!ActivationStats::record(
+            program.get<std::string>("--stats-script"), stats_model,
+            program.get<std::string>("--stats-input-shape"),
+            activation_stats))
+      activation_stats.clear();
+  }
+  if (!activation_stats.empty())
+    std::cout << "Activation statistics for "
+              << ActivationStats::attach(activation_stats, tasks) << " of "
+              << tasks.size() << " kernels\n";
+  else if (input_profile.profile == DataProfile::FROM_STATS)
+    std::cerr << "--input-profile from-stats without --activation-stats or "
+                 "--stats-model, every kernel falls back to random-norm\n";
+
+  // Shape and data order variants of the unique kernels, lowered and
+  // measured like them. Identical variant sources hit the compilation cache.
+  std::vector<std::function<bool(KernelTask &)>> variant_jobs;
+  // --const-args weights: the model's literals of each kernel's layer. The
+  // text has to carry them, a bytecode model is printed in full for this.
+  std::map<size_t, std::map<size_t, std::string>> const_weights;
+  if (const_args.weights) {
+    std::set<size_t> layers;
+    for (const KernelTask &task : tasks)
+      if (const ModelLayer *layer = ModelLayers::find(task.mlir_filepath))
+        layers.insert(layer->index);
+    fs::path weights_text = manager.get_model_text_filepath();
+    bool printed = ModelSource::is_bytecode(model_file);
+    if (printed) {
+      weights_text = fs::path(outputFolderPath)
+                         .append(fs::path(model_file).stem().string() +
+                                 ".weights.mlir");
+      if (!ModelSource::write_text(model_file, weights_text, 0))
+        weights_text.clear();
+    }
+    if (!weights_text.empty() && !layers.empty())
+      const_weights =
+          ConstantArgs::model_weights(weights_text, operation_types, layers);
+    if (printed) {
+      std::error_code ec;
+      fs::remove(weights_text, ec);
+    }
+    if (const_weights.empty())
+      std::cerr << "--const-args weights: no model weights reach the "
+                   "kernels (elided or not literals)\n";
+  }
+  for (size_t t = 0; t < tasks.size(); t++) {
+    if (!tasks[t].metadata_ready)
+      continue;
+    auto shape_job = [this, t](const ShapeScale &scale) {
+      return [this, t, scale](KernelTask &variant) {
+        return manager.generate_shape_variant(tasks[t], scale, variant);
+      };
+    };
+    std::vector<ShapeScale> scales = shape_sweep;
+    if (!caches.empty() && working_set_ops.count(tasks[t].op_type))
+      for (const ShapeScale &scale : ShapeSweep::for_working_sets(
+               load_json_from_file(tasks[t].json_filepath), caches))
+        scales.push_back(scale);
+    for (const ShapeScale &scale : scales)
+      variant_jobs.push_back(shape_job(scale));
+    // One object for the model's shapes and all of the above
+    if (dynamic_shapes)
+      variant_jobs.push_back([this, t, scales](KernelTask &variant) {
+        return manager.generate_dynamic_variant(tasks[t], scales, variant);
+      });
+    if (data_order_ops.count(tasks[t].op_type))
+      for (DataOrder order : data_order_sweep)
+        variant_jobs.push_back([this, t, order](KernelTask &variant) {
+          return manager.generate_order_variant(tasks[t], order, variant);
+        });
+    if (!const_args.empty()) {
+      std::map<size_t, std::string> weights;
+      if (const ModelLayer *layer = ModelLayers::find(tasks[t].mlir_filepath))
+        if (auto found = const_weights.find(layer->index);
+            found != const_weights.end())
+          weights = found->second;
+      if (!weights.empty() || !const_args.indices.empty())
+        variant_jobs.push_back([this, t, weights](KernelTask &variant) {
+          return manager.generate_const_variant(tasks[t], const_args, weights,
+                                                variant);
+        });
+    }
+    if (!sparse_args.empty() && sparse_ops.count(tasks[t].op_type))
+      variant_jobs.push_back([this, t](KernelTask &variant) {
+        return manager.generate_sparse_variant(tasks[t], sparse_args, variant);
+      });
+  }
+  if (!variant_jobs.empty()) {
+    std::vector<KernelTask> variants(variant_jobs.size());
+    std::vector<uint8_t> generated(variants.size(), 0);
+    {
+      ThreadPool variant_pool(jobs, measure_cpu);
+      for (size_t slot = 0; slot < variant_jobs.size(); slot++)
+        variant_pool.submit([&, slot]() {
+          generated[slot] = variant_jobs[slot](variants[slot]);
+        });
+      variant_pool.wait();
+    }
+    size_t variant_count = 0;
+    for (size_t slot = 0; slot < variants.size(); slot++)
+      if (generated[slot]) {
+        tasks.push_back(std::move(variants[slot]));
+        variant_count++;
+      }
+    std::cout << "Shape and data order sweeps: " << variant_count
+              << " kernel variants\n";
+  }
+
+  // Fused subgraphs are measured like the variants, the model summaries
+  // leave them out
+  if (fusion.granularity != FusionGranularity::OP) {
+    std::vector<KernelTask> subgraphs = SubgraphIsolation::isolate(
+        manager.get_model_text_filepath(), operation_types, fusion,
+        manager.get_lowering_folder());
+    std::cout << "Subgraph isolation (" << SubgraphIsolation::describe(fusion)
+              << "): " << subgraphs.size() << " distinct subgraphs\n";
+    tasks.insert(tasks.end(), std::make_move_iterator(subgraphs.begin()),
+                 std::make_move_iterator(subgraphs.end()));
+  }
+
+  // --autotune: candidate pipelines instead of the benchmark
+  if (std::string autotune_template = program.get<std::string>("--autotune");
+      !autotune_template.empty()) {
+    AutotuneConfig autotune;
+    autotune.template_json = autotune_template;
+    autotune.scope = program.get<std::string>("--autotune-scope") == "kernel"
+                         ? TuneScope::KERNEL
+                         : TuneScope::OP_TYPE;
+    autotune.search = program.get<std::string>("--autotune-search") == "random"
+                          ? TuneSearch::RANDOM
+                          : TuneSearch::BAYESIAN;
+    autotune.trials = std::max(1, program.get<int>("--autotune-trials"));
+    autotune.samples = std::max(1, sample_run_count);
+    autotune.probe_samples = std::min(2u, autotune.samples);
+    autotune.early_stop =
+        std::max(1.0, program.get<double>("--autotune-early-stop"));
+    autotune.jobs = jobs;
+    autotune.measure_cpu = measure_cpu;
+    autotune.seed = input_seed;
+    std::string metric = manager.get_primary_metric();
+    Autotuner tuner(manager, autotune);
+    if (!tuner.load_template())
+      return 1;
+    bool tuned = tuner.run(
+        tasks,
+        [&](KernelTask &task, const fs::path &ll, unsigned int samples,
+            double &value) {
+          manager.set_perf_sample_run_count(samples);
+          auto run_candidate = [&]() {
+            SandboxResult result;
+            result.samples =
+                manager.execute_with_parameters(ll, task.json_filepath);
+            return result;
+          };
+          SandboxResult result;
+          std::string failure;
+          bool ok = true;
+          if (isolate_kernels)
+            ok = KernelSandbox::run(run_candidate, kernel_timeout, result,
+                                    failure);
+          else
+            result = run_candidate();
+          manager.set_perf_sample_run_count(sample_run_count);
+          if (!ok)
+            std::cerr << "Candidate failed on " << task.mlir_filepath.filename()
+                      << ": " << failure << "\n";
+          if (!ok || result.samples.empty())
+            return false;
+          std::vector<double> values;
+          for (const auto &sample : result.samples)
+            values.push_back(sample.count(metric) ? sample.at(metric) : 0.0);
+          value = Statistics::mean(values);
+          return true;
+        },
+        outputFolderPath);
+    CompileCache::print_statistics();
+    PassPrefixCache::print_statistics();
+    return tuned ? 0 : 1;
+  }
+
+  if (!ResultsStore::open(
+          outputFolderPath, model_file, manager.get_primary_pipeline().label,
+          manager.get_primary_metric(),
+          Statistics::describe(manager.get_outlier_config().method)))
+    std::cerr << "Samples are only kept in memory for the summaries, pass "
+                 "--csv-export to keep them\n";
+
+  // --resume: kernels finished before only rejoin for the summaries
+  if (!resume_dir.empty()) {
+    auto resumed = std::stable_partition(
+        tasks.begin(), tasks.end(), [&](KernelTask &task) {
+          return !task.metadata_ready || !kernel_manifest->restore(task);
+        });
+    resumed_tasks.assign(std::make_move_iterator(resumed),
+                         std::make_move_iterator(tasks.end()));
+    tasks.erase(resumed, tasks.end());
+    std::cout << "Resuming: " << resumed_tasks.size()
+              << " kernels already measured, " << tasks.size() << " left\n";
+  }
+  Telemetry::set_total(tasks.size() + resumed_tasks.size());
+  for (const KernelTask &task : resumed_tasks)
+    Telemetry::kernel_done(task, "reused", 0);
+
+  // --cost-model: the kernels that weigh most in the model are measured
+  // first, so a --time-budget is spent on them
+  if (std::string cost_model_json = program.get<std::string>("--cost-model");
+      !cost_model_json.empty() && cost_model.load(cost_model_json)) {
+    for (KernelTask &task : tasks)
+      if (task.metadata_ready)
+        task.predicted_cost = cost_model.predict(CostModel::features_of(
+            task, manager.get_primary_pipeline().label));
+    std::stable_sort(tasks.begin(), tasks.end(),
+                     [](const KernelTask &a, const KernelTask &b) {
+                       return a.predicted_cost * a.multiplicity >
+                              b.predicted_cost * b.multiplicity;
+                     });
+    std::cout << "Kernels ordered by predicted " << cost_model.metric()
+              << " times multiplicity\n";
+  } else if (time_budget > 0.0 || !priority_from.empty()) {
+    KernelPriority::order(tasks);
+    std::cout << "Kernels ordered by " << priority_basis
+              << " times multiplicity\n";
+  }
+
+  // --workers measure everything they can, the coordinator what is left
+  local_indices.resize(tasks.size());
+  std::iota(local_indices.begin(), local_indices.end(), 0);
+  bool cross_target =
+      TargetInfo::is_cross(manager.get_primary_pipeline().target);
+  if (cross_target) {
+    // Shards carry the objects instead of the kernels to lower
+    Telemetry::stage("cross_compile");
+    ThreadPool cross_pool(jobs, measure_cpu);
+    for (KernelTask &task : tasks)
+      cross_pool.submit([this, &task]() { manager.prepare_kernel(task); });
+    cross_pool.wait();
+  }
+  if (!distributed.hosts.empty()) {
+    Telemetry::stage("workers");
+    local_indices = Distributed::coordinate(
+        tasks, distributed, outputFolderPath, pipelineJsonPath,
+        [&](KernelTask &task, const SandboxResult *result) {
+          if (!result) {
+            KernelSandbox::write_failure_record(task, task.failure,
+                                                outputFolderPath);
+            kernel_manifest->record(task, outputFolderPath);
+            Telemetry::kernel_done(task, "failed", 0);
+            return;
+          }
+          SandboxResult measured = *result;
+          task.prepared = task.measured = true;
+          report_task(task, measured);
+        });
+  }
+  // What no worker took cannot run on this host
+  if (cross_target) {
+    for (size_t t : local_indices) {
+      KernelTask &task = tasks[t];
+      task.failure = task.cross_object.empty()
+                         ? "cross compilation failed"
+                         : "no worker measured it";
+      KernelSandbox::write_failure_record(task, task.failure,
+                                          outputFolderPath);
+      kernel_manifest->record(task, outputFolderPath);
+      Telemetry::kernel_done(task, "failed", 0);
+    }
+    local_indices.clear();
+  }
+  for (size_t t : local_indices)
+    local_tasks.push_back(std::move(tasks[t]));
+
+  // Comparison pipelines are compiled up front, one pipeline at a time since
+  // the build settings are global
+  for (const PipelineSpec &pipeline :
+       manager.get_comparison_pipelines()) {
+    std::cout << "Compiling for pipeline " << pipeline.label << "\n";
+    manager.use_pipeline(pipeline);
+    ThreadPool pipeline_pool(jobs, measure_cpu);
+    for (KernelTask &task : local_tasks)
+      if (task.metadata_ready && task.shape_variant.empty())
+        pipeline_pool.submit([this, &task, &pipeline]() {
+          manager.prepare_pipeline_variant(task, pipeline);
+        });
+    pipeline_pool.wait();
+  }
+  manager.use_pipeline(manager.get_primary_pipeline());
+  return std::nullopt;
+}
+
+void BenchmarkRun::compile_and_measure() {
+  Telemetry::stage("compile_and_measure");
+  KernelScheduler scheduler(manager, schedule_mode, jobs, queue_depth,
+                            measure_cpu);
+  scheduler.set_time_budget(time_budget);
+  scheduler.run(local_tasks, [&](KernelTask &task) {
+    if (previous_manifest &&
+        previous_manifest->reuse(task, only_changed, outputFolderPath)) {
+      std::cout << "Unchanged LLVM IR, reusing the results of "
+                << task.mlir_filepath.filename() << "\n";
+      ResultsStore::copy_kernel(only_changed, task);
+      kernel_manifest->record(task, outputFolderPath);
+      Telemetry::kernel_done(task, "reused", 0);
+      return;
+    }
+    SandboxResult measured;
+    if (!measure_task(task, measured)) {
+      KernelSandbox::write_failure_record(task, task.failure,
+                                          outputFolderPath);
+      kernel_manifest->record(task, outputFolderPath);
+      Telemetry::kernel_done(task, "failed", 0);
+      return;
+    }
+    report_task(task, measured);
+  });
+}
+
+int BenchmarkRun::report_results() {
+  Telemetry::stage("reporting");
+  // Recorded as not measured, so --resume measures them later
+  size_t over_budget = 0;
+  for (const KernelTask &task : local_tasks)
+    if (task.skipped_budget) {
+      kernel_manifest->record(task, outputFolderPath);
+      over_budget++;
+    }
+  if (over_budget)
+    std::cerr << "--time-budget ran out, " << over_budget
+              << " kernels were not measured\n";
+  for (size_t i = 0; i < local_indices.size(); i++)
+    tasks[local_indices[i]] = std::move(local_tasks[i]);
+  tasks.insert(tasks.end(), std::make_move_iterator(resumed_tasks.begin()),
+               std::make_move_iterator(resumed_tasks.end()));
+  KernelScheduler::write_timeline(
+      tasks, fs::path(outputFolderPath).append("timeline.csv"));
+  // Model summaries below only cover the model's own kernels
+  auto model_end = std::stable_partition(
+      tasks.begin(), tasks.end(),
+      [](const KernelTask &t) { return t.shape_variant.empty(); });
+  std::vector<KernelTask> shape_tasks(std::make_move_iterator(model_end),
+                                      std::make_move_iterator(tasks.end()));
+  tasks.erase(model_end, tasks.end());
+  if (!shape_sweep.empty())
+    write_shape_scaling(
+        tasks, shape_tasks, manager.get_primary_metric(),
+        fs::path(outputFolderPath).append("shape_scaling.csv"));
+  if (dynamic_shapes)
+    write_shape_specialization(
+        tasks, shape_tasks, manager.get_primary_metric(),
+        fs::path(outputFolderPath).append("shape_specialization.csv"));
+  if (sample_kernels) {
+    std::vector<Extrapolation> totals = KernelSampling::extrapolate(
+        sample_plan, tasks, manager.get_primary_metric());
+    KernelSampling::write_extrapolation(
+        totals, manager.get_primary_metric(),
+        fs::path(outputFolderPath).append("sample_extrapolation.csv"));
+    double sample_error = std::nan("");
+    bool sample_within = false;
+    if (sample_validation)
+      KernelSampling::validate(
+          totals, sample_plan, tasks, manager.get_primary_metric(),
+          fs::path(outputFolderPath).append("sample_validation.csv"),
+          sample_error, sample_within);
+    KernelSampling::record_run(sampling_state, sampling_model,
+                               outputFolderPath, sample_error, sample_within);
+  }
+  if (!const_args.empty())
+    write_const_specialization(
+        tasks, shape_tasks, manager.get_primary_metric(),
+        fs::path(outputFolderPath).append("const_specialization.csv"));
+  if (!sparse_args.empty())
+    write_sparse_crossover(
+        tasks, shape_tasks, manager.get_primary_metric(),
+        fs::path(outputFolderPath).append("sparse_crossover.csv"));
+  if (!data_order_sweep.empty())
+    write_data_order_sweep(
+        tasks, shape_tasks, manager.get_primary_metric(),
+        fs::path(outputFolderPath).append("data_order.csv"));
+  if (fusion.granularity != FusionGranularity::OP)
+    SubgraphIsolation::write_opportunities(
+        tasks, shape_tasks, manager.get_primary_metric(),
+        manager.get_lowering_folder(),
+        fs::path(outputFolderPath).append("fusion_opportunities.csv"));
+  if (!caches.empty())
+    write_working_set_sweep(
+        tasks, shape_tasks, caches, manager.get_primary_metric(),
+        fs::path(outputFolderPath).append("working_set.csv"));
+  if (enable_dedup)
+    KernelDedup::write_groups(
+        tasks, fs::path(outputFolderPath).append("kernel_groups.csv"));
+  // Per kernel statistics such as ci95 do not add up across kernels
+  std::vector<std::string> total_metrics;
+  for (const ReportMetric &metric :
+       manager.get_report_metric_definitions())
+    if (metric.aggregation == MetricAggregation::SUM)
+      total_metrics.push_back(metric.name);
+  KernelDedup::write_weighted_totals(
+      tasks, total_metrics,
+      fs::path(outputFolderPath).append("model_totals.csv"));
+
+  // --end-to-end: the whole model as one more task, after its kernels so
+  // that the reserved CPU measures them in the same state
+  std::vector<KernelTask> model_tasks;
+  if (program.get<bool>("--end-to-end")) {
+    model_tasks.resize(1);
+    if (ModelBenchmark::prepare(model_file, manager.get_lowering_folder(),
+                                model_tasks[0])) {
+      std::cout << "Running the model end to end\n";
+      Telemetry::stage("end_to_end");
+      KernelScheduler(manager, ScheduleMode::PHASED, 1, queue_depth,
+                      measure_cpu)
+          .run(model_tasks, [&](KernelTask &task) {
+            SandboxResult measured;
+            if (!measure_task(task, measured)) {
+              KernelSandbox::write_failure_record(task, task.failure,
+                                                  outputFolderPath);
+              kernel_manifest->record(task, outputFolderPath);
+              return;
+            }
+            report_task(task, measured);
+          });
+    }
+    const KernelTask &model_task = model_tasks[0];
+    if (!model_task.measured || !model_task.failure.empty()) {
+      std::cerr << "The end-to-end model run failed, no model_vs_kernels.csv\n";
+      reporting_failed = true;
+    } else {
+      ModelBenchmark::write_comparison(
+          model_task, tasks, total_metrics,
+          fs::path(outputFolderPath).append("model_vs_kernels.csv"));
+    }
+  }
+
+  // Kernels in model order on their producers' outputs
+  if (program.get<bool>("--replay")) {
+    auto measure_replayed =
+        [&](const KernelTask &task,
+            std::vector<std::map<std::string, double>> &samples) {
+          auto run = [this, &task]() {
+            SandboxResult result;
+            result.samples = manager.execute_with_parameters(
+                task.ll_filepath, task.json_filepath);
+            return result;
+          };
+          SandboxResult result;
+          std::string failure;
+          if (!isolate_kernels)
+            result = run();
+          else if (!KernelSandbox::run(run, kernel_timeout, result,
+                                       failure)) {
+            std::cerr << "Replay of " << task.ll_filepath.filename()
+                      << " failed: " << failure << std::endl;
+            return false;
+          }
+          samples = result.samples;
+          return !samples.empty();
+        };
+    std::vector<ReplayedLayer> replayed = ModelReplay::run(
+        manager, tasks, operation_types, manager.get_model_text_filepath(),
+        program.get<std::string>("--tensor-source"), outputFolderPath,
+        measure_replayed);
+    for (KernelTask &task : tasks)
+      if (!task.replay_results.empty() &&
+          !report_kernel_results(manager, task, task.replay_results,
+                                 report_metrics, outputFolderPath, ".replay",
+                                 &task.replay_average_metrics))
+        reporting_failed = true;
+    ModelReplay::write_comparison(
+        replayed, manager.get_primary_metric(),
+        fs::path(outputFolderPath).append("replay_vs_isolated.csv"));
+  }
+
+  // Per layer cost in model order, against the whole model if it was run
+  std::string timeline_metric = manager.get_primary_metric();
+  if (std::find(total_metrics.begin(), total_metrics.end(),
+                timeline_metric) == total_metrics.end() &&
+      !total_metrics.empty())
+    timeline_metric = total_metrics.front();
+  ModelLayers::write_timeline(
+      tasks, timeline_metric, model_tasks.empty() ? nullptr : &model_tasks[0],
+      fs::path(outputFolderPath).append("layer_timeline.csv"));
+  LinalgStructures::write_classes(
+      tasks, timeline_metric,
+      fs::path(outputFolderPath).append("structure_classes.csv"));
+  if (!cost_model.empty())
+    cost_model.write_check(
+        tasks, program.get<double>("--cost-model-tolerance"),
+        fs::path(outputFolderPath).append("cost_model_check.csv"));
+  if (program.get<bool>("--code-footprint"))
+    CodeFootprint::write_correlation(
+        tasks, fs::path(outputFolderPath).append("code_footprint.csv"));
+
+  if (profile_config.flamegraph) {
+    std::vector<std::pair<fs::path, double>> folded_stacks;
+    for (const KernelTask &task : tasks)
+      folded_stacks.emplace_back(
+          KernelProfiler::flamegraph_path(outputFolderPath, task.op_type,
+                                          task.json_filepath.stem().string()),
+          task.multiplicity);
+    KernelProfiler::merge_folded_stacks(folded_stacks,
+                                        fs::path(outputFolderPath)
+                                            .append("flamegraphs")
+                                            .append("model.folded"));
+  }
+
+  if (!layout_sweep.empty())
+    write_layout_sensitivity(
+        tasks, manager.get_primary_metric(),
+        fs::path(outputFolderPath).append("layout_sensitivity.csv"));
+  if (cache_mode == CacheMode::BOTH)
+    write_cache_sensitivity(
+        tasks, manager.get_primary_metric(),
+        fs::path(outputFolderPath).append("cache_sensitivity.csv"));
+  if (!density_sweep.empty())
+    write_density_sensitivity(
+        tasks, manager.get_primary_metric(),
+        fs::path(outputFolderPath).append("density_sensitivity.csv"));
+  if (!profile_sweep.empty())
+    write_profile_sensitivity(
+        tasks, manager.get_primary_metric(),
+        program.get<double>("--profile-threshold"),
+        fs::path(outputFolderPath).append("profile_sensitivity.csv"));
+  if (!comparison_pipelines.empty() || out_params || pgo)
+    write_pipeline_comparison(
+        tasks, manager.get_primary_metric(),
+        fs::path(outputFolderPath).append("pipeline_comparison.csv"));
+  if (!contention_profiles.empty())
+    write_contention_slowdown(
+        tasks, manager.get_primary_metric(),
+        fs::path(outputFolderPath).append("contention_slowdown.csv"));
+  if (!torch_baselines.empty())
+    write_torch_baseline(
+        tasks, manager.get_primary_metric(),
+        fs::path(outputFolderPath).append("torch_baseline.csv"));
+  if (!sweep_points.empty())
+    write_pipeline_sweep(
+        tasks, manager.get_primary_metric(), sweep, sweep_points,
+        fs::path(outputFolderPath).append("pipeline_sweep.csv"));
+  if (!thread_sweep.empty())
+    write_thread_scaling(
+        tasks, fs::path(outputFolderPath).append("thread_scaling.csv"));
+  if (!replica_sweep.empty())
+    write_replica_scaling(
+        tasks, fs::path(outputFolderPath).append("replica_scaling.csv"));
+  if (call_latency_calls)
+    write_call_latency(
+        tasks, fs::path(outputFolderPath).append("call_latency.csv"));
+  if (manager.is_verifying())
+    write_verification_summary(
+        tasks, fs::path(outputFolderPath).append("verification.csv"));
+  write_sample_statistics(
+      tasks, fs::path(outputFolderPath).append("sample_statistics.csv"));
+  if (outlier_config.method != OutlierMethod::NONE)
+    write_rejected_samples(
+        tasks, manager.get_primary_metric(),
+        fs::path(outputFolderPath).append("rejected_samples.csv"));
+  if (CompileProfiler::is_enabled())
+    write_compile_profile(tasks, manager.get_primary_pipeline().label,
+                          outputFolderPath);
+
+  // Lowering command follows file structure
+  // lowerings/<type-of-op>/<kernel-name>.mlir
+
+  if (!ResultWriter::stop())
+    reporting_failed = true;
+
+  std::string trend_db = program.get<std::string>("--trend-db");
+  if (trend_db != "none") {
+    if (trend_db.empty())
+      trend_db = fs::path(outputFolderPath)
+                     .parent_path()
+                     .append("trends.sqlite")
+                     .string();
+    TrendRun trend_run;
+    trend_run.date = get_timestamp_string();
+    trend_run.output_dir = outputFolderPath;
+    trend_run.model = fs::path(model_file).stem().string();
+    trend_run.pipeline = manager.get_primary_pipeline().label;
+    trend_run.pipeline_hash = KernelManifest::pipeline_hash(pipelineJsonPath);
+    json fingerprint = Distributed::fingerprint();
+    trend_run.host = Distributed::fingerprint_id(fingerprint);
+    trend_run.host_fingerprint = fingerprint.dump();
+    trend_run.primary_metric = manager.get_primary_metric();
+    TrendStore::read_toolchain(buildPath, trend_run);
+    TrendStore::record(trend_db, trend_run, tasks, report_metrics);
+  }
+  ResultsStore::close();
+  json report;
+  if (program.get<bool>("--html-report") &&
+      (!HtmlReport::build({outputFolderPath}, {}, report) ||
+       !HtmlReport::write(report, outputFolderPath)))
+    reporting_failed = true;
+  TensorDump::flush();
+  CompileCache::print_statistics();
+  PassPrefixCache::print_statistics();
+  // Shared prefixes are intermediates like the kernels' .linalg stages
+  if (!program.get<bool>("--pass-logs")) {
+    std::error_code error;
+    fs::remove_all(fs::path(manager.get_lowering_folder()).append("prefixes"),
+                   error);
+  }
+  if (!scratch_folder.empty()) {
+    size_t kept = ScratchSpace::persist(
+        manager.get_lowering_folder(),
+        fs::path(outputFolderPath).append("lowerings"));
+    std::cout << "Kept " << kept << " kernel reports from " << scratch_folder
+              << "\n";
+  }
+  return reporting_failed ? 1 : 0;
+}
+
+/*
+ * The whole benchmark of one command line, formerly main(), on the
+ * session's `manager`. Runs under BenchmarkSession's process wide lock.
+ */
+static int run_benchmark(CommandManager &manager, int argc, char **args) {
+  // Take argument as model name
+  // Input: <model-mlir-file>
+
+  if (argc > 1 && std::string(args[1]) == "roofline")
+    return run_roofline(argc - 1, args + 1);
+  if (argc > 1 && std::string(args[1]) == "serve")
+    return run_server(argc - 1, args + 1);
+  if (argc > 1 && std::string(args[1]) == "compare")
+    return run_compare(argc - 1, args + 1);
+  if (argc > 1 && std::string(args[1]) == "report")
+    return run_report(argc - 1, args + 1);
+  if (argc > 1 && std::string(args[1]) == "trend")
+    return run_trend(argc - 1, args + 1);
+  if (argc > 1 && std::string(args[1]) == "cost-model")
+    return run_cost_model(argc - 1, args + 1);
+  if (argc > 1 && std::string(args[1]) == "convert-model")
+    return run_convert_model(argc - 1, args + 1);
+
+  BenchmarkRun run(manager);
+  if (std::optional<int> status = run.parse_options(argc, args))
+    return *status;
+
+  // Result files and store commits leave the measurement thread from here on
+  ResultWriter::start(manager.get_measure_cpu(), run.fsync_interval());
+
+  // --worker: measure a coordinator's shard, the kernels are already
+  // isolated, deduplicated and given their metadata
+  if (run.is_worker())
+    return run.measure_shard();
+
+  if (std::optional<int> status = run.prepare_kernels())
+    return *status;
+  run.compile_and_measure();
+  return run.report_results();
+}
+
+// The compile cache, the result writer and the counter sessions are process
+// wide
+static std::mutex session_mutex;
+
+// Process wide state a previous session may have filled
+static void reset_session_state() {
+  PassPrefixCache::reset();
+  LinalgStructures::clear();
+}
+
+BenchmarkSession::BenchmarkSession(std::vector<std::string> arguments,
+                                   std::string program_name)
+    : m_program_name(std::move(program_name)),
+      m_arguments(std::move(arguments)) {}
+
+const std::vector<std::string> &BenchmarkSession::arguments() const {
+  return m_arguments;
+}
+
+int BenchmarkSession::run(const std::function<void()> &on_start) {
+  // argparse wants a mutable argv, backed by copies owned by this call
+  std::vector<std::string> storage = {m_program_name};
+  storage.insert(storage.end(), m_arguments.begin(), m_arguments.end());
+  std::vector<char *> argv;
+  for (std::string &argument : storage)
+    argv.push_back(argument.data());
+  argv.push_back(nullptr);
+
+  std::lock_guard<std::mutex> lock(session_mutex);
+  reset_session_state();
+  // Every run starts from the defaults, only its own arguments configure it
+  m_settings = CommandManagerSettings();
+  CommandManager manager(m_settings);
+  if (on_start)
+    on_start();
+  try {
+    int status = run_benchmark(manager, static_cast<int>(storage.size()),
+                               argv.data());
+    // Runs that returned early still drain their queued results
+    ResultWriter::stop();
+    Telemetry::stop(status == 0 ? "ok" : "failed");
+    return status;
+  } catch (const std::exception &error) {
+    ResultWriter::stop();
+    Telemetry::stop("error");
+    std::cerr << "Benchmark session failed: " << error.what() << "\n";
+    return 1;
+  }
+}
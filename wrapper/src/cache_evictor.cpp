@@ -0,0 +1,72 @@
+#include "cache_evictor.h"
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <unistd.h>
+
+static const uint64_t CACHE_LINE_BYTES = 64;
+static const uint64_t FALLBACK_LLC_BYTES = 32ull << 20;
+
+CacheEvictor::CacheEvictor(uint64_t buffer_bytes) {
+  if (buffer_bytes == 0)
+    buffer_bytes = 2 * CacheEvictor::last_level_cache_bytes();
+  m_buffer.assign(buffer_bytes, 0);
+}
+
+void CacheEvictor::evict() {
+  // Writes make the lines dirty, so they are also gone from inclusive caches
+  volatile uint8_t *buffer = m_buffer.data();
+  for (uint64_t i = 0; i < m_buffer.size(); i += CACHE_LINE_BYTES)
+    buffer[i] = buffer[i] + 1;
+}
+
+/*
+ * /sys/devices/system/cpu/cpu<N>/cache/index<M>/{level,type,size}, where size
+ * looks like "32768K"
+ */
+std::vector<CacheLevel> CacheEvictor::cache_levels(int cpu) {
+  std::vector<CacheLevel> levels;
+  for (int index = 0;; index++) {
+    std::string entry = "/sys/devices/system/cpu/cpu" + std::to_string(cpu) +
+                        "/cache/index" + std::to_string(index);
+    std::ifstream level_file(entry + "/level");
+    std::ifstream size_file(entry + "/size");
+    if (!level_file.is_open() || !size_file.is_open())
+      break;
+
+    CacheLevel cache;
+    std::string size, type;
+    level_file >> cache.level;
+    size_file >> size;
+    std::ifstream(entry + "/type") >> type;
+    if (size.empty() || type == "Instruction")
+      continue;
+
+    cache.bytes = std::stoull(size);
+    if (size.back() == 'K')
+      cache.bytes <<= 10;
+    else if (size.back() == 'M')
+      cache.bytes <<= 20;
+    levels.push_back(cache);
+  }
+
+  std::sort(levels.begin(), levels.end(),
+            [](const CacheLevel &a, const CacheLevel &b) {
+              return a.level < b.level;
+            });
+  return levels;
+}
+
+uint64_t CacheEvictor::last_level_cache_bytes() {
+  std::vector<CacheLevel> levels = CacheEvictor::cache_levels(0);
+  if (!levels.empty())
+    return levels.back().bytes;
+
+#ifdef _SC_LEVEL3_CACHE_SIZE
+  long l3 = sysconf(_SC_LEVEL3_CACHE_SIZE);
+  if (l3 > 0)
+    return static_cast<uint64_t>(l3);
+#endif
+  return FALLBACK_LLC_BYTES;
+}
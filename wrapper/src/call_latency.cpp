@@ -0,0 +1,107 @@
+#include "call_latency.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <sstream>
+
+static constexpr uint64_t SUB_BUCKETS = uint64_t(1)
+                                        << LatencyHistogram::SUB_BUCKET_BITS;
+static constexpr uint64_t HALF_BUCKETS = SUB_BUCKETS / 2;
+
+LatencyHistogram::LatencyHistogram()
+    : m_counts(SUB_BUCKETS + (64 - SUB_BUCKET_BITS) * HALF_BUCKETS, 0) {}
+
+size_t LatencyHistogram::index(uint64_t value) {
+  if (value < SUB_BUCKETS)
+    return value;
+  // The top SUB_BUCKET_BITS bits select the bucket within the power of two
+  unsigned int shift = std::bit_width(value) - SUB_BUCKET_BITS;
+  uint64_t top = value >> shift;
+  return SUB_BUCKETS + (shift - 1) * HALF_BUCKETS + (top - HALF_BUCKETS);
+}
+
+uint64_t LatencyHistogram::lowest(size_t index) {
+  if (index < SUB_BUCKETS)
+    return index;
+  uint64_t offset = index - SUB_BUCKETS;
+  unsigned int shift = offset / HALF_BUCKETS + 1;
+  return (offset % HALF_BUCKETS + HALF_BUCKETS) << shift;
+}
+
+uint64_t LatencyHistogram::highest(size_t index) {
+  if (index < SUB_BUCKETS)
+    return index;
+  uint64_t offset = index - SUB_BUCKETS;
+  unsigned int shift = offset / HALF_BUCKETS + 1;
+  // Wraps to the largest value for the last bucket
+  return ((offset % HALF_BUCKETS + HALF_BUCKETS + 1) << shift) - 1;
+}
+
+void LatencyHistogram::record(uint64_t nanoseconds) {
+  m_counts[LatencyHistogram::index(nanoseconds)]++;
+  m_min = m_count ? std::min(m_min, nanoseconds) : nanoseconds;
+  m_max = std::max(m_max, nanoseconds);
+  m_sum += static_cast<double>(nanoseconds);
+  m_count++;
+}
+
+double LatencyHistogram::mean() const {
+  return m_count ? m_sum / static_cast<double>(m_count) : 0.0;
+}
+
+uint64_t LatencyHistogram::percentile(double fraction) const {
+  if (!m_count)
+    return 0;
+  if (fraction >= 1.0)
+    return m_max;
+  uint64_t rank = std::max<uint64_t>(
+      1, static_cast<uint64_t>(std::ceil(fraction * m_count)));
+  uint64_t cumulative = 0;
+  for (size_t i = 0; i < m_counts.size(); i++) {
+    cumulative += m_counts[i];
+    if (cumulative >= rank)
+      return std::min(LatencyHistogram::highest(i), m_max);
+  }
+  return m_max;
+}
+
+std::vector<std::string> LatencyHistogram::columns() {
+  return {"call_latency_calls", "call_mean_ns", "call_p50_ns",
+          "call_p99_ns",        "call_p999_ns", "call_max_ns"};
+}
+
+std::map<std::string, double> LatencyHistogram::summary() const {
+  return {{"call_p50_ns", static_cast<double>(percentile(0.5))},
+          {"call_p99_ns", static_cast<double>(percentile(0.99))},
+          {"call_p999_ns", static_cast<double>(percentile(0.999))},
+          {"call_max_ns", static_cast<double>(m_max)},
+          {"call_mean_ns", mean()},
+          {"call_latency_calls", static_cast<double>(m_count)}};
+}
+
+std::string LatencyHistogram::to_csv() const {
+  std::ostringstream csv;
+  csv << "low_ns,high_ns,count,percentile\n";
+  uint64_t cumulative = 0;
+  for (size_t i = 0; i < m_counts.size(); i++) {
+    if (!m_counts[i])
+      continue;
+    cumulative += m_counts[i];
+    csv << LatencyHistogram::lowest(i) << ","
+        << std::min(LatencyHistogram::highest(i), m_max) << ","
+        << m_counts[i] << ","
+        << static_cast<double>(cumulative) / static_cast<double>(m_count)
+        << "\n";
+  }
+  return csv.str();
+}
+
+fs::path LatencyHistogram::histogram_path(const fs::path &output_root,
+                                          const std::string &op_type,
+                                          const std::string &kernel) {
+  return fs::path(output_root)
+      .append("call_latency")
+      .append(op_type)
+      .append(kernel + ".hist.csv");
+}
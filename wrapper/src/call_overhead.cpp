@@ -0,0 +1,105 @@
+#include "call_overhead.h"
+#include "statistics.h"
+
+#include <algorithm>
+#include <sstream>
+
+bool CallOverhead::parse(const std::string &name, CallOverheadMode &mode) {
+  if (name == "off")
+    mode = CallOverheadMode::OFF;
+  else if (name == "measure")
+    mode = CallOverheadMode::MEASURE;
+  else if (name == "subtract")
+    mode = CallOverheadMode::SUBTRACT;
+  else
+    return false;
+  return true;
+}
+
+std::string CallOverhead::describe(CallOverheadMode mode) {
+  switch (mode) {
+  case CallOverheadMode::OFF:
+    return "off";
+  case CallOverheadMode::MEASURE:
+    return "measure";
+  case CallOverheadMode::SUBTRACT:
+    return "subtract";
+  }
+  return "off";
+}
+
+// Not inlined into the call sites, which only ever see a function pointer
+__attribute__((noinline)) void CallOverhead::empty_kernel() {
+  asm volatile("");
+}
+
+__attribute__((noinline)) void CallOverhead::empty_trampoline(void **,
+                                                              void *) {
+  asm volatile("");
+}
+
+std::map<std::string, OverheadStats> CallOverhead::summarize(
+    const std::vector<std::map<std::string, double>> &windows,
+    const std::vector<std::string> &metrics) {
+  std::map<std::string, OverheadStats> overhead;
+  for (const std::string &metric : metrics) {
+    std::vector<double> values;
+    for (const auto &window : windows) {
+      auto value = window.find(metric);
+      if (value != window.end())
+        values.push_back(value->second);
+    }
+    if (values.empty())
+      continue;
+    OverheadStats &stats = overhead[metric];
+    stats.median = Statistics::median(values);
+    stats.mad = Statistics::mad(values);
+    stats.p5 = Statistics::percentile(values, 0.05);
+    stats.p95 = Statistics::percentile(values, 0.95);
+  }
+  return overhead;
+}
+
+void CallOverhead::apply(const std::map<std::string, OverheadStats> &overhead,
+                         CallOverheadMode mode,
+                         std::map<std::string, double> &sample) {
+  for (const auto &[metric, stats] : overhead) {
+    sample["overhead_" + metric] = stats.median;
+    sample["overhead_" + metric + "_mad"] = stats.mad;
+    if (mode != CallOverheadMode::SUBTRACT)
+      continue;
+    auto value = sample.find(metric);
+    if (value == sample.end())
+      continue;
+    sample[metric + "_raw"] = value->second;
+    value->second = std::max(0.0, value->second - stats.median);
+  }
+}
+
+std::vector<std::string>
+CallOverhead::columns(const std::vector<std::string> &metrics,
+                      CallOverheadMode mode) {
+  std::vector<std::string> columns;
+  if (mode == CallOverheadMode::OFF)
+    return columns;
+  for (const std::string &metric : metrics) {
+    columns.push_back("overhead_" + metric);
+    columns.push_back("overhead_" + metric + "_mad");
+  }
+  if (mode == CallOverheadMode::SUBTRACT)
+    for (const std::string &metric : metrics)
+      columns.push_back(metric + "_raw");
+  return columns;
+}
+
+std::string
+CallOverhead::describe(const std::map<std::string, OverheadStats> &overhead) {
+  std::ostringstream text;
+  for (const auto &[metric, stats] : overhead) {
+    if (text.tellp() > 0)
+      text << ", ";
+    text << metric << " " << stats.median << " (" << stats.p5 << "-"
+         << stats.p95 << ")";
+  }
+  return text.str();
+}
@@ -0,0 +1,96 @@
+#include "call_trampoline.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+static const char *CIFACE_SYMBOL = "_mlir_ciface_kernel_call";
+
+std::string
+CallTrampoline::trampoline_symbol(const std::string &kernel_symbol) {
+  return kernel_symbol + "_trampoline";
+}
+
+void CallTrampoline::request_c_interface(std::vector<std::string> &pass_list) {
+  if (std::find(pass_list.begin(), pass_list.end(),
+                "llvm-request-c-wrappers") != pass_list.end())
+    return;
+
+  // The attribute has to be in place before functions are lowered
+  auto func_to_llvm =
+      std::find(pass_list.begin(), pass_list.end(), "convert-func-to-llvm");
+  // The sparsifier lowers functions itself, and the sparse assembler moves
+  // the attribute over to the public wrapper it generates
+  if (func_to_llvm == pass_list.end())
+    func_to_llvm = std::find_if(
+        pass_list.begin(), pass_list.end(), [](const std::string &pass) {
+          return pass.rfind("sparse-assembler", 0) == 0 ||
+                 pass.rfind("sparsifier", 0) == 0;
+        });
+  pass_list.insert(func_to_llvm, "llvm-request-c-wrappers");
+}
+
+std::string CallTrampoline::generate_ir(size_t arg_count,
+                                        size_t return_count) {
+  std::ostringstream ir;
+  ir << "\n; Generated by the benchmark harness\n";
+  ir << "define void @" << CallTrampoline::trampoline_symbol("kernel_call")
+     << "(ptr %args, ptr %results) {\n";
+  ir << "entry:\n";
+  for (size_t i = 0; i < arg_count; i++) {
+    ir << "  %a" << i << ".addr = getelementptr inbounds ptr, ptr %args, i64 "
+       << i << "\n";
+    ir << "  %a" << i << " = load ptr, ptr %a" << i << ".addr, align 8\n";
+  }
+
+  ir << "  call void @" << CIFACE_SYMBOL << "(";
+  bool first = true;
+  if (return_count) {
+    ir << "ptr %results";
+    first = false;
+  }
+  for (size_t i = 0; i < arg_count; i++) {
+    ir << (first ? "" : ", ") << "ptr %a" << i;
+    first = false;
+  }
+  ir << ")\n";
+  ir << "  ret void\n";
+  ir << "}\n";
+  return ir.str();
+}
+
+bool CallTrampoline::append_to_ll(const fs::path &ll_filepath,
+                                  size_t arg_count, size_t return_count) {
+  std::ifstream ll_stream(ll_filepath);
+  std::ostringstream contents;
+  contents << ll_stream.rdbuf();
+  ll_stream.close();
+
+  const std::string &ir = contents.str();
+  if (ir.find("@" + std::string(CIFACE_SYMBOL) + "(") == std::string::npos)
+    return false;
+  // Restored lowerings may already carry it
+  if (ir.find("@" + CallTrampoline::trampoline_symbol("kernel_call") + "(") !=
+      std::string::npos)
+    return true;
+
+  std::ofstream out(ll_filepath, std::ios::app);
+  out << CallTrampoline::generate_ir(arg_count, return_count);
+  return out.good();
+}
+
+size_t CallTrampoline::descriptor_slots(int64_t rank) { return 3 + 2 * rank; }
+
+std::vector<int64_t> CallTrampoline::pack_descriptor(MemRefArg &arg) {
+  std::vector<int64_t> packed;
+  packed.reserve(CallTrampoline::descriptor_slots(arg.get_tensor_rank()));
+  packed.push_back(reinterpret_cast<intptr_t>(arg.m_desc->base_ptr));
+  packed.push_back(reinterpret_cast<intptr_t>(arg.m_desc->aligned_ptr));
+  packed.push_back(arg.m_desc->offset);
+  for (int64_t i = 0; i < arg.get_tensor_rank(); i++)
+    packed.push_back(arg.m_desc->dimension[i]);
+  for (int64_t i = 0; i < arg.get_tensor_rank(); i++)
+    packed.push_back(arg.m_desc->strides[i]);
+  return packed;
+}
@@ -0,0 +1,386 @@
+#include "code_footprint.h"
+#include "statistics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <mutex>
+#include <set>
+
+#ifdef MLIR_BENCH_ORC_JIT
+#include "llvm/MC/MCAsmInfo.h"
+#include "llvm/MC/MCContext.h"
+#include "llvm/MC/MCDisassembler/MCDisassembler.h"
+#include "llvm/MC/MCInst.h"
+#include "llvm/MC/MCInstrAnalysis.h"
+#include "llvm/MC/MCInstrInfo.h"
+#include "llvm/MC/MCRegisterInfo.h"
+#include "llvm/MC/MCSubtargetInfo.h"
+#include "llvm/MC/MCTargetOptions.h"
+#include "llvm/MC/TargetRegistry.h"
+#include "llvm/Object/ObjectFile.h"
+#include "llvm/Object/SymbolSize.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/raw_ostream.h"
+#else
+// Clashes with llvm/BinaryFormat/ELF.h
+#include <elf.h>
+#endif
+
+// Linker and crt glue present in every shared object
+static const std::set<std::string> CRT_FUNCTIONS = {
+    "deregister_tm_clones", "register_tm_clones", "__do_global_dtors_aux",
+    "frame_dummy", "_init", "_fini"};
+
+namespace {
+struct Footprint {
+  uint64_t text_bytes = 0, kernel_bytes = 0, functions = 0;
+  uint64_t instructions = 0, basic_blocks = 0;
+  std::map<std::string, uint64_t> mix = {{"branch", 0}, {"call", 0},
+                                         {"load", 0},   {"store", 0},
+                                         {"simd", 0},   {"other", 0}};
+};
+} // namespace
+
+#ifdef MLIR_BENCH_ORC_JIT
+
+bool CodeFootprint::disassembler_available() { return true; }
+
+static bool read_footprint(const fs::path &so_filepath, Footprint &footprint) {
+  static std::once_flag initialise;
+  std::call_once(initialise, [] {
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetDisassembler();
+  });
+
+  auto binary =
+      llvm::object::ObjectFile::createObjectFile(so_filepath.generic_string());
+  if (!binary) {
+    llvm::consumeError(binary.takeError());
+    std::cerr << "Could not read " << so_filepath << " as an object\n";
+    return false;
+  }
+  const llvm::object::ObjectFile &object = *binary->getBinary();
+  std::string triple = object.makeTriple().str();
+  std::string error;
+  const llvm::Target *target = llvm::TargetRegistry::lookupTarget(triple, error);
+  if (!target) {
+    std::cerr << "No disassembler for " << triple << ": " << error << "\n";
+    return false;
+  }
+  std::unique_ptr<llvm::MCRegisterInfo> registers(
+      target->createMCRegInfo(triple));
+  llvm::MCTargetOptions options;
+  std::unique_ptr<llvm::MCAsmInfo> asm_info(
+      target->createMCAsmInfo(*registers, triple, options));
+  std::unique_ptr<llvm::MCSubtargetInfo> subtarget(
+      target->createMCSubtargetInfo(triple, "", ""));
+  std::unique_ptr<llvm::MCInstrInfo> instr_info(target->createMCInstrInfo());
+  llvm::MCContext context(object.makeTriple(), asm_info.get(),
+                          registers.get(), subtarget.get());
+  std::unique_ptr<llvm::MCDisassembler> disassembler(
+      target->createMCDisassembler(*subtarget, context));
+  std::unique_ptr<llvm::MCInstrAnalysis> analysis(
+      target->createMCInstrAnalysis(instr_info.get()));
+  if (!disassembler) {
+    std::cerr << "No disassembler for " << triple << "\n";
+    return false;
+  }
+
+  llvm::object::SectionRef text;
+  for (const llvm::object::SectionRef &section : object.sections()) {
+    auto name = section.getName();
+    if (name && *name == ".text") {
+      text = section;
+      break;
+    }
+    if (!name)
+      llvm::consumeError(name.takeError());
+  }
+  if (!text.getObject()) {
+    std::cerr << "No .text section in " << so_filepath << "\n";
+    return false;
+  }
+  auto contents = text.getContents();
+  if (!contents) {
+    llvm::consumeError(contents.takeError());
+    return false;
+  }
+  footprint.text_bytes = text.getSize();
+  uint64_t text_address = text.getAddress();
+  auto bytes = llvm::arrayRefFromStringRef(*contents);
+
+  for (const auto &[symbol, size] : llvm::object::computeSymbolSizes(object)) {
+    auto type = symbol.getType();
+    auto name = symbol.getName();
+    auto address = symbol.getAddress();
+    if (!type || !name || !address) {
+      llvm::consumeError(type.takeError());
+      llvm::consumeError(name.takeError());
+      llvm::consumeError(address.takeError());
+      continue;
+    }
+    if (*type != llvm::object::SymbolRef::ST_Function || size == 0 ||
+        CRT_FUNCTIONS.count(name->str()) || *address < text_address ||
+        *address + size > text_address + bytes.size())
+      continue;
+    footprint.functions++;
+    footprint.kernel_bytes += size;
+
+    std::set<uint64_t> leaders = {*address};
+    uint64_t end = *address + size;
+    for (uint64_t pc = *address; pc < end;) {
+      llvm::MCInst instruction;
+      uint64_t length = 0;
+      auto status = disassembler->getInstruction(
+          instruction, length, bytes.slice(pc - text_address, end - pc), pc,
+          llvm::nulls());
+      if (status != llvm::MCDisassembler::Success) {
+        pc += std::max<uint64_t>(length, 1);
+        continue;
+      }
+      footprint.instructions++;
+      const llvm::MCInstrDesc &desc = instr_info->get(instruction.getOpcode());
+      bool simd = false;
+      for (const llvm::MCOperand &operand : instruction)
+        if (operand.isReg() && operand.getReg()) {
+          llvm::StringRef reg = registers->getName(operand.getReg());
+          simd |= reg.starts_with("XMM") || reg.starts_with("YMM") ||
+                  reg.starts_with("ZMM") || reg.starts_with("Q") ||
+                  reg.starts_with("Z");
+        }
+      if (desc.isCall())
+        footprint.mix["call"]++;
+      else if (desc.isBranch() || desc.isReturn())
+        footprint.mix["branch"]++;
+      else if (desc.mayLoad())
+        footprint.mix["load"]++;
+      else if (desc.mayStore())
+        footprint.mix["store"]++;
+      else if (simd)
+        footprint.mix["simd"]++;
+      else
+        footprint.mix["other"]++;
+
+      if (!desc.isCall() && (desc.isBranch() || desc.isReturn())) {
+        leaders.insert(pc + length);
+        uint64_t branch_target = 0;
+        if (analysis &&
+            analysis->evaluateBranch(instruction, pc, length, branch_target))
+          leaders.insert(branch_target);
+      }
+      pc += length;
+    }
+    footprint.basic_blocks += std::count_if(
+        leaders.begin(), leaders.end(),
+        [&](uint64_t leader) { return leader >= *address && leader < end; });
+  }
+  return true;
+}
+
+#else
+
+bool CodeFootprint::disassembler_available() { return false; }
+
+// Section and symbol sizes from the ELF64 headers
+static bool read_footprint(const fs::path &so_filepath, Footprint &footprint) {
+  std::ifstream file(so_filepath, std::ios::binary);
+  std::string image((std::istreambuf_iterator<char>(file)),
+                    std::istreambuf_iterator<char>());
+  Elf64_Ehdr header;
+  if (image.size() < sizeof(header) ||
+      std::memcmp(image.data(), ELFMAG, SELFMAG) != 0 ||
+      image[EI_CLASS] != ELFCLASS64) {
+    std::cerr << "Could not read " << so_filepath << " as an ELF64 object\n";
+    return false;
+  }
+  std::memcpy(&header, image.data(), sizeof(header));
+  auto section = [&](size_t index) {
+    Elf64_Shdr shdr{};
+    size_t offset = header.e_shoff + index * sizeof(Elf64_Shdr);
+    if (offset + sizeof(shdr) <= image.size())
+      std::memcpy(&shdr, image.data() + offset, sizeof(shdr));
+    return shdr;
+  };
+  if (header.e_shstrndx >= header.e_shnum)
+    return false;
+  Elf64_Shdr names = section(header.e_shstrndx);
+
+  size_t text_index = 0;
+  Elf64_Shdr symbols{};
+  for (size_t i = 0; i < header.e_shnum; i++) {
+    Elf64_Shdr shdr = section(i);
+    if (names.sh_offset + shdr.sh_name < image.size() &&
+        std::strcmp(image.c_str() + names.sh_offset + shdr.sh_name,
+                    ".text") == 0) {
+      text_index = i;
+      footprint.text_bytes = shdr.sh_size;
+    }
+    // The full symbol table if present, the dynamic one otherwise
+    if (shdr.sh_type == SHT_SYMTAB ||
+        (shdr.sh_type == SHT_DYNSYM && symbols.sh_type != SHT_SYMTAB))
+      symbols = shdr;
+  }
+  if (!text_index || !symbols.sh_entsize)
+    return true;
+
+  Elf64_Shdr strings = section(symbols.sh_link);
+  for (size_t offset = symbols.sh_offset;
+       offset + sizeof(Elf64_Sym) <= symbols.sh_offset + symbols.sh_size &&
+       offset + sizeof(Elf64_Sym) <= image.size();
+       offset += symbols.sh_entsize) {
+    Elf64_Sym symbol;
+    std::memcpy(&symbol, image.data() + offset, sizeof(symbol));
+    if (ELF64_ST_TYPE(symbol.st_info) != STT_FUNC ||
+        symbol.st_shndx != text_index || symbol.st_size == 0 ||
+        strings.sh_offset + symbol.st_name >= image.size() ||
+        CRT_FUNCTIONS.count(image.c_str() + strings.sh_offset + symbol.st_name))
+      continue;
+    footprint.functions++;
+    footprint.kernel_bytes += symbol.st_size;
+  }
+  return true;
+}
+
+#endif
+
+fs::path CodeFootprint::filepath(const fs::path &ll_filepath) {
+  return fs::path(ll_filepath).replace_extension(".footprint.json");
+}
+
+bool CodeFootprint::analyse(const fs::path &so_filepath,
+                            const fs::path &ll_filepath) {
+  Footprint footprint;
+  if (!read_footprint(so_filepath, footprint))
+    return false;
+  if (!CodeFootprint::disassembler_available()) {
+    static std::once_flag warned;
+    std::call_once(warned, [] {
+      std::cerr << "Warning: Instruction footprint columns need the LLVM "
+                   "libraries (--with-mlir), they are left empty.\n";
+    });
+  }
+
+  json report = {{"object", so_filepath.generic_string()},
+                 {"text_bytes", footprint.text_bytes},
+                 {"kernel_bytes", footprint.kernel_bytes},
+                 {"functions", footprint.functions},
+                 {"disassembled", CodeFootprint::disassembler_available()},
+                 {"instructions", footprint.instructions},
+                 {"basic_blocks", footprint.basic_blocks},
+                 {"mix", footprint.mix}};
+  fs::path json_filepath = CodeFootprint::filepath(ll_filepath);
+  std::ofstream file(json_filepath);
+  if (!file.is_open()) {
+    std::cerr << "Error: Could not open " << json_filepath
+              << " for writing.\n";
+    return false;
+  }
+  file << report.dump(1) << "\n";
+  return true;
+}
+
+std::map<std::string, double>
+CodeFootprint::columns(const fs::path &ll_filepath) {
+  std::ifstream file(CodeFootprint::filepath(ll_filepath));
+  if (!file.is_open())
+    return {};
+  json report = json::parse(file, nullptr, false);
+  if (!report.is_object())
+    return {};
+
+  std::map<std::string, double> columns = {
+      {"code_text_bytes", report.value("text_bytes", 0.0)},
+      {"code_kernel_bytes", report.value("kernel_bytes", 0.0)},
+      {"code_functions", report.value("functions", 0.0)}};
+  // Not disassembled: no instruction counts rather than zero of them
+  double unknown = std::numeric_limits<double>::quiet_NaN();
+  bool disassembled = report.value("disassembled", false);
+  columns["code_instructions"] =
+      disassembled ? report.value("instructions", 0.0) : unknown;
+  columns["code_basic_blocks"] =
+      disassembled ? report.value("basic_blocks", 0.0) : unknown;
+  for (const char *kind :
+       {"branch", "call", "load", "store", "simd", "other"})
+    columns[std::string("code_") + kind] =
+        disassembled ? report["mix"].value(kind, 0.0) : unknown;
+  return columns;
+}
+
+std::vector<std::string> CodeFootprint::column_names() {
+  return {"code_text_bytes",   "code_kernel_bytes", "code_functions",
+          "code_instructions", "code_basic_blocks", "code_branch",
+          "code_call",         "code_load",         "code_store",
+          "code_simd",         "code_other"};
+}
+
+bool CodeFootprint::write_correlation(const std::vector<KernelTask> &tasks,
+                                      const fs::path &csv_filepath) {
+  std::string icache_metric;
+  for (const char *metric : {"L1-icache-load-misses", "l1i_mpki"})
+    for (const KernelTask &task : tasks)
+      if (icache_metric.empty() && task.average_metrics.count(metric))
+        icache_metric = metric;
+
+  struct Row {
+    const KernelTask *task;
+    std::map<std::string, double> columns;
+  };
+  std::vector<Row> rows;
+  for (const KernelTask &task : tasks) {
+    if (!task.measured || !task.failure.empty())
+      continue;
+    std::map<std::string, double> columns =
+        CodeFootprint::columns(task.ll_filepath);
+    if (!columns.empty())
+      rows.push_back({&task, std::move(columns)});
+  }
+  if (rows.empty())
+    return false;
+
+  std::ofstream csv(csv_filepath);
+  if (!csv.is_open()) {
+    std::cerr << "Error: Could not open " << csv_filepath
+              << " for writing.\n";
+    return false;
+  }
+  csv << "op_type,kernel,code_kernel_bytes,code_instructions,"
+         "code_basic_blocks";
+  if (!icache_metric.empty())
+    csv << "," << icache_metric;
+  csv << "\n";
+  std::vector<double> kernel_bytes, misses;
+  for (const Row &row : rows) {
+    const KernelTask &task = *row.task;
+    csv << task.op_type << ","
+        << fs::path(task.mlir_filepath).replace_extension().filename().string()
+        << "," << row.columns.at("code_kernel_bytes");
+    for (const char *column : {"code_instructions", "code_basic_blocks"}) {
+      csv << ",";
+      if (!std::isnan(row.columns.at(column)))
+        csv << row.columns.at(column);
+    }
+    auto it = task.average_metrics.find(icache_metric);
+    if (it != task.average_metrics.end()) {
+      csv << "," << it->second;
+      kernel_bytes.push_back(row.columns.at("code_kernel_bytes"));
+      misses.push_back(it->second);
+    } else if (!icache_metric.empty()) {
+      csv << ",";
+    }
+    csv << "\n";
+  }
+  std::cout << "Code footprint written to " << csv_filepath << "\n";
+  if (kernel_bytes.size() >= 3)
+    std::cout << "Kernel bytes vs " << icache_metric << " over "
+              << kernel_bytes.size() << " kernels: Pearson "
+              << Statistics::pearson(kernel_bytes, misses) << ", Spearman "
+              << Statistics::spearman(kernel_bytes, misses) << "\n";
+  else if (icache_metric.empty())
+    std::cout << "Count L1-icache-load-misses (or --metric-group frontend) "
+                 "to correlate it with the code footprint\n";
+  return true;
+}
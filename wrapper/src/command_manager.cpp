@@ -13,46 +13,108 @@
 #include <ffi.h> // Linux is required if not MACOS (Windows does not have standard FFI library)
 #endif
 
+#include "activation_stats.h"
+#include "allocation_tracker.h"
+#include "cache_evictor.h"
+#include "call_latency.h"
+#include "code_footprint.h"
+#include "compile_cache.h"
+#include "cpu_environment.h"
+#include "dram_counter.h"
+#include "input_cache.h"
+#include "isolation_cache.h"
+#include "jit_engine.h"
+#include "kernel_cost.h"
+#include "kernel_index.h"
+#include "kernel_metadata.h"
+#include "linalg_structure.h"
+#include "memref_layout.h"
+#include "mlir_engine.h"
+#include "model_layers.h"
+#include "model_source.h"
+#include "pass_prefix_cache.h"
+#include "pgo_profile.h"
+#include "replica_group.h"
+#include "result_buffers.h"
+#include "result_writer.h"
+#include "scratch_space.h"
+#include "statistics.h"
+#include "tensor_dump.h"
 #include "tensor_fuzzer.h"
+#include "tensor_source.h"
+#include "tsc_clock.h"
 #include "utils.h"
+#include "vector_coverage.h"
 // #include <Python.h>
+#include <algorithm>
 #include <cassert>
+#include <cctype>
+#include <chrono>
+#include <cmath>
 #include <cstdint>
 #include <cstdlib>
+#include <cstring>
 #include <dlfcn.h>
 #include <filesystem>
 #include <fstream>
 #include <initializer_list>
 #include <iostream>
+#include <limits>
 #include <nlohmann/json.hpp>
 // #include <numpy/arrayobject.h>
 // #include <numpy/ndarraytypes.h>
+#include <set>
 #include <sstream>
 
 namespace fs = std::filesystem;
 
 ffi_type *create_memref_struct_type(int rank);
 void destroy_memref_struct_type(ffi_type *memref_type);
+ffi_type *create_results_struct_type(const std::vector<JSONArgument> &returns);
+void destroy_results_struct_type(ffi_type *results_type);
 
 // perf::EventCounter CommandManager::perf_event_counter = perf::EventCounter{};
-fs::path CommandManager::torch_mlir_install_path;
 
-fs::path CommandManager::torch_opt_exec;
-fs::path CommandManager::mlir_opt_exec;
-
-fs::path CommandManager::llvm_install_path;
-
-fs::path CommandManager::pipeline_json;
-fs::path CommandManager::llvm_lib_path;
+/*
+ * Per CPU values of a PER_CORE sample, stored as "<metric>@cpu<N>", plus:
+ *    active_threads - CPUs that did at least 1% of the busiest CPU's work
+ *    imbalance      - busiest CPU over the mean of the active CPUs (1 = even)
+ * Work is measured in cycles when counted, else the first hardware metric.
+ */
+static void add_core_breakdown(const CounterSession &counters,
+                               uint64_t normalization,
+                               std::map<std::string, double> &sample) {
+  std::vector<std::map<std::string, double>> cores =
+      counters.core_results(normalization);
+  const std::vector<int> &core_ids = counters.core_ids();
+
+  std::string work_metric;
+  for (size_t c = 0; c < cores.size(); c++)
+    for (const auto &[metric, value] : cores[c]) {
+      sample[metric + "@cpu" + std::to_string(core_ids[c])] = value;
+      if (work_metric.empty() || metric == "cycles")
+        work_metric = metric;
+    }
 
-std::string CommandManager::compiler = "/usr/bin/clang++";
-fs::path CommandManager::outputFolder;
-fs::path CommandManager::loweringFolder;
-bool CommandManager::enableLogFiles = false;
-bool CommandManager::enableRunLogs = false;
+  double busiest = 0.0;
+  for (const auto &core : cores)
+    busiest = std::max(busiest, core.count(work_metric)
+                                    ? core.at(work_metric)
+                                    : 0.0);
+
+  double active_sum = 0.0;
+  unsigned int active = 0;
+  for (const auto &core : cores) {
+    double value = core.count(work_metric) ? core.at(work_metric) : 0.0;
+    if (busiest > 0.0 && value >= 0.01 * busiest) {
+      active_sum += value;
+      active++;
+    }
+  }
 
-std::vector<std::string> CommandManager::perf_metrics;
-unsigned int CommandManager::perf_run_count;
+  sample["active_threads"] = active;
+  sample["imbalance"] = active ? busiest / (active_sum / active) : 0.0;
+}
 
 /*
  * Execute a command on the system's command line
@@ -75,6 +137,9 @@ std::string CommandManager::exec(const std::string &cmd) {
   return result;
 }
 
+CommandManager::CommandManager(CommandManagerSettings &settings)
+    : settings(settings) {}
+
 /*
  *
  * Initialisation Call: Create all needed directories here
@@ -83,56 +148,94 @@ std::string CommandManager::exec(const std::string &cmd) {
 void CommandManager::initialise_environment() {
   CommandManager::verifyParameters();
   std::cout << "Creating directory: "
-            << CommandManager::outputFolder.generic_string() << std::endl;
-  CommandManager::exec("mkdir " +
-                       CommandManager::outputFolder.generic_string());
-
-  // CommandManager::perf_event_counter.add(
-  //     {"seconds", "instructions", "cycles", "cache-misses"});
-  // CommandManager::perf_event_counter.add(CommandManager::perf_metrics);
-}
-
-std::map<std::string, double> CommandManager::aggregate_metrics(
-    std::vector<std::map<std::string, double>> &metrics) {
-
-  if (!metrics.size()) {
-    std::cerr << "Empty metrics passed. Skipping aggregation\n";
-    return std::map<std::string, double>();
+            << settings.outputFolder.generic_string() << std::endl;
+  CommandManager::exec("mkdir " + settings.outputFolder.generic_string());
+
+  // Resolve the codegen targets once, `native` is replaced by the host CPU
+  CommandManager::primary_pipeline =
+      CommandManager::resolve_pipeline(settings.pipeline_json);
+  std::set<std::string> labels = {CommandManager::primary_pipeline.label};
+  CommandManager::comparison_pipelines.clear();
+  for (const fs::path &filepath : settings.comparison_pipeline_jsons) {
+    PipelineSpec pipeline = CommandManager::resolve_pipeline(filepath);
+    std::string label = pipeline.label;
+    for (int i = 2; labels.count(pipeline.label); i++)
+      pipeline.label = label + "-" + std::to_string(i);
+    labels.insert(pipeline.label);
+    CommandManager::comparison_pipelines.push_back(pipeline);
   }
-
-  std::map<std::string, double> aggregated_map;
-  unsigned int total_counter = 0;
-
-  // Collecting metric sums
-  for (auto v : metrics) {
-    for (std::string &perf : CommandManager::perf_metrics) {
-      aggregated_map[perf] += v[perf];
-    }
-    total_counter++;
+  if (settings.out_params_variant) {
+    PipelineSpec pipeline = CommandManager::primary_pipeline;
+    pipeline.label = "out-params";
+    for (int i = 2; labels.count(pipeline.label); i++)
+      pipeline.label = "out-params-" + std::to_string(i);
+    pipeline.out_params = true;
+    CommandManager::comparison_pipelines.push_back(pipeline);
   }
-
-  // Perform Avg reduction
-  for (auto &p : aggregated_map) {
-    p.second /= total_counter;
+  if (settings.pgo_variant) {
+    PipelineSpec pipeline = CommandManager::primary_pipeline;
+    pipeline.label = "pgo";
+    for (int i = 2; labels.count(pipeline.label); i++)
+      pipeline.label = "pgo-" + std::to_string(i);
+    pipeline.pgo = true;
+    CommandManager::comparison_pipelines.push_back(pipeline);
+  }
+  auto describe = [](const PipelineSpec &pipeline) {
+    return "Target CPU: " + pipeline.target.cpu +
+           ", features: " + TargetInfo::features_string(pipeline.target) +
+           ", backend: " + BackendOpt::describe(pipeline.backend_opt) +
+           ", parallel runtime: " +
+           ParallelRuntime::describe(pipeline.parallel_runtime);
+  };
+  std::cout << describe(CommandManager::primary_pipeline) << std::endl;
+  for (const PipelineSpec &pipeline : CommandManager::comparison_pipelines) {
+    std::cout << "Comparison pipeline " << pipeline.label << ": "
+              << describe(pipeline) << std::endl;
+    CommandManager::use_pipeline(pipeline);
+    PassPrefixCache::add_pipeline(CommandManager::extract_pass_list());
+  }
+  CommandManager::use_pipeline(CommandManager::primary_pipeline);
+  PassPrefixCache::add_pipeline(CommandManager::extract_pass_list());
+
+  CPUEnvironment::check_measurement_cpu(CommandManager::get_measure_cpu());
+
+  // Dialect and pass registration is paid once here instead of per kernel
+  if (settings.lowering_engine == LoweringEngine::IN_PROCESS)
+    MLIREngine::initialise();
+
+  if (settings.execution_engine == ExecutionEngine::ORC_JIT &&
+      !JITEngine::initialise(settings.llvm_lib_path,
+                             CommandManager::target.cpu,
+                             CommandManager::target.features,
+                             CommandManager::target.vector_width,
+                             BackendOpt::codegen_level(
+                                 CommandManager::backend_opt),
+                             ParallelRuntime::runtime_libraries(
+                                 CommandManager::parallel_runtime))) {
+    std::cerr << "Failed to initialise the ORC JIT. Falling back to shared "
+                 "object execution\n";
+    settings.execution_engine = ExecutionEngine::SHARED_OBJECT;
   }
 
-  return aggregated_map;
+  // CommandManager::perf_event_counter.add(
+  //     {"seconds", "instructions", "cycles", "cache-misses"});
+  // CommandManager::perf_event_counter.add(settings.perf_metrics);
 }
 
 bool CommandManager::verifyParameters() {
-  assert(CommandManager::llvm_install_path.generic_string().size() > 0);
-  assert(CommandManager::mlir_opt_exec.generic_string().size() > 0);
-  assert(CommandManager::torch_mlir_install_path.generic_string().size() > 0);
-  assert(CommandManager::torch_opt_exec.generic_string().size() > 0);
-  assert(CommandManager::pipeline_json.generic_string().size() > 0);
-  assert(CommandManager::outputFolder.generic_string().size() > 0);
-  assert(CommandManager::compiler.size() > 0);
-  assert(CommandManager::perf_metrics.size() > 0);
-  assert(CommandManager::perf_run_count > 0);
+  assert(settings.llvm_install_path.generic_string().size() > 0);
+  assert(settings.mlir_opt_exec.generic_string().size() > 0);
+  assert(settings.torch_mlir_install_path.generic_string().size() > 0);
+  assert(settings.torch_opt_exec.generic_string().size() > 0);
+  assert(settings.pipeline_json.generic_string().size() > 0);
+  assert(settings.outputFolder.generic_string().size() > 0);
+  assert(settings.compiler.size() > 0);
+  assert(settings.perf_metrics.size() > 0);
+  assert(settings.perf_run_count > 0);
 
   // Derivative variables
-  assert(CommandManager::llvm_lib_path.generic_string().size() > 0);
-  assert(CommandManager::loweringFolder.generic_string().size() > 0);
+  assert(settings.llvm_lib_path.generic_string().size() > 0);
+  assert(settings.loweringFolder.generic_string().size() > 0);
 
   return true;
 }
@@ -141,55 +244,454 @@ bool CommandManager::verifyParameters() {
  * Command Manager Configuration methods
  */
 void CommandManager::set_pass_log_flag(bool flag) {
-  CommandManager::enableLogFiles = flag;
+  settings.enableLogFiles = flag;
 }
 void CommandManager::set_run_log_flag(bool flag) {
-  CommandManager::enableRunLogs = flag;
+  settings.enableRunLogs = flag;
 }
 
 void CommandManager::set_perf_sample_run_count(const unsigned int &count) {
-  CommandManager::perf_run_count = count;
+  settings.perf_run_count = count;
+}
+
+void CommandManager::set_warmup_config(const WarmupConfig &config) {
+  settings.warmup = config;
+}
+
+void CommandManager::set_sampling_config(const SamplingConfig &config) {
+  settings.sampling = config;
+}
+
+void CommandManager::set_outlier_config(const OutlierConfig &config) {
+  settings.outlier_config = config;
+}
+
+const OutlierConfig &CommandManager::get_outlier_config() {
+  return settings.outlier_config;
+}
+
+void CommandManager::set_noise_config(const NoiseConfig &config) {
+  settings.noise_config = config;
+}
+
+void CommandManager::set_call_overhead(CallOverheadMode mode) {
+  settings.call_overhead = mode;
+}
+
+void CommandManager::set_energy_config(const EnergyConfig &config) {
+  settings.energy_config = config;
+}
+
+void CommandManager::measure_idle_power(int cpu) {
+  CommandManager::idle_watts.clear();
+  if (!settings.energy_config.enabled)
+    return;
+  EnergyCounter energy(cpu >= 0 ? cpu : sched_getcpu());
+  CommandManager::idle_watts =
+      energy.measure_idle(settings.energy_config.idle_seconds);
+  if (energy.available())
+    std::cout << "Energy from " << energy.source() << ", idle package "
+              << (CommandManager::idle_watts.count("pkg")
+                      ? CommandManager::idle_watts["pkg"]
+                      : 0.0)
+              << " W\n";
+}
+
+void CommandManager::set_vectorization_report(bool flag) {
+  settings.vectorization_report = flag;
+}
+
+void CommandManager::set_code_footprint(bool flag) {
+  settings.code_footprint = flag;
+}
+
+void CommandManager::set_dram_traffic(bool flag) {
+  settings.dram_traffic = flag;
+}
+
+void CommandManager::set_counter_mode(const CounterMode &mode) {
+  settings.counter_mode = mode;
+}
+
+void CommandManager::set_counter_batch_size(unsigned int counters) {
+  settings.counter_batch_size = counters;
+}
+
+void CommandManager::set_thread_scope(const ThreadScope &scope) {
+  settings.thread_scope = scope;
+}
+
+void CommandManager::set_cache_mode(const CacheMode &mode) {
+  settings.cache_mode = mode;
+}
+
+void CommandManager::set_track_allocations(bool flag) {
+  settings.track_allocations = flag;
+}
+
+void CommandManager::set_profile_config(const ProfileConfig &config) {
+  settings.profile = config;
+}
+
+void CommandManager::set_arena_config(const ArenaConfig &config) {
+  settings.arena_config = config;
+  CommandManager::tensor_arena.reset();
+}
+
+void CommandManager::release_tensor_arena() {
+  CommandManager::tensor_arena.reset();
+}
+
+void CommandManager::set_input_layout(const LayoutKind &layout) {
+  settings.input_layout = layout;
+}
+
+void CommandManager::set_tensor_source(const fs::path &directory) {
+  settings.tensor_source_dir = directory;
+}
+
+void CommandManager::set_replay_outputs(const fs::path &directory) {
+  settings.replay_output_dir = directory;
+}
+
+void CommandManager::set_input_cache(const fs::path &directory) {
+  settings.input_cache_dir = directory;
+}
+
+void CommandManager::set_isolation_cache(const fs::path &directory) {
+  settings.isolation_cache_dir = directory;
+}
+
+bool CommandManager::isolation_from_cache() {
+  return CommandManager::isolation_restored;
+}
+
+void CommandManager::store_isolation_metadata(
+    const std::vector<KernelTask> &tasks) {
+  if (!CommandManager::isolation_key.empty())
+    IsolationCache::store_metadata(settings.isolation_cache_dir,
+                                   CommandManager::isolation_key,
+                                   settings.loweringFolder, tasks);
+}
+
+void CommandManager::set_input_seed(uint64_t seed) {
+  settings.input_seed = seed;
+}
+
+void CommandManager::set_input_profile(const InputProfile &profile) {
+  settings.input_profile = profile;
+}
+
+void CommandManager::set_record_outputs(bool flag) {
+  settings.record_outputs = flag;
+}
+
+void CommandManager::set_call_latency(unsigned int calls) {
+  settings.call_latency_calls = calls;
+}
+
+void CommandManager::set_verification(const fs::path &reference_dir,
+                                      const Tolerance &tolerance) {
+  settings.verify_reference_dir = reference_dir;
+  settings.verify_tolerance = tolerance;
+}
+
+bool CommandManager::is_verifying() {
+  return !settings.verify_reference_dir.empty();
+}
+
+void CommandManager::set_thread_budget(unsigned int threads) {
+  settings.thread_budget = threads;
+}
+
+void CommandManager::set_call_interface(const CallInterface &interface) {
+  settings.call_interface = interface;
+}
+
+void CommandManager::set_out_params_variant(bool flag) {
+  settings.out_params_variant = flag;
+}
+
+void CommandManager::set_pgo_variant(bool flag) {
+  settings.pgo_variant = flag;
+}
+
+void CommandManager::set_torch_baselines(const std::vector<TorchMode> &modes) {
+  settings.torch_baselines = modes;
+}
+
+void CommandManager::set_measure_cpu(int cpu) {
+  int cpu_count = get_online_cpu_count();
+  if (cpu >= cpu_count) {
+    std::cerr << "CPU " << cpu << " is not online, using CPU "
+              << cpu_count - 1 << " for measurements\n";
+    cpu = -1;
+  }
+  settings.measure_cpu = cpu;
+}
+
+int CommandManager::get_measure_cpu() {
+  return settings.measure_cpu >= 0 ? settings.measure_cpu
+                                          : get_online_cpu_count() - 1;
+}
+
+void CommandManager::set_realtime_scheduling(bool flag) {
+  settings.realtime_scheduling = flag;
+}
+
+void CommandManager::set_ftz_daz(bool flag) { settings.ftz_daz = flag; }
+
+void CommandManager::set_lowering_engine(const LoweringEngine &engine) {
+  if (engine == LoweringEngine::IN_PROCESS && !MLIREngine::available()) {
+    std::cerr << "In-process lowering requested but the wrapper was built "
+                 "without MLIR. Falling back to the popen toolchain\n";
+    settings.lowering_engine = LoweringEngine::POPEN;
+    return;
+  }
+  settings.lowering_engine = engine;
+}
+
+void CommandManager::set_execution_engine(const ExecutionEngine &engine) {
+  if (engine == ExecutionEngine::ORC_JIT && !JITEngine::available()) {
+    std::cerr << "JIT execution requested but the wrapper was built without "
+                 "LLVM. Falling back to shared object execution\n";
+    settings.execution_engine = ExecutionEngine::SHARED_OBJECT;
+    return;
+  }
+  settings.execution_engine = engine;
+}
+
+void CommandManager::set_link_mode(const LinkMode &mode) {
+  settings.link_mode = mode;
 }
 
+LinkMode CommandManager::get_link_mode() { return settings.link_mode; }
+
 void CommandManager::set_compiler_executable(const fs::path &binary) {
-  CommandManager::compiler = binary.generic_string();
+  settings.compiler = binary.generic_string();
 }
 
 void CommandManager::set_pipeline_json_filepath(const fs::path &filepath) {
-  CommandManager::pipeline_json = filepath;
+  settings.pipeline_json = filepath;
+}
+
+void CommandManager::set_sparse_pipeline(const fs::path &filepath) {
+  settings.sparse_pipeline_json = filepath;
+}
+
+void CommandManager::set_comparison_pipelines(
+    const std::vector<fs::path> &filepaths) {
+  settings.comparison_pipeline_jsons = filepaths;
+}
+
+const PipelineSpec &CommandManager::get_primary_pipeline() {
+  return CommandManager::primary_pipeline;
+}
+
+const std::vector<PipelineSpec> &CommandManager::get_comparison_pipelines() {
+  return CommandManager::comparison_pipelines;
 }
 
 void CommandManager::set_output_folder(const fs::path &output) {
-  CommandManager::outputFolder = output;
-  CommandManager::loweringFolder = fs::path(outputFolder).append("lowerings");
+  settings.outputFolder = output;
+  settings.scratchFolder = output;
+  settings.loweringFolder = fs::path(settings.outputFolder).append("lowerings");
+}
+
+void CommandManager::set_scratch_folder(const fs::path &folder,
+                                        bool load_from_memory) {
+  settings.scratchFolder = folder;
+  settings.loweringFolder = fs::path(folder).append("lowerings");
+  settings.loadFromMemory = load_from_memory;
 }
 
 void CommandManager::set_llvm_install_path(const fs::path &path) {
-  CommandManager::llvm_install_path = path;
-  CommandManager::mlir_opt_exec =
-      fs::path(CommandManager::llvm_install_path).append("bin/mlir-opt");
-  CommandManager::llvm_lib_path = fs::path(llvm_install_path).append("lib");
+  settings.llvm_install_path = path;
+  settings.mlir_opt_exec =
+      fs::path(settings.llvm_install_path).append("bin/mlir-opt");
+  settings.llvm_lib_path = fs::path(settings.llvm_install_path).append("lib");
+  settings.llvm_opt_exec =
+      fs::path(settings.llvm_install_path).append("bin/opt");
 }
 
 void CommandManager::set_torch_install_path(const fs::path &path) {
-  CommandManager::torch_mlir_install_path = path;
-  fs::path execPath = (fs::path(CommandManager::torch_mlir_install_path));
+  settings.torch_mlir_install_path = path;
+  fs::path execPath = (fs::path(settings.torch_mlir_install_path));
 
   execPath.append("bin/torch-mlir-opt");
-  CommandManager::torch_opt_exec = execPath;
+  settings.torch_opt_exec = execPath;
+  ModelSource::set_torch_opt(execPath);
 }
 
 void CommandManager::set_perf_metrics(const std::vector<std::string> &metrics) {
-  CommandManager::perf_metrics = metrics;
+  settings.perf_metrics = metrics;
+}
+void CommandManager::set_metric_groups(const std::vector<MetricGroup> &groups) {
+  settings.metric_groups = groups;
 }
 /*
  *
  */
 fs::path CommandManager::get_output_folder() {
-  return CommandManager::outputFolder;
+  return settings.outputFolder;
 }
 fs::path CommandManager::get_lowering_folder() {
-  return CommandManager::loweringFolder;
+  return settings.loweringFolder;
+}
+
+fs::path CommandManager::get_model_text_filepath() {
+  return settings.modelTextFilepath;
+}
+
+std::vector<ReportMetric> CommandManager::get_report_metric_definitions() {
+  std::vector<ReportMetric> columns;
+  auto add = [&columns](const std::string &name,
+                        MetricAggregation aggregation) {
+    columns.push_back({name, aggregation});
+  };
+  const MetricAggregation SUM = MetricAggregation::SUM;
+  const MetricAggregation PER_KERNEL = MetricAggregation::PER_KERNEL;
+
+  for (const std::string &metric : settings.perf_metrics)
+    add(metric, SUM);
+  add("compile_seconds", SUM);
+  add("ci95", PER_KERNEL);
+  add("counter_overhead", PER_KERNEL);
+  for (const std::string &column : CallOverhead::columns(
+           settings.perf_metrics, settings.call_overhead))
+    add(column, SUM);
+  if (settings.counter_batch_size > 0)
+    add("anchor_drift", PER_KERNEL);
+  add("inner_repetitions", PER_KERNEL);
+  add("disturbed", PER_KERNEL);
+  if (settings.noise_config.action != NoiseAction::OFF)
+    for (const std::string &column : NoiseMonitor::columns())
+      add(column, PER_KERNEL);
+  add("bytes_moved", SUM);
+  add("bandwidth_gbs", PER_KERNEL);
+  add("flops", SUM);
+  add("gflops", PER_KERNEL);
+  add("arith_intensity", PER_KERNEL);
+  if (settings.energy_config.enabled)
+    for (const ReportMetric &column : EnergyCounter::columns())
+      columns.push_back(column);
+  if (settings.dram_traffic)
+    for (const ReportMetric &column : DramCounter::columns())
+      columns.push_back(column);
+  if (settings.vectorization_report)
+    for (const std::string &column : VectorCoverage::column_names())
+      add(column, PER_KERNEL);
+  if (settings.code_footprint)
+    for (const std::string &column : CodeFootprint::column_names())
+      add(column, PER_KERNEL);
+  auto has = [&columns](const char *name) {
+    return std::any_of(
+        columns.begin(), columns.end(),
+        [name](const ReportMetric &column) { return column.name == name; });
+  };
+  if (has("instructions") && has("cycles"))
+    add("ipc", PER_KERNEL);
+  // Top-down slots and miss rates
+  for (const MetricGroup &group : settings.metric_groups)
+    for (const std::string &column : group.columns)
+      add(column, PER_KERNEL);
+  add("rss_bytes", PER_KERNEL);
+  if (settings.call_latency_calls)
+    for (const std::string &column : LatencyHistogram::columns())
+      add(column, SUM);
+  if (CommandManager::is_verifying()) {
+    add("verified", PER_KERNEL);
+    add("mismatches", PER_KERNEL);
+    add("max_rel_error", PER_KERNEL);
+    add("max_ulp_error", PER_KERNEL);
+  }
+  for (ElementType type : ElementTypes::all())
+    add(ElementTypes::bytes_column(type), SUM);
+  if (settings.track_allocations) {
+    add("alloc_count", SUM);
+    add("alloc_bytes", SUM);
+    add("peak_live_bytes", PER_KERNEL);
+    add("page-faults", SUM);
+  }
+  if (ParallelRuntime::is_gpu(CommandManager::parallel_runtime))
+    for (const std::string &column : GpuRuntime::columns())
+      add(column, SUM);
+  if (settings.thread_scope == ThreadScope::PER_CORE) {
+    add("active_threads", PER_KERNEL);
+    add("imbalance", PER_KERNEL);
+  }
+  return columns;
+}
+
+std::vector<std::string> CommandManager::get_report_metrics() {
+  std::vector<std::string> names;
+  for (const ReportMetric &column :
+       CommandManager::get_report_metric_definitions())
+    names.push_back(column.name);
+  return names;
+}
+
+std::string CommandManager::get_primary_metric() {
+  return settings.perf_metrics.empty() ? "seconds" : settings.perf_metrics[0];
+}
+
+std::vector<std::pair<std::string, std::string>>
+CommandManager::get_run_annotations() {
+  const InputProfile &input = settings.input_profile;
+  bool sparse = input.profile == DataProfile::SPARSE;
+  std::vector<std::pair<std::string, std::string>> annotations = {
+      {"target_triple", CommandManager::target.triple.empty()
+                            ? "host"
+                            : CommandManager::target.triple},
+      {"target_cpu", CommandManager::target.cpu},
+      {"target_features", TargetInfo::features_string(CommandManager::target)},
+      {"vector_width", CommandManager::target.vector_width
+                           ? std::to_string(CommandManager::target.vector_width)
+                           : "default"},
+      {"llvm_opt", BackendOpt::describe(CommandManager::backend_opt)},
+      {"parallel_runtime",
+       ParallelRuntime::describe(CommandManager::parallel_runtime)},
+      {"input_layout", MemRefLayout::describe(settings.input_layout)},
+      {"input_seed", std::to_string(settings.input_seed)},
+      {"ftz_daz", settings.ftz_daz ? "on" : "off"},
+      {"input_profile", TensorFuzzer::describe(input.profile)},
+      {"input_density",
+       sparse ? std::to_string(1.f - input.sparsity.sparsity_percentage)
+              : "1"},
+      {"sparsity_dist",
+       sparse ? TensorFuzzer::describe(input.sparsity.distribution_type)
+              : "none"},
+      {"tensor_source", settings.tensor_source_dir.empty()
+                            ? "generated"
+                            : settings.tensor_source_dir.generic_string()},
+      {"input_cache", settings.input_cache_dir.empty() ? "off" : "on"},
+      {"buffer_alignment",
+       std::to_string(settings.arena_config.alignment)},
+      {"huge_pages",
+       TensorArena::describe(settings.arena_config.huge_pages)},
+      {"numa_policy",
+       NumaPlacement::describe(settings.arena_config.numa_policy)},
+      {"numa_nodes",
+       NumaPlacement::describe_nodes(settings.arena_config.numa_nodes)},
+      {"measure_node", std::to_string(NumaPlacement::node_of_cpu(
+                           CommandManager::get_measure_cpu()))},
+      {"measure_cpu", std::to_string(CommandManager::get_measure_cpu())},
+      {"governor", CPUEnvironment::governor(CommandManager::get_measure_cpu())},
+      {"turbo", CPUEnvironment::turbo_state()},
+      {"cpu_mhz", std::to_string(CPUEnvironment::current_frequency_mhz(
+                      CommandManager::get_measure_cpu()))},
+      {"outlier_rejection",
+       Statistics::describe(settings.outlier_config.method)},
+      {"noise_monitor",
+       NoiseMonitor::describe(settings.noise_config.action)},
+  };
+  if (!CommandManager::comparison_pipelines.empty())
+    annotations.emplace_back("pipeline", CommandManager::active_pipeline);
+  return annotations;
+}
+
+const TargetSpec &CommandManager::get_target() {
+  return CommandManager::target;
 }
 
 /*
@@ -202,97 +704,170 @@ void CommandManager::isolate_torch_kernels(const std::string &filepath) {
 
   // Detecting model filepath
   fs::path model_filepath = fs::current_path().append(filepath);
-  fs::path log_path = fs::path(CommandManager::outputFolder)
+  fs::path log_path = fs::path(settings.outputFolder)
                           .append("logs_" + get_timestamp_string());
 
   // Prepare lowering output folder path
 
   std::string model_isolation_command =
-      CommandManager::torch_opt_exec.generic_string() +
-      " --isolate-torch-ops=\"output-path=" +
-      CommandManager::loweringFolder.generic_string() + "\" " +
+      settings.torch_opt_exec.generic_string() +
+      " --mlir-print-debuginfo --isolate-torch-ops=\"output-path=" +
+      settings.loweringFolder.generic_string() + "\" " +
       model_filepath.generic_string() + " > " +
-      CommandManager::outputFolder.generic_string() + "/model_lower.log";
-
-  // std::cout << "Executing command: " << model_isolation_command.c_str()
-  //           << std::endl;
-  std::cout << "Starting Operator Isolation\n";
-  // Create model lowerings
-  CommandManager::exec(model_isolation_command.c_str());
-  // std::cout << "Successfully isolated torch operators\n";
-}
-
-std::vector<std::string> CommandManager::get_operation_types() {
-  // fs::path lowering_path =
-  //     fs::path(CommandManager::outputFolder).append("lowerings");
-  if (!fs::is_directory(CommandManager::loweringFolder)) {
-    std::cerr << "Isolation seems to have failed. Can't fetch op types\n";
-    return std::vector<std::string>();
+      settings.scratchFolder.generic_string() + "/model_lower.log";
+
+  // The same model through the same torch-opt isolates to the same kernels
+  CommandManager::isolation_key.clear();
+  CommandManager::isolation_restored = false;
+  if (!settings.isolation_cache_dir.empty()) {
+    CommandManager::isolation_key =
+        IsolationCache::key(model_filepath, settings.torch_opt_exec);
+    CommandManager::isolation_restored = IsolationCache::restore(
+        settings.isolation_cache_dir, CommandManager::isolation_key,
+        settings.loweringFolder);
   }
 
-  std::string list_command =
-      "ls -d " + CommandManager::loweringFolder.generic_string() + "/*/";
-
-  std::vector<std::string> returnedDirPaths =
-      CommandManager::get_cmd_output(list_command, '\n');
-
-  std::vector<std::string> opNames;
-  for (std::string s : returnedDirPaths) {
-    opNames.push_back(fs::path(s).parent_path().filename().generic_string());
+  if (!CommandManager::isolation_restored) {
+    // std::cout << "Executing command: " << model_isolation_command.c_str()
+    //           << std::endl;
+    std::cout << "Starting Operator Isolation\n";
+    // Create model lowerings
+    CommandManager::exec(model_isolation_command.c_str());
+    // std::cout << "Successfully isolated torch operators\n";
+
+    // Later stages read the kernels from the index rather than the folders,
+    // which fill up with their artifacts
+    if (!KernelIndex::build(settings.loweringFolder))
+      return;
+    if (!CommandManager::isolation_key.empty())
+      IsolationCache::store(settings.isolation_cache_dir,
+                            CommandManager::isolation_key,
+                            settings.loweringFolder);
   }
 
-  return opNames;
-}
-
-// Get the list of outlined files in the specified path
-std::vector<std::string>
-CommandManager::get_file_list(const fs::path &folderPath) {
-  std::vector<std::string> kernel_vec = CommandManager::get_cmd_output(
-      std::string("ls ") + folderPath.c_str() + "/*", '\n');
-  return kernel_vec;
+  // Kernels keep their op's loc(...) (debug info above), which ties them
+  // back to the model's layers. Bytecode models are read through a print
+  // without their weights.
+  fs::path model_text_filepath = model_filepath;
+  if (ModelSource::is_bytecode(model_filepath)) {
+    model_text_filepath = fs::path(settings.scratchFolder)
+                              .append(model_filepath.stem().string() +
+                                      ".layers.mlir");
+    if (!ModelSource::write_text(model_filepath, model_text_filepath,
+                                 ModelSource::ELIDE_BYTES))
+      return;
+  }
+  settings.modelTextFilepath = model_text_filepath;
+  ModelLayers::build(model_filepath, model_text_filepath,
+                     settings.loweringFolder);
 }
 
-fs::path CommandManager::lower_to_llvm_dialect(const fs::path &mlirFilePath) {
-  // 1. Lower Torch to Linalg
-  fs::path linalg_path(mlirFilePath.parent_path().append(
-      mlirFilePath.filename().replace_extension(".linalg.mlir").c_str()));
+fs::path CommandManager::lower_to_llvm_ir(const fs::path &mlirFilePath,
+                                          bool profile) {
+  fs::path linalg_path = fs::path(mlirFilePath)
+                             .replace_extension(profile ? ".linalg.mlir"
+                                                        : ".linalg.mlirbc");
+  fs::path llvm_mlir_filepath =
+      fs::path(mlirFilePath).replace_extension(".llvm.mlirbc");
+  fs::path ll_filepath = fs::path(mlirFilePath).replace_extension(".llvm.ll");
 
-  std::string linalg_lowering_cmd =
-      CommandManager::torch_opt_exec.generic_string() + " \
+  // Profiles time every pass, so they never start from a shared prefix
+  std::vector<std::string> pass_list =
+      CommandManager::extract_pass_list(mlirFilePath);
+  PassPrefixCache::Plan plan;
+  if (!profile)
+    plan = PassPrefixCache::plan(
+        mlirFilePath, pass_list, CommandManager::get_toolchain_identity(),
+        fs::path(settings.loweringFolder).append("prefixes"));
+  auto passes = [&pass_list](size_t first, size_t last) {
+    std::string pass_seq = " ";
+    for (size_t i = first; i < last; i++)
+      pass_seq += " --" + pass_list[i] + " ";
+    return pass_seq;
+  };
+
+  // 1. Lower Torch to Linalg, unless a shared prefix is already lowered
+  std::string lowering_cmd;
+  if (plan.start.empty()) {
+    lowering_cmd =
+        settings.torch_opt_exec.generic_string() + " \
   -pass-pipeline=\"builtin.module(torch-backend-to-linalg-on-tensors-backend-pipeline)\" " +
-      mlirFilePath.generic_string() + " > " + linalg_path.c_str();
-
-  CommandManager::exec(linalg_lowering_cmd.c_str());
-
-  std::string pass_seq = CommandManager::extract_pipeline();
-
-  // 2. Lower Linalg to LLVM
-  // Lower the file to .ll format
-  fs::path llvm_mlir_filepath = mlirFilePath.parent_path().append(
-      mlirFilePath.filename().replace_extension(".llvm.mlir").c_str());
-
-  // Create .ll file using supplied pass pipeline
-  std::string llvm_lowering_cmd =
-      CommandManager::mlir_opt_exec.generic_string() + " " +
-      linalg_path.c_str() + pass_seq + " -o " + llvm_mlir_filepath.c_str();
-
-  std::cout << "Lowering command: " << llvm_lowering_cmd.c_str() << std::endl;
-
-  CommandManager::get_cmd_output(llvm_lowering_cmd, '\0');
-  return llvm_mlir_filepath;
-}
-
-// Compiling the LLVM Dialect file
-fs::path
-CommandManager::compile_llvm_dialect(const fs::path &llvm_mlir_filepath) {
-  fs::path ll_filepath = fs::path(llvm_mlir_filepath).replace_extension(".ll");
-  std::string cmd_string = "\
-        mlir-translate --mlir-to-llvmir " +
-                           llvm_mlir_filepath.generic_string() + " > " +
-                           ll_filepath.generic_string();
+        mlirFilePath.generic_string() + (profile ? "" : " --emit-bytecode");
+    if (settings.enableLogFiles || profile)
+      lowering_cmd += " | tee " + linalg_path.generic_string();
+  } else {
+    lowering_cmd = "cat " + plan.start.generic_string();
+  }
 
-  CommandManager::exec(cmd_string);
+  // GPU kernels are also written out as text once outlined, to check that
+  // no memory access stayed in the host code. A shared prefix past that
+  // point comes from a lowering of the same kernel that passed the check,
+  // and profiles follow a plain lowering.
+  fs::path outlined_filepath;
+  size_t outlined_depth = 0;
+  if (ParallelRuntime::is_gpu(CommandManager::parallel_runtime) && !profile) {
+    outlined_depth = GpuRuntime::outlined_depth(pass_list);
+    if (outlined_depth > plan.start_depth)
+      outlined_filepath =
+          fs::path(mlirFilePath).replace_extension(".outlined.mlir");
+  }
 
+  // 2. Lower Linalg to LLVM using the supplied pass pipeline, writing the
+  // shared prefixes on the way
+  size_t depth = plan.start_depth;
+  auto lower_to = [&](size_t target_depth, bool text) {
+    if (target_depth > depth)
+      lowering_cmd += " | " + settings.mlir_opt_exec.generic_string() +
+                      passes(depth, target_depth) +
+                      (text ? "" : " --emit-bytecode");
+    depth = std::max(depth, target_depth);
+  };
+  bool outlined = outlined_filepath.empty();
+  for (const PassPrefixCache::Plan::Store &store : plan.stores) {
+    if (!outlined && outlined_depth <= store.depth) {
+      lower_to(outlined_depth, true);
+      lowering_cmd += " | tee " + outlined_filepath.generic_string();
+      outlined = true;
+    }
+    lower_to(store.depth, false);
+    lowering_cmd += " | tee " + store.staging.generic_string();
+  }
+  if (!outlined) {
+    lower_to(outlined_depth, true);
+    lowering_cmd += " | tee " + outlined_filepath.generic_string();
+  }
+  if (depth < pass_list.size() || profile) {
+    lowering_cmd += " | " + settings.mlir_opt_exec.generic_string() +
+                    passes(depth, pass_list.size()) + " --emit-bytecode";
+    if (profile)
+      lowering_cmd += CompileProfiler::mlir_opt_flags(
+          CompileProfiler::log_filepath(mlirFilePath));
+  }
+  if (settings.enableLogFiles)
+    lowering_cmd += " | tee " + llvm_mlir_filepath.generic_string();
+
+  // 3. Translate to LLVM IR
+  lowering_cmd +=
+      " | mlir-translate --mlir-to-llvmir > " + ll_filepath.generic_string();
+
+  std::cout << "Lowering command: " << lowering_cmd << std::endl;
+  CommandManager::exec(lowering_cmd);
+
+  std::error_code ec;
+  if (!outlined_filepath.empty()) {
+    std::string access = GpuRuntime::host_memory_access(outlined_filepath);
+    if (!access.empty()) {
+      std::cerr << "Rejecting " << mlirFilePath.filename()
+                << " for the GPU: its host code keeps " << access
+                << " of " << outlined_filepath.filename()
+                << ", which would access device buffers from the host\n";
+      fs::remove(ll_filepath, ec);
+    }
+    if (!settings.enableLogFiles)
+      fs::remove(outlined_filepath, ec);
+  }
+  PassPrefixCache::commit(plan, fs::exists(ll_filepath) &&
+                                    fs::file_size(ll_filepath, ec) > 0);
   return ll_filepath;
 }
 
@@ -301,11 +876,11 @@ void CommandManager::generate_metadata_json(const std::string &mlir_filepath,
                                             const std::string &log_filename) {
 
   std::string log_file_appending =
-      CommandManager::enableLogFiles || log_filename.size()
+      settings.enableLogFiles || log_filename.size()
           ? " > " + log_filename
           : "";
   std::string param_gen_cmd =
-      CommandManager::torch_opt_exec.generic_string() +
+      settings.torch_opt_exec.generic_string() +
       " --generate-param-metadata=\"output-json=" + std::string(json_filename) +
       "\" " + mlir_filepath.c_str() + log_file_appending;
 
@@ -313,6 +888,49 @@ void CommandManager::generate_metadata_json(const std::string &mlir_filepath,
   CommandManager::exec(param_gen_cmd);
 }
 
+PipelineSpec CommandManager::resolve_pipeline(const fs::path &pipeline_json) {
+  json file = load_json_from_file(pipeline_json);
+  PipelineSpec pipeline;
+  pipeline.label = pipeline_json.stem().string();
+  pipeline.pipeline_json = pipeline_json;
+  pipeline.target = TargetInfo::from_pipeline_json(file);
+  pipeline.backend_opt = BackendOpt::from_pipeline_json(file);
+  pipeline.parallel_runtime = ParallelRuntime::from_pipeline_json(file);
+  // Results of GPU kernels live in preallocated device buffers
+  if (ParallelRuntime::is_gpu(pipeline.parallel_runtime)) {
+    pipeline.out_params = true;
+    if (pipeline.target.gpu_chip.empty())
+      pipeline.target.gpu_chip =
+          GpuRuntime::device_chip(pipeline.parallel_runtime);
+    if (pipeline.target.gpu_chip.empty())
+      std::cerr << "No GPU to take the chip of " << pipeline.label
+                << " from, set \"gpu_chip\" in " << pipeline_json << "\n";
+  }
+  // A cross target's "native" is the CPU of hosts not known here
+  if (pipeline.target.requested_cpu == "native" &&
+      !TargetInfo::is_cross(pipeline.target)) {
+    std::string cpu_flag = TargetInfo::host_architecture() == "aarch64"
+                               ? " -mcpu=native"
+                               : " -march=native";
+    std::string host_cpu = TargetInfo::parse_driver_target_cpu(
+        CommandManager::exec(settings.compiler + cpu_flag +
+                             " -### -x c -c /dev/null 2>&1"));
+    if (!host_cpu.empty())
+      pipeline.target.cpu = host_cpu;
+  }
+  return pipeline;
+}
+
+void CommandManager::use_pipeline(const PipelineSpec &pipeline) {
+  settings.pipeline_json = pipeline.pipeline_json;
+  CommandManager::target = pipeline.target;
+  CommandManager::backend_opt = pipeline.backend_opt;
+  CommandManager::parallel_runtime = pipeline.parallel_runtime;
+  CommandManager::active_pipeline = pipeline.label;
+  CommandManager::out_params = pipeline.out_params;
+  CommandManager::pgo = pipeline.pgo;
+}
+
 /*
  * Get the output as a string vector seperated by a delimiter
  */
@@ -331,9 +949,86 @@ std::vector<std::string> CommandManager::get_cmd_output(const std::string &cmd,
 }
 
 fs::path CommandManager::generate_ll_file(const fs::path &mlirFilePath) {
+  // Profiles need an actual lowering
+  if (!CompileCache::is_enabled() || CompileProfiler::is_enabled())
+    return CommandManager::generate_ll_file_uncached(mlirFilePath);
+
   fs::path llvm_mlir_filepath =
-      CommandManager::lower_to_llvm_dialect(mlirFilePath);
-  return CommandManager::compile_llvm_dialect(llvm_mlir_filepath);
+      fs::path(mlirFilePath).replace_extension(".llvm.mlirbc");
+  fs::path ll_filepath = fs::path(mlirFilePath).replace_extension(".llvm.ll");
+
+  // The cached .ll is already through the llvm_opt stage
+  std::string cache_key = CompileCache::lowering_key(
+      mlirFilePath,
+      CommandManager::extract_pipeline(mlirFilePath) + " | llvm_opt=" +
+          BackendOpt::describe(CommandManager::backend_opt),
+      CommandManager::get_toolchain_identity());
+  if (CompileCache::fetch_lowering(cache_key, ll_filepath, llvm_mlir_filepath))
+    return ll_filepath;
+
+  fs::path generated_ll =
+      CommandManager::generate_ll_file_uncached(mlirFilePath);
+  CompileCache::store_lowering(cache_key, generated_ll, llvm_mlir_filepath);
+  return generated_ll;
+}
+
+fs::path
+CommandManager::generate_ll_file_uncached(const fs::path &mlirFilePath,
+                                          bool profile) {
+  // GPU kernels are checked between the passes (see lower_to_llvm_ir)
+  if (settings.lowering_engine == LoweringEngine::IN_PROCESS &&
+      !profile &&
+      !ParallelRuntime::is_gpu(CommandManager::parallel_runtime)) {
+    // Keeping the same file name as the popen path (<kernel>.llvm.ll)
+    fs::path ll_filepath = fs::path(mlirFilePath).replace_extension(".llvm.ll");
+    if (MLIREngine::lower_kernel(
+            mlirFilePath, CommandManager::extract_pass_list(mlirFilePath),
+            ll_filepath, settings.enableLogFiles)) {
+      CommandManager::optimize_ll_file(ll_filepath);
+      return ll_filepath;
+    }
+
+    std::cerr << "In-process lowering failed for " << mlirFilePath
+              << ". Retrying with the popen toolchain\n";
+  }
+
+  fs::path ll_filepath =
+      CommandManager::lower_to_llvm_ir(mlirFilePath, profile);
+  CommandManager::optimize_ll_file(ll_filepath);
+  return ll_filepath;
+}
+
+bool CommandManager::optimize_ll_file(const fs::path &ll_filepath) {
+  if (!BackendOpt::needs_opt(CommandManager::backend_opt))
+    return true;
+
+  std::error_code ec;
+  if (!fs::exists(ll_filepath) || fs::file_size(ll_filepath, ec) == 0)
+    return false;
+
+  fs::path noopt_filepath =
+      fs::path(ll_filepath).replace_extension(".noopt.ll");
+  fs::rename(ll_filepath, noopt_filepath, ec);
+  if (ec) {
+    std::cerr << "Failed to stage " << ll_filepath << " for opt\n";
+    return false;
+  }
+
+  CommandManager::exec(BackendOpt::opt_command(
+      CommandManager::backend_opt, settings.llvm_opt_exec,
+      noopt_filepath, ll_filepath));
+
+  // Never lose the kernel to a failed opt run
+  if (!fs::exists(ll_filepath) || fs::file_size(ll_filepath, ec) == 0) {
+    std::cerr << "opt failed for " << ll_filepath
+              << ", using the unoptimised IR\n";
+    fs::rename(noopt_filepath, ll_filepath, ec);
+    return false;
+  }
+
+  if (!settings.enableLogFiles)
+    fs::remove(noopt_filepath, ec);
+  return true;
 }
 
 /*
@@ -370,6 +1065,9 @@ fs::path CommandManager::generate_ll_file(const fs::path &mlirFilePath) {
  * Hence, we are abandoning it now. If I get some time to try out this route, we
  * might be able to achieve this
  *
+ * Kernels are instead verified against a reference pipeline's results on the
+ * same inputs, see output_verifier.h
+ *
  */
 // void CommandManager::execute_with_python(fs::path json_filepath,
 //                                          const std::string &op_type) {
@@ -445,10 +1143,104 @@ fs::path CommandManager::generate_ll_file(const fs::path &mlirFilePath) {
 //   Py_Finalize();
 // }
 
-std::string CommandManager::extract_pipeline() {
-  json file = load_json_from_file(CommandManager::pipeline_json);
+/*
+ * The lowering tools are identified by path and build time, so that
+ * rebuilding torch-mlir in place invalidates cached lowerings
+ */
+std::string CommandManager::get_toolchain_identity() {
+  std::string identity;
+  for (const fs::path &tool :
+       {settings.torch_opt_exec, settings.mlir_opt_exec,
+        settings.llvm_opt_exec}) {
+    std::error_code ec;
+    auto mtime = fs::last_write_time(tool, ec);
+    identity += tool.generic_string() + "@" +
+                std::to_string(ec ? 0 : mtime.time_since_epoch().count()) +
+                ";";
+  }
+  return identity;
+}
+
+std::string CommandManager::get_compiler_identity() {
+  // Queried once, the compiler does not change during a run
+  static std::string identity =
+      settings.compiler + "\n" +
+      CommandManager::exec(settings.compiler + " --version");
+  return identity;
+}
+
+std::string CommandManager::get_compile_flags() {
+  return "--std=c++20 -fPIC -shared -Wno-everything -Woverride-module" +
+         TargetInfo::compile_flags(CommandManager::target) +
+         BackendOpt::compile_flags(CommandManager::backend_opt) +
+         ParallelRuntime::link_flags(CommandManager::parallel_runtime);
+}
+
+std::string CommandManager::get_measurement_hash() {
+  const InputProfile &input = settings.input_profile;
+  const SamplingConfig &sampling = settings.sampling;
+  const WarmupConfig &warmup = settings.warmup;
+  json config = {
+      {"build",
+       {CommandManager::get_compile_flags(), settings.compiler,
+        int(settings.link_mode), int(settings.execution_engine),
+        int(settings.call_interface), settings.ftz_daz}},
+      {"inputs",
+       {settings.input_seed, int(input.profile),
+        int(input.sparsity.distribution_type), input.sparsity.row_block_size,
+        input.sparsity.sparsity_percentage,
+        int(settings.input_layout)}},
+      {"cache_mode", int(settings.cache_mode)},
+      {"sampling",
+       {settings.perf_run_count, sampling.target_ci,
+        sampling.max_seconds, sampling.max_samples,
+        sampling.min_window_seconds, sampling.max_inner_repetitions,
+        warmup.runs, warmup.auto_detect, warmup.window, warmup.cv_threshold,
+        warmup.max_runs, int(settings.outlier_config.method),
+        settings.outlier_config.threshold,
+        int(settings.call_overhead), int(settings.counter_mode),
+        settings.counter_batch_size,
+        int(settings.thread_scope)}}};
+  return hash_to_hex(hash_string(config.dump()));
+}
+
+std::vector<std::string>
+CommandManager::extract_pass_list(const fs::path &kernel) {
+  // The sparsifier bufferizes on its own, out-params don't apply
+  bool sparse = !kernel.empty() && SparseEncoding::is_sparse_kernel(kernel);
+  json file = load_json_from_file(sparse ? settings.sparse_pipeline_json
+                                         : settings.pipeline_json);
   std::vector<std::string> pass_list =
       file["pass"].template get<std::vector<std::string>>();
+  TargetInfo::apply_to_pass_list(CommandManager::target, pass_list);
+  if (ParallelRuntime::is_gpu(CommandManager::parallel_runtime))
+    GpuRuntime::apply_to_pass_list(CommandManager::target.gpu_chip,
+                                   pass_list);
+  // Right after bufferization, so that buffer deallocation sees the
+  // out-params and hoisted static allocations leave no copy behind
+  if (CommandManager::out_params && !sparse) {
+    auto position = std::find_if(
+        pass_list.begin(), pass_list.end(), [](const std::string &pass) {
+          return pass.rfind("one-shot-bufferize", 0) == 0;
+        });
+    if (position != pass_list.end())
+      position++;
+    else
+      position = std::find_if(
+          pass_list.begin(), pass_list.end(), [](const std::string &pass) {
+            return pass.find("-to-llvm") != std::string::npos;
+          });
+    pass_list.insert(position,
+                     "buffer-results-to-out-params=\"hoist-static-allocs\"");
+  }
+  if (settings.call_interface == CallInterface::TRAMPOLINE)
+    CallTrampoline::request_c_interface(pass_list);
+  return pass_list;
+}
+
+std::string CommandManager::extract_pipeline(const fs::path &kernel) {
+  std::vector<std::string> pass_list =
+      CommandManager::extract_pass_list(kernel);
 
   std::string pass_seq = " ";
   for (const std::string &pass : pass_list) {
@@ -461,10 +1253,14 @@ std::string CommandManager::extract_pipeline() {
  * Execute the specified ll-file with the specified argument metadata
  */
 std::vector<std::map<std::string, double>>
-CommandManager::execute_with_parameters(const fs::path &ll_object_filepath,
-                                        const fs::path &json_filepath) {
+CommandManager::execute_with_parameters(
+    const fs::path &ll_object_filepath, const fs::path &json_filepath,
+    KernelHandle *prepared_kernel,
+    std::vector<std::map<std::string, double>> *warmup_results,
+    std::vector<std::map<std::string, double>> *cold_results,
+    std::map<std::string, std::vector<std::map<std::string, double>>>
+        *baseline_results) {
   // 1. Read in JSON
-  fs::path parent_path = ll_object_filepath.parent_path();
   std::cout << "Working on: " << ll_object_filepath.filename().generic_string()
             << std::endl;
 
@@ -479,91 +1275,314 @@ CommandManager::execute_with_parameters(const fs::path &ll_object_filepath,
       kernel_function_json["returns"].template get<std::vector<json>>();
 
   // Prepare appropriate MemRef structures
-  std::ofstream data_output_filestream(ll_object_filepath.generic_string() +
-                                       ".output");
-
-  // Storing tensor arguments as MemRef argument structures
+  // Storing tensor arguments as MemRef argument structures, released when
+  // the kernel is done
+  std::vector<std::unique_ptr<MemRefArg>> argument_storage;
   std::vector<MemRefArg *> argument_data;
+  // Buffers of inputs which are not owned by the arena (mapped files)
+  std::vector<std::pair<void *, uint64_t>> mapped_inputs;
+
+  // Measurement thread setup: affinity is set before the inputs are
+  // generated, so that first touch places them on the measurement CPU's node.
+  // Worker threads of parallel kernels inherit the affinity mask, so the
+  // thread is only pinned for serial kernels, or to the CPUs of a thread
+  // budget.
+  const ThreadScope thread_scope = settings.thread_scope;
+  const unsigned int thread_budget = settings.thread_budget;
+  int cpu = CommandManager::get_measure_cpu();
+  if (thread_budget > 0) {
+    if (!ParallelRuntime::apply_thread_budget(thread_budget, cpu))
+      std::cerr << "Failed to pin the measurement thread to " << thread_budget
+                << " CPUs from CPU " << cpu << std::endl;
+  } else if (thread_scope == ThreadScope::CALLING_THREAD &&
+             !pin_current_thread(cpu)) {
+    std::cerr << "Failed to pin the measurement thread to CPU " << cpu
+              << std::endl;
+  }
 
-  int log_counter = 1;
+  // Input buffers come from the session arena, recycled for every kernel
+  if (!CommandManager::tensor_arena)
+    CommandManager::tensor_arena =
+        std::make_unique<TensorArena>(settings.arena_config);
+  CommandManager::tensor_arena->reset();
+
+  // Real tensors are mapped in place of generated ones, for this kernel only
+  std::unique_ptr<TensorSource> tensor_source;
+  if (!settings.tensor_source_dir.empty())
+    tensor_source =
+        std::make_unique<TensorSource>(settings.tensor_source_dir);
+  // Generated inputs kept across pipelines and runs
+  std::unique_ptr<InputCache> input_cache;
+  if (!settings.input_cache_dir.empty())
+    input_cache =
+        std::make_unique<InputCache>(settings.input_cache_dir);
+  std::string kernel_name = json_filepath.stem().generic_string();
+  // Isolated torch kernel next to the metadata, the same for every pipeline
+  fs::path kernel_source = fs::path(json_filepath).replace_extension();
+  uint64_t kernel_hash = fs::exists(kernel_source)
+                             ? hash_file_contents(kernel_source)
+                             : hash_string(kernel_name);
+  // Recorded argument distributions, next to the metadata
+  std::vector<std::shared_ptr<const TensorStats>> argument_stats;
+  if (settings.input_profile.profile == DataProfile::FROM_STATS) {
+    argument_stats = ActivationStats::load(json_filepath);
+    if (argument_stats.empty())
+      std::cerr << "No activation statistics for " << kernel_name
+                << ", using random-norm inputs\n";
+  }
+  uint64_t generated_bytes = 0;
+  uint64_t cached_bytes = 0;
+  double generation_seconds = 0.0;
 
   // Parse Arguments from JSON and Generate data for arguments
-  for (auto a : arg_arr) {
-    JSONArgument argObject = a.template get<JSONArgument>();
+  for (size_t arg_index = 0; arg_index < arg_arr.size(); arg_index++) {
+    JSONArgument argObject = arg_arr[arg_index].template get<JSONArgument>();
+    MemRefLayout::apply(argObject, settings.input_layout);
 
     // Representing each argument using the MemRefArg structure
-    MemRefArg *arg = new MemRefArg(argObject);
+    argument_storage.push_back(std::make_unique<MemRefArg>(argObject));
+    MemRefArg *arg = argument_storage.back().get();
+
+    MappedTensor mapped;
+    if (tensor_source &&
+        tensor_source->bind(kernel_name, arg_index, argObject, mapped)) {
+      // Zero copy: the descriptor points into the mapping
+      arg->setData(mapped.data);
+      argument_data.push_back(arg);
+      mapped_inputs.emplace_back(mapped.data, mapped.bytes);
+      std::cout << "Input " << arg_index << " mapped from --tensor-source ("
+                << (mapped.bytes >> 20) << " MiB)\n";
+      continue;
+    }
 
     // Generate random normalised data
     DataFormatInfo dataInfo;
-    // DataFormatInfo dataInfo(
-    // DataProfile::TEST); // This is done for demonstration purposes
-    auto elem_count = arg->get_tensor_elem_count();
+    dataInfo.setInputProfile(settings.input_profile);
+    // Padded layouts span more elements than the tensor holds, the padding
+    // is filled as well
+    auto elem_count = arg->get_buffer_elem_count();
     dataInfo.setElemCount(elem_count);
+    dataInfo.setElemType(arg->m_elem_type);
+    // Sparsity patterns follow the rows of the buffer, i.e. the row pitch
+    int rank = arg->get_tensor_rank();
+    if (rank > 0)
+      dataInfo.setRowLength(std::max(
+          arg->m_desc->dimension[rank - 1],
+          rank > 1 ? arg->m_desc->strides[rank - 2] : int64_t(0)));
+    if (arg_index < argument_stats.size())
+      dataInfo.setStats(argument_stats[arg_index]);
+    // Data order variants draw the same logical tensor as their model kernel
+    DataOrder order;
+    if (!argObject.data_order.empty() &&
+        DataOrders::parse(argObject.data_order, order))
+      dataInfo.setDataOrder(order, argObject.shape);
+    // One stream per argument, identical for every pipeline of the kernel
+    dataInfo.setSeed(TensorFuzzer::stream_seed(settings.input_seed,
+                                               kernel_hash, arg_index));
+
+    // Lazily zeroed inputs are mapped untouched, the kernel faults them in
+    if (TensorFuzzer::is_untouched(dataInfo.m_profile)) {
+      void *zero_pages = CommandManager::tensor_arena->allocate_untouched(
+          elem_count * arg->get_elem_size());
+      if (!zero_pages) {
+        std::cerr << "Failed to map zero pages for "
+                  << ll_object_filepath.filename() << std::endl;
+        return std::vector<std::map<std::string, double>>();
+      }
+      arg->setData(zero_pages);
+      arg->m_desc->offset = argObject.offset;
+      argument_data.push_back(arg);
+      continue;
+    }
 
-    // Add generated data into argument
-    float *generated_data = TensorFuzzer::generate_data(dataInfo);
+    // Add generated data into argument, through the cache if there is one
+    auto fill_start = std::chrono::steady_clock::now();
+    uint64_t bytes = elem_count * arg->get_elem_size();
+    void *generated_data = CommandManager::tensor_arena->allocate(bytes);
+    auto fill = [&dataInfo](void *array) {
+      return TensorFuzzer::fill_data(dataInfo, array);
+    };
+    bool hit = false;
+    if (!generated_data ||
+        !(input_cache ? input_cache->load(InputCache::key(dataInfo),
+                                          generated_data, bytes, fill, hit)
+                      : fill(generated_data))) {
+      std::cerr << "Failed to generate input data for "
+                << ll_object_filepath.filename() << std::endl;
+      return std::vector<std::map<std::string, double>>();
+    }
+    if (hit) {
+      cached_bytes += bytes;
+    } else {
+      generation_seconds += std::chrono::duration<double>(
+                                std::chrono::steady_clock::now() - fill_start)
+                                .count();
+      generated_bytes += bytes;
+    }
     arg->setData(generated_data);
+    arg->m_desc->offset = argObject.offset;
 
     argument_data.push_back(arg);
+  }
+  if (generated_bytes && generation_seconds > 0.0)
+    std::cout << "Generated " << (generated_bytes >> 20) << " MiB of inputs ("
+              << generated_bytes / generation_seconds / 1e9 << " GB/s)\n";
+  if (cached_bytes)
+    std::cout << "Read " << (cached_bytes >> 20)
+              << " MiB of inputs from --input-cache\n";
+
+  // --sparse-args variants take the buffers of their encoded arguments in
+  // place of the dense tensors, compressed from the same inputs
+  bool sparse_inputs = false;
+  for (const json &arg : arg_arr)
+    sparse_inputs |= arg.contains("sparse");
+  if (sparse_inputs) {
+    std::vector<MemRefArg *> compressed_data;
+    for (size_t arg_index = 0; arg_index < arg_arr.size(); arg_index++) {
+      JSONArgument argObject = arg_arr[arg_index].template get<JSONArgument>();
+      SparseArgument sparse;
+      if (argObject.sparse_format.empty() ||
+          !SparseEncoding::parse_format(argObject.sparse_format, sparse)) {
+        compressed_data.push_back(argument_data[arg_index]);
+        continue;
+      }
+      MemRefArg *dense_arg = argument_data[arg_index];
+      std::vector<uint8_t> dense = dense_arg->dense_copy();
+      std::vector<SparseBuffer> buffers;
+      if (!SparseEncoding::compress(sparse, argObject.shape,
+                                    dense_arg->m_elem_type, dense.data(),
+                                    buffers)) {
+        std::cerr << "Input " << arg_index << " can't be stored as "
+                  << argObject.sparse_format << std::endl;
+        return std::vector<std::map<std::string, double>>();
+      }
+      uint64_t stored = buffers.front().count;
+      for (const SparseBuffer &buffer : buffers) {
+        JSONArgument buffer_arg;
+        buffer_arg.dtype = ElementTypes::describe(buffer.type);
+        buffer_arg.rank = 1;
+        buffer_arg.shape = {buffer.count};
+        argument_storage.push_back(std::make_unique<MemRefArg>(buffer_arg));
+        MemRefArg *arg = argument_storage.back().get();
+        // Empty buffers still need an address
+        void *data = CommandManager::tensor_arena->allocate(
+            std::max<size_t>(buffer.data.size(), arg->get_elem_size()));
+        if (!data) {
+          std::cerr << "Failed to allocate the buffers of input "
+                    << arg_index << std::endl;
+          return std::vector<std::map<std::string, double>>();
+        }
+        if (!buffer.data.empty())
+          std::memcpy(data, buffer.data.data(), buffer.data.size());
+        arg->setData(data);
+        compressed_data.push_back(arg);
+      }
+      std::cout << "Input " << arg_index << " stored as "
+                << argObject.sparse_format << " (" << stored << " of "
+                << dense_arg->get_tensor_elem_count() << " entries)\n";
+    }
+    argument_data = std::move(compressed_data);
+  }
 
-    // @DEBUG: Logging results
-    if (CommandManager::enableRunLogs) {
-      data_output_filestream << "Input " << log_counter++ << ": [" << "\n";
-      for (int k = 0; k < elem_count; k++) {
-        data_output_filestream << generated_data[k] << ", ";
+  // --out-params kernels take their results after the inputs, allocated
+  // once here and overwritten by every call. Sparse kernels are lowered
+  // without them.
+  const bool out_params_call = CommandManager::out_params && !sparse_inputs;
+  std::vector<MemRefArg *> call_arguments = argument_data;
+  std::vector<std::unique_ptr<MemRefArg>> out_params;
+  if (out_params_call) {
+    for (const json &r : return_arg_arr) {
+      out_params.push_back(
+          std::make_unique<MemRefArg>(r.template get<JSONArgument>()));
+      MemRefArg *out = out_params.back().get();
+      void *buffer = CommandManager::tensor_arena->allocate(
+          out->get_tensor_elem_count() * out->get_elem_size());
+      if (!buffer) {
+        std::cerr << "Failed to allocate the results of "
+                  << ll_object_filepath.filename() << std::endl;
+        return std::vector<std::map<std::string, double>>();
       }
-      data_output_filestream << "]\n\n";
-      data_output_filestream.flush();
-      // std::cout << "End\n";
-    }
-  }
-
-  // Compile this file to a ".so" file
-  fs::path output_filepath = fs::path(parent_path).append("kernel_call.so");
-  std::string compilation_command =
-      CommandManager::compiler + " \
-      --std=c++20 \
-      -fPIC \
-      -shared -Wno-everything -Woverride-module \
-      -o " +
-      output_filepath.generic_string() + " -Wl,-rpath," +
-      CommandManager::llvm_lib_path.generic_string() + " -L" +
-      CommandManager::llvm_lib_path.generic_string() +
-      " -lmlir_runner_utils -lmlir_c_runner_utils " +
-      ll_object_filepath.generic_string();
-  CommandManager::exec(compilation_command);
-
-  //
-  // Prepare and call C++ using ffi
-  //
+      out->setData(buffer);
+      call_arguments.push_back(out);
+    }
+    std::cout << "Results preallocated as " << out_params.size()
+              << " out-params\n";
+  }
 
-  //  Import it using dlopen
-  void *fHandle = dlopen(output_filepath.c_str(), RTLD_LAZY);
-  if (fHandle == NULL) {
-    std::cerr << "Failed to open compiled version of "
-              << fs::path(ll_object_filepath).replace_extension().filename()
-              << std::endl;
-    std::cerr << dlerror() << std::endl;
-    return std::vector<std::map<std::string, double>>();
+  // GPU kernels get device copies of all of them. Descriptors point at the
+  // device buffers until sampling is done, the host buffers are kept here.
+  const bool on_gpu =
+      ParallelRuntime::is_gpu(CommandManager::parallel_runtime);
+  std::vector<std::pair<void *, void *>> host_pointers;
+  std::map<std::string, double> transfer_columns;
+  auto buffer_bytes = [](MemRefArg *arg) {
+    return static_cast<uint64_t>(arg->m_desc->offset +
+                                 arg->get_buffer_elem_count()) *
+           arg->get_elem_size();
+  };
+  if (on_gpu) {
+    if (!GpuRuntime::open(CommandManager::parallel_runtime))
+      return std::vector<std::map<std::string, double>>();
+    if (!CommandManager::device_arena)
+      CommandManager::device_arena = std::make_unique<DeviceArena>();
+    CommandManager::device_arena->reset();
+
+    uint64_t h2d_bytes = 0;
+    auto copy_start = std::chrono::steady_clock::now();
+    for (MemRefArg *arg : call_arguments) {
+      uint64_t bytes = buffer_bytes(arg);
+      void *device_ptr = CommandManager::device_arena->allocate(bytes);
+      if (!device_ptr || !GpuRuntime::copy_to_device(
+                             device_ptr, arg->m_desc->aligned_ptr, bytes)) {
+        std::cerr << "Failed to copy the arguments of "
+                  << ll_object_filepath.filename() << " to the device\n";
+        return std::vector<std::map<std::string, double>>();
+      }
+      host_pointers.emplace_back(arg->m_desc->base_ptr,
+                                 arg->m_desc->aligned_ptr);
+      arg->m_desc->base_ptr = device_ptr;
+      arg->m_desc->aligned_ptr = device_ptr;
+      h2d_bytes += bytes;
+    }
+    transfer_columns["h2d_bytes"] = static_cast<double>(h2d_bytes);
+    transfer_columns["h2d_seconds"] =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                      copy_start)
+            .count();
+    std::cout << "Copied " << (h2d_bytes >> 20) << " MiB to the device\n";
   }
 
-  //  Import function handle using dlsym
-  void *kHandle = dlsym(fHandle, "kernel_call");
-  if (!kHandle) {
-    std::cerr << "Failed to load kernel function: "
-              << fs::path(ll_object_filepath).replace_extension().filename()
-              << std::endl;
-    dlclose(fHandle);
+  KernelHandle local_kernel;
+  KernelHandle &kernel = prepared_kernel ? *prepared_kernel : local_kernel;
+  if (!CommandManager::load_kernel(ll_object_filepath, kernel))
     return std::vector<std::map<std::string, double>>();
+  void *kHandle = kernel.function;
+  // Usually analysed in prepare_kernel, not for JIT or batched kernels
+  std::map<std::string, double> object_columns;
+  if (settings.vectorization_report) {
+    if (!fs::exists(VectorCoverage::filepath(ll_object_filepath)))
+      CommandManager::analyse_vectorization(ll_object_filepath, kernel);
+    object_columns = VectorCoverage::columns(ll_object_filepath);
   }
+  // Batch objects hold every member, so only per kernel objects count
+  if (settings.code_footprint && !kernel.so_filepath.empty() &&
+      settings.link_mode == LinkMode::PER_KERNEL) {
+    if (!fs::exists(CodeFootprint::filepath(ll_object_filepath)))
+      CodeFootprint::analyse(kernel.so_filepath, ll_object_filepath);
+    std::map<std::string, double> footprint_columns =
+        CodeFootprint::columns(ll_object_filepath);
+    object_columns.insert(footprint_columns.begin(), footprint_columns.end());
+  }
+  if (thread_budget > 0)
+    ParallelRuntime::set_worker_count(CommandManager::parallel_runtime,
+                                      thread_budget, kernel.so_handle);
 
   //  Prepare the argument type list and data array to call the function
   std::vector<ffi_type *> func_arg_types;
   std::vector<void *> func_arg_data;
 
-  for (int i = 0; i < argument_data.size(); i++) {
-    MemRefArg *curr_memarg = argument_data[i];
+  for (size_t i = 0; i < call_arguments.size(); i++) {
+    MemRefArg *curr_memarg = call_arguments[i];
     // std::cout << "Argument State: " << i << std::endl;
     // curr_memarg->printState();
 
@@ -593,12 +1612,19 @@ CommandManager::execute_with_parameters(const fs::path &ll_object_filepath,
     }
   }
 
-  // Preparing Return Data Type and memory alignments
-  JSONArgument returnArgObject = return_arg_arr[0].template get<JSONArgument>();
-  // std::cout << "Return Rank: " << returnArgObject.rank << std::endl;
-  ffi_type *ret_arg_type = create_memref_struct_type(
-      returnArgObject.rank); // This will be a MemRef descriptor
-  // structure (most probably)
+  // Preparing Return Data Type and memory alignments. Several results come
+  // back as one packed struct of MemRef descriptors, out-params return none.
+  std::vector<JSONArgument> return_args;
+  if (!out_params_call)
+    for (const json &r : return_arg_arr)
+      return_args.push_back(r.template get<JSONArgument>());
+  ffi_type *ret_arg_type = create_results_struct_type(return_args);
+  if (!ret_arg_type) {
+    CommandManager::unload_kernel(kernel);
+    return std::vector<std::map<std::string, double>>();
+  }
+  std::unique_ptr<ffi_type, void (*)(ffi_type *)> ret_type_owner(
+      ret_arg_type, destroy_results_struct_type);
 
   // std::cout << "Arguments: " << func_arg_types.size() << "\t"
   //           << func_arg_data.size() << std::endl;
@@ -615,53 +1641,742 @@ CommandManager::execute_with_parameters(const fs::path &ll_object_filepath,
 
   if (status != FFI_OK) {
     std::cerr << "Failed to prepare kernel call: " << std::endl;
-    dlclose(fHandle);
+    CommandManager::unload_kernel(kernel);
     return std::vector<std::map<std::string, double>>();
   }
 
-  MemRefArg return_arg_data(returnArgObject);
-  return_arg_data.updateWithFFITemplate(ret_arg_type);
+  // One descriptor per result, filled from the packed return value
+  std::vector<std::unique_ptr<MemRefArg>> return_arg_data;
+  for (const JSONArgument &returned : return_args) {
+    return_arg_data.push_back(std::make_unique<MemRefArg>(returned));
+    return_arg_data.back()->updateWithFFITemplate(ret_arg_type);
+  }
 
   // TODO: Time this using perf-cpp
   // CommandManager::perf_event_counter.start();
   // ffi_call(&calling_interface, FFI_FN(kHandle), return_arg.getData(),
   //          func_arg_data.data());
 
-  std::cout << "Printer: \n";
-  for (int i = 0; i < func_arg_data.size(); i++) {
-    std::cout << *((uint64_t *)func_arg_data[i]) << std::endl;
-  }
-
   // void *returned_ptr = malloc(ret_arg_type->size);
   void *returned_ptr;
-  posix_memalign(&returned_ptr, ret_arg_type->alignment, ret_arg_type->size);
+  posix_memalign(&returned_ptr, std::max<size_t>(ret_arg_type->alignment, 8),
+                 std::max<size_t>(ret_arg_type->size, 8));
+
+  // Typed trampoline: packed descriptors are built once, the timed region only
+  // contains a direct call. Returns are laid out back to back, exactly like
+  // the struct libffi fills in.
+  std::vector<std::vector<int64_t>> packed_arguments;
+  std::vector<void *> trampoline_args;
+  std::vector<int64_t> trampoline_results;
+  CallTrampoline::Function trampoline =
+      reinterpret_cast<CallTrampoline::Function>(kernel.trampoline);
+  if (trampoline) {
+    for (MemRefArg *arg : call_arguments)
+      packed_arguments.push_back(CallTrampoline::pack_descriptor(*arg));
+    for (std::vector<int64_t> &packed : packed_arguments)
+      trampoline_args.push_back(packed.data());
+
+    size_t result_slots = 0;
+    for (const JSONArgument &returned : return_args)
+      result_slots += CallTrampoline::descriptor_slots(returned.rank);
+    trampoline_results.assign(std::max<size_t>(result_slots, 1), 0);
+    std::cout << "Calling through the typed C interface trampoline\n";
+  }
+  void *result_ptr = trampoline ? trampoline_results.data() : returned_ptr;
+
+  // Every call returns fresh result buffers, released after each counter
+  // window so that resident memory stays flat across samples
+  std::vector<int64_t> result_ranks;
+  for (const JSONArgument &returned : return_args)
+    result_ranks.push_back(returned.rank);
+  ResultBuffers returned_buffers(result_ranks,
+                                 CommandManager::tensor_arena.get(),
+                                 kernel.alloc_hooks != nullptr);
+  for (const auto &[data, bytes] : mapped_inputs)
+    returned_buffers.exclude(data, bytes);
+
+  // Bound torch op standing in for the kernel (--torch-baseline)
+  TorchCall *torch_call = nullptr;
+  auto invoke_kernel = [&]() {
+    if (torch_call) {
+      torch_call->call();
+      return;
+    }
+    if (trampoline)
+      trampoline(trampoline_args.data(), result_ptr);
+    else
+      ffi_call(&calling_interface, FFI_FN(kHandle), returned_ptr,
+               func_arg_data.data());
+    returned_buffers.capture(result_ptr);
+  };
+
+  // --pgo: the instrumented object is trained on these inputs, then swapped
+  // for one rebuilt with the profile before anything is measured
+  if (CommandManager::pgo && !PgoProfile::is_current(ll_object_filepath)) {
+    for (unsigned int c = 0; c < PgoProfile::TRAINING_CALLS; c++) {
+      returned_buffers.reserve(1);
+      invoke_kernel();
+      returned_buffers.release();
+    }
+    bool trained = PgoProfile::write_raw(kernel.so_handle, ll_object_filepath);
+    CommandManager::unload_kernel(kernel);
+    if (trained) {
+      std::string merge_output = CommandManager::exec(PgoProfile::merge_command(
+          fs::path(settings.llvm_install_path)
+              .append("bin/llvm-profdata"),
+          ll_object_filepath));
+      trained = PgoProfile::is_current(ll_object_filepath);
+      if (!trained)
+        std::cerr << merge_output;
+    }
+    if (!trained) {
+      std::cerr << "No PGO profile for " << ll_object_filepath.filename()
+                << ", skipping its pgo measurement\n";
+      return std::vector<std::map<std::string, double>>();
+    }
+    if (!CommandManager::load_kernel(ll_object_filepath, kernel))
+      return std::vector<std::map<std::string, double>>();
+    kHandle = kernel.function;
+    trampoline = reinterpret_cast<CallTrampoline::Function>(kernel.trampoline);
+    std::cout << "Rebuilt with the profile of " << PgoProfile::TRAINING_CALLS
+              << " training calls\n";
+  }
   // memset(returned_ptr, 0xCC, ret_arg_type->size); // scribble to detect
   // writes
 
-  std::vector<std::map<std::string, double>> collected_metrics;
+  // Optionally SCHED_FIFO for the whole warmup/sampling phase
+  ScopedRealtimePriority realtime(settings.realtime_scheduling);
+  // Denormal mode of every call, set after input generation so that the
+  // generated subnormals survive
+  ScopedFloatMode float_mode(settings.ftz_daz);
+
+  // Scheduler interference is tracked alongside the requested metrics.
+  // Software events can't be read through rdpmc, so live mode goes without,
+  // and worker threads of parallel kernels switch by design.
+  static const std::vector<std::string> interference_metrics = {
+      "context-switches", "cpu-migrations"};
+  std::vector<std::string> session_metrics = settings.perf_metrics;
+  if (settings.counter_mode != CounterMode::LIVE &&
+      thread_scope == ThreadScope::CALLING_THREAD && thread_budget <= 1)
+    for (const std::string &metric : interference_metrics)
+      if (std::find(session_metrics.begin(), session_metrics.end(), metric) ==
+          session_metrics.end())
+        session_metrics.push_back(metric);
+  if (settings.track_allocations &&
+      settings.counter_mode != CounterMode::LIVE &&
+      std::find(session_metrics.begin(), session_metrics.end(),
+                "page-faults") == session_metrics.end())
+    session_metrics.push_back("page-faults");
+
+  // Events of the --metric-group columns, not reported themselves
+  std::vector<std::vector<std::string>> event_groups;
+  for (const MetricGroup &group : settings.metric_groups) {
+    for (const std::string &event : group.events)
+      if (std::find(session_metrics.begin(), session_metrics.end(), event) ==
+          session_metrics.end())
+        session_metrics.push_back(event);
+    event_groups.insert(event_groups.end(), group.event_groups.begin(),
+                        group.event_groups.end());
+  }
 
-  for (int i = 0; i < CommandManager::perf_run_count; i++) {
+  // More PMU events than counters are split into batches, one counter
+  // window each per sample (--counter-batches). Topdown groups sit on the
+  // fixed slots counter and go with the first batch.
+  std::string anchor;
+  std::vector<std::vector<std::string>> batches = {session_metrics};
+  if (settings.counter_batch_size > 0)
+    batches = CounterScheduler::partition(
+        session_metrics, settings.counter_batch_size, anchor);
+  if (batches.size() > 1)
+    std::cout << "Counting " << batches.size() << " event batches, anchored "
+              << "on " << anchor << "\n";
+
+  // Counters are opened once per kernel (unless --counter-mode=per-sample)
+  std::vector<std::unique_ptr<CounterSession>> batch_counters;
+  for (size_t b = 0; b < batches.size(); b++) {
+    batch_counters.push_back(std::make_unique<CounterSession>(
+        settings.counter_mode, batches[b], thread_scope,
+        b == 0 ? event_groups : std::vector<std::vector<std::string>>()));
+    if (!batch_counters.back()->open()) {
+      CommandManager::unload_kernel(kernel);
+      return std::vector<std::map<std::string, double>>();
+    }
+  }
+  CounterSession &counters = *batch_counters.front();
+
+  // Cost of an empty counter window, reported so that it can be subtracted
+  std::map<std::string, double> counter_overhead;
+  for (auto &batch : batch_counters)
+    counter_overhead.merge(batch->measure_overhead(100));
+  std::cout << "Counter read overhead:";
+  for (const auto &[metric, value] : counter_overhead)
+    std::cout << " " << metric << "=" << value;
+  std::cout << "\n";
+
+  // --energy: package energy around the first batch's window, against the
+  // package's idle power of the session
+  std::unique_ptr<EnergyCounter> energy;
+  const std::map<std::string, double> &idle_watts =
+      CommandManager::idle_watts;
+  if (settings.energy_config.enabled) {
+    energy = std::make_unique<EnergyCounter>(sched_getcpu());
+    if (!energy->available()) {
+      std::cerr << "No readable RAPL counters (perf power PMU or powercap), "
+                   "energy columns are 0\n";
+      energy.reset();
+    }
+  }
 
-    perf::EventCounter perf_event_counter = perf::EventCounter{};
-    perf_event_counter.add(CommandManager::perf_metrics);
-    perf_event_counter.start();
-    ffi_call(&calling_interface, FFI_FN(kHandle), returned_ptr,
-             func_arg_data.data());
-    perf_event_counter.stop();
+  // --dram-traffic: memory controller traffic around the same window
+  std::unique_ptr<DramCounter> dram;
+  if (settings.dram_traffic) {
+    dram = std::make_unique<DramCounter>(sched_getcpu());
+    if (!dram->available()) {
+      std::cerr << "No readable uncore IMC counters, DRAM columns are 0\n";
+      dram.reset();
+    } else {
+      std::cout << "DRAM traffic from " << dram->channels()
+                << " memory controller channels\n";
+    }
+  }
 
-    auto result = perf_event_counter.result();
+  // One counter window around `repetitions` back to back kernel calls,
+  // reported per call
+  uint64_t inner_repetitions = 1;
+  // Instrumented kernels count their heap usage per window as well
+  bool track_allocations = settings.track_allocations && kernel.alloc_hooks;
+  if (settings.track_allocations && !kernel.alloc_hooks)
+    std::cerr << "No allocation hooks in " << ll_object_filepath.filename()
+              << ", heap usage is not tracked\n";
+  AllocationTracker::install(kernel.alloc_hooks);
+  if (on_gpu && !kernel.gpu_hooks)
+    std::cerr << "No launch hooks in " << ll_object_filepath.filename()
+              << ", device time is not measured\n";
+  GpuRuntime::install(kernel.gpu_hooks);
+
+  // Eviction buffer is only allocated when cold samples are requested
+  const CacheMode cache_mode = settings.cache_mode;
+  std::unique_ptr<CacheEvictor> evictor;
+  if (cache_mode != CacheMode::WARM) {
+    evictor = std::make_unique<CacheEvictor>();
+    std::cout << "Cold cache samples: flushing through a "
+              << (evictor->buffer_bytes() >> 20) << " MiB buffer\n";
+  }
 
-    // Collect Timing Metrics
-    // Write individual run to csv
-    std::ofstream perf_stream(ll_object_filepath.generic_string() + "." +
-                              std::to_string(i) + ".metric");
-    perf_stream << result.to_csv();
-    perf_stream.close();
+  // Cold windows flush the caches before every counter batch, each batch
+  // runs the kernel again and would find the previous batch's data
+  auto run_sample = [&](uint64_t repetitions, bool cold = false) {
+    if (track_allocations)
+      AllocationTracker::begin_window();
+    bool device_window = kernel.gpu_hooks && !torch_call;
+    if (device_window)
+      GpuRuntime::begin_window();
+    // Every event is taken from the first batch counting it
+    perf::CounterResult result;
+    std::vector<double> anchor_values;
+    for (auto &batch : batch_counters) {
+      // Outside the counter window
+      if (cold)
+        evictor->evict();
+      returned_buffers.reserve(repetitions);
+      bool energy_window = energy && batch == batch_counters.front();
+      bool dram_window = dram && batch == batch_counters.front();
+      if (energy_window)
+        energy->start();
+      if (dram_window)
+        dram->start();
+      batch->start();
+      for (uint64_t r = 0; r < repetitions; r++)
+        invoke_kernel();
+      batch->stop();
+      if (dram_window) {
+        dram->stop();
+        for (const auto &[column, value] : dram->window_columns(repetitions))
+          result.emplace_back(column, value);
+      }
+      if (energy_window) {
+        energy->stop();
+        for (const auto &[column, value] :
+             energy->window_columns(repetitions, idle_watts))
+          result.emplace_back(column, value);
+      }
+      for (const auto &[name, value] : batch->result(repetitions)) {
+        if (name == anchor)
+          anchor_values.push_back(value);
+        if (!result.get(name))
+          result.emplace_back(name, value);
+      }
+      // Outside the window, the latest results are kept for the run logs
+      returned_buffers.release(true);
+    }
+    if (anchor_values.size() > 1) {
+      auto [low, high] =
+          std::minmax_element(anchor_values.begin(), anchor_values.end());
+      double mean = Statistics::mean(anchor_values);
+      result.emplace_back("anchor_drift",
+                          mean > 0.0 ? (*high - *low) / mean : 0.0);
+    }
+    if (track_allocations) {
+      uint64_t calls = repetitions * batch_counters.size();
+      AllocationStats stats = AllocationTracker::window_stats();
+      result.emplace_back("alloc_count",
+                          static_cast<double>(stats.allocations) / calls);
+      result.emplace_back("alloc_bytes",
+                          static_cast<double>(stats.bytes_allocated) / calls);
+      // Peak of the whole window, not per call
+      result.emplace_back("peak_live_bytes",
+                          static_cast<double>(stats.peak_live_bytes));
+    }
+    if (device_window)
+      for (const auto &[column, value] : GpuRuntime::window_columns(
+               repetitions * batch_counters.size()))
+        result.emplace_back(column, value);
+    return result;
+  };
+
+  // --replicas: every replica starts warming up at the same time
+  ReplicaGroup::arrive();
+
+  // Warmup: lazy binding, first touch page faults and a cold icache only
+  // affect these runs
+  const WarmupConfig &warmup = settings.warmup;
+  const std::string primary_metric = CommandManager::get_primary_metric();
+  std::vector<std::map<std::string, double>> warmup_metrics;
+  std::vector<double> warmup_primary;
+  bool steady_state = !warmup.auto_detect;
+  while (true) {
+    size_t done = warmup_metrics.size();
+    if (done >= warmup.runs) {
+      if (!warmup.auto_detect)
+        break;
+      if (done >= warmup.window &&
+          Statistics::window_cv(warmup_primary, warmup.window) <
+              warmup.cv_threshold) {
+        steady_state = true;
+        break;
+      }
+      if (done >= warmup.max_runs)
+        break;
+    }
 
-    // We dont need to check if the key is in the perf_metrics vector since that
-    // vector is what was used to initialise the perf_counter
+    auto result = run_sample(inner_repetitions);
     std::map<std::string, double> run_result_map(result.begin(), result.end());
-    collected_metrics.push_back(run_result_map);
+    warmup_primary.push_back(run_result_map[primary_metric]);
+    warmup_metrics.push_back(run_result_map);
+  }
+
+  if (warmup.auto_detect)
+    std::cout << (steady_state ? "Steady state reached after "
+                               : "No steady state within ")
+              << warmup_metrics.size() << " warmup runs (window CV "
+              << Statistics::window_cv(warmup_primary, warmup.window) * 100
+              << "%)\n";
+  if (warmup_results)
+    *warmup_results = warmup_metrics;
+
+  // Calibrate the inner repetition count once the kernel is warm: double K
+  // until a window reaches the minimum, then scale to the exact target
+  const SamplingConfig &sampling = settings.sampling;
+  if (sampling.min_window_seconds > 0.0) {
+    double window_seconds = 0.0;
+    while (inner_repetitions < sampling.max_inner_repetitions) {
+      returned_buffers.reserve(inner_repetitions);
+      auto calibration_start = std::chrono::steady_clock::now();
+      for (uint64_t r = 0; r < inner_repetitions; r++)
+        invoke_kernel();
+      window_seconds = std::chrono::duration<double>(
+                           std::chrono::steady_clock::now() - calibration_start)
+                           .count();
+      returned_buffers.release(true);
+      if (window_seconds >= sampling.min_window_seconds)
+        break;
+      inner_repetitions *= 2;
+    }
+    if (window_seconds > 0.0 && window_seconds < sampling.min_window_seconds)
+      inner_repetitions = static_cast<uint64_t>(
+          inner_repetitions * sampling.min_window_seconds / window_seconds);
+    inner_repetitions =
+        std::clamp<uint64_t>(inner_repetitions, 1,
+                             sampling.max_inner_repetitions);
+    std::cout << "Inner repetitions: " << inner_repetitions << " calls per "
+              << "counter window\n";
+  }
+
+  // Logical tensor traffic of one call, per element type: every input is read
+  // once and every result written once. Padding is not counted.
+  std::map<std::string, double> traffic;
+  for (ElementType type : ElementTypes::all())
+    traffic[ElementTypes::bytes_column(type)] = 0.0;
+  for (MemRefArg *arg : argument_data)
+    traffic[ElementTypes::bytes_column(arg->m_elem_type)] +=
+        static_cast<double>(arg->get_tensor_elem_count()) *
+        arg->get_elem_size();
+  for (const json &r : return_arg_arr) {
+    JSONArgument returned = r.template get<JSONArgument>();
+    double elem_count = 1.0;
+    for (uint64_t dim : returned.shape)
+      elem_count *= dim;
+    ElementType type = ElementTypes::parse(returned.dtype);
+    traffic[ElementTypes::bytes_column(type)] +=
+        elem_count * ElementTypes::size(type);
+  }
+  double bytes_moved = 0.0;
+  for (const auto &[column, bytes] : traffic)
+    bytes_moved += bytes;
+
+  // Arithmetic work of one call, from the op's loop nest
+  std::string kernel_text;
+  if (fs::exists(kernel_source)) {
+    std::ifstream kernel_file(kernel_source);
+    std::stringstream contents;
+    contents << kernel_file.rdbuf();
+    kernel_text = contents.str();
+  }
+  KernelCost cost = KernelCosts::estimate(
+      json_filepath.parent_path().filename().string(), metadata, kernel_text);
+  bool count_ipc =
+      std::count(settings.perf_metrics.begin(),
+                 settings.perf_metrics.end(), "instructions") &&
+      std::count(settings.perf_metrics.begin(),
+                 settings.perf_metrics.end(), "cycles");
+
+  // Bandwidth needs a time metric among the counted ones
+  std::string time_metric;
+  for (const std::string &metric : settings.perf_metrics)
+    if (time_metric.empty() && CounterSession::is_time_metric(metric))
+      time_metric = metric;
+
+  if (evictor && inner_repetitions > 1)
+    std::cout << "Cold cache samples use a single call per counter window\n";
+
+  // --call-overhead: windows of `repetitions` empty calls, made with the
+  // kernel's call interface but an empty function. The result slots are
+  // cleared first, so that the empty calls capture no buffers.
+  auto calibrate_overhead = [&](uint64_t repetitions) {
+    std::fill(trampoline_results.begin(), trampoline_results.end(), 0);
+    std::memset(returned_ptr, 0, std::max<size_t>(ret_arg_type->size, 8));
+    CallTrampoline::Function kernel_trampoline = trampoline;
+    void *kernel_function = kHandle;
+    if (trampoline)
+      trampoline = CallOverhead::empty_trampoline;
+    else
+      kHandle = reinterpret_cast<void *>(CallOverhead::empty_kernel);
+    std::vector<std::map<std::string, double>> windows;
+    for (unsigned int w = 0; w < CallOverhead::WINDOWS; w++) {
+      auto result = run_sample(repetitions);
+      windows.emplace_back(result.begin(), result.end());
+    }
+    trampoline = kernel_trampoline;
+    kHandle = kernel_function;
+    return CallOverhead::summarize(windows, settings.perf_metrics);
+  };
+
+  // Sampling stops once the minimum count is reached and, when adaptive, the
+  // confidence interval target is met, or when the time budget runs out
+  auto collect_samples = [&](bool cold) {
+    std::vector<std::map<std::string, double>> collected_metrics;
+    // Only the first call of a window would start cold
+    uint64_t window_repetitions = cold ? 1 : inner_repetitions;
+    std::string file_tag = cold ? ".cold." : ".";
+
+    // The torch baseline is measured as called, dispatch included
+    std::map<std::string, OverheadStats> overhead;
+    if (settings.call_overhead != CallOverheadMode::OFF && !torch_call) {
+      overhead = calibrate_overhead(window_repetitions);
+      std::cout << "Call overhead per call, median (p5-p95): "
+                << CallOverhead::describe(overhead) << "\n";
+    }
+
+    auto sampling_start = std::chrono::steady_clock::now();
+    std::vector<double> primary_values;
+    double achieved_ci = std::numeric_limits<double>::infinity();
+    // Nothing is written between samples, the dumps are queued afterwards
+    std::vector<std::pair<fs::path, std::string>> metric_dumps;
+    // --noise-monitor: the measuring core around every window
+    NoiseConfig noise_config = settings.noise_config;
+    noise_config.count_switches =
+        thread_scope == ThreadScope::CALLING_THREAD && thread_budget <= 1;
+    std::unique_ptr<NoiseMonitor> noise;
+    if (noise_config.action != NoiseAction::OFF)
+      noise = std::make_unique<NoiseMonitor>(noise_config);
+
+    for (unsigned int i = 0;; i++) {
+      if (i >= settings.perf_run_count &&
+          (sampling.target_ci <= 0.0 || achieved_ci <= sampling.target_ci ||
+           i >= sampling.max_samples))
+        break;
+
+      double elapsed = std::chrono::duration<double>(
+                           std::chrono::steady_clock::now() - sampling_start)
+                           .count();
+      if (sampling.max_seconds > 0.0 && i >= 2 &&
+          elapsed >= sampling.max_seconds)
+        break;
+
+      // Noisy windows are run again with --noise-monitor retry, the last
+      // one is kept either way
+      std::map<std::string, double> noise_columns;
+      unsigned int noise_retries = 0;
+      auto sample_window = [&]() {
+        while (true) {
+          if (!noise)
+            return run_sample(window_repetitions, cold);
+          NoiseSnapshot before = noise->snapshot();
+          auto window = run_sample(window_repetitions, cold);
+          NoiseSnapshot after = noise->snapshot();
+          bool noisy = noise->record(before, after, noise_columns);
+          if (!noisy || noise_config.action != NoiseAction::RETRY ||
+              noise_retries >= noise_config.retries)
+            return window;
+          noise_retries++;
+        }
+      };
+      auto result = sample_window();
+
+      // Raw counter dump of each run, the samples go to the results store
+      if (settings.enableLogFiles)
+        metric_dumps.emplace_back(ll_object_filepath.generic_string() +
+                                      file_tag + std::to_string(i) +
+                                      ".metric",
+                                  result.to_csv());
+
+      // We dont need to check if the key is in the perf_metrics vector since
+      // that vector is what was used to initialise the perf_counter
+      std::map<std::string, double> run_result_map(result.begin(),
+                                                   result.end());
+      // Before anything is derived from the counted values
+      CallOverhead::apply(overhead, settings.call_overhead, run_result_map);
+      run_result_map["compile_seconds"] =
+          torch_call ? torch_call->compile_seconds() : kernel.compile_seconds;
+      if (noise) {
+        run_result_map.insert(noise_columns.begin(), noise_columns.end());
+        run_result_map["noise_retries"] = noise_retries;
+      }
+      run_result_map.insert(traffic.begin(), traffic.end());
+      run_result_map["bytes_moved"] = bytes_moved;
+      // Returned buffers are already released, so this is the steady state
+      run_result_map["rss_bytes"] = static_cast<double>(current_rss_bytes());
+      run_result_map["flops"] = cost.flops;
+      run_result_map["arith_intensity"] =
+          bytes_moved > 0.0 ? cost.flops / bytes_moved : 0.0;
+      if (!time_metric.empty() && run_result_map[time_metric] > 0.0) {
+        double seconds = run_result_map[time_metric] *
+                         CounterSession::seconds_per_unit(time_metric);
+        run_result_map["bandwidth_gbs"] = bytes_moved / seconds / 1e9;
+        run_result_map["gflops"] = cost.flops / seconds / 1e9;
+      }
+      if (energy) {
+        double joules = run_result_map["energy_pkg_j"] +
+                        run_result_map["energy_ram_j"];
+        run_result_map["gflops_per_j"] =
+            joules > 0.0 ? cost.flops / joules / 1e9 : 0.0;
+      }
+      if (dram) {
+        double dram_bytes = run_result_map["dram_bytes"];
+        run_result_map["dram_intensity"] =
+            dram_bytes > 0.0 ? cost.flops / dram_bytes : 0.0;
+        run_result_map["dram_traffic_ratio"] =
+            bytes_moved > 0.0 ? dram_bytes / bytes_moved : 0.0;
+      }
+      run_result_map.insert(object_columns.begin(), object_columns.end());
+      if (count_ipc && run_result_map["cycles"] > 0.0)
+        run_result_map["ipc"] =
+            run_result_map["instructions"] / run_result_map["cycles"];
+      for (const MetricGroup &group : settings.metric_groups)
+        MetricGroups::evaluate(group, run_result_map);
+      if (counters.scope() == ThreadScope::PER_CORE)
+        add_core_breakdown(counters, window_repetitions, run_result_map);
+      primary_values.push_back(run_result_map[primary_metric]);
+      achieved_ci = Statistics::relative_ci_95(primary_values);
+      collected_metrics.push_back(run_result_map);
+    }
+    for (auto &[dump_filepath, dump] : metric_dumps)
+      ResultWriter::write(dump_filepath, std::move(dump));
+
+    // A sample is disturbed if the scheduler touched the thread during it
+    unsigned int disturbed_samples = 0;
+    for (auto &run_result_map : collected_metrics) {
+      bool disturbed = run_result_map["context-switches"] > 0 ||
+                       run_result_map["cpu-migrations"] > 0;
+      run_result_map["disturbed"] = disturbed ? 1.0 : 0.0;
+      disturbed_samples += disturbed;
+    }
+    if (disturbed_samples)
+      std::cerr << "Warning: " << disturbed_samples << "/"
+                << collected_metrics.size()
+                << " samples saw context switches or CPU migrations\n";
+
+    // The achieved interval is recorded with every sample of the kernel
+    for (auto &run_result_map : collected_metrics) {
+      run_result_map["ci95"] = achieved_ci;
+      // Per call, like the kernel metrics
+      run_result_map["counter_overhead"] =
+          counter_overhead[primary_metric] / window_repetitions;
+      run_result_map["inner_repetitions"] = window_repetitions;
+    }
+    std::cout << collected_metrics.size() << (cold ? " cold" : "")
+              << " samples, 95% CI of " << primary_metric << ": +-"
+              << achieved_ci * 100 << "%";
+    if (sampling.target_ci > 0.0 && achieved_ci > sampling.target_ci)
+      std::cout << " (target " << sampling.target_ci * 100
+                << "% not reached)";
+    std::cout << "\n";
+    return collected_metrics;
+  };
+
+  std::vector<std::map<std::string, double>> collected_metrics =
+      collect_samples(cache_mode == CacheMode::COLD);
+  // --replicas: the load stays on until the others are sampled as well
+  ReplicaGroup::hold([&]() {
+    returned_buffers.reserve(1);
+    invoke_kernel();
+    returned_buffers.release();
+  });
+  if (cache_mode == CacheMode::BOTH) {
+    std::vector<std::map<std::string, double>> cold_metrics =
+        collect_samples(true);
+    if (cold_results)
+      *cold_results = cold_metrics;
+  }
+
+  // --call-latency: every call timed on its own, for the tail the sample
+  // windows average away. Result buffers are handed out and released
+  // outside the reads, so only the call itself is timed.
+  if (prepared_kernel && settings.call_latency_calls) {
+    double ns_per_tick = TscClock::ns_per_tick();
+    LatencyHistogram histogram;
+    for (unsigned int c = 0; c < settings.call_latency_calls; c++) {
+      returned_buffers.reserve(1);
+      uint64_t start = TscClock::start();
+      invoke_kernel();
+      uint64_t stop = TscClock::stop();
+      returned_buffers.release();
+      histogram.record(static_cast<uint64_t>(
+          std::llround(static_cast<double>(stop - start) * ns_per_tick)));
+    }
+    std::map<std::string, double> latency = histogram.summary();
+    std::cout << histogram.count() << " timed calls, p50 "
+              << latency["call_p50_ns"] << " ns, p99 "
+              << latency["call_p99_ns"] << " ns, p99.9 "
+              << latency["call_p999_ns"] << " ns, max "
+              << latency["call_max_ns"] << " ns\n";
+    ResultWriter::write(
+        LatencyHistogram::histogram_path(
+            settings.outputFolder,
+            json_filepath.parent_path().filename().string(), kernel_name),
+        histogram.to_csv());
+    for (auto &sample : collected_metrics)
+      sample.insert(latency.begin(), latency.end());
+  }
+
+  // Out-params come back from the device for verification and the run
+  // logs, every descriptor points at host memory again from here on
+  if (on_gpu) {
+    uint64_t d2h_bytes = 0;
+    auto copy_start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < host_pointers.size(); i++) {
+      MemRefArg *arg = call_arguments[i];
+      void *device_ptr = arg->m_desc->aligned_ptr;
+      arg->m_desc->base_ptr = host_pointers[i].first;
+      arg->m_desc->aligned_ptr = host_pointers[i].second;
+      if (i < argument_data.size())
+        continue;
+      uint64_t bytes = buffer_bytes(arg);
+      if (!GpuRuntime::copy_to_host(arg->m_desc->aligned_ptr, device_ptr,
+                                    bytes))
+        std::cerr << "Failed to copy result " << i - argument_data.size()
+                  << " back from the device\n";
+      d2h_bytes += bytes;
+    }
+    transfer_columns["d2h_bytes"] = static_cast<double>(d2h_bytes);
+    transfer_columns["d2h_seconds"] =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                      copy_start)
+            .count();
+    for (auto &sample : collected_metrics)
+      sample.insert(transfer_columns.begin(), transfer_columns.end());
+    if (cold_results)
+      for (auto &sample : *cold_results)
+        sample.insert(transfer_columns.begin(), transfer_columns.end());
+  }
+
+  // --torch-baseline: the isolated op through torch on the same inputs, warm
+  // samples only. Kernels lowered by the metadata pass get the op from their
+  // isolated source. Sparse variants have no dense inputs left to bind.
+  if (baseline_results && !settings.torch_baselines.empty() && !sparse_inputs) {
+    json op = metadata.contains("op") ? metadata["op"] : json();
+    if (op.is_null() && fs::exists(kernel_source))
+      KernelMetadata::extract_op(kernel_source, op);
+    // As many threads as the kernel may use
+    unsigned int torch_threads =
+        thread_budget ? thread_budget
+        : thread_scope == ThreadScope::CALLING_THREAD
+            ? 1u
+            : static_cast<unsigned int>(get_online_cpu_count());
+    for (TorchMode mode : settings.torch_baselines) {
+      std::string name = TorchCall::describe(mode);
+      std::unique_ptr<TorchCall> bound =
+          TorchCall::bind(op, mode, argument_data, torch_threads);
+      if (!bound)
+        continue;
+      std::cout << "Baseline " << name << " (bound in "
+                << bound->compile_seconds() << " s):\n";
+      torch_call = bound.get();
+      for (size_t w = 0; w < std::max<size_t>(warmup_metrics.size(), 1); w++)
+        run_sample(inner_repetitions);
+      (*baseline_results)[name] = collect_samples(false);
+      torch_call = nullptr;
+    }
+  }
+
+  // Hotspots, call stacks and data accesses of the main measurement, sampled
+  // after the counted windows and written while the kernel is still loaded
+  // for symbol resolution. Of a GPU kernel, only its host side would show.
+  const ProfileConfig &profile = settings.profile;
+  if (prepared_kernel && !on_gpu &&
+      (profile.hotspots || profile.flamegraph || profile.memory ||
+       profile.latency || profile.branches || profile.perf_data)) {
+    KernelProfiler profiler(profile);
+    bool sampled = profiler.profile(
+        [&]() {
+          returned_buffers.reserve(1);
+          invoke_kernel();
+          returned_buffers.release(true);
+        },
+        ll_object_filepath);
+    if (sampled && profiler.sample_count()) {
+      std::cout << profiler.sample_count() << " IP samples over "
+                << profiler.calls() << " calls\n";
+      if (profile.hotspots)
+        profiler.write_hotspots(ll_object_filepath);
+      if (profile.flamegraph)
+        profiler.write_folded_stacks(KernelProfiler::flamegraph_path(
+            settings.outputFolder,
+            json_filepath.parent_path().filename().string(), kernel_name));
+    }
+    if (sampled && profile.memory) {
+      // Results are allocated by the kernel on every call, only the inputs
+      // have stable addresses
+      std::vector<TensorRegion> regions;
+      for (size_t i = 0; i < argument_data.size(); i++) {
+        MemRefArg *arg = argument_data[i];
+        std::string shape;
+        for (int64_t d = 0; d < arg->get_tensor_rank(); d++)
+          shape += (d ? "x" : "") + std::to_string(arg->m_desc->dimension[d]);
+        regions.push_back(
+            {"input" + std::to_string(i),
+             ElementTypes::describe(arg->m_elem_type) + "[" + shape + "]",
+             reinterpret_cast<uintptr_t>(arg->getData()),
+             static_cast<size_t>(arg->get_buffer_elem_count()) *
+                 arg->get_elem_size()});
+      }
+      profiler.write_memory_access(ll_object_filepath, regions);
+    }
+    if (sampled && profile.latency)
+      profiler.write_latency_histogram(ll_object_filepath);
+    if (sampled && profile.branches)
+      profiler.write_branches(ll_object_filepath, cost.num_parallel,
+                              cost.num_reduction);
   }
 
   // std::cout << "Function called\n";
@@ -671,32 +2386,964 @@ CommandManager::execute_with_parameters(const fs::path &ll_object_filepath,
   // }
   // std::cout << std::endl;
 
-  if (CommandManager::enableRunLogs) {
-    return_arg_data.extractDescFromFFIPtr(returned_ptr);
-    // return_arg_data.setData((float *)(*((uint64_t *)returned_ptr)));
+  // Results are unpacked from the last call and checked against the
+  // metadata, so the returned buffers can be verified and released safely
+  int64_t *result_slot = static_cast<int64_t *>(result_ptr);
+  for (size_t r = 0; r < return_arg_data.size(); r++) {
+    MemRefArg &returned = *return_arg_data[r];
+    returned.extractDescFromFFIPtr(result_slot);
+    result_slot += CallTrampoline::descriptor_slots(returned.get_tensor_rank());
+
+    std::string error;
+    if (!returned.validate_descriptor(return_args[r].shape, error))
+      std::cerr << "Result " << r << " of "
+                << ll_object_filepath.filename().generic_string()
+                << " has an invalid descriptor: " << error << std::endl;
+  }
+  // Out-params hold the results of the last call in place
+  for (std::unique_ptr<MemRefArg> &out : out_params)
+    return_arg_data.push_back(std::move(out));
+
+  // Cross pipeline verification, for the main measurement only (swept
+  // layouts produce the same results)
+  if (prepared_kernel &&
+      (settings.record_outputs || CommandManager::is_verifying())) {
+    std::string op_type = json_filepath.parent_path().filename().string();
+    if (settings.record_outputs)
+      OutputVerifier::write_reference(
+          OutputVerifier::reference_prefix(settings.outputFolder,
+                                           op_type, kernel_name),
+          return_arg_data);
+
+    if (CommandManager::is_verifying()) {
+      VerificationResult verdict = OutputVerifier::verify(
+          OutputVerifier::reference_prefix(
+              settings.verify_reference_dir, op_type, kernel_name),
+          return_arg_data, settings.verify_tolerance);
+      if (verdict.passed)
+        std::cout << "Verification passed (max relative error "
+                  << verdict.max_rel_error << ", " << verdict.max_ulp_error
+                  << " ULP)\n";
+      else
+        std::cerr << "Verification FAILED for "
+                  << ll_object_filepath.filename().generic_string() << ": "
+                  << (verdict.error.empty()
+                          ? std::to_string(verdict.mismatches) + "/" +
+                                std::to_string(verdict.elements) +
+                                " elements out of tolerance"
+                          : verdict.error)
+                  << std::endl;
+
+      for (auto *samples : {&collected_metrics, cold_results})
+        if (samples)
+          for (auto &run_result_map : *samples) {
+            run_result_map["verified"] = verdict.passed ? 1.0 : 0.0;
+            run_result_map["mismatches"] = verdict.mismatches;
+            run_result_map["max_rel_error"] = verdict.max_rel_error;
+            run_result_map["max_ulp_error"] = verdict.max_ulp_error;
+          }
+    }
+  }
 
-    // Transform structure to MemRefDescriptor
+  // Binary run logs: copied here, written by the dump thread
+  if (settings.enableRunLogs) {
+    std::vector<DumpedTensor> tensors;
+    for (size_t i = 0; i < argument_data.size(); i++)
+      tensors.push_back(
+          DumpedTensor::from("input" + std::to_string(i), *argument_data[i]));
+    for (size_t r = 0; r < return_arg_data.size(); r++)
+      tensors.push_back(DumpedTensor::from("output" + std::to_string(r),
+                                           *return_arg_data[r]));
+    TensorDump::submit(ll_object_filepath.generic_string() + ".tensors",
+                       kernel_name, std::move(tensors));
+  }
 
-    data_output_filestream << "Output: [\n";
-    for (int i = 0; i < return_arg_data.get_tensor_elem_count(); i++) {
-      data_output_filestream << *(((float *)return_arg_data.getData()) +
-                                  return_arg_data.m_desc->offset + i)
-                             << ", ";
+  // Replayed layers hand their outputs to their consumers, written before
+  // the next layer starts
+  if (!settings.replay_output_dir.empty()) {
+    std::error_code ec;
+    fs::create_directories(settings.replay_output_dir, ec);
+    for (size_t r = 0; r < return_arg_data.size(); r++) {
+      fs::path npy_filepath =
+          fs::path(settings.replay_output_dir)
+              .append("output" + std::to_string(r) + ".npy");
+      if (!TensorDump::write_npy(
+              npy_filepath, DumpedTensor::from("output" + std::to_string(r),
+                                               *return_arg_data[r])))
+        std::cerr << "Failed to write " << npy_filepath << "\n";
     }
-    data_output_filestream << "\n]\n";
   }
-  data_output_filestream.close();
 
-  dlclose(fHandle);
+  returned_buffers.release();
+  if (returned_buffers.released_buffers())
+    std::cout << "Released " << returned_buffers.released_buffers()
+              << " returned buffers\n";
 
-  //  e. setup perf classes to initiate timing - DONE
-  //  f. collect the timing details in a structure
-
-  //  g. Remove the .so file, so the next file run does not conflict
-  CommandManager::exec("rm " + output_filepath.generic_string());
+  CommandManager::unload_kernel(kernel);
   return collected_metrics;
 }
 
+bool CommandManager::load_kernel(const fs::path &ll_object_filepath,
+                                 KernelHandle &kernel) {
+  // Batched kernels are resolved during the link stage
+  if (kernel.function)
+    return true;
+
+  // Accumulates on top of any build time already spent in prepare_kernel
+  auto load_start = std::chrono::steady_clock::now();
+  auto record_load_time = [&]() {
+    kernel.compile_seconds += std::chrono::duration<double>(
+                                  std::chrono::steady_clock::now() - load_start)
+                                  .count();
+  };
+
+  // A linked cross object has no IR to JIT
+  if (settings.execution_engine == ExecutionEngine::ORC_JIT &&
+      kernel.so_filepath.empty() && !CommandManager::pgo) {
+    kernel.function = JITEngine::load_kernel(ll_object_filepath, "kernel_call",
+                                             kernel.jit_resource_key);
+    if (kernel.function) {
+      if (settings.call_interface == CallInterface::TRAMPOLINE)
+        kernel.trampoline = JITEngine::lookup(
+            kernel.jit_resource_key,
+            CallTrampoline::trampoline_symbol("kernel_call"));
+      if (settings.track_allocations)
+        kernel.alloc_hooks = JITEngine::lookup(
+            kernel.jit_resource_key, AllocationTracker::HOOK_TABLE_SYMBOL);
+      if (ParallelRuntime::is_gpu(CommandManager::parallel_runtime))
+        kernel.gpu_hooks = JITEngine::lookup(kernel.jit_resource_key,
+                                             GpuRuntime::HOOK_TABLE_SYMBOL);
+      record_load_time();
+      return true;
+    }
+    std::cerr << "JIT compilation failed for " << ll_object_filepath
+              << ". Retrying with a shared object build\n";
+  }
+
+  // Object may already have been built by prepare_kernel
+  if (kernel.so_filepath.empty() &&
+      !CommandManager::build_kernel_object(ll_object_filepath, kernel))
+    return false;
+  fs::path output_filepath = kernel.so_filepath;
+  load_start = std::chrono::steady_clock::now();
+
+  //  Import it using dlopen
+  void *fHandle =
+      settings.loadFromMemory
+          ? ScratchSpace::dlopen_from_memory(output_filepath, RTLD_LAZY)
+          : dlopen(output_filepath.c_str(), RTLD_LAZY);
+  if (fHandle == NULL) {
+    std::cerr << "Failed to open compiled version of "
+              << fs::path(ll_object_filepath).replace_extension().filename()
+              << std::endl;
+    std::cerr << dlerror() << std::endl;
+    CommandManager::unload_kernel(kernel);
+    return false;
+  }
+  kernel.so_handle = fHandle;
+
+  //  Import function handle using dlsym
+  kernel.function = dlsym(fHandle, kernel.symbol.c_str());
+  if (!kernel.function) {
+    std::cerr << "Failed to load kernel function: "
+              << fs::path(ll_object_filepath).replace_extension().filename()
+              << std::endl;
+    CommandManager::unload_kernel(kernel);
+    return false;
+  }
+  if (settings.call_interface == CallInterface::TRAMPOLINE)
+    kernel.trampoline = dlsym(
+        fHandle, CallTrampoline::trampoline_symbol(kernel.symbol).c_str());
+  if (settings.track_allocations)
+    kernel.alloc_hooks = dlsym(fHandle, AllocationTracker::HOOK_TABLE_SYMBOL);
+  if (ParallelRuntime::is_gpu(CommandManager::parallel_runtime))
+    kernel.gpu_hooks = dlsym(fHandle, GpuRuntime::HOOK_TABLE_SYMBOL);
+
+  record_load_time();
+  return true;
+}
+
+bool CommandManager::build_kernel_object(const fs::path &ll_object_filepath,
+                                         KernelHandle &kernel) {
+  auto compile_start = std::chrono::steady_clock::now();
+
+  // Unique per kernel, so that parallel builds never overwrite each other
+  fs::path output_filepath =
+      fs::path(ll_object_filepath).replace_extension(".so");
+
+  std::string object_key;
+  fs::path cached_object;
+  std::string pgo_flags;
+  if (CommandManager::pgo) {
+    // Without a current profile this is the instrumented build to train
+    if (!PgoProfile::is_current(ll_object_filepath) &&
+        !PgoProfile::write_hook(ll_object_filepath))
+      return false;
+    pgo_flags = PgoProfile::compile_flags(ll_object_filepath);
+  }
+  if (CompileCache::is_enabled() && !CommandManager::pgo) {
+    object_key = CompileCache::object_key(
+        ll_object_filepath, CommandManager::get_compiler_identity(),
+        CommandManager::get_compile_flags());
+    if (!CompileProfiler::is_enabled())
+      cached_object = CompileCache::lookup_object(object_key);
+  }
+
+  if (!cached_object.empty()) {
+    output_filepath = cached_object;
+    kernel.so_from_cache = true;
+  } else {
+    // Compile this file to a ".so" file
+    std::string compilation_command =
+        settings.compiler + " " + CommandManager::get_compile_flags() +
+        pgo_flags + " -o " + output_filepath.generic_string() +
+        " -Wl,-rpath," +
+        settings.llvm_lib_path.generic_string() + " -L" +
+        settings.llvm_lib_path.generic_string() +
+        " -lmlir_runner_utils -lmlir_c_runner_utils " +
+        ll_object_filepath.generic_string();
+    CommandManager::exec(compilation_command);
+
+    if (!fs::exists(output_filepath)) {
+      std::cerr << "Failed to compile " << ll_object_filepath << std::endl;
+      return false;
+    }
+
+    if (!object_key.empty())
+      CompileCache::store_object(object_key, output_filepath);
+  }
+
+  kernel.so_filepath = output_filepath;
+  kernel.compile_seconds += std::chrono::duration<double>(
+                                std::chrono::steady_clock::now() -
+                                compile_start)
+                                .count();
+  return true;
+}
+
+bool CommandManager::analyse_vectorization(const fs::path &ll_object_filepath,
+                                           const KernelHandle &kernel) {
+  // A batch object holds every member, it says nothing about this kernel
+  std::string disassembly;
+  if (!kernel.so_filepath.empty() && settings.link_mode == LinkMode::PER_KERNEL)
+    disassembly = CommandManager::exec("objdump -d --no-show-raw-insn " +
+                                       kernel.so_filepath.generic_string() +
+                                       " 2>/dev/null");
+  return VectorCoverage::write(ll_object_filepath, disassembly);
+}
+
+bool CommandManager::prepare_metadata(KernelTask &task) {
+  std::cout << "Generating Metadata: " << task.mlir_filepath << "\n";
+  CommandManager::generate_metadata_json(task.mlir_filepath,
+                                         task.json_filepath);
+
+  task.metadata_ready = fs::exists(task.json_filepath);
+  if (!task.metadata_ready) {
+    std::cerr << "Metadata generation failed for " << task.mlir_filepath
+              << std::endl;
+    return false;
+  }
+
+  // Loop structure of the kernel's generics, kept from earlier runs
+  if (!fs::exists(LinalgStructures::filepath(task.mlir_filepath)))
+    LinalgStructures::analyse(
+        task.mlir_filepath,
+        CommandManager::exec(
+            settings.torch_opt_exec.generic_string() +
+            " -pass-pipeline=\"builtin.module(torch-backend-to-linalg-on-"
+            "tensors-backend-pipeline)\" " +
+            task.mlir_filepath.generic_string() + " 2>/dev/null | " +
+            settings.mlir_opt_exec.generic_string() +
+            " --linalg-generalize-named-ops 2>/dev/null"));
+  return true;
+}
+
+bool CommandManager::generate_shape_variant(const KernelTask &task,
+                                            const ShapeScale &scale,
+                                            KernelTask &variant) {
+  std::ifstream kernel_file(task.mlir_filepath);
+  std::ostringstream contents;
+  contents << kernel_file.rdbuf();
+  std::string rewritten;
+  if (!ShapeSweep::rewrite_kernel(contents.str(), scale, rewritten))
+    return false;
+
+  fs::path variant_folder = fs::path(task.mlir_filepath)
+                                .parent_path()
+                                .append("shapes")
+                                .append(scale.name);
+  fs::create_directories(variant_folder);
+  fs::path filename = task.mlir_filepath.filename();
+  fs::path dynamic_filepath = fs::path(variant_folder).append(
+      fs::path(filename).replace_extension(".dynamic.mlir").generic_string());
+  std::ofstream(dynamic_filepath) << rewritten;
+
+  // Shapes of the results and intermediates, from the new arguments
+  variant = KernelTask();
+  variant.op_type = task.op_type;
+  variant.mlir_filepath = fs::path(variant_folder).append(filename.string());
+  variant.json_filepath =
+      fs::path(variant_folder).append(filename.string() + ".json");
+  fs::remove(variant.mlir_filepath);
+  std::string refine_cmd =
+      settings.torch_opt_exec.generic_string() +
+      " -pass-pipeline=\"builtin.module(torch-shape-refinement-pipeline,"
+      "torch-refine-public-return,canonicalize)\" " +
+      dynamic_filepath.generic_string() + " -o " +
+      variant.mlir_filepath.generic_string() + " 2>&1";
+  std::string refine_log = CommandManager::exec(refine_cmd);
+
+  json metadata;
+  if (!fs::exists(variant.mlir_filepath) ||
+      !KernelMetadata::extract_from_kernel(variant.mlir_filepath, metadata)) {
+    std::cerr << "Shape variant " << scale.name << " of "
+              << task.mlir_filepath.filename()
+              << " could not be refined, skipping it\n"
+              << refine_log;
+    return false;
+  }
+  std::ofstream(variant.json_filepath) << metadata.dump(2);
+
+  variant.metadata_ready = true;
+  variant.multiplicity = task.multiplicity;
+  variant.shape_variant = scale.name;
+  variant.shape_scale = scale;
+  variant.shape_parent = task.mlir_filepath;
+  return true;
+}
+
+bool CommandManager::generate_dynamic_variant(
+    const KernelTask &task, const std::vector<ShapeScale> &scales,
+    KernelTask &variant) {
+  std::ifstream kernel_file(task.mlir_filepath);
+  std::ostringstream contents;
+  contents << kernel_file.rdbuf();
+  std::string relaxed;
+  if (!ShapeSweep::relax_kernel(contents.str(), relaxed))
+    return false;
+
+  fs::path shapes_folder =
+      fs::path(task.mlir_filepath).parent_path().append("shapes");
+  fs::path variant_folder = fs::path(shapes_folder).append("dynamic");
+  fs::create_directories(variant_folder);
+  fs::path filename = task.mlir_filepath.filename();
+  fs::path relaxed_filepath = fs::path(variant_folder).append(
+      fs::path(filename).replace_extension(".relaxed.mlir").generic_string());
+  std::ofstream(relaxed_filepath) << relaxed;
+
+  // Results and intermediates stay dynamic, refinement only checks them
+  variant = KernelTask();
+  variant.op_type = task.op_type;
+  variant.mlir_filepath = fs::path(variant_folder).append(filename.string());
+  variant.json_filepath =
+      fs::path(variant_folder).append(filename.string() + ".json");
+  fs::remove(variant.mlir_filepath);
+  std::string refine_cmd =
+      settings.torch_opt_exec.generic_string() +
+      " -pass-pipeline=\"builtin.module(torch-shape-refinement-pipeline,"
+      "torch-refine-public-return,canonicalize)\" " +
+      relaxed_filepath.generic_string() + " -o " +
+      variant.mlir_filepath.generic_string() + " 2>&1";
+  std::string refine_log = CommandManager::exec(refine_cmd);
+  std::error_code ec;
+  if (!fs::exists(variant.mlir_filepath) ||
+      !fs::copy_file(task.json_filepath, variant.json_filepath,
+                     fs::copy_options::overwrite_existing, ec)) {
+    std::cerr << "Dynamic shape variant of " << filename
+              << " could not be refined, skipping it\n"
+              << refine_log;
+    return false;
+  }
+
+  // Written by generate_shape_variant, those that failed are skipped when
+  // the kernel is measured
+  for (const ShapeScale &scale : scales)
+    variant.dynamic_shapes[scale.name] =
+        fs::path(shapes_folder)
+            .append(scale.name)
+            .append(filename.string() + ".json");
+
+  variant.metadata_ready = true;
+  variant.multiplicity = task.multiplicity;
+  variant.shape_variant = "dynamic";
+  variant.dynamic = true;
+  variant.shape_parent = task.mlir_filepath;
+  return true;
+}
+
+bool CommandManager::generate_const_variant(
+    const KernelTask &task, const ConstantArgsSpec &constants,
+    const std::map<size_t, std::string> &weights, KernelTask &variant) {
+  std::ifstream kernel_file(task.mlir_filepath);
+  std::ostringstream contents;
+  contents << kernel_file.rdbuf();
+  std::string text = contents.str();
+  fs::path filename = task.mlir_filepath.filename();
+
+  // Listed arguments are drawn exactly as execute_with_parameters would
+  // draw them for the generic kernel
+  std::map<size_t, std::string> literals = weights;
+  if (!constants.indices.empty()) {
+    json metadata = load_json_from_file(task.json_filepath);
+    std::vector<json> args =
+        metadata["kernel_call"]["args"].template get<std::vector<json>>();
+    std::vector<std::string> types = ConstantArgs::argument_types(text);
+    std::string kernel_name = task.json_filepath.stem().generic_string();
+    fs::path kernel_source = fs::path(task.json_filepath).replace_extension();
+    uint64_t kernel_hash = hash_file_contents(kernel_source);
+    std::vector<std::shared_ptr<const TensorStats>> argument_stats;
+    if (settings.input_profile.profile == DataProfile::FROM_STATS)
+      argument_stats = ActivationStats::load(task.json_filepath);
+    std::unique_ptr<TensorSource> tensor_source;
+    if (!settings.tensor_source_dir.empty())
+      tensor_source =
+          std::make_unique<TensorSource>(settings.tensor_source_dir);
+
+    for (size_t index : constants.indices) {
+      if (index >= args.size() || index >= types.size() ||
+          literals.count(index))
+        continue;
+      JSONArgument argObject = args[index].template get<JSONArgument>();
+      std::string literal;
+      MappedTensor mapped;
+      if (tensor_source &&
+          tensor_source->bind(kernel_name, index, argObject, mapped)) {
+        literal = ConstantArgs::dense_literal(types[index], mapped.data,
+                                              mapped.bytes);
+      } else {
+        ElementType elem_type = ElementTypes::parse(argObject.dtype);
+        uint64_t elem_count = 1;
+        for (uint64_t dim : argObject.shape)
+          elem_count *= dim;
+        DataFormatInfo dataInfo;
+        dataInfo.setInputProfile(settings.input_profile);
+        dataInfo.setElemCount(elem_count);
+        dataInfo.setElemType(elem_type);
+        if (!argObject.shape.empty())
+          dataInfo.setRowLength(argObject.shape.back());
+        if (index < argument_stats.size())
+          dataInfo.setStats(argument_stats[index]);
+        dataInfo.setSeed(TensorFuzzer::stream_seed(settings.input_seed,
+                                                   kernel_hash, index));
+        // Untouched profiles hand out zero pages
+        std::vector<uint8_t> data(elem_count * ElementTypes::size(elem_type),
+                                  0);
+        if (TensorFuzzer::is_untouched(dataInfo.m_profile) ||
+            TensorFuzzer::fill_data(dataInfo, data.data()))
+          literal = ConstantArgs::dense_literal(types[index], data.data(),
+                                                data.size());
+      }
+      if (literal.empty()) {
+        std::cerr << "Argument " << index << " of " << filename
+                  << " can't be written as a constant, keeping it\n";
+        continue;
+      }
+      literals[index] = std::move(literal);
+    }
+  }
+
+  std::string specialized;
+  size_t inlined = 0;
+  if (literals.empty() ||
+      !ConstantArgs::specialize(text, literals, specialized, inlined))
+    return false;
+
+  fs::path variant_folder = fs::path(task.mlir_filepath)
+                                .parent_path()
+                                .append("shapes")
+                                .append("const");
+  fs::create_directories(variant_folder);
+  variant = KernelTask();
+  variant.op_type = task.op_type;
+  variant.mlir_filepath = fs::path(variant_folder).append(filename.string());
+  variant.json_filepath =
+      fs::path(variant_folder).append(filename.string() + ".json");
+  std::ofstream(variant.mlir_filepath) << specialized;
+
+  json metadata;
+  if (!KernelMetadata::extract_from_kernel(variant.mlir_filepath, metadata)) {
+    std::cerr << "Constant specialized " << filename
+              << " has no readable signature, skipping it\n";
+    return false;
+  }
+  std::ofstream(variant.json_filepath) << metadata.dump(2);
+
+  variant.metadata_ready = true;
+  variant.multiplicity = task.multiplicity;
+  variant.shape_variant = "const";
+  variant.const_args = inlined;
+  variant.shape_parent = task.mlir_filepath;
+  return true;
+}
+
+bool CommandManager::generate_sparse_variant(
+    const KernelTask &task, const std::map<size_t, SparseArgument> &arguments,
+    KernelTask &variant) {
+  std::ifstream kernel_file(task.mlir_filepath);
+  std::ostringstream contents;
+  contents << kernel_file.rdbuf();
+  fs::path filename = task.mlir_filepath.filename();
+
+  json metadata = load_json_from_file(task.json_filepath);
+  json &args = metadata["kernel_call"]["args"];
+  std::vector<std::vector<uint64_t>> shapes;
+  for (const json &arg : args)
+    shapes.push_back(arg["shape"].template get<std::vector<uint64_t>>());
+
+  std::map<size_t, SparseArgument> encoded = arguments;
+  std::string annotated;
+  if (!SparseEncoding::annotate(contents.str(), shapes, encoded, annotated))
+    return false;
+
+  // The encoded types aren't metadata material, the parent's is tagged
+  std::string spec;
+  for (const auto &[index, argument] : encoded) {
+    args[index]["sparse"] = SparseEncoding::describe(argument);
+    spec += (spec.empty() ? "" : ",") + std::to_string(index) + ":" +
+            SparseEncoding::describe(argument);
+  }
+
+  fs::path variant_folder = fs::path(task.mlir_filepath)
+                                .parent_path()
+                                .append("shapes")
+                                .append("sparse");
+  fs::create_directories(variant_folder);
+  variant = KernelTask();
+  variant.op_type = task.op_type;
+  variant.mlir_filepath = fs::path(variant_folder).append(filename.string());
+  variant.json_filepath =
+      fs::path(variant_folder).append(filename.string() + ".json");
+  std::ofstream(variant.mlir_filepath) << annotated;
+  std::ofstream(variant.json_filepath) << metadata.dump(2);
+
+  variant.metadata_ready = true;
+  variant.multiplicity = task.multiplicity;
+  variant.shape_variant = "sparse";
+  variant.sparse_args = spec;
+  variant.shape_parent = task.mlir_filepath;
+  return true;
+}
+
+bool CommandManager::generate_order_variant(const KernelTask &task,
+                                            DataOrder order,
+                                            KernelTask &variant) {
+  std::ifstream kernel_file(task.mlir_filepath);
+  std::ostringstream contents;
+  contents << kernel_file.rdbuf();
+  std::string rewritten;
+  std::vector<size_t> converted_args;
+  if (!DataOrders::rewrite_kernel(contents.str(), order, rewritten,
+                                  converted_args))
+    return false;
+
+  std::string name = DataOrders::describe(order);
+  fs::path variant_folder = fs::path(task.mlir_filepath)
+                                .parent_path()
+                                .append("orders")
+                                .append(name);
+  fs::create_directories(variant_folder);
+  fs::path filename = task.mlir_filepath.filename();
+  variant = KernelTask();
+  variant.op_type = task.op_type;
+  variant.mlir_filepath = fs::path(variant_folder).append(filename.string());
+  variant.json_filepath =
+      fs::path(variant_folder).append(filename.string() + ".json");
+  std::ofstream(variant.mlir_filepath) << rewritten;
+
+  json metadata;
+  if (!KernelMetadata::extract_from_kernel(variant.mlir_filepath, metadata)) {
+    std::cerr << "Data order variant " << name << " of " << filename
+              << " has no readable signature, skipping it\n";
+    return false;
+  }
+  for (size_t arg : converted_args)
+    if (arg < metadata["kernel_call"]["args"].size())
+      metadata["kernel_call"]["args"][arg]["data_order"] = name;
+  std::ofstream(variant.json_filepath) << metadata.dump(2);
+
+  variant.metadata_ready = true;
+  variant.multiplicity = task.multiplicity;
+  variant.shape_variant = name;
+  variant.data_order = order;
+  variant.shape_parent = task.mlir_filepath;
+  return true;
+}
+
+bool CommandManager::prepare_pipeline_variant(KernelTask &task,
+                                              const PipelineSpec &pipeline) {
+  if (!task.metadata_ready)
+    return false;
+  fs::path variant_folder = fs::path(task.mlir_filepath)
+                                .parent_path()
+                                .append("pipelines")
+                                .append(pipeline.label);
+  std::error_code ec;
+  fs::create_directories(variant_folder, ec);
+  KernelTask variant;
+  variant.op_type = task.op_type;
+  variant.mlir_filepath =
+      fs::path(variant_folder).append(task.mlir_filepath.filename().string());
+  variant.json_filepath = task.json_filepath;
+  variant.metadata_ready = true;
+  fs::copy_file(task.mlir_filepath, variant.mlir_filepath,
+                fs::copy_options::overwrite_existing, ec);
+  if (ec || !CommandManager::prepare_kernel(variant)) {
+    std::cerr << "Could not compile " << task.mlir_filepath.filename()
+              << " with pipeline " << pipeline.label << "\n";
+    return false;
+  }
+  CommandManager::unload_kernel(variant.kernel);
+  task.pipeline_ll_filepaths[pipeline.label] = variant.ll_filepath;
+  if (variant.compile_profile.collected)
+    task.pipeline_compile_profiles[pipeline.label] = variant.compile_profile;
+  return true;
+}
+
+void CommandManager::collect_compile_profile(KernelTask &task,
+                                             double lowering_seconds) {
+  CompileProfile &profile = task.compile_profile;
+  profile = CompileProfile();
+  profile.lowering_seconds = lowering_seconds;
+  fs::path log = CompileProfiler::log_filepath(task.mlir_filepath);
+  size_t linalg_ops = CompileProfiler::count_ops(
+      fs::path(task.mlir_filepath).replace_extension(".linalg.mlir"));
+  if (!CompileProfiler::parse_log(log, linalg_ops, profile))
+    std::cerr << "No pass timing report in " << log << "\n";
+  std::error_code ec;
+  uintmax_t ll_bytes = fs::file_size(task.ll_filepath, ec);
+  profile.ll_bytes = ec ? 0 : ll_bytes;
+  profile.collected = true;
+  if (!settings.enableLogFiles)
+    fs::remove(log, ec);
+}
+
+bool CommandManager::prepare_kernel(KernelTask &task) {
+  if (!task.metadata_ready && !CommandManager::prepare_metadata(task))
+    return false;
+
+  // Shipped by a coordinator that compiled it for this architecture
+  if (!task.cross_object.empty()) {
+    task.ll_filepath = task.cross_object;
+    if (!CommandManager::build_kernel_object(task.cross_object, task.kernel))
+      return false;
+    if (settings.code_footprint)
+      CodeFootprint::analyse(task.kernel.so_filepath, task.ll_filepath);
+    task.prepared = true;
+    return true;
+  }
+
+  // Lower the file to .ll format. Printing the IR after every pass slows
+  // the profiled lowering down, its time comes from a plain lowering first.
+  auto lowering_start = std::chrono::steady_clock::now();
+  double lowering_seconds = 0.0;
+  if (CompileProfiler::is_enabled()) {
+    CommandManager::generate_ll_file_uncached(task.mlir_filepath, false);
+    lowering_seconds = std::chrono::duration<double>(
+                           std::chrono::steady_clock::now() - lowering_start)
+                           .count();
+  }
+  task.ll_filepath = CommandManager::generate_ll_file(task.mlir_filepath);
+  if (CompileProfiler::is_enabled())
+    CommandManager::collect_compile_profile(task, lowering_seconds);
+
+  // Typed entry point next to kernel_call, compiled along with it
+  if (settings.call_interface == CallInterface::TRAMPOLINE) {
+    json metadata = load_json_from_file(task.json_filepath);
+    // Encoded arguments are passed as their buffers
+    size_t arg_count = 0;
+    bool sparse = false;
+    for (const json &arg : metadata["kernel_call"]["args"]) {
+      JSONArgument argObject = arg.template get<JSONArgument>();
+      SparseArgument encoded;
+      if (!argObject.sparse_format.empty() &&
+          SparseEncoding::parse_format(argObject.sparse_format, encoded)) {
+        arg_count += SparseEncoding::buffer_count(encoded, argObject.rank);
+        sparse = true;
+      } else {
+        arg_count++;
+      }
+    }
+    size_t return_count = metadata["kernel_call"]["returns"].size();
+    if (CommandManager::out_params && !sparse) {
+      arg_count += return_count;
+      return_count = 0;
+    }
+    if (!CallTrampoline::append_to_ll(task.ll_filepath, arg_count,
+                                      return_count))
+      std::cerr << "No C interface in " << task.ll_filepath
+                << ", calling through libffi\n";
+  }
+
+  // After the optimiser, so that the pipeline sees libc calls as usual
+  if (settings.track_allocations)
+    AllocationTracker::instrument_ll(task.ll_filepath);
+  if (ParallelRuntime::is_gpu(CommandManager::parallel_runtime) &&
+      !GpuRuntime::instrument_ll(task.ll_filepath))
+    std::cerr << "No kernel launches in " << task.ll_filepath.filename()
+              << ", device time is not measured\n";
+
+  // Linked and measured on a worker of the target's architecture
+  if (TargetInfo::is_cross(CommandManager::target)) {
+    if (!CommandManager::build_cross_object(task))
+      return false;
+    task.prepared = true;
+    return true;
+  }
+
+  // The JIT compiles at load time on the measurement thread, batched objects
+  // are linked once every kernel has been lowered
+  if (settings.execution_engine == ExecutionEngine::SHARED_OBJECT &&
+      settings.link_mode == LinkMode::PER_KERNEL &&
+      !CommandManager::build_kernel_object(task.ll_filepath, task.kernel))
+    return false;
+  if (settings.vectorization_report)
+    CommandManager::analyse_vectorization(task.ll_filepath, task.kernel);
+  if (settings.code_footprint && !task.kernel.so_filepath.empty())
+    CodeFootprint::analyse(task.kernel.so_filepath, task.ll_filepath);
+
+  if (task.compile_profile.collected && !task.kernel.so_filepath.empty()) {
+    std::error_code ec;
+    uintmax_t object_bytes = fs::file_size(task.kernel.so_filepath, ec);
+    task.compile_profile.object_seconds = task.kernel.compile_seconds;
+    task.compile_profile.object_bytes = ec ? 0 : object_bytes;
+  }
+  task.prepared = true;
+  return true;
+}
+
+bool CommandManager::build_cross_object(KernelTask &task) {
+  auto compile_start = std::chrono::steady_clock::now();
+  fs::path object_filepath = fs::path(task.ll_filepath).replace_extension(".o");
+  CommandManager::exec(settings.compiler + " " +
+                       CommandManager::get_compile_flags() + " -c -o " +
+                       object_filepath.generic_string() + " " +
+                       task.ll_filepath.generic_string());
+  if (!fs::exists(object_filepath)) {
+    std::cerr << "Failed to compile " << task.ll_filepath << " for "
+              << CommandManager::target.triple << std::endl;
+    return false;
+  }
+  task.cross_object = object_filepath;
+  task.kernel.compile_seconds += std::chrono::duration<double>(
+                                     std::chrono::steady_clock::now() -
+                                     compile_start)
+                                     .count();
+  return true;
+}
+
+void CommandManager::unload_kernel(KernelHandle &kernel) {
+  if (kernel.jit_resource_key) {
+    JITEngine::release(kernel.jit_resource_key);
+    kernel.jit_resource_key = 0;
+  }
+
+  // Batch members only drop their reference, the last one closes the object
+  if (kernel.batch_object) {
+    kernel.batch_object.reset();
+    kernel.so_handle = nullptr;
+    kernel.so_filepath.clear();
+  }
+
+  if (kernel.so_handle) {
+    dlclose(kernel.so_handle);
+    kernel.so_handle = nullptr;
+  }
+
+  // Remove the .so file, so the next file run does not conflict
+  if (!kernel.so_filepath.empty() && !kernel.so_from_cache) {
+    CommandManager::exec("rm " + kernel.so_filepath.generic_string());
+  }
+  kernel.so_filepath.clear();
+  kernel.so_from_cache = false;
+  kernel.function = nullptr;
+  kernel.trampoline = nullptr;
+  kernel.alloc_hooks = nullptr;
+  kernel.gpu_hooks = nullptr;
+}
+
+/*
+ * Replaces every reference to the global `from` (e.g. @kernel_call) in LLVM IR
+ * text, leaving longer identifiers sharing the prefix untouched
+ */
+static std::string rename_global_symbol(const std::string &ir,
+                                        const std::string &from,
+                                        const std::string &to) {
+  std::string renamed;
+  renamed.reserve(ir.size());
+  size_t pos = 0;
+  while (true) {
+    size_t found = ir.find(from, pos);
+    if (found == std::string::npos)
+      break;
+
+    size_t end = found + from.size();
+    bool whole_symbol =
+        end >= ir.size() ||
+        !(std::isalnum((unsigned char)ir[end]) || ir[end] == '_' ||
+          ir[end] == '.' || ir[end] == '$');
+    renamed.append(ir, pos, found - pos);
+    renamed += whole_symbol ? to : from;
+    pos = end;
+  }
+  renamed.append(ir, pos, std::string::npos);
+  return renamed;
+}
+
+bool CommandManager::link_kernel_batch(const std::vector<KernelTask *> &batch,
+                                       const fs::path &so_filepath) {
+  auto link_start = std::chrono::steady_clock::now();
+
+  // 1. Give every entry point (and its C interface wrapper) a unique name
+  std::vector<fs::path> batch_ll_files;
+  for (size_t i = 0; i < batch.size(); i++) {
+    KernelTask *task = batch[i];
+    std::string symbol = "kernel_call_" + std::to_string(i);
+
+    std::ifstream ll_stream(task->ll_filepath);
+    std::ostringstream contents;
+    contents << ll_stream.rdbuf();
+    std::string ir = rename_global_symbol(contents.str(), "@kernel_call",
+                                          "@" + symbol);
+    ir = rename_global_symbol(
+        ir, "@" + CallTrampoline::trampoline_symbol("kernel_call"),
+        "@" + CallTrampoline::trampoline_symbol(symbol));
+    ir = rename_global_symbol(ir, "@_mlir_ciface_kernel_call",
+                              "@_mlir_ciface_" + symbol);
+
+    fs::path batch_ll =
+        fs::path(task->ll_filepath).replace_extension(".batch.ll");
+    std::ofstream batch_stream(batch_ll);
+    batch_stream << ir;
+    batch_stream.close();
+
+    task->kernel.symbol = symbol;
+    batch_ll_files.push_back(batch_ll);
+  }
+
+  // 2. Compile and link once (or reuse a cached batch object)
+  std::string object_key;
+  fs::path object_filepath = so_filepath;
+  bool from_cache = false;
+  if (CompileCache::is_enabled()) {
+    object_key = CompileCache::object_key(
+        batch_ll_files, CommandManager::get_compiler_identity(),
+        CommandManager::get_compile_flags());
+    fs::path cached_object = CompileCache::lookup_object(object_key);
+    if (!cached_object.empty()) {
+      object_filepath = cached_object;
+      from_cache = true;
+    }
+  }
+
+  if (!from_cache) {
+    std::string compilation_command =
+        settings.compiler + " " + CommandManager::get_compile_flags() +
+        " -o " + so_filepath.generic_string() + " -Wl,-rpath," +
+        settings.llvm_lib_path.generic_string() + " -L" +
+        settings.llvm_lib_path.generic_string() +
+        " -lmlir_runner_utils -lmlir_c_runner_utils";
+    for (const fs::path &batch_ll : batch_ll_files)
+      compilation_command += " " + batch_ll.generic_string();
+    CommandManager::exec(compilation_command);
+
+    if (!fs::exists(so_filepath)) {
+      std::cerr << "Failed to link batch " << so_filepath << std::endl;
+      return false;
+    }
+    if (!object_key.empty())
+      CompileCache::store_object(object_key, so_filepath);
+  }
+
+  // 3. Load once, resolve every member
+  void *handle =
+      settings.loadFromMemory
+          ? ScratchSpace::dlopen_from_memory(object_filepath, RTLD_LAZY)
+          : dlopen(object_filepath.c_str(), RTLD_LAZY);
+  if (handle == NULL) {
+    std::cerr << "Failed to open batch " << object_filepath << ": "
+              << dlerror() << std::endl;
+    return false;
+  }
+  std::shared_ptr<void> batch_object(
+      handle, [object_filepath, from_cache](void *h) {
+        dlclose(h);
+        if (!from_cache) {
+          std::error_code ec;
+          fs::remove(object_filepath, ec);
+        }
+      });
+
+  for (KernelTask *task : batch)
+    if (!dlsym(handle, task->kernel.symbol.c_str())) {
+      std::cerr << "Failed to resolve " << task->kernel.symbol << " in "
+                << object_filepath << std::endl;
+      return false;
+    }
+
+  // Link cost is amortised over the members of the batch
+  double share = std::chrono::duration<double>(
+                     std::chrono::steady_clock::now() - link_start)
+                     .count() /
+                 batch.size();
+  for (KernelTask *task : batch) {
+    task->kernel.function = dlsym(handle, task->kernel.symbol.c_str());
+    if (settings.call_interface == CallInterface::TRAMPOLINE)
+      task->kernel.trampoline = dlsym(
+          handle,
+          CallTrampoline::trampoline_symbol(task->kernel.symbol).c_str());
+    // Forwarders are linkonce_odr, so the batch has a single hook table
+    if (settings.track_allocations)
+      task->kernel.alloc_hooks =
+          dlsym(handle, AllocationTracker::HOOK_TABLE_SYMBOL);
+    if (ParallelRuntime::is_gpu(CommandManager::parallel_runtime))
+      task->kernel.gpu_hooks = dlsym(handle, GpuRuntime::HOOK_TABLE_SYMBOL);
+    task->kernel.so_handle = handle;
+    task->kernel.so_filepath = object_filepath;
+    task->kernel.batch_object = batch_object;
+    task->kernel.compile_seconds += share;
+  }
+  return true;
+}
+
+void CommandManager::link_kernel_batches(std::vector<KernelTask> &tasks) {
+  if (settings.link_mode == LinkMode::PER_KERNEL ||
+      settings.execution_engine != ExecutionEngine::SHARED_OBJECT)
+    return;
+
+  // Only successfully lowered kernels take part in linking
+  std::map<std::string, std::vector<KernelTask *>> batches;
+  for (KernelTask &task : tasks) {
+    if (!task.prepared)
+      continue;
+    std::string batch_name =
+        settings.link_mode == LinkMode::MODEL ? "" : task.op_type;
+    batches[batch_name].push_back(&task);
+  }
+
+  for (auto &[batch_name, batch] : batches) {
+    fs::path so_filepath =
+        batch_name.empty()
+            ? fs::path(settings.loweringFolder).append("model.batch.so")
+            : fs::path(settings.loweringFolder)
+                  .append(batch_name)
+                  .append("kernels.batch.so");
+
+    std::cout << "Linking " << batch.size() << " kernels into "
+              << so_filepath.generic_string() << std::endl;
+    if (CommandManager::link_kernel_batch(batch, so_filepath))
+      continue;
+
+    // A single bad kernel must not take the whole batch down
+    std::cerr << "Batch link failed, building kernels individually\n";
+    for (KernelTask *task : batch) {
+      CommandManager::unload_kernel(task->kernel);
+      task->kernel.symbol = "kernel_call";
+      task->prepared =
+          CommandManager::build_kernel_object(task->ll_filepath, task->kernel);
+    }
+  }
+}
+
 /**
  * Dynamically creates the ffi_type_struct for an MLIR MemRef descriptor.
  * The MemRef descriptor format is: { ptr, ptr, i64, [rank x i64], [rank x i64]
@@ -770,3 +3417,59 @@ void destroy_memref_struct_type(ffi_type *memref_type) {
     free(memref_type);
   }
 }
+
+/*
+ * Return type of a kernel with any number of results:
+ *    0 results  -> void
+ *    1 result   -> the MemRef descriptor itself
+ *    N results  -> { desc_0, desc_1, ..., desc_N-1 }
+ *
+ * The lowering packs multiple results into a struct of descriptors. Every
+ * field is 8 bytes wide, so the nested struct has no padding and matches the
+ * back to back layout the trampoline uses.
+ */
+ffi_type *create_results_struct_type(const std::vector<JSONArgument> &returns) {
+  if (returns.empty())
+    return &ffi_type_void;
+  if (returns.size() == 1)
+    return create_memref_struct_type(returns[0].rank);
+
+  ffi_type *results_type = (ffi_type *)malloc(sizeof(ffi_type));
+  ffi_type **elements =
+      (ffi_type **)malloc(sizeof(ffi_type *) * (returns.size() + 1));
+  if (!results_type || !elements) {
+    std::cerr << "Failed to initialize the results struct type\n";
+    free(results_type);
+    free(elements);
+    return NULL;
+  }
+
+  for (size_t i = 0; i < returns.size(); i++) {
+    elements[i] = create_memref_struct_type(returns[i].rank);
+    if (!elements[i]) {
+      for (size_t j = 0; j < i; j++)
+        destroy_memref_struct_type(elements[j]);
+      free(elements);
+      free(results_type);
+      return NULL;
+    }
+  }
+  elements[returns.size()] = NULL;
+
+  memset(results_type, 0, sizeof(ffi_type));
+  results_type->type = FFI_TYPE_STRUCT;
+  results_type->elements = elements;
+  return results_type;
+}
+
+void destroy_results_struct_type(ffi_type *results_type) {
+  if (!results_type || results_type == &ffi_type_void)
+    return;
+
+  // Nested descriptors are structs themselves, plain descriptors only hold
+  // scalar fields
+  for (ffi_type **field = results_type->elements; field && *field; field++)
+    if ((*field)->type == FFI_TYPE_STRUCT)
+      destroy_memref_struct_type(*field);
+  destroy_memref_struct_type(results_type);
+}
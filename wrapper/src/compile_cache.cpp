@@ -0,0 +1,214 @@
+#include "compile_cache.h"
+#include "utils.h"
+
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <unistd.h>
+
+bool CompileCache::enabled = false;
+fs::path CompileCache::cache_dir;
+
+std::atomic<uint64_t> CompileCache::lowering_hits{0};
+std::atomic<uint64_t> CompileCache::lowering_misses{0};
+std::atomic<uint64_t> CompileCache::object_hits{0};
+std::atomic<uint64_t> CompileCache::object_misses{0};
+
+static const char *CACHED_LL_NAME = "kernel.ll";
+static const char *CACHED_LLVM_MLIR_NAME = "kernel.llvm.mlirbc";
+static const char *CACHED_OBJECT_NAME = "kernel_call.so";
+
+void CompileCache::set_enabled(bool flag) { CompileCache::enabled = flag; }
+
+void CompileCache::set_cache_dir(const fs::path &path) {
+  CompileCache::cache_dir = path;
+}
+
+bool CompileCache::is_enabled() {
+  return CompileCache::enabled && !CompileCache::cache_dir.empty();
+}
+
+fs::path CompileCache::default_cache_dir() {
+  if (const char *xdg = std::getenv("XDG_CACHE_HOME"); xdg && *xdg)
+    return fs::path(xdg).append("mlir-bench");
+  if (const char *home = std::getenv("HOME"); home && *home)
+    return fs::path(home).append(".cache/mlir-bench");
+  return fs::temp_directory_path().append("mlir-bench");
+}
+
+std::string CompileCache::lowering_key(const fs::path &mlir_filepath,
+                                       const std::string &pipeline,
+                                       const std::string &toolchain_id) {
+  uint64_t hash = hash_file_contents(mlir_filepath);
+  hash = hash_string(pipeline, hash);
+  hash = hash_string(toolchain_id, hash);
+  return hash_to_hex(hash);
+}
+
+std::string CompileCache::object_key(const fs::path &ll_filepath,
+                                     const std::string &compiler_id,
+                                     const std::string &compile_flags) {
+  uint64_t hash = hash_file_contents(ll_filepath);
+  hash = hash_string(compiler_id, hash);
+  hash = hash_string(compile_flags, hash);
+  return hash_to_hex(hash);
+}
+
+std::string CompileCache::object_key(const std::vector<fs::path> &ll_filepaths,
+                                     const std::string &compiler_id,
+                                     const std::string &compile_flags) {
+  uint64_t hash = hash_string("batch");
+  for (const fs::path &ll_filepath : ll_filepaths)
+    hash = hash_file_contents(ll_filepath, hash);
+  hash = hash_string(compiler_id, hash);
+  hash = hash_string(compile_flags, hash);
+  return hash_to_hex(hash);
+}
+
+/*
+ * Moves a fully written staging directory into its final location. Losing the
+ * race against another process writing the same key is not an error, since
+ * both entries are equivalent by construction.
+ */
+bool CompileCache::commit_entry(const fs::path &staging_dir,
+                                const fs::path &entry_dir) {
+  std::error_code ec;
+  fs::create_directories(entry_dir.parent_path(), ec);
+  fs::rename(staging_dir, entry_dir, ec);
+  if (ec) {
+    fs::remove_all(staging_dir, ec);
+    return fs::exists(entry_dir);
+  }
+  return true;
+}
+
+static fs::path make_staging_dir(const fs::path &cache_dir) {
+  std::ostringstream name;
+  name << "tmp_" << getpid() << "_" << std::this_thread::get_id();
+  fs::path staging = fs::path(cache_dir).append("staging").append(name.str());
+  std::error_code ec;
+  fs::remove_all(staging, ec);
+  fs::create_directories(staging, ec);
+  return staging;
+}
+
+bool CompileCache::fetch_lowering(const std::string &key,
+                                  const fs::path &ll_filepath,
+                                  const fs::path &llvm_mlir_filepath) {
+  if (!CompileCache::is_enabled())
+    return false;
+
+  fs::path entry =
+      fs::path(CompileCache::cache_dir).append("lowering").append(key);
+  fs::path cached_ll = fs::path(entry).append(CACHED_LL_NAME);
+  if (!fs::exists(cached_ll)) {
+    CompileCache::lowering_misses++;
+    return false;
+  }
+
+  std::error_code ec;
+  fs::copy_file(cached_ll, ll_filepath, fs::copy_options::overwrite_existing,
+                ec);
+  if (ec) {
+    std::cerr << "Compile cache: failed to restore " << ll_filepath << ": "
+              << ec.message() << std::endl;
+    CompileCache::lowering_misses++;
+    return false;
+  }
+
+  fs::path cached_llvm_mlir = fs::path(entry).append(CACHED_LLVM_MLIR_NAME);
+  if (fs::exists(cached_llvm_mlir))
+    fs::copy_file(cached_llvm_mlir, llvm_mlir_filepath,
+                  fs::copy_options::overwrite_existing, ec);
+
+  CompileCache::lowering_hits++;
+  return true;
+}
+
+void CompileCache::store_lowering(const std::string &key,
+                                  const fs::path &ll_filepath,
+                                  const fs::path &llvm_mlir_filepath) {
+  if (!CompileCache::is_enabled())
+    return;
+
+  // Failed lowerings leave behind empty files, which must never be cached
+  std::error_code ec;
+  if (!fs::exists(ll_filepath) || fs::file_size(ll_filepath, ec) == 0)
+    return;
+
+  fs::path staging = make_staging_dir(CompileCache::cache_dir);
+  fs::copy_file(ll_filepath, fs::path(staging).append(CACHED_LL_NAME), ec);
+  if (!ec && fs::exists(llvm_mlir_filepath))
+    fs::copy_file(llvm_mlir_filepath,
+                  fs::path(staging).append(CACHED_LLVM_MLIR_NAME), ec);
+  if (ec) {
+    fs::remove_all(staging, ec);
+    return;
+  }
+
+  CompileCache::commit_entry(
+      staging, fs::path(CompileCache::cache_dir).append("lowering").append(key));
+}
+
+fs::path CompileCache::lookup_object(const std::string &key) {
+  if (!CompileCache::is_enabled())
+    return fs::path();
+
+  fs::path cached_object = fs::path(CompileCache::cache_dir)
+                               .append("objects")
+                               .append(key)
+                               .append(CACHED_OBJECT_NAME);
+  if (!fs::exists(cached_object)) {
+    CompileCache::object_misses++;
+    return fs::path();
+  }
+
+  CompileCache::object_hits++;
+  return cached_object;
+}
+
+void CompileCache::store_object(const std::string &key,
+                                const fs::path &so_filepath) {
+  if (!CompileCache::is_enabled() || !fs::exists(so_filepath))
+    return;
+
+  std::error_code ec;
+  fs::path staging = make_staging_dir(CompileCache::cache_dir);
+  fs::copy_file(so_filepath, fs::path(staging).append(CACHED_OBJECT_NAME), ec);
+  if (ec) {
+    fs::remove_all(staging, ec);
+    return;
+  }
+
+  CompileCache::commit_entry(
+      staging, fs::path(CompileCache::cache_dir).append("objects").append(key));
+}
+
+CompileCacheCounts CompileCache::counts() {
+  return {CompileCache::lowering_hits, CompileCache::lowering_misses,
+          CompileCache::object_hits, CompileCache::object_misses};
+}
+
+void CompileCache::print_statistics() {
+  if (!CompileCache::is_enabled())
+    return;
+
+  auto print_line = [](const char *name, uint64_t hits, uint64_t misses) {
+    uint64_t total = hits + misses;
+    double rate = total ? (100.0 * hits) / total : 0.0;
+    std::ostringstream line;
+    line << "  " << std::left << std::setw(10) << name << hits << " hits, "
+         << misses << " misses (" << std::fixed << std::setprecision(1)
+         << rate << "% hit rate)\n";
+    std::cout << line.str();
+  };
+
+  std::cout << "Compile cache (" << CompileCache::cache_dir.generic_string()
+            << "):\n";
+  print_line("Lowering", CompileCache::lowering_hits,
+             CompileCache::lowering_misses);
+  print_line("Objects", CompileCache::object_hits,
+             CompileCache::object_misses);
+}
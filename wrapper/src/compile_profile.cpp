@@ -0,0 +1,119 @@
+#include "compile_profile.h"
+
+#include <fstream>
+#include <map>
+#include <regex>
+
+bool CompileProfiler::enabled = false;
+
+void CompileProfiler::set_enabled(bool flag) {
+  CompileProfiler::enabled = flag;
+}
+
+bool CompileProfiler::is_enabled() { return CompileProfiler::enabled; }
+
+std::string CompileProfiler::mlir_opt_flags(const fs::path &log) {
+  return " -mlir-timing -mlir-timing-display=tree -mlir-disable-threading "
+         "-mlir-print-ir-after-all -mlir-print-ir-module-scope 2> " +
+         log.generic_string();
+}
+
+fs::path CompileProfiler::log_filepath(const fs::path &mlir_filepath) {
+  return fs::path(mlir_filepath).replace_extension(".passes.log");
+}
+
+// `%0:2 = linalg.generic`, `scf.for`, `"test.op"()`, `return`, `module {`
+static const std::regex OP_LINE(
+    R"(^\s*(%[\w#:, %]*=\s*)?("?[A-Za-z_]\w*\.[\w.$]+|return\b|module\b))");
+
+size_t CompileProfiler::count_ops(std::istream &ir) {
+  size_t ops = 0;
+  for (std::string line; std::getline(ir, line);)
+    if (std::regex_search(line, OP_LINE))
+      ops++;
+  return ops;
+}
+
+size_t CompileProfiler::count_ops(const fs::path &mlir_filepath) {
+  std::ifstream ir(mlir_filepath);
+  return ir.is_open() ? CompileProfiler::count_ops(ir) : 0;
+}
+
+bool CompileProfiler::parse_log(const fs::path &log, size_t input_ops,
+                                CompileProfile &profile) {
+  std::ifstream file(log);
+  if (!file.is_open())
+    return false;
+
+  // "// -----// IR Dump After Canonicalizer (canonicalize) //----- //"
+  static const std::regex dump_header(
+      R"(^// -----// IR Dump After (.+?)(?: \(([^()]*)\))? //----- //)");
+  // "    0.0032 ( 15.8%)    Canonicalizer"
+  static const std::regex timing_line(
+      R"(^\s*([0-9.]+)\s+\(\s*[0-9.]+%\)\s+(.+?)\s*$)");
+  static const std::regex total_line(
+      R"(Total Execution Time:\s*([0-9.]+) seconds)");
+
+  // Module op count after each dump, and pass class name -> argument
+  std::vector<std::pair<std::string, size_t>> dumps;
+  std::map<std::string, std::string> arguments;
+  std::vector<std::pair<std::string, double>> timings;
+  bool in_report = false;
+  size_t ops = 0;
+  std::smatch match;
+  for (std::string line; std::getline(file, line);) {
+    if (std::regex_search(line, match, dump_header)) {
+      dumps.push_back({match[1].str(), 0});
+      if (match[2].matched)
+        arguments[match[1].str()] = match[2].str();
+      ops = 0;
+      continue;
+    }
+    if (std::regex_search(line, match, total_line)) {
+      profile.mlir_opt_seconds = std::stod(match[1].str());
+      in_report = true;
+      continue;
+    }
+    if (in_report) {
+      if (!std::regex_match(line, match, timing_line))
+        continue;
+      std::string name = match[2].str();
+      // Not passes: mlir-opt's own stages, pass adaptors and analyses
+      if (name == "Parser" || name == "Output" || name == "Total" ||
+          name == "Rest" || name.starts_with("(A)") ||
+          name.ends_with(" Pipeline"))
+        continue;
+      timings.push_back({name, std::stod(match[1].str()) * 1000.0});
+    } else if (!dumps.empty() && std::regex_search(line, OP_LINE)) {
+      dumps.back().second = ++ops;
+    }
+  }
+  if (!in_report)
+    return false;
+
+  // Timing entries are pass instances in pipeline order, matched to the next
+  // dump of the same pass. A function pass on a kernel with several
+  // functions dumps once per function, its counts are then approximate.
+  profile.passes.clear();
+  size_t current = input_ops;
+  size_t next_dump = 0;
+  for (const auto &[name, wall_ms] : timings) {
+    PassProfile pass;
+    auto argument = arguments.find(name);
+    pass.name = argument == arguments.end() ? name : argument->second;
+    pass.wall_ms = wall_ms;
+    pass.ops_before = current;
+    for (size_t d = next_dump; d < dumps.size(); d++) {
+      if (dumps[d].first != name)
+        continue;
+      current = dumps[d].second;
+      next_dump = d + 1;
+      break;
+    }
+    pass.ops_after = current;
+    profile.passes.push_back(pass);
+  }
+  profile.linalg_ops = input_ops;
+  profile.llvm_ops = current;
+  return true;
+}
@@ -0,0 +1,307 @@
+#include "constant_args.h"
+#include "model_source.h"
+#include "subgraph_isolation.h"
+
+#include <iostream>
+#include <sstream>
+#include <string_view>
+
+bool ConstantArgs::parse(const std::string &spec, ConstantArgsSpec &constants) {
+  std::stringstream ss(spec);
+  for (std::string entry; std::getline(ss, entry, ',');) {
+    if (entry.empty())
+      continue;
+    if (entry == "weights") {
+      constants.weights = true;
+      continue;
+    }
+    size_t end = 0;
+    try {
+      constants.indices.insert(std::stoul(entry, &end));
+    } catch (const std::exception &) {
+      return false;
+    }
+    if (end != entry.size())
+      return false;
+  }
+  return true;
+}
+
+static std::string_view trim(std::string_view text) {
+  size_t begin = text.find_first_not_of(" \t\r\n");
+  if (begin == std::string_view::npos)
+    return {};
+  return text.substr(begin, text.find_last_not_of(" \t\r\n") - begin + 1);
+}
+
+/*
+ * Positions of the kernel_call argument list, and [begin, end) of every
+ * argument in it. Commas inside types, locations and strings don't split.
+ */
+struct Signature {
+  size_t open = std::string::npos;
+  size_t close = std::string::npos;
+  std::vector<std::pair<size_t, size_t>> args;
+};
+
+static bool parse_signature(const std::string &text, Signature &signature) {
+  size_t func_pos = text.find("@kernel_call(");
+  if (func_pos == std::string::npos)
+    return false;
+  signature.open = text.find('(', func_pos);
+  int depth = 0;
+  bool quoted = false;
+  size_t begin = signature.open + 1;
+  for (size_t i = signature.open; i < text.size(); i++) {
+    char c = text[i];
+    if (quoted) {
+      if (c == '\\')
+        i++;
+      else if (c == '"')
+        quoted = false;
+      continue;
+    }
+    if (c == '"') {
+      quoted = true;
+    } else if (c == '(' || c == '<' || c == '[' || c == '{') {
+      depth++;
+    } else if (c == ')' || c == '>' || c == ']' || c == '}') {
+      if (--depth == 0) {
+        signature.close = i;
+        if (!trim(std::string_view(text).substr(begin, i - begin)).empty())
+          signature.args.emplace_back(begin, i);
+        return true;
+      }
+    } else if (c == ',' && depth == 1) {
+      signature.args.emplace_back(begin, i);
+      begin = i + 1;
+    }
+  }
+  return false;
+}
+
+// "%arg0: !torch.vtensor<[1,3],f32> loc(#loc1)" -> name and type
+static void split_argument(std::string_view arg, std::string &name,
+                           std::string &type) {
+  arg = trim(arg);
+  size_t colon = arg.find(':');
+  name = std::string(trim(arg.substr(0, colon)));
+  type.clear();
+  if (colon == std::string_view::npos)
+    return;
+  std::string_view rest = trim(arg.substr(colon + 1));
+  int depth = 0;
+  size_t end = 0;
+  for (; end < rest.size(); end++) {
+    char c = rest[end];
+    if (c == '<' || c == '(' || c == '[')
+      depth++;
+    else if (c == '>' || c == ')' || c == ']')
+      depth--;
+    else if (depth == 0 && (c == ' ' || c == '{'))
+      break;
+  }
+  type = std::string(rest.substr(0, end));
+}
+
+/*
+ * Builtin tensor type of a static torch value tensor,
+ * !torch.vtensor<[64,3,11,11],f32> -> tensor<64x3x11x11xf32>. Empty for
+ * dynamic or unranked ones.
+ */
+static std::string builtin_tensor(const std::string &vtensor_type) {
+  static const std::string PREFIX = "!torch.vtensor<[";
+  if (vtensor_type.rfind(PREFIX, 0) != 0 || vtensor_type.back() != '>')
+    return "";
+  size_t dims_end = vtensor_type.find("],", PREFIX.size());
+  if (dims_end == std::string::npos)
+    return "";
+  std::string dims =
+      vtensor_type.substr(PREFIX.size(), dims_end - PREFIX.size());
+  std::string dtype = vtensor_type.substr(
+      dims_end + 2, vtensor_type.size() - dims_end - 3);
+  if (dims.find('?') != std::string::npos || dtype.empty())
+    return "";
+  std::string shape;
+  for (char c : dims)
+    if (c != ' ')
+      shape += c == ',' ? 'x' : c;
+  return "tensor<" + shape + (shape.empty() ? "" : "x") + dtype + ">";
+}
+
+std::vector<std::string>
+ConstantArgs::argument_types(const std::string &kernel_text) {
+  std::vector<std::string> types;
+  Signature signature;
+  if (!parse_signature(kernel_text, signature))
+    return types;
+  for (const auto &[begin, end] : signature.args) {
+    std::string name, type;
+    split_argument(std::string_view(kernel_text).substr(begin, end - begin),
+                   name, type);
+    types.push_back(type);
+  }
+  return types;
+}
+
+std::string ConstantArgs::dense_literal(const std::string &vtensor_type,
+                                        const void *data, size_t bytes) {
+  std::string tensor = builtin_tensor(vtensor_type);
+  if (tensor.empty() || tensor.find("xi1>") != std::string::npos ||
+      tensor == "tensor<i1>")
+    return "";
+  static const char DIGITS[] = "0123456789ABCDEF";
+  std::string literal = "dense<\"0x";
+  literal.reserve(literal.size() + 2 * bytes + tensor.size() + 8);
+  const unsigned char *bytes_data = static_cast<const unsigned char *>(data);
+  for (size_t i = 0; i < bytes; i++) {
+    literal += DIGITS[bytes_data[i] >> 4];
+    literal += DIGITS[bytes_data[i] & 0xF];
+  }
+  return literal + "\"> : " + tensor;
+}
+
+std::map<size_t, std::map<size_t, std::string>>
+ConstantArgs::model_weights(const fs::path &model_text_filepath,
+                            const std::set<std::string> &op_types,
+                            const std::set<size_t> &layers) {
+  std::map<size_t, std::map<size_t, std::string>> weights;
+  std::vector<std::vector<KernelInput>> inputs =
+      SubgraphIsolation::kernel_inputs(model_text_filepath, op_types);
+
+  // Model values the kernels take as arguments, and where
+  std::map<std::string, std::vector<std::pair<size_t, size_t>>> wanted;
+  for (size_t layer : layers)
+    if (layer < inputs.size())
+      for (size_t i = 0; i < inputs[layer].size(); i++)
+        if (inputs[layer][i].producer < 0)
+          wanted[inputs[layer][i].value].emplace_back(layer, i);
+  if (wanted.empty())
+    return weights;
+
+  MappedFile model(model_text_filepath);
+  if (!model.valid())
+    return weights;
+  std::string_view text = model.view();
+  size_t resources_pos = text.rfind("{-#");
+  std::string_view body = text.substr(0, resources_pos);
+
+  // Literal attributes of the wanted values, resources are resolved below
+  static const std::string_view LITERAL = "torch.vtensor.literal(";
+  static const std::string_view LITERAL_TYPE = ") : !torch.vtensor<";
+  std::map<std::string, std::string> literals;
+  std::map<std::string, std::vector<std::string>> resource_users;
+  for (size_t pos = 0; pos < body.size();) {
+    size_t line_end = body.find('\n', pos);
+    if (line_end == std::string_view::npos)
+      line_end = body.size();
+    std::string_view line = body.substr(pos, line_end - pos);
+    pos = line_end + 1;
+
+    size_t literal = line.find(LITERAL);
+    size_t assign = line.find(" = ");
+    if (literal == std::string_view::npos || assign == std::string_view::npos)
+      continue;
+    std::string value(trim(line.substr(0, assign)));
+    if (!wanted.count(value))
+      continue;
+    size_t attr_begin = literal + LITERAL.size();
+    size_t attr_end = line.rfind(LITERAL_TYPE);
+    if (attr_end == std::string_view::npos || attr_end < attr_begin)
+      continue;
+    std::string attr(line.substr(attr_begin, attr_end - attr_begin));
+    if (attr.find("__elided__") != std::string::npos)
+      continue;
+    if (attr.rfind("dense_resource<", 0) == 0) {
+      size_t key_end = attr.find('>');
+      resource_users[attr.substr(15, key_end - 15)].push_back(value);
+    }
+    literals[value] = attr;
+  }
+
+  // Blobs are "0x" + the 4 byte alignment + the data, the data alone is a
+  // hex dense attribute of the same type
+  if (resources_pos != std::string_view::npos && !resource_users.empty()) {
+    std::string_view resources = text.substr(resources_pos);
+    for (size_t pos = 0; pos < resources.size();) {
+      size_t line_end = resources.find('\n', pos);
+      if (line_end == std::string_view::npos)
+        line_end = resources.size();
+      std::string_view line = trim(resources.substr(pos, line_end - pos));
+      pos = line_end + 1;
+
+      size_t colon = line.find(": \"0x");
+      if (colon == std::string_view::npos)
+        continue;
+      auto users = resource_users.find(std::string(line.substr(0, colon)));
+      if (users == resource_users.end())
+        continue;
+      std::string_view blob = line.substr(colon + 3);
+      blob = blob.substr(0, blob.find('"'));
+      if (blob.size() < 10)
+        continue;
+      for (const std::string &value : users->second) {
+        std::string &attr = literals[value];
+        attr = "dense<\"0x" + std::string(blob.substr(10)) + "\">" +
+               attr.substr(attr.find('>') + 1);
+      }
+      resource_users.erase(users);
+    }
+  }
+  // Resources the model doesn't define can't be inlined
+  for (const auto &[key, values] : resource_users)
+    for (const std::string &value : values)
+      literals.erase(value);
+
+  for (const auto &[value, attr] : literals)
+    for (const auto &[layer, index] : wanted[value])
+      weights[layer][index] = attr;
+  return weights;
+}
+
+bool ConstantArgs::specialize(const std::string &kernel_text,
+                              const std::map<size_t, std::string> &literals,
+                              std::string &specialized, size_t &inlined) {
+  inlined = 0;
+  Signature signature;
+  if (!parse_signature(kernel_text, signature))
+    return false;
+  // The body opens at the end of the signature's line
+  size_t line_end = kernel_text.find('\n', signature.close);
+  size_t body_open = kernel_text.rfind('{', line_end);
+  if (body_open == std::string::npos || body_open < signature.close)
+    return false;
+
+  std::string kept_args, definitions;
+  for (size_t i = 0; i < signature.args.size(); i++) {
+    auto [begin, end] = signature.args[i];
+    std::string_view arg =
+        trim(std::string_view(kernel_text).substr(begin, end - begin));
+    std::string name, type;
+    split_argument(arg, name, type);
+
+    auto literal = literals.find(i);
+    std::string tensor = builtin_tensor(type);
+    if (literal != literals.end() && !tensor.empty() &&
+        literal->second.size() > tensor.size() &&
+        literal->second.compare(literal->second.size() - tensor.size(),
+                                tensor.size(), tensor) == 0) {
+      definitions += "\n    " + name + " = torch.vtensor.literal(" +
+                     literal->second + ") : " + type;
+      inlined++;
+      continue;
+    }
+    if (literal != literals.end())
+      std::cerr << "Constant for argument " << i << " doesn't match " << type
+                << ", keeping it an argument\n";
+    kept_args += (kept_args.empty() ? "" : ", ") + std::string(arg);
+  }
+  if (!inlined)
+    return false;
+
+  specialized = kernel_text.substr(0, signature.open + 1) + kept_args +
+                kernel_text.substr(signature.close,
+                                   body_open + 1 - signature.close) +
+                definitions + kernel_text.substr(body_open + 1);
+  return true;
+}
@@ -0,0 +1,173 @@
+#include "contention.h"
+#include "cache_evictor.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+static const uint64_t CACHE_LINE_WORDS = 64 / sizeof(uint64_t);
+
+std::string ContentionProfile::name() const {
+  std::string kind_name = kind == StressorKind::BANDWIDTH ? "bandwidth"
+                          : kind == StressorKind::LLC     ? "llc"
+                                                          : "spin";
+  std::string placement_name = placement == StressorPlacement::SMT ? "smt"
+                               : placement == StressorPlacement::CORE
+                                   ? "core"
+                                   : "socket";
+  return kind_name + "-" + placement_name;
+}
+
+bool ContentionGenerator::parse(const std::string &list,
+                                std::vector<ContentionProfile> &profiles) {
+  std::stringstream ss(list);
+  for (std::string entry; std::getline(ss, entry, ',');) {
+    if (entry.empty())
+      continue;
+    size_t at = entry.find('@');
+    std::string kind = entry.substr(0, at);
+    std::string placement =
+        at == std::string::npos ? "core" : entry.substr(at + 1);
+
+    ContentionProfile profile;
+    if (kind == "bandwidth")
+      profile.kind = StressorKind::BANDWIDTH;
+    else if (kind == "llc")
+      profile.kind = StressorKind::LLC;
+    else if (kind == "spin")
+      profile.kind = StressorKind::SPIN;
+    else
+      return false;
+    if (placement == "smt")
+      profile.placement = StressorPlacement::SMT;
+    else if (placement == "core")
+      profile.placement = StressorPlacement::CORE;
+    else if (placement == "socket")
+      profile.placement = StressorPlacement::SOCKET;
+    else
+      return false;
+    profiles.push_back(profile);
+  }
+  return true;
+}
+
+// sysfs topology value of a CPU, -1 if not described
+static int topology_id(int cpu, const std::string &field) {
+  std::ifstream file("/sys/devices/system/cpu/cpu" + std::to_string(cpu) +
+                     "/topology/" + field);
+  int id = -1;
+  file >> id;
+  return id;
+}
+
+std::vector<int>
+ContentionGenerator::placement_cpus(StressorPlacement placement,
+                                    int measure_cpu) {
+  int package = topology_id(measure_cpu, "physical_package_id");
+  int core = topology_id(measure_cpu, "core_id");
+
+  std::vector<int> siblings, others;
+  for (int cpu = 0; cpu < get_online_cpu_count(); cpu++) {
+    if (cpu == measure_cpu ||
+        topology_id(cpu, "physical_package_id") != package)
+      continue;
+    // Without topology every CPU counts as a core of its own
+    if (core >= 0 && topology_id(cpu, "core_id") == core)
+      siblings.push_back(cpu);
+    else
+      others.push_back(cpu);
+  }
+
+  if (placement == StressorPlacement::SMT)
+    return siblings;
+  if (placement == StressorPlacement::SOCKET || others.empty())
+    return others;
+  int nearest = *std::min_element(
+      others.begin(), others.end(), [measure_cpu](int a, int b) {
+        return std::abs(a - measure_cpu) < std::abs(b - measure_cpu);
+      });
+  return {nearest};
+}
+
+ContentionGenerator::ContentionGenerator(const ContentionProfile &profile,
+                                         int measure_cpu)
+    : m_profile(profile),
+      m_cpus(ContentionGenerator::placement_cpus(profile.placement,
+                                                 measure_cpu)) {}
+
+ContentionGenerator::~ContentionGenerator() { stop(); }
+
+bool ContentionGenerator::start() {
+  if (m_cpus.empty())
+    return false;
+
+  // Several LLC sizes stream from memory, a single one keeps the LLC busy
+  uint64_t llc_bytes = CacheEvictor::last_level_cache_bytes();
+  uint64_t buffer_bytes =
+      m_profile.kind == StressorKind::BANDWIDTH ? 4 * llc_bytes
+      : m_profile.kind == StressorKind::LLC
+          ? llc_bytes / std::max<size_t>(m_cpus.size(), 1)
+          : 0;
+  m_buffers.assign(m_cpus.size(), std::vector<uint64_t>(
+                                      buffer_bytes / sizeof(uint64_t), 1));
+
+  m_stop = false;
+  m_ready = 0;
+  for (size_t i = 0; i < m_cpus.size(); i++)
+    m_threads.emplace_back(&ContentionGenerator::run, this, m_cpus[i], i);
+  while (m_ready < m_threads.size())
+    std::this_thread::yield();
+  return true;
+}
+
+void ContentionGenerator::stop() {
+  m_stop = true;
+  for (std::thread &thread : m_threads)
+    thread.join();
+  m_threads.clear();
+  m_buffers.clear();
+}
+
+void ContentionGenerator::run(int cpu, size_t index) {
+  pin_current_thread(cpu);
+  std::vector<uint64_t> &buffer = m_buffers[index];
+  m_ready++;
+
+  uint64_t checksum = 0;
+  switch (m_profile.kind) {
+  case StressorKind::BANDWIDTH:
+    while (!m_stop.load(std::memory_order_relaxed))
+      for (uint64_t i = 0; i < buffer.size(); i++)
+        buffer[i] += i;
+    break;
+  case StressorKind::LLC: {
+    // Random line order defeats the prefetchers, so every touch misses the
+    // private caches
+    uint64_t lines = std::max<uint64_t>(buffer.size() / CACHE_LINE_WORDS, 1);
+    uint64_t state = 0x9e3779b97f4a7c15ull + cpu;
+    while (!m_stop.load(std::memory_order_relaxed))
+      for (int step = 0; step < 4096; step++) {
+        state = state * 6364136223846793005ull + 1442695040888963407ull;
+        uint64_t &word = buffer[(state >> 17) % lines * CACHE_LINE_WORDS];
+        word += state;
+      }
+    break;
+  }
+  case StressorKind::SPIN: {
+    double value = 1.0 + cpu;
+    uint64_t integer = cpu + 1;
+    while (!m_stop.load(std::memory_order_relaxed))
+      for (int step = 0; step < 4096; step++) {
+        value = value * 0.999999 + 1e-7;
+        integer = integer * 2862933555777941757ull + 3037000493ull;
+      }
+    checksum = integer + static_cast<uint64_t>(value);
+    break;
+  }
+  }
+  // Keeps the spin loop from being optimised away
+  if (checksum == 1)
+    buffer.push_back(checksum);
+}
@@ -0,0 +1,306 @@
+#include "cost_model.h"
+#include "element_type.h"
+#include "kernel_cost.h"
+#include "linalg_structure.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+// Never flag predictions within this factor, however tight the fit
+static const double MIN_FLAG_RATIO = 2.0;
+
+std::map<std::string, double>
+CostModel::encode(const CostFeatures &features) {
+  std::map<std::string, double> encoded = {
+      {"bias", 1.0},
+      {"log_flops", std::log1p(features.flops)},
+      {"log_bytes", std::log1p(features.bytes_moved)},
+      {"num_loops", double(features.num_loops)},
+      {"num_parallel", double(features.num_parallel)},
+      {"num_reduction", double(features.num_reduction)}};
+  encoded["op_type=" + features.op_type] = 1.0;
+  if (!features.pipeline.empty())
+    encoded["pipeline=" + features.pipeline] = 1.0;
+  if (!features.structural_class.empty())
+    encoded["class=" + features.structural_class] = 1.0;
+  return encoded;
+}
+
+static void add_structure(const json &structure, CostFeatures &features) {
+  if (!structure.is_object() || !structure.contains("class"))
+    return;
+  features.structural_class = structure["class"];
+  features.num_loops = structure.value("num_loops", 0);
+  features.num_parallel = structure.value("num_parallel", 0);
+  features.num_reduction = structure.value("num_reduction", 0);
+}
+
+CostFeatures CostModel::features_of(const KernelTask &task,
+                                    const std::string &pipeline) {
+  CostFeatures features;
+  features.op_type = task.op_type;
+  features.pipeline = pipeline;
+  if (!task.metadata_ready)
+    return features;
+
+  json metadata = load_json_from_file(task.json_filepath);
+  std::ifstream kernel_file(task.mlir_filepath);
+  std::stringstream kernel_text;
+  kernel_text << kernel_file.rdbuf();
+  KernelCost cost =
+      KernelCosts::estimate(task.op_type, metadata, kernel_text.str());
+  features.flops = cost.modelled ? cost.flops : 0.0;
+  for (const char *side : {"args", "returns"})
+    for (const json &tensor :
+         metadata["kernel_call"].value(side, std::vector<json>())) {
+      double elements = 1.0;
+      for (uint64_t dim : tensor.value("shape", std::vector<uint64_t>()))
+        elements *= double(dim);
+      features.bytes_moved +=
+          elements * ElementTypes::size(ElementTypes::parse(
+                         tensor.value("dtype", std::string("f32"))));
+    }
+  add_structure(LinalgStructures::to_json(task.mlir_filepath), features);
+  return features;
+}
+
+CostFeatures CostModel::features_of(const StoredKernel &kernel,
+                                    const std::string &pipeline) {
+  CostFeatures features;
+  features.op_type = kernel.op_type;
+  features.pipeline = pipeline;
+  auto average = [&](const char *metric) {
+    auto it = kernel.averages.find(metric);
+    // Unmodelled FLOPs are stored as NaN
+    return it == kernel.averages.end() || std::isnan(it->second)
+               ? 0.0
+               : it->second;
+  };
+  features.flops = average("flops");
+  features.bytes_moved = average("bytes_moved");
+  add_structure(json::parse(kernel.structure, nullptr, false), features);
+  return features;
+}
+
+// Solves A x = b in place by Gaussian elimination with partial pivoting
+static bool solve(std::vector<std::vector<double>> &a, std::vector<double> &b,
+                  std::vector<double> &x) {
+  size_t n = b.size();
+  for (size_t col = 0; col < n; col++) {
+    size_t pivot = col;
+    for (size_t row = col + 1; row < n; row++)
+      if (std::fabs(a[row][col]) > std::fabs(a[pivot][col]))
+        pivot = row;
+    if (std::fabs(a[pivot][col]) < 1e-12)
+      return false;
+    std::swap(a[col], a[pivot]);
+    std::swap(b[col], b[pivot]);
+    for (size_t row = col + 1; row < n; row++) {
+      double factor = a[row][col] / a[col][col];
+      for (size_t k = col; k < n; k++)
+        a[row][k] -= factor * a[col][k];
+      b[row] -= factor * b[col];
+    }
+  }
+  x.assign(n, 0.0);
+  for (size_t row = n; row-- > 0;) {
+    double sum = b[row];
+    for (size_t k = row + 1; k < n; k++)
+      sum -= a[row][k] * x[k];
+    x[row] = sum / a[row][row];
+  }
+  return true;
+}
+
+bool CostModel::train(const std::vector<fs::path> &output_dirs,
+                      const std::string &metric, double ridge) {
+  std::vector<std::map<std::string, double>> rows;
+  std::vector<double> targets;
+  std::map<std::string, size_t> columns;
+  m_sources.clear();
+  for (const fs::path &output_dir : output_dirs) {
+    StoredRun run;
+    if (!ResultsStore::load_samples(output_dir, run)) {
+      std::cerr << "No results store in " << output_dir << ", skipped\n";
+      continue;
+    }
+    m_sources.push_back(output_dir.string());
+    for (const StoredKernel &kernel : run.kernels) {
+      auto value = kernel.averages.find(metric);
+      if (value == kernel.averages.end() || value->second <= 0.0)
+        continue;
+      rows.push_back(encode(features_of(kernel, run.primary_pipeline)));
+      targets.push_back(std::log(value->second));
+      for (const auto &[name, x] : rows.back())
+        columns.emplace(name, 0);
+    }
+  }
+  if (rows.empty()) {
+    std::cerr << "No kernel in the stores has a positive " << metric << "\n";
+    return false;
+  }
+
+  std::vector<std::string> names;
+  for (auto &[name, column] : columns) {
+    column = names.size();
+    names.push_back(name);
+  }
+  size_t n = names.size();
+  // Normal equations of the ridge, the bias unpenalised
+  std::vector<std::vector<double>> a(n, std::vector<double>(n, 0.0));
+  std::vector<double> b(n, 0.0);
+  for (size_t r = 0; r < rows.size(); r++) {
+    std::vector<std::pair<size_t, double>> x;
+    for (const auto &[name, value] : rows[r])
+      x.emplace_back(columns[name], value);
+    for (const auto &[i, xi] : x) {
+      b[i] += xi * targets[r];
+      for (const auto &[j, xj] : x)
+        a[i][j] += xi * xj;
+    }
+  }
+  for (size_t i = 0; i < n; i++)
+    if (names[i] != "bias")
+      a[i][i] += ridge;
+  std::vector<double> weights;
+  if (!solve(a, b, weights)) {
+    std::cerr << "The cost model is singular, raise --ridge\n";
+    return false;
+  }
+
+  m_metric = metric;
+  m_weights.clear();
+  for (size_t i = 0; i < n; i++)
+    m_weights[names[i]] = weights[i];
+  double mean = 0.0, residual_sum = 0.0, total_sum = 0.0;
+  for (double target : targets)
+    mean += target / targets.size();
+  for (size_t r = 0; r < rows.size(); r++) {
+    double predicted = 0.0;
+    for (const auto &[name, value] : rows[r])
+      predicted += m_weights[name] * value;
+    residual_sum += (targets[r] - predicted) * (targets[r] - predicted);
+    total_sum += (targets[r] - mean) * (targets[r] - mean);
+  }
+  m_kernels = rows.size();
+  m_residual_std = std::sqrt(residual_sum / rows.size());
+  m_r2 = total_sum > 0.0 ? 1.0 - residual_sum / total_sum : 0.0;
+  std::cout << "Cost model of " << metric << " over " << m_kernels
+            << " kernels and " << n << " features: R^2 " << m_r2
+            << ", residual std " << m_residual_std << " (log)\n";
+  return true;
+}
+
+bool CostModel::load(const fs::path &json_filepath) {
+  json model = load_json_from_file(json_filepath);
+  if (!model.is_object() || !model.contains("weights")) {
+    std::cerr << "Error: " << json_filepath << " is not a cost model\n";
+    return false;
+  }
+  m_metric = model.value("metric", std::string("cycles"));
+  m_weights = model["weights"].get<std::map<std::string, double>>();
+  m_residual_std = model.value("residual_std", 0.0);
+  m_r2 = model.value("r2", 0.0);
+  m_kernels = model.value("kernels", size_t(0));
+  m_sources = model.value("sources", std::vector<std::string>());
+  return true;
+}
+
+bool CostModel::save(const fs::path &json_filepath) const {
+  std::ofstream file(json_filepath);
+  if (!file.is_open()) {
+    std::cerr << "Error: Could not open " << json_filepath
+              << " for writing.\n";
+    return false;
+  }
+  json model = {{"metric", m_metric},
+                {"weights", m_weights},
+                {"residual_std", m_residual_std},
+                {"r2", m_r2},
+                {"kernels", m_kernels},
+                {"sources", m_sources},
+                {"trained", get_timestamp_string()}};
+  file << model.dump(1) << "\n";
+  std::cout << "Cost model written to " << json_filepath << "\n";
+  return true;
+}
+
+double CostModel::predict(const CostFeatures &features) const {
+  if (m_weights.empty())
+    return 0.0;
+  double log_value = 0.0;
+  for (const auto &[name, value] : encode(features)) {
+    auto weight = m_weights.find(name);
+    if (weight != m_weights.end())
+      log_value += weight->second * value;
+  }
+  return std::exp(log_value);
+}
+
+double CostModel::deviation(double predicted, double measured) const {
+  if (predicted <= 0.0 || measured <= 0.0)
+    return 0.0;
+  double distance = std::fabs(std::log(measured / predicted));
+  return m_residual_std > 0.0 ? distance / m_residual_std : 0.0;
+}
+
+size_t CostModel::write_check(const std::vector<KernelTask> &tasks,
+                              double tolerance,
+                              const fs::path &csv_filepath) const {
+  struct Check {
+    const KernelTask *task;
+    double measured, deviation;
+    bool flagged;
+  };
+  std::vector<Check> checks;
+  for (const KernelTask &task : tasks) {
+    auto measured = task.average_metrics.find(m_metric);
+    if (task.predicted_cost <= 0.0 || !task.measured ||
+        !task.failure.empty() || measured == task.average_metrics.end())
+      continue;
+    double ratio = measured->second / task.predicted_cost;
+    double deviation = CostModel::deviation(task.predicted_cost,
+                                            measured->second);
+    bool flagged = deviation > tolerance &&
+                   (ratio > MIN_FLAG_RATIO || ratio < 1.0 / MIN_FLAG_RATIO);
+    checks.push_back({&task, measured->second, deviation, flagged});
+  }
+  if (checks.empty())
+    return 0;
+  std::sort(checks.begin(), checks.end(),
+            [](const Check &a, const Check &b) {
+              return a.deviation > b.deviation;
+            });
+
+  std::ofstream csv(csv_filepath);
+  if (!csv.is_open()) {
+    std::cerr << "Error: Could not open " << csv_filepath
+              << " for writing.\n";
+    return 0;
+  }
+  size_t flagged = 0;
+  csv << "op_type,kernel,predicted,measured,ratio,deviation,flagged\n";
+  for (const Check &check : checks) {
+    const KernelTask &task = *check.task;
+    std::string kernel =
+        fs::path(task.mlir_filepath).replace_extension().filename().string();
+    csv << task.op_type << "," << kernel << "," << task.predicted_cost << ","
+        << check.measured << "," << check.measured / task.predicted_cost
+        << "," << check.deviation << "," << (check.flagged ? 1 : 0) << "\n";
+    if (check.flagged) {
+      flagged++;
+      std::cerr << "Cost model: " << task.op_type << "/" << kernel
+                << " measured " << check.measured << " " << m_metric
+                << ", predicted " << task.predicted_cost
+                << ", likely noise or a miscompilation\n";
+    }
+  }
+  std::cout << flagged << " of " << checks.size()
+            << " kernels far from the cost model, see " << csv_filepath
+            << "\n";
+  return flagged;
+}
@@ -0,0 +1,54 @@
+#include "counter_scheduler.h"
+#include "counter_session.h"
+#include "perfcpp/counter_definition.h"
+#include "perfcpp/hardware_info.h"
+
+#include <algorithm>
+#include <linux/perf_event.h>
+
+unsigned int CounterScheduler::default_counters() {
+  return perf::HardwareInfo::is_amd() ? 6 : 4;
+}
+
+bool CounterScheduler::uses_counter(const std::string &metric) {
+  if (CounterSession::is_time_metric(metric))
+    return false;
+  auto definitions = perf::CounterDefinition::global().counter(metric);
+  for (const auto &[pmu, event, config] : definitions)
+    if (config.type() == PERF_TYPE_SOFTWARE)
+      return false;
+  return true;
+}
+
+std::vector<std::vector<std::string>>
+CounterScheduler::partition(const std::vector<std::string> &metrics,
+                            unsigned int counters, std::string &anchor) {
+  std::vector<std::string> free_metrics;
+  std::vector<std::string> pmu_events;
+  for (const std::string &metric : metrics)
+    (CounterScheduler::uses_counter(metric) ? pmu_events : free_metrics)
+        .push_back(metric);
+
+  anchor.clear();
+  if (pmu_events.size() <= counters || counters < 2)
+    return {metrics};
+
+  for (const char *candidate : {"cycles", "instructions"})
+    if (anchor.empty() && std::count(pmu_events.begin(), pmu_events.end(),
+                                     std::string(candidate)))
+      anchor = candidate;
+  if (anchor.empty())
+    anchor = pmu_events.front();
+  pmu_events.erase(std::find(pmu_events.begin(), pmu_events.end(), anchor));
+
+  std::vector<std::vector<std::string>> batches;
+  for (size_t i = 0; i < pmu_events.size(); i += counters - 1) {
+    std::vector<std::string> batch =
+        batches.empty() ? free_metrics : std::vector<std::string>();
+    batch.push_back(anchor);
+    size_t end = std::min(pmu_events.size(), i + counters - 1);
+    batch.insert(batch.end(), pmu_events.begin() + i, pmu_events.begin() + end);
+    batches.push_back(batch);
+  }
+  return batches;
+}
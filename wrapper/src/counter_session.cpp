@@ -0,0 +1,313 @@
+#include "counter_session.h"
+#include "tsc_clock.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <exception>
+#include <iostream>
+
+CounterSession::CounterSession(CounterMode mode,
+                               const std::vector<std::string> &metrics,
+                               ThreadScope scope,
+                               const std::vector<std::vector<std::string>>
+                                   &event_groups)
+    : m_mode(mode), m_scope(scope), m_event_groups(event_groups) {
+  for (const std::string &metric : metrics)
+    (TscClock::is_metric(metric) ? m_tsc_metrics : m_metrics)
+        .push_back(metric);
+  m_perf = !m_metrics.empty() || !m_event_groups.empty();
+}
+
+CounterSession::~CounterSession() {
+  for (auto &core_counter : m_core_counters)
+    core_counter->close();
+  m_live.reset();
+  if (m_counter && m_mode != CounterMode::PER_SAMPLE) {
+    if (m_mode == CounterMode::LIVE)
+      m_counter->stop();
+    m_counter->close();
+  }
+}
+
+perf::Config CounterSession::counter_config() const {
+  perf::Config config;
+  config.include_child_threads(m_scope == ThreadScope::INHERIT);
+  return config;
+}
+
+void CounterSession::add_events(perf::EventCounter &counter,
+                                const std::vector<std::string> &metrics) const {
+  counter.add(metrics);
+  for (const std::vector<std::string> &group : m_event_groups)
+    counter.add(group, perf::EventCounter::Schedule::Group);
+}
+
+bool CounterSession::is_time_metric(const std::string &metric) {
+  return metric == "seconds" || metric == "milliseconds" ||
+         metric == "microseconds" || metric == "nanoseconds" ||
+         TscClock::is_metric(metric);
+}
+
+double CounterSession::seconds_per_unit(const std::string &metric) {
+  if (metric == "seconds")
+    return 1.0;
+  if (metric == "milliseconds")
+    return 1e-3;
+  if (metric == "microseconds")
+    return 1e-6;
+  if (metric == "nanoseconds" || TscClock::is_metric(metric))
+    return 1e-9;
+  return 0.0;
+}
+
+double CounterSession::elapsed_in_unit(const std::string &metric) const {
+  double nanoseconds =
+      std::chrono::duration<double, std::nano>(m_stop - m_start).count();
+  if (metric == "seconds")
+    return nanoseconds / 1e9;
+  if (metric == "milliseconds")
+    return nanoseconds / 1e6;
+  if (metric == "microseconds")
+    return nanoseconds / 1e3;
+  return nanoseconds;
+}
+
+bool CounterSession::open_per_core() {
+  perf::Config config;
+  config.process(perf::Process::Any);
+
+  std::vector<std::string> hardware_metrics;
+  for (const std::string &metric : m_metrics)
+    if (!CounterSession::is_time_metric(metric))
+      hardware_metrics.push_back(metric);
+
+  try {
+    for (int cpu = 0; cpu < get_online_cpu_count(); cpu++) {
+      config.cpu_core(static_cast<std::uint16_t>(cpu));
+      auto counter = std::make_unique<perf::EventCounter>(config);
+      add_events(*counter, hardware_metrics);
+      counter->open();
+      m_core_counters.push_back(std::move(counter));
+      m_core_ids.push_back(cpu);
+    }
+  } catch (const std::exception &err) {
+    std::cerr << "Per core counters unavailable (" << err.what()
+              << "), needs perf_event_paranoid <= 0 or root\n";
+    m_core_counters.clear();
+    m_core_ids.clear();
+    return false;
+  }
+  return true;
+}
+
+bool CounterSession::open() {
+  if (!m_tsc_metrics.empty()) {
+    if (!TscClock::invariant())
+      std::cerr << "No invariant TSC, " << TscClock::METRIC
+                << " follows the core clock\n";
+    // Calibrated here rather than inside the first window
+    TscClock::ns_per_tick();
+  }
+  if (!m_perf)
+    return true;
+
+  if (m_scope == ThreadScope::PER_CORE) {
+    if (open_per_core())
+      return true;
+    m_scope = ThreadScope::INHERIT;
+  }
+
+  // rdpmc only sees the calling thread
+  if (m_mode == CounterMode::LIVE && m_scope == ThreadScope::INHERIT) {
+    std::cerr << "Live counters can't follow child threads, using a counter "
+                 "session\n";
+    m_mode = CounterMode::SESSION;
+  }
+
+  // Grouped events (topdown slots) aren't read through rdpmc
+  if (m_mode == CounterMode::LIVE && !m_event_groups.empty()) {
+    std::cerr << "Live counters can't read metric groups, using a counter "
+                 "session\n";
+    m_mode = CounterMode::SESSION;
+  }
+
+  if (m_mode == CounterMode::PER_SAMPLE)
+    return true;
+
+  if (m_mode == CounterMode::LIVE) {
+#if defined(__x86_64__) || defined(__i386__)
+    try {
+      m_counter = std::make_unique<perf::EventCounter>();
+      std::vector<std::string> hardware_metrics;
+      for (const std::string &metric : m_metrics)
+        if (!CounterSession::is_time_metric(metric))
+          hardware_metrics.push_back(metric);
+      m_counter->add_live(std::move(hardware_metrics));
+      if (!m_counter->start())
+        throw std::runtime_error("could not start live counters");
+      m_live = std::make_unique<perf::LiveEventCounter>(*m_counter);
+      return true;
+    } catch (const std::exception &err) {
+      std::cerr << "Live counters unavailable (" << err.what()
+                << "), using a counter session\n";
+    }
+#else
+    std::cerr << "Live counters need rdpmc (x86), using a counter session\n";
+#endif
+    m_live.reset();
+    m_counter.reset();
+    m_mode = CounterMode::SESSION;
+  }
+
+  try {
+    m_counter = std::make_unique<perf::EventCounter>(counter_config());
+    add_events(*m_counter, m_metrics);
+    m_counter->open();
+  } catch (const std::exception &err) {
+    std::cerr << "Failed to open counters: " << err.what() << std::endl;
+    m_counter.reset();
+    if (m_tsc_metrics.empty())
+      return false;
+    std::cerr << "Counting " << TscClock::METRIC << " only\n";
+    m_metrics.clear();
+    m_event_groups.clear();
+    m_perf = false;
+  }
+  return true;
+}
+
+void CounterSession::start() {
+  start_perf();
+  if (!m_tsc_metrics.empty())
+    m_tsc_start = TscClock::start();
+}
+
+void CounterSession::stop() {
+  if (!m_tsc_metrics.empty())
+    m_tsc_stop = TscClock::stop();
+  stop_perf();
+}
+
+void CounterSession::start_perf() {
+  if (!m_perf)
+    return;
+
+  if (m_scope == ThreadScope::PER_CORE) {
+    m_start = std::chrono::steady_clock::now();
+    for (auto &core_counter : m_core_counters)
+      core_counter->start();
+    return;
+  }
+
+  switch (m_mode) {
+  case CounterMode::PER_SAMPLE:
+    m_counter = std::make_unique<perf::EventCounter>(counter_config());
+    add_events(*m_counter, m_metrics);
+    m_counter->start();
+    break;
+  case CounterMode::SESSION:
+    m_counter->start();
+    break;
+  case CounterMode::LIVE:
+    m_start = std::chrono::steady_clock::now();
+    m_live->start();
+    break;
+  }
+}
+
+void CounterSession::stop_perf() {
+  if (!m_perf)
+    return;
+
+  if (m_scope == ThreadScope::PER_CORE) {
+    for (auto &core_counter : m_core_counters)
+      core_counter->stop();
+    m_stop = std::chrono::steady_clock::now();
+    return;
+  }
+
+  switch (m_mode) {
+  case CounterMode::PER_SAMPLE:
+  case CounterMode::SESSION:
+    m_counter->stop();
+    break;
+  case CounterMode::LIVE:
+    m_live->stop();
+    m_stop = std::chrono::steady_clock::now();
+    break;
+  }
+}
+
+perf::CounterResult CounterSession::result(uint64_t normalization) const {
+  perf::CounterResult result = perf_result(normalization);
+  for (const std::string &metric : m_tsc_metrics)
+    result.emplace_back(metric, static_cast<double>(m_tsc_stop - m_tsc_start) *
+                                    TscClock::ns_per_tick() / normalization);
+  return result;
+}
+
+perf::CounterResult
+CounterSession::perf_result(uint64_t normalization) const {
+  if (!m_perf)
+    return perf::CounterResult();
+
+  // Whole kernel: sum over every core
+  if (m_scope == ThreadScope::PER_CORE) {
+    std::map<std::string, double> totals;
+    for (const auto &core : core_results(normalization))
+      for (const auto &[metric, value] : core)
+        totals[metric] += value;
+
+    perf::CounterResult result;
+    for (const std::string &metric : m_metrics)
+      result.emplace_back(metric, CounterSession::is_time_metric(metric)
+                                      ? elapsed_in_unit(metric) / normalization
+                                      : totals[metric]);
+    for (const std::vector<std::string> &group : m_event_groups)
+      for (const std::string &event : group)
+        result.emplace_back(event, totals[event]);
+    return result;
+  }
+
+  if (m_mode != CounterMode::LIVE)
+    return m_counter->result(normalization);
+
+  perf::CounterResult result;
+  for (const std::string &metric : m_metrics)
+    result.emplace_back(metric,
+                        CounterSession::is_time_metric(metric)
+                            ? elapsed_in_unit(metric) / normalization
+                            : m_live->get(metric, normalization));
+  return result;
+}
+
+std::vector<std::map<std::string, double>>
+CounterSession::core_results(uint64_t normalization) const {
+  std::vector<std::map<std::string, double>> cores;
+  for (const auto &core_counter : m_core_counters) {
+    std::map<std::string, double> core;
+    for (const auto &[metric, value] : core_counter->result(normalization))
+      core[std::string(metric)] = value;
+    cores.push_back(core);
+  }
+  return cores;
+}
+
+std::map<std::string, double>
+CounterSession::measure_overhead(unsigned int iterations) {
+  std::map<std::string, std::vector<double>> windows;
+  for (unsigned int i = 0; i < iterations; i++) {
+    start();
+    stop();
+    for (const auto &[name, value] : result())
+      windows[std::string(name)].push_back(value);
+  }
+
+  std::map<std::string, double> overhead;
+  for (auto &[name, values] : windows) {
+    std::nth_element(values.begin(), values.begin() + values.size() / 2,
+                     values.end());
+    overhead[name] = values[values.size() / 2];
+  }
+  return overhead;
+}
@@ -0,0 +1,155 @@
+#include "cpu_environment.h"
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+static std::string read_first_line(const std::string &path) {
+  std::ifstream file(path);
+  std::string line;
+  if (!file.is_open() || !std::getline(file, line))
+    return "";
+  return line;
+}
+
+static std::string cpufreq_path(int cpu, const std::string &entry) {
+  return "/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/cpufreq/" +
+         entry;
+}
+
+std::string CPUEnvironment::governor(int cpu) {
+  std::string governor = read_first_line(cpufreq_path(cpu, "scaling_governor"));
+  return governor.empty() ? "unknown" : governor;
+}
+
+std::string CPUEnvironment::turbo_state() {
+  std::string no_turbo =
+      read_first_line("/sys/devices/system/cpu/intel_pstate/no_turbo");
+  if (!no_turbo.empty())
+    return no_turbo == "1" ? "off" : "on";
+
+  std::string boost = read_first_line("/sys/devices/system/cpu/cpufreq/boost");
+  if (!boost.empty())
+    return boost == "1" ? "on" : "off";
+  return "unknown";
+}
+
+double CPUEnvironment::current_frequency_mhz(int cpu) {
+  std::string khz = read_first_line(cpufreq_path(cpu, "scaling_cur_freq"));
+  try {
+    return khz.empty() ? 0.0 : std::stod(khz) / 1000.0;
+  } catch (const std::exception &) {
+    return 0.0;
+  }
+}
+
+void CPUEnvironment::check_measurement_cpu(int cpu) {
+  std::string governor = CPUEnvironment::governor(cpu);
+  std::string turbo = CPUEnvironment::turbo_state();
+  std::cout << "Measurement CPU " << cpu << ": governor " << governor
+            << ", turbo " << turbo << ", "
+            << CPUEnvironment::current_frequency_mhz(cpu) << " MHz\n";
+
+  if (governor != "performance" && governor != "unknown")
+    std::cerr << "Warning: CPU " << cpu << " uses the '" << governor
+              << "' governor, frequencies will drift. Consider "
+                 "`cpupower frequency-set -g performance`\n";
+  if (turbo == "on")
+    std::cerr << "Warning: turbo boost is enabled, results depend on "
+                 "thermal headroom\n";
+}
+
+#ifdef __linux__
+
+ScopedRealtimePriority::ScopedRealtimePriority(bool enable, int priority) {
+  if (!enable)
+    return;
+
+  sched_param previous{};
+  pthread_getschedparam(pthread_self(), &m_previous_policy, &previous);
+  m_previous_priority = previous.sched_priority;
+
+  sched_param param{};
+  param.sched_priority = priority;
+  int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+  if (err != 0) {
+    std::cerr << "Failed to enable SCHED_FIFO: " << std::strerror(err)
+              << " (needs root or CAP_SYS_NICE)\n";
+    return;
+  }
+  m_active = true;
+}
+
+ScopedRealtimePriority::~ScopedRealtimePriority() {
+  if (!m_active)
+    return;
+  sched_param previous{};
+  previous.sched_priority = m_previous_priority;
+  pthread_setschedparam(pthread_self(), m_previous_policy, &previous);
+}
+
+#else
+
+ScopedRealtimePriority::ScopedRealtimePriority(bool enable, int priority) {
+  if (enable)
+    std::cerr << "SCHED_FIFO is only supported on Linux\n";
+}
+
+ScopedRealtimePriority::~ScopedRealtimePriority() {}
+
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+
+static const uint32_t MXCSR_FTZ_DAZ = 0x8040; // FTZ (bit 15) | DAZ (bit 6)
+
+ScopedFloatMode::ScopedFloatMode(bool flush_denormals) {
+  uint32_t mxcsr = _mm_getcsr();
+  m_previous = mxcsr;
+  _mm_setcsr(flush_denormals ? (mxcsr | MXCSR_FTZ_DAZ)
+                             : (mxcsr & ~MXCSR_FTZ_DAZ));
+  m_active = true;
+}
+
+ScopedFloatMode::~ScopedFloatMode() {
+  if (m_active)
+    _mm_setcsr(static_cast<uint32_t>(m_previous));
+}
+
+#elif defined(__aarch64__)
+
+static const uint64_t FPCR_FZ = 1ull << 24;
+
+ScopedFloatMode::ScopedFloatMode(bool flush_denormals) {
+  uint64_t fpcr;
+  __asm__ volatile("mrs %0, fpcr" : "=r"(fpcr));
+  m_previous = fpcr;
+  fpcr = flush_denormals ? (fpcr | FPCR_FZ) : (fpcr & ~FPCR_FZ);
+  __asm__ volatile("msr fpcr, %0" : : "r"(fpcr));
+  m_active = true;
+}
+
+ScopedFloatMode::~ScopedFloatMode() {
+  if (m_active)
+    __asm__ volatile("msr fpcr, %0" : : "r"(m_previous));
+}
+
+#else
+
+ScopedFloatMode::ScopedFloatMode(bool flush_denormals) {
+  if (flush_denormals)
+    std::cerr << "--ftz-daz is only supported on x86-64 and AArch64\n";
+}
+
+ScopedFloatMode::~ScopedFloatMode() {}
+
+#endif
@@ -0,0 +1,399 @@
+#include "data_order.h"
+
+#include <cctype>
+#include <iostream>
+#include <regex>
+#include <set>
+#include <sstream>
+
+// Torch value tensor type, !torch.vtensor<[1,3,224,224],f32>
+static const std::regex
+    VTENSOR_TYPE(R"(!torch\.vtensor<\[([^\]]*)\],([^>]+)>)");
+static const std::regex KERNEL_ARG(
+    R"(%(arg\d+)\s*:\s*!torch\.vtensor<\[([^\]]*)\],([^>]+)>)");
+static const std::regex RETURN_OP(R"((func\.)?return\s+([^:\n]+):\s*([^\n]+))");
+
+static uint64_t channel_block(DataOrder order) {
+  return order == DataOrder::NCHW8C ? 8 : order == DataOrder::NCHW16C ? 16 : 1;
+}
+
+static bool parse_dims(const std::string &list, std::vector<uint64_t> &dims) {
+  dims.clear();
+  std::stringstream ss(list);
+  std::string dim;
+  while (std::getline(ss, dim, ',')) {
+    if (dim.empty() ||
+        dim.find_first_not_of("0123456789 ") != std::string::npos)
+      return false;
+    dims.push_back(std::stoull(dim));
+  }
+  return true;
+}
+
+static std::string vtensor(const std::vector<uint64_t> &dims,
+                           const std::string &dtype) {
+  std::string type = "!torch.vtensor<[";
+  for (size_t i = 0; i < dims.size(); i++)
+    type += (i ? "," : "") + std::to_string(dims[i]);
+  return type + "]," + dtype + ">";
+}
+
+// Splits "a, b" at the commas outside of <> and ()
+static std::vector<std::string> split_top_level(const std::string &list) {
+  std::vector<std::string> items(1);
+  int depth = 0;
+  for (char c : list) {
+    if (c == '<' || c == '(' || c == '[')
+      depth++;
+    else if (c == '>' || c == ')' || c == ']')
+      depth--;
+    if (c == ',' && depth == 0) {
+      items.emplace_back();
+      continue;
+    }
+    if (!(items.back().empty() && c == ' '))
+      items.back() += c;
+  }
+  for (std::string &item : items)
+    while (!item.empty() && std::isspace(static_cast<unsigned char>(
+                                item.back())))
+      item.pop_back();
+  return items;
+}
+
+/*
+ * Conversion ops of one kernel, with the integer constants they share
+ * emitted once at the kernel entry
+ */
+namespace {
+struct ConversionEmitter {
+  std::set<uint64_t> constants;
+  unsigned int next_value = 0;
+
+  std::string fresh() { return "%do_" + std::to_string(next_value++); }
+
+  std::string int_list(const std::vector<uint64_t> &values,
+                       std::string &ops) {
+    std::string name = fresh();
+    std::string operands, types;
+    for (size_t i = 0; i < values.size(); i++) {
+      constants.insert(values[i]);
+      operands += (i ? ", " : "") + std::string("%do_int") +
+                  std::to_string(values[i]);
+      types += (i ? ", " : "") + std::string("!torch.int");
+    }
+    ops += "    " + name + " = torch.prim.ListConstruct " + operands +
+           " : (" + types + ") -> !torch.list<int>\n";
+    return name;
+  }
+
+  // op is torch.aten.permute or torch.aten.reshape
+  std::string apply(const std::string &op, const std::string &value,
+                    const std::string &from_type,
+                    const std::vector<uint64_t> &list,
+                    const std::string &to_type, std::string &ops,
+                    const std::string &name = "") {
+    std::string operand = int_list(list, ops);
+    std::string result = name.empty() ? fresh() : name;
+    ops += "    " + result + " = " + op + " " + value + ", " + operand +
+           " : " + from_type + ", !torch.list<int> -> " + to_type + "\n";
+    return result;
+  }
+
+  std::string constant_ops() const {
+    std::string ops;
+    for (uint64_t value : constants)
+      ops += "    %do_int" + std::to_string(value) +
+             " = torch.constant.int " + std::to_string(value) + "\n";
+    return ops;
+  }
+
+  // Stored tensor `value` into logical NCHW, named `name`
+  void to_logical(DataOrder order, const std::string &value,
+                  const std::vector<uint64_t> &logical,
+                  const std::string &dtype, const std::string &name,
+                  std::string &ops) {
+    std::vector<uint64_t> stored;
+    DataOrders::stored_shape(order, logical, stored);
+    std::string stored_type = vtensor(stored, dtype);
+    std::string logical_type = vtensor(logical, dtype);
+    if (order == DataOrder::NCWH)
+      apply("torch.aten.permute", value, stored_type, {0, 1, 3, 2},
+            logical_type, ops, name);
+    else if (order == DataOrder::NHWC)
+      apply("torch.aten.permute", value, stored_type, {0, 3, 1, 2},
+            logical_type, ops, name);
+    else {
+      uint64_t block = channel_block(order);
+      std::string split_type = vtensor(
+          {logical[0], logical[1] / block, block, logical[2], logical[3]},
+          dtype);
+      std::string split = apply("torch.aten.permute", value, stored_type,
+                                {0, 1, 4, 2, 3}, split_type, ops);
+      apply("torch.aten.reshape", split, split_type, logical, logical_type,
+            ops, name);
+    }
+  }
+
+  // Logical NCHW tensor `value` into `order`, returns the stored value
+  std::string from_logical(DataOrder order, const std::string &value,
+                           const std::vector<uint64_t> &logical,
+                           const std::string &dtype, std::string &ops) {
+    std::vector<uint64_t> stored;
+    DataOrders::stored_shape(order, logical, stored);
+    std::string stored_type = vtensor(stored, dtype);
+    std::string logical_type = vtensor(logical, dtype);
+    if (order == DataOrder::NCWH)
+      return apply("torch.aten.permute", value, logical_type, {0, 1, 3, 2},
+                   stored_type, ops);
+    if (order == DataOrder::NHWC)
+      return apply("torch.aten.permute", value, logical_type, {0, 2, 3, 1},
+                   stored_type, ops);
+    uint64_t block = channel_block(order);
+    std::vector<uint64_t> split_dims = {logical[0], logical[1] / block, block,
+                                        logical[2], logical[3]};
+    std::string split_type = vtensor(split_dims, dtype);
+    std::string split = apply("torch.aten.reshape", value, logical_type,
+                              split_dims, split_type, ops);
+    return apply("torch.aten.permute", split, split_type, {0, 1, 3, 4, 2},
+                 stored_type, ops);
+  }
+};
+} // namespace
+
+bool DataOrders::parse(const std::string &name, DataOrder &order) {
+  for (DataOrder candidate : {DataOrder::NCHW, DataOrder::NCWH,
+                              DataOrder::NHWC, DataOrder::NCHW8C,
+                              DataOrder::NCHW16C})
+    if (DataOrders::describe(candidate) == name) {
+      order = candidate;
+      return true;
+    }
+  return false;
+}
+
+std::string DataOrders::describe(DataOrder order) {
+  switch (order) {
+  case DataOrder::NCWH:
+    return "ncwh";
+  case DataOrder::NHWC:
+    return "nhwc";
+  case DataOrder::NCHW8C:
+    return "nchw8c";
+  case DataOrder::NCHW16C:
+    return "nchw16c";
+  case DataOrder::NCHW:
+  default:
+    return "nchw";
+  }
+}
+
+std::vector<DataOrder> DataOrders::parse_list(const std::string &spec) {
+  std::vector<DataOrder> orders;
+  std::stringstream ss(spec);
+  std::string name;
+  while (std::getline(ss, name, ',')) {
+    DataOrder order;
+    if (name.empty())
+      continue;
+    if (!DataOrders::parse(name, order)) {
+      std::cerr << "Unknown data order '" << name << "', skipping it\n";
+      continue;
+    }
+    // The model's kernels are NCHW already
+    if (order != DataOrder::NCHW)
+      orders.push_back(order);
+  }
+  return orders;
+}
+
+bool DataOrders::stored_shape(DataOrder order,
+                              const std::vector<uint64_t> &logical,
+                              std::vector<uint64_t> &stored) {
+  if (logical.size() != 4)
+    return false;
+  uint64_t n = logical[0], c = logical[1], h = logical[2], w = logical[3];
+  uint64_t block = channel_block(order);
+  switch (order) {
+  case DataOrder::NCWH:
+    stored = {n, c, w, h};
+    return true;
+  case DataOrder::NHWC:
+    stored = {n, h, w, c};
+    return true;
+  case DataOrder::NCHW8C:
+  case DataOrder::NCHW16C:
+    if (c % block != 0)
+      return false;
+    stored = {n, c / block, h, w, block};
+    return true;
+  default:
+    stored = logical;
+    return true;
+  }
+}
+
+bool DataOrders::logical_shape(DataOrder order,
+                               const std::vector<uint64_t> &stored,
+                               std::vector<uint64_t> &logical) {
+  uint64_t block = channel_block(order);
+  switch (order) {
+  case DataOrder::NCWH:
+    if (stored.size() != 4)
+      return false;
+    logical = {stored[0], stored[1], stored[3], stored[2]};
+    return true;
+  case DataOrder::NHWC:
+    if (stored.size() != 4)
+      return false;
+    logical = {stored[0], stored[3], stored[1], stored[2]};
+    return true;
+  case DataOrder::NCHW8C:
+  case DataOrder::NCHW16C:
+    if (stored.size() != 5 || stored[4] != block)
+      return false;
+    logical = {stored[0], stored[1] * block, stored[2], stored[3]};
+    return true;
+  default:
+    if (stored.size() != 4)
+      return false;
+    logical = stored;
+    return true;
+  }
+}
+
+uint64_t DataOrders::stored_index(DataOrder order,
+                                  const std::vector<uint64_t> &logical,
+                                  uint64_t n, uint64_t c, uint64_t h,
+                                  uint64_t w) {
+  uint64_t C = logical[1], H = logical[2], W = logical[3];
+  uint64_t block = channel_block(order);
+  switch (order) {
+  case DataOrder::NCWH:
+    return ((n * C + c) * W + w) * H + h;
+  case DataOrder::NHWC:
+    return ((n * H + h) * W + w) * C + c;
+  case DataOrder::NCHW8C:
+  case DataOrder::NCHW16C:
+    return (((n * (C / block) + c / block) * H + h) * W + w) * block +
+           c % block;
+  default:
+    return ((n * C + c) * H + h) * W + w;
+  }
+}
+
+bool DataOrders::rewrite_kernel(const std::string &mlir_text, DataOrder order,
+                                std::string &rewritten,
+                                std::vector<size_t> &converted_args) {
+  converted_args.clear();
+  size_t func_pos = mlir_text.find("@kernel_call(");
+  if (func_pos == std::string::npos || order == DataOrder::NCHW)
+    return false;
+  size_t args_open = mlir_text.find('(', func_pos);
+  size_t args_close = args_open;
+  for (int depth = 0; args_close < mlir_text.size(); args_close++) {
+    if (mlir_text[args_close] == '(')
+      depth++;
+    else if (mlir_text[args_close] == ')' && --depth == 0)
+      break;
+  }
+  size_t body_open = mlir_text.find('{', args_close);
+  if (args_close >= mlir_text.size() || body_open == std::string::npos)
+    return false;
+
+  ConversionEmitter emitter;
+  std::string prologue;
+
+  // Arguments: stored type in the signature, NCHW value for the body
+  std::string signature =
+      mlir_text.substr(args_open, args_close - args_open);
+  std::string new_signature;
+  std::vector<std::string> converted_names;
+  std::vector<uint64_t> first;
+  size_t copied = 0, arg_index = 0;
+  for (auto it = std::sregex_iterator(signature.begin(), signature.end(),
+                                      KERNEL_ARG);
+       it != std::sregex_iterator(); ++it, arg_index++) {
+    std::vector<uint64_t> dims, stored;
+    if (!parse_dims((*it)[2].str(), dims))
+      return false;
+    if (arg_index == 0)
+      first = dims;
+    if (dims.size() != 4 || dims != first ||
+        !DataOrders::stored_shape(order, dims, stored))
+      continue;
+
+    std::string name = "%" + (*it)[1].str();
+    std::string dtype = (*it)[3].str();
+    new_signature += signature.substr(copied, it->position(0) - copied);
+    new_signature += name + ": " + vtensor(stored, dtype);
+    copied = it->position(0) + it->length(0);
+    emitter.to_logical(order, name, dims, dtype, name + "_nchw", prologue);
+    converted_names.push_back(name);
+    converted_args.push_back(arg_index);
+  }
+  new_signature += signature.substr(copied);
+
+  // Results of the same batch: converted right before the return
+  std::string result_types =
+      mlir_text.substr(args_close, body_open - args_close);
+  std::string body = mlir_text.substr(body_open + 1);
+  for (const std::string &name : converted_names)
+    body = std::regex_replace(
+        body, std::regex(name + R"((?![0-9A-Za-z_$.\-]))"), name + "_nchw");
+
+  std::smatch return_match;
+  for (auto it = std::sregex_iterator(body.begin(), body.end(), RETURN_OP);
+       it != std::sregex_iterator(); ++it)
+    return_match = *it;
+  bool results_converted = false;
+  std::string new_body = body;
+  if (!return_match.empty() && !first.empty()) {
+    std::vector<std::string> operands =
+        split_top_level(return_match[2].str());
+    std::vector<std::string> types = split_top_level(return_match[3].str());
+    std::string epilogue;
+    for (size_t r = 0; r < operands.size() && r < types.size(); r++) {
+      std::smatch type_match;
+      std::vector<uint64_t> dims, stored;
+      if (!std::regex_match(types[r], type_match, VTENSOR_TYPE) ||
+          !parse_dims(type_match[1].str(), dims) || dims.size() != 4 ||
+          dims[0] != first[0] ||
+          !DataOrders::stored_shape(order, dims, stored))
+        continue;
+      std::string dtype = type_match[2].str();
+      operands[r] =
+          emitter.from_logical(order, operands[r], dims, dtype, epilogue);
+      types[r] = vtensor(stored, dtype);
+      results_converted = true;
+    }
+
+    if (results_converted) {
+      std::string operand_list, type_list;
+      for (size_t r = 0; r < operands.size(); r++)
+        operand_list += (r ? ", " : "") + operands[r];
+      for (size_t r = 0; r < types.size(); r++)
+        type_list += (r ? ", " : "") + types[r];
+      // The function type lists the returned types in the same order
+      result_types = ") -> " +
+                     (types.size() > 1 ? "(" + type_list + ")" : type_list) +
+                     " ";
+      size_t line_start = body.rfind('\n', return_match.position(0));
+      line_start = line_start == std::string::npos ? 0 : line_start + 1;
+      new_body = body.substr(0, line_start) + epilogue +
+                 body.substr(line_start,
+                             return_match.position(0) - line_start) +
+                 return_match[1].str() + "return " + operand_list + " : " +
+                 type_list + body.substr(return_match.position(0) +
+                                         return_match.length(0));
+    }
+  }
+  if (converted_args.empty() && !results_converted)
+    return false;
+
+  if (!new_body.empty() && new_body[0] == '\n')
+    new_body.erase(0, 1);
+  rewritten = mlir_text.substr(0, args_open) + new_signature + result_types +
+              "{\n" + emitter.constant_ops() + prologue + new_body;
+  return true;
+}
@@ -0,0 +1,469 @@
+#include "distributed.h"
+#include "activation_stats.h"
+#include "cache_evictor.h"
+#include "data_order.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <sys/utsname.h>
+#include <thread>
+#include <unistd.h>
+
+static const char *MANIFEST_NAME = "manifest.json";
+static const char *FINGERPRINT_NAME = "fingerprint.json";
+
+// Single quoted for the remote shell
+static std::string quote(const std::string &arg) {
+  std::string quoted = "'";
+  for (char c : arg)
+    quoted += c == '\'' ? std::string("'\\''") : std::string(1, c);
+  return quoted + "'";
+}
+
+// Runs `command` with its output appended to `log`, true on exit status 0
+static bool run_logged(const std::string &command, const fs::path &log) {
+  {
+    std::ofstream log_file(log, std::ios::app);
+    log_file << "$ " << command << "\n";
+  }
+  return std::system((command + " >> " + quote(log.string()) + " 2>&1")
+                         .c_str()) == 0;
+}
+
+static std::string read_text(const fs::path &filepath) {
+  std::ifstream file(filepath);
+  std::stringstream contents;
+  contents << file.rdbuf();
+  return contents.str();
+}
+
+json Distributed::fingerprint() {
+  json fingerprint;
+  char hostname[256] = {};
+  gethostname(hostname, sizeof(hostname) - 1);
+  fingerprint["hostname"] = hostname;
+
+  std::ifstream cpuinfo("/proc/cpuinfo");
+  for (std::string line; std::getline(cpuinfo, line);)
+    if (line.rfind("model name", 0) == 0) {
+      fingerprint["cpu_model"] = line.substr(line.find(':') + 2);
+      break;
+    }
+  fingerprint["logical_cpus"] = get_online_cpu_count();
+  fingerprint["caches"] = json::array();
+  for (const CacheLevel &cache : CacheEvictor::cache_levels())
+    fingerprint["caches"].push_back(
+        {{"level", cache.level}, {"bytes", cache.bytes}});
+  fingerprint["memory_bytes"] = static_cast<uint64_t>(sysconf(_SC_PHYS_PAGES)) *
+                                static_cast<uint64_t>(sysconf(_SC_PAGE_SIZE));
+
+  struct utsname system;
+  if (uname(&system) == 0) {
+    fingerprint["kernel_release"] = system.release;
+    fingerprint["machine"] = system.machine;
+  }
+  return fingerprint;
+}
+
+std::string Distributed::fingerprint_id(const json &fingerprint) {
+  // Identical machines share an id, whatever their names
+  json hardware = fingerprint;
+  hardware.erase("hostname");
+  return hash_to_hex(hash_string(hardware.dump())).substr(0, 12);
+}
+
+bool Distributed::read_shard(const fs::path &shard_dir,
+                             std::vector<KernelTask> &tasks) {
+  fs::path manifest_filepath = fs::path(shard_dir).append(MANIFEST_NAME);
+  if (!fs::exists(manifest_filepath)) {
+    std::cerr << "Error: No shard manifest at " << manifest_filepath << "\n";
+    return false;
+  }
+  json manifest = load_json_from_file(manifest_filepath);
+  for (const json &kernel : manifest["kernels"]) {
+    KernelTask task;
+    task.op_type = kernel["op_type"].get<std::string>();
+    task.mlir_filepath =
+        fs::path(shard_dir).append(kernel["mlir"].get<std::string>());
+    task.json_filepath =
+        fs::path(shard_dir).append(kernel["json"].get<std::string>());
+    task.shape_variant = kernel.value("shape_variant", "");
+    task.multiplicity = kernel.value("multiplicity", 1u);
+    DataOrders::parse(kernel.value("data_order", "nchw"), task.data_order);
+    if (kernel.contains("object"))
+      task.cross_object =
+          fs::path(shard_dir).append(kernel["object"].get<std::string>());
+    task.metadata_ready = true;
+    tasks.push_back(task);
+  }
+  return true;
+}
+
+bool Distributed::write_worker_result(const fs::path &shard_dir, size_t index,
+                                      const SandboxResult *result,
+                                      const std::string &failure) {
+  fs::path results_dir = fs::path(shard_dir).append("results");
+  fs::create_directories(results_dir);
+  fs::path filepath = fs::path(results_dir).append(
+      std::to_string(index) + (result ? ".samples" : ".failure"));
+  std::ofstream out(filepath);
+  if (!out.is_open()) {
+    std::cerr << "Error: Could not open " << filepath << " for writing.\n";
+    return false;
+  }
+  out << (result ? KernelSandbox::serialize(*result) : failure);
+  return true;
+}
+
+namespace {
+struct Shard {
+  size_t id = 0;
+  std::vector<size_t> tasks; // indices into the coordinator's tasks
+  std::set<std::string> failed_on; // hosts it isn't given to again
+};
+
+struct NodeState {
+  std::string host;
+  unsigned int failures = 0;
+  bool alive = true;
+  bool files_shipped = false;
+  std::string fingerprint_id;
+};
+} // namespace
+
+// Unique per coordinator run, so runs sharing a worker never share a folder
+static std::string run_id(const fs::path &output_dir) {
+  char hostname[256] = {};
+  gethostname(hostname, sizeof(hostname) - 1);
+  std::string run =
+      std::string(hostname) + ":" + std::to_string(getpid()) + ":" +
+      std::to_string(
+          std::chrono::system_clock::now().time_since_epoch().count()) +
+      ":" + fs::absolute(output_dir).string();
+  return fs::path(output_dir).filename().string() + "-" +
+         hash_to_hex(hash_string(run)).substr(0, 12);
+}
+
+/*
+ * Forwarded args naming local files or folders (--tensor-source,
+ * --verify-against, ...) point into <remote_root>/files on the workers. The
+ * paths are staged in <staging>/files/<n>/ for every node to fetch once.
+ * The model is left alone, workers only record its name.
+ */
+static std::vector<std::string>
+stage_forwarded_paths(const DistributedConfig &config, const fs::path &staging,
+                      const fs::path &remote_root) {
+  std::vector<std::string> remote_args;
+  size_t staged = 0;
+  for (const std::string &arg : config.forwarded_args) {
+    // Flag values only, --flag=value or the arg after a flag
+    bool inline_value = arg.rfind("--", 0) == 0 && arg.find('=') != arg.npos;
+    if (arg.rfind("-", 0) == 0 && !inline_value) {
+      remote_args.push_back(arg);
+      continue;
+    }
+    std::string prefix = inline_value ? arg.substr(0, arg.find('=') + 1) : "";
+    fs::path local = arg.substr(prefix.size());
+    std::error_code error;
+    if (arg == config.model_file || local.empty() ||
+        !fs::exists(local, error)) {
+      remote_args.push_back(arg);
+      continue;
+    }
+    fs::path folder = fs::path("files") / std::to_string(staged++);
+    fs::path name = fs::absolute(local).lexically_normal().filename();
+    if (name.empty())
+      name = fs::absolute(local).lexically_normal().parent_path().filename();
+    fs::create_directories(staging / folder, error);
+    fs::copy(local, staging / folder / name,
+             fs::copy_options::recursive | fs::copy_options::overwrite_existing,
+             error);
+    if (error) {
+      std::cerr << "Error: Could not stage " << local << " for the workers: "
+                << error.message() << "\n";
+      remote_args.push_back(arg);
+      continue;
+    }
+    remote_args.push_back(prefix + (remote_root / folder / name).string());
+  }
+  return remote_args;
+}
+
+// Local copy of a shard: manifest, kernels and pipeline
+static bool stage_shard(const Shard &shard,
+                        const std::vector<KernelTask> &tasks,
+                        const fs::path &pipeline_json,
+                        const fs::path &shard_dir) {
+  fs::create_directories(shard_dir);
+  std::error_code error;
+  fs::copy_file(pipeline_json, fs::path(shard_dir).append("pipeline.json"),
+                fs::copy_options::overwrite_existing, error);
+  if (error) {
+    std::cerr << "Error: Could not stage " << pipeline_json << ": "
+              << error.message() << "\n";
+    return false;
+  }
+
+  json manifest = {{"kernels", json::array()}};
+  for (size_t position = 0; position < shard.tasks.size(); position++) {
+    const KernelTask &task = tasks[shard.tasks[position]];
+    fs::path kernel_dir = fs::path("kernels").append(std::to_string(position));
+    fs::create_directories(fs::path(shard_dir) / kernel_dir);
+    fs::path stats = ActivationStats::kernel_stats_filepath(task.json_filepath);
+    for (const fs::path &source :
+         {task.mlir_filepath, task.json_filepath, stats, task.cross_object}) {
+      if (source.empty() || (source == stats && !fs::exists(stats)))
+        continue;
+      fs::copy_file(source, fs::path(shard_dir) / kernel_dir / source.filename(),
+                    fs::copy_options::overwrite_existing, error);
+      if (error) {
+        std::cerr << "Error: Could not stage " << source << ": "
+                  << error.message() << "\n";
+        return false;
+      }
+    }
+    manifest["kernels"].push_back(
+        {{"op_type", task.op_type},
+         {"mlir", (kernel_dir / task.mlir_filepath.filename()).string()},
+         {"json", (kernel_dir / task.json_filepath.filename()).string()},
+         {"shape_variant", task.shape_variant},
+         {"data_order", DataOrders::describe(task.data_order)},
+         {"multiplicity", task.multiplicity}});
+    if (!task.cross_object.empty())
+      manifest["kernels"].back()["object"] =
+          (kernel_dir / task.cross_object.filename()).string();
+  }
+  std::ofstream(fs::path(shard_dir).append(MANIFEST_NAME))
+      << manifest.dump(2) << "\n";
+  return true;
+}
+
+std::vector<size_t> Distributed::coordinate(std::vector<KernelTask> &tasks,
+                                            const DistributedConfig &config,
+                                            const fs::path &output_dir,
+                                            const fs::path &pipeline_json,
+                                            const ReportFn &report) {
+  fs::path staging = fs::path(output_dir).append("distributed");
+  std::error_code error;
+  fs::remove_all(fs::path(staging).append("files"), error);
+  fs::create_directories(staging);
+  // Runs of different coordinators may share a worker
+  fs::path remote_root = fs::path(config.remote_dir) / run_id(output_dir);
+  std::cout << "Worker folder of this run: " << remote_root.string() << "\n";
+
+  std::deque<Shard> queue;
+  Shard shard;
+  for (size_t t = 0; t < tasks.size(); t++) {
+    if (!tasks[t].metadata_ready)
+      continue;
+    shard.tasks.push_back(t);
+    if (shard.tasks.size() >= std::max(1u, config.shard_size)) {
+      queue.push_back(shard);
+      shard = Shard{queue.size(), {}, {}};
+    }
+  }
+  if (!shard.tasks.empty())
+    queue.push_back(shard);
+  std::cout << "Distributing " << queue.size() << " shards over "
+            << config.hosts.size() << " workers\n";
+
+  std::vector<NodeState> nodes;
+  for (const std::string &host : config.hosts) {
+    nodes.emplace_back();
+    nodes.back().host = host;
+  }
+  std::mutex mutex;
+  std::condition_variable shard_available;
+  size_t in_flight = 0;
+  std::vector<size_t> leftover;
+
+  std::string forwarded;
+  for (const std::string &arg :
+       stage_forwarded_paths(config, staging, remote_root))
+    forwarded += " " + quote(arg);
+  bool ship_files = fs::exists(fs::path(staging).append("files"));
+
+  // Measures one shard on `node`, false if the node failed it. Kernels
+  // without results go back to `missing`.
+  auto run_shard = [&](NodeState &node, const Shard &shard,
+                       std::vector<size_t> &missing) {
+    fs::path shard_dir =
+        fs::path(staging).append("shard-" + std::to_string(shard.id));
+    fs::path log = fs::path(shard_dir).append("transfer.log");
+    fs::path remote_shard =
+        fs::path(remote_root).append("shard-" + std::to_string(shard.id));
+    fs::path local_results = fs::path(shard_dir).append("results");
+    std::error_code error;
+    fs::remove_all(local_results, error);
+
+    std::string ssh = "ssh -o BatchMode=yes " + quote(node.host);
+    // The staged path flags go to every node once, before its first shard
+    if (ship_files && !node.files_shipped) {
+      fs::create_directories(shard_dir);
+      node.files_shipped =
+          run_logged(ssh + " " +
+                         quote("mkdir -p " + quote(remote_root.string())),
+                     log) &&
+          run_logged("scp -q -r -o BatchMode=yes " +
+                         quote(fs::path(staging).append("files").string()) +
+                         " " + quote(node.host + ":" + remote_root.string()),
+                     log);
+      if (!node.files_shipped) {
+        missing = shard.tasks;
+        return false;
+      }
+    }
+    std::string worker =
+        quote(config.remote_binary) + forwarded + " --worker " +
+        quote(remote_shard.string()) + " --pipeline " +
+        quote(fs::path(remote_shard).append("pipeline.json").string()) +
+        " --output-dir " +
+        quote(fs::path(remote_shard).append("out").string()) + " > " +
+        quote(fs::path(remote_shard).append("worker.log").string()) +
+        " 2>&1";
+    bool transferred =
+        stage_shard(shard, tasks, pipeline_json, shard_dir) &&
+        run_logged(ssh + " " +
+                       quote("rm -rf " + quote(remote_shard.string()) +
+                             " && mkdir -p " + quote(remote_root.string())),
+                   log) &&
+        run_logged("scp -q -r -o BatchMode=yes " + quote(shard_dir.string()) +
+                       " " + quote(node.host + ":" + remote_root.string()),
+                   log);
+    // A non zero exit still leaves the results of the kernels it finished
+    if (transferred && !run_logged(ssh + " " + quote(worker), log))
+      std::cerr << "Worker " << node.host << " exited with an error on shard "
+                << shard.id << ", see " << log << "\n";
+    if (transferred)
+      run_logged("scp -q -r -o BatchMode=yes " +
+                     quote(node.host + ":" +
+                           fs::path(remote_shard).append("results").string()) +
+                     " " + quote(shard_dir.string()),
+                 log);
+
+    json fingerprint;
+    if (fs::exists(fs::path(local_results).append(FINGERPRINT_NAME)))
+      fingerprint = load_json_from_file(
+          fs::path(local_results).append(FINGERPRINT_NAME));
+
+    for (size_t position = 0; position < shard.tasks.size(); position++) {
+      KernelTask &task = tasks[shard.tasks[position]];
+      fs::path samples =
+          fs::path(local_results).append(std::to_string(position) + ".samples");
+      fs::path failure =
+          fs::path(local_results).append(std::to_string(position) + ".failure");
+      SandboxResult result;
+      bool measured = fs::exists(samples) &&
+                      KernelSandbox::deserialize(read_text(samples), result);
+      if (!measured && !fs::exists(failure)) {
+        missing.push_back(shard.tasks[position]);
+        continue;
+      }
+
+      std::lock_guard<std::mutex> lock(mutex);
+      node.fingerprint_id = Distributed::fingerprint_id(fingerprint);
+      task.node = node.host;
+      task.node_fingerprint = node.fingerprint_id;
+      if (measured) {
+        report(task, &result);
+      } else {
+        task.failure = read_text(failure);
+        report(task, nullptr);
+      }
+    }
+    return missing.empty() && !fingerprint.is_null();
+  };
+
+  // Shards every live node has failed go to the coordinator, none of the
+  // others is left waiting for them. Called with `mutex` held.
+  auto hand_over_exhausted = [&]() {
+    for (auto it = queue.begin(); it != queue.end();) {
+      bool takeable = false;
+      for (const NodeState &other : nodes)
+        takeable |= other.alive && !it->failed_on.count(other.host);
+      if (takeable) {
+        ++it;
+        continue;
+      }
+      leftover.insert(leftover.end(), it->tasks.begin(), it->tasks.end());
+      it = queue.erase(it);
+    }
+  };
+
+  auto node_loop = [&](NodeState &node) {
+    while (true) {
+      Shard shard;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        auto next = queue.end();
+        shard_available.wait(lock, [&]() {
+          next = std::find_if(queue.begin(), queue.end(),
+                              [&](const Shard &queued) {
+                                return !queued.failed_on.count(node.host);
+                              });
+          return next != queue.end() || (queue.empty() && !in_flight);
+        });
+        if (next == queue.end())
+          return;
+        shard = *next;
+        queue.erase(next);
+        in_flight++;
+      }
+
+      std::cout << "Shard " << shard.id << " (" << shard.tasks.size()
+                << " kernels) on " << node.host << "\n";
+      std::vector<size_t> missing;
+      bool ok = run_shard(node, shard, missing);
+
+      std::lock_guard<std::mutex> lock(mutex);
+      in_flight--;
+      node.failures = ok ? 0 : node.failures + 1;
+      if (!missing.empty()) {
+        std::cerr << missing.size() << " kernels of shard " << shard.id
+                  << " have no results from " << node.host
+                  << ", rescheduling them on the other workers\n";
+        shard.tasks = missing;
+        shard.failed_on.insert(node.host);
+        queue.push_back(shard);
+      }
+      bool dropped = node.failures >= config.max_node_failures;
+      if (dropped) {
+        std::cerr << "Dropping worker " << node.host << " after "
+                  << node.failures << " failed shards\n";
+        node.alive = false;
+      }
+      hand_over_exhausted();
+      shard_available.notify_all();
+      if (dropped)
+        return;
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (NodeState &node : nodes)
+    threads.emplace_back(node_loop, std::ref(node));
+  for (std::thread &thread : threads)
+    thread.join();
+
+  json node_list = json::array();
+  for (const NodeState &node : nodes)
+    node_list.push_back({{"host", node.host},
+                         {"fingerprint", node.fingerprint_id},
+                         {"alive", node.alive}});
+  std::ofstream(fs::path(staging).append("nodes.json"))
+      << node_list.dump(2) << "\n";
+  if (!leftover.empty())
+    std::cerr << leftover.size()
+              << " kernels failed on every worker left, measuring them "
+                 "locally\n";
+  return leftover;
+}
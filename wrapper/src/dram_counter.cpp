@@ -0,0 +1,164 @@
+#include "dram_counter.h"
+#include "utils.h"
+
+#include <cstring>
+#include <fstream>
+#include <linux/perf_event.h>
+#include <sstream>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static const fs::path EVENT_SOURCES = "/sys/bus/event_source/devices";
+
+/*
+ * Encodes an event description ("event=0x04,umask=0x03") into the attr's
+ * config fields through the PMU's format files ("config:0-7")
+ */
+static bool encode_event(const fs::path &pmu, const std::string &description,
+                         perf_event_attr &attr) {
+  std::stringstream terms(description);
+  for (std::string term; std::getline(terms, term, ',');) {
+    size_t equals = term.find('=');
+    std::string name = term.substr(0, equals);
+    uint64_t value = equals == std::string::npos
+                         ? 1
+                         : std::stoull(term.substr(equals + 1), nullptr, 0);
+    std::string format = read_line(pmu / "format" / name);
+    size_t colon = format.find(':');
+    if (colon == std::string::npos)
+      return false;
+    std::string field = format.substr(0, colon);
+    __u64 *config = field == "config"    ? &attr.config
+                    : field == "config1" ? &attr.config1
+                    : field == "config2" ? &attr.config2
+                                         : nullptr;
+    if (!config)
+      return false;
+    // Bit ranges "0-7" or single bits "21", possibly split by commas
+    int shift = 0;
+    std::stringstream ranges(format.substr(colon + 1));
+    for (std::string range; std::getline(ranges, range, ',');) {
+      size_t dash = range.find('-');
+      int low = std::stoi(range.substr(0, dash));
+      int high = dash == std::string::npos ? low
+                                           : std::stoi(range.substr(dash + 1));
+      int width = high - low + 1;
+      uint64_t mask = width >= 64 ? ~0ULL : ((1ULL << width) - 1);
+      *config |= ((value >> shift) & mask) << low;
+      shift += width;
+    }
+  }
+  return true;
+}
+
+DramCounter::DramCounter(int cpu) {
+  int package = package_of(cpu);
+  std::error_code ec;
+  for (const auto &entry : fs::directory_iterator(EVENT_SOURCES, ec))
+    if (entry.path().filename().string().rfind("uncore_imc", 0) == 0)
+      open_pmu(entry.path(), package);
+}
+
+DramCounter::~DramCounter() {
+  for (Event &event : m_events)
+    if (event.fd >= 0)
+      close(event.fd);
+}
+
+void DramCounter::open_pmu(const fs::path &pmu, int package) {
+  std::string type = read_line(pmu / "type");
+  if (type.empty())
+    return;
+  int package_cpu = -1;
+  for (int cpu : parse_cpu_list(read_line(pmu / "cpumask")))
+    if (package_of(cpu) == package)
+      package_cpu = cpu;
+  if (package_cpu < 0)
+    return;
+
+  bool opened = false;
+  for (const auto &[name, write] :
+       {std::pair<const char *, bool>{"cas_count_read", false},
+        {"cas_count_write", true},
+        {"data_reads", false},
+        {"data_writes", true}}) {
+    // Client names only where the server CAS events are missing
+    if (opened && std::strncmp(name, "data_", 5) == 0)
+      continue;
+    fs::path event_path = pmu / "events" / name;
+    std::string description = read_line(event_path);
+    if (description.empty())
+      continue;
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = std::stoul(type);
+    if (!encode_event(pmu, description, attr))
+      continue;
+    int fd = syscall(SYS_perf_event_open, &attr, -1, package_cpu, -1,
+                     PERF_FLAG_FD_CLOEXEC);
+    if (fd < 0)
+      continue;
+
+    Event event;
+    event.write = write;
+    event.fd = fd;
+    // Usually 6.103515625e-5 MiB, one 64 byte line per count
+    std::string scale = read_line(fs::path(event_path).concat(".scale"));
+    std::string unit = read_line(fs::path(event_path).concat(".unit"));
+    if (!scale.empty()) {
+      double factor = unit == "MiB"   ? 1024.0 * 1024.0
+                      : unit == "KiB" ? 1024.0
+                      : unit == "GiB" ? 1024.0 * 1024.0 * 1024.0
+                                      : 1.0;
+      event.bytes_per_count = std::atof(scale.c_str()) * factor;
+    }
+    m_events.push_back(event);
+    opened = true;
+  }
+  m_channels += opened;
+}
+
+uint64_t DramCounter::read(const Event &event) const {
+  uint64_t value = 0;
+  if (::read(event.fd, &value, sizeof(value)) != sizeof(value))
+    value = 0;
+  return value;
+}
+
+void DramCounter::start() {
+  for (Event &event : m_events)
+    event.start = read(event);
+  m_start = std::chrono::steady_clock::now();
+}
+
+void DramCounter::stop() {
+  m_stop = std::chrono::steady_clock::now();
+  for (Event &event : m_events)
+    event.stop = read(event);
+}
+
+std::map<std::string, double>
+DramCounter::window_columns(uint64_t calls) const {
+  double read_bytes = 0.0, write_bytes = 0.0;
+  for (const Event &event : m_events) {
+    double bytes = (event.stop - event.start) * event.bytes_per_count;
+    (event.write ? write_bytes : read_bytes) += bytes;
+  }
+  double seconds = std::chrono::duration<double>(m_stop - m_start).count();
+  calls = calls ? calls : 1;
+  return {{"dram_read_bytes", read_bytes / calls},
+          {"dram_write_bytes", write_bytes / calls},
+          {"dram_bytes", (read_bytes + write_bytes) / calls},
+          {"dram_bandwidth_gbs",
+           seconds > 0.0 ? (read_bytes + write_bytes) / seconds / 1e9 : 0.0}};
+}
+
+std::vector<ReportMetric> DramCounter::columns() {
+  return {{"dram_read_bytes", MetricAggregation::SUM},
+          {"dram_write_bytes", MetricAggregation::SUM},
+          {"dram_bytes", MetricAggregation::SUM},
+          {"dram_bandwidth_gbs", MetricAggregation::PER_KERNEL},
+          {"dram_intensity", MetricAggregation::PER_KERNEL},
+          {"dram_traffic_ratio", MetricAggregation::PER_KERNEL}};
+}
@@ -0,0 +1,219 @@
+#include "element_type.h"
+
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+ElementType ElementTypes::parse(const std::string &dtype) {
+  if (dtype == "f32")
+    return ElementType::F32;
+  if (dtype == "f16")
+    return ElementType::F16;
+  if (dtype == "bf16")
+    return ElementType::BF16;
+  if (dtype == "f64")
+    return ElementType::F64;
+  if (dtype == "i1")
+    return ElementType::I1;
+  if (dtype == "si8" || dtype == "i8")
+    return ElementType::I8;
+  if (dtype == "ui8")
+    return ElementType::U8;
+  if (dtype == "si16" || dtype == "i16")
+    return ElementType::I16;
+  if (dtype == "si32" || dtype == "i32")
+    return ElementType::I32;
+  if (dtype == "si64" || dtype == "i64")
+    return ElementType::I64;
+
+  std::cerr << "Unsupported element type '" << dtype << "', treating it as "
+            << "f32\n";
+  return ElementType::F32;
+}
+
+std::string ElementTypes::describe(ElementType type) {
+  switch (type) {
+  case ElementType::F16:
+    return "f16";
+  case ElementType::BF16:
+    return "bf16";
+  case ElementType::F64:
+    return "f64";
+  case ElementType::I1:
+    return "i1";
+  case ElementType::I8:
+    return "i8";
+  case ElementType::U8:
+    return "ui8";
+  case ElementType::I16:
+    return "i16";
+  case ElementType::I32:
+    return "i32";
+  case ElementType::I64:
+    return "i64";
+  default:
+    return "f32";
+  }
+}
+
+size_t ElementTypes::size(ElementType type) {
+  switch (type) {
+  case ElementType::I1:
+  case ElementType::I8:
+  case ElementType::U8:
+    return 1;
+  case ElementType::F16:
+  case ElementType::BF16:
+  case ElementType::I16:
+    return 2;
+  case ElementType::F64:
+  case ElementType::I64:
+    return 8;
+  default:
+    return 4;
+  }
+}
+
+bool ElementTypes::is_floating_point(ElementType type) {
+  return type == ElementType::F32 || type == ElementType::F16 ||
+         type == ElementType::BF16 || type == ElementType::F64;
+}
+
+std::string ElementTypes::bytes_column(ElementType type) {
+  return "bytes_" + ElementTypes::describe(type);
+}
+
+const std::vector<ElementType> &ElementTypes::all() {
+  static const std::vector<ElementType> types = {
+      ElementType::F32, ElementType::F16, ElementType::BF16, ElementType::F64,
+      ElementType::I1,  ElementType::I8,  ElementType::U8,   ElementType::I16,
+      ElementType::I32, ElementType::I64};
+  return types;
+}
+
+uint16_t ElementTypes::float_to_half(float value) {
+  uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  uint32_t sign = (bits >> 16) & 0x8000;
+  int32_t exponent = static_cast<int32_t>((bits >> 23) & 0xff) - 127 + 15;
+  uint32_t mantissa = bits & 0x7fffff;
+
+  if (((bits >> 23) & 0xff) == 0xff) // Inf / NaN
+    return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+  if (exponent >= 0x1f) // Overflow
+    return sign | 0x7c00;
+  if (exponent <= 0) { // Subnormal or zero
+    if (exponent < -10)
+      return sign;
+    mantissa |= 0x800000;
+    uint32_t shift = 14 - exponent;
+    uint32_t half = mantissa >> shift;
+    uint32_t rest = mantissa & ((1u << shift) - 1);
+    uint32_t halfway = 1u << (shift - 1);
+    if (rest > halfway || (rest == halfway && (half & 1)))
+      half++;
+    return sign | half;
+  }
+
+  uint32_t half = sign | (exponent << 10) | (mantissa >> 13);
+  uint32_t rest = mantissa & 0x1fff;
+  if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+    half++; // May carry into the exponent, which rounds up correctly
+  return static_cast<uint16_t>(half);
+}
+
+float ElementTypes::half_to_float(uint16_t half) {
+  uint32_t sign = static_cast<uint32_t>(half & 0x8000) << 16;
+  uint32_t exponent = (half >> 10) & 0x1f;
+  uint32_t mantissa = half & 0x3ff;
+
+  float value;
+  if (exponent == 0)
+    value = std::ldexp(static_cast<float>(mantissa), -24);
+  else if (exponent == 0x1f)
+    value = mantissa ? NAN : INFINITY;
+  else
+    value = std::ldexp(static_cast<float>(mantissa | 0x400),
+                       static_cast<int>(exponent) - 25);
+  return sign ? -value : value;
+}
+
+uint16_t ElementTypes::float_to_bfloat16(float value) {
+  uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  if ((bits & 0x7fffffff) > 0x7f800000) // NaN stays quiet NaN
+    return static_cast<uint16_t>((bits >> 16) | 0x40);
+  bits += 0x7fff + ((bits >> 16) & 1);
+  return static_cast<uint16_t>(bits >> 16);
+}
+
+float ElementTypes::bfloat16_to_float(uint16_t bfloat) {
+  uint32_t bits = static_cast<uint32_t>(bfloat) << 16;
+  float value;
+  std::memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+void ElementTypes::store(void *buffer, int64_t index, ElementType type,
+                         double value) {
+  switch (type) {
+  case ElementType::F16:
+    static_cast<uint16_t *>(buffer)[index] =
+        ElementTypes::float_to_half(static_cast<float>(value));
+    return;
+  case ElementType::BF16:
+    static_cast<uint16_t *>(buffer)[index] =
+        ElementTypes::float_to_bfloat16(static_cast<float>(value));
+    return;
+  case ElementType::F64:
+    static_cast<double *>(buffer)[index] = value;
+    return;
+  case ElementType::I1:
+    static_cast<uint8_t *>(buffer)[index] = value != 0.0;
+    return;
+  case ElementType::I8:
+    static_cast<int8_t *>(buffer)[index] = static_cast<int8_t>(value);
+    return;
+  case ElementType::U8:
+    static_cast<uint8_t *>(buffer)[index] = static_cast<uint8_t>(value);
+    return;
+  case ElementType::I16:
+    static_cast<int16_t *>(buffer)[index] = static_cast<int16_t>(value);
+    return;
+  case ElementType::I32:
+    static_cast<int32_t *>(buffer)[index] = static_cast<int32_t>(value);
+    return;
+  case ElementType::I64:
+    static_cast<int64_t *>(buffer)[index] = static_cast<int64_t>(value);
+    return;
+  default:
+    static_cast<float *>(buffer)[index] = static_cast<float>(value);
+  }
+}
+
+double ElementTypes::load(const void *buffer, int64_t index,
+                          ElementType type) {
+  switch (type) {
+  case ElementType::F16:
+    return ElementTypes::half_to_float(
+        static_cast<const uint16_t *>(buffer)[index]);
+  case ElementType::BF16:
+    return ElementTypes::bfloat16_to_float(
+        static_cast<const uint16_t *>(buffer)[index]);
+  case ElementType::F64:
+    return static_cast<const double *>(buffer)[index];
+  case ElementType::I1:
+  case ElementType::U8:
+    return static_cast<const uint8_t *>(buffer)[index];
+  case ElementType::I8:
+    return static_cast<const int8_t *>(buffer)[index];
+  case ElementType::I16:
+    return static_cast<const int16_t *>(buffer)[index];
+  case ElementType::I32:
+    return static_cast<const int32_t *>(buffer)[index];
+  case ElementType::I64:
+    return static_cast<const int64_t *>(buffer)[index];
+  default:
+    return static_cast<const float *>(buffer)[index];
+  }
+}
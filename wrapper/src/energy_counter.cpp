@@ -0,0 +1,178 @@
+#include "energy_counter.h"
+#include "utils.h"
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <linux/perf_event.h>
+#include <sstream>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+
+static const fs::path POWER_PMU = "/sys/bus/event_source/devices/power";
+
+EnergyCounter::EnergyCounter(int cpu) {
+  int package = package_of(cpu);
+  if (open_perf(package))
+    m_source = "perf";
+  else if (open_powercap(package))
+    m_source = "powercap";
+}
+
+EnergyCounter::~EnergyCounter() {
+  for (Domain &domain : m_domains)
+    if (domain.fd >= 0)
+      close(domain.fd);
+}
+
+bool EnergyCounter::open_perf(int package) {
+  std::string type = read_line(POWER_PMU / "type");
+  if (type.empty())
+    return false;
+  // The PMU counts per package on the CPU its cpumask names
+  int package_cpu = -1;
+  for (int cpu : parse_cpu_list(read_line(POWER_PMU / "cpumask")))
+    if (package_of(cpu) == package)
+      package_cpu = cpu;
+  if (package_cpu < 0)
+    return false;
+
+  for (const auto &[event, name] :
+       {std::pair<const char *, const char *>{"energy-pkg", "pkg"},
+        {"energy-cores", "cores"},
+        {"energy-ram", "ram"},
+        {"energy-psys", "psys"}}) {
+    fs::path event_path = POWER_PMU / "events" / event;
+    std::string config = read_line(event_path);
+    size_t equals = config.find("event=");
+    if (equals == std::string::npos)
+      continue;
+
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = std::stoul(type);
+    attr.config = std::stoull(config.substr(equals + 6), nullptr, 16);
+    int fd = syscall(SYS_perf_event_open, &attr, -1, package_cpu, -1,
+                     PERF_FLAG_FD_CLOEXEC);
+    if (fd < 0)
+      continue;
+    Domain domain;
+    domain.name = name;
+    domain.fd = fd;
+    domain.scale =
+        std::atof(read_line(fs::path(event_path).concat(".scale")).c_str());
+    m_domains.push_back(domain);
+  }
+  return !m_domains.empty();
+}
+
+bool EnergyCounter::open_powercap(int package) {
+  fs::path zone = "/sys/class/powercap/intel-rapl:" + std::to_string(package);
+  auto add = [&](const fs::path &zone_path, const std::string &name) {
+    if (access((zone_path / "energy_uj").c_str(), R_OK) != 0)
+      return;
+    Domain domain;
+    domain.name = name;
+    domain.filepath = zone_path / "energy_uj";
+    domain.scale = 1e-6;
+    std::string range = read_line(zone_path / "max_energy_range_uj");
+    domain.range = range.empty() ? 0 : std::stoull(range);
+    m_domains.push_back(domain);
+  };
+  add(zone, "pkg");
+  for (int sub = 0; sub < 8; sub++) {
+    fs::path sub_zone = fs::path(zone).concat(":" + std::to_string(sub));
+    std::string name = read_line(sub_zone / "name");
+    if (name == "core")
+      add(sub_zone, "cores");
+    else if (name == "dram")
+      add(sub_zone, "ram");
+  }
+  return !m_domains.empty();
+}
+
+uint64_t EnergyCounter::read(const Domain &domain) const {
+  uint64_t value = 0;
+  if (domain.fd >= 0) {
+    if (::read(domain.fd, &value, sizeof(value)) != sizeof(value))
+      value = 0;
+    return value;
+  }
+  std::string text = read_line(domain.filepath);
+  return text.empty() ? 0 : std::stoull(text);
+}
+
+void EnergyCounter::start() {
+  for (Domain &domain : m_domains)
+    domain.start = read(domain);
+  m_start = std::chrono::steady_clock::now();
+}
+
+void EnergyCounter::stop() {
+  m_stop = std::chrono::steady_clock::now();
+  for (Domain &domain : m_domains)
+    domain.stop = read(domain);
+}
+
+std::map<std::string, double> EnergyCounter::joules() const {
+  std::map<std::string, double> result;
+  for (const Domain &domain : m_domains) {
+    uint64_t counts = domain.stop >= domain.start
+                          ? domain.stop - domain.start
+                          : domain.stop + domain.range - domain.start;
+    result[domain.name] = counts * domain.scale;
+  }
+  return result;
+}
+
+double EnergyCounter::seconds() const {
+  return std::chrono::duration<double>(m_stop - m_start).count();
+}
+
+std::map<std::string, double> EnergyCounter::measure_idle(double seconds) {
+  std::map<std::string, double> watts;
+  if (!available() || seconds <= 0.0)
+    return watts;
+  start();
+  std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+  stop();
+  for (const auto &[name, joules] : joules())
+    watts[name] = joules / EnergyCounter::seconds();
+  return watts;
+}
+
+std::map<std::string, double> EnergyCounter::window_columns(
+    uint64_t calls, const std::map<std::string, double> &idle_watts) const {
+  std::map<std::string, double> window = joules();
+  double seconds = EnergyCounter::seconds();
+  auto domain = [&](const std::map<std::string, double> &values,
+                    const char *name) {
+    auto it = values.find(name);
+    return it == values.end() ? 0.0 : it->second;
+  };
+  calls = calls ? calls : 1;
+
+  std::map<std::string, double> columns;
+  for (const char *name : {"pkg", "cores", "ram", "psys"})
+    columns[std::string("energy_") + name + "_j"] =
+        domain(window, name) / calls;
+  double total = domain(window, "pkg") + domain(window, "ram");
+  double idle =
+      (domain(idle_watts, "pkg") + domain(idle_watts, "ram")) * seconds;
+  columns["energy_net_j"] = (total - idle) / calls;
+  columns["power_pkg_w"] =
+      seconds > 0.0 ? domain(window, "pkg") / seconds : 0.0;
+  return columns;
+}
+
+std::vector<ReportMetric> EnergyCounter::columns() {
+  return {{"energy_pkg_j", MetricAggregation::SUM},
+          {"energy_cores_j", MetricAggregation::SUM},
+          {"energy_ram_j", MetricAggregation::SUM},
+          {"energy_psys_j", MetricAggregation::SUM},
+          {"energy_net_j", MetricAggregation::SUM},
+          {"power_pkg_w", MetricAggregation::PER_KERNEL},
+          {"gflops_per_j", MetricAggregation::PER_KERNEL}};
+}
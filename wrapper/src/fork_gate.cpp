@@ -0,0 +1,60 @@
+#include "fork_gate.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <unistd.h>
+
+namespace {
+struct GateState {
+  std::mutex mutex;
+  std::condition_variable changed;
+  unsigned int open = 0;    // Sections running, over all threads
+  unsigned int waiting = 0; // Threads that want to fork
+  bool forking = false;
+};
+
+// Replaced in every worker, whose copy may have waiters that don't exist
+GateState *state = new GateState();
+thread_local unsigned int held = 0; // Sections of the current thread
+} // namespace
+
+ForkGate::Section::Section() {
+  std::unique_lock<std::mutex> lock(state->mutex);
+  // A thread already inside a section finishes it rather than wait
+  if (held == 0)
+    state->changed.wait(lock, []() { return state->waiting == 0; });
+  state->open++;
+  held++;
+}
+
+ForkGate::Section::~Section() {
+  {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    state->open--;
+    held--;
+  }
+  state->changed.notify_all();
+}
+
+pid_t ForkGate::fork() {
+  std::unique_lock<std::mutex> lock(state->mutex);
+  state->waiting++;
+  state->changed.wait(
+      lock, []() { return !state->forking && state->open == held; });
+  state->forking = true;
+  lock.unlock();
+
+  pid_t pid = ::fork();
+  if (pid == 0) {
+    state = new GateState();
+    state->open = held;
+    return 0;
+  }
+
+  lock.lock();
+  state->forking = false;
+  state->waiting--;
+  lock.unlock();
+  state->changed.notify_all();
+  return pid;
+}
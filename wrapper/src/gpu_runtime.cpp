@@ -0,0 +1,516 @@
+#include "gpu_runtime.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <dlfcn.h>
+#include <fstream>
+#include <sstream>
+
+const char *GpuRuntime::HOOK_TABLE_SYMBOL = "mlir_bench_gpu_hooks";
+
+namespace {
+const char *LAUNCH_SYMBOL = "mgpuLaunchKernel";
+const char *LAUNCH_FORWARDER = "mlir_bench_mgpuLaunchKernel";
+// mgpuLaunchKernel(function, grid x/y/z, block x/y/z, smem, stream, ...)
+const size_t LAUNCH_STREAM_PARAMETER = 8;
+
+const uint64_t MIN_SLAB_BYTES = 64ull << 20;
+
+// Entry points of either driver, CUDA device pointers are 64 bit integers
+struct GpuDriver {
+  ParallelRuntimeKind kind = ParallelRuntimeKind::SERIAL_RUNTIME;
+  void *handle = nullptr;
+
+  int (*init)(unsigned int) = nullptr;
+  int (*device_get)(int *, int) = nullptr;
+  int (*primary_ctx_retain)(void **, int) = nullptr;
+  int (*ctx_set_current)(void *) = nullptr;
+  int (*set_device)(int) = nullptr;
+  int (*mem_alloc)(void *, size_t) = nullptr;
+  int (*cu_mem_free)(uint64_t) = nullptr;
+  int (*hip_free)(void *) = nullptr;
+  int (*cu_memcpy_htod)(uint64_t, const void *, size_t) = nullptr;
+  int (*cu_memcpy_dtoh)(void *, uint64_t, size_t) = nullptr;
+  int (*hip_memcpy)(void *, const void *, size_t, int) = nullptr;
+  int (*event_create)(void **, unsigned int) = nullptr;
+  int (*hip_event_create)(void **) = nullptr;
+  int (*event_record)(void *, void *) = nullptr;
+  int (*event_synchronize)(void *) = nullptr;
+  int (*event_elapsed)(float *, void *, void *) = nullptr;
+
+  // Launch events, begin and end of every launch back to back
+  std::vector<void *> events;
+  size_t used_events = 0;
+  bool recording = false;
+};
+
+GpuDriver &gpu_driver() {
+  static GpuDriver driver;
+  return driver;
+}
+
+bool is_cuda() {
+  return gpu_driver().kind == ParallelRuntimeKind::CUDA_RUNTIME;
+}
+
+template <typename T> bool bind(void *handle, const char *symbol, T &fn) {
+  fn = reinterpret_cast<T>(dlsym(handle, symbol));
+  if (!fn)
+    std::cerr << "Missing " << symbol << " in the GPU driver\n";
+  return fn != nullptr;
+}
+
+bool bind_cuda(GpuDriver &driver) {
+  void *h = driver.handle;
+  return bind(h, "cuInit", driver.init) &&
+         bind(h, "cuDeviceGet", driver.device_get) &&
+         bind(h, "cuDevicePrimaryCtxRetain", driver.primary_ctx_retain) &&
+         bind(h, "cuCtxSetCurrent", driver.ctx_set_current) &&
+         bind(h, "cuMemAlloc_v2", driver.mem_alloc) &&
+         bind(h, "cuMemFree_v2", driver.cu_mem_free) &&
+         bind(h, "cuMemcpyHtoD_v2", driver.cu_memcpy_htod) &&
+         bind(h, "cuMemcpyDtoH_v2", driver.cu_memcpy_dtoh) &&
+         bind(h, "cuEventCreate", driver.event_create) &&
+         bind(h, "cuEventRecord", driver.event_record) &&
+         bind(h, "cuEventSynchronize", driver.event_synchronize) &&
+         bind(h, "cuEventElapsedTime", driver.event_elapsed);
+}
+
+bool bind_hip(GpuDriver &driver) {
+  void *h = driver.handle;
+  return bind(h, "hipInit", driver.init) &&
+         bind(h, "hipSetDevice", driver.set_device) &&
+         bind(h, "hipMalloc", driver.mem_alloc) &&
+         bind(h, "hipFree", driver.hip_free) &&
+         bind(h, "hipMemcpy", driver.hip_memcpy) &&
+         bind(h, "hipEventCreate", driver.hip_event_create) &&
+         bind(h, "hipEventRecord", driver.event_record) &&
+         bind(h, "hipEventSynchronize", driver.event_synchronize) &&
+         bind(h, "hipEventElapsedTime", driver.event_elapsed);
+}
+
+// Types of a `declare` line's parameters, attributes dropped
+std::vector<std::string> declared_parameter_types(const std::string &line) {
+  std::vector<std::string> types;
+  size_t open = line.find('(');
+  size_t close = line.rfind(')');
+  if (open == std::string::npos || close == std::string::npos)
+    return types;
+  std::stringstream ss(line.substr(open + 1, close - open - 1));
+  for (std::string parameter; std::getline(ss, parameter, ',');) {
+    std::stringstream words(parameter);
+    std::string type;
+    words >> type;
+    if (!type.empty())
+      types.push_back(type);
+  }
+  return types;
+}
+
+std::string launch_forwarder_ir(const std::vector<std::string> &types,
+                                const std::string &declaration) {
+  std::string parameters;
+  for (size_t i = 0; i < types.size(); i++)
+    parameters += (i ? ", " : "") + types[i] + " %a" + std::to_string(i);
+  std::string launch = std::string("  call void @") + LAUNCH_SYMBOL + "(" +
+                       parameters + ")\n";
+  std::string stream = "ptr %a" + std::to_string(LAUNCH_STREAM_PARAMETER);
+
+  std::ostringstream ir;
+  ir << "\n@" << GpuRuntime::HOOK_TABLE_SYMBOL
+     << " = linkonce_odr global [2 x ptr] zeroinitializer\n"
+     << "\ndefine linkonce_odr void @" << LAUNCH_FORWARDER << "("
+     << parameters << ") {\n"
+     << "  %begin = load ptr, ptr @" << GpuRuntime::HOOK_TABLE_SYMBOL << "\n"
+     << "  %unhooked = icmp eq ptr %begin, null\n"
+     << "  br i1 %unhooked, label %direct, label %hooked\n"
+     << "direct:\n"
+     << launch << "  ret void\n"
+     << "hooked:\n"
+     << "  call void %begin(" << stream << ")\n"
+     << launch
+     << "  %end_slot = getelementptr [2 x ptr], ptr @"
+     << GpuRuntime::HOOK_TABLE_SYMBOL << ", i64 0, i64 1\n"
+     << "  %end = load ptr, ptr %end_slot\n"
+     << "  call void %end(" << stream << ")\n"
+     << "  ret void\n}\n"
+     << declaration << "\n";
+  return ir.str();
+}
+} // namespace
+
+bool GpuRuntime::open(ParallelRuntimeKind kind) {
+  GpuDriver &driver = gpu_driver();
+  if (driver.handle)
+    return driver.kind == kind;
+
+  const char *library = kind == ParallelRuntimeKind::CUDA_RUNTIME
+                            ? "libcuda.so.1"
+                            : "libamdhip64.so";
+  void *handle = dlopen(library, RTLD_NOW | RTLD_GLOBAL);
+  if (!handle) {
+    std::cerr << "Failed to load the GPU driver " << library << ": "
+              << dlerror() << std::endl;
+    return false;
+  }
+  driver.handle = handle;
+  driver.kind = kind;
+  bool bound = is_cuda() ? bind_cuda(driver) : bind_hip(driver);
+  if (!bound || driver.init(0) != 0) {
+    std::cerr << "Failed to initialise " << library << std::endl;
+    dlclose(handle);
+    driver = GpuDriver();
+    return false;
+  }
+
+  // Same primary context as the MLIR runtime wrappers
+  bool current;
+  if (is_cuda()) {
+    int device = 0;
+    void *context = nullptr;
+    current = driver.device_get(&device, 0) == 0 &&
+              driver.primary_ctx_retain(&context, device) == 0 &&
+              driver.ctx_set_current(context) == 0;
+  } else {
+    current = driver.set_device(0) == 0;
+  }
+  if (!current)
+    std::cerr << "Failed to make GPU device 0 current\n";
+  return current;
+}
+
+void *GpuRuntime::allocate(uint64_t bytes) {
+  GpuDriver &driver = gpu_driver();
+  if (!driver.handle)
+    return nullptr;
+  void *device_ptr = nullptr;
+  if (driver.mem_alloc(&device_ptr, bytes) != 0) {
+    std::cerr << "Failed to allocate " << (bytes >> 20)
+              << " MiB of device memory\n";
+    return nullptr;
+  }
+  return device_ptr;
+}
+
+void GpuRuntime::release(void *device_ptr) {
+  GpuDriver &driver = gpu_driver();
+  if (!driver.handle || !device_ptr)
+    return;
+  if (is_cuda())
+    driver.cu_mem_free(reinterpret_cast<uint64_t>(device_ptr));
+  else
+    driver.hip_free(device_ptr);
+}
+
+bool GpuRuntime::copy_to_device(void *device_ptr, const void *host_ptr,
+                                uint64_t bytes) {
+  GpuDriver &driver = gpu_driver();
+  if (!driver.handle)
+    return false;
+  // Synchronous for pageable host memory, hipMemcpyHostToDevice is 1
+  int status = is_cuda()
+                   ? driver.cu_memcpy_htod(
+                         reinterpret_cast<uint64_t>(device_ptr), host_ptr,
+                         bytes)
+                   : driver.hip_memcpy(device_ptr, host_ptr, bytes, 1);
+  return status == 0;
+}
+
+bool GpuRuntime::copy_to_host(void *host_ptr, const void *device_ptr,
+                              uint64_t bytes) {
+  GpuDriver &driver = gpu_driver();
+  if (!driver.handle)
+    return false;
+  // hipMemcpyDeviceToHost is 2
+  int status = is_cuda()
+                   ? driver.cu_memcpy_dtoh(
+                         host_ptr, reinterpret_cast<uint64_t>(device_ptr),
+                         bytes)
+                   : driver.hip_memcpy(host_ptr, device_ptr, bytes, 2);
+  return status == 0;
+}
+
+bool GpuRuntime::instrument_ll(const fs::path &ll_filepath) {
+  std::ifstream ll_stream(ll_filepath);
+  std::ostringstream contents;
+  contents << ll_stream.rdbuf();
+  ll_stream.close();
+
+  std::string ir = contents.str();
+  // Restored lowerings may already be instrumented
+  if (ir.find(std::string("@") + HOOK_TABLE_SYMBOL) != std::string::npos)
+    return true;
+
+  // The forwarder takes the parameters of the kernel's own declaration,
+  // which follows the runtime wrappers of the MLIR version in use
+  std::string callee = std::string("@") + LAUNCH_SYMBOL + "(";
+  std::istringstream lines(ir);
+  std::ostringstream kept;
+  std::string declaration;
+  for (std::string line; std::getline(lines, line);) {
+    if (line.rfind("declare ", 0) == 0 &&
+        line.find(callee) != std::string::npos)
+      declaration = line;
+    else
+      kept << line << "\n";
+  }
+  if (declaration.empty())
+    return false;
+
+  std::vector<std::string> types = declared_parameter_types(declaration);
+  if (declaration.rfind("declare void ", 0) != 0 ||
+      types.size() <= LAUNCH_STREAM_PARAMETER ||
+      types[LAUNCH_STREAM_PARAMETER] != "ptr") {
+    std::cerr << "Unexpected " << LAUNCH_SYMBOL << " declaration in "
+              << ll_filepath.filename() << ", launches are not timed\n";
+    return false;
+  }
+
+  ir = kept.str();
+  std::string forwarder = std::string("@") + LAUNCH_FORWARDER + "(";
+  for (size_t pos = ir.find(callee); pos != std::string::npos;
+       pos = ir.find(callee, pos + forwarder.size()))
+    ir.replace(pos, callee.size(), forwarder);
+
+  std::ofstream out(ll_filepath, std::ios::trunc);
+  out << ir << launch_forwarder_ir(types, declaration);
+  return out.good();
+}
+
+std::string GpuRuntime::cuda_chip(const std::string &compute_capability) {
+  size_t dot = compute_capability.find('.');
+  if (dot == std::string::npos || dot == 0 ||
+      dot + 1 >= compute_capability.size())
+    return "";
+  std::string digits = compute_capability.substr(0, dot) +
+                       compute_capability.substr(dot + 1);
+  if (!std::all_of(digits.begin(), digits.end(),
+                   [](unsigned char c) { return std::isdigit(c); }))
+    return "";
+  return "sm_" + digits;
+}
+
+std::string GpuRuntime::rocm_chip(unsigned int gfx_target_version) {
+  // major * 10000 + minor * 100 + stepping, the last two in hex
+  if (gfx_target_version == 0)
+    return "";
+  std::ostringstream chip;
+  chip << "gfx" << gfx_target_version / 10000 << std::hex
+       << gfx_target_version / 100 % 100 << gfx_target_version % 100;
+  return chip.str();
+}
+
+std::string GpuRuntime::device_chip(ParallelRuntimeKind kind) {
+  if (kind == ParallelRuntimeKind::CUDA_RUNTIME) {
+    FILE *pipe = popen("nvidia-smi --query-gpu=compute_cap "
+                       "--format=csv,noheader --id=0 2>/dev/null",
+                       "r");
+    if (!pipe)
+      return "";
+    char line[64] = {};
+    bool read = fgets(line, sizeof(line), pipe) != nullptr;
+    pclose(pipe);
+    std::string capability = read ? line : "";
+    capability.erase(std::remove_if(capability.begin(), capability.end(),
+                                    [](unsigned char c) {
+                                      return std::isspace(c);
+                                    }),
+                     capability.end());
+    return GpuRuntime::cuda_chip(capability);
+  }
+  if (kind != ParallelRuntimeKind::ROCM_RUNTIME)
+    return "";
+
+  // CPUs are KFD nodes too, with version 0. Nodes are numbered in order.
+  const fs::path nodes = "/sys/class/kfd/kfd/topology/nodes";
+  for (unsigned int node = 0;; node++) {
+    std::ifstream properties(nodes / std::to_string(node) / "properties");
+    if (!properties.is_open())
+      return "";
+    std::string key;
+    unsigned int value = 0;
+    while (properties >> key >> value)
+      if (key == "gfx_target_version" && value != 0)
+        return GpuRuntime::rocm_chip(value);
+  }
+}
+
+void GpuRuntime::apply_to_pass_list(const std::string &chip,
+                                    std::vector<std::string> &pass_list) {
+  if (chip.empty())
+    return;
+  for (std::string &pass : pass_list) {
+    if (pass.rfind("nvvm-attach-target", 0) != 0 &&
+        pass.rfind("rocdl-attach-target", 0) != 0)
+      continue;
+    if (pass.find("chip=") != std::string::npos)
+      continue;
+    // name, name="options" or name=option
+    size_t equals = pass.find('=');
+    if (equals == std::string::npos)
+      pass += "=\"chip=" + chip + "\"";
+    else if (pass.size() > equals + 1 && pass[equals + 1] == '"')
+      pass.insert(equals + 2, "chip=" + chip + " ");
+    else
+      pass = pass.substr(0, equals) + "=\"chip=" + chip + " " +
+             pass.substr(equals + 1) + "\"";
+  }
+}
+
+size_t GpuRuntime::outlined_depth(const std::vector<std::string> &pass_list) {
+  for (size_t i = 0; i < pass_list.size(); i++)
+    if (pass_list[i].rfind("gpu-kernel-outlining", 0) == 0)
+      return i + 1;
+  return 0;
+}
+
+std::string GpuRuntime::host_memory_access(const fs::path &outlined_mlir) {
+  static const std::vector<std::string> HOST_ACCESSES = {
+      "memref.alloc",        "memref.alloca",        "memref.copy",
+      "memref.load",         "memref.store",         "affine.load",
+      "affine.store",        "vector.load",          "vector.store",
+      "vector.transfer_read", "vector.transfer_write", "scf.parallel"};
+  auto is_name_char = [](char c) {
+    return std::isalnum(static_cast<unsigned char>(c)) || c == '_' ||
+           c == '.';
+  };
+
+  std::ifstream file(outlined_mlir);
+  std::string line;
+  // Brace depth inside a gpu.module, 0 in host code
+  long device_depth = 0;
+  for (size_t number = 1; std::getline(file, line); number++) {
+    long braces = std::count(line.begin(), line.end(), '{') -
+                  std::count(line.begin(), line.end(), '}');
+    if (device_depth > 0) {
+      device_depth += braces;
+      continue;
+    }
+    if (line.find("gpu.module @") != std::string::npos) {
+      device_depth = braces;
+      continue;
+    }
+    for (size_t start = line.find_first_not_of(" ");
+         start != std::string::npos && start < line.size();) {
+      size_t end = start;
+      while (end < line.size() && is_name_char(line[end]))
+        end++;
+      std::string word = line.substr(start, end - start);
+      if (word.rfind("linalg.", 0) == 0 ||
+          std::find(HOST_ACCESSES.begin(), HOST_ACCESSES.end(), word) !=
+              HOST_ACCESSES.end())
+        return word + " at line " + std::to_string(number);
+      start = end == start ? end + 1 : end;
+    }
+  }
+  return "";
+}
+
+void GpuRuntime::install(void *hook_table) {
+  if (!hook_table)
+    return;
+  void **slots = static_cast<void **>(hook_table);
+  slots[0] = reinterpret_cast<void *>(&GpuRuntime::launch_begin);
+  slots[1] = reinterpret_cast<void *>(&GpuRuntime::launch_end);
+}
+
+void GpuRuntime::begin_window() {
+  GpuDriver &driver = gpu_driver();
+  driver.used_events = 0;
+  driver.recording = driver.handle != nullptr;
+}
+
+std::map<std::string, double> GpuRuntime::window_columns(uint64_t calls) {
+  GpuDriver &driver = gpu_driver();
+  driver.recording = false;
+  double seconds = 0.0;
+  size_t launches = driver.used_events / 2;
+  if (launches > 0 &&
+      driver.event_synchronize(driver.events[2 * launches - 1]) == 0) {
+    for (size_t l = 0; l < launches; l++) {
+      float milliseconds = 0.0f;
+      if (driver.event_elapsed(&milliseconds, driver.events[2 * l],
+                               driver.events[2 * l + 1]) == 0)
+        seconds += milliseconds * 1e-3;
+    }
+  }
+  calls = std::max<uint64_t>(calls, 1);
+  return {{"device_seconds", seconds / calls},
+          {"device_launches", static_cast<double>(launches) / calls}};
+}
+
+std::vector<std::string> GpuRuntime::columns() {
+  return {"device_seconds", "device_launches", "h2d_bytes",
+          "h2d_seconds",    "d2h_bytes",       "d2h_seconds"};
+}
+
+void *GpuRuntime::next_event() {
+  GpuDriver &driver = gpu_driver();
+  // Created by the first windows (warmup), reused by the later ones
+  if (driver.used_events == driver.events.size()) {
+    void *event = nullptr;
+    int status = is_cuda() ? driver.event_create(&event, 0)
+                           : driver.hip_event_create(&event);
+    if (status != 0)
+      return nullptr;
+    driver.events.push_back(event);
+  }
+  return driver.events[driver.used_events++];
+}
+
+void GpuRuntime::launch_begin(void *stream) {
+  GpuDriver &driver = gpu_driver();
+  if (!driver.recording)
+    return;
+  void *event = next_event();
+  if (event)
+    driver.event_record(event, stream);
+}
+
+void GpuRuntime::launch_end(void *stream) {
+  GpuDriver &driver = gpu_driver();
+  if (!driver.recording)
+    return;
+  // Unpaired begin events are not counted (used_events / 2)
+  void *event = next_event();
+  if (event)
+    driver.event_record(event, stream);
+}
+
+DeviceArena::~DeviceArena() {
+  for (Slab &slab : m_slabs)
+    GpuRuntime::release(slab.base);
+}
+
+void *DeviceArena::allocate(uint64_t bytes) {
+  bytes = std::max<uint64_t>(bytes, 1);
+  auto round_up = [](uint64_t value) {
+    return (value + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+  };
+  for (; m_current < m_slabs.size(); m_current++) {
+    Slab &slab = m_slabs[m_current];
+    uint64_t offset = round_up(slab.used);
+    if (offset + bytes <= slab.size) {
+      slab.used = offset + bytes;
+      return slab.base + offset;
+    }
+  }
+
+  // Driver allocations are at least 256 byte aligned
+  Slab slab;
+  slab.size = round_up(std::max(bytes, MIN_SLAB_BYTES));
+  slab.base = static_cast<uint8_t *>(GpuRuntime::allocate(slab.size));
+  if (!slab.base)
+    return nullptr;
+  slab.used = bytes;
+  m_slabs.push_back(slab);
+  m_current = m_slabs.size() - 1;
+  return slab.base;
+}
+
+void DeviceArena::reset() {
+  for (Slab &slab : m_slabs)
+    slab.used = 0;
+  m_current = 0;
+}
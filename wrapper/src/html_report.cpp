@@ -0,0 +1,332 @@
+#include "html_report.h"
+#include "result_compare.h"
+#include "results_store.h"
+#include "statistics.h"
+#include "utils.h"
+
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <set>
+
+bool HtmlReport::is_rate_metric(const std::string &metric) {
+  // Same list as graph-gen/comparative_inter_op.py
+  static const std::set<std::string> rates = {
+      "gflops",         "bandwidth_gbs",  "ipc",          "arith_intensity",
+      "ci95",           "frontend_bound", "backend_bound", "bad_speculation",
+      "retiring",       "memory_bound",   "core_bound",   "l1d_mpki",
+      "llc_mpki",       "dtlb_mpki",      "fetch_latency", "fetch_bandwidth",
+      "l1i_mpki",       "itlb_mpki",      "cache_miss_rate",
+      "branch_miss_rate", "l1d_miss_rate", "power_pkg_w", "gflops_per_j",
+      "vec_fraction", "dram_bandwidth_gbs", "dram_intensity",
+      "dram_traffic_ratio"};
+  return rates.count(metric) > 0;
+}
+
+// Ratios of counters the samples carry, from their means
+static json derived_metrics(const std::map<std::string, double> &means) {
+  json derived = json::object();
+  auto ratio = [&means, &derived](const char *name, const char *numerator,
+                                  const char *denominator) {
+    auto n = means.find(numerator), d = means.find(denominator);
+    if (n != means.end() && d != means.end() && d->second > 0.0)
+      derived[name] = n->second / d->second;
+  };
+  if (!means.count("ipc"))
+    ratio("ipc", "instructions", "cycles");
+  ratio("cache_miss_rate", "cache-misses", "cache-references");
+  ratio("branch_miss_rate", "branch-misses", "branches");
+  ratio("l1d_miss_rate", "L1-dcache-load-misses", "L1-dcache-loads");
+  ratio("instructions_per_flop", "instructions", "flops");
+  return derived;
+}
+
+bool HtmlReport::build(const std::vector<fs::path> &output_dirs,
+                       const std::vector<std::string> &labels, json &report) {
+  std::vector<StoredRun> runs(output_dirs.size());
+  for (size_t s = 0; s < output_dirs.size(); s++)
+    if (!ResultsStore::load_samples(output_dirs[s], runs[s])) {
+      std::cerr << "No results store in " << output_dirs[s] << "\n";
+      return false;
+    }
+
+  std::string primary_metric =
+      runs.front().primary_metric.empty() ? "seconds"
+                                          : runs.front().primary_metric;
+  report = {{"generated", get_timestamp_string()},
+            {"primary_metric", primary_metric},
+            {"sets", json::array()},
+            {"metrics", json::array()},
+            {"higher_is_better", json::array()},
+            {"rate_metrics", json::array()},
+            {"kernels", json::array()},
+            {"op_types", json::array()},
+            {"structure_classes", json::array()}};
+
+  // Kernels in the baseline's order, then the ones the others add, matched
+  // by hash (op type and name for stores without one)
+  std::vector<std::string> order;
+  std::map<std::string, size_t> index;
+  std::set<std::string> metrics;
+  for (size_t s = 0; s < runs.size(); s++) {
+    report["sets"].push_back(
+        {{"label", s < labels.size() ? labels[s]
+                                     : output_dirs[s].filename().string()},
+         {"output_dir", output_dirs[s].string()},
+         {"kernels", runs[s].kernels.size()}});
+    for (const StoredKernel &kernel : runs[s].kernels) {
+      std::string key = kernel.hash.empty()
+                            ? kernel.op_type + "/" + kernel.kernel
+                            : kernel.hash;
+      auto [it, inserted] = index.emplace(key, order.size());
+      if (inserted) {
+        order.push_back(key);
+        json layers = json::parse(kernel.layers, nullptr, false);
+        json structure = json::parse(kernel.structure, nullptr, false);
+        report["kernels"].push_back(
+            {{"op_type", kernel.op_type},
+             {"kernel", kernel.kernel},
+             {"hash", kernel.hash},
+             {"multiplicity", kernel.multiplicity},
+             {"layers", layers.is_array() ? layers : json::array()},
+             {"structure",
+              structure.is_object() ? structure : json::object()},
+             {"sets", json::array()}});
+        for (size_t pad = 0; pad < runs.size(); pad++)
+          report["kernels"].back()["sets"].push_back(nullptr);
+      }
+      json &entry = report["kernels"][it->second]["sets"][s];
+      if (!entry.is_null())
+        continue; // Same kernel again without --dedup
+
+      entry = {{"kernel", kernel.kernel}, {"stats", json::object()}};
+      std::map<std::string, double> means;
+      for (const auto &[metric, values] : kernel.samples) {
+        metrics.insert(metric);
+        SampleSummary summary = Statistics::summarize(values, 0);
+        means[metric] = summary.mean;
+        entry["stats"][metric] = {{"count", summary.count},
+                                  {"mean", summary.mean},
+                                  {"median", summary.median},
+                                  {"min", summary.min},
+                                  {"max", summary.max},
+                                  {"stddev", summary.stddev}};
+      }
+      entry["derived"] = derived_metrics(means);
+      for (const auto &[metric, value] : entry["derived"].items()) {
+        metrics.insert(metric);
+        entry["stats"][metric] = {{"count", 1},      {"mean", value},
+                                  {"median", value}, {"min", value},
+                                  {"max", value},    {"stddev", 0.0}};
+      }
+      auto primary = kernel.samples.find(primary_metric);
+      entry["samples"] = primary == kernel.samples.end()
+                             ? json::array()
+                             : json(primary->second);
+    }
+  }
+  for (const std::string &metric : metrics) {
+    report["metrics"].push_back(metric);
+    if (ResultCompare::higher_is_better(metric))
+      report["higher_is_better"].push_back(metric);
+    if (HtmlReport::is_rate_metric(metric))
+      report["rate_metrics"].push_back(metric);
+  }
+
+  // Op type and structural class totals of the medians, per metric and set
+  auto group_totals = [&](const char *group_key, const char *name_key,
+                          std::function<std::string(const json &)> group_of) {
+    std::map<std::string, json> groups;
+    std::map<std::string, std::map<std::string, std::vector<double>>> weights;
+    for (const json &kernel : report["kernels"]) {
+      std::string name = group_of(kernel);
+      int multiplicity = kernel["multiplicity"];
+      json &group = groups[name];
+      if (group.is_null())
+        group = {{name_key, name}, {"kernels", 0}, {"totals", json::object()}};
+      group["kernels"] = group["kernels"].get<int>() + 1;
+      for (size_t s = 0; s < runs.size(); s++) {
+        const json &entry = kernel["sets"][s];
+        if (entry.is_null())
+          continue;
+        for (const auto &[metric, stats] : entry["stats"].items()) {
+          json &totals = group["totals"][metric];
+          if (totals.is_null())
+            totals = std::vector<double>(runs.size(), 0.0);
+          std::vector<double> &weight = weights[name][metric];
+          weight.resize(runs.size(), 0.0);
+          totals[s] = totals[s].get<double>() +
+                      stats["median"].get<double>() * multiplicity;
+          weight[s] += multiplicity;
+        }
+      }
+    }
+    for (auto &[name, group] : groups) {
+      for (auto &[metric, totals] : group["totals"].items())
+        if (HtmlReport::is_rate_metric(metric))
+          for (size_t s = 0; s < runs.size(); s++)
+            if (weights[name][metric][s] > 0.0)
+              totals[s] = totals[s].get<double>() / weights[name][metric][s];
+      report[group_key].push_back(group);
+    }
+  };
+  group_totals("op_types", "op_type", [](const json &kernel) {
+    return kernel["op_type"].get<std::string>();
+  });
+  group_totals("structure_classes", "class", [](const json &kernel) {
+    return kernel["structure"].value("class", std::string("unknown"));
+  });
+  return true;
+}
+
+static const char *HTML_HEAD = R"html(<!DOCTYPE html>
+<html><head><meta charset="utf-8"><title>Benchmark report</title>
+<style>
+body{font:13px system-ui,sans-serif;margin:16px;color:#222}
+h1{font-size:18px}h2{font-size:15px;margin-top:24px}
+table{border-collapse:collapse;margin:6px 0}
+th,td{padding:3px 8px;border-bottom:1px solid #ddd;text-align:right;white-space:nowrap}
+th{background:#f4f4f4;cursor:pointer;user-select:none;position:sticky;top:0}
+td.l,th.l{text-align:left}
+tr.k:hover{background:#eef4ff;cursor:pointer}
+.worse{color:#b00020}.better{color:#087f23}
+.bar{display:inline-block;height:9px;background:#7aa6e0;vertical-align:middle}
+#detail{border:1px solid #ccc;padding:8px;margin-top:12px;display:none}
+input,select,button{font:inherit;margin-right:8px}
+</style></head><body>
+<h1>Benchmark report</h1>
+<div id="sets"></div>
+<p>Metric <select id="metric"></select>
+Op type <select id="op"><option value="">all</option></select>
+Filter <input id="filter" placeholder="kernel name"></p>
+<h2><select id="group"><option value="op_types">Op types</option><option value="structure_classes">Structural classes</option></select></h2><table id="ops"></table>
+<h2>Kernels</h2><table id="kernels"></table>
+<button id="more">Show more</button>
+<div id="detail"></div>
+<script id="data" type="application/json">)html";
+
+static const char *HTML_TAIL = R"html(</script>
+<script>
+const R = JSON.parse(document.getElementById('data').textContent);
+const N = R.sets.length, PAGE = 250;
+let metric = R.primary_metric, op = '', filter = '', limit = PAGE, group = 'op_types';
+let sortColumn = N > 1 ? 3 + N : 3, sortDir = -1;
+const $ = id => document.getElementById(id);
+const esc = s => String(s).replace(/[&<>"]/g, c => ({'&':'&amp;','<':'&lt;','>':'&gt;','"':'&quot;'}[c]));
+const fmt = v => v == null ? '' : Math.abs(v) >= 1e5 || (v != 0 && Math.abs(v) < 1e-3) ? v.toExponential(3) : (+v.toFixed(4)).toString();
+const median = (k, s) => { const e = k.sets[s]; return e && e.stats[metric] ? e.stats[metric].median : null; };
+// Slowdown of set s against the baseline, positive is worse
+function change(base, value) {
+  if (base == null || value == null || base == 0 || value == 0) return null;
+  return R.higher_is_better.includes(metric) ? base / value - 1 : value / base - 1;
+}
+const pct = c => c == null ? '' : `<span class="${c > 0.02 ? 'worse' : c < -0.02 ? 'better' : ''}">${(c * 100).toFixed(1)}%</span>`;
+$('sets').innerHTML = 'Sets: ' + R.sets.map((s, i) => `<b>${esc(s.label)}</b>${i ? '' : ' (baseline)'} ${s.kernels} kernels`).join(', ') + '. Generated ' + esc(R.generated) + '.';
+for (const m of R.metrics) $('metric').add(new Option(m, m, false, m == metric));
+for (const o of R.op_types) $('op').add(new Option(o.op_type, o.op_type));
+$('metric').onchange = e => { metric = e.target.value; draw(); };
+$('group').onchange = e => { group = e.target.value; drawOps(); };
+$('op').onchange = e => { op = e.target.value; limit = PAGE; draw(); };
+$('filter').oninput = e => { filter = e.target.value.toLowerCase(); limit = PAGE; drawKernels(); };
+$('more').onclick = () => { limit += PAGE; drawKernels(); };
+
+function header(columns, onSort) {
+  return '<tr>' + columns.map((c, i) => `<th class="${i < 2 ? 'l' : ''}" data-i="${i}">${esc(c)}${onSort && i == sortColumn ? (sortDir < 0 ? ' ▼' : ' ▲') : ''}</th>`).join('') + '</tr>';
+}
+function drawOps() {
+  const rows = (R[group] || []).filter(o => o.totals[metric]);
+  const max = Math.max(...rows.map(o => Math.max(...o.totals[metric])), 0);
+  const columns = [group == 'op_types' ? 'Op type' : 'Class', 'Kernels', ...R.sets.map(s => s.label), ...R.sets.slice(1).map(s => s.label + ' vs base')];
+  let html = header(columns, false);
+  for (const o of rows) {
+    const t = o.totals[metric];
+    html += `<tr><td class="l">${esc(o.op_type || o.class)}</td><td class="l">${o.kernels}</td>` +
+      t.map(v => `<td>${fmt(v)} <span class="bar" style="width:${max ? 80 * v / max : 0}px"></span></td>`).join('') +
+      t.slice(1).map(v => `<td>${pct(change(t[0], v))}</td>`).join('') + '</tr>';
+  }
+  $('ops').innerHTML = html + (R.rate_metrics.includes(metric) ? `<tr><td class="l" colspan="9">Averaged over the ${group == 'op_types' ? 'op type' : 'class'}, weighted by multiplicity</td></tr>` : '');
+}
+function kernelRow(k) {
+  const values = R.sets.map((s, i) => median(k, i));
+  return [k.op_type, k.kernel, k.multiplicity, ...values, ...values.slice(1).map(v => change(values[0], v))];
+}
+function drawKernels() {
+  let rows = R.kernels.map((k, i) => [i, kernelRow(k)])
+    .filter(([i, r]) => (!op || r[0] == op) && (!filter || r[1].toLowerCase().includes(filter)) && r.slice(3, 3 + N).some(v => v != null));
+  rows.sort((a, b) => {
+    const x = a[1][sortColumn], y = b[1][sortColumn];
+    if (x == null) return 1; if (y == null) return -1;
+    return (x < y ? -1 : x > y ? 1 : 0) * sortDir;
+  });
+  const columns = ['Op type', 'Kernel', 'Mult', ...R.sets.map(s => s.label), ...R.sets.slice(1).map(s => s.label + ' vs base')];
+  let html = header(columns, true);
+  for (const [i, r] of rows.slice(0, limit))
+    html += `<tr class="k" data-k="${i}"><td class="l">${esc(r[0])}</td><td class="l">${esc(r[1])}</td><td>${r[2]}</td>` +
+      r.slice(3, 3 + N).map(v => `<td>${fmt(v)}</td>`).join('') + r.slice(3 + N).map(v => `<td>${pct(v)}</td>`).join('') + '</tr>';
+  $('kernels').innerHTML = html;
+  $('more').style.display = rows.length > limit ? '' : 'none';
+  $('more').textContent = `Show more (${limit} of ${rows.length})`;
+}
+$('kernels').onclick = e => {
+  const th = e.target.closest('th');
+  if (th) { const i = +th.dataset.i; sortDir = i == sortColumn ? -sortDir : -1; sortColumn = i; drawKernels(); return; }
+  const tr = e.target.closest('tr.k');
+  if (tr) detail(R.kernels[+tr.dataset.k]);
+};
+function strip(k) {
+  const all = k.sets.flatMap(e => e ? e.samples : []);
+  if (!all.length) return '';
+  const lo = Math.min(...all), hi = Math.max(...all), w = 420, h = 18;
+  let svg = `<svg width="${w + 140}" height="${h * N + 16}">`;
+  k.sets.forEach((e, s) => {
+    svg += `<text x="0" y="${h * s + 13}">${esc(R.sets[s].label)}</text>`;
+    for (const v of e ? e.samples : [])
+      svg += `<circle cx="${130 + (hi > lo ? (v - lo) / (hi - lo) * w : w / 2)}" cy="${h * s + 9}" r="2.5" fill="#3366cc" fill-opacity="0.5"/>`;
+  });
+  return svg + `<text x="130" y="${h * N + 12}">${fmt(lo)}</text><text x="${130 + w}" y="${h * N + 12}" text-anchor="end">${fmt(hi)}</text></svg>`;
+}
+function detail(k) {
+  const metrics = [...new Set(k.sets.flatMap(e => e ? Object.keys(e.stats) : []))].sort();
+  const layers = (Array.isArray(k.layers) ? k.layers : []).map(l => `${esc(l.name)} (#${l.index}, ${esc(l.location)})`);
+  let html = `<b>${esc(k.op_type)}/${esc(k.kernel)}</b> hash ${esc(k.hash)}, ${k.multiplicity} occurrences` +
+    (layers.length ? `<br>Model layers: ${layers.join(', ')}` : '') +
+    (k.structure && k.structure.class ? `<br>Structure: ${esc(k.structure.class)}, ${k.structure.num_loops} loops (${k.structure.num_parallel} parallel, ${k.structure.num_reduction} reduction${k.structure.reduction_dims ? ' at ' + esc(k.structure.reduction_dims) : ''})` : '') +
+    `<h2>${esc(R.primary_metric)} samples</h2>` + strip(k) +
+    '<table>' + header(['Metric', 'Stat', ...R.sets.map(s => s.label)], false);
+  for (const m of metrics)
+    for (const stat of ['median', 'mean', 'min', 'max', 'stddev'])
+      html += `<tr><td class="l">${stat == 'median' ? esc(m) : ''}</td><td class="l">${stat}</td>` +
+        k.sets.map(e => `<td>${e && e.stats[m] ? fmt(e.stats[m][stat]) : ''}</td>`).join('') + '</tr>';
+  $('detail').innerHTML = html + '</table>';
+  $('detail').style.display = 'block';
+  $('detail').scrollIntoView();
+}
+function draw() { drawOps(); drawKernels(); }
+draw();
+</script></body></html>
+)html";
+
+bool HtmlReport::write(const json &report, const fs::path &folder) {
+  std::error_code ec;
+  fs::create_directories(folder, ec);
+  fs::path json_filepath = fs::path(folder).append("report.json");
+  fs::path html_filepath = fs::path(folder).append("report.html");
+  std::ofstream json_file(json_filepath);
+  std::ofstream html_file(html_filepath);
+  if (!json_file.is_open() || !html_file.is_open()) {
+    std::cerr << "Error: Could not write the report to " << folder << "\n";
+    return false;
+  }
+  json_file << report.dump(1) << "\n";
+
+  // Kept inside its script element
+  std::string data = report.dump();
+  for (size_t pos = data.find("</"); pos != std::string::npos;
+       pos = data.find("</", pos + 3))
+    data.insert(pos + 1, "\\");
+  html_file << HTML_HEAD << data << HTML_TAIL;
+  std::cout << "Report written to " << html_filepath << " ("
+            << report["kernels"].size() << " kernels)\n";
+  return true;
+}
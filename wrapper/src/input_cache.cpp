@@ -0,0 +1,96 @@
+#include "input_cache.h"
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+InputCache::InputCache(const fs::path &directory) : m_directory(directory) {
+  std::error_code error;
+  fs::create_directories(m_directory, error);
+}
+
+std::string InputCache::key(const DataFormatInfo &info) {
+  std::ostringstream description;
+  description << ElementTypes::describe(info.m_elem_type) << ":"
+              << info.m_elem_count << ":" << info.m_row_length << ":"
+              << TensorFuzzer::describe(info.m_profile) << ":"
+              << info.m_range_bounds.min_val << ","
+              << info.m_range_bounds.max_val << ":" << info.m_seed;
+  if (info.m_profile == DataProfile::SPARSE)
+    description << ":"
+                << TensorFuzzer::describe(info.m_sp_profile.distribution_type)
+                << "," << int(info.m_sp_profile.row_block_size) << ","
+                << info.m_sp_profile.sparsity_percentage;
+  if (info.m_profile == DataProfile::FROM_STATS && info.m_stats) {
+    const TensorStats &stats = *info.m_stats;
+    description << ":" << stats.zero_fraction << "," << stats.min << ","
+                << stats.max << "," << stats.histogram_min << ","
+                << stats.histogram_max;
+    for (double count : stats.histogram)
+      description << "," << count;
+  }
+  if (info.m_order != DataOrder::NCHW) {
+    description << ":" << DataOrders::describe(info.m_order);
+    for (uint64_t dim : info.m_stored_dims)
+      description << "," << dim;
+  }
+  return hash_to_hex(hash_string(description.str()));
+}
+
+// Whole-buffer transfers, retried on short reads and writes
+static bool transfer(int fd, void *buffer, uint64_t bytes, bool reading) {
+  auto *cursor = static_cast<char *>(buffer);
+  while (bytes) {
+    ssize_t done = reading ? read(fd, cursor, bytes) : write(fd, cursor, bytes);
+    if (done < 0 && errno == EINTR)
+      continue;
+    if (done <= 0)
+      return false;
+    cursor += done;
+    bytes -= done;
+  }
+  return true;
+}
+
+bool InputCache::load(const std::string &key, void *destination,
+                      uint64_t bytes, const std::function<bool(void *)> &fill,
+                      bool &hit) {
+  fs::path filepath = fs::path(m_directory).append(key + ".bin");
+  hit = false;
+  if (bytes == 0)
+    return fill(destination);
+  int fd = open(filepath.c_str(), O_RDONLY);
+  struct stat file_stat;
+  if (fd >= 0 && fstat(fd, &file_stat) == 0 &&
+      static_cast<uint64_t>(file_stat.st_size) == bytes)
+    hit = transfer(fd, destination, bytes, true);
+  if (fd >= 0)
+    close(fd);
+  if (hit)
+    return true;
+
+  if (!fill(destination))
+    return false;
+  // Other workers only ever see complete files
+  fs::path partial = fs::path(m_directory)
+                         .append(key + "." + std::to_string(getpid()) +
+                                 ".partial");
+  int out = open(partial.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  bool written = out >= 0 && transfer(out, destination, bytes, false);
+  if (out >= 0)
+    close(out);
+  std::error_code error;
+  if (written)
+    fs::rename(partial, filepath, error);
+  if (!written || error) {
+    std::cerr << "Failed to cache " << filepath << ": "
+              << (error ? error.message() : std::strerror(errno)) << "\n";
+    fs::remove(partial, error);
+  }
+  return true;
+}
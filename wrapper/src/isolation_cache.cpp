@@ -0,0 +1,97 @@
+#include "isolation_cache.h"
+#include "kernel_index.h"
+#include "utils.h"
+
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <unistd.h>
+
+// Unique per process and thread, so concurrent writers never share one
+static std::string staging_suffix() {
+  std::ostringstream suffix;
+  suffix << ".tmp_" << getpid() << "_" << std::this_thread::get_id();
+  return suffix.str();
+}
+
+std::string IsolationCache::key(const fs::path &model_filepath,
+                                const fs::path &torch_opt_exec) {
+  std::error_code ec;
+  auto mtime = fs::last_write_time(torch_opt_exec, ec);
+  std::string toolchain =
+      torch_opt_exec.generic_string() + "@" +
+      std::to_string(ec ? 0 : mtime.time_since_epoch().count());
+  return hash_to_hex(
+      hash_string(toolchain, hash_file_contents(model_filepath)));
+}
+
+bool IsolationCache::restore(const fs::path &cache_dir, const std::string &key,
+                             const fs::path &lowering_folder) {
+  fs::path entry = fs::path(cache_dir).append(key);
+  if (!fs::exists(KernelIndex::filepath(entry)))
+    return false;
+  std::error_code ec;
+  fs::create_directories(lowering_folder, ec);
+  fs::copy(entry, lowering_folder,
+           fs::copy_options::recursive | fs::copy_options::overwrite_existing,
+           ec);
+  if (ec) {
+    std::cerr << "Could not restore the isolation from " << entry << ": "
+              << ec.message() << "\n";
+    return false;
+  }
+  std::cout << "Isolated kernels restored from " << entry << "\n";
+  return true;
+}
+
+bool IsolationCache::store(const fs::path &cache_dir, const std::string &key,
+                           const fs::path &lowering_folder) {
+  fs::path entry = fs::path(cache_dir).append(key);
+  fs::path staging = fs::path(entry).concat(staging_suffix());
+  std::error_code ec;
+  fs::create_directories(staging, ec);
+  fs::copy_file(KernelIndex::filepath(lowering_folder),
+                KernelIndex::filepath(staging), ec);
+  for (auto it = fs::recursive_directory_iterator(lowering_folder, ec);
+       !ec && it != fs::recursive_directory_iterator(); it.increment(ec)) {
+    if (!it->is_regular_file() ||
+        !KernelIndex::is_isolated_kernel(it->path()))
+      continue;
+    fs::path target =
+        staging / fs::relative(it->path(), lowering_folder, ec);
+    fs::create_directories(target.parent_path(), ec);
+    fs::copy_file(it->path(), target, ec);
+    if (ec)
+      break;
+  }
+  // Another run may have published the same entry first, both are equal
+  if (!ec)
+    fs::rename(staging, entry, ec);
+  bool stored = !ec;
+  fs::remove_all(staging, ec);
+  return stored;
+}
+
+void IsolationCache::store_metadata(const fs::path &cache_dir,
+                                    const std::string &key,
+                                    const fs::path &lowering_folder,
+                                    const std::vector<KernelTask> &tasks) {
+  fs::path entry = fs::path(cache_dir).append(key);
+  if (!fs::exists(entry))
+    return;
+  std::string suffix = staging_suffix();
+  std::error_code ec;
+  for (const KernelTask &task : tasks) {
+    if (!task.metadata_ready)
+      continue;
+    fs::path target =
+        entry / fs::relative(task.json_filepath, lowering_folder, ec);
+    if (ec || fs::exists(target))
+      continue;
+    fs::path staging = fs::path(target).concat(suffix);
+    fs::copy_file(task.json_filepath, staging, ec);
+    if (!ec)
+      fs::rename(staging, target, ec);
+    fs::remove(staging, ec);
+  }
+}
@@ -0,0 +1,221 @@
+#include "jit_engine.h"
+
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#ifdef MLIR_BENCH_ORC_JIT
+#include "llvm/ExecutionEngine/Orc/ExecutionUtils.h"
+#include "llvm/ExecutionEngine/Orc/JITTargetMachineBuilder.h"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/ExecutionEngine/Orc/ThreadSafeModule.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/TargetParser/SubtargetFeature.h"
+#include "llvm/Support/raw_ostream.h"
+#endif
+
+#ifdef MLIR_BENCH_ORC_JIT
+
+namespace {
+struct JITState {
+  std::unique_ptr<llvm::orc::LLJIT> jit;
+  std::map<uint64_t, llvm::orc::JITDylib *> kernel_dylibs;
+  uint64_t next_key = 1;
+  unsigned int vector_width = 0;
+  bool initialised = false;
+  std::mutex mutex;
+};
+
+JITState &jit_state() {
+  static JITState state;
+  return state;
+}
+
+void print_error(const std::string &context, llvm::Error err) {
+  std::string message;
+  llvm::raw_string_ostream stream(message);
+  stream << err;
+  std::cerr << context << ": " << stream.str() << std::endl;
+}
+} // namespace
+
+bool JITEngine::available() { return true; }
+
+bool JITEngine::initialise(const fs::path &llvm_lib_path,
+                           const std::string &target_cpu,
+                           const std::vector<std::string> &target_features,
+                           unsigned int vector_width, int codegen_opt_level,
+                           const std::vector<std::string> &runtime_libraries) {
+  JITState &state = jit_state();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  if (state.initialised)
+    return state.jit != nullptr;
+  state.initialised = true;
+  state.vector_width = vector_width;
+
+  llvm::InitializeNativeTarget();
+  llvm::InitializeNativeTargetAsmPrinter();
+
+  auto target_builder = llvm::orc::JITTargetMachineBuilder::detectHost();
+  if (!target_builder) {
+    print_error("Failed to detect the host target", target_builder.takeError());
+    return false;
+  }
+  if (!target_cpu.empty() && target_cpu != "native")
+    target_builder->setCPU(target_cpu);
+  for (const std::string &feature : target_features)
+    target_builder->getFeatures().AddFeature(feature);
+
+  static const llvm::CodeGenOptLevel opt_levels[] = {
+      llvm::CodeGenOptLevel::None, llvm::CodeGenOptLevel::Less,
+      llvm::CodeGenOptLevel::Default, llvm::CodeGenOptLevel::Aggressive};
+  target_builder->setCodeGenOptLevel(
+      opt_levels[std::clamp(codegen_opt_level, 0, 3)]);
+
+  auto jit = llvm::orc::LLJITBuilder()
+                 .setJITTargetMachineBuilder(std::move(*target_builder))
+                 .create();
+  if (!jit) {
+    print_error("Failed to create LLJIT", jit.takeError());
+    return false;
+  }
+  state.jit = std::move(*jit);
+
+  // Same runtime libraries the shared object path links against
+  char global_prefix = state.jit->getDataLayout().getGlobalPrefix();
+  std::vector<std::string> libraries = {"libmlir_runner_utils.so",
+                                        "libmlir_c_runner_utils.so"};
+  libraries.insert(libraries.end(), runtime_libraries.begin(),
+                   runtime_libraries.end());
+  for (const std::string &lib : libraries) {
+    fs::path lib_path = fs::path(llvm_lib_path).append(lib);
+    auto generator = llvm::orc::DynamicLibrarySearchGenerator::Load(
+        lib_path.c_str(), global_prefix);
+    if (!generator) {
+      print_error("Failed to load " + lib_path.generic_string(),
+                  generator.takeError());
+      state.jit.reset();
+      return false;
+    }
+    state.jit->getMainJITDylib().addGenerator(std::move(*generator));
+  }
+
+  return true;
+}
+
+void *JITEngine::load_kernel(const fs::path &ll_filepath,
+                             const std::string &symbol,
+                             uint64_t &resource_key) {
+  JITState &state = jit_state();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  if (!state.jit)
+    return nullptr;
+
+  auto context = std::make_unique<llvm::LLVMContext>();
+  llvm::SMDiagnostic diagnostic;
+  std::unique_ptr<llvm::Module> module =
+      llvm::parseIRFile(ll_filepath.generic_string(), diagnostic, *context);
+  if (!module) {
+    std::string message;
+    llvm::raw_string_ostream stream(message);
+    diagnostic.print("jit", stream);
+    std::cerr << "Failed to parse " << ll_filepath << ": " << stream.str()
+              << std::endl;
+    return nullptr;
+  }
+
+  if (state.vector_width)
+    for (llvm::Function &function : *module)
+      if (!function.isDeclaration())
+        function.addFnAttr("prefer-vector-width",
+                           std::to_string(state.vector_width));
+
+  uint64_t key = state.next_key++;
+  auto dylib = state.jit->createJITDylib("kernel_" + std::to_string(key));
+  if (!dylib) {
+    print_error("Failed to create JITDylib", dylib.takeError());
+    return nullptr;
+  }
+  dylib->addToLinkOrder(state.jit->getMainJITDylib());
+
+  if (llvm::Error err = state.jit->addIRModule(
+          *dylib,
+          llvm::orc::ThreadSafeModule(std::move(module), std::move(context)))) {
+    print_error("Failed to add module " + ll_filepath.generic_string(),
+                std::move(err));
+    return nullptr;
+  }
+
+  // Lookup triggers the actual compilation of the module
+  auto address = state.jit->lookup(*dylib, symbol);
+  if (!address) {
+    print_error("Failed to resolve " + symbol, address.takeError());
+    return nullptr;
+  }
+
+  state.kernel_dylibs[key] = &(*dylib);
+  resource_key = key;
+  return address->toPtr<void *>();
+}
+
+void *JITEngine::lookup(uint64_t resource_key, const std::string &symbol) {
+  JITState &state = jit_state();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  auto it = state.kernel_dylibs.find(resource_key);
+  if (it == state.kernel_dylibs.end() || !state.jit)
+    return nullptr;
+
+  auto address = state.jit->lookup(*it->second, symbol);
+  if (!address) {
+    llvm::consumeError(address.takeError());
+    return nullptr;
+  }
+  return address->toPtr<void *>();
+}
+
+void JITEngine::release(uint64_t resource_key) {
+  JITState &state = jit_state();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  auto it = state.kernel_dylibs.find(resource_key);
+  if (it == state.kernel_dylibs.end() || !state.jit)
+    return;
+
+  if (llvm::Error err =
+          state.jit->getExecutionSession().removeJITDylib(*it->second))
+    print_error("Failed to release kernel", std::move(err));
+  state.kernel_dylibs.erase(it);
+}
+
+#else
+
+bool JITEngine::available() { return false; }
+
+bool JITEngine::initialise(const fs::path &llvm_lib_path,
+                           const std::string &target_cpu,
+                           const std::vector<std::string> &target_features,
+                           unsigned int vector_width, int codegen_opt_level,
+                           const std::vector<std::string> &runtime_libraries) {
+  return false;
+}
+
+void *JITEngine::load_kernel(const fs::path &ll_filepath,
+                             const std::string &symbol,
+                             uint64_t &resource_key) {
+  return nullptr;
+}
+
+void *JITEngine::lookup(uint64_t resource_key, const std::string &symbol) {
+  return nullptr;
+}
+
+void JITEngine::release(uint64_t resource_key) {}
+
+#endif
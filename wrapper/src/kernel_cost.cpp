@@ -0,0 +1,203 @@
+#include "kernel_cost.h"
+
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <set>
+#include <sstream>
+
+// Op types whose loop nest reduces the whole first argument into the result
+static const std::set<std::string> REDUCTION_OPS = {
+    "adaptive_avg_pool2d", "mean", "sum", "amax", "amin", "max", "min",
+    "argmax", "argmin", "var", "std", "norm", "prod", "logsumexp"};
+
+// Ops that only move data
+static const std::set<std::string> DATA_MOVEMENT_OPS = {
+    "view", "reshape", "flatten", "unsqueeze", "squeeze", "permute",
+    "transpose", "t", "expand", "broadcast_to", "contiguous", "clone",
+    "copy", "slice", "select", "cat", "stack", "dropout", "detach", "pad",
+    "constant_pad_nd", "index_select", "gather", "to", "_to_copy"};
+
+// Elementwise ops of one operation per result element
+static const std::set<std::string> UNARY_BINARY_OPS = {
+    "add", "sub", "rsub", "mul", "div", "neg", "abs", "relu", "relu6",
+    "leaky_relu", "hardtanh", "clamp", "clamp_min", "clamp_max", "maximum",
+    "minimum", "exp", "log", "sqrt", "rsqrt", "reciprocal", "tanh", "erf",
+    "pow", "where", "eq", "ne", "lt", "le", "gt", "ge", "floor", "ceil",
+    "round", "sign", "masked_fill", "fill", "add_", "mul_", "relu_"};
+
+// FLOPs per result element of elementwise ops that are more than one
+// operation: normalisations (subtract, scale, shift) and softmax (max,
+// subtract, exp, sum, divide)
+static const std::map<std::string, double> ELEMENTWISE_FLOPS = {
+    {"batch_norm", 4.0},   {"native_batch_norm", 4.0}, {"layer_norm", 5.0},
+    {"group_norm", 5.0},   {"softmax", 5.0},           {"_softmax", 5.0},
+    {"log_softmax", 5.0},  {"_log_softmax", 5.0},      {"sigmoid", 4.0},
+    {"hardswish", 4.0},    {"hardsigmoid", 3.0},       {"silu", 5.0},
+    {"gelu", 8.0}};
+
+static double element_count(const json &tensor) {
+  double count = 1.0;
+  for (uint64_t dim : tensor.value("shape", std::vector<uint64_t>()))
+    count *= double(dim);
+  return count;
+}
+
+// Dims of `input` that are reduced into `result`: the rank difference, or
+// the differing extents if the reduction keeps its dims
+static int reduced_dims(const std::vector<uint64_t> &input,
+                        const std::vector<uint64_t> &result) {
+  if (input.size() != result.size())
+    return input.size() > result.size() ? int(input.size() - result.size())
+                                         : 0;
+  int reduced = 0;
+  for (size_t d = 0; d < input.size(); d++)
+    reduced += input[d] != result[d];
+  return reduced;
+}
+
+static std::vector<uint64_t> shape_of(const std::vector<json> &tensors,
+                                      size_t index) {
+  if (index >= tensors.size())
+    return {};
+  return tensors[index].value("shape", std::vector<uint64_t>());
+}
+
+std::vector<int64_t>
+KernelCosts::int_list_operand(const std::string &mlir_text,
+                              const std::string &op, size_t operand) {
+  // SSA name -> right hand side of its definition
+  std::map<std::string, std::string> definitions;
+  std::string op_operands;
+  std::stringstream lines(mlir_text);
+  std::string line;
+  const std::string op_prefix = "torch.aten." + op + " ";
+  while (std::getline(lines, line)) {
+    size_t name_start = line.find('%');
+    size_t assign = line.find(" = ");
+    if (name_start == std::string::npos || assign == std::string::npos ||
+        name_start > assign)
+      continue;
+    std::string rhs = line.substr(assign + 3);
+    definitions[line.substr(name_start, assign - name_start)] = rhs;
+    if (op_operands.empty() && rhs.rfind(op_prefix, 0) == 0)
+      op_operands = rhs.substr(op_prefix.size(), rhs.find(" :") -
+                                                     op_prefix.size());
+  }
+
+  auto split = [](const std::string &list) {
+    std::vector<std::string> names;
+    std::stringstream ss(list);
+    for (std::string name; std::getline(ss, name, ',');) {
+      name.erase(0, name.find_first_not_of(' '));
+      name.erase(name.find_last_not_of(' ') + 1);
+      if (!name.empty())
+        names.push_back(name);
+    }
+    return names;
+  };
+
+  std::vector<std::string> operands = split(op_operands);
+  if (operand >= operands.size())
+    return {};
+  const std::string list_prefix = "torch.prim.ListConstruct ";
+  const std::string &list = definitions[operands[operand]];
+  if (list.rfind(list_prefix, 0) != 0)
+    return {};
+
+  std::vector<int64_t> values;
+  const std::string int_prefix = "torch.constant.int ";
+  for (const std::string &element : split(
+           list.substr(list_prefix.size(),
+                       list.find(" :") - list_prefix.size()))) {
+    const std::string &constant = definitions[element];
+    if (constant.rfind(int_prefix, 0) != 0)
+      return {};
+    values.push_back(std::stoll(constant.substr(int_prefix.size())));
+  }
+  return values;
+}
+
+KernelCost KernelCosts::estimate(const std::string &op_type,
+                                 const json &metadata,
+                                 const std::string &mlir_text) {
+  KernelCost cost;
+  const json &signature = metadata["kernel_call"];
+  std::vector<json> args = signature.value("args", std::vector<json>());
+  std::vector<json> returns = signature.value("returns", std::vector<json>());
+  if (args.empty() || returns.empty())
+    return cost;
+
+  double result_elements = element_count(returns[0]);
+  double reduction = 1.0;
+  double flops_per_iteration = 1.0;
+  double bias_flops = 0.0;
+  cost.modelled = true;
+  // The result shape is known even when the op is not
+  cost.num_parallel = int(shape_of(returns, 0).size());
+
+  std::vector<uint64_t> lhs = shape_of(args, 0);
+  std::vector<uint64_t> rhs = shape_of(args, 1);
+  if (op_type == "convolution" || op_type == "conv2d" ||
+      op_type == "_convolution") {
+    if (rhs.empty() || rhs[0] == 0)
+      return KernelCost();
+    reduction = element_count(args[1]) / double(rhs[0]);
+    cost.num_reduction = int(rhs.size()) - 1;
+    flops_per_iteration = 2.0;
+    if (args.size() > 2 && shape_of(args, 2).size() == 1)
+      bias_flops = result_elements;
+  } else if (op_type == "linear") {
+    if (rhs.empty())
+      return KernelCost();
+    reduction = double(rhs.back());
+    cost.num_reduction = 1;
+    flops_per_iteration = 2.0;
+    if (args.size() > 2 && !shape_of(args, 2).empty())
+      bias_flops = result_elements;
+  } else if (op_type == "matmul" || op_type == "mm" || op_type == "bmm") {
+    if (lhs.empty())
+      return KernelCost();
+    reduction = double(lhs.back());
+    cost.num_reduction = 1;
+    flops_per_iteration = 2.0;
+  } else if (op_type == "addmm" || op_type == "baddbmm") {
+    std::vector<uint64_t> mat1 = shape_of(args, 1);
+    if (mat1.empty())
+      return KernelCost();
+    reduction = double(mat1.back());
+    cost.num_reduction = 1;
+    flops_per_iteration = 2.0;
+    bias_flops = result_elements;
+  } else if (op_type == "max_pool2d" || op_type == "max_pool2d_with_indices" ||
+             op_type == "avg_pool2d") {
+    std::vector<int64_t> window = int_list_operand(mlir_text, op_type, 1);
+    if (!window.empty()) {
+      for (int64_t extent : window)
+        reduction *= double(std::max<int64_t>(1, extent));
+      cost.num_reduction = int(window.size());
+    } else if (result_elements > 0.0) {
+      reduction = std::max(1.0, element_count(args[0]) / result_elements);
+      cost.num_reduction = reduced_dims(lhs, shape_of(returns, 0));
+    }
+  } else if (REDUCTION_OPS.count(op_type)) {
+    if (result_elements > 0.0)
+      reduction = std::max(1.0, element_count(args[0]) / result_elements);
+    cost.num_reduction = reduced_dims(lhs, shape_of(returns, 0));
+  } else if (DATA_MOVEMENT_OPS.count(op_type)) {
+    flops_per_iteration = 0.0;
+  } else if (auto it = ELEMENTWISE_FLOPS.find(op_type);
+             it != ELEMENTWISE_FLOPS.end()) {
+    flops_per_iteration = it->second;
+  } else if (!UNARY_BINARY_OPS.count(op_type)) {
+    // Guessing one FLOP per element would pass for a count
+    cost.modelled = false;
+    cost.iterations = std::numeric_limits<double>::quiet_NaN();
+    cost.flops = std::numeric_limits<double>::quiet_NaN();
+    return cost;
+  }
+
+  cost.iterations = result_elements * reduction;
+  cost.flops = cost.iterations * flops_per_iteration + bias_flops;
+  return cost;
+}
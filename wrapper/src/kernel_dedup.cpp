@@ -0,0 +1,182 @@
+#include "kernel_dedup.h"
+#include "utils.h"
+
+#include <cctype>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <unordered_map>
+
+/*
+ * Strips everything that does not change the kernel's semantics:
+ *    - location aliases (#loc = loc(...)) and inline loc(...) attributes
+ *    - comments
+ *    - indentation and whitespace runs
+ */
+std::string KernelDedup::normalize_kernel(const std::string &mlir_text) {
+  std::istringstream input(mlir_text);
+  std::ostringstream output;
+  std::string line;
+
+  while (std::getline(input, line)) {
+    if (line.rfind("#loc", 0) == 0)
+      continue;
+
+    std::string cleaned;
+    cleaned.reserve(line.size());
+    bool pending_space = false;
+
+    for (size_t i = 0; i < line.size(); i++) {
+      // Comments run until the end of the line
+      if (line.compare(i, 2, "//") == 0)
+        break;
+
+      // Inline location: loc(...) with nested parentheses
+      if (line.compare(i, 4, "loc(") == 0 &&
+          (i == 0 || !std::isalnum((unsigned char)line[i - 1]))) {
+        int depth = 0;
+        size_t j = i + 3;
+        for (; j < line.size(); j++) {
+          if (line[j] == '(')
+            depth++;
+          else if (line[j] == ')' && --depth == 0)
+            break;
+        }
+        i = j;
+        continue;
+      }
+
+      char c = line[i];
+      if (std::isspace((unsigned char)c)) {
+        pending_space = !cleaned.empty();
+        continue;
+      }
+      if (pending_space)
+        cleaned += ' ';
+      pending_space = false;
+      cleaned += c;
+    }
+
+    if (!cleaned.empty())
+      output << cleaned << '\n';
+  }
+
+  return output.str();
+}
+
+std::string KernelDedup::kernel_signature(const KernelTask &task) {
+  std::ifstream kernel_file(task.mlir_filepath);
+  std::ostringstream contents;
+  contents << kernel_file.rdbuf();
+
+  uint64_t hash = hash_string(KernelDedup::normalize_kernel(contents.str()));
+
+  // Canonical dump, independent of key order and formatting
+  json metadata = load_json_from_file(task.json_filepath);
+  hash = hash_string(metadata.dump(), hash);
+
+  return hash_to_hex(hash);
+}
+
+std::vector<KernelTask>
+KernelDedup::deduplicate(std::vector<KernelTask> &tasks) {
+  std::vector<KernelTask> unique_tasks;
+  std::unordered_map<std::string, size_t> group_index;
+
+  for (KernelTask &task : tasks) {
+    // Kernels without metadata can't be compared, keep them on their own
+    if (!task.metadata_ready) {
+      unique_tasks.push_back(task);
+      continue;
+    }
+
+    task.kernel_hash = KernelDedup::kernel_signature(task);
+    auto it = group_index.find(task.kernel_hash);
+    if (it == group_index.end()) {
+      group_index[task.kernel_hash] = unique_tasks.size();
+      unique_tasks.push_back(task);
+      continue;
+    }
+
+    KernelTask &representative = unique_tasks[it->second];
+    representative.multiplicity++;
+    representative.duplicate_filepaths.push_back(task.mlir_filepath);
+  }
+
+  std::cout << "Deduplication: " << tasks.size() << " kernels, "
+            << unique_tasks.size() << " unique\n";
+  return unique_tasks;
+}
+
+bool KernelDedup::write_groups(const std::vector<KernelTask> &unique_tasks,
+                               const fs::path &csv_filepath) {
+  std::ofstream csv(csv_filepath);
+  if (!csv.is_open()) {
+    std::cerr << "Error: Could not open " << csv_filepath
+              << " for writing.\n";
+    return false;
+  }
+
+  csv << "kernel_hash,op_type,representative,multiplicity,occurrences\n";
+  for (const KernelTask &task : unique_tasks) {
+    csv << task.kernel_hash << "," << task.op_type << ","
+        << task.mlir_filepath.filename().generic_string() << ","
+        << task.multiplicity << ",";
+
+    csv << task.mlir_filepath.filename().generic_string();
+    for (const fs::path &duplicate : task.duplicate_filepaths)
+      csv << ";" << duplicate.filename().generic_string();
+    csv << "\n";
+  }
+  return true;
+}
+
+bool KernelDedup::write_weighted_totals(
+    const std::vector<KernelTask> &unique_tasks,
+    const std::vector<std::string> &metrics, const fs::path &csv_filepath) {
+  std::map<std::string, std::map<std::string, double>> op_totals;
+  std::map<std::string, unsigned int> op_kernel_counts;
+  std::map<std::string, double> model_totals;
+  unsigned int model_kernel_count = 0;
+
+  for (const KernelTask &task : unique_tasks) {
+    if (!task.measured || !task.failure.empty())
+      continue;
+
+    op_kernel_counts[task.op_type] += task.multiplicity;
+    model_kernel_count += task.multiplicity;
+    for (const std::string &metric : metrics) {
+      auto it = task.average_metrics.find(metric);
+      double weighted =
+          (it == task.average_metrics.end() ? 0.0 : it->second) *
+          task.multiplicity;
+      op_totals[task.op_type][metric] += weighted;
+      model_totals[metric] += weighted;
+    }
+  }
+
+  std::ofstream csv(csv_filepath);
+  if (!csv.is_open()) {
+    std::cerr << "Error: Could not open " << csv_filepath
+              << " for writing.\n";
+    return false;
+  }
+
+  csv << "scope,kernels";
+  for (const std::string &metric : metrics)
+    csv << "," << metric;
+  csv << "\n";
+
+  for (const auto &[op_type, totals] : op_totals) {
+    csv << op_type << "," << op_kernel_counts[op_type];
+    for (const std::string &metric : metrics)
+      csv << "," << totals.at(metric);
+    csv << "\n";
+  }
+
+  csv << "model," << model_kernel_count;
+  for (const std::string &metric : metrics)
+    csv << "," << model_totals[metric];
+  csv << "\n";
+  return true;
+}
@@ -0,0 +1,123 @@
+#include "kernel_index.h"
+#include "kernel_dedup.h"
+#include "kernel_metadata.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <regex>
+#include <sstream>
+
+fs::path KernelIndex::filepath(const fs::path &lowering_folder) {
+  return fs::path(lowering_folder).append("kernel_index.json");
+}
+
+bool KernelIndex::is_isolated_kernel(const fs::path &filepath) {
+  if (filepath.extension() != ".mlir")
+    return false;
+  std::string stage = filepath.stem().extension().string();
+  return stage != ".linalg" && stage != ".llvm";
+}
+
+// "1x3x224x224xf32" for every argument or return of the metadata
+static json shape_strings(const json &values) {
+  json shapes = json::array();
+  for (const json &value : values) {
+    std::string text;
+    for (const json &dim : value.at("shape"))
+      text += std::to_string(dim.get<int64_t>()) + "x";
+    shapes.push_back(text + value.at("dtype").get<std::string>());
+  }
+  return shapes;
+}
+
+static json index_entry(const std::string &op_type, const fs::path &kernel,
+                        const fs::path &lowering_folder) {
+  std::ifstream file(kernel);
+  std::stringstream contents;
+  contents << file.rdbuf();
+  std::string text = contents.str();
+
+  // loc("model.py":12:8), inline or behind a #loc alias
+  static const std::regex location(
+      R"re(loc\("([^"]*)":(\d+):(\d+)\))re");
+  std::smatch match;
+  std::string source;
+  if (std::regex_search(text, match, location))
+    source = match[1].str() + ":" + match[2].str() + ":" + match[3].str();
+
+  json entry = {
+      {"op_type", op_type},
+      {"kernel", fs::relative(kernel, lowering_folder).generic_string()},
+      {"location", source},
+      {"args", json::array()},
+      {"returns", json::array()},
+      {"hash", hash_to_hex(hash_string(KernelDedup::normalize_kernel(text)))}};
+  json metadata;
+  if (KernelMetadata::extract_from_kernel(kernel, metadata)) {
+    entry["args"] = shape_strings(metadata["kernel_call"]["args"]);
+    entry["returns"] = shape_strings(metadata["kernel_call"]["returns"]);
+  }
+  return entry;
+}
+
+bool KernelIndex::build(const fs::path &lowering_folder) {
+  if (!fs::is_directory(lowering_folder)) {
+    std::cerr << "Isolation seems to have failed, no " << lowering_folder
+              << "\n";
+    return false;
+  }
+
+  std::vector<fs::path> op_folders;
+  for (const auto &entry : fs::directory_iterator(lowering_folder))
+    if (entry.is_directory())
+      op_folders.push_back(entry.path());
+  std::sort(op_folders.begin(), op_folders.end());
+
+  json kernels = json::array();
+  for (const fs::path &op_folder : op_folders) {
+    std::vector<fs::path> kernel_files;
+    for (const auto &entry : fs::directory_iterator(op_folder))
+      if (entry.is_regular_file() &&
+          KernelIndex::is_isolated_kernel(entry.path()))
+        kernel_files.push_back(entry.path());
+    std::sort(kernel_files.begin(), kernel_files.end());
+    for (const fs::path &kernel : kernel_files)
+      kernels.push_back(index_entry(op_folder.filename().string(), kernel,
+                                    lowering_folder));
+  }
+
+  fs::path index_filepath = KernelIndex::filepath(lowering_folder);
+  std::ofstream index(index_filepath);
+  if (!index.is_open()) {
+    std::cerr << "Error: Could not open " << index_filepath
+              << " for writing.\n";
+    return false;
+  }
+  index << json({{"kernels", kernels}}).dump(2) << "\n";
+  std::cout << "Indexed " << kernels.size() << " kernels of "
+            << op_folders.size() << " op types in " << index_filepath << "\n";
+  return true;
+}
+
+bool KernelIndex::load(const fs::path &lowering_folder,
+                       std::vector<KernelTask> &tasks) {
+  fs::path index_filepath = KernelIndex::filepath(lowering_folder);
+  if (!fs::exists(index_filepath)) {
+    std::cerr << "No kernel index at " << index_filepath
+              << ", isolation seems to have failed\n";
+    return false;
+  }
+
+  json index = load_json_from_file(index_filepath);
+  for (const json &entry : index.value("kernels", json::array())) {
+    KernelTask task;
+    task.op_type = entry.at("op_type").get<std::string>();
+    task.mlir_filepath =
+        fs::path(lowering_folder) / entry.at("kernel").get<std::string>();
+    task.json_filepath = fs::path(task.mlir_filepath).concat(".json");
+    tasks.push_back(task);
+  }
+  return true;
+}
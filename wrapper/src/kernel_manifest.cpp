@@ -0,0 +1,166 @@
+#include "kernel_manifest.h"
+#include "kernel_dedup.h"
+#include "linalg_structure.h"
+#include "model_layers.h"
+#include "result_writer.h"
+#include "utils.h"
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+static std::string file_hash(const fs::path &filepath) {
+  std::ifstream file(filepath, std::ios::binary);
+  if (!file.is_open())
+    return "";
+  std::stringstream contents;
+  contents << file.rdbuf();
+  return hash_to_hex(hash_string(contents.str()));
+}
+
+KernelManifest::KernelManifest(const fs::path &filepath,
+                               const fs::path &lowering_folder,
+                               const std::string &pipeline_hash,
+                               const std::string &measurement_hash,
+                               const std::vector<std::string> &columns)
+    : m_filepath(filepath), m_lowering_folder(lowering_folder),
+      m_pipeline_hash(pipeline_hash), m_measurement_hash(measurement_hash) {
+  if (fs::exists(filepath))
+    m_manifest = load_json_from_file(filepath);
+  // Averages of other columns can't stand in for this run's
+  if (m_manifest.value("columns", json(columns)) != json(columns)) {
+    std::cerr << "Warning: " << filepath
+              << " was written with other metrics, ignoring its kernels\n";
+    m_manifest["kernels"] = json::object();
+  }
+  m_manifest["columns"] = columns;
+  if (!m_manifest.contains("kernels"))
+    m_manifest["kernels"] = json::object();
+}
+
+std::string KernelManifest::pipeline_hash(const fs::path &pipeline_json) {
+  return file_hash(pipeline_json);
+}
+
+std::string KernelManifest::ll_hash(const fs::path &ll_filepath) {
+  return file_hash(ll_filepath);
+}
+
+std::string KernelManifest::key(const KernelTask &task) const {
+  return fs::relative(task.mlir_filepath, m_lowering_folder).generic_string();
+}
+
+void KernelManifest::record(const KernelTask &task,
+                            const fs::path &output_folder) {
+  json entry = {
+      {"source_hash", task.kernel_hash.empty()
+                          ? KernelDedup::kernel_signature(task)
+                          : task.kernel_hash},
+      {"ll_hash", task.ll_filepath.empty()
+                      ? std::string()
+                      : KernelManifest::ll_hash(task.ll_filepath)},
+      {"pipeline_hash", m_pipeline_hash},
+      {"measurement_hash", m_measurement_hash},
+      {"status", task.skipped_budget  ? "skipped_budget"
+                 : task.failure.empty() ? "measured"
+                                        : "failed"},
+      {"layers", ModelLayers::layers_of(task)},
+      {"structure", LinalgStructures::to_json(task.mlir_filepath)},
+      {"results", json::array()},
+      {"averages",
+       {{"main", task.average_metrics},
+        {"cold", task.cold_average_metrics},
+        {"layouts", task.layout_average_metrics},
+        {"threads", task.thread_average_metrics},
+        {"densities", task.density_average_metrics},
+        {"profiles", task.profile_average_metrics},
+        {"pipelines", task.pipeline_average_metrics},
+        {"baselines", task.baseline_average_metrics},
+        {"contentions", task.contention_average_metrics},
+        {"shapes", task.dynamic_shape_average_metrics},
+        {"replicas", task.replica_average_metrics}}}};
+  for (const fs::path &result : task.result_filepaths)
+    entry["results"].push_back(
+        fs::relative(result, output_folder).generic_string());
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_manifest["kernels"][key(task)] = entry;
+  // Queued behind the kernel's results, so it never lists unwritten files
+  ResultWriter::replace(m_filepath, m_manifest.dump(2) + "\n");
+}
+
+const json *KernelManifest::measured_entry(const KernelTask &task) const {
+  const json &kernels = m_manifest.at("kernels");
+  auto entry = kernels.find(key(task));
+  if (entry == kernels.end() ||
+      entry->value("status", "") != "measured")
+    return nullptr;
+  return &*entry;
+}
+
+static void restore_averages(const json &averages, KernelTask &task) {
+  averages.at("main").get_to(task.average_metrics);
+  averages.at("cold").get_to(task.cold_average_metrics);
+  averages.at("layouts").get_to(task.layout_average_metrics);
+  averages.at("threads").get_to(task.thread_average_metrics);
+  averages.at("densities").get_to(task.density_average_metrics);
+  averages.at("profiles").get_to(task.profile_average_metrics);
+  averages.at("pipelines").get_to(task.pipeline_average_metrics);
+  // Absent from manifests written before --torch-baseline
+  averages.value("baselines", json::object())
+      .get_to(task.baseline_average_metrics);
+  averages.value("contentions", json::object())
+      .get_to(task.contention_average_metrics);
+  averages.value("shapes", json::object())
+      .get_to(task.dynamic_shape_average_metrics);
+  // Keyed by count, which json stores as [count, averages] pairs
+  averages.value("replicas", json::array())
+      .get_to(task.replica_average_metrics);
+  task.prepared = task.measured = true;
+}
+
+bool KernelManifest::restore(KernelTask &task) const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  const json *entry = measured_entry(task);
+  if (!entry || entry->value("pipeline_hash", "") != m_pipeline_hash ||
+      entry->value("measurement_hash", "") != m_measurement_hash)
+    return false;
+  std::string source_hash = task.kernel_hash.empty()
+                                ? KernelDedup::kernel_signature(task)
+                                : task.kernel_hash;
+  if (entry->value("source_hash", "") != source_hash)
+    return false;
+  for (const json &result : entry->at("results"))
+    task.result_filepaths.push_back(fs::path(m_filepath).parent_path().append(
+        result.get<std::string>()));
+  restore_averages(entry->at("averages"), task);
+  return true;
+}
+
+bool KernelManifest::reuse(KernelTask &task, const fs::path &previous_output,
+                           const fs::path &output_folder) const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  const json *entry = measured_entry(task);
+  std::string ll_hash = KernelManifest::ll_hash(task.ll_filepath);
+  // Same code measured with other flags, inputs or sampling is not reusable
+  if (!entry || ll_hash.empty() || entry->value("ll_hash", "") != ll_hash ||
+      entry->value("measurement_hash", "") != m_measurement_hash)
+    return false;
+
+  std::vector<fs::path> copied;
+  for (const json &result : entry->at("results")) {
+    fs::path source = fs::path(previous_output) / result.get<std::string>();
+    fs::path target = fs::path(output_folder) / result.get<std::string>();
+    std::error_code error;
+    fs::create_directories(target.parent_path(), error);
+    fs::copy_file(source, target, fs::copy_options::overwrite_existing,
+                  error);
+    // Rather measure again than report a partial kernel
+    if (error)
+      return false;
+    copied.push_back(target);
+  }
+  task.result_filepaths = copied;
+  restore_averages(entry->at("averages"), task);
+  return true;
+}
@@ -0,0 +1,329 @@
+#include "kernel_metadata.h"
+#include "utils.h"
+
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+
+static std::string trim(const std::string &s) {
+  size_t begin = s.find_first_not_of(" \t\n\r");
+  if (begin == std::string::npos)
+    return "";
+  size_t end = s.find_last_not_of(" \t\n\r");
+  return s.substr(begin, end - begin + 1);
+}
+
+// Splits on commas which are not nested inside (), [], <> or {}
+static std::vector<std::string> split_top_level(const std::string &s) {
+  std::vector<std::string> parts;
+  int depth = 0;
+  std::string current;
+  for (char c : s) {
+    if (c == '(' || c == '[' || c == '<' || c == '{')
+      depth++;
+    else if (c == ')' || c == ']' || c == '>' || c == '}')
+      depth--;
+
+    if (c == ',' && depth == 0) {
+      parts.push_back(trim(current));
+      current.clear();
+      continue;
+    }
+    current += c;
+  }
+  if (!trim(current).empty())
+    parts.push_back(trim(current));
+  return parts;
+}
+
+// Returns the index of the bracket closing the one at `open`
+static size_t find_matching(const std::string &s, size_t open) {
+  char open_c = s[open];
+  char close_c = open_c == '(' ? ')' : open_c == '<' ? '>' : ']';
+  int depth = 0;
+  for (size_t i = open; i < s.size(); i++) {
+    if (s[i] == open_c)
+      depth++;
+    else if (s[i] == close_c && --depth == 0)
+      return i;
+  }
+  return std::string::npos;
+}
+
+bool KernelMetadata::parse_tensor_type(const std::string &type_str,
+                                       json &argument) {
+  std::string type = trim(type_str);
+  std::vector<uint64_t> shape;
+  std::string dtype;
+  std::string layout;
+
+  auto parse_dim = [&shape](const std::string &dim) {
+    std::string d = trim(dim);
+    if (d.empty() || d == "?" || d.find_first_not_of("0123456789") !=
+                                     std::string::npos)
+      return false;
+    shape.push_back(std::stoull(d));
+    return true;
+  };
+
+  if (type.rfind("!torch.vtensor<", 0) == 0) {
+    // !torch.vtensor<[1,3,224,224],f32>
+    size_t open = type.find('[');
+    size_t close = type.find(']');
+    if (open == std::string::npos || close == std::string::npos)
+      return false;
+
+    std::string dims = type.substr(open + 1, close - open - 1);
+    std::stringstream ss(dims);
+    std::string dim;
+    while (std::getline(ss, dim, ','))
+      if (!parse_dim(dim))
+        return false;
+
+    size_t comma = type.find(',', close);
+    size_t end = type.rfind('>');
+    if (comma == std::string::npos || end == std::string::npos)
+      return false;
+    dtype = trim(type.substr(comma + 1, end - comma - 1));
+  } else if (type.rfind("tensor<", 0) == 0 || type.rfind("memref<", 0) == 0) {
+    // tensor<1x3x224x224xf32>
+    size_t open = type.find('<');
+    size_t end = type.rfind('>');
+    std::string body = type.substr(open + 1, end - open - 1);
+    size_t layout_comma = body.find(',');
+    if (layout_comma != std::string::npos && type.rfind("memref<", 0) == 0)
+      layout = trim(body.substr(layout_comma + 1));
+    body = body.substr(0, layout_comma); // Drop layouts / encodings
+
+    std::stringstream ss(body);
+    std::string part;
+    std::vector<std::string> parts;
+    while (std::getline(ss, part, 'x'))
+      parts.push_back(part);
+    if (parts.empty())
+      return false;
+
+    dtype = trim(parts.back());
+    parts.pop_back();
+    for (const std::string &d : parts)
+      if (!parse_dim(d))
+        return false;
+  } else {
+    return false;
+  }
+
+  if (dtype.empty())
+    return false;
+
+  argument = json{{"dtype", dtype}, {"rank", shape.size()}, {"shape", shape}};
+
+  // memref<4x8xf32, strided<[16, 1], offset: 2>>. Dynamic strides or offsets
+  // and affine maps are only recorded verbatim.
+  if (!layout.empty()) {
+    argument["layout"] = layout;
+    size_t strides_open = layout.find("strided<[");
+    size_t strides_close = layout.find(']');
+    if (strides_open != std::string::npos &&
+        strides_close != std::string::npos &&
+        layout.find('?') == std::string::npos) {
+      std::vector<int64_t> strides;
+      std::stringstream ss(
+          layout.substr(strides_open + 9, strides_close - strides_open - 9));
+      std::string stride;
+      while (std::getline(ss, stride, ','))
+        strides.push_back(std::stoll(trim(stride)));
+
+      int64_t offset = 0;
+      size_t offset_pos = layout.find("offset:");
+      if (offset_pos != std::string::npos)
+        offset = std::stoll(trim(layout.substr(offset_pos + 7)));
+
+      if (strides.size() == shape.size()) {
+        argument["strides"] = strides;
+        argument["offset"] = offset;
+      }
+    }
+  }
+  return true;
+}
+
+bool KernelMetadata::extract_from_kernel(const fs::path &mlir_filepath,
+                                         json &metadata) {
+  std::ifstream kernel_file(mlir_filepath);
+  std::ostringstream contents;
+  contents << kernel_file.rdbuf();
+  std::string text = contents.str();
+
+  size_t func_pos = text.find("@kernel_call(");
+  if (func_pos == std::string::npos)
+    return false;
+
+  size_t args_open = text.find('(', func_pos);
+  size_t args_close = find_matching(text, args_open);
+  if (args_close == std::string::npos)
+    return false;
+
+  json args = json::array();
+  for (const std::string &arg :
+       split_top_level(text.substr(args_open + 1, args_close - args_open - 1))) {
+    // %arg0: !torch.vtensor<[...],f32> {attributes}
+    size_t colon = arg.find(':');
+    if (colon == std::string::npos)
+      return false;
+    std::string type = trim(arg.substr(colon + 1));
+    size_t attr = type.find(" {");
+    if (attr != std::string::npos)
+      type = type.substr(0, attr);
+
+    json argument;
+    if (!KernelMetadata::parse_tensor_type(type, argument))
+      return false;
+    args.push_back(argument);
+  }
+
+  // Results: -> type | -> (type, type) ending at the function body
+  json returns = json::array();
+  size_t body_open = text.find('{', args_close);
+  size_t arrow = text.find("->", args_close);
+  if (arrow != std::string::npos && arrow < body_open) {
+    std::string results = trim(text.substr(arrow + 2, body_open - arrow - 2));
+    size_t attributes = results.find(" attributes");
+    if (attributes != std::string::npos)
+      results = trim(results.substr(0, attributes));
+    if (!results.empty() && results.front() == '(')
+      results = results.substr(1, find_matching(results, 0) - 1);
+
+    for (const std::string &result : split_top_level(results)) {
+      json argument;
+      if (!KernelMetadata::parse_tensor_type(result, argument))
+        return false;
+      returns.push_back(argument);
+    }
+  }
+
+  metadata = json{{"kernel_call", {{"args", args}, {"returns", returns}}}};
+  return true;
+}
+
+// Value of an SSA operand: kernel arguments by index, constants by value
+static bool operand_value(const std::string &operand,
+                          const std::map<std::string, json> &constants,
+                          json &value) {
+  if (operand.rfind("%arg", 0) == 0 &&
+      operand.find_first_not_of("0123456789", 4) == std::string::npos &&
+      operand.size() > 4) {
+    value = json{{"arg", std::stoi(operand.substr(4))}};
+    return true;
+  }
+  auto constant = constants.find(operand);
+  if (constant == constants.end())
+    return false;
+  value = constant->second;
+  return true;
+}
+
+bool KernelMetadata::extract_op(const fs::path &mlir_filepath, json &op) {
+  std::ifstream kernel_file(mlir_filepath);
+  std::map<std::string, json> constants;
+  bool found = false;
+  for (std::string line; std::getline(kernel_file, line);) {
+    // %name = torch.constant.int 4 loc(#loc3)
+    size_t location = line.find(" loc(");
+    if (location != std::string::npos)
+      line = line.substr(0, location);
+    size_t equals = line.find(" = ");
+    if (equals == std::string::npos)
+      continue;
+    std::string result = trim(line.substr(0, equals));
+    result = result.substr(0, result.find(':')); // %0:2 = ...
+    std::string rest = trim(line.substr(equals + 3));
+    size_t space = rest.find(' ');
+    std::string name = rest.substr(0, space);
+    std::string body =
+        space == std::string::npos ? "" : trim(rest.substr(space + 1));
+    // Operands end at the type list, which may be all there is
+    std::string typed = " " + body;
+    std::string operands = trim(typed.substr(0, typed.find(" : ")));
+
+    try {
+      if (name == "torch.constant.int")
+        constants[result] = std::stoll(body);
+      else if (name == "torch.constant.float")
+        constants[result] = std::stod(body);
+      else if (name == "torch.constant.bool")
+        constants[result] = body == "true";
+      else if (name == "torch.constant.none")
+        constants[result] = nullptr;
+      else if (name == "torch.constant.str" ||
+               name == "torch.constant.device")
+        constants[result] = body.size() >= 2 && body.front() == '"'
+                                ? body.substr(1, body.rfind('"') - 1)
+                                : body;
+    } catch (const std::exception &) {
+      continue;
+    }
+
+    if (name == "torch.prim.ListConstruct") {
+      json list = json::array();
+      bool constant = true;
+      for (const std::string &operand : split_top_level(operands)) {
+        json value;
+        constant = constant && operand_value(operand, constants, value);
+        list.push_back(value);
+      }
+      if (constant)
+        constants[result] = list;
+    }
+
+    // Fused subgraphs (several aten ops) have no single torch equivalent
+    if (name.rfind("torch.aten.", 0) != 0)
+      continue;
+    if (found)
+      return false;
+    json values = json::array();
+    for (const std::string &operand : split_top_level(operands)) {
+      json value;
+      if (!operand_value(operand, constants, value))
+        return false;
+      values.push_back(value);
+    }
+    op = json{{"name", name.substr(6)}, {"operands", values}};
+    found = true;
+  }
+  return found;
+}
+
+size_t KernelMetadata::emit_for_isolated_kernels(
+    std::vector<KernelTask> &tasks, const fs::path &manifest_filepath) {
+  json manifest = json::object();
+  size_t emitted = 0;
+
+  for (KernelTask &task : tasks) {
+    json metadata;
+    if (!KernelMetadata::extract_from_kernel(task.mlir_filepath, metadata)) {
+      std::cerr << "Signature metadata unavailable for " << task.mlir_filepath
+                << ", using the metadata pass\n";
+      continue;
+    }
+    // For the --torch-baseline, kernels without one just go without
+    json op;
+    if (KernelMetadata::extract_op(task.mlir_filepath, op))
+      metadata["op"] = op;
+
+    std::ofstream sidecar(task.json_filepath);
+    sidecar << metadata.dump(2);
+    sidecar.close();
+
+    manifest[task.mlir_filepath.generic_string()] = metadata;
+    task.metadata_ready = true;
+    emitted++;
+  }
+
+  std::ofstream manifest_stream(manifest_filepath);
+  manifest_stream << manifest.dump(2);
+
+  std::cout << "Metadata emitted during isolation for " << emitted << "/"
+            << tasks.size() << " kernels\n";
+  return emitted;
+}
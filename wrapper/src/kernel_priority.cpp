@@ -0,0 +1,137 @@
+#include "kernel_priority.h"
+#include "kernel_cost.h"
+#include "kernel_dedup.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+
+std::vector<std::string> KernelPriority::parse_ops(const std::string &list) {
+  std::vector<std::string> ops;
+  std::stringstream ss(list);
+  for (std::string op; std::getline(ss, op, ',');)
+    if (!op.empty())
+      ops.push_back(op.rfind("aten.", 0) == 0 ? op.substr(5) : op);
+  return ops;
+}
+
+bool KernelPriority::op_selected(const std::string &op_type,
+                                 const std::vector<std::string> &ops) {
+  if (ops.empty())
+    return true;
+  std::string name = op_type.rfind("aten.", 0) == 0 ? op_type.substr(5)
+                                                    : op_type;
+  return std::any_of(ops.begin(), ops.end(), [&name](const std::string &op) {
+    return name.rfind(op, 0) == 0;
+  });
+}
+
+static double estimated_flops(const KernelTask &task) {
+  json metadata = load_json_from_file(task.json_filepath);
+  std::ifstream kernel_file(task.mlir_filepath);
+  std::stringstream kernel_text;
+  kernel_text << kernel_file.rdbuf();
+  KernelCost cost =
+      KernelCosts::estimate(task.op_type, metadata, kernel_text.str());
+  return cost.modelled ? cost.flops : 0.0;
+}
+
+std::string KernelPriority::assign(std::vector<KernelTask> &tasks,
+                                   const fs::path &prior_output,
+                                   const std::string &metric,
+                                   const fs::path &lowering_folder) {
+  // Metric of every measured kernel of the prior run, by hash and by path
+  std::map<std::string, double> by_hash, by_path;
+  if (!prior_output.empty()) {
+    fs::path manifest_filepath =
+        fs::path(prior_output).append("kernel_manifest.json");
+    if (fs::exists(manifest_filepath)) {
+      json manifest = load_json_from_file(manifest_filepath);
+      // Outlives the loop, items() only refers to it
+      json kernels = manifest.value("kernels", json::object());
+      for (const auto &[path, entry] : kernels.items()) {
+        if (entry.value("status", "") != "measured")
+          continue;
+        json main = entry["averages"].value("main", json::object());
+        if (!main.contains(metric))
+          continue;
+        double value = main[metric].get<double>();
+        by_hash[entry.value("source_hash", "")] = value;
+        by_path[path] = value;
+      }
+    } else {
+      std::cerr << "No kernel_manifest.json in " << prior_output
+                << ", kernels are prioritised by FLOPs\n";
+    }
+  }
+
+  std::vector<double> flops(tasks.size(), 0.0), prior(tasks.size(), -1.0);
+  double prior_sum = 0.0, flops_sum = 0.0;
+  for (size_t t = 0; t < tasks.size(); t++) {
+    const KernelTask &task = tasks[t];
+    if (!task.metadata_ready)
+      continue;
+    flops[t] = estimated_flops(task);
+    if (by_hash.empty())
+      continue;
+    auto hash = by_hash.find(task.kernel_hash.empty()
+                                 ? KernelDedup::kernel_signature(task)
+                                 : task.kernel_hash);
+    auto path = by_path.find(
+        fs::relative(task.mlir_filepath, lowering_folder).generic_string());
+    if (hash != by_hash.end())
+      prior[t] = hash->second;
+    else if (path != by_path.end())
+      prior[t] = path->second;
+    else
+      continue;
+    prior_sum += prior[t];
+    flops_sum += flops[t];
+  }
+
+  bool use_prior = prior_sum > 0.0;
+  double scale = use_prior && flops_sum > 0.0 ? prior_sum / flops_sum : 1.0;
+  for (size_t t = 0; t < tasks.size(); t++)
+    tasks[t].priority =
+        (prior[t] >= 0.0 ? prior[t] : flops[t] * scale) *
+        tasks[t].multiplicity;
+  return use_prior ? "prior " + metric : "flops";
+}
+
+void KernelPriority::order(std::vector<KernelTask> &tasks) {
+  std::stable_sort(tasks.begin(), tasks.end(),
+                   [](const KernelTask &a, const KernelTask &b) {
+                     return a.priority > b.priority;
+                   });
+}
+
+size_t KernelPriority::cap_per_op(std::vector<KernelTask> &tasks,
+                                  unsigned int max_per_op) {
+  if (max_per_op == 0)
+    return 0;
+  std::map<std::string, std::vector<size_t>> by_op;
+  for (size_t t = 0; t < tasks.size(); t++)
+    by_op[tasks[t].op_type].push_back(t);
+
+  std::vector<bool> kept(tasks.size(), true);
+  size_t dropped = 0;
+  for (auto &[op, indices] : by_op) {
+    std::stable_sort(indices.begin(), indices.end(), [&](size_t a, size_t b) {
+      return tasks[a].priority > tasks[b].priority;
+    });
+    for (size_t i = max_per_op; i < indices.size(); i++) {
+      kept[indices[i]] = false;
+      dropped++;
+    }
+  }
+
+  std::vector<KernelTask> selected;
+  for (size_t t = 0; t < tasks.size(); t++)
+    if (kept[t])
+      selected.push_back(std::move(tasks[t]));
+  tasks = std::move(selected);
+  return dropped;
+}
@@ -0,0 +1,699 @@
+#include "kernel_profiler.h"
+#include "command_manager.h"
+
+#include "perfcpp/analyzer/flame_graph_generator.h"
+#include "perfcpp/analyzer/memory_access.h"
+#include "perfcpp/hardware_info.h"
+#include "perfcpp/period.h"
+#include "perfcpp/sampler.h"
+#include "perfcpp/symbol_resolver.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <regex>
+#include <set>
+#include <sstream>
+
+// Symbols annotated with their disassembly, hottest first
+static const size_t ANNOTATED_SYMBOLS = 8;
+static const double ANNOTATED_MIN_SHARE = 0.01;
+
+// Loops reported in <kernel>.loops.csv and branches in .mispredicts.csv
+static const double HOT_LOOP_MIN_SHARE = 0.01;
+static const size_t MISPREDICT_SITES = 50;
+
+// One line of objdump -d: "    1a40:\tvfmadd231ps ..."
+static const std::regex OBJDUMP_LINE(R"(^\s*([0-9a-f]+):\s*(.*)$)");
+
+namespace {
+struct SymbolSamples {
+  std::string module;
+  std::string module_path;
+  uintptr_t address = 0;
+  size_t size = 0;
+  uint64_t samples = 0;
+  std::map<uintptr_t, uint64_t> instructions; // symbol relative offset
+};
+} // namespace
+
+static std::string hex(uint64_t value) {
+  char text[20];
+  std::snprintf(text, sizeof(text), "%llx",
+                static_cast<unsigned long long>(value));
+  return text;
+}
+
+static std::string percent(uint64_t part, uint64_t total) {
+  char text[16];
+  std::snprintf(text, sizeof(text), "%6.2f%%",
+                total ? 100.0 * double(part) / double(total) : 0.0);
+  return text;
+}
+
+KernelProfiler::KernelProfiler(const ProfileConfig &config)
+    : m_config(config) {}
+
+// Runs `invoke` back to back under a sampler configured by `setup`, and
+// writes the samples to `perf_data` unless it is empty
+static bool run_sampler(const std::function<void(perf::Sampler &)> &setup,
+                        const std::function<void()> &invoke, double seconds,
+                        std::vector<perf::Sample> &samples, uint64_t &calls,
+                        const fs::path &perf_data) {
+  perf::Sampler sampler;
+  setup(sampler);
+  // perf report attributes samples through the pid/tid of the mmap records
+  // and weights them by period
+  if (!perf_data.empty())
+    sampler.values().thread_id(true).timestamp(true).period(true);
+  sampler.open();
+  if (!sampler.start())
+    throw std::runtime_error("could not start the sampler");
+
+  auto start = std::chrono::steady_clock::now();
+  do {
+    invoke();
+    calls++;
+  } while (std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                         start)
+               .count() < seconds);
+  sampler.stop();
+  if (!perf_data.empty()) {
+    // /proc/self/maps is read now, while the kernel is loaded
+    try {
+      sampler.to_perf_file(perf_data.generic_string());
+    } catch (const std::exception &err) {
+      std::cerr << "Could not write " << perf_data << " (" << err.what()
+                << ")\n";
+    }
+  }
+  samples = sampler.result(false);
+  sampler.close();
+  return true;
+}
+
+bool KernelProfiler::profile(const std::function<void()> &invoke,
+                             const fs::path &prefix) {
+  bool write_perf_data = m_config.perf_data && !prefix.empty();
+  fs::path perf_data =
+      write_perf_data ? fs::path(prefix.generic_string() + ".perf.data")
+                      : fs::path();
+  fs::path memory_perf_data =
+      write_perf_data ? fs::path(prefix.generic_string() + ".memory.perf.data")
+                      : fs::path();
+
+  bool sampled = false;
+  if (m_config.hotspots || m_config.flamegraph || m_config.perf_data) {
+    try {
+      sampled |= run_sampler(
+          [&](perf::Sampler &sampler) {
+            sampler.trigger("cycles", perf::Period{m_config.period});
+            sampler.values().instruction_pointer(true);
+            if (m_config.flamegraph)
+              sampler.values().callchain(true);
+          },
+          invoke, m_config.seconds, m_samples, m_calls, perf_data);
+    } catch (const std::exception &err) {
+      std::cerr << "Sampling unavailable (" << err.what()
+                << "), no profile for this kernel\n";
+    }
+  }
+
+  if (m_config.memory || m_config.latency) {
+    try {
+      sampled |= run_sampler(
+          [&](perf::Sampler &sampler) {
+            perf::Period period{m_config.memory_period};
+            if (perf::HardwareInfo::is_amd_ibs_supported())
+              sampler.trigger("ibs_op", perf::Precision::MustHaveZeroSkid,
+                              period);
+            else if (perf::HardwareInfo::is_intel_aux_counter_required())
+              // Sapphire Rapids and newer only sample loads grouped behind
+              // the auxiliary event
+              sampler.trigger(std::vector<std::vector<perf::Sampler::Trigger>>{
+                  {perf::Sampler::Trigger{"mem-loads-aux",
+                                          perf::Precision::MustHaveZeroSkid},
+                   perf::Sampler::Trigger{"mem-loads",
+                                          perf::Precision::RequestZeroSkid,
+                                          period}}});
+            else
+              sampler.trigger("mem-loads", perf::Precision::MustHaveZeroSkid,
+                              period);
+            sampler.values()
+                .logical_memory_address(true)
+                .data_source(true)
+                .latency(true);
+          },
+          invoke, m_config.seconds, m_memory_samples, m_memory_calls,
+          memory_perf_data);
+    } catch (const std::exception &err) {
+      std::cerr << "Memory access sampling unavailable (" << err.what()
+                << "), no memory profile for this kernel\n";
+    }
+  }
+
+  if (m_config.branches) {
+    try {
+      sampled |= run_sampler(
+          [&](perf::Sampler &sampler) {
+            sampler.trigger("cycles", perf::Period{m_config.period});
+            sampler.values().branch_stack(
+                {perf::BranchType::User, perf::BranchType::Conditional});
+          },
+          invoke, m_config.seconds, m_branch_samples, m_branch_calls,
+          fs::path());
+    } catch (const std::exception &err) {
+      std::cerr << "Branch stack sampling unavailable (" << err.what()
+                << "), needs LBR on Intel or BRS/LbrExtV2 on AMD\n";
+    }
+  }
+  return sampled;
+}
+
+bool KernelProfiler::write_hotspots(const fs::path &prefix) const {
+  fs::path report_filepath = prefix.generic_string() + ".hotspots.txt";
+  std::ofstream report(report_filepath);
+  if (!report.is_open()) {
+    std::cerr << "Error: Could not open " << report_filepath
+              << " for writing.\n";
+    return false;
+  }
+
+  // Read now: /proc/self/maps has to list the loaded kernel
+  perf::SymbolResolver resolver;
+  std::map<std::string, SymbolSamples> symbols;
+  uint64_t total = 0;
+  for (const perf::Sample &sample : m_samples) {
+    auto ip = sample.instruction_execution().logical_instruction_pointer();
+    if (!ip)
+      continue;
+    total++;
+    auto resolved = resolver.resolve(*ip);
+    if (!resolved) {
+      SymbolSamples &unknown = symbols["[unknown]"];
+      unknown.module = "[anonymous]";
+      unknown.samples++;
+      unknown.instructions[*ip]++;
+      continue;
+    }
+    SymbolSamples &symbol = symbols[resolved->symbol().name()];
+    symbol.module = resolved->module().name();
+    symbol.module_path = resolved->module().path();
+    symbol.address = resolved->symbol().address();
+    symbol.size = resolved->symbol().size();
+    symbol.samples++;
+    symbol.instructions[resolved->offset()]++;
+  }
+
+  std::vector<std::pair<std::string, const SymbolSamples *>> ranked;
+  for (const auto &[name, symbol] : symbols)
+    ranked.emplace_back(name, &symbol);
+  std::sort(ranked.begin(), ranked.end(), [](const auto &a, const auto &b) {
+    return a.second->samples > b.second->samples;
+  });
+
+  report << "# " << total << " samples every " << m_config.period
+         << " cycles over " << m_calls << " calls\n\n";
+  for (const auto &[name, symbol] : ranked)
+    report << percent(symbol->samples, total) << "  " << name << "  ["
+           << symbol->module << "]\n";
+
+  for (size_t s = 0; s < ranked.size() && s < ANNOTATED_SYMBOLS; s++) {
+    const auto &[name, symbol] = ranked[s];
+    if (double(symbol->samples) < ANNOTATED_MIN_SHARE * double(total))
+      break;
+    report << "\n## " << name << " (" << percent(symbol->samples, total)
+           << ")\n";
+
+    // Unresolved or stripped code: addresses only
+    std::string disassembly;
+    if (!symbol->module_path.empty() && fs::exists(symbol->module_path) &&
+        symbol->size > 0)
+      disassembly = CommandManager::exec(
+          "objdump -d --no-show-raw-insn --start-address=0x" +
+          hex(symbol->address) + " --stop-address=0x" +
+          hex(symbol->address + symbol->size) + " " + symbol->module_path +
+          " 2>/dev/null");
+    std::stringstream lines(disassembly);
+    std::string line;
+    bool annotated = false;
+    while (std::getline(lines, line)) {
+      std::smatch match;
+      if (!std::regex_match(line, match, OBJDUMP_LINE))
+        continue;
+      uintptr_t address = std::stoull(match[1].str(), nullptr, 16);
+      auto hits = symbol->instructions.find(address - symbol->address);
+      uint64_t count = hits == symbol->instructions.end() ? 0 : hits->second;
+      report << (count ? percent(count, total) : std::string(7, ' ')) << "  "
+             << hex(address) << ":  " << match[2].str() << "\n";
+      annotated = true;
+    }
+    if (!annotated)
+      for (const auto &[offset, count] : symbol->instructions)
+        report << percent(count, total) << "  "
+               << (symbol->address ? name + "+0x" + hex(offset)
+                                   : "0x" + hex(offset))
+               << "\n";
+  }
+
+  if (!ranked.empty())
+    std::cout << "Hottest symbol: " << ranked[0].first << " ("
+              << percent(ranked[0].second->samples, total) << " of " << total
+              << " samples), see " << report_filepath.filename() << "\n";
+  return true;
+}
+
+bool KernelProfiler::write_folded_stacks(const fs::path &filepath) const {
+  if (!filepath.parent_path().empty())
+    fs::create_directories(filepath.parent_path());
+  std::ofstream folded(filepath);
+  if (!folded.is_open()) {
+    std::cerr << "Error: Could not open " << filepath << " for writing.\n";
+    return false;
+  }
+
+  // Resolved now, while /proc/self/maps lists the loaded kernel
+  double cycles_per_sample =
+      double(m_config.period) / double(std::max<uint64_t>(1, m_calls));
+  for (const auto &[stack, samples] :
+       perf::analyzer::FlameGraphGenerator{}.map(m_samples)) {
+    auto weight = std::llround(double(samples) * cycles_per_sample);
+    if (stack.empty() || weight <= 0)
+      continue;
+    for (size_t f = 0; f < stack.size(); f++)
+      folded << (f ? ";" : "") << stack[f];
+    folded << " " << weight << "\n";
+  }
+  return true;
+}
+
+// IBS reports the miss latency, PEBS the latency of the whole access
+static uint64_t load_latency(const perf::DataAccess &access) {
+  return perf::HardwareInfo::is_amd()
+             ? access.latency().cache_miss().value_or(0)
+             : access.latency().cache_access().value_or(0);
+}
+
+namespace {
+// Where the sampled accesses of one tensor were served from
+struct AccessBreakdown {
+  uint64_t samples = 0;
+  uint64_t loads = 0;
+  uint64_t stores = 0;
+  uint64_t l1_hits = 0;
+  uint64_t l2_hits = 0;
+  uint64_t llc_hits = 0;
+  uint64_t dram_hits = 0;
+  uint64_t remote_dram_hits = 0;
+  uint64_t load_latency = 0;
+
+  void add(const perf::Sample &sample) {
+    samples++;
+    const perf::DataAccess &access = sample.data_access();
+    if (access.is_store()) {
+      stores++;
+      return;
+    }
+    if (!access.is_load())
+      return;
+    loads++;
+    const auto &source = access.source();
+    if (source) {
+      l1_hits += source->is_l1_hit();
+      l2_hits += source->is_l2_hit();
+      llc_hits += source->is_l3_hit();
+      dram_hits += source->is_memory_hit() && !source->is_remote();
+      remote_dram_hits += source->is_memory_hit() && source->is_remote();
+    }
+    load_latency += ::load_latency(access);
+  }
+
+  void subtract(const AccessBreakdown &part) {
+    samples -= part.samples;
+    loads -= part.loads;
+    stores -= part.stores;
+    l1_hits -= part.l1_hits;
+    l2_hits -= part.l2_hits;
+    llc_hits -= part.llc_hits;
+    dram_hits -= part.dram_hits;
+    remote_dram_hits -= part.remote_dram_hits;
+    load_latency -= part.load_latency;
+  }
+};
+} // namespace
+
+bool KernelProfiler::write_memory_access(
+    const fs::path &prefix, const std::vector<TensorRegion> &regions) const {
+  fs::path csv_filepath = prefix.generic_string() + ".memory.csv";
+  std::ofstream csv(csv_filepath);
+  if (!csv.is_open()) {
+    std::cerr << "Error: Could not open " << csv_filepath << " for writing.\n";
+    return false;
+  }
+
+  // Every input is one data type with a single member spanning its buffer
+  perf::analyzer::MemoryAccess analyzer;
+  for (const TensorRegion &region : regions) {
+    if (!region.base || !region.bytes)
+      continue;
+    perf::analyzer::DataType type(std::string(region.name), region.bytes);
+    type.add("data", region.bytes);
+    analyzer.add(std::move(type));
+    analyzer.annotate(region.name, reinterpret_cast<void *>(region.base));
+  }
+
+  std::map<std::string, AccessBreakdown> tensors;
+  for (const auto &type : analyzer.map(m_memory_samples).data_types())
+    for (const auto &member : type.members())
+      for (const perf::Sample &sample : member.samples())
+        tensors[type.name()].add(sample);
+
+  // Everything with a data address, less what the inputs account for
+  AccessBreakdown other;
+  for (const perf::Sample &sample : m_memory_samples)
+    if (sample.data_access().logical_memory_address())
+      other.add(sample);
+  uint64_t total = other.samples;
+  for (const auto &[name, row] : tensors)
+    other.subtract(row);
+  csv << "argument,tensor,samples,share,loads,stores,l1_hits,l2_hits,"
+         "llc_hits,dram_hits,remote_dram_hits,avg_load_latency\n";
+  auto write_row = [&](const std::string &name, const std::string &tensor,
+                       const AccessBreakdown &row) {
+    csv << name << "," << tensor << "," << row.samples << ","
+        << (total ? double(row.samples) / double(total) : 0.0) << ","
+        << row.loads << "," << row.stores << "," << row.l1_hits << ","
+        << row.l2_hits << "," << row.llc_hits << "," << row.dram_hits << ","
+        << row.remote_dram_hits << ","
+        << (row.loads ? double(row.load_latency) / double(row.loads) : 0.0)
+        << "\n";
+  };
+  for (const TensorRegion &region : regions)
+    write_row(region.name, region.description, tensors[region.name]);
+  write_row("other", "", other);
+
+  // Slowest input first in the console summary
+  const TensorRegion *slowest = nullptr;
+  double slowest_latency = 0.0;
+  for (const TensorRegion &region : regions) {
+    const AccessBreakdown &row = tensors[region.name];
+    double latency = row.loads ? double(row.load_latency) / row.loads : 0.0;
+    if (latency > slowest_latency) {
+      slowest = &region;
+      slowest_latency = latency;
+    }
+  }
+  std::cout << total << " data address samples over " << m_memory_calls
+            << " calls";
+  if (slowest)
+    std::cout << ", slowest loads from " << slowest->name << " ("
+              << slowest_latency << " cycles on average)";
+  std::cout << ", see " << csv_filepath.filename() << "\n";
+  return true;
+}
+
+namespace {
+// One loop, identified by its back edge (a backward conditional branch)
+struct LoopStats {
+  uintptr_t back_edge = 0;
+  uintptr_t target = 0;
+  uint64_t taken = 0;
+  uint64_t mispredicted = 0;
+  uint64_t censored = 0;
+  std::map<uint64_t, uint64_t> trip_counts; // complete instances
+
+  bool contains(uintptr_t ip) const { return ip >= target && ip <= back_edge; }
+};
+
+struct BranchSite {
+  uint64_t executed = 0;
+  uint64_t mispredicted = 0;
+};
+} // namespace
+
+bool KernelProfiler::write_branches(const fs::path &prefix, int num_parallel,
+                                    int num_reduction) const {
+  fs::path loops_filepath = prefix.generic_string() + ".loops.csv";
+  fs::path mispredicts_filepath = prefix.generic_string() + ".mispredicts.csv";
+  std::ofstream loops_csv(loops_filepath);
+  std::ofstream mispredicts_csv(mispredicts_filepath);
+  if (!loops_csv.is_open() || !mispredicts_csv.is_open()) {
+    std::cerr << "Error: Could not open " << loops_filepath << " or "
+              << mispredicts_filepath << " for writing.\n";
+    return false;
+  }
+
+  std::map<std::pair<uintptr_t, uintptr_t>, LoopStats> loops;
+  std::map<uintptr_t, BranchSite> sites;
+  uint64_t stacks = 0;
+  uint64_t back_edges_total = 0;
+  for (const perf::Sample &sample : m_branch_samples) {
+    const auto &stack = sample.branch_stack();
+    if (!stack || stack->empty())
+      continue;
+    stacks++;
+    // The stack is newest first
+    std::vector<perf::Branch> branches(stack->rbegin(), stack->rend());
+    std::set<std::pair<uintptr_t, uintptr_t>> seen;
+    for (const perf::Branch &branch : branches) {
+      BranchSite &site = sites[branch.instruction_pointer_from()];
+      site.executed++;
+      site.mispredicted += branch.is_mispredicted();
+      if (branch.instruction_pointer_to() >= branch.instruction_pointer_from())
+        continue;
+      auto key = std::make_pair(branch.instruction_pointer_from(),
+                                branch.instruction_pointer_to());
+      LoopStats &loop = loops[key];
+      loop.back_edge = key.first;
+      loop.target = key.second;
+      loop.taken++;
+      loop.mispredicted += branch.is_mispredicted();
+      back_edges_total++;
+      seen.insert(key);
+    }
+
+    // An instance ends at the first branch from outside the loop body. LLVM
+    // rotates loops, so the last iteration falls through its back edge.
+    for (const auto &key : seen) {
+      LoopStats &loop = loops[key];
+      uint64_t back_edges = 0;
+      bool entered = false;
+      for (const perf::Branch &branch : branches) {
+        if (!loop.contains(branch.instruction_pointer_from())) {
+          if (back_edges && entered)
+            loop.trip_counts[back_edges + 1]++;
+          else if (back_edges)
+            loop.censored++;
+          entered = true;
+          back_edges = 0;
+        } else if (branch.instruction_pointer_from() == key.first &&
+                   branch.instruction_pointer_to() == key.second) {
+          back_edges++;
+        }
+      }
+      // Still iterating when the sample was taken
+      if (back_edges)
+        loop.censored++;
+    }
+  }
+
+  // Resolved now, while /proc/self/maps lists the loaded kernel
+  perf::SymbolResolver resolver;
+  auto location = [&](uintptr_t ip) {
+    auto resolved = resolver.resolve(ip);
+    return resolved ? resolved->symbol().name() + "+0x" +
+                          hex(resolved->offset())
+                    : "0x" + hex(ip);
+  };
+
+  std::vector<const LoopStats *> hot;
+  for (const auto &[key, loop] : loops)
+    if (double(loop.taken) >= HOT_LOOP_MIN_SHARE * double(back_edges_total))
+      hot.push_back(&loop);
+  std::sort(hot.begin(), hot.end(), [](const auto *a, const auto *b) {
+    return a->taken > b->taken;
+  });
+
+  int num_loops = num_parallel + num_reduction;
+  int max_depth = 0;
+  loops_csv << "back_edge,target,depth,back_edges,share,instances,censored,"
+               "trip_min,trip_median,trip_mean,trip_max,mispredict_rate,"
+               "trip_histogram,num_loops,num_parallel\n";
+  for (const LoopStats *loop : hot) {
+    // Nested in every hot loop whose body contains this one
+    int depth = 1;
+    for (const LoopStats *outer : hot)
+      if (outer != loop && outer->contains(loop->target) &&
+          outer->contains(loop->back_edge))
+        depth++;
+    max_depth = std::max(max_depth, depth);
+
+    uint64_t instances = 0;
+    double trip_sum = 0.0;
+    for (const auto &[trips, count] : loop->trip_counts) {
+      instances += count;
+      trip_sum += double(trips) * double(count);
+    }
+    uint64_t median = 0;
+    uint64_t cumulative = 0;
+    std::string histogram;
+    for (const auto &[trips, count] : loop->trip_counts) {
+      cumulative += count;
+      if (!median && 2 * cumulative >= instances)
+        median = trips;
+      histogram += (histogram.empty() ? "" : ";") + std::to_string(trips) +
+                   ":" + std::to_string(count);
+    }
+
+    loops_csv << location(loop->back_edge) << "," << location(loop->target)
+              << "," << depth << "," << loop->taken << ","
+              << double(loop->taken) / double(back_edges_total) << ","
+              << instances << "," << loop->censored << ",";
+    if (instances)
+      loops_csv << loop->trip_counts.begin()->first << "," << median << ","
+                << trip_sum / double(instances) << ","
+                << loop->trip_counts.rbegin()->first;
+    else
+      loops_csv << ",,,";
+    loops_csv << "," << double(loop->mispredicted) / double(loop->taken)
+              << "," << histogram << "," << num_loops << "," << num_parallel
+              << "\n";
+  }
+
+  std::vector<std::pair<uintptr_t, BranchSite>> ranked(sites.begin(),
+                                                       sites.end());
+  std::sort(ranked.begin(), ranked.end(), [](const auto &a, const auto &b) {
+    return a.second.mispredicted > b.second.mispredicted;
+  });
+  mispredicts_csv << "branch,executed,mispredicted,mispredict_rate\n";
+  for (size_t i = 0; i < ranked.size() && i < MISPREDICT_SITES; i++) {
+    const auto &[ip, site] = ranked[i];
+    if (!site.mispredicted)
+      break;
+    mispredicts_csv << location(ip) << "," << site.executed << ","
+                    << site.mispredicted << ","
+                    << double(site.mispredicted) / double(site.executed)
+                    << "\n";
+  }
+
+  std::cout << stacks << " branch stacks over " << m_branch_calls
+            << " calls: " << hot.size() << " hot loops nested " << max_depth
+            << " deep (linalg nest: num_loops " << num_loops
+            << ", num_parallel " << num_parallel << "), see "
+            << loops_filepath.filename() << "\n";
+  return true;
+}
+
+bool KernelProfiler::write_latency_histogram(const fs::path &prefix) const {
+  fs::path csv_filepath = prefix.generic_string() + ".latency.csv";
+  std::ofstream csv(csv_filepath);
+  if (!csv.is_open()) {
+    std::cerr << "Error: Could not open " << csv_filepath << " for writing.\n";
+    return false;
+  }
+
+  // Bucket b holds latencies in [2^(b-1), 2^b), bucket 0 a latency of 0
+  static const char *LEVELS[] = {"l1",   "l2",          "llc",
+                                 "dram", "remote_dram", "other"};
+  std::map<int, std::array<uint64_t, 6>> buckets;
+  std::vector<uint64_t> latencies;
+  for (const perf::Sample &sample : m_memory_samples) {
+    const perf::DataAccess &access = sample.data_access();
+    if (!access.is_load())
+      continue;
+    uint64_t latency = load_latency(access);
+    const auto &source = access.source();
+    size_t level = 5;
+    if (source && source->is_l1_hit())
+      level = 0;
+    else if (source && source->is_l2_hit())
+      level = 1;
+    else if (source && source->is_l3_hit())
+      level = 2;
+    else if (source && source->is_memory_hit())
+      level = source->is_remote() ? 4 : 3;
+    buckets[std::bit_width(latency)][level]++;
+    latencies.push_back(latency);
+  }
+
+  uint64_t total = latencies.size();
+  csv << "latency_min,latency_max,loads,share";
+  for (const char *level : LEVELS)
+    csv << "," << level;
+  csv << "\n";
+  for (const auto &[bucket, levels] : buckets) {
+    uint64_t low = bucket ? uint64_t(1) << (bucket - 1) : 0;
+    uint64_t high = bucket ? (uint64_t(1) << bucket) - 1 : 0;
+    uint64_t loads = 0;
+    for (uint64_t count : levels)
+      loads += count;
+    csv << low << "," << high << "," << loads << ","
+        << (total ? double(loads) / double(total) : 0.0);
+    for (uint64_t count : levels)
+      csv << "," << count;
+    csv << "\n";
+  }
+
+  auto percentile = [&](double p) {
+    size_t rank = std::min(latencies.size() - 1,
+                           size_t(p * double(latencies.size())));
+    std::nth_element(latencies.begin(), latencies.begin() + rank,
+                     latencies.end());
+    return latencies[rank];
+  };
+  std::cout << total << " sampled loads";
+  if (total)
+    std::cout << ", latency p50 " << percentile(0.5) << " / p90 "
+              << percentile(0.9) << " / p99 " << percentile(0.99)
+              << " cycles";
+  std::cout << ", see " << csv_filepath.filename() << "\n";
+  return true;
+}
+
+fs::path KernelProfiler::flamegraph_path(const fs::path &output_root,
+                                         const std::string &op_type,
+                                         const std::string &kernel) {
+  return fs::path(output_root)
+      .append("flamegraphs")
+      .append(op_type)
+      .append(kernel + ".folded");
+}
+
+bool KernelProfiler::merge_folded_stacks(
+    const std::vector<std::pair<fs::path, double>> &inputs,
+    const fs::path &filepath) {
+  std::map<std::string, double> merged;
+  for (const auto &[input_filepath, weight] : inputs) {
+    std::ifstream folded(input_filepath);
+    if (!folded.is_open())
+      continue;
+    std::string root = input_filepath.parent_path().filename().string() +
+                       ";" + input_filepath.stem().string();
+    std::string line;
+    while (std::getline(folded, line)) {
+      size_t split = line.rfind(' ');
+      if (split == std::string::npos)
+        continue;
+      merged[root + ";" + line.substr(0, split)] +=
+          std::stod(line.substr(split + 1)) * weight;
+    }
+  }
+  if (merged.empty())
+    return false;
+
+  std::ofstream model(filepath);
+  if (!model.is_open()) {
+    std::cerr << "Error: Could not open " << filepath << " for writing.\n";
+    return false;
+  }
+  for (const auto &[stack, weight] : merged)
+    model << stack << " " << std::llround(weight) << "\n";
+  std::cout << "Model flame graph stacks written to " << filepath << "\n";
+  return true;
+}
@@ -0,0 +1,470 @@
+#include "kernel_sampling.h"
+#include "element_type.h"
+#include "kernel_cost.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <tuple>
+
+bool KernelSampling::parse(const std::string &spec, double &fraction,
+                           size_t &count) {
+  fraction = 0.0;
+  count = 0;
+  if (spec.empty())
+    return true;
+  size_t end = 0;
+  double value = 0.0;
+  try {
+    value = std::stod(spec, &end);
+  } catch (const std::exception &) {
+    return false;
+  }
+  if (end != spec.size() || value <= 0.0)
+    return false;
+  if (value < 1.0)
+    fraction = value;
+  else if (value == std::floor(value))
+    count = static_cast<size_t>(value);
+  else
+    return false;
+  return true;
+}
+
+// Stratum and size of a kernel, from its metadata and op
+static void describe(const KernelTask &task, SampledKernel &kernel) {
+  json metadata = load_json_from_file(task.json_filepath);
+  std::ifstream kernel_file(task.mlir_filepath);
+  std::stringstream kernel_text;
+  kernel_text << kernel_file.rdbuf();
+  KernelCost cost =
+      KernelCosts::estimate(task.op_type, metadata, kernel_text.str());
+
+  // ';' keeps the stratum a single CSV field
+  std::string signature;
+  double bytes = 0.0;
+  for (const char *side : {"args", "returns"})
+    for (const json &tensor :
+         metadata["kernel_call"].value(side, std::vector<json>())) {
+      std::vector<uint64_t> shape =
+          tensor.value("shape", std::vector<uint64_t>());
+      std::string dtype = tensor.value("dtype", std::string("f32"));
+      double elements = 1.0;
+      for (uint64_t dim : shape)
+        elements *= double(dim);
+      bytes += elements * ElementTypes::size(ElementTypes::parse(dtype));
+      if (std::string(side) == "args")
+        signature += (signature.empty() ? "" : ";") + dtype + ":" +
+                     std::to_string(shape.size());
+    }
+
+  kernel.op_type = task.op_type;
+  kernel.kernel = task.mlir_filepath;
+  kernel.multiplicity = task.multiplicity;
+  kernel.stratum = task.op_type + "|" + signature + "|p" +
+                   std::to_string(cost.num_parallel) + "r" +
+                   std::to_string(cost.num_reduction);
+  kernel.size = std::max(cost.flops > 0.0 ? cost.flops : bytes, 1.0);
+}
+
+SamplePlan KernelSampling::plan(const std::vector<KernelTask> &tasks,
+                                double fraction, size_t count) {
+  SamplePlan plan;
+  for (const KernelTask &task : tasks) {
+    if (!task.metadata_ready)
+      continue;
+    plan.kernels.emplace_back();
+    describe(task, plan.kernels.back());
+  }
+  size_t total = plan.kernels.size();
+  if (total == 0)
+    return plan;
+  size_t budget =
+      count ? count
+            : static_cast<size_t>(std::ceil(fraction * double(total)));
+  budget = std::clamp<size_t>(budget, 1, total);
+
+  struct Stratum {
+    std::vector<size_t> members;
+    double weight = 0.0;
+    size_t allocated = 0;
+  };
+  std::map<std::string, Stratum> strata;
+  for (size_t k = 0; k < total; k++) {
+    const SampledKernel &kernel = plan.kernels[k];
+    Stratum &stratum = strata[kernel.stratum];
+    stratum.members.push_back(k);
+    stratum.weight += kernel.size * kernel.multiplicity;
+  }
+  plan.strata = strata.size();
+
+  // One kernel per stratum, the heaviest first, then in proportion to
+  // weight while strata have kernels left (the highest weight per kernel
+  // allocated so far gets the next one)
+  std::vector<Stratum *> by_weight;
+  for (auto &[key, stratum] : strata)
+    by_weight.push_back(&stratum);
+  std::stable_sort(by_weight.begin(), by_weight.end(),
+                   [](const Stratum *a, const Stratum *b) {
+                     return a->weight > b->weight;
+                   });
+  size_t left = budget;
+  for (Stratum *stratum : by_weight)
+    if (left) {
+      stratum->allocated = 1;
+      left--;
+    }
+  for (; left; left--) {
+    Stratum *next = nullptr;
+    for (Stratum *stratum : by_weight)
+      if (stratum->allocated < stratum->members.size() &&
+          (!next || stratum->weight / (stratum->allocated + 1) >
+                        next->weight / (next->allocated + 1)))
+        next = stratum;
+    if (!next)
+      break;
+    next->allocated++;
+  }
+
+  for (auto &[key, stratum] : strata) {
+    std::vector<size_t> members = stratum.members;
+    size_t allocated = stratum.allocated;
+    double weight = stratum.weight;
+    auto weight_of = [&plan](size_t k) {
+      return plan.kernels[k].size * plan.kernels[k].multiplicity;
+    };
+    std::stable_sort(members.begin(), members.end(),
+                     [&](size_t a, size_t b) {
+                       return weight_of(a) > weight_of(b);
+                     });
+    // Kernels weighing at least an even share of what is left
+    size_t first = 0;
+    while (allocated && first < members.size() &&
+           weight_of(members[first]) * allocated >= weight) {
+      plan.kernels[members[first]].sampled = true;
+      plan.kernels[members[first]].certain = true;
+      weight -= weight_of(members[first]);
+      allocated--;
+      first++;
+    }
+    // The rest at evenly spaced ranks of size
+    std::vector<size_t> rest(members.begin() + first, members.end());
+    std::stable_sort(rest.begin(), rest.end(), [&](size_t a, size_t b) {
+      return plan.kernels[a].size < plan.kernels[b].size;
+    });
+    for (size_t i = 0; i < allocated && !rest.empty(); i++)
+      plan.kernels[rest[(2 * i + 1) * rest.size() / (2 * allocated)]]
+          .sampled = true;
+  }
+  for (const SampledKernel &kernel : plan.kernels)
+    plan.sampled += kernel.sampled;
+  return plan;
+}
+
+size_t KernelSampling::apply(const SamplePlan &plan,
+                             std::vector<KernelTask> &tasks) {
+  std::set<fs::path> sampled;
+  for (const SampledKernel &kernel : plan.kernels)
+    if (kernel.sampled)
+      sampled.insert(kernel.kernel);
+  size_t before = tasks.size();
+  tasks.erase(std::remove_if(tasks.begin(), tasks.end(),
+                             [&sampled](const KernelTask &task) {
+                               return task.metadata_ready &&
+                                      !sampled.count(task.mlir_filepath);
+                             }),
+              tasks.end());
+  return before - tasks.size();
+}
+
+// Metric average of every measured kernel, by path
+static std::map<fs::path, double>
+measured_values(const std::vector<KernelTask> &tasks,
+                const std::string &metric) {
+  std::map<fs::path, double> values;
+  for (const KernelTask &task : tasks) {
+    auto value = task.average_metrics.find(metric);
+    if (task.failure.empty() && value != task.average_metrics.end())
+      values[task.mlir_filepath] = value->second;
+  }
+  return values;
+}
+
+std::vector<Extrapolation>
+KernelSampling::extrapolate(const SamplePlan &plan,
+                            const std::vector<KernelTask> &tasks,
+                            const std::string &metric) {
+  std::map<fs::path, double> values = measured_values(tasks, metric);
+
+  // Per stratum: exact part of the certain kernels, and the ratio
+  // estimate's population (x = size * multiplicity) and measured sample
+  struct Stratum {
+    std::string op_type;
+    size_t kernels = 0, measured = 0;
+    double exact = 0.0;
+    size_t population = 0;
+    double population_x = 0.0;
+    std::vector<std::pair<double, double>> sample; // x, y
+    double estimate = 0.0, variance = 0.0;
+    bool bounded = true;
+  };
+  std::map<std::string, Stratum> strata;
+  for (const SampledKernel &kernel : plan.kernels) {
+    Stratum &stratum = strata[kernel.stratum];
+    stratum.op_type = kernel.op_type;
+    stratum.kernels++;
+    auto value = values.find(kernel.kernel);
+    bool measured = kernel.sampled && value != values.end();
+    stratum.measured += measured;
+    double y = measured ? value->second * kernel.multiplicity : 0.0;
+    if (kernel.certain && measured) {
+      stratum.exact += y;
+      continue;
+    }
+    double x = kernel.size * kernel.multiplicity;
+    stratum.population++;
+    stratum.population_x += x;
+    if (measured)
+      stratum.sample.emplace_back(x, y);
+  }
+
+  // Ratios pooled over op types and the model, and the relative residual
+  // variance pooled over the strata that have one
+  std::map<std::string, std::pair<double, double>> op_ratio;
+  std::pair<double, double> model_ratio{0.0, 0.0};
+  double pooled_relative = 0.0, pooled_degrees = 0.0;
+  for (auto &[key, stratum] : strata) {
+    double sum_x = 0.0, sum_y = 0.0;
+    for (const auto &[x, y] : stratum.sample) {
+      sum_x += x;
+      sum_y += y;
+    }
+    op_ratio[stratum.op_type].first += sum_x;
+    op_ratio[stratum.op_type].second += sum_y;
+    model_ratio.first += sum_x;
+    model_ratio.second += sum_y;
+    size_t n = stratum.sample.size();
+    stratum.estimate = stratum.exact;
+    if (n == 0)
+      continue;
+    double ratio = sum_y / sum_x;
+    stratum.estimate = stratum.exact + ratio * stratum.population_x;
+    if (n < 2 || n == stratum.population)
+      continue;
+    double residuals = 0.0;
+    for (const auto &[x, y] : stratum.sample)
+      residuals += (y - ratio * x) * (y - ratio * x);
+    double s2 = residuals / double(n - 1);
+    double population = double(stratum.population);
+    stratum.variance = population * population *
+                       (1.0 - double(n) / population) / double(n) * s2;
+    double mean_y = sum_y / double(n);
+    if (mean_y > 0.0) {
+      pooled_relative += s2 / (mean_y * mean_y) * double(n - 1);
+      pooled_degrees += double(n - 1);
+    }
+  }
+  bool pooled = pooled_degrees > 0.0;
+  if (pooled)
+    pooled_relative /= pooled_degrees;
+
+  for (auto &[key, stratum] : strata) {
+    size_t n = stratum.sample.size();
+    double population = double(stratum.population);
+    if (n == 0 && stratum.population) {
+      auto [sum_x, sum_y] = op_ratio[stratum.op_type];
+      if (sum_x <= 0.0)
+        std::tie(sum_x, sum_y) = model_ratio;
+      double extrapolated =
+          sum_x > 0.0 ? sum_y / sum_x * stratum.population_x : 0.0;
+      stratum.estimate = stratum.exact + extrapolated;
+      // As if one kernel of mean size had been measured
+      stratum.variance =
+          pooled_relative * extrapolated * extrapolated * (population - 1.0);
+      stratum.bounded = pooled && sum_x > 0.0;
+    } else if (n == 1 && stratum.population > 1) {
+      double y = stratum.sample.front().second;
+      stratum.variance =
+          population * (population - 1.0) * pooled_relative * y * y;
+      stratum.bounded = pooled;
+    }
+  }
+
+  std::vector<Extrapolation> totals;
+  auto add = [&totals](const std::string &scope, const Stratum &stratum,
+                       size_t &slot) {
+    if (slot == SIZE_MAX) {
+      slot = totals.size();
+      totals.push_back(Extrapolation{scope});
+    }
+    Extrapolation &total = totals[slot];
+    total.kernels += stratum.kernels;
+    total.measured += stratum.measured;
+    total.estimate += stratum.estimate;
+    total.high += stratum.variance; // Variance until finished
+    total.bounded = total.bounded && stratum.bounded;
+  };
+  size_t model_slot = SIZE_MAX;
+  std::map<std::string, size_t> op_slots;
+  for (const auto &[key, stratum] : strata)
+    add("model", stratum, model_slot);
+  for (const auto &[key, stratum] : strata)
+    add(stratum.op_type, stratum,
+        op_slots.try_emplace(stratum.op_type, SIZE_MAX).first->second);
+  for (const auto &[key, stratum] : strata) {
+    size_t slot = SIZE_MAX;
+    add(key, stratum, slot);
+  }
+  for (Extrapolation &total : totals) {
+    double half_width = 1.96 * std::sqrt(total.high);
+    total.low = std::max(0.0, total.estimate - half_width);
+    total.high = total.estimate + half_width;
+  }
+  return totals;
+}
+
+// model, op_type or stratum
+static std::string level_of(const Extrapolation &total) {
+  if (total.scope == "model")
+    return "model";
+  return total.scope.find('|') == std::string::npos ? "op_type" : "stratum";
+}
+
+bool KernelSampling::write_extrapolation(
+    const std::vector<Extrapolation> &totals, const std::string &metric,
+    const fs::path &csv_filepath) {
+  std::ofstream csv(csv_filepath);
+  if (!csv.is_open()) {
+    std::cerr << "Error: Could not open " << csv_filepath
+              << " for writing.\n";
+    return false;
+  }
+  csv << "level,scope,kernels,measured,metric,estimate,low,high,bounded\n";
+  for (const Extrapolation &total : totals)
+    csv << level_of(total) << "," << total.scope << "," << total.kernels
+        << "," << total.measured << "," << metric << "," << total.estimate
+        << "," << total.low << "," << total.high << ","
+        << (total.bounded ? "yes" : "no") << "\n";
+
+  if (!totals.empty()) {
+    const Extrapolation &model = totals.front();
+    std::cout << "Sampled " << model.measured << " of " << model.kernels
+              << " unique kernels, model " << metric << " ~"
+              << model.estimate;
+    if (model.bounded && model.estimate > 0.0)
+      std::cout << " +-"
+                << 100.0 * (model.high - model.estimate) / model.estimate
+                << "% (95%)";
+    else
+      std::cout << " (too few kernels measured for bounds)";
+    std::cout << "\n";
+  }
+  return true;
+}
+
+static json load_state(const fs::path &state_filepath) {
+  std::ifstream state_file(state_filepath);
+  if (!state_file.is_open())
+    return json::object();
+  json state = json::parse(state_file, nullptr, false);
+  return state.is_object() ? state : json::object();
+}
+
+bool KernelSampling::validation_due(const fs::path &state_filepath,
+                                    const std::string &model,
+                                    unsigned int every) {
+  if (every == 0)
+    return false;
+  json entry = load_state(state_filepath).value(model, json::object());
+  if (entry.value("validations", json::array()).empty())
+    return true;
+  return entry.value("since_validation", 0u) + 1 >= every;
+}
+
+bool KernelSampling::validate(const std::vector<Extrapolation> &totals,
+                              const SamplePlan &plan,
+                              const std::vector<KernelTask> &tasks,
+                              const std::string &metric,
+                              const fs::path &csv_filepath, double &error,
+                              bool &within) {
+  error = std::nan("");
+  within = false;
+  std::map<fs::path, double> values = measured_values(tasks, metric);
+  // Full totals of every scope, NaN once a kernel of it is missing
+  std::map<std::string, double> actual;
+  for (const SampledKernel &kernel : plan.kernels) {
+    auto value = values.find(kernel.kernel);
+    double y = value == values.end() ? std::nan("")
+                                     : value->second * kernel.multiplicity;
+    for (const std::string &scope :
+         {std::string("model"), kernel.op_type, kernel.stratum})
+      actual[scope] += y;
+  }
+
+  std::ofstream csv(csv_filepath);
+  if (!csv.is_open()) {
+    std::cerr << "Error: Could not open " << csv_filepath
+              << " for writing.\n";
+    return false;
+  }
+  csv << "level,scope,kernels,measured,metric,estimate,low,high,actual,"
+         "error,within\n";
+  for (const Extrapolation &total : totals) {
+    double full = actual[total.scope];
+    if (std::isnan(full) || full <= 0.0)
+      continue;
+    double relative = (total.estimate - full) / full;
+    bool inside = total.low <= full && full <= total.high;
+    csv << level_of(total) << "," << total.scope << "," << total.kernels
+        << "," << total.measured << "," << metric << "," << total.estimate
+        << "," << total.low << "," << total.high << "," << full << ","
+        << relative << "," << (inside ? "yes" : "no") << "\n";
+    if (total.scope == "model") {
+      error = relative;
+      within = inside;
+    }
+  }
+
+  if (std::isnan(error))
+    std::cerr << "Validation run: not every kernel was measured, no full "
+                 "model total to validate the extrapolation against\n";
+  else
+    std::cout << "Validation run: extrapolated model " << metric << " off by "
+              << 100.0 * error << "%, "
+              << (within ? "inside" : "outside") << " its 95% bounds\n";
+  return true;
+}
+
+bool KernelSampling::record_run(const fs::path &state_filepath,
+                                const std::string &model,
+                                const fs::path &output_dir, double error,
+                                bool within) {
+  json state = load_state(state_filepath);
+  json &entry = state[model];
+  if (!entry.is_object())
+    entry = json::object();
+  entry["runs"] = entry.value("runs", 0u) + 1;
+  if (std::isnan(error)) {
+    entry["since_validation"] = entry.value("since_validation", 0u) + 1;
+  } else {
+    entry["since_validation"] = 0u;
+    entry["validations"].push_back({{"date", get_timestamp_string()},
+                                    {"output_dir", output_dir.string()},
+                                    {"error", error},
+                                    {"within", within}});
+  }
+  std::ofstream state_file(state_filepath);
+  if (!state_file.is_open()) {
+    std::cerr << "Error: Could not open " << state_filepath
+              << " for writing.\n";
+    return false;
+  }
+  state_file << state.dump(2) << "\n";
+  return true;
+}
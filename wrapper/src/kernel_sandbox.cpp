@@ -0,0 +1,259 @@
+#include "kernel_sandbox.h"
+#include "fork_gate.h"
+#include "tensor_dump.h"
+
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <nlohmann/json.hpp>
+#include <sstream>
+#include <thread>
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using json = nlohmann::json;
+
+// Anonymous mappings are committed lazily, so only the used part costs memory
+static const size_t SHARED_BUFFER_BYTES = 256ull << 20;
+
+/*
+ * Shared buffer layout: status word, payload length, payload
+ */
+struct SharedHeader {
+  volatile int status; // 0 = running, 1 = done, 2 = payload too large
+  size_t length;
+};
+
+/*
+ * One "<section> <sample> <metric> <value>" line per value, sections being
+ * S (samples), W (warmup), C (cold), L.<layout>, T.<threads>, D.<density>,
+ * P.<profile>, A.<pipeline> and B.<baseline>. Text keeps infinities (ci95
+ * of a single sample) intact, which JSON can't represent.
+ */
+std::string KernelSandbox::serialize(const SandboxResult &result) {
+  std::ostringstream out;
+  out.precision(17);
+  auto write_section = [&out](const std::string &section,
+                              const SampleList &samples) {
+    for (size_t i = 0; i < samples.size(); i++)
+      for (const auto &[metric, value] : samples[i])
+        out << section << " " << i << " " << metric << " " << value << "\n";
+  };
+  write_section("S", result.samples);
+  write_section("W", result.warmup);
+  write_section("C", result.cold);
+  for (const auto &[layout, samples] : result.layouts)
+    write_section("L." + layout, samples);
+  for (const auto &[threads, samples] : result.threads)
+    write_section("T." + std::to_string(threads), samples);
+  for (const auto &[density, samples] : result.densities)
+    write_section("D." + density, samples);
+  for (const auto &[profile, samples] : result.profiles)
+    write_section("P." + profile, samples);
+  for (const auto &[pipeline, samples] : result.pipelines)
+    write_section("A." + pipeline, samples);
+  for (const auto &[baseline, samples] : result.baselines)
+    write_section("B." + baseline, samples);
+  for (const auto &[contention, samples] : result.contentions)
+    write_section("X." + contention, samples);
+  for (const auto &[shape, samples] : result.shapes)
+    write_section("Y." + shape, samples);
+  for (const auto &[replicas, samples] : result.replicas)
+    write_section("N." + std::to_string(replicas), samples);
+  return out.str();
+}
+
+bool KernelSandbox::deserialize(const std::string &text,
+                                SandboxResult &result) {
+  std::istringstream in(text);
+  std::string line;
+  while (std::getline(in, line)) {
+    std::istringstream fields(line);
+    std::string section;
+    size_t index = 0;
+    std::string metric, value;
+    if (!(fields >> section >> index >> metric >> value))
+      return false;
+
+    SampleList &samples =
+        section == "S"   ? result.samples
+        : section == "W" ? result.warmup
+        : section == "C" ? result.cold
+        : section.rfind("T.", 0) == 0
+            ? result.threads[std::stoul(section.substr(2))]
+        : section.rfind("D.", 0) == 0 ? result.densities[section.substr(2)]
+        : section.rfind("P.", 0) == 0 ? result.profiles[section.substr(2)]
+        : section.rfind("A.", 0) == 0 ? result.pipelines[section.substr(2)]
+        : section.rfind("B.", 0) == 0 ? result.baselines[section.substr(2)]
+        : section.rfind("X.", 0) == 0 ? result.contentions[section.substr(2)]
+        : section.rfind("Y.", 0) == 0 ? result.shapes[section.substr(2)]
+        : section.rfind("N.", 0) == 0
+            ? result.replicas[std::stoul(section.substr(2))]
+                                      : result.layouts[section.substr(2)];
+    if (samples.size() <= index)
+      samples.resize(index + 1);
+    // strtod understands inf and nan
+    samples[index][metric] = std::strtod(value.c_str(), nullptr);
+  }
+  return true;
+}
+
+static std::string describe_exit(int wait_status) {
+  if (WIFSIGNALED(wait_status)) {
+    int signal_number = WTERMSIG(wait_status);
+    return std::string("killed by signal ") + std::to_string(signal_number) +
+           " (" + strsignal(signal_number) + ")";
+  }
+  if (WIFEXITED(wait_status))
+    return "exited with status " + std::to_string(WEXITSTATUS(wait_status)) +
+           " before reporting results";
+  return "stopped unexpectedly";
+}
+
+bool KernelSandbox::run(const MeasureFn &measure, double timeout_seconds,
+                        SandboxResult &result, std::string &failure) {
+  Worker worker;
+  return KernelSandbox::start(measure, worker, failure) &&
+         KernelSandbox::finish(worker, timeout_seconds, result, failure);
+}
+
+bool KernelSandbox::start(const MeasureFn &measure, Worker &worker,
+                          std::string &failure) {
+  void *shared = mmap(nullptr, SHARED_BUFFER_BYTES, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (shared == MAP_FAILED) {
+    failure = std::string("could not map shared memory: ") +
+              std::strerror(errno);
+    return false;
+  }
+  SharedHeader *header = static_cast<SharedHeader *>(shared);
+  char *payload = static_cast<char *>(shared) + sizeof(SharedHeader);
+  header->status = 0;
+  header->length = 0;
+
+  // Buffered output would otherwise be printed by both processes
+  std::cout.flush();
+  std::cerr.flush();
+  fflush(nullptr);
+
+  pid_t pid = ForkGate::fork();
+  if (pid < 0) {
+    failure = std::string("fork failed: ") + std::strerror(errno);
+    munmap(shared, SHARED_BUFFER_BYTES);
+    return false;
+  }
+
+  if (pid == 0) {
+    // Worker: only this thread exists here, and no other thread was inside
+    // a ForkGate section when it forked. _exit skips the destructors of the
+    // state it shares with the parent.
+    std::string text = KernelSandbox::serialize(measure());
+    if (text.size() > SHARED_BUFFER_BYTES - sizeof(SharedHeader)) {
+      header->status = 2;
+    } else {
+      std::memcpy(payload, text.data(), text.size());
+      header->length = text.size();
+      header->status = 1;
+    }
+    // Dumps are written by a thread of this process
+    TensorDump::flush();
+    std::cout.flush();
+    std::cerr.flush();
+    fflush(nullptr);
+    _exit(0);
+  }
+
+  worker.pid = pid;
+  worker.shared = shared;
+  worker.start = std::chrono::steady_clock::now();
+  return true;
+}
+
+bool KernelSandbox::is_finished(const Worker &worker,
+                                double timeout_seconds) {
+  if (timeout_seconds > 0.0 &&
+      std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                    worker.start)
+              .count() > timeout_seconds)
+    return true;
+  // WNOWAIT leaves the worker for finish() to collect
+  siginfo_t info{};
+  return waitid(P_PID, worker.pid, &info, WEXITED | WNOHANG | WNOWAIT) != 0 ||
+         info.si_pid == worker.pid;
+}
+
+bool KernelSandbox::finish(Worker &worker, double timeout_seconds,
+                           SandboxResult &result, std::string &failure) {
+  SharedHeader *header = static_cast<SharedHeader *>(worker.shared);
+  char *payload = static_cast<char *>(worker.shared) + sizeof(SharedHeader);
+  int wait_status = 0;
+  bool timed_out = false;
+  while (waitpid(worker.pid, &wait_status, WNOHANG) == 0) {
+    double elapsed = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - worker.start)
+                         .count();
+    if (timeout_seconds > 0.0 && elapsed > timeout_seconds) {
+      kill(worker.pid, SIGKILL);
+      waitpid(worker.pid, &wait_status, 0);
+      timed_out = true;
+      break;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+
+  bool success = false;
+  if (timed_out)
+    failure = "timed out after " + std::to_string(timeout_seconds) + " s";
+  else if (header->status == 2)
+    failure = "results exceeded the shared buffer";
+  else if (header->status != 1)
+    failure = describe_exit(wait_status);
+  else if (!KernelSandbox::deserialize(std::string(payload, header->length),
+                                       result))
+    failure = "malformed results from the worker";
+  else
+    success = true;
+
+  munmap(worker.shared, SHARED_BUFFER_BYTES);
+  worker = Worker();
+  return success;
+}
+
+bool KernelSandbox::write_failure_record(const KernelTask &task,
+                                         const std::string &failure,
+                                         const fs::path &output_folder) {
+  fs::path record_path = fs::path(output_folder)
+                             .append("failures")
+                             .append(task.op_type)
+                             .append(fs::path(task.mlir_filepath)
+                                         .replace_extension()
+                                         .filename()
+                                         .generic_string())
+                             .replace_extension(".json");
+  std::error_code ec;
+  fs::create_directories(record_path.parent_path(), ec);
+
+  std::ofstream record(record_path);
+  if (!record.is_open()) {
+    std::cerr << "Error: Could not open " << record_path << " for writing.\n";
+    return false;
+  }
+
+  json failure_json = {
+      {"op_type", task.op_type},
+      {"kernel", task.mlir_filepath.generic_string()},
+      {"object", task.ll_filepath.generic_string()},
+      {"kernel_hash", task.kernel_hash},
+      {"reason", failure},
+  };
+  record << failure_json.dump(2) << "\n";
+  std::cerr << "Kernel " << task.mlir_filepath << " failed: " << failure
+            << " (" << record_path.generic_string() << ")\n";
+  return true;
+}
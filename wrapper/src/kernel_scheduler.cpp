@@ -0,0 +1,144 @@
+#include "kernel_scheduler.h"
+#include "bounded_queue.h"
+#include "telemetry.h"
+#include "thread_pool.h"
+#include "utils.h"
+
+#include <chrono>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <thread>
+
+using steady_clock = std::chrono::steady_clock;
+
+static double seconds_between(steady_clock::time_point from,
+                              steady_clock::time_point to) {
+  return std::chrono::duration<double>(to - from).count();
+}
+
+KernelScheduler::KernelScheduler(CommandManager &manager, ScheduleMode mode,
+                                 unsigned int jobs, unsigned int queue_depth,
+                                 int measure_cpu)
+    : m_manager(manager), m_mode(mode), m_jobs(jobs ? jobs : 1),
+      m_queue_depth(queue_depth ? queue_depth : 1), m_measure_cpu(measure_cpu) {
+}
+
+void KernelScheduler::run(std::vector<KernelTask> &tasks,
+                          const MeasureFn &measure) {
+  if (tasks.empty())
+    return;
+
+  steady_clock::time_point run_start = steady_clock::now();
+  auto over_budget = [this, run_start]() {
+    return m_time_budget > 0.0 &&
+           seconds_between(run_start, steady_clock::now()) > m_time_budget;
+  };
+
+  // Phased scheduling simply never blocks producers and holds the consumer
+  // back until every kernel has been compiled
+  size_t capacity = m_mode == ScheduleMode::PIPELINED ? m_queue_depth
+                                                      : tasks.size();
+  BoundedQueue<std::pair<KernelTask *, steady_clock::time_point>> ready_queue(
+      capacity);
+
+  std::promise<void> compilation_finished;
+  std::shared_future<void> compilation_done =
+      compilation_finished.get_future().share();
+
+  std::thread measurement_thread([&]() {
+    pin_current_thread(m_measure_cpu);
+    if (m_mode == ScheduleMode::PHASED)
+      compilation_done.wait();
+
+    for (size_t i = 0; i < tasks.size(); i++) {
+      auto [task, ready_time] = ready_queue.pop();
+      steady_clock::time_point measure_start = steady_clock::now();
+      task->timeline.queue_wait_seconds =
+          seconds_between(ready_time, measure_start);
+      task->timeline.measure_start = seconds_between(run_start, measure_start);
+
+      if (!task->skipped_budget && !task->prepared) {
+        std::cerr << "Skipping " << task->mlir_filepath
+                  << ": compilation failed\n";
+        Telemetry::kernel_done(*task, "compile_failed", 0);
+        continue;
+      }
+      if (task->skipped_budget || over_budget()) {
+        task->skipped_budget = true;
+        Telemetry::kernel_done(*task, "skipped_budget", 0);
+        continue;
+      }
+
+      measure(*task);
+      task->measured = true;
+      task->timeline.measure_seconds =
+          seconds_between(measure_start, steady_clock::now());
+    }
+  });
+
+  {
+    ThreadPool compile_pool(m_jobs, m_measure_cpu);
+    for (KernelTask &task : tasks) {
+      compile_pool.submit([&, run_start]() {
+        // Queued without compiling, the consumer accounts for it
+        if (over_budget()) {
+          task.skipped_budget = true;
+          ready_queue.push({&task, steady_clock::now()});
+          return;
+        }
+        steady_clock::time_point compile_start = steady_clock::now();
+        m_manager.prepare_kernel(task);
+        steady_clock::time_point compile_end = steady_clock::now();
+        Telemetry::compiled(task.prepared);
+
+        task.timeline.compile_start = seconds_between(run_start, compile_start);
+        task.timeline.compile_seconds =
+            seconds_between(compile_start, compile_end);
+
+        // Failed kernels are queued as well so the consumer can account for
+        // every task
+        ready_queue.push({&task, compile_end});
+      });
+    }
+    compile_pool.wait();
+  }
+
+  // Batched objects need every kernel of the batch lowered first
+  m_manager.link_kernel_batches(tasks);
+  compilation_finished.set_value();
+
+  measurement_thread.join();
+}
+
+bool KernelScheduler::write_timeline(const std::vector<KernelTask> &tasks,
+                                     const fs::path &csv_filepath) {
+  std::ofstream csv(csv_filepath);
+  if (!csv.is_open()) {
+    std::cerr << "Error: Could not open " << csv_filepath
+              << " for writing.\n";
+    return false;
+  }
+
+  csv << "op_type,kernel,status,compile_start,compile_seconds,"
+         "queue_wait_seconds,measure_start,measure_seconds\n";
+  for (const KernelTask &task : tasks) {
+    auto verified = task.average_metrics.find("verified");
+    bool invalid = verified != task.average_metrics.end() &&
+                   verified->second < 1.0;
+    const char *status = task.skipped_budget     ? "skipped_budget"
+                         : !task.failure.empty() ? "crashed"
+                         : invalid               ? "invalid"
+                         : task.measured         ? "measured"
+                         : task.prepared         ? "skipped"
+                                                 : "compile_failed";
+    csv << task.op_type << ","
+        << fs::path(task.mlir_filepath).filename().generic_string() << ","
+        << status << "," << task.timeline.compile_start << ","
+        << task.timeline.compile_seconds << ","
+        << task.timeline.queue_wait_seconds << ","
+        << task.timeline.measure_start << ","
+        << task.timeline.measure_seconds << "\n";
+  }
+  return true;
+}
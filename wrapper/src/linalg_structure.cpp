@@ -0,0 +1,232 @@
+#include "linalg_structure.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <tuple>
+
+std::map<std::string, LinalgStructure> LinalgStructures::kernel_structures;
+std::mutex LinalgStructures::mutex;
+
+static std::string kernel_key(const fs::path &kernel_filepath) {
+  return fs::absolute(kernel_filepath).lexically_normal().string();
+}
+
+std::string LinalgStructure::structural_class() const {
+  return (main.reduction_format == "none" ? std::string("no")
+                                          : main.reduction_format) +
+         "-reduction";
+}
+
+void LinalgStructures::clear() {
+  std::lock_guard<std::mutex> lock(LinalgStructures::mutex);
+  LinalgStructures::kernel_structures.clear();
+}
+
+fs::path LinalgStructures::filepath(const fs::path &kernel_filepath) {
+  return fs::path(kernel_filepath).replace_extension(".structure.csv");
+}
+
+LinalgGeneric
+LinalgStructures::describe(const std::vector<std::string> &iterators) {
+  LinalgGeneric generic;
+  generic.num_loops = int(iterators.size());
+  int first_reduction = -1, last_reduction = -1;
+  int first_parallel = -1, last_parallel = -1;
+  for (int loop = 0; loop < generic.num_loops; loop++) {
+    if (iterators[loop] == "reduction") {
+      generic.num_reduction++;
+      if (first_reduction < 0)
+        first_reduction = loop;
+      last_reduction = loop;
+      generic.reduction_dims +=
+          (generic.reduction_dims.empty() ? "" : " ") + std::to_string(loop);
+    } else {
+      generic.num_parallel++;
+      if (first_parallel < 0)
+        first_parallel = loop;
+      last_parallel = loop;
+    }
+  }
+  if (generic.num_reduction == 0)
+    generic.reduction_format = "none";
+  else if (generic.num_parallel == 0 || first_reduction > last_parallel)
+    generic.reduction_format = "inner";
+  else if (last_reduction < first_parallel)
+    generic.reduction_format = "outer";
+  else
+    generic.reduction_format = "mixed";
+  return generic;
+}
+
+std::vector<LinalgGeneric>
+LinalgStructures::parse(const std::string &linalg_text) {
+  // linalg.generic {indexing_maps = [...], iterator_types = ["parallel",
+  // "reduction"]} ins(...)
+  std::vector<LinalgGeneric> generics;
+  for (size_t op = linalg_text.find("linalg.generic");
+       op != std::string::npos;
+       op = linalg_text.find("linalg.generic", op + 1)) {
+    size_t types = linalg_text.find("iterator_types", op);
+    size_t open = linalg_text.find('[', types);
+    size_t close = linalg_text.find(']', open);
+    if (types == std::string::npos || open == std::string::npos ||
+        close == std::string::npos)
+      break;
+    std::vector<std::string> iterators;
+    std::string list = linalg_text.substr(open + 1, close - open - 1);
+    for (size_t quote = list.find('"'); quote != std::string::npos;
+         quote = list.find('"', quote + 1)) {
+      size_t end = list.find('"', quote + 1);
+      if (end == std::string::npos)
+        break;
+      iterators.push_back(list.substr(quote + 1, end - quote - 1));
+      quote = end;
+    }
+    generics.push_back(LinalgStructures::describe(iterators));
+  }
+  return generics;
+}
+
+static LinalgStructure summarize(const std::vector<LinalgGeneric> &generics) {
+  LinalgStructure structure;
+  structure.generics = int(generics.size());
+  for (const LinalgGeneric &generic : generics)
+    if (std::tie(generic.num_reduction, generic.num_loops) >
+        std::tie(structure.main.num_reduction, structure.main.num_loops))
+      structure.main = generic;
+  return structure;
+}
+
+bool LinalgStructures::analyse(const fs::path &kernel_filepath,
+                               const std::string &linalg_text) {
+  std::vector<LinalgGeneric> generics = LinalgStructures::parse(linalg_text);
+  if (generics.empty()) {
+    std::cerr << "No linalg.generic in the lowering of " << kernel_filepath
+              << ", no structural metrics\n";
+    return false;
+  }
+
+  fs::path csv_filepath = LinalgStructures::filepath(kernel_filepath);
+  std::ofstream csv(csv_filepath);
+  if (!csv.is_open()) {
+    std::cerr << "Error: Could not open " << csv_filepath
+              << " for writing.\n";
+    return false;
+  }
+  csv << "generic,num_loops,num_parallel,num_reduction,reduction_format,"
+         "reduction_dims\n";
+  for (size_t g = 0; g < generics.size(); g++)
+    csv << g << "," << generics[g].num_loops << ","
+        << generics[g].num_parallel << "," << generics[g].num_reduction << ","
+        << generics[g].reduction_format << "," << generics[g].reduction_dims
+        << "\n";
+
+  std::lock_guard<std::mutex> lock(LinalgStructures::mutex);
+  LinalgStructures::kernel_structures[kernel_key(kernel_filepath)] =
+      summarize(generics);
+  return true;
+}
+
+const LinalgStructure *
+LinalgStructures::find(const fs::path &kernel_filepath) {
+  std::lock_guard<std::mutex> lock(LinalgStructures::mutex);
+  std::string key = kernel_key(kernel_filepath);
+  auto it = LinalgStructures::kernel_structures.find(key);
+  if (it != LinalgStructures::kernel_structures.end())
+    return &it->second;
+
+  std::ifstream csv(LinalgStructures::filepath(kernel_filepath));
+  if (!csv.is_open())
+    return nullptr;
+  std::vector<LinalgGeneric> generics;
+  std::string line;
+  std::getline(csv, line); // Header
+  while (std::getline(csv, line)) {
+    std::vector<std::string> fields;
+    std::stringstream row(line);
+    for (std::string field; std::getline(row, field, ',');)
+      fields.push_back(field);
+    if (fields.size() < 5)
+      continue;
+    LinalgGeneric generic;
+    generic.num_loops = std::stoi(fields[1]);
+    generic.num_parallel = std::stoi(fields[2]);
+    generic.num_reduction = std::stoi(fields[3]);
+    generic.reduction_format = fields[4];
+    generic.reduction_dims = fields.size() > 5 ? fields[5] : "";
+    generics.push_back(generic);
+  }
+  if (generics.empty())
+    return nullptr;
+  return &(LinalgStructures::kernel_structures[key] = summarize(generics));
+}
+
+std::vector<std::pair<std::string, std::string>>
+LinalgStructures::annotations(const fs::path &kernel_filepath) {
+  const LinalgStructure *structure = LinalgStructures::find(kernel_filepath);
+  if (!structure)
+    return {{"num_loops", ""},        {"num_parallel", ""},
+            {"num_reduction", ""},    {"reduction_format", ""},
+            {"reduction_dims", ""},   {"structural_class", ""}};
+  const LinalgGeneric &main = structure->main;
+  return {{"num_loops", std::to_string(main.num_loops)},
+          {"num_parallel", std::to_string(main.num_parallel)},
+          {"num_reduction", std::to_string(main.num_reduction)},
+          {"reduction_format", main.reduction_format},
+          {"reduction_dims", main.reduction_dims},
+          {"structural_class", structure->structural_class()}};
+}
+
+json LinalgStructures::to_json(const fs::path &kernel_filepath) {
+  const LinalgStructure *structure = LinalgStructures::find(kernel_filepath);
+  if (!structure)
+    return json::object();
+  const LinalgGeneric &main = structure->main;
+  return {{"num_loops", main.num_loops},
+          {"num_parallel", main.num_parallel},
+          {"num_reduction", main.num_reduction},
+          {"reduction_format", main.reduction_format},
+          {"reduction_dims", main.reduction_dims},
+          {"generics", structure->generics},
+          {"class", structure->structural_class()}};
+}
+
+bool LinalgStructures::write_classes(const std::vector<KernelTask> &tasks,
+                                     const std::string &metric,
+                                     const fs::path &csv_filepath) {
+  // Class -> kernels and the sum of their averages, duplicates included
+  std::map<std::string, std::pair<unsigned int, double>> classes;
+  double total = 0.0;
+  for (const KernelTask &task : tasks) {
+    const LinalgStructure *structure =
+        LinalgStructures::find(task.mlir_filepath);
+    auto it = task.average_metrics.find(metric);
+    if (!structure || !task.measured || !task.failure.empty() ||
+        it == task.average_metrics.end())
+      continue;
+    auto &[kernels, value] = classes[structure->structural_class()];
+    kernels += task.multiplicity;
+    value += it->second * task.multiplicity;
+    total += it->second * task.multiplicity;
+  }
+  if (classes.empty())
+    return true;
+
+  std::ofstream csv(csv_filepath);
+  if (!csv.is_open()) {
+    std::cerr << "Error: Could not open " << csv_filepath
+              << " for writing.\n";
+    return false;
+  }
+  csv << "class,kernels," << metric << ",share\n";
+  for (const auto &[name, entry] : classes) {
+    csv << name << "," << entry.first << "," << entry.second << ",";
+    if (total != 0.0)
+      csv << entry.second / total;
+    csv << "\n";
+  }
+  std::cout << "Structural classes written to " << csv_filepath << "\n";
+  return true;
+}
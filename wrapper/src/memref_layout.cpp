@@ -0,0 +1,103 @@
+#include "memref_layout.h"
+
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+
+static const int64_t PADDING_MULTIPLE = 16;
+
+std::string MemRefLayout::describe(LayoutKind kind) {
+  switch (kind) {
+  case LayoutKind::PADDED:
+    return "padded";
+  case LayoutKind::TRANSPOSED:
+    return "transposed";
+  case LayoutKind::OFFSET:
+    return "offset";
+  default:
+    return "dense";
+  }
+}
+
+std::vector<LayoutKind> MemRefLayout::parse_list(const std::string &names) {
+  std::vector<LayoutKind> layouts;
+  std::stringstream ss(names);
+  std::string name;
+  while (std::getline(ss, name, ',')) {
+    if (name.empty())
+      continue;
+    bool known = false;
+    for (LayoutKind kind : {LayoutKind::DENSE, LayoutKind::PADDED,
+                            LayoutKind::TRANSPOSED, LayoutKind::OFFSET})
+      if (MemRefLayout::describe(kind) == name) {
+        layouts.push_back(kind);
+        known = true;
+      }
+    if (!known)
+      std::cerr << "Unknown layout '" << name << "', skipping it\n";
+  }
+  return layouts;
+}
+
+std::vector<int64_t>
+MemRefLayout::dense_strides(const std::vector<uint64_t> &shape) {
+  std::vector<int64_t> strides(shape.size(), 1);
+  int64_t accum = 1;
+  for (int i = shape.size() - 1; i >= 0; i--) {
+    strides[i] = accum;
+    accum *= shape[i];
+  }
+  return strides;
+}
+
+void MemRefLayout::apply(JSONArgument &argument, LayoutKind kind) {
+  const std::vector<uint64_t> &shape = argument.shape;
+  size_t rank = shape.size();
+  if (rank == 0)
+    return;
+
+  switch (kind) {
+  case LayoutKind::DENSE:
+    if (argument.strides.empty())
+      argument.strides = MemRefLayout::dense_strides(shape);
+    return;
+
+  case LayoutKind::PADDED: {
+    argument.strides.assign(rank, 1);
+    int64_t pitch = (static_cast<int64_t>(shape[rank - 1]) +
+                     PADDING_MULTIPLE - 1) /
+                        PADDING_MULTIPLE * PADDING_MULTIPLE +
+                    PADDING_MULTIPLE;
+    int64_t accum = pitch;
+    for (int i = rank - 2; i >= 0; i--) {
+      argument.strides[i] = accum;
+      accum *= shape[i];
+    }
+    argument.offset = 0;
+    return;
+  }
+
+  case LayoutKind::TRANSPOSED: {
+    argument.strides = MemRefLayout::dense_strides(shape);
+    argument.offset = 0;
+    if (rank < 2)
+      return;
+    // Innermost two dimensions column major, outer ones dense around them
+    int64_t rows = shape[rank - 2];
+    int64_t cols = shape[rank - 1];
+    argument.strides[rank - 2] = 1;
+    argument.strides[rank - 1] = rows;
+    int64_t accum = rows * cols;
+    for (int i = rank - 3; i >= 0; i--) {
+      argument.strides[i] = accum;
+      accum *= shape[i];
+    }
+    return;
+  }
+
+  case LayoutKind::OFFSET:
+    argument.strides = MemRefLayout::dense_strides(shape);
+    argument.offset = 1;
+    return;
+  }
+}
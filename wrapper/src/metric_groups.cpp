@@ -0,0 +1,141 @@
+#include "metric_groups.h"
+#include "perfcpp/counter_definition.h"
+
+#include <algorithm>
+#include <cmath>
+#include <exception>
+#include <iostream>
+
+/*
+ * One way of computing part of a group: the events it counts and the
+ * perf-cpp formulas (hyphenated event names quoted) of its columns
+ */
+struct MetricRecipe {
+  std::vector<std::string> events;
+  bool grouped; // events have to be scheduled as one perf group
+  std::vector<std::pair<std::string, std::string>> formulas;
+};
+
+// Parts of a group, each a list of alternatives in order of preference
+using GroupDefinition = std::vector<std::vector<MetricRecipe>>;
+
+// Misses of `event` per thousand instructions
+static MetricRecipe mpki(const std::string &column, const std::string &event) {
+  return {{"instructions", event},
+          false,
+          {{column, "1000 * '" + event + "' / instructions"}}};
+}
+
+static const std::map<std::string, GroupDefinition> &definitions() {
+  static const std::map<std::string, GroupDefinition> groups = {
+      {"topdown-l1",
+       {{// Icelake and later: slots split by the PMU's perf-metrics
+         {{"slots", "topdown-retiring", "topdown-bad-spec",
+           "topdown-fe-bound", "topdown-be-bound"},
+          true,
+          {{"frontend_bound", "100 * 'topdown-fe-bound' / slots"},
+           {"backend_bound", "100 * 'topdown-be-bound' / slots"},
+           {"bad_speculation", "100 * 'topdown-bad-spec' / slots"},
+           {"retiring", "100 * 'topdown-retiring' / slots"}}},
+         // Skylake era: backend bound is what the other three leave
+         {{"topdown-total-slots", "topdown-slots-issued",
+           "topdown-slots-retired", "topdown-fetch-bubbles",
+           "topdown-recovery-bubbles"},
+          false,
+          {{"frontend_bound",
+            "100 * 'topdown-fetch-bubbles' / 'topdown-total-slots'"},
+           {"backend_bound",
+            "100 - 100 * ('topdown-fetch-bubbles' + 'topdown-slots-issued' + "
+            "'topdown-recovery-bubbles') / 'topdown-total-slots'"},
+           {"bad_speculation",
+            "100 * ('topdown-slots-issued' - 'topdown-slots-retired' + "
+            "'topdown-recovery-bubbles') / 'topdown-total-slots'"},
+           {"retiring",
+            "100 * 'topdown-slots-retired' / 'topdown-total-slots'"}}}}}},
+      {"memory-bound",
+       {{{{"slots", "topdown-be-bound", "topdown-mem-bound"},
+          true,
+          {{"memory_bound", "100 * 'topdown-mem-bound' / slots"},
+           {"core_bound",
+            "100 * ('topdown-be-bound' - 'topdown-mem-bound') / slots"}}}},
+        {mpki("l1d_mpki", "L1-dcache-load-misses")},
+        {mpki("llc_mpki", "LLC-load-misses")},
+        {mpki("dtlb_mpki", "dTLB-load-misses")}}},
+      {"frontend",
+       {{{{"slots", "topdown-fe-bound", "topdown-fetch-lat"},
+          true,
+          {{"fetch_latency", "100 * 'topdown-fetch-lat' / slots"},
+           {"fetch_bandwidth",
+            "100 * ('topdown-fe-bound' - 'topdown-fetch-lat') / slots"}}}},
+        {mpki("l1i_mpki", "L1-icache-load-misses")},
+        {mpki("itlb_mpki", "iTLB-load-misses")}}}};
+  return groups;
+}
+
+static bool available(const MetricRecipe &recipe) {
+  const perf::CounterDefinition &counters = perf::CounterDefinition::global();
+  for (const std::string &event : recipe.events)
+    if (counters.counter(event).empty())
+      return false;
+  return true;
+}
+
+std::vector<std::string> MetricGroups::names() {
+  std::vector<std::string> names;
+  for (const auto &[name, parts] : definitions())
+    names.push_back(name);
+  return names;
+}
+
+bool MetricGroups::resolve(const std::string &name, MetricGroup &group) {
+  auto it = definitions().find(name);
+  if (it == definitions().end())
+    return false;
+
+  group = MetricGroup();
+  group.name = name;
+  for (const std::vector<MetricRecipe> &alternatives : it->second) {
+    const MetricRecipe *chosen = nullptr;
+    for (const MetricRecipe &recipe : alternatives)
+      if (!chosen && available(recipe))
+        chosen = &recipe;
+    if (!chosen) {
+      std::cerr << "Metric group " << name << ": no events for "
+                << alternatives.front().formulas.front().first
+                << " on this CPU, skipping it\n";
+      continue;
+    }
+
+    if (chosen->grouped)
+      group.event_groups.push_back(chosen->events);
+    else
+      for (const std::string &event : chosen->events)
+        if (std::find(group.events.begin(), group.events.end(), event) ==
+            group.events.end())
+          group.events.push_back(event);
+    for (const auto &[column, formula] : chosen->formulas) {
+      try {
+        group.formulas.push_back(std::make_shared<perf::FormulaMetric>(
+            std::string(column), std::string(formula)));
+        group.columns.push_back(column);
+      } catch (const std::exception &err) {
+        std::cerr << "Metric group " << name << ": can't parse " << column
+                  << " (" << err.what() << ")\n";
+      }
+    }
+  }
+  return !group.columns.empty();
+}
+
+void MetricGroups::evaluate(const MetricGroup &group,
+                            std::map<std::string, double> &values) {
+  perf::CounterResult counters;
+  for (const auto &[name, value] : values)
+    counters.emplace_back(name, value);
+
+  for (size_t i = 0; i < group.formulas.size(); i++) {
+    std::optional<double> value = group.formulas[i]->calculate(counters);
+    if (value && std::isfinite(*value))
+      values[group.columns[i]] = *value;
+  }
+}
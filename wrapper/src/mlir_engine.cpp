@@ -0,0 +1,267 @@
+#include "mlir_engine.h"
+
+#include <iostream>
+#include <memory>
+#include <mutex>
+
+#ifdef MLIR_BENCH_INPROCESS
+#include "mlir/Bytecode/BytecodeWriter.h"
+#include "mlir/IR/BuiltinOps.h"
+#include "mlir/IR/DialectRegistry.h"
+#include "mlir/IR/MLIRContext.h"
+#include "mlir/InitAllDialects.h"
+#include "mlir/InitAllExtensions.h"
+#include "mlir/InitAllPasses.h"
+#include "mlir/Parser/Parser.h"
+#include "mlir/Pass/PassManager.h"
+#include "mlir/Pass/PassRegistry.h"
+#include "mlir/Target/LLVMIR/Dialect/All.h"
+#include "mlir/Target/LLVMIR/Export.h"
+#include "torch-mlir/InitAll.h"
+
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/raw_ostream.h"
+#endif
+
+std::string
+MLIREngine::build_pipeline_string(const std::vector<std::string> &pass_list,
+                                  bool &allow_unregistered) {
+  allow_unregistered = false;
+  std::string pipeline = "builtin.module(";
+  bool first = true;
+
+  for (const std::string &entry : pass_list) {
+    if (entry == "allow-unregistered-dialect") {
+      allow_unregistered = true;
+      continue;
+    }
+
+    // mlir-opt style: pass-name="opt1 opt2=val"  ->  pass-name{opt1 opt2=val}
+    std::string pass = entry;
+    size_t eq_pos = entry.find('=');
+    if (eq_pos != std::string::npos) {
+      std::string options = entry.substr(eq_pos + 1);
+      if (options.size() >= 2 && options.front() == '"' &&
+          options.back() == '"')
+        options = options.substr(1, options.size() - 2);
+      pass = entry.substr(0, eq_pos) + "{" + options + "}";
+    }
+
+    if (!first)
+      pipeline += ",";
+    pipeline += pass;
+    first = false;
+  }
+
+  pipeline += ")";
+  return pipeline;
+}
+
+#ifdef MLIR_BENCH_INPROCESS
+
+// Same pipeline that the popen path passes to torch-mlir-opt
+static const char *TORCH_TO_LINALG_PIPELINE =
+    "builtin.module(torch-backend-to-linalg-on-tensors-backend-pipeline)";
+
+namespace {
+struct EngineState {
+  std::unique_ptr<mlir::MLIRContext> context;
+  std::once_flag init_flag;
+};
+
+EngineState &engine_state() {
+  static EngineState state;
+  return state;
+}
+
+// Kept stages are bytecode, `mlir-opt <file>` prints them
+bool write_module(mlir::ModuleOp module, const fs::path &filepath) {
+  std::error_code ec;
+  llvm::raw_fd_ostream os(filepath.generic_string(), ec);
+  if (ec) {
+    std::cerr << "Failed to open " << filepath << ": " << ec.message()
+              << std::endl;
+    return false;
+  }
+  return mlir::succeeded(mlir::writeBytecodeToFile(module, os));
+}
+
+bool run_pipeline(mlir::MLIRContext &context, mlir::ModuleOp module,
+                  const std::string &pipeline) {
+  // Implicit nesting mirrors mlir-opt's behaviour for flags like
+  // --affine-loop-tile which are anchored on func.func
+  mlir::PassManager pm(&context, mlir::ModuleOp::getOperationName(),
+                       mlir::OpPassManager::Nesting::Implicit);
+
+  std::string error_message;
+  llvm::raw_string_ostream error_stream(error_message);
+  if (mlir::failed(mlir::parsePassPipeline(pipeline, pm, error_stream))) {
+    std::cerr << "Failed to parse pass pipeline: " << pipeline << "\n"
+              << error_stream.str() << std::endl;
+    return false;
+  }
+
+  return mlir::succeeded(pm.run(module));
+}
+} // namespace
+
+bool MLIREngine::available() { return true; }
+
+void MLIREngine::initialise() {
+  EngineState &state = engine_state();
+  std::call_once(state.init_flag, [&state]() {
+    mlir::DialectRegistry registry;
+    mlir::registerAllDialects(registry);
+    mlir::registerAllExtensions(registry);
+    mlir::registerAllToLLVMIRTranslations(registry);
+    mlir::torch::registerAllDialects(registry);
+
+    // Pass registration is global, hence it must happen exactly once
+    mlir::registerAllPasses();
+    mlir::torch::registerAllPasses();
+
+    state.context = std::make_unique<mlir::MLIRContext>(registry);
+    state.context->loadAllAvailableDialects();
+    /*
+     * Kernels lower in parallel on this one context, so the context wide
+     * flag is set here and never toggled while they parse. A pipeline
+     * without allow-unregistered-dialect then parses the ops that
+     * mlir-opt would reject, and fails at translation instead.
+     */
+    state.context->allowUnregisteredDialects(true);
+  });
+}
+
+bool MLIREngine::lower_kernel(const fs::path &torch_filepath,
+                              const std::vector<std::string> &pass_list,
+                              const fs::path &ll_filepath,
+                              bool keep_intermediates) {
+  MLIREngine::initialise();
+  mlir::MLIRContext &context = *engine_state().context;
+
+  // The context already allows unregistered dialects, see initialise()
+  bool allow_unregistered = false;
+  std::string pipeline =
+      MLIREngine::build_pipeline_string(pass_list, allow_unregistered);
+
+  mlir::OwningOpRef<mlir::ModuleOp> module =
+      mlir::parseSourceFile<mlir::ModuleOp>(torch_filepath.generic_string(),
+                                            &context);
+  if (!module) {
+    std::cerr << "Failed to parse kernel: " << torch_filepath << std::endl;
+    return false;
+  }
+
+  // 1. Lower Torch to Linalg
+  if (!run_pipeline(context, *module, TORCH_TO_LINALG_PIPELINE)) {
+    std::cerr << "Torch to Linalg lowering failed: " << torch_filepath
+              << std::endl;
+    return false;
+  }
+  if (keep_intermediates)
+    write_module(*module, fs::path(torch_filepath)
+                              .replace_extension(".linalg.mlirbc"));
+
+  // 2. Lower Linalg to LLVM dialect using the pipeline JSON
+  if (!run_pipeline(context, *module, pipeline)) {
+    std::cerr << "Pipeline lowering failed: " << torch_filepath << std::endl;
+    return false;
+  }
+  if (keep_intermediates)
+    write_module(*module,
+                 fs::path(torch_filepath).replace_extension(".llvm.mlirbc"));
+
+  // 3. Translate LLVM dialect to LLVM IR
+  llvm::LLVMContext llvm_context;
+  std::unique_ptr<llvm::Module> llvm_module =
+      mlir::translateModuleToLLVMIR(*module, llvm_context);
+  if (!llvm_module) {
+    std::cerr << "LLVM IR translation failed: " << torch_filepath << std::endl;
+    return false;
+  }
+
+  std::error_code ec;
+  llvm::raw_fd_ostream ll_stream(ll_filepath.generic_string(), ec);
+  if (ec) {
+    std::cerr << "Failed to open " << ll_filepath << ": " << ec.message()
+              << std::endl;
+    return false;
+  }
+  llvm_module->print(ll_stream, nullptr);
+  return true;
+}
+
+bool MLIREngine::convert_model(const fs::path &model_filepath,
+                               const fs::path &output_filepath, bool bytecode,
+                               size_t elide_bytes) {
+  MLIREngine::initialise();
+  mlir::MLIRContext &context = *engine_state().context;
+
+  // Large files are mapped; the shared source manager keeps the mapping for
+  // bytecode resources that point into it
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> buffer =
+      llvm::MemoryBuffer::getFile(model_filepath.generic_string(),
+                                  /*IsText=*/false,
+                                  /*RequiresNullTerminator=*/false);
+  if (!buffer) {
+    std::cerr << "Failed to open " << model_filepath << ": "
+              << buffer.getError().message() << std::endl;
+    return false;
+  }
+  auto source_mgr = std::make_shared<llvm::SourceMgr>();
+  source_mgr->AddNewSourceBuffer(std::move(*buffer), llvm::SMLoc());
+  mlir::ParserConfig config(&context);
+  mlir::OwningOpRef<mlir::ModuleOp> module =
+      mlir::parseSourceFile<mlir::ModuleOp>(source_mgr, config);
+  if (!module) {
+    std::cerr << "Failed to parse model: " << model_filepath << std::endl;
+    return false;
+  }
+
+  std::error_code ec;
+  llvm::raw_fd_ostream os(output_filepath.generic_string(), ec);
+  if (ec) {
+    std::cerr << "Failed to open " << output_filepath << ": " << ec.message()
+              << std::endl;
+    return false;
+  }
+  if (bytecode)
+    return mlir::succeeded(mlir::writeBytecodeToFile(
+        *module, os, mlir::BytecodeWriterConfig("torch-metric-collector")));
+
+  mlir::OpPrintingFlags flags;
+  flags.enableDebugInfo(true);
+  if (elide_bytes)
+    flags.elideLargeElementsAttrs(elide_bytes)
+        .elideLargeResourceString(elide_bytes);
+  module->print(os, flags);
+  return true;
+}
+
+#else
+
+bool MLIREngine::available() { return false; }
+
+void MLIREngine::initialise() {}
+
+bool MLIREngine::lower_kernel(
+    [[maybe_unused]] const fs::path &torch_filepath,
+    [[maybe_unused]] const std::vector<std::string> &pass_list,
+    [[maybe_unused]] const fs::path &ll_filepath,
+    [[maybe_unused]] bool keep_intermediates) {
+  std::cerr << "In-process lowering is not available in this build. Rebuild "
+               "with premake5 --with-mlir=<torch-mlir-build-path>\n";
+  return false;
+}
+
+bool MLIREngine::convert_model(
+    [[maybe_unused]] const fs::path &model_filepath,
+    [[maybe_unused]] const fs::path &output_filepath,
+    [[maybe_unused]] bool bytecode, [[maybe_unused]] size_t elide_bytes) {
+  return false;
+}
+
+#endif
@@ -0,0 +1,104 @@
+#include "model_benchmark.h"
+#include "kernel_metadata.h"
+#include "model_source.h"
+
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <regex>
+#include <sstream>
+
+bool ModelBenchmark::prepare(const fs::path &model_filepath,
+                             const fs::path &lowering_folder,
+                             KernelTask &task) {
+  fs::path model_folder = fs::path(lowering_folder).append(OP_TYPE);
+  std::error_code ec;
+  fs::create_directories(model_folder, ec);
+
+  // The model computes with its weights, bytecode is printed in full
+  fs::path text_filepath = model_filepath;
+  if (ModelSource::is_bytecode(model_filepath)) {
+    text_filepath = fs::path(model_folder)
+                        .append(model_filepath.stem().string() + ".text.mlir");
+    if (!ModelSource::write_text(model_filepath, text_filepath, 0))
+      return false;
+  }
+
+  std::ifstream model_file(text_filepath);
+  if (!model_file.is_open()) {
+    std::cerr << "Could not read the model " << model_filepath << "\n";
+    return false;
+  }
+  std::stringstream contents;
+  contents << model_file.rdbuf();
+  std::string text = contents.str();
+  if (text_filepath != model_filepath)
+    fs::remove(text_filepath, ec);
+
+  // The first public function is the model's entry (private ones have the
+  // visibility between func.func and the name)
+  static const std::regex entry(R"(func\.func @([\w$.\-]+)\()");
+  std::smatch match;
+  if (!std::regex_search(text, match, entry)) {
+    std::cerr << "No public function in " << model_filepath
+              << ", can't run the model end to end\n";
+    return false;
+  }
+  std::string name = "@" + match[1].str() + "(";
+  if (name != "@kernel_call(")
+    for (size_t pos = text.find(name); pos != std::string::npos;
+         pos = text.find(name, pos))
+      text.replace(pos, name.size(), "@kernel_call(");
+
+  task = KernelTask();
+  task.op_type = OP_TYPE;
+  task.mlir_filepath = fs::path(model_folder)
+                           .append(model_filepath.stem().string() + ".mlir");
+  task.json_filepath = fs::path(task.mlir_filepath).concat(".json");
+  std::ofstream(task.mlir_filepath) << text;
+
+  json metadata;
+  if (!KernelMetadata::extract_from_kernel(task.mlir_filepath, metadata)) {
+    std::cerr << "Could not read the signature of " << match[1].str()
+              << " in " << model_filepath << "\n";
+    return false;
+  }
+  std::ofstream(task.json_filepath) << metadata.dump(2);
+  task.metadata_ready = true;
+  return true;
+}
+
+bool ModelBenchmark::write_comparison(
+    const KernelTask &model_task, const std::vector<KernelTask> &kernel_tasks,
+    const std::vector<std::string> &metrics, const fs::path &csv_filepath) {
+  std::map<std::string, double> kernel_sums;
+  for (const KernelTask &task : kernel_tasks) {
+    if (!task.measured || !task.failure.empty())
+      continue;
+    for (const std::string &metric : metrics) {
+      auto it = task.average_metrics.find(metric);
+      if (it != task.average_metrics.end())
+        kernel_sums[metric] += it->second * task.multiplicity;
+    }
+  }
+
+  std::ofstream csv(csv_filepath);
+  if (!csv.is_open()) {
+    std::cerr << "Error: Could not open " << csv_filepath
+              << " for writing.\n";
+    return false;
+  }
+  csv << "metric,end_to_end,kernel_sum,gap,ratio\n";
+  for (const std::string &metric : metrics) {
+    auto it = model_task.average_metrics.find(metric);
+    double end_to_end = it == model_task.average_metrics.end() ? 0.0
+                                                               : it->second;
+    double kernel_sum = kernel_sums[metric];
+    csv << metric << "," << end_to_end << "," << kernel_sum << ","
+        << end_to_end - kernel_sum << ",";
+    if (kernel_sum != 0.0)
+      csv << end_to_end / kernel_sum;
+    csv << "\n";
+  }
+  return true;
+}
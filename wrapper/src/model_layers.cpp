@@ -0,0 +1,368 @@
+#include "model_layers.h"
+#include "kernel_index.h"
+#include "model_source.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <regex>
+#include <set>
+#include <sstream>
+#include <string_view>
+
+std::map<std::string, ModelLayer> ModelLayers::kernel_layers;
+std::vector<ModelLayer> ModelLayers::layers;
+
+fs::path ModelLayers::filepath(const fs::path &lowering_folder) {
+  return fs::path(lowering_folder).append("model_layers.json");
+}
+
+static std::string kernel_key(const fs::path &kernel_filepath) {
+  return fs::absolute(kernel_filepath).lexically_normal().string();
+}
+
+static std::string read_text(const fs::path &filepath) {
+  std::ifstream file(filepath);
+  std::stringstream contents;
+  contents << file.rdbuf();
+  return contents.str();
+}
+
+// Kernel file names numbered by isolation sort 2 before 10
+static bool natural_less(const std::string &a, const std::string &b) {
+  size_t i = 0, j = 0;
+  while (i < a.size() && j < b.size()) {
+    if (std::isdigit((unsigned char)a[i]) && std::isdigit((unsigned char)b[j])) {
+      size_t i_end = i, j_end = j;
+      while (i_end < a.size() && std::isdigit((unsigned char)a[i_end]))
+        i_end++;
+      while (j_end < b.size() && std::isdigit((unsigned char)b[j_end]))
+        j_end++;
+      std::string x = a.substr(i, i_end - i), y = b.substr(j, j_end - j);
+      x.erase(0, std::min(x.find_first_not_of('0'), x.size()));
+      y.erase(0, std::min(y.find_first_not_of('0'), y.size()));
+      if (x.size() != y.size())
+        return x.size() < y.size();
+      if (x != y)
+        return x < y;
+      i = i_end;
+      j = j_end;
+    } else {
+      if (a[i] != b[j])
+        return a[i] < b[j];
+      i++;
+      j++;
+    }
+  }
+  return a.size() - i < b.size() - j;
+}
+
+// A torch op of a parsed MLIR file: op name, name location, file:line:col
+struct ParsedOp {
+  std::string op;
+  std::string name;
+  std::string location;
+};
+
+/*
+ * Torch ops of the given types in textual order. Locations behind #loc
+ * aliases are substituted before reading the first "name"(...) and
+ * "file":line:col out of them; ops without a loc(...) get their own position
+ * in the file, as MLIR's parser would.
+ */
+static std::vector<ParsedOp> parse_ops(std::string_view text,
+                                       const std::string &file_name,
+                                       const std::set<std::string> &op_types) {
+  static const std::regex alias_def(R"re(^(#loc[0-9]*) = loc\((.*)\)\s*$)re");
+  static const std::regex alias_use(R"re(#loc[0-9]*)re");
+  static const std::regex op_regex(R"re(\btorch\.([A-Za-z0-9_.]+))re");
+  static const std::regex name_regex(R"re("([^"]*)"\()re");
+  static const std::regex file_regex(R"re("([^"]*)":(\d+):(\d+))re");
+
+  // Views into the text, only the lines read further are copied
+  std::map<std::string, std::string> aliases;
+  std::vector<std::string_view> lines;
+  for (size_t begin = 0; begin < text.size();) {
+    size_t end = std::min(text.find('\n', begin), text.size());
+    std::string_view line = text.substr(begin, end - begin);
+    begin = end + 1;
+    // Only the weights follow
+    if (line.rfind("{-#", 0) == 0)
+      break;
+    if (line.rfind("#loc", 0) == 0) {
+      std::string alias(line);
+      std::smatch match;
+      if (std::regex_match(alias, match, alias_def))
+        aliases[match[1].str()] = match[2].str();
+    }
+    lines.push_back(line);
+  }
+
+  // Aliases may refer to aliases; the depth bound guards against cycles
+  auto resolve = [&](std::string location) {
+    for (int depth = 0; depth < 8; depth++) {
+      std::string resolved;
+      std::smatch match;
+      std::string::const_iterator begin = location.cbegin();
+      bool substituted = false;
+      while (std::regex_search(begin, location.cend(), match, alias_use)) {
+        resolved.append(begin, match[0].first);
+        auto it = aliases.find(match[0].str());
+        resolved += it == aliases.end() ? match[0].str() : it->second;
+        substituted |= it != aliases.end();
+        begin = match[0].second;
+      }
+      resolved.append(begin, location.cend());
+      location = resolved;
+      if (!substituted)
+        break;
+    }
+    return location;
+  };
+
+  std::vector<ParsedOp> ops;
+  for (size_t l = 0; l < lines.size(); l++) {
+    if (lines[l].rfind("#loc", 0) == 0 ||
+        lines[l].find("torch.") == std::string_view::npos)
+      continue;
+    std::string line(lines[l]);
+    std::smatch op_match;
+    if (!std::regex_search(line, op_match, op_regex) ||
+        !op_types.count(op_match[1].str()))
+      continue;
+    ParsedOp op;
+    op.op = "torch." + op_match[1].str();
+
+    // The op's trailing loc(...), parentheses balanced
+    size_t loc_begin = line.rfind(" loc(");
+    if (loc_begin != std::string::npos) {
+      size_t start = loc_begin + 5, end = start;
+      for (int depth = 1; end < line.size() && depth > 0; end++)
+        depth += line[end] == '(' ? 1 : line[end] == ')' ? -1 : 0;
+      std::string location =
+          resolve(line.substr(start, end > start ? end - start - 1 : 0));
+      std::smatch match;
+      if (std::regex_search(location, match, name_regex))
+        op.name = match[1].str();
+      if (std::regex_search(location, match, file_regex))
+        op.location = fs::path(match[1].str()).filename().string() + ":" +
+                      match[2].str() + ":" + match[3].str();
+    } else {
+      // The parser's location is where the op's results start
+      size_t column = line.find_first_not_of(" \t");
+      op.location = file_name + ":" + std::to_string(l + 1) + ":" +
+                    std::to_string(column + 1);
+    }
+    ops.push_back(op);
+  }
+  return ops;
+}
+
+bool ModelLayers::build(const fs::path &model_filepath,
+                        const fs::path &model_text_filepath,
+                        const fs::path &lowering_folder) {
+  ModelLayers::layers.clear();
+  ModelLayers::kernel_layers.clear();
+
+  std::vector<KernelTask> kernels;
+  if (!KernelIndex::load(lowering_folder, kernels))
+    return false;
+  std::set<std::string> op_types;
+  std::map<std::string, std::vector<fs::path>> kernels_by_op;
+  for (const KernelTask &kernel : kernels) {
+    op_types.insert(kernel.op_type);
+    kernels_by_op["torch." + kernel.op_type].push_back(kernel.mlir_filepath);
+  }
+
+  std::vector<ParsedOp> model_ops;
+  {
+    MappedFile model_text(model_text_filepath);
+    if (!model_text.valid()) {
+      std::cerr << "Could not read " << model_text_filepath
+                << ", kernels are not attributed to model layers\n";
+      return false;
+    }
+    model_ops = parse_ops(model_text.view(),
+                          model_text_filepath.filename().string(), op_types);
+  }
+
+  std::map<std::string, size_t> occurrences;
+  for (const ParsedOp &op : model_ops) {
+    ModelLayer layer;
+    layer.index = ModelLayers::layers.size();
+    layer.op = op.op;
+    layer.location = op.location;
+    layer.name = op.name.empty()
+                     ? op.op.substr(6) + "#" +
+                           std::to_string(occurrences[op.op])
+                     : op.name;
+    occurrences[op.op]++;
+    ModelLayers::layers.push_back(layer);
+  }
+
+  // Kernel of every layer, empty where nothing was isolated
+  std::vector<std::string> layer_kernels(ModelLayers::layers.size());
+  size_t unmatched = 0;
+  for (auto &[op, files] : kernels_by_op) {
+    std::sort(files.begin(), files.end(),
+              [](const fs::path &a, const fs::path &b) {
+                return natural_less(a.filename().string(),
+                                    b.filename().string());
+              });
+    std::vector<std::string> locations;
+    for (const fs::path &file : files) {
+      std::vector<ParsedOp> kernel_ops = parse_ops(
+          read_text(file), file.filename().string(), {op.substr(6)});
+      locations.push_back(kernel_ops.empty() ? "" : kernel_ops[0].location);
+    }
+
+    std::vector<bool> assigned(files.size(), false);
+    auto claim = [&](size_t k, bool by_location) {
+      for (ModelLayer &layer : ModelLayers::layers) {
+        if (layer.op != op || !layer_kernels[layer.index].empty() ||
+            (by_location && layer.location != locations[k]))
+          continue;
+        layer_kernels[layer.index] = files[k].string();
+        ModelLayers::kernel_layers[kernel_key(files[k])] = layer;
+        assigned[k] = true;
+        return;
+      }
+    };
+    for (size_t k = 0; k < files.size(); k++)
+      if (!locations[k].empty())
+        claim(k, true);
+    for (size_t k = 0; k < files.size(); k++)
+      if (!assigned[k])
+        claim(k, false);
+    unmatched += std::count(assigned.begin(), assigned.end(), false);
+  }
+
+  json entries = json::array();
+  for (const ModelLayer &layer : ModelLayers::layers) {
+    json entry = ModelLayers::to_json(layer);
+    entry["kernel"] =
+        layer_kernels[layer.index].empty()
+            ? ""
+            : fs::path(layer_kernels[layer.index])
+                  .lexically_relative(lowering_folder)
+                  .generic_string();
+    entries.push_back(entry);
+  }
+
+  fs::path layers_filepath = ModelLayers::filepath(lowering_folder);
+  std::ofstream file(layers_filepath);
+  if (!file.is_open()) {
+    std::cerr << "Error: Could not open " << layers_filepath
+              << " for writing.\n";
+    return false;
+  }
+  file << json({{"model", model_filepath.generic_string()},
+                {"layers", entries}})
+              .dump(2)
+       << "\n";
+  std::cout << "Attributed " << ModelLayers::kernel_layers.size()
+            << " kernels to " << ModelLayers::layers.size()
+            << " model layers in " << layers_filepath << "\n";
+  if (unmatched > 0)
+    std::cerr << "Warning: " << unmatched
+              << " kernels match no op of the model\n";
+  return true;
+}
+
+const ModelLayer *ModelLayers::find(const fs::path &kernel_filepath) {
+  auto it = ModelLayers::kernel_layers.find(kernel_key(kernel_filepath));
+  return it == ModelLayers::kernel_layers.end() ? nullptr : &it->second;
+}
+
+json ModelLayers::to_json(const ModelLayer &layer) {
+  return {{"index", layer.index},
+          {"name", layer.name},
+          {"op", layer.op},
+          {"location", layer.location}};
+}
+
+json ModelLayers::layers_of(const KernelTask &task) {
+  json result = json::array();
+  if (const ModelLayer *layer = ModelLayers::find(task.mlir_filepath))
+    result.push_back(ModelLayers::to_json(*layer));
+  for (const fs::path &duplicate : task.duplicate_filepaths)
+    if (const ModelLayer *layer = ModelLayers::find(duplicate))
+      result.push_back(ModelLayers::to_json(*layer));
+  return result;
+}
+
+bool ModelLayers::write_timeline(const std::vector<KernelTask> &tasks,
+                                 const std::string &metric,
+                                 const KernelTask *model_task,
+                                 const fs::path &csv_filepath) {
+  if (ModelLayers::layers.empty())
+    return true;
+
+  // Duplicates cost what their representative measured
+  std::map<std::string, const KernelTask *> task_of;
+  for (const KernelTask &task : tasks) {
+    task_of[kernel_key(task.mlir_filepath)] = &task;
+    for (const fs::path &duplicate : task.duplicate_filepaths)
+      task_of[kernel_key(duplicate)] = &task;
+  }
+  std::vector<const KernelTask *> layer_tasks(ModelLayers::layers.size());
+  for (const auto &[kernel, layer] : ModelLayers::kernel_layers) {
+    auto it = task_of.find(kernel);
+    if (it != task_of.end())
+      layer_tasks[layer.index] = it->second;
+  }
+  auto value_of = [&](const KernelTask *task, double &value) {
+    if (!task || !task->measured || !task->failure.empty())
+      return false;
+    auto it = task->average_metrics.find(metric);
+    if (it == task->average_metrics.end())
+      return false;
+    value = it->second;
+    return true;
+  };
+
+  double total = 0.0;
+  for (const KernelTask *task : layer_tasks) {
+    double value;
+    if (value_of(task, value))
+      total += value;
+  }
+
+  std::ofstream csv(csv_filepath);
+  if (!csv.is_open()) {
+    std::cerr << "Error: Could not open " << csv_filepath
+              << " for writing.\n";
+    return false;
+  }
+  csv << "index,layer,op,location,kernel," << metric << ",cumulative,share\n";
+  double cumulative = 0.0;
+  for (const ModelLayer &layer : ModelLayers::layers) {
+    const KernelTask *task = layer_tasks[layer.index];
+    csv << layer.index << "," << layer.name << "," << layer.op << ","
+        << layer.location << ","
+        << (task ? (task->mlir_filepath.parent_path().filename() /
+                    task->mlir_filepath.filename())
+                       .generic_string()
+                 : "")
+        << ",";
+    double value;
+    if (value_of(task, value)) {
+      cumulative += value;
+      csv << value << "," << cumulative << ",";
+      if (total != 0.0)
+        csv << value / total;
+    } else {
+      csv << "," << cumulative << ",";
+    }
+    csv << "\n";
+  }
+  // The whole model against the sum of its layers
+  double end_to_end;
+  if (value_of(model_task, end_to_end)) {
+    csv << ",end_to_end,,,," << end_to_end << "," << cumulative << ",";
+    if (end_to_end != 0.0)
+      csv << cumulative / end_to_end;
+    csv << "\n";
+  }
+  return true;
+}
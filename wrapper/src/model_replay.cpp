@@ -0,0 +1,181 @@
+#include "model_replay.h"
+#include "model_layers.h"
+#include "subgraph_isolation.h"
+
+#include <fstream>
+#include <iostream>
+
+fs::path ModelReplay::folder(const fs::path &output_folder) {
+  return fs::path(output_folder).append("replay");
+}
+
+static fs::path layer_folder(const fs::path &replay_folder, size_t index) {
+  return fs::path(replay_folder).append("layers").append(
+      std::to_string(index));
+}
+
+std::vector<ReplayedLayer>
+ModelReplay::run(CommandManager &manager, std::vector<KernelTask> &tasks,
+                 const std::set<std::string> &op_types,
+                 const fs::path &model_text_filepath,
+                 const fs::path &tensor_source,
+                 const fs::path &output_folder, const Measure &measure) {
+  std::vector<ReplayedLayer> replayed;
+  std::vector<std::vector<KernelInput>> inputs =
+      SubgraphIsolation::kernel_inputs(model_text_filepath, op_types);
+
+  // Duplicates replay their representative
+  std::map<size_t, std::pair<KernelTask *, const ModelLayer *>> layer_tasks;
+  for (KernelTask &task : tasks) {
+    if (!task.measured || !task.failure.empty())
+      continue;
+    std::vector<fs::path> kernels{task.mlir_filepath};
+    kernels.insert(kernels.end(), task.duplicate_filepaths.begin(),
+                   task.duplicate_filepaths.end());
+    for (const fs::path &kernel : kernels)
+      if (const ModelLayer *layer = ModelLayers::find(kernel))
+        layer_tasks[layer->index] = {&task, layer};
+  }
+  if (inputs.empty() || layer_tasks.empty()) {
+    std::cerr << "No measured kernel traced to a model layer, nothing to "
+                 "replay\n";
+    return replayed;
+  }
+
+  // Last layer reading each layer's outputs
+  std::map<long, size_t> last_use;
+  for (const auto &[index, entry] : layer_tasks)
+    if (index < inputs.size())
+      for (const KernelInput &input : inputs[index])
+        if (input.producer >= 0)
+          last_use[input.producer] = index;
+
+  std::error_code ec;
+  fs::path replay_folder = ModelReplay::folder(output_folder);
+  fs::remove_all(replay_folder, ec);
+  fs::path bind_folder = fs::path(replay_folder).append("bind");
+
+  for (const auto &[index, entry] : layer_tasks) {
+    auto [task, layer] = entry;
+    ReplayedLayer result;
+    result.index = index;
+    result.name = layer->name;
+    result.op = layer->op;
+    result.task = task;
+
+    // Only this kernel's links, the previous layer's are gone
+    std::string kernel_name = task->json_filepath.stem().generic_string();
+    fs::path kernel_folder = fs::path(bind_folder).append(kernel_name);
+    fs::remove_all(bind_folder, ec);
+    fs::create_directories(kernel_folder, ec);
+    const std::vector<KernelInput> untraced;
+    const std::vector<KernelInput> &arguments =
+        index < inputs.size() ? inputs[index] : untraced;
+    result.arguments = arguments.size();
+    for (size_t i = 0; i < arguments.size(); i++) {
+      std::string arg_file = "arg" + std::to_string(i) + ".npy";
+      fs::path target;
+      if (arguments[i].producer >= 0)
+        target = layer_folder(replay_folder, arguments[i].producer)
+                     .append("output" + std::to_string(arguments[i].result) +
+                             ".npy");
+      if (!target.empty() && fs::exists(target, ec))
+        result.chained++;
+      else if (!tensor_source.empty())
+        target = fs::path(tensor_source).append(kernel_name).append(arg_file);
+      if (!target.empty() && fs::exists(target, ec))
+        fs::create_symlink(fs::absolute(target, ec),
+                           fs::path(kernel_folder).append(arg_file), ec);
+    }
+
+    std::cout << "Replaying layer " << index << " (" << layer->name << "), "
+              << result.chained << "/" << result.arguments
+              << " arguments from upstream kernels:\n";
+    manager.set_tensor_source(bind_folder);
+    manager.set_replay_outputs(layer_folder(replay_folder, index));
+    if (measure(*task, result.samples))
+      task->replay_results.insert(task->replay_results.end(),
+                                  result.samples.begin(),
+                                  result.samples.end());
+    else
+      std::cerr << "Replaying layer " << index << " failed, its consumers "
+                << "get generated inputs\n";
+
+    // Outputs no later layer reads
+    if (!last_use.count(index))
+      fs::remove_all(layer_folder(replay_folder, index), ec);
+    for (auto it = last_use.begin(); it != last_use.end();)
+      if (it->second <= index) {
+        fs::remove_all(layer_folder(replay_folder, it->first), ec);
+        it = last_use.erase(it);
+      } else {
+        ++it;
+      }
+    replayed.push_back(std::move(result));
+  }
+
+  manager.set_tensor_source(tensor_source);
+  manager.set_replay_outputs("");
+  fs::remove_all(replay_folder, ec);
+  return replayed;
+}
+
+bool ModelReplay::write_comparison(const std::vector<ReplayedLayer> &layers,
+                                   const std::string &metric,
+                                   const fs::path &csv_filepath) {
+  if (layers.empty())
+    return false;
+
+  std::ofstream csv(csv_filepath);
+  if (!csv.is_open()) {
+    std::cerr << "Error: Could not open " << csv_filepath
+              << " for writing.\n";
+    return false;
+  }
+  csv << "index,layer,op,kernel,chained,arguments,metric,isolated,replayed,"
+         "ratio\n";
+  double isolated_total = 0.0, replayed_total = 0.0;
+  for (const ReplayedLayer &layer : layers) {
+    double sum = 0.0;
+    size_t count = 0;
+    for (const std::map<std::string, double> &sample : layer.samples) {
+      auto value = sample.find(metric);
+      if (value != sample.end()) {
+        sum += value->second;
+        count++;
+      }
+    }
+    auto isolated = layer.task->average_metrics.find(metric);
+
+    csv << layer.index << "," << layer.name << "," << layer.op << ","
+        << (layer.task->mlir_filepath.parent_path().filename() /
+            layer.task->mlir_filepath.filename())
+               .generic_string()
+        << "," << layer.chained << "," << layer.arguments << "," << metric
+        << ",";
+    if (isolated != layer.task->average_metrics.end())
+      csv << isolated->second;
+    csv << ",";
+    if (count > 0)
+      csv << sum / count;
+    csv << ",";
+    if (count > 0 && isolated != layer.task->average_metrics.end() &&
+        isolated->second != 0.0) {
+      csv << sum / count / isolated->second;
+      isolated_total += isolated->second;
+      replayed_total += sum / count;
+    }
+    csv << "\n";
+  }
+  csv << ",model,,,,," << metric << "," << isolated_total << ","
+      << replayed_total << ",";
+  if (isolated_total != 0.0)
+    csv << replayed_total / isolated_total;
+  csv << "\n";
+
+  if (isolated_total != 0.0)
+    std::cout << "Replayed layers: " << metric << " "
+              << replayed_total / isolated_total
+              << "x of the isolated kernels\n";
+  return true;
+}
@@ -0,0 +1,92 @@
+#include "model_source.h"
+#include "mlir_engine.h"
+
+#include <cstdlib>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+fs::path ModelSource::torch_opt_exec;
+
+MappedFile::MappedFile(const fs::path &filepath) {
+  int fd = open(filepath.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return;
+  struct stat status;
+  if (fstat(fd, &status) == 0 && status.st_size > 0) {
+    void *address =
+        mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (address != MAP_FAILED) {
+      // Readers go front to back once
+      madvise(address, status.st_size, MADV_SEQUENTIAL);
+      m_data = static_cast<const char *>(address);
+      m_bytes = status.st_size;
+    }
+  }
+  // The mapping keeps the file
+  close(fd);
+}
+
+MappedFile::~MappedFile() {
+  if (m_data)
+    munmap(const_cast<char *>(m_data), m_bytes);
+}
+
+void ModelSource::set_torch_opt(const fs::path &exec) {
+  ModelSource::torch_opt_exec = exec;
+}
+
+bool ModelSource::is_bytecode(const fs::path &filepath) {
+  char magic[4] = {};
+  std::ifstream file(filepath, std::ios::binary);
+  return file.read(magic, sizeof(magic)) && magic[0] == 'M' &&
+         magic[1] == 'L' && magic[2] == '\xef' && magic[3] == 'R';
+}
+
+// Through the in-process engine if built, else one torch-mlir-opt call
+static bool write_model(const fs::path &model_filepath,
+                        const fs::path &output_filepath, bool bytecode,
+                        size_t elide_bytes, const fs::path &torch_opt_exec) {
+  std::error_code ec;
+  fs::remove(output_filepath, ec);
+  if (MLIREngine::available()) {
+    if (!MLIREngine::convert_model(model_filepath, output_filepath, bytecode,
+                                   elide_bytes))
+      return false;
+  } else {
+    std::string flags =
+        bytecode ? " --emit-bytecode" : " --mlir-print-debuginfo";
+    if (!bytecode && elide_bytes)
+      flags += " --mlir-elide-elementsattrs-if-larger=" +
+               std::to_string(elide_bytes) +
+               " --mlir-elide-resource-strings-if-larger=" +
+               std::to_string(elide_bytes);
+    std::system((torch_opt_exec.generic_string() + flags + " " +
+                 model_filepath.generic_string() + " -o " +
+                 output_filepath.generic_string())
+                    .c_str());
+  }
+  if (!fs::exists(output_filepath, ec) ||
+      fs::file_size(output_filepath, ec) == 0) {
+    std::cerr << "Could not write " << output_filepath << " from "
+              << model_filepath << "\n";
+    return false;
+  }
+  return true;
+}
+
+bool ModelSource::convert(const fs::path &model_filepath,
+                          const fs::path &bytecode_filepath) {
+  return write_model(model_filepath, bytecode_filepath, true, 0,
+                     ModelSource::torch_opt_exec);
+}
+
+bool ModelSource::write_text(const fs::path &model_filepath,
+                             const fs::path &text_filepath,
+                             size_t elide_bytes) {
+  return write_model(model_filepath, text_filepath, false, elide_bytes,
+                     ModelSource::torch_opt_exec);
+}
@@ -0,0 +1,196 @@
+#include "noise_monitor.h"
+#include "cpu_environment.h"
+#include "utils.h"
+
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <sched.h>
+#include <sstream>
+#include <sys/resource.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+static const uint32_t MSR_MPERF = 0xE7;
+static const uint32_t MSR_APERF = 0xE8;
+
+// Package temperature sensor: thermal zone first, then hwmon drivers
+static fs::path temperature_path() {
+  std::error_code error;
+  for (const auto &zone :
+       fs::directory_iterator("/sys/class/thermal", error))
+    if (read_line(zone.path() / "type") == "x86_pkg_temp")
+      return zone.path() / "temp";
+  for (const auto &hwmon : fs::directory_iterator("/sys/class/hwmon", error)) {
+    std::string name = read_line(hwmon.path() / "name");
+    if ((name == "coretemp" || name == "k10temp") &&
+        fs::exists(hwmon.path() / "temp1_input"))
+      return hwmon.path() / "temp1_input";
+  }
+  return {};
+}
+
+NoiseMonitor::NoiseMonitor(const NoiseConfig &config)
+    : m_config(config), m_cpu(sched_getcpu()) {
+  m_msr_fd = open(("/dev/cpu/" + std::to_string(m_cpu) + "/msr").c_str(),
+                  O_RDONLY | O_CLOEXEC);
+  m_interrupts_fd = open("/proc/interrupts", O_RDONLY | O_CLOEXEC);
+  fs::path temperature = temperature_path();
+  if (!temperature.empty())
+    m_temperature_fd = open(temperature.c_str(), O_RDONLY | O_CLOEXEC);
+}
+
+NoiseMonitor::~NoiseMonitor() {
+  for (int fd : {m_msr_fd, m_interrupts_fd, m_temperature_fd})
+    if (fd >= 0)
+      close(fd);
+}
+
+void NoiseMonitor::read_interrupts(NoiseSnapshot &snapshot) {
+  if (m_interrupts_fd < 0)
+    return;
+  std::string text;
+  char buffer[65536];
+  ssize_t length;
+  off_t offset = 0;
+  while ((length = pread(m_interrupts_fd, buffer, sizeof(buffer), offset)) >
+         0) {
+    text.append(buffer, length);
+    offset += length;
+  }
+
+  std::istringstream lines(text);
+  std::string line;
+  // Offline CPUs have no column, so the header names them
+  std::getline(lines, line);
+  std::istringstream header(line);
+  std::string token, wanted = "CPU" + std::to_string(m_cpu);
+  int column = -1;
+  for (int c = 0; header >> token; c++)
+    if (token == wanted)
+      column = c;
+  if (column < 0)
+    return;
+
+  while (std::getline(lines, line)) {
+    std::istringstream fields(line);
+    std::string label;
+    fields >> label;
+    uint64_t count = 0;
+    int c = 0;
+    for (; c <= column && fields >> token; c++)
+      if (c == column &&
+          token.find_first_not_of("0123456789") == std::string::npos)
+        count = std::stoull(token);
+    // ERR: and MIS: are system wide totals without per CPU columns
+    if (c <= column || label == "ERR:" || label == "MIS:")
+      continue;
+    if (label == "LOC:")
+      snapshot.timer_irqs += count;
+    else
+      snapshot.irqs += count;
+  }
+}
+
+double NoiseMonitor::read_temperature() {
+  if (m_temperature_fd < 0)
+    return 0.0;
+  char buffer[32];
+  ssize_t length = pread(m_temperature_fd, buffer, sizeof(buffer) - 1, 0);
+  if (length <= 0)
+    return 0.0;
+  buffer[length] = '\0';
+  return std::atof(buffer) / 1000.0;
+}
+
+NoiseSnapshot NoiseMonitor::snapshot() {
+  NoiseSnapshot snapshot;
+  read_interrupts(snapshot);
+  rusage usage;
+  if (getrusage(RUSAGE_THREAD, &usage) == 0) {
+    snapshot.page_faults = usage.ru_minflt + usage.ru_majflt;
+    snapshot.switches = usage.ru_nvcsw + usage.ru_nivcsw;
+  }
+  if (m_msr_fd >= 0 &&
+      (pread(m_msr_fd, &snapshot.aperf, sizeof(uint64_t), MSR_APERF) !=
+           sizeof(uint64_t) ||
+       pread(m_msr_fd, &snapshot.mperf, sizeof(uint64_t), MSR_MPERF) !=
+           sizeof(uint64_t))) {
+    close(m_msr_fd);
+    m_msr_fd = -1;
+    snapshot.aperf = snapshot.mperf = 0;
+  }
+  snapshot.cpu = sched_getcpu();
+  // Last, so the reads above fall outside the window
+  snapshot.time = std::chrono::steady_clock::now();
+  return snapshot;
+}
+
+bool NoiseMonitor::record(const NoiseSnapshot &before,
+                          const NoiseSnapshot &after,
+                          std::map<std::string, double> &sample) {
+  double seconds =
+      std::chrono::duration<double>(after.time - before.time).count();
+  double mhz = after.aperf > before.aperf && seconds > 0.0
+                   ? (after.aperf - before.aperf) / seconds / 1e6
+                   : CPUEnvironment::current_frequency_mhz(m_cpu);
+  double irqs = static_cast<double>(after.irqs - before.irqs);
+  double page_faults = static_cast<double>(after.page_faults -
+                                           before.page_faults);
+  double switches = static_cast<double>(after.switches - before.switches);
+  double migrations = after.cpu != before.cpu ? 1.0 : 0.0;
+  double temperature = read_temperature();
+
+  sample["noise_irqs"] = irqs;
+  sample["noise_timer_irqs"] =
+      static_cast<double>(after.timer_irqs - before.timer_irqs);
+  sample["noise_page_faults"] = page_faults;
+  sample["noise_switches"] = switches;
+  sample["noise_migrations"] = migrations;
+  sample["noise_mhz"] = mhz;
+  sample["noise_temp_c"] = temperature;
+
+  const NoiseConfig &limits = m_config;
+  bool noisy = (limits.max_irqs >= 0.0 && irqs > limits.max_irqs) ||
+               (limits.max_page_faults >= 0.0 &&
+                page_faults > limits.max_page_faults) ||
+               (limits.max_temp_c >= 0.0 && temperature > 0.0 &&
+                temperature > limits.max_temp_c) ||
+               (limits.count_switches && (switches > 0.0 || migrations > 0.0));
+  if (mhz > 0.0) {
+    if (limits.max_freq_drop >= 0.0 && m_peak_mhz > 0.0 &&
+        mhz < m_peak_mhz * (1.0 - limits.max_freq_drop))
+      noisy = true;
+    m_peak_mhz = std::max(m_peak_mhz, mhz);
+  }
+  sample["noisy"] = noisy ? 1.0 : 0.0;
+  return noisy;
+}
+
+std::vector<std::string> NoiseMonitor::columns() {
+  return {"noise_irqs",     "noise_timer_irqs", "noise_page_faults",
+          "noise_switches", "noise_migrations", "noise_mhz",
+          "noise_temp_c",   "noisy",            "noise_retries"};
+}
+
+std::string NoiseMonitor::describe(NoiseAction action) {
+  switch (action) {
+  case NoiseAction::MARK:
+    return "mark";
+  case NoiseAction::RETRY:
+    return "retry";
+  default:
+    return "off";
+  }
+}
+
+bool NoiseMonitor::parse(const std::string &name, NoiseAction &action) {
+  for (NoiseAction candidate :
+       {NoiseAction::OFF, NoiseAction::MARK, NoiseAction::RETRY})
+    if (NoiseMonitor::describe(candidate) == name) {
+      action = candidate;
+      return true;
+    }
+  return false;
+}
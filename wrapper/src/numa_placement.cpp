@@ -0,0 +1,152 @@
+#include "numa_placement.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+// From <numaif.h>, which is only shipped with libnuma
+static const int MPOL_BIND_MODE = 2;
+static const int MPOL_INTERLEAVE_MODE = 3;
+
+// Parses sysfs cpu/node lists such as "0-3,8,10-11"
+static std::vector<int> parse_id_list(const std::string &list) {
+  std::vector<int> ids;
+  std::stringstream ranges(list);
+  std::string range;
+  while (std::getline(ranges, range, ',')) {
+    if (range.empty())
+      continue;
+    size_t dash = range.find('-');
+    int first = std::stoi(range.substr(0, dash));
+    int last = dash == std::string::npos ? first
+                                         : std::stoi(range.substr(dash + 1));
+    for (int id = first; id <= last; id++)
+      ids.push_back(id);
+  }
+  return ids;
+}
+
+std::vector<int> NumaPlacement::online_nodes() {
+  std::ifstream online("/sys/devices/system/node/online");
+  std::string list;
+  if (!online.is_open() || !std::getline(online, list))
+    return {0};
+  std::vector<int> nodes = parse_id_list(list);
+  return nodes.empty() ? std::vector<int>{0} : nodes;
+}
+
+int NumaPlacement::node_of_cpu(int cpu) {
+  // The cpu directory holds a nodeN link to its node
+  std::error_code ec;
+  fs::path cpu_dir =
+      fs::path("/sys/devices/system/cpu/cpu" + std::to_string(cpu));
+  for (const fs::directory_entry &entry :
+       fs::directory_iterator(cpu_dir, ec)) {
+    std::string name = entry.path().filename().string();
+    if (name.rfind("node", 0) == 0 && name.size() > 4 &&
+        std::isdigit((unsigned char)name[4]))
+      return std::stoi(name.substr(4));
+  }
+  return 0;
+}
+
+std::vector<int> NumaPlacement::cpus_of_node(int node) {
+  std::ifstream cpulist("/sys/devices/system/node/node" +
+                        std::to_string(node) + "/cpulist");
+  std::string list;
+  std::vector<int> cpus;
+  if (cpulist.is_open() && std::getline(cpulist, list))
+    cpus = parse_id_list(list);
+  if (cpus.empty())
+    for (int cpu = 0; cpu < get_online_cpu_count(); cpu++)
+      cpus.push_back(cpu);
+  return cpus;
+}
+
+std::vector<int> NumaPlacement::target_nodes(NumaPolicy policy, int cpu) {
+  std::vector<int> nodes = NumaPlacement::online_nodes();
+  int local = NumaPlacement::node_of_cpu(cpu);
+
+  switch (policy) {
+  case NumaPolicy::FIRST_TOUCH:
+    return {};
+  case NumaPolicy::LOCAL_NODE:
+    return {local};
+  case NumaPolicy::INTERLEAVE:
+    return nodes;
+  case NumaPolicy::REMOTE_NODE: {
+    // Next node after the local one, so that the choice is stable
+    auto it = std::upper_bound(nodes.begin(), nodes.end(), local);
+    int remote = it != nodes.end() ? *it : nodes.front();
+    if (remote == local)
+      std::cerr << "Only one NUMA node online, remote placement is local\n";
+    return {remote};
+  }
+  }
+  return {};
+}
+
+bool NumaPlacement::bind(void *addr, size_t bytes, NumaPolicy policy,
+                         const std::vector<int> &nodes) {
+  if (policy == NumaPolicy::FIRST_TOUCH || nodes.empty())
+    return true;
+#ifdef __linux__
+  int max_node = *std::max_element(nodes.begin(), nodes.end());
+  std::vector<unsigned long> mask(max_node / (8 * sizeof(unsigned long)) + 1,
+                                  0);
+  for (int node : nodes)
+    mask[node / (8 * sizeof(unsigned long))] |=
+        1ul << (node % (8 * sizeof(unsigned long)));
+
+  int mode = policy == NumaPolicy::INTERLEAVE ? MPOL_INTERLEAVE_MODE
+                                              : MPOL_BIND_MODE;
+  // maxnode counts bits, the kernel ignores the last one
+  if (syscall(SYS_mbind, addr, bytes, mode, mask.data(),
+              mask.size() * 8 * sizeof(unsigned long) + 1, 0) != 0) {
+    std::cerr << "mbind to NUMA node(s) "
+              << NumaPlacement::describe_nodes(nodes)
+              << " failed: " << std::strerror(errno) << "\n";
+    return false;
+  }
+  return true;
+#else
+  return false;
+#endif
+}
+
+std::string NumaPlacement::describe(NumaPolicy policy) {
+  switch (policy) {
+  case NumaPolicy::FIRST_TOUCH:
+    return "first-touch";
+  case NumaPolicy::LOCAL_NODE:
+    return "local";
+  case NumaPolicy::INTERLEAVE:
+    return "interleave";
+  case NumaPolicy::REMOTE_NODE:
+    return "remote";
+  }
+  return "unknown";
+}
+
+std::string NumaPlacement::describe_nodes(const std::vector<int> &nodes) {
+  if (nodes.empty())
+    return "any";
+  std::string described;
+  for (size_t i = 0; i < nodes.size(); i++)
+    described += (i ? ";" : "") + std::to_string(nodes[i]);
+  return described;
+}
@@ -0,0 +1,225 @@
+#include "output_verifier.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+
+// Elements converted per block, small enough to stay in L1
+static const uint64_t BLOCK_ELEMENTS = 1024;
+
+void VerificationResult::merge(const VerificationResult &other) {
+  passed = passed && other.passed;
+  elements += other.elements;
+  mismatches += other.mismatches;
+  max_abs_error = std::max(max_abs_error, other.max_abs_error);
+  max_rel_error = std::max(max_rel_error, other.max_rel_error);
+  max_ulp_error = std::max(max_ulp_error, other.max_ulp_error);
+  if (error.empty())
+    error = other.error;
+}
+
+fs::path OutputVerifier::reference_prefix(const fs::path &reference_root,
+                                          const std::string &op_type,
+                                          const std::string &kernel) {
+  return fs::path(reference_root)
+      .append("references")
+      .append(op_type)
+      .append(kernel);
+}
+
+bool OutputVerifier::write_reference(
+    const fs::path &prefix,
+    const std::vector<std::unique_ptr<MemRefArg>> &results) {
+  std::error_code ec;
+  fs::create_directories(prefix.parent_path(), ec);
+
+  json header = json::array();
+  for (size_t r = 0; r < results.size(); r++) {
+    MemRefArg &result = *results[r];
+    std::vector<int64_t> shape(result.m_desc->dimension,
+                               result.m_desc->dimension +
+                                   result.get_tensor_rank());
+    header.push_back({{"dtype", ElementTypes::describe(result.m_elem_type)},
+                      {"shape", shape}});
+
+    std::vector<uint8_t> dense = result.dense_copy();
+    std::ofstream data(prefix.generic_string() + ".result" +
+                           std::to_string(r) + ".bin",
+                       std::ios::binary | std::ios::trunc);
+    data.write(reinterpret_cast<const char *>(dense.data()), dense.size());
+    if (!data.good()) {
+      std::cerr << "Failed to write the reference results of " << prefix
+                << "\n";
+      return false;
+    }
+  }
+
+  std::ofstream header_stream(prefix.generic_string() + ".results.json");
+  header_stream << header.dump(2) << "\n";
+  return header_stream.good();
+}
+
+VerificationResult OutputVerifier::verify(
+    const fs::path &prefix,
+    const std::vector<std::unique_ptr<MemRefArg>> &results,
+    const Tolerance &tolerance) {
+  VerificationResult verdict;
+  fs::path header_filepath = prefix.generic_string() + ".results.json";
+  if (!fs::exists(header_filepath)) {
+    verdict.passed = false;
+    verdict.error = "no reference results";
+    return verdict;
+  }
+
+  json header = load_json_from_file(header_filepath);
+  if (!header.is_array() || header.size() != results.size()) {
+    verdict.passed = false;
+    verdict.error = "reference has a different number of results";
+    return verdict;
+  }
+
+  for (size_t r = 0; r < results.size(); r++) {
+    MemRefArg &result = *results[r];
+    std::vector<int64_t> shape(result.m_desc->dimension,
+                               result.m_desc->dimension +
+                                   result.get_tensor_rank());
+    if (header[r].value("dtype", "") !=
+            ElementTypes::describe(result.m_elem_type) ||
+        header[r].value("shape", std::vector<int64_t>()) != shape) {
+      verdict.passed = false;
+      verdict.error = "result " + std::to_string(r) +
+                      " differs in dtype or shape from the reference";
+      return verdict;
+    }
+
+    std::vector<uint8_t> actual = result.dense_copy();
+    std::vector<uint8_t> expected(actual.size());
+    std::ifstream data(prefix.generic_string() + ".result" +
+                           std::to_string(r) + ".bin",
+                       std::ios::binary);
+    data.read(reinterpret_cast<char *>(expected.data()), expected.size());
+    if (data.gcount() != (std::streamsize)expected.size()) {
+      verdict.passed = false;
+      verdict.error = "reference data of result " + std::to_string(r) +
+                      " is truncated";
+      return verdict;
+    }
+
+    verdict.merge(OutputVerifier::compare(actual.data(), expected.data(),
+                                          result.get_tensor_elem_count(),
+                                          result.m_elem_type, tolerance));
+  }
+  return verdict;
+}
+
+namespace {
+/*
+ * Maps IEEE bit patterns onto a monotonic integer line, so that the distance
+ * of two values is their ULP difference
+ */
+template <typename Bits> double ordered_bits(Bits bits) {
+  constexpr Bits sign = Bits(1) << (sizeof(Bits) * 8 - 1);
+  double magnitude = static_cast<double>(bits & ~sign);
+  return (bits & sign) ? -magnitude : magnitude;
+}
+
+template <typename Bits>
+double max_ulp_distance(const void *actual, const void *expected,
+                        uint64_t count) {
+  const Bits *a = static_cast<const Bits *>(actual);
+  const Bits *b = static_cast<const Bits *>(expected);
+  double max_ulp = 0.0;
+  for (uint64_t i = 0; i < count; i++)
+    max_ulp = std::max(max_ulp,
+                       std::fabs(ordered_bits(a[i]) - ordered_bits(b[i])));
+  return max_ulp;
+}
+
+/*
+ * Error reduction over one contiguous block. Branch free (selects instead of
+ * ifs), so that it vectorises.
+ */
+template <typename V>
+void accumulate_errors(const V *a, const V *b, uint64_t count,
+                       const Tolerance &tolerance, VerificationResult &result) {
+  const V rtol = static_cast<V>(tolerance.rtol);
+  const V atol = static_cast<V>(tolerance.atol);
+  V max_abs = 0, max_rel = 0;
+  uint64_t mismatches = 0;
+
+  for (uint64_t i = 0; i < count; i++) {
+    bool nan_a = a[i] != a[i];
+    bool nan_b = b[i] != b[i];
+    // Equal infinities would give inf - inf = NaN
+    V diff = a[i] == b[i] ? V(0) : std::fabs(a[i] - b[i]);
+    bool within = diff <= atol + rtol * std::fabs(b[i]);
+    bool ok = (nan_a && nan_b) || (!nan_a && !nan_b && within);
+    mismatches += !ok;
+
+    V clean_diff = (nan_a || nan_b) ? V(0) : diff;
+    V magnitude = std::max(std::fabs(b[i]), std::numeric_limits<V>::min());
+    max_abs = std::max(max_abs, clean_diff);
+    max_rel = std::max(max_rel, clean_diff / magnitude);
+  }
+
+  result.mismatches += mismatches;
+  result.max_abs_error = std::max<double>(result.max_abs_error, max_abs);
+  result.max_rel_error = std::max<double>(result.max_rel_error, max_rel);
+}
+
+template <typename V>
+void compare_blocks(const void *actual, const void *expected, uint64_t count,
+                    ElementType type, const Tolerance &tolerance,
+                    VerificationResult &result) {
+  V a[BLOCK_ELEMENTS], b[BLOCK_ELEMENTS];
+  for (uint64_t start = 0; start < count; start += BLOCK_ELEMENTS) {
+    uint64_t block = std::min(BLOCK_ELEMENTS, count - start);
+    for (uint64_t i = 0; i < block; i++) {
+      a[i] = static_cast<V>(ElementTypes::load(actual, start + i, type));
+      b[i] = static_cast<V>(ElementTypes::load(expected, start + i, type));
+    }
+    accumulate_errors(a, b, block, tolerance, result);
+  }
+}
+} // namespace
+
+VerificationResult OutputVerifier::compare(const void *actual,
+                                           const void *expected,
+                                           uint64_t count, ElementType type,
+                                           const Tolerance &tolerance) {
+  VerificationResult result;
+  result.elements = count;
+
+  switch (type) {
+  case ElementType::F32:
+    // Already contiguous floats, no conversion needed
+    accumulate_errors(static_cast<const float *>(actual),
+                      static_cast<const float *>(expected), count, tolerance,
+                      result);
+    result.max_ulp_error = max_ulp_distance<uint32_t>(actual, expected, count);
+    break;
+  case ElementType::F64:
+    accumulate_errors(static_cast<const double *>(actual),
+                      static_cast<const double *>(expected), count, tolerance,
+                      result);
+    result.max_ulp_error = max_ulp_distance<uint64_t>(actual, expected, count);
+    break;
+  case ElementType::F16:
+  case ElementType::BF16:
+    compare_blocks<float>(actual, expected, count, type, tolerance, result);
+    result.max_ulp_error = max_ulp_distance<uint16_t>(actual, expected, count);
+    break;
+  default:
+    // Integers: exact match only
+    compare_blocks<double>(actual, expected, count, type, Tolerance{0.0, 0.0},
+                           result);
+    result.max_ulp_error = result.max_abs_error;
+    break;
+  }
+
+  result.passed = result.mismatches == 0;
+  return result;
+}
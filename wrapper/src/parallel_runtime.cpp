@@ -0,0 +1,137 @@
+#include "parallel_runtime.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <dlfcn.h>
+#include <iostream>
+#include <sstream>
+
+ParallelRuntimeKind ParallelRuntime::from_pipeline_json(const json &pipeline) {
+  if (!pipeline.contains("parallel_runtime"))
+    return ParallelRuntimeKind::SERIAL_RUNTIME;
+
+  std::string name = pipeline["parallel_runtime"].get<std::string>();
+  if (name == "openmp")
+    return ParallelRuntimeKind::OPENMP_RUNTIME;
+  if (name == "async")
+    return ParallelRuntimeKind::ASYNC_RUNTIME;
+  if (name == "cuda")
+    return ParallelRuntimeKind::CUDA_RUNTIME;
+  if (name == "rocm")
+    return ParallelRuntimeKind::ROCM_RUNTIME;
+  if (name != "none")
+    std::cerr << "Unknown parallel_runtime '" << name
+              << "', assuming serial kernels\n";
+  return ParallelRuntimeKind::SERIAL_RUNTIME;
+}
+
+bool ParallelRuntime::is_gpu(ParallelRuntimeKind kind) {
+  return kind == ParallelRuntimeKind::CUDA_RUNTIME ||
+         kind == ParallelRuntimeKind::ROCM_RUNTIME;
+}
+
+std::string ParallelRuntime::link_flags(ParallelRuntimeKind kind) {
+  switch (kind) {
+  case ParallelRuntimeKind::OPENMP_RUNTIME:
+    return " -fopenmp";
+  case ParallelRuntimeKind::ASYNC_RUNTIME:
+    // Resolved through the -L / rpath of the runner utils
+    return " -lmlir_async_runtime";
+  case ParallelRuntimeKind::CUDA_RUNTIME:
+    return " -lmlir_cuda_runtime";
+  case ParallelRuntimeKind::ROCM_RUNTIME:
+    return " -lmlir_rocm_runtime";
+  default:
+    return "";
+  }
+}
+
+std::vector<std::string>
+ParallelRuntime::runtime_libraries(ParallelRuntimeKind kind) {
+  switch (kind) {
+  case ParallelRuntimeKind::OPENMP_RUNTIME:
+    return {"libomp.so"};
+  case ParallelRuntimeKind::ASYNC_RUNTIME:
+    return {"libmlir_async_runtime.so"};
+  case ParallelRuntimeKind::CUDA_RUNTIME:
+    return {"libmlir_cuda_runtime.so"};
+  case ParallelRuntimeKind::ROCM_RUNTIME:
+    return {"libmlir_rocm_runtime.so"};
+  default:
+    return {};
+  }
+}
+
+bool ParallelRuntime::apply_thread_budget(unsigned int threads,
+                                          int first_cpu) {
+  // Runtimes read these once they start, an explicit environment wins for
+  // binding and places
+  setenv("OMP_NUM_THREADS", std::to_string(threads).c_str(), 1);
+  setenv("OMP_PROC_BIND", "close", 0);
+  setenv("OMP_PLACES", "threads", 0);
+  return pin_current_thread_range(first_cpu, threads);
+}
+
+void ParallelRuntime::set_worker_count(ParallelRuntimeKind kind,
+                                       unsigned int threads,
+                                       void *library_handle) {
+  if (kind != ParallelRuntimeKind::OPENMP_RUNTIME)
+    return;
+
+  using SetNumThreadsFn = void (*)(int);
+  auto set_num_threads = reinterpret_cast<SetNumThreadsFn>(
+      dlsym(library_handle ? library_handle : RTLD_DEFAULT,
+            "omp_set_num_threads"));
+  if (set_num_threads)
+    set_num_threads(static_cast<int>(threads));
+}
+
+std::vector<unsigned int>
+ParallelRuntime::parse_sweep(const std::string &spec) {
+  std::vector<unsigned int> counts;
+  unsigned int cpu_count =
+      static_cast<unsigned int>(std::max(1, get_online_cpu_count()));
+
+  if (spec == "pow2") {
+    for (unsigned int threads = 1; threads < cpu_count; threads *= 2)
+      counts.push_back(threads);
+    counts.push_back(cpu_count);
+    return counts;
+  }
+
+  std::stringstream ss(spec);
+  std::string count;
+  while (std::getline(ss, count, ',')) {
+    if (count.empty())
+      continue;
+    try {
+      int threads = std::stoi(count);
+      if (threads < 1 || static_cast<unsigned int>(threads) > cpu_count)
+        throw std::out_of_range(count);
+      counts.push_back(threads);
+    } catch (const std::exception &) {
+      std::cerr << "Invalid thread count '" << count << "' (1 to "
+                << cpu_count << "), skipping it\n";
+    }
+  }
+
+  std::sort(counts.begin(), counts.end());
+  counts.erase(std::unique(counts.begin(), counts.end()), counts.end());
+  return counts;
+}
+
+std::string ParallelRuntime::describe(ParallelRuntimeKind kind) {
+  switch (kind) {
+  case ParallelRuntimeKind::OPENMP_RUNTIME:
+    return "openmp";
+  case ParallelRuntimeKind::ASYNC_RUNTIME:
+    return "async";
+  case ParallelRuntimeKind::CUDA_RUNTIME:
+    return "cuda";
+  case ParallelRuntimeKind::ROCM_RUNTIME:
+    return "rocm";
+  default:
+    return "none";
+  }
+}
@@ -0,0 +1,142 @@
+#include "pass_prefix_cache.h"
+#include "utils.h"
+
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <unistd.h>
+
+bool PassPrefixCache::enabled = true;
+std::mutex PassPrefixCache::mutex;
+std::vector<PassPrefixCache::Node> PassPrefixCache::trie(1);
+std::set<std::vector<std::string>> PassPrefixCache::registered;
+
+std::atomic<uint64_t> PassPrefixCache::passes_skipped{0};
+std::atomic<uint64_t> PassPrefixCache::lowerings_reused{0};
+std::atomic<uint64_t> PassPrefixCache::nodes_stored{0};
+
+void PassPrefixCache::set_enabled(bool flag) {
+  PassPrefixCache::enabled = flag;
+}
+
+bool PassPrefixCache::is_enabled() { return PassPrefixCache::enabled; }
+
+void PassPrefixCache::add_pipeline(const std::vector<std::string> &pass_list) {
+  std::lock_guard<std::mutex> lock(PassPrefixCache::mutex);
+  if (!PassPrefixCache::registered.insert(pass_list).second)
+    return;
+
+  size_t node = 0;
+  PassPrefixCache::trie[node].pipelines++;
+  for (const std::string &pass : pass_list) {
+    auto child = PassPrefixCache::trie[node].children.find(pass);
+    if (child == PassPrefixCache::trie[node].children.end()) {
+      PassPrefixCache::trie.emplace_back();
+      child = PassPrefixCache::trie[node]
+                  .children.emplace(pass, PassPrefixCache::trie.size() - 1)
+                  .first;
+    }
+    node = child->second;
+    PassPrefixCache::trie[node].pipelines++;
+  }
+}
+
+PassPrefixCache::Plan
+PassPrefixCache::plan(const fs::path &kernel,
+                      const std::vector<std::string> &pass_list,
+                      const std::string &toolchain_id, const fs::path &folder) {
+  Plan plan;
+  if (!PassPrefixCache::enabled)
+    return plan;
+
+  // Shared depths along the path where pipelines part ways, it leaves the
+  // trie where the pass list was never registered. A shared node whose
+  // child carries all of its pipelines is never the deepest start of any
+  // of them, so it is not stored.
+  std::vector<size_t> shared;
+  {
+    std::lock_guard<std::mutex> lock(PassPrefixCache::mutex);
+    size_t node = 0;
+    for (size_t depth = 0;; depth++) {
+      const Node &current = PassPrefixCache::trie[node];
+      if (current.pipelines < 2)
+        break;
+      auto child = depth == pass_list.size()
+                       ? current.children.end()
+                       : current.children.find(pass_list[depth]);
+      if (child == current.children.end()) {
+        shared.push_back(depth);
+        break;
+      }
+      if (PassPrefixCache::trie[child->second].pipelines < current.pipelines)
+        shared.push_back(depth);
+      node = child->second;
+    }
+  }
+  if (shared.empty())
+    return plan;
+
+  std::error_code ec;
+  fs::create_directories(folder, ec);
+  std::ostringstream staging_suffix;
+  staging_suffix << ".tmp_" << getpid() << "_" << std::this_thread::get_id();
+
+  uint64_t hash = hash_string(toolchain_id, hash_file_contents(kernel));
+  size_t depth = 0;
+  for (size_t shared_depth : shared) {
+    for (; depth < shared_depth; depth++)
+      hash = hash_string(pass_list[depth] + "\n", hash);
+    fs::path filepath =
+        fs::path(folder).append(hash_to_hex(hash) + ".mlirbc");
+    if (fs::exists(filepath)) {
+      // Deeper IR makes the nodes above it redundant
+      plan.start = filepath;
+      plan.start_depth = shared_depth;
+      plan.stores.clear();
+    } else {
+      plan.stores.push_back(
+          {shared_depth, filepath,
+           fs::path(filepath).concat(staging_suffix.str())});
+    }
+  }
+
+  if (!plan.start.empty()) {
+    PassPrefixCache::lowerings_reused++;
+    PassPrefixCache::passes_skipped += plan.start_depth;
+  }
+  return plan;
+}
+
+void PassPrefixCache::commit(const Plan &plan, bool success) {
+  std::error_code ec;
+  for (const Plan::Store &store : plan.stores) {
+    bool written = success && fs::exists(store.staging) &&
+                   fs::file_size(store.staging, ec) > 0;
+    if (written) {
+      // Another thread may have published the same node, both are equal
+      fs::rename(store.staging, store.filepath, ec);
+      if (!ec)
+        PassPrefixCache::nodes_stored++;
+    }
+    fs::remove(store.staging, ec);
+  }
+}
+
+void PassPrefixCache::reset() {
+  std::lock_guard<std::mutex> lock(PassPrefixCache::mutex);
+  PassPrefixCache::enabled = true;
+  PassPrefixCache::trie.assign(1, Node());
+  PassPrefixCache::registered.clear();
+  PassPrefixCache::passes_skipped = 0;
+  PassPrefixCache::lowerings_reused = 0;
+  PassPrefixCache::nodes_stored = 0;
+}
+
+void PassPrefixCache::print_statistics() {
+  if (!PassPrefixCache::lowerings_reused && !PassPrefixCache::nodes_stored)
+    return;
+  std::cout << "Pass prefixes: " << PassPrefixCache::lowerings_reused
+            << " lowerings started from shared IR ("
+            << PassPrefixCache::passes_skipped << " passes skipped), "
+            << PassPrefixCache::nodes_stored << " prefixes stored\n";
+}
@@ -0,0 +1,76 @@
+#include "pgo_profile.h"
+
+#include <dlfcn.h>
+#include <fstream>
+
+const char *PgoProfile::DUMP_SYMBOL = "mlir_bench_profile_dump";
+
+fs::path PgoProfile::profile_path(const fs::path &ll_filepath) {
+  return fs::path(ll_filepath).replace_extension(".profdata");
+}
+
+fs::path PgoProfile::raw_folder(const fs::path &ll_filepath) {
+  return fs::path(ll_filepath).replace_extension(".profraw");
+}
+
+fs::path PgoProfile::hook_path(const fs::path &ll_filepath) {
+  return fs::path(ll_filepath).replace_extension(".pgo_hook.ll");
+}
+
+bool PgoProfile::is_current(const fs::path &ll_filepath) {
+  std::error_code ec;
+  fs::path profile = PgoProfile::profile_path(ll_filepath);
+  if (!fs::exists(profile, ec) || fs::file_size(profile, ec) == 0)
+    return false;
+  return fs::last_write_time(profile, ec) >=
+         fs::last_write_time(ll_filepath, ec);
+}
+
+std::string PgoProfile::compile_flags(const fs::path &ll_filepath) {
+  if (PgoProfile::is_current(ll_filepath))
+    return " -fprofile-use=" +
+           PgoProfile::profile_path(ll_filepath).generic_string();
+  return " -fprofile-generate=" +
+         PgoProfile::raw_folder(ll_filepath).generic_string() + " " +
+         PgoProfile::hook_path(ll_filepath).generic_string();
+}
+
+bool PgoProfile::write_hook(const fs::path &ll_filepath) {
+  fs::path hook = PgoProfile::hook_path(ll_filepath);
+  std::ofstream ir(hook);
+  ir << "declare i32 @__llvm_profile_dump()\n\n"
+     << "define i32 @" << PgoProfile::DUMP_SYMBOL << "() {\n"
+     << "  %status = call i32 @__llvm_profile_dump()\n"
+     << "  ret i32 %status\n}\n";
+  if (!ir) {
+    std::cerr << "Could not write the profile hook " << hook << "\n";
+    return false;
+  }
+  return true;
+}
+
+bool PgoProfile::write_raw(void *so_handle, const fs::path &ll_filepath) {
+  // Exported by the hook of instrumented objects only
+  using DumpFn = int (*)();
+  auto dump = reinterpret_cast<DumpFn>(
+      so_handle ? dlsym(so_handle, PgoProfile::DUMP_SYMBOL) : nullptr);
+  if (!dump) {
+    std::cerr << "No profile runtime in the object of "
+              << ll_filepath.filename() << ", is it instrumented?\n";
+    return false;
+  }
+
+  std::error_code ec;
+  fs::path raw = PgoProfile::raw_folder(ll_filepath);
+  fs::remove_all(raw, ec);
+  fs::create_directories(raw, ec);
+  return dump() == 0;
+}
+
+std::string PgoProfile::merge_command(const fs::path &llvm_profdata,
+                                      const fs::path &ll_filepath) {
+  return llvm_profdata.generic_string() + " merge -o " +
+         PgoProfile::profile_path(ll_filepath).generic_string() + " " +
+         PgoProfile::raw_folder(ll_filepath).generic_string() +
+         "/*.profraw 2>&1";
+}
@@ -0,0 +1,203 @@
+#include "pipeline_template.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <cctype>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <numeric>
+#include <set>
+
+static const size_t MAX_ORDERS = 120;
+
+bool PipelineTemplate::load(const fs::path &template_json,
+                            std::mt19937_64 &rng) {
+  if (!fs::exists(template_json)) {
+    std::cerr << "Error: No pipeline template at " << template_json << "\n";
+    return false;
+  }
+  m_template = load_json_from_file(template_json);
+  if (!m_template.contains("pass") || !m_template["pass"].is_array()) {
+    std::cerr << "Error: " << template_json << " has no \"pass\" list\n";
+    return false;
+  }
+
+  m_dimensions.clear();
+  // Outlives the loop, items() only refers to it
+  json parameters = m_template.value("parameters", json::object());
+  for (const auto &[name, values] : parameters.items()) {
+    if (!values.is_array() || values.empty()) {
+      std::cerr << "Error: parameter " << name
+                << " needs a non-empty list of values\n";
+      return false;
+    }
+    m_dimensions.push_back({name, values.get<std::vector<json>>()});
+  }
+
+  size_t group = 0;
+  for (const json &entry : m_template["pass"]) {
+    if (!entry.is_object() || !entry.contains("permute"))
+      continue;
+    std::vector<size_t> order(entry["permute"].size());
+    std::iota(order.begin(), order.end(), 0);
+    Dimension dimension{"order." + std::to_string(group++), {}};
+    if (order.size() <= 5) {
+      do
+        dimension.values.push_back(order);
+      while (std::next_permutation(order.begin(), order.end()));
+    } else {
+      // Too many orders to enumerate, the original one and a sample
+      dimension.values.push_back(order);
+      std::set<std::vector<size_t>> seen = {order};
+      for (size_t attempt = 0;
+           dimension.values.size() < MAX_ORDERS && attempt < 100 * MAX_ORDERS;
+           attempt++) {
+        std::shuffle(order.begin(), order.end(), rng);
+        if (seen.insert(order).second)
+          dimension.values.push_back(order);
+      }
+    }
+    m_dimensions.push_back(dimension);
+  }
+
+  return true;
+}
+
+const std::vector<PipelineTemplate::Dimension> &
+PipelineTemplate::dimensions() const {
+  return m_dimensions;
+}
+
+size_t PipelineTemplate::size() const {
+  size_t candidates = 1;
+  for (const Dimension &dimension : m_dimensions)
+    candidates = std::min<size_t>(candidates * dimension.values.size(),
+                                  std::numeric_limits<uint32_t>::max());
+  return candidates;
+}
+
+std::vector<std::vector<size_t>> PipelineTemplate::grid() const {
+  std::vector<std::vector<size_t>> choices;
+  std::vector<size_t> choice(m_dimensions.size(), 0);
+  while (true) {
+    choices.push_back(choice);
+    // Odometer, the last dimension varying fastest
+    size_t d = m_dimensions.size();
+    while (d > 0 && ++choice[d - 1] == m_dimensions[d - 1].values.size())
+      choice[--d] = 0;
+    if (d == 0)
+      return choices;
+  }
+}
+
+// `${name}` replaced by the chosen parameter values
+static std::string substitute(std::string text,
+                              const std::map<std::string, json> &values) {
+  for (const auto &[name, value] : values) {
+    std::string placeholder = "${" + name + "}";
+    std::string replacement =
+        value.is_string() ? value.get<std::string>() : value.dump();
+    for (size_t at = text.find(placeholder); at != std::string::npos;
+         at = text.find(placeholder, at + replacement.size()))
+      text.replace(at, placeholder.size(), replacement);
+  }
+  return text;
+}
+
+static json substitute_all(const json &node,
+                           const std::map<std::string, json> &values) {
+  if (node.is_string())
+    return substitute(node.get<std::string>(), values);
+  json result = node;
+  if (node.is_object() || node.is_array())
+    for (auto it = result.begin(); it != result.end(); ++it)
+      *it = substitute_all(*it, values);
+  return result;
+}
+
+json PipelineTemplate::render(const std::vector<size_t> &choice) const {
+  std::map<std::string, json> values;
+  std::vector<std::vector<size_t>> orders;
+  for (size_t d = 0; d < m_dimensions.size(); d++) {
+    const json &value = m_dimensions[d].values[choice[d]];
+    if (m_dimensions[d].name.rfind("order.", 0) == 0)
+      orders.push_back(value.get<std::vector<size_t>>());
+    else
+      values[m_dimensions[d].name] = value;
+  }
+
+  json pipeline = m_template;
+  pipeline.erase("parameters");
+  json passes = json::array();
+  size_t group = 0;
+  for (const json &entry : m_template["pass"]) {
+    if (entry.is_string()) {
+      passes.push_back(substitute(entry.get<std::string>(), values));
+    } else if (entry.contains("permute")) {
+      for (size_t index : orders[group])
+        passes.push_back(
+            substitute(entry["permute"][index].get<std::string>(), values));
+      group++;
+    } else if (entry.contains("pass")) {
+      auto condition = values.find(entry.value("if", ""));
+      if (condition == values.end() || condition->second == true)
+        passes.push_back(
+            substitute(entry["pass"].get<std::string>(), values));
+    }
+  }
+  pipeline = substitute_all(pipeline, values);
+  pipeline["pass"] = passes;
+  return pipeline;
+}
+
+std::vector<std::string>
+PipelineTemplate::values(const std::vector<size_t> &choice) const {
+  std::vector<std::string> texts;
+  for (size_t d = 0; d < m_dimensions.size(); d++) {
+    const json &value = m_dimensions[d].values[choice[d]];
+    std::string text;
+    if (value.is_array()) {
+      for (size_t i = 0; i < value.size(); i++)
+        text += (i ? "-" : "") + value[i].dump();
+    } else {
+      text = value.is_string() ? value.get<std::string>() : value.dump();
+    }
+    texts.push_back(text);
+  }
+  return texts;
+}
+
+std::string
+PipelineTemplate::describe(const std::vector<size_t> &choice) const {
+  std::vector<std::string> texts = values(choice);
+  std::string text;
+  for (size_t d = 0; d < m_dimensions.size(); d++)
+    text += (d ? " " : "") + m_dimensions[d].name + "=" + texts[d];
+  return text;
+}
+
+std::string PipelineTemplate::label(const std::vector<size_t> &choice) const {
+  std::vector<std::string> texts = values(choice);
+  std::string text;
+  for (size_t d = 0; d < m_dimensions.size(); d++)
+    text += (d ? "_" : "") + m_dimensions[d].name + "-" + texts[d];
+  for (char &c : text)
+    if (!std::isalnum(static_cast<unsigned char>(c)) && c != '.' &&
+        c != '-' && c != '_')
+      c = '-';
+  return text.empty() ? "template" : text;
+}
+
+std::vector<std::string> PipelineTemplate::labels(
+    const std::vector<std::vector<size_t>> &choices) const {
+  std::vector<std::string> labels;
+  std::set<std::string> taken;
+  for (const std::vector<size_t> &choice : choices) {
+    std::string base = label(choice), unique = base;
+    for (unsigned int n = 2; !taken.insert(unique).second; n++)
+      unique = base + "_" + std::to_string(n);
+    labels.push_back(unique);
+  }
+  return labels;
+}
@@ -0,0 +1,160 @@
+#include "replica_group.h"
+#include "kernel_sandbox.h"
+#include "numa_placement.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <set>
+#include <thread>
+
+#include <sys/mman.h>
+
+// A replica that never gets this far has failed without its worker dying
+static const double ARRIVAL_TIMEOUT_SECONDS = 300.0;
+// Upper bound of the load a finished replica keeps up for the others
+static const double HOLD_TIMEOUT_SECONDS = 600.0;
+
+ReplicaGroup::Barrier *ReplicaGroup::barrier = nullptr;
+
+// sysfs topology value of a CPU, -1 if not described
+static int topology_id(int cpu, const std::string &field) {
+  std::ifstream file("/sys/devices/system/cpu/cpu" + std::to_string(cpu) +
+                     "/topology/" + field);
+  int id = -1;
+  file >> id;
+  return id;
+}
+
+std::vector<int> ReplicaGroup::replica_cpus(unsigned int count,
+                                            int measure_cpu) {
+  std::vector<int> nodes = NumaPlacement::online_nodes();
+  int measure_node = NumaPlacement::node_of_cpu(measure_cpu);
+  std::stable_partition(nodes.begin(), nodes.end(),
+                        [measure_node](int node) {
+                          return node == measure_node;
+                        });
+
+  std::vector<int> cpus{measure_cpu};
+  std::set<std::pair<int, int>> cores{
+      {topology_id(measure_cpu, "physical_package_id"),
+       topology_id(measure_cpu, "core_id")}};
+  for (int node : nodes)
+    for (int cpu : NumaPlacement::cpus_of_node(node)) {
+      if (cpus.size() >= count)
+        return cpus;
+      // Without topology every CPU counts as a core of its own
+      int core = topology_id(cpu, "core_id");
+      if (cpu == measure_cpu ||
+          (core >= 0 &&
+           !cores.insert({topology_id(cpu, "physical_package_id"), core})
+                .second))
+        continue;
+      cpus.push_back(cpu);
+    }
+  return cpus;
+}
+
+bool ReplicaGroup::wait_for(const std::atomic<unsigned int> &counter,
+                            double timeout_seconds) {
+  auto start = std::chrono::steady_clock::now();
+  while (counter + barrier->failed < barrier->count) {
+    if (std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                      start)
+            .count() > timeout_seconds)
+      return false;
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+  }
+  return true;
+}
+
+void ReplicaGroup::arrive() {
+  if (!barrier)
+    return;
+  barrier->arrived++;
+  if (!ReplicaGroup::wait_for(barrier->arrived, ARRIVAL_TIMEOUT_SECONDS))
+    std::cerr << "Not every replica got ready, sampling anyway\n";
+}
+
+void ReplicaGroup::hold(const std::function<void()> &call) {
+  if (!barrier)
+    return;
+  barrier->done++;
+  auto start = std::chrono::steady_clock::now();
+  while (barrier->done + barrier->failed < barrier->count &&
+         std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+                 .count() < HOLD_TIMEOUT_SECONDS)
+    call();
+}
+
+bool ReplicaGroup::run(const std::vector<int> &cpus,
+                       const std::function<Samples(int cpu)> &measure,
+                       double timeout_seconds, Samples &samples,
+                       std::string &failure) {
+  void *shared = mmap(nullptr, sizeof(Barrier), PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (shared == MAP_FAILED) {
+    failure = "could not map the replica barrier";
+    return false;
+  }
+  // Inherited by every worker
+  barrier = new (shared) Barrier();
+  barrier->count = cpus.size();
+
+  std::vector<SandboxResult> results(cpus.size());
+  std::vector<std::string> failures(cpus.size());
+  std::vector<uint8_t> succeeded(cpus.size(), 0);
+  // Forked one after the other from this thread, see kernel_sandbox.h
+  std::vector<KernelSandbox::Worker> workers(cpus.size());
+  std::vector<uint8_t> running(cpus.size(), 0);
+  for (size_t r = 0; r < cpus.size(); r++) {
+    running[r] = KernelSandbox::start(
+        [&, r]() {
+          SandboxResult result;
+          result.samples = measure(cpus[r]);
+          return result;
+        },
+        workers[r], failures[r]);
+    if (!running[r])
+      barrier->failed++;
+  }
+  // Collected as they end, so a replica that died holds up nobody
+  while (std::find(running.begin(), running.end(), 1) != running.end()) {
+    for (size_t r = 0; r < cpus.size(); r++) {
+      if (!running[r] || !KernelSandbox::is_finished(workers[r],
+                                                     timeout_seconds))
+        continue;
+      running[r] = 0;
+      succeeded[r] = KernelSandbox::finish(workers[r], timeout_seconds,
+                                           results[r], failures[r]);
+      if (!succeeded[r] || results[r].samples.empty())
+        barrier->failed++;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  barrier->~Barrier();
+  munmap(shared, sizeof(Barrier));
+  barrier = nullptr;
+
+  samples.clear();
+  failure.clear();
+  for (size_t r = 0; r < cpus.size(); r++) {
+    if (!succeeded[r] || results[r].samples.empty()) {
+      failure += (failure.empty() ? "" : "; ") + std::string("replica ") +
+                 std::to_string(r) + " on CPU " + std::to_string(cpus[r]) +
+                 ": " + (failures[r].empty() ? "no samples" : failures[r]);
+      continue;
+    }
+    for (std::map<std::string, double> &sample : results[r].samples) {
+      sample["replica"] = r;
+      sample["replica_cpu"] = cpus[r];
+      sample["replica_node"] = NumaPlacement::node_of_cpu(cpus[r]);
+      samples.push_back(std::move(sample));
+    }
+  }
+  return failure.empty();
+}
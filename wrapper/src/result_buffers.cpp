@@ -0,0 +1,64 @@
+#include "result_buffers.h"
+#include "allocation_tracker.h"
+#include "call_trampoline.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+// Allocated pointer MLIR stores in descriptors of memref.get_global
+static void *const GLOBAL_MEMREF_MARKER = reinterpret_cast<void *>(0xdeadbeef);
+
+ResultBuffers::ResultBuffers(const std::vector<int64_t> &result_ranks,
+                             const TensorArena *input_arena, bool tracked)
+    : m_input_arena(input_arena), m_tracked(tracked) {
+  size_t slot = 0;
+  for (int64_t rank : result_ranks) {
+    m_base_slots.push_back(slot);
+    slot += CallTrampoline::descriptor_slots(rank);
+  }
+}
+
+ResultBuffers::~ResultBuffers() { release(); }
+
+void ResultBuffers::reserve(uint64_t calls) {
+  m_pending.reserve(calls * m_base_slots.size());
+}
+
+void ResultBuffers::exclude(const void *begin, uint64_t bytes) {
+  m_excluded.emplace_back(static_cast<const uint8_t *>(begin), bytes);
+}
+
+bool ResultBuffers::is_owned(void *ptr) const {
+  if (!ptr || ptr == GLOBAL_MEMREF_MARKER)
+    return false;
+  const uint8_t *address = static_cast<const uint8_t *>(ptr);
+  for (const auto &[begin, bytes] : m_excluded)
+    if (address >= begin && address < begin + bytes)
+      return false;
+  return !m_input_arena || !m_input_arena->contains(ptr);
+}
+
+void ResultBuffers::release(bool keep_latest) {
+  size_t kept = keep_latest ? std::min(m_base_slots.size(), m_pending.size())
+                            : 0;
+  std::vector<void *> latest(m_pending.end() - kept, m_pending.end());
+  m_pending.resize(m_pending.size() - kept);
+
+  // Aliased results would otherwise be freed twice, and a buffer of the last
+  // call must not be freed through an earlier call's alias either
+  std::sort(m_pending.begin(), m_pending.end());
+  m_pending.erase(std::unique(m_pending.begin(), m_pending.end()),
+                  m_pending.end());
+  for (void *ptr : m_pending) {
+    if (!is_owned(ptr) ||
+        std::find(latest.begin(), latest.end(), ptr) != latest.end())
+      continue;
+    if (m_tracked)
+      AllocationTracker::release(ptr);
+    else
+      std::free(ptr);
+    m_released++;
+  }
+
+  m_pending.assign(latest.begin(), latest.end());
+}
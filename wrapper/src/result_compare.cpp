@@ -0,0 +1,218 @@
+#include "result_compare.h"
+#include "statistics.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <set>
+
+bool ResultCompare::higher_is_better(const std::string &metric) {
+  static const std::set<std::string> throughputs = {
+      "gflops", "bandwidth_gbs", "dram_bandwidth_gbs", "ipc", "gflops_per_j"};
+  auto ends_with = [&metric](const std::string &suffix) {
+    return metric.size() > suffix.size() &&
+           metric.compare(metric.size() - suffix.size(), suffix.size(),
+                          suffix) == 0;
+  };
+  return throughputs.count(metric) > 0 || ends_with("_gbs") ||
+         ends_with("_per_s") || ends_with("_per_j");
+}
+
+// Kernels by hash, falling back to op type and name for stores without one.
+// Without --dedup the same kernel shows up more than once: its first
+// occurrence stands for all of them.
+static std::map<std::string, StoredKernel>
+kernels_by_hash(const StoredRun &run) {
+  std::map<std::string, StoredKernel> kernels;
+  for (const StoredKernel &kernel : run.kernels) {
+    std::string key = kernel.hash.empty()
+                          ? kernel.op_type + "/" + kernel.kernel
+                          : kernel.hash;
+    auto [it, inserted] = kernels.emplace(key, kernel);
+    if (!inserted)
+      it->second.multiplicity += kernel.multiplicity;
+  }
+  return kernels;
+}
+
+std::vector<KernelComparison>
+ResultCompare::compare(const StoredRun &baseline, const StoredRun &candidate,
+                       const CompareConfig &config) {
+  std::vector<std::string> metrics = config.metrics;
+  if (metrics.empty())
+    metrics.push_back(baseline.primary_metric.empty()
+                          ? "seconds"
+                          : baseline.primary_metric);
+
+  std::map<std::string, StoredKernel> candidates = kernels_by_hash(candidate);
+  std::vector<KernelComparison> comparisons;
+  for (const auto &[hash, kernel] : kernels_by_hash(baseline)) {
+    auto match = candidates.find(hash);
+    if (match == candidates.end())
+      continue;
+    for (const std::string &metric : metrics) {
+      auto base = kernel.samples.find(metric);
+      auto cand = match->second.samples.find(metric);
+      if (base == kernel.samples.end() ||
+          cand == match->second.samples.end() || base->second.empty() ||
+          cand->second.empty())
+        continue;
+
+      KernelComparison comparison;
+      comparison.op_type = kernel.op_type;
+      comparison.kernel = kernel.kernel;
+      comparison.candidate_kernel = match->second.kernel;
+      comparison.hash = kernel.hash;
+      comparison.multiplicity = kernel.multiplicity;
+      comparison.metric = metric;
+      comparison.baseline_samples = base->second.size();
+      comparison.candidate_samples = cand->second.size();
+      comparison.baseline_median = Statistics::median(base->second);
+      comparison.candidate_median = Statistics::median(cand->second);
+
+      bool higher = ResultCompare::higher_is_better(metric);
+      double worse = higher ? comparison.baseline_median
+                            : comparison.candidate_median;
+      double better = higher ? comparison.candidate_median
+                             : comparison.baseline_median;
+      if (better != 0.0)
+        comparison.change = worse / better - 1.0;
+
+      double u = 0.0;
+      comparison.p_value =
+          config.test == SignificanceTest::BOOTSTRAP
+              ? Statistics::bootstrap_p(cand->second, base->second,
+                                        config.bootstrap_resamples)
+              : Statistics::mann_whitney_p(cand->second, base->second, u);
+      comparison.effect =
+          Statistics::cliffs_delta(cand->second, base->second);
+      if (higher)
+        comparison.effect = -comparison.effect;
+      comparisons.push_back(comparison);
+    }
+  }
+
+  // Every metric is its own family of tests, one per kernel
+  for (const std::string &metric : metrics) {
+    std::vector<size_t> family;
+    std::vector<double> p_values;
+    for (size_t c = 0; c < comparisons.size(); c++)
+      if (comparisons[c].metric == metric) {
+        family.push_back(c);
+        p_values.push_back(comparisons[c].p_value);
+      }
+    std::vector<double> adjusted =
+        config.correction == PCorrection::HOLM ? Statistics::holm(p_values)
+        : config.correction == PCorrection::BENJAMINI_HOCHBERG
+            ? Statistics::benjamini_hochberg(p_values)
+            : p_values;
+    for (size_t f = 0; f < family.size(); f++)
+      comparisons[family[f]].adjusted_p = adjusted[f];
+  }
+  for (KernelComparison &comparison : comparisons)
+    if (comparison.adjusted_p >= config.alpha || comparison.change == 0.0)
+      comparison.verdict = "unchanged";
+    else
+      comparison.verdict = comparison.change > 0.0 ? "regression" : "speedup";
+
+  std::stable_sort(comparisons.begin(), comparisons.end(),
+                   [](const KernelComparison &a, const KernelComparison &b) {
+                     return a.change > b.change;
+                   });
+  return comparisons;
+}
+
+void ResultCompare::print_summary(
+    const std::vector<KernelComparison> &comparisons,
+    const StoredRun &baseline, const StoredRun &candidate,
+    const CompareConfig &config) {
+  std::map<std::string, StoredKernel> baseline_kernels =
+      kernels_by_hash(baseline);
+  std::map<std::string, StoredKernel> candidate_kernels =
+      kernels_by_hash(candidate);
+  size_t matched = 0;
+  for (const auto &[hash, kernel] : baseline_kernels)
+    matched += candidate_kernels.count(hash);
+  std::cout << "Matched " << matched << " kernels ("
+            << baseline_kernels.size() - matched << " only in the baseline, "
+            << candidate_kernels.size() - matched
+            << " only in the candidate)\n";
+
+  std::cout << std::left << std::setw(12) << "Verdict" << std::setw(40)
+            << "Kernel" << std::setw(16) << "Metric" << std::right
+            << std::setw(14) << "Baseline" << std::setw(14) << "Candidate"
+            << std::setw(10) << "Change" << std::setw(10) << "p"
+            << std::setw(8) << "Delta" << "\n";
+  for (const KernelComparison &c : comparisons) {
+    if (c.verdict == "unchanged")
+      continue;
+    std::cout << std::left << std::setw(12) << c.verdict << std::setw(40)
+              << c.op_type + "/" + c.kernel << std::setw(16) << c.metric
+              << std::right << std::setw(14) << c.baseline_median
+              << std::setw(14) << c.candidate_median << std::setw(9)
+              << std::fixed << std::setprecision(1) << c.change * 100.0 << "%"
+              << std::setw(10) << std::setprecision(4) << c.adjusted_p
+              << std::setw(8) << std::setprecision(2) << c.effect
+              << std::defaultfloat << std::setprecision(6) << "\n";
+  }
+
+  // Weighted by the baseline's multiplicity, over the matched kernels
+  std::map<std::string, std::pair<double, double>> totals;
+  std::map<std::string, std::map<std::string, size_t>> verdicts;
+  for (const KernelComparison &c : comparisons) {
+    totals[c.metric].first += c.baseline_median * c.multiplicity;
+    totals[c.metric].second += c.candidate_median * c.multiplicity;
+    verdicts[c.metric][c.verdict]++;
+  }
+  for (const auto &[metric, total] : totals) {
+    const auto &[base, cand] = total;
+    bool higher = ResultCompare::higher_is_better(metric);
+    double better = higher ? cand : base;
+    double change = better == 0.0 ? 0.0 : (higher ? base : cand) / better - 1.0;
+    std::cout << metric << ": weighted total " << base << " -> " << cand
+              << " (" << std::showpos << std::fixed << std::setprecision(2)
+              << change * 100.0 << "%" << std::noshowpos << std::defaultfloat
+              << std::setprecision(6) << "), " << verdicts[metric]["regression"]
+              << " regressions, " << verdicts[metric]["speedup"]
+              << " speedups, " << verdicts[metric]["unchanged"]
+              << " unchanged at alpha " << config.alpha
+              << (config.correction == PCorrection::HOLM ? " (Holm)"
+                  : config.correction == PCorrection::BENJAMINI_HOCHBERG
+                      ? " (Benjamini-Hochberg)"
+                      : "")
+              << "\n";
+  }
+}
+
+bool ResultCompare::write_csv(const std::vector<KernelComparison> &comparisons,
+                              const fs::path &csv_filepath) {
+  std::ofstream csv(csv_filepath);
+  if (!csv.is_open()) {
+    std::cerr << "Error: Could not open " << csv_filepath
+              << " for writing.\n";
+    return false;
+  }
+  csv << "op_type,kernel,candidate_kernel,hash,multiplicity,metric,"
+         "baseline_samples,candidate_samples,baseline_median,"
+         "candidate_median,change,p_value,adjusted_p,cliffs_delta,verdict\n";
+  for (const KernelComparison &c : comparisons)
+    csv << c.op_type << "," << c.kernel << "," << c.candidate_kernel << ","
+        << c.hash << "," << c.multiplicity << "," << c.metric << ","
+        << c.baseline_samples << "," << c.candidate_samples << ","
+        << c.baseline_median << "," << c.candidate_median << "," << c.change
+        << "," << c.p_value << "," << c.adjusted_p << "," << c.effect << ","
+        << c.verdict << "\n";
+  return true;
+}
+
+size_t
+ResultCompare::count_failures(const std::vector<KernelComparison> &comparisons,
+                              const CompareConfig &config) {
+  return std::count_if(comparisons.begin(), comparisons.end(),
+                       [&config](const KernelComparison &c) {
+                         return c.verdict == "regression" &&
+                                c.change > config.threshold;
+                       });
+}
@@ -0,0 +1,245 @@
+#include "result_writer.h"
+#include "fork_gate.h"
+#include "utils.h"
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <future>
+#include <iostream>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+struct WriteJob {
+  enum Kind { WRITE, REPLACE, CALL } kind = CALL;
+  fs::path filepath;
+  std::string data;
+  std::function<void()> fn;
+  std::atomic<WriteJob *> next{nullptr};
+};
+
+/*
+ * Intrusive MPSC queue (Vyukov): producers exchange the head, the writer
+ * follows next pointers from the tail. A stub node keeps it non-empty.
+ */
+WriteJob stub;
+std::atomic<WriteJob *> head{&stub};
+WriteJob *tail = &stub;
+
+void push(WriteJob *job) {
+  job->next.store(nullptr, std::memory_order_relaxed);
+  WriteJob *previous = head.exchange(job, std::memory_order_acq_rel);
+  previous->next.store(job, std::memory_order_release);
+}
+
+// Writer thread only. nullptr when empty or while a push is half done.
+WriteJob *pop() {
+  WriteJob *first = tail;
+  WriteJob *next = first->next.load(std::memory_order_acquire);
+  if (first == &stub) {
+    if (!next)
+      return nullptr;
+    tail = next;
+    first = next;
+    next = next->next.load(std::memory_order_acquire);
+  }
+  if (next) {
+    tail = next;
+    return first;
+  }
+  if (first != head.load(std::memory_order_acquire))
+    return nullptr;
+  push(&stub);
+  next = first->next.load(std::memory_order_acquire);
+  if (next) {
+    tail = next;
+    return first;
+  }
+  return nullptr;
+}
+
+std::thread writer;
+pid_t writer_pid = 0;
+std::atomic<bool> stopping{false};
+std::atomic<size_t> failures{0};
+double fsync_seconds = 1.0;
+// Written since the last sync, still open. Writer thread only.
+std::vector<int> dirty;
+// Open files kept for the next sync at most
+const size_t MAX_DIRTY = 64;
+
+void sync_dirty() {
+  for (int fd : dirty) {
+    fsync(fd);
+    close(fd);
+  }
+  dirty.clear();
+}
+
+bool write_all(int fd, const std::string &data) {
+  for (size_t written = 0; written < data.size();) {
+    ssize_t n = ::write(fd, data.data() + written, data.size() - written);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    written += n;
+  }
+  return true;
+}
+
+// keep: hand the descriptor to the next sync instead of closing it now
+bool write_file(const fs::path &filepath, const std::string &data, bool keep) {
+  std::error_code ec;
+  if (filepath.has_parent_path())
+    fs::create_directories(filepath.parent_path(), ec);
+  int fd = open(filepath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    std::cerr << "Error: Could not open " << filepath
+              << " for writing: " << std::strerror(errno) << "\n";
+    return false;
+  }
+  if (!write_all(fd, data)) {
+    std::cerr << "Error: Could not write " << filepath << ": "
+              << std::strerror(errno) << "\n";
+    close(fd);
+    return false;
+  }
+  if (keep)
+    dirty.push_back(fd);
+  else
+    close(fd);
+  return true;
+}
+
+bool run_job(WriteJob &job, bool keep) {
+  switch (job.kind) {
+  case WriteJob::WRITE:
+    return write_file(job.filepath, job.data, keep);
+  case WriteJob::REPLACE: {
+    fs::path staging = fs::path(job.filepath).concat(".tmp");
+    // Whatever was queued before is on disk before the file claims it
+    if (!write_file(staging, job.data, true))
+      return false;
+    sync_dirty();
+    std::error_code ec;
+    fs::rename(staging, job.filepath, ec);
+    if (ec)
+      std::cerr << "Error: Could not update " << job.filepath << ": "
+                << ec.message() << "\n";
+    return !ec;
+  }
+  case WriteJob::CALL:
+    job.fn();
+    return true;
+  }
+  return true;
+}
+
+void writer_loop(int reserved_cpu) {
+  if (reserved_cpu >= 0)
+    pin_current_thread_excluding(reserved_cpu);
+  auto last_sync = std::chrono::steady_clock::now();
+  while (true) {
+    if (WriteJob *job = pop()) {
+      ForkGate::Section section;
+      if (!run_job(*job, true))
+        failures++;
+      delete job;
+      if (dirty.size() >= MAX_DIRTY)
+        sync_dirty();
+      continue;
+    }
+    // stop() is only called once the producers are done
+    if (stopping.load(std::memory_order_acquire) &&
+        tail->next.load(std::memory_order_acquire) == nullptr &&
+        head.load(std::memory_order_acquire) == tail)
+      break;
+    auto now = std::chrono::steady_clock::now();
+    if (fsync_seconds > 0.0 && !dirty.empty() &&
+        std::chrono::duration<double>(now - last_sync).count() >=
+            fsync_seconds) {
+      sync_dirty();
+      last_sync = now;
+    }
+    // Polling keeps producers free of wake-up syscalls
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  }
+  sync_dirty();
+}
+
+// Synchronously in the calling thread, or queued for the writer
+void submit(WriteJob *job) {
+  if (ResultWriter::is_running()) {
+    push(job);
+    return;
+  }
+  if (!run_job(*job, false))
+    failures++;
+  delete job;
+}
+
+} // namespace
+
+void ResultWriter::start(int reserved_cpu, double fsync_interval) {
+  if (ResultWriter::is_running())
+    return;
+  fsync_seconds = fsync_interval;
+  stopping = false;
+  failures = 0;
+  writer_pid = getpid();
+  writer = std::thread(writer_loop, reserved_cpu);
+}
+
+bool ResultWriter::stop() {
+  if (ResultWriter::is_running()) {
+    stopping.store(true, std::memory_order_release);
+    writer.join();
+    writer_pid = 0;
+  }
+  return failures.exchange(0) == 0;
+}
+
+bool ResultWriter::is_running() {
+  return writer.joinable() && writer_pid == getpid();
+}
+
+void ResultWriter::write(const fs::path &filepath, std::string data) {
+  WriteJob *job = new WriteJob;
+  job->kind = WriteJob::WRITE;
+  job->filepath = filepath;
+  job->data = std::move(data);
+  submit(job);
+}
+
+void ResultWriter::replace(const fs::path &filepath, std::string data) {
+  WriteJob *job = new WriteJob;
+  job->kind = WriteJob::REPLACE;
+  job->filepath = filepath;
+  job->data = std::move(data);
+  submit(job);
+}
+
+void ResultWriter::call(std::function<void()> fn) {
+  WriteJob *job = new WriteJob;
+  job->kind = WriteJob::CALL;
+  job->fn = std::move(fn);
+  submit(job);
+}
+
+void ResultWriter::flush() {
+  if (!ResultWriter::is_running())
+    return;
+  std::promise<void> done;
+  std::future<void> synced = done.get_future();
+  ResultWriter::call([&done]() {
+    sync_dirty();
+    done.set_value();
+  });
+  synced.wait();
+}
@@ -0,0 +1,560 @@
+#include "results_store.h"
+#include "kernel_dedup.h"
+#include "linalg_structure.h"
+#include "model_layers.h"
+#include "result_writer.h"
+#include "nlohmann/json.hpp"
+
+#include <ctime>
+#include <iostream>
+#include <set>
+#include <sqlite3.h>
+
+sqlite3 *ResultsStore::db = nullptr;
+long long ResultsStore::run_id = 0;
+std::string ResultsStore::primary_pipeline;
+std::string ResultsStore::outlier_method;
+bool ResultsStore::csv_export = false;
+std::mutex ResultsStore::mutex;
+std::vector<ResultsStore::SampleRow> ResultsStore::pending;
+std::vector<ResultsStore::StatisticsRow> ResultsStore::pending_statistics;
+std::vector<ResultsStore::RejectedRow> ResultsStore::pending_rejected;
+
+// Rows buffered before a transaction is forced in the middle of a kernel
+static const size_t BATCH_ROWS = 50000;
+
+static const char *SCHEMA = R"sql(
+CREATE TABLE IF NOT EXISTS runs (
+  run INTEGER PRIMARY KEY AUTOINCREMENT,
+  started TEXT, model TEXT, primary_pipeline TEXT, primary_metric TEXT);
+CREATE TABLE IF NOT EXISTS pipelines (
+  run INTEGER, pipeline TEXT, annotations TEXT,
+  PRIMARY KEY (run, pipeline));
+CREATE TABLE IF NOT EXISTS kernels (
+  run INTEGER, op_type TEXT, kernel TEXT, multiplicity INTEGER,
+  duplicates TEXT, node TEXT, hash TEXT, layers TEXT, structure TEXT,
+  PRIMARY KEY (run, op_type, kernel));
+CREATE TABLE IF NOT EXISTS samples (
+  run INTEGER, pipeline TEXT, op_type TEXT, kernel TEXT, variant TEXT,
+  sample INTEGER, metric TEXT, value REAL);
+CREATE TABLE IF NOT EXISTS statistics (
+  run INTEGER, pipeline TEXT, op_type TEXT, kernel TEXT, variant TEXT,
+  metric TEXT, samples INTEGER, mean REAL, median REAL, min REAL, max REAL,
+  p90 REAL, p99 REAL, stddev REAL, mad REAL, ci95_low REAL, ci95_high REAL);
+CREATE TABLE IF NOT EXISTS rejected (
+  run INTEGER, pipeline TEXT, op_type TEXT, kernel TEXT, variant TEXT,
+  sample INTEGER, method TEXT);
+CREATE INDEX IF NOT EXISTS samples_kernel
+  ON samples (op_type, kernel, variant, run);
+)sql";
+
+// Columns added since the first version of the schema, failing harmlessly
+// once a store has them
+static const char *SCHEMA_UPGRADES[] = {
+    "ALTER TABLE runs ADD COLUMN primary_metric TEXT",
+    "ALTER TABLE kernels ADD COLUMN hash TEXT",
+    "ALTER TABLE kernels ADD COLUMN layers TEXT",
+    "ALTER TABLE kernels ADD COLUMN structure TEXT"};
+
+// Kernels are named by the stem of their isolated MLIR file, like their CSVs
+static std::string kernel_name(const fs::path &mlir_filepath) {
+  return fs::path(mlir_filepath).replace_extension().filename().string();
+}
+
+// Comparison pipeline samples are main samples under their own label
+static std::pair<std::string, std::string>
+pipeline_and_variant(const std::string &primary_pipeline,
+                     const std::string &variant) {
+  std::string variant_name = variant.empty() ? "" : variant.substr(1);
+  if (variant_name.rfind("pipeline-", 0) == 0)
+    return {variant_name.substr(9), ""};
+  return {primary_pipeline, variant_name};
+}
+
+// Annotations of the pipeline in use, already inserted for this run
+static std::set<std::string> recorded_pipelines;
+// Kernel rows waiting for the next flush
+static std::vector<json> pending_kernels;
+
+fs::path ResultsStore::filepath(const fs::path &output_dir) {
+  return fs::path(output_dir).append("results.sqlite");
+}
+
+/*
+ * Runs one bound insert and resets it. Failures are counted, the first one
+ * of every statement keeps its message for the report.
+ */
+static void step_insert(sqlite3 *db, sqlite3_stmt *insert, size_t &failed,
+                        std::string &error) {
+  if (!insert || sqlite3_step(insert) != SQLITE_DONE) {
+    if (!failed++)
+      error = sqlite3_errmsg(db);
+  }
+  if (insert)
+    sqlite3_reset(insert);
+}
+
+static bool report_failed(const char *table, size_t failed, size_t rows,
+                          const std::string &error) {
+  if (failed)
+    std::cerr << "Results store: " << failed << " of " << rows << " "
+              << table << " rows were not written (" << error << ")\n";
+  return !failed;
+}
+
+void ResultsStore::set_csv_export(bool flag) { ResultsStore::csv_export = flag; }
+
+bool ResultsStore::is_csv_export() { return ResultsStore::csv_export; }
+
+bool ResultsStore::execute(const std::string &sql) {
+  char *error = nullptr;
+  if (sqlite3_exec(ResultsStore::db, sql.c_str(), nullptr, nullptr, &error) ==
+      SQLITE_OK)
+    return true;
+  std::cerr << "Results store: " << (error ? error : "unknown error") << "\n";
+  sqlite3_free(error);
+  return false;
+}
+
+bool ResultsStore::open(const fs::path &output_dir, const std::string &model,
+                        const std::string &primary_pipeline,
+                        const std::string &primary_metric,
+                        const std::string &outlier_method) {
+  ResultsStore::close();
+  std::lock_guard<std::mutex> lock(ResultsStore::mutex);
+  std::error_code ec;
+  fs::create_directories(output_dir, ec);
+  fs::path db_filepath = ResultsStore::filepath(output_dir);
+  if (sqlite3_open(db_filepath.c_str(), &ResultsStore::db) != SQLITE_OK) {
+    std::cerr << "Could not open the results store " << db_filepath << ": "
+              << sqlite3_errmsg(ResultsStore::db) << "\n";
+    sqlite3_close(ResultsStore::db);
+    ResultsStore::db = nullptr;
+    return false;
+  }
+  // Readers (graph-gen, the server's clients) may look at it mid-run
+  if (!ResultsStore::execute("PRAGMA journal_mode=WAL;") ||
+      !ResultsStore::execute(SCHEMA)) {
+    sqlite3_close(ResultsStore::db);
+    ResultsStore::db = nullptr;
+    return false;
+  }
+  for (const char *upgrade : SCHEMA_UPGRADES)
+    sqlite3_exec(ResultsStore::db, upgrade, nullptr, nullptr, nullptr);
+
+  char started[32];
+  std::time_t now = std::time(nullptr);
+  std::strftime(started, sizeof(started), "%Y-%m-%dT%H:%M:%S",
+                std::localtime(&now));
+  sqlite3_stmt *insert = nullptr;
+  sqlite3_prepare_v2(ResultsStore::db,
+                     "INSERT INTO runs (started, model, primary_pipeline, "
+                     "primary_metric) VALUES (?, ?, ?, ?)",
+                     -1, &insert, nullptr);
+  sqlite3_bind_text(insert, 1, started, -1, SQLITE_TRANSIENT);
+  sqlite3_bind_text(insert, 2, model.c_str(), -1, SQLITE_TRANSIENT);
+  sqlite3_bind_text(insert, 3, primary_pipeline.c_str(), -1,
+                    SQLITE_TRANSIENT);
+  sqlite3_bind_text(insert, 4, primary_metric.c_str(), -1, SQLITE_TRANSIENT);
+  bool inserted = sqlite3_step(insert) == SQLITE_DONE;
+  sqlite3_finalize(insert);
+  if (!inserted) {
+    std::cerr << "Could not start a run in " << db_filepath << ": "
+              << sqlite3_errmsg(ResultsStore::db) << "\n";
+    sqlite3_close(ResultsStore::db);
+    ResultsStore::db = nullptr;
+    return false;
+  }
+  ResultsStore::run_id = sqlite3_last_insert_rowid(ResultsStore::db);
+  ResultsStore::primary_pipeline = primary_pipeline;
+  ResultsStore::outlier_method = outlier_method;
+  recorded_pipelines.clear();
+  std::cout << "Results store: " << db_filepath << " (run "
+            << ResultsStore::run_id << ")\n";
+  return true;
+}
+
+bool ResultsStore::is_open() { return ResultsStore::db != nullptr; }
+
+void ResultsStore::close() {
+  std::lock_guard<std::mutex> lock(ResultsStore::mutex);
+  if (!ResultsStore::db)
+    return;
+  ResultsStore::flush_locked();
+  sqlite3_close(ResultsStore::db);
+  ResultsStore::db = nullptr;
+}
+
+void ResultsStore::record_samples(
+    const KernelTask &task, const std::string &variant,
+    const std::vector<std::map<std::string, double>> &samples,
+    const std::vector<std::pair<std::string, std::string>> &annotations) {
+  std::lock_guard<std::mutex> lock(ResultsStore::mutex);
+  if (!ResultsStore::db)
+    return;
+
+  auto [pipeline, variant_name] =
+      pipeline_and_variant(ResultsStore::primary_pipeline, variant);
+  if (recorded_pipelines.insert(pipeline).second) {
+    json build = json::object();
+    for (const auto &[column, value] : annotations)
+      build[column] = value;
+    sqlite3_stmt *insert = nullptr;
+    sqlite3_prepare_v2(ResultsStore::db,
+                       "INSERT OR IGNORE INTO pipelines VALUES (?, ?, ?)", -1,
+                       &insert, nullptr);
+    std::string text = build.dump();
+    sqlite3_bind_int64(insert, 1, ResultsStore::run_id);
+    sqlite3_bind_text(insert, 2, pipeline.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(insert, 3, text.c_str(), -1, SQLITE_TRANSIENT);
+    size_t failed = 0;
+    std::string error;
+    step_insert(ResultsStore::db, insert, failed, error);
+    sqlite3_finalize(insert);
+    report_failed("pipelines", failed, 1, error);
+  }
+
+  std::string kernel = kernel_name(task.mlir_filepath);
+  for (size_t s = 0; s < samples.size(); s++)
+    for (const auto &[metric, value] : samples[s])
+      ResultsStore::pending.push_back({pipeline, task.op_type, kernel,
+                                       variant_name, static_cast<int>(s + 1),
+                                       metric, value});
+  if (ResultsStore::pending.size() >= BATCH_ROWS) {
+    if (ResultWriter::is_running())
+      ResultWriter::call([]() { ResultsStore::flush(); });
+    else
+      ResultsStore::flush_locked();
+  }
+}
+
+void ResultsStore::record_statistics(
+    const KernelTask &task, const std::string &variant,
+    const std::map<std::string, SampleSummary> &summaries,
+    const std::vector<std::pair<size_t, double>> &rejected) {
+  std::lock_guard<std::mutex> lock(ResultsStore::mutex);
+  if (!ResultsStore::db)
+    return;
+  auto [pipeline, variant_name] =
+      pipeline_and_variant(ResultsStore::primary_pipeline, variant);
+  std::string kernel = kernel_name(task.mlir_filepath);
+  for (const auto &[metric, summary] : summaries)
+    ResultsStore::pending_statistics.push_back(
+        {pipeline, task.op_type, kernel, variant_name, metric, summary});
+  for (const auto &[sample, value] : rejected)
+    ResultsStore::pending_rejected.push_back({pipeline, task.op_type, kernel,
+                                              variant_name, sample,
+                                              ResultsStore::outlier_method});
+}
+
+void ResultsStore::record_kernel(const KernelTask &task) {
+  std::lock_guard<std::mutex> lock(ResultsStore::mutex);
+  if (!ResultsStore::db)
+    return;
+  json duplicates = json::array();
+  for (const fs::path &duplicate : task.duplicate_filepaths)
+    duplicates.push_back(kernel_name(duplicate));
+  pending_kernels.push_back({{"op_type", task.op_type},
+                             {"kernel", kernel_name(task.mlir_filepath)},
+                             {"multiplicity", task.multiplicity},
+                             {"duplicates", duplicates.dump()},
+                             {"node", task.node},
+                             {"hash", task.kernel_hash.empty()
+                                          ? KernelDedup::kernel_signature(task)
+                                          : task.kernel_hash},
+                             {"layers", ModelLayers::layers_of(task).dump()},
+                             {"structure", LinalgStructures::to_json(
+                                               task.mlir_filepath)
+                                               .dump()}});
+}
+
+bool ResultsStore::flush() {
+  std::lock_guard<std::mutex> lock(ResultsStore::mutex);
+  return ResultsStore::flush_locked();
+}
+
+bool ResultsStore::flush_locked() {
+  if (!ResultsStore::db ||
+      (ResultsStore::pending.empty() && pending_kernels.empty() &&
+       ResultsStore::pending_statistics.empty() &&
+       ResultsStore::pending_rejected.empty()))
+    return true;
+  if (!ResultsStore::execute("BEGIN;"))
+    return false;
+  bool written = true;
+  size_t failed = 0;
+  std::string error;
+
+  sqlite3_stmt *sample = nullptr;
+  sqlite3_prepare_v2(ResultsStore::db,
+                     "INSERT INTO samples VALUES (?, ?, ?, ?, ?, ?, ?, ?)",
+                     -1, &sample, nullptr);
+  for (const SampleRow &row : ResultsStore::pending) {
+    sqlite3_bind_int64(sample, 1, ResultsStore::run_id);
+    sqlite3_bind_text(sample, 2, row.pipeline.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_text(sample, 3, row.op_type.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_text(sample, 4, row.kernel.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_text(sample, 5, row.variant.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_int(sample, 6, row.sample);
+    sqlite3_bind_text(sample, 7, row.metric.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_double(sample, 8, row.value);
+    step_insert(ResultsStore::db, sample, failed, error);
+  }
+  sqlite3_finalize(sample);
+  written &= report_failed("samples", failed, ResultsStore::pending.size(), error);
+  failed = 0;
+
+  sqlite3_stmt *kernel = nullptr;
+  sqlite3_prepare_v2(ResultsStore::db,
+                     "INSERT OR REPLACE INTO kernels VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?)",
+                     -1, &kernel, nullptr);
+  for (const json &row : pending_kernels) {
+    std::string op_type = row["op_type"], name = row["kernel"],
+                duplicates = row["duplicates"], node = row["node"],
+                hash = row["hash"], layers = row["layers"],
+                structure = row["structure"];
+    sqlite3_bind_int64(kernel, 1, ResultsStore::run_id);
+    sqlite3_bind_text(kernel, 2, op_type.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(kernel, 3, name.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_int(kernel, 4, row["multiplicity"].get<int>());
+    sqlite3_bind_text(kernel, 5, duplicates.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(kernel, 6, node.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(kernel, 7, hash.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(kernel, 8, layers.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(kernel, 9, structure.c_str(), -1, SQLITE_TRANSIENT);
+    step_insert(ResultsStore::db, kernel, failed, error);
+  }
+  sqlite3_finalize(kernel);
+  written &= report_failed("kernels", failed, pending_kernels.size(), error);
+  failed = 0;
+
+  sqlite3_stmt *statistic = nullptr;
+  sqlite3_prepare_v2(ResultsStore::db,
+                     "INSERT INTO statistics VALUES (?, ?, ?, ?, ?, ?, ?, ?, "
+                     "?, ?, ?, ?, ?, ?, ?, ?, ?)",
+                     -1, &statistic, nullptr);
+  for (const StatisticsRow &row : ResultsStore::pending_statistics) {
+    const SampleSummary &s = row.summary;
+    sqlite3_bind_int64(statistic, 1, ResultsStore::run_id);
+    sqlite3_bind_text(statistic, 2, row.pipeline.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_text(statistic, 3, row.op_type.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_text(statistic, 4, row.kernel.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_text(statistic, 5, row.variant.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_text(statistic, 6, row.metric.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_int64(statistic, 7, s.count);
+    int column = 8;
+    for (double value : {s.mean, s.median, s.min, s.max, s.p90, s.p99,
+                         s.stddev, s.mad, s.ci95_low, s.ci95_high})
+      sqlite3_bind_double(statistic, column++, value);
+    step_insert(ResultsStore::db, statistic, failed, error);
+  }
+  sqlite3_finalize(statistic);
+  written &= report_failed("statistics", failed, ResultsStore::pending_statistics.size(), error);
+  failed = 0;
+
+  sqlite3_stmt *rejected = nullptr;
+  sqlite3_prepare_v2(ResultsStore::db,
+                     "INSERT INTO rejected VALUES (?, ?, ?, ?, ?, ?, ?)", -1,
+                     &rejected, nullptr);
+  for (const RejectedRow &row : ResultsStore::pending_rejected) {
+    sqlite3_bind_int64(rejected, 1, ResultsStore::run_id);
+    sqlite3_bind_text(rejected, 2, row.pipeline.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_text(rejected, 3, row.op_type.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_text(rejected, 4, row.kernel.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_text(rejected, 5, row.variant.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_int64(rejected, 6, row.sample);
+    sqlite3_bind_text(rejected, 7, row.method.c_str(), -1, SQLITE_STATIC);
+    step_insert(ResultsStore::db, rejected, failed, error);
+  }
+  sqlite3_finalize(rejected);
+  written &= report_failed("rejected", failed, ResultsStore::pending_rejected.size(), error);
+  failed = 0;
+
+  ResultsStore::pending.clear();
+  ResultsStore::pending_statistics.clear();
+  ResultsStore::pending_rejected.clear();
+  pending_kernels.clear();
+  return ResultsStore::execute("COMMIT;") && written;
+}
+
+bool ResultsStore::copy_kernel(const fs::path &previous_output_dir,
+                               const KernelTask &task) {
+  fs::path previous = ResultsStore::filepath(previous_output_dir);
+  std::lock_guard<std::mutex> lock(ResultsStore::mutex);
+  if (!ResultsStore::db || !fs::exists(previous))
+    return false;
+  ResultsStore::flush_locked();
+
+  std::string run = std::to_string(ResultsStore::run_id);
+  // Single quotes are the only thing to escape in an SQL string literal
+  std::string path = previous.string();
+  for (size_t pos = path.find('\''); pos != std::string::npos;
+       pos = path.find('\'', pos + 2))
+    path.insert(pos, "'");
+  if (!ResultsStore::execute("ATTACH DATABASE '" + path + "' AS previous;"))
+    return false;
+
+  sqlite3_stmt *copy = nullptr;
+  bool copied = true;
+  std::string hash = task.kernel_hash.empty()
+                         ? KernelDedup::kernel_signature(task)
+                         : task.kernel_hash;
+  std::string layers = ModelLayers::layers_of(task).dump();
+  std::string structure = LinalgStructures::to_json(task.mlir_filepath).dump();
+  for (const char *sql :
+       {"INSERT INTO samples SELECT ?1, pipeline, op_type, kernel, variant, "
+        "sample, metric, value FROM previous.samples WHERE op_type = ?2 AND "
+        "kernel = ?3 AND run = (SELECT MAX(run) FROM previous.samples WHERE "
+        "op_type = ?2 AND kernel = ?3)",
+        "INSERT INTO statistics SELECT ?1, pipeline, op_type, kernel, "
+        "variant, metric, samples, mean, median, min, max, p90, p99, stddev, "
+        "mad, ci95_low, ci95_high FROM previous.statistics WHERE op_type = ?2 "
+        "AND kernel = ?3 AND run = (SELECT MAX(run) FROM previous.samples "
+        "WHERE op_type = ?2 AND kernel = ?3)",
+        "INSERT INTO rejected SELECT ?1, pipeline, op_type, kernel, variant, "
+        "sample, method FROM previous.rejected WHERE op_type = ?2 AND kernel "
+        "= ?3 AND run = (SELECT MAX(run) FROM previous.samples WHERE op_type "
+        "= ?2 AND kernel = ?3)",
+        // Hash, layers and structure are the current ones, the previous
+        // store may predate them
+        "INSERT OR REPLACE INTO kernels SELECT ?1, op_type, kernel, "
+        "multiplicity, duplicates, node, ?4, ?5, ?6 FROM previous.kernels WHERE op_type = "
+        "?2 AND kernel = ?3 AND run = (SELECT MAX(run) FROM previous.kernels "
+        "WHERE op_type = ?2 AND kernel = ?3)"}) {
+    std::string kernel = kernel_name(task.mlir_filepath);
+    sqlite3_prepare_v2(ResultsStore::db, sql, -1, &copy, nullptr);
+    sqlite3_bind_int64(copy, 1, ResultsStore::run_id);
+    sqlite3_bind_text(copy, 2, task.op_type.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(copy, 3, kernel.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(copy, 4, hash.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(copy, 5, layers.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(copy, 6, structure.c_str(), -1, SQLITE_TRANSIENT);
+    copied &= sqlite3_step(copy) == SQLITE_DONE;
+    sqlite3_finalize(copy);
+  }
+  if (!copied)
+    std::cerr << "Results store: could not copy " << task.mlir_filepath
+              << " from " << previous << ": "
+              << sqlite3_errmsg(ResultsStore::db) << "\n";
+  ResultsStore::execute("DETACH DATABASE previous;");
+  return copied;
+}
+
+bool ResultsStore::load_averages(const fs::path &output_dir,
+                                 std::vector<StoredKernel> &kernels) {
+  fs::path db_filepath = ResultsStore::filepath(output_dir);
+  sqlite3 *store = nullptr;
+  if (!fs::exists(db_filepath) ||
+      sqlite3_open_v2(db_filepath.c_str(), &store, SQLITE_OPEN_READONLY,
+                      nullptr) != SQLITE_OK) {
+    sqlite3_close(store);
+    return false;
+  }
+
+  sqlite3_stmt *query = nullptr;
+  sqlite3_prepare_v2(
+      store,
+      "SELECT s.op_type, s.kernel, s.metric, AVG(s.value) FROM samples s "
+      "JOIN runs r ON r.run = s.run AND r.primary_pipeline = s.pipeline "
+      "WHERE s.variant = '' AND s.run = (SELECT MAX(run) FROM samples l "
+      "WHERE l.op_type = s.op_type AND l.kernel = s.kernel AND "
+      "l.variant = '') AND NOT EXISTS (SELECT 1 FROM rejected x WHERE "
+      "x.run = s.run AND x.pipeline = s.pipeline AND x.op_type = s.op_type "
+      "AND x.kernel = s.kernel AND x.variant = '' AND x.sample = s.sample) "
+      "GROUP BY s.op_type, s.kernel, s.metric "
+      "ORDER BY s.op_type, s.kernel",
+      -1, &query, nullptr);
+  while (sqlite3_step(query) == SQLITE_ROW) {
+    std::string op_type =
+        reinterpret_cast<const char *>(sqlite3_column_text(query, 0));
+    std::string kernel =
+        reinterpret_cast<const char *>(sqlite3_column_text(query, 1));
+    if (kernels.empty() || kernels.back().op_type != op_type ||
+        kernels.back().kernel != kernel) {
+      kernels.emplace_back();
+      kernels.back().op_type = op_type;
+      kernels.back().kernel = kernel;
+    }
+    kernels.back().averages[reinterpret_cast<const char *>(
+        sqlite3_column_text(query, 2))] = sqlite3_column_double(query, 3);
+  }
+  sqlite3_finalize(query);
+  sqlite3_close(store);
+  return true;
+}
+
+bool ResultsStore::load_samples(const fs::path &output_dir, StoredRun &run) {
+  fs::path db_filepath = ResultsStore::filepath(output_dir);
+  sqlite3 *store = nullptr;
+  if (!fs::exists(db_filepath) ||
+      sqlite3_open_v2(db_filepath.c_str(), &store, SQLITE_OPEN_READONLY,
+                      nullptr) != SQLITE_OK) {
+    sqlite3_close(store);
+    return false;
+  }
+
+  sqlite3_stmt *query = nullptr;
+  sqlite3_prepare_v2(store,
+                     "SELECT primary_metric, primary_pipeline FROM runs WHERE "
+                     "primary_metric IS NOT NULL ORDER BY run DESC LIMIT 1",
+                     -1, &query, nullptr);
+  if (sqlite3_step(query) == SQLITE_ROW) {
+    run.primary_metric =
+        reinterpret_cast<const char *>(sqlite3_column_text(query, 0));
+    const unsigned char *pipeline = sqlite3_column_text(query, 1);
+    run.primary_pipeline =
+        pipeline ? reinterpret_cast<const char *>(pipeline) : "";
+  }
+  sqlite3_finalize(query);
+
+  sqlite3_prepare_v2(
+      store,
+      "SELECT s.op_type, s.kernel, s.metric, s.value, k.hash, "
+      "k.multiplicity, k.layers, k.structure FROM samples s "
+      "JOIN runs r ON r.run = s.run AND r.primary_pipeline = s.pipeline "
+      "LEFT JOIN kernels k ON k.run = s.run AND k.op_type = s.op_type AND "
+      "k.kernel = s.kernel "
+      "WHERE s.variant = '' AND s.run = (SELECT MAX(run) FROM samples l "
+      "WHERE l.op_type = s.op_type AND l.kernel = s.kernel AND "
+      "l.variant = '') AND NOT EXISTS (SELECT 1 FROM rejected x WHERE "
+      "x.run = s.run AND x.pipeline = s.pipeline AND x.op_type = s.op_type "
+      "AND x.kernel = s.kernel AND x.variant = '' AND x.sample = s.sample) "
+      "ORDER BY s.op_type, s.kernel, s.sample",
+      -1, &query, nullptr);
+  while (sqlite3_step(query) == SQLITE_ROW) {
+    std::string op_type =
+        reinterpret_cast<const char *>(sqlite3_column_text(query, 0));
+    std::string kernel =
+        reinterpret_cast<const char *>(sqlite3_column_text(query, 1));
+    if (run.kernels.empty() || run.kernels.back().op_type != op_type ||
+        run.kernels.back().kernel != kernel) {
+      StoredKernel stored;
+      stored.op_type = op_type;
+      stored.kernel = kernel;
+      const unsigned char *hash = sqlite3_column_text(query, 4);
+      stored.hash = hash ? reinterpret_cast<const char *>(hash) : "";
+      if (sqlite3_column_type(query, 5) != SQLITE_NULL)
+        stored.multiplicity = sqlite3_column_int(query, 5);
+      const unsigned char *layers = sqlite3_column_text(query, 6);
+      stored.layers = layers ? reinterpret_cast<const char *>(layers) : "";
+      const unsigned char *structure = sqlite3_column_text(query, 7);
+      stored.structure =
+          structure ? reinterpret_cast<const char *>(structure) : "";
+      run.kernels.push_back(stored);
+    }
+    run.kernels.back()
+        .samples[reinterpret_cast<const char *>(sqlite3_column_text(query, 2))]
+        .push_back(sqlite3_column_double(query, 3));
+  }
+  sqlite3_finalize(query);
+  sqlite3_close(store);
+
+  for (StoredKernel &kernel : run.kernels)
+    for (const auto &[metric, values] : kernel.samples) {
+      double sum = 0.0;
+      for (double value : values)
+        sum += value;
+      kernel.averages[metric] = sum / values.size();
+    }
+  return true;
+}
@@ -0,0 +1,373 @@
+#include "roofline.h"
+#include "cache_evictor.h"
+#include "results_store.h"
+#include "utils.h"
+
+#include "nlohmann/json.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+using json = nlohmann::json;
+
+// Independent accumulators per thread: enough to cover FMA latency times the
+// number of FMA ports without spilling registers
+static const int FMA_CHAINS = 10;
+static const uint64_t FMA_ITERATIONS = 20000000;
+static const int TRIAD_REPETITIONS = 5;
+// Share of a roof below which a kernel counts as cache bound
+static const double BOUND_SHARE = 0.5;
+
+/*
+ * The microkernels are compiled optimised even in Debug builds, and their
+ * chains fully unrolled: otherwise the accumulators live on the stack. Each returns the FLOPs it did and
+ * folds its accumulators into `sink` so that nothing is optimised away.
+ */
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx512f"), optimize("O2"))) static double
+fma_avx512(uint64_t iterations, float &sink) {
+  __m512 acc[FMA_CHAINS];
+  for (int c = 0; c < FMA_CHAINS; c++)
+    acc[c] = _mm512_set1_ps(1.0f + c * 1e-3f);
+  const __m512 mul = _mm512_set1_ps(0.9999999f);
+  const __m512 add = _mm512_set1_ps(1e-7f);
+  for (uint64_t i = 0; i < iterations; i++)
+#pragma GCC unroll 16
+    for (int c = 0; c < FMA_CHAINS; c++)
+      acc[c] = _mm512_fmadd_ps(acc[c], mul, add);
+  for (int c = 1; c < FMA_CHAINS; c++)
+    acc[0] = _mm512_add_ps(acc[0], acc[c]);
+  sink += _mm512_reduce_add_ps(acc[0]);
+  return 2.0 * 16 * FMA_CHAINS * double(iterations);
+}
+
+__attribute__((target("avx2,fma"), optimize("O2"))) static double
+fma_avx2(uint64_t iterations, float &sink) {
+  __m256 acc[FMA_CHAINS];
+  for (int c = 0; c < FMA_CHAINS; c++)
+    acc[c] = _mm256_set1_ps(1.0f + c * 1e-3f);
+  const __m256 mul = _mm256_set1_ps(0.9999999f);
+  const __m256 add = _mm256_set1_ps(1e-7f);
+  for (uint64_t i = 0; i < iterations; i++)
+#pragma GCC unroll 16
+    for (int c = 0; c < FMA_CHAINS; c++)
+      acc[c] = _mm256_fmadd_ps(acc[c], mul, add);
+  float lanes[8];
+  for (int c = 1; c < FMA_CHAINS; c++)
+    acc[0] = _mm256_add_ps(acc[0], acc[c]);
+  _mm256_storeu_ps(lanes, acc[0]);
+  for (float lane : lanes)
+    sink += lane;
+  return 2.0 * 8 * FMA_CHAINS * double(iterations);
+}
+#endif
+
+// Separate multiply and add on whatever vector unit the build targets
+__attribute__((optimize("O2"))) static double
+fma_generic(uint64_t iterations, float &sink) {
+  typedef float vec4 __attribute__((vector_size(16)));
+  vec4 acc[FMA_CHAINS];
+  for (int c = 0; c < FMA_CHAINS; c++)
+    acc[c] = vec4{1.0f, 1.0f, 1.0f, 1.0f} + c * 1e-3f;
+  const vec4 mul = {0.9999999f, 0.9999999f, 0.9999999f, 0.9999999f};
+  const vec4 add = {1e-7f, 1e-7f, 1e-7f, 1e-7f};
+  for (uint64_t i = 0; i < iterations; i++)
+#pragma GCC unroll 16
+    for (int c = 0; c < FMA_CHAINS; c++)
+      acc[c] = acc[c] * mul + add;
+  for (int c = 0; c < FMA_CHAINS; c++)
+    sink += acc[c][0] + acc[c][1] + acc[c][2] + acc[c][3];
+  return 2.0 * 4 * FMA_CHAINS * double(iterations);
+}
+
+// Bytes moved: two arrays read, one written (write allocate not counted)
+__attribute__((optimize("O2"))) static double
+triad(double *a, const double *b, const double *c, size_t elements) {
+  const double scalar = 3.0;
+  for (size_t i = 0; i < elements; i++)
+    a[i] = b[i] + scalar * c[i];
+  return 3.0 * sizeof(double) * double(elements);
+}
+
+static std::string fma_isa() {
+#if defined(__x86_64__) || defined(__i386__)
+  if (__builtin_cpu_supports("avx512f"))
+    return "avx512";
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    return "avx2";
+#endif
+  return "generic";
+}
+
+// Aggregate rate of `work` (returns units done) run once on every thread
+template <typename Work>
+static double run_pinned(int first_cpu, int threads, Work work) {
+  std::vector<double> units(threads, 0.0);
+  std::vector<double> seconds(threads, 0.0);
+  std::atomic<int> ready{0};
+  std::vector<std::thread> workers;
+  int cpus = std::max(1, get_online_cpu_count());
+  for (int t = 0; t < threads; t++)
+    workers.emplace_back([&, t]() {
+      pin_current_thread((first_cpu + t) % cpus);
+      // Start together so that the threads share the memory bus
+      ready++;
+      while (ready.load() < threads)
+        std::this_thread::yield();
+      auto start = std::chrono::steady_clock::now();
+      units[t] = work(t);
+      seconds[t] = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+    });
+  for (std::thread &worker : workers)
+    worker.join();
+
+  double slowest = *std::max_element(seconds.begin(), seconds.end());
+  double total = 0.0;
+  for (double u : units)
+    total += u;
+  return slowest > 0.0 ? total / slowest : 0.0;
+}
+
+MachinePeaks Roofline::measure_peaks(int first_cpu, int threads) {
+  MachinePeaks peaks;
+  peaks.threads = std::max(1, threads);
+  peaks.isa = fma_isa();
+
+  std::vector<float> sinks(peaks.threads, 0.0f);
+  double flops_per_second = run_pinned(first_cpu, peaks.threads, [&](int t) {
+#if defined(__x86_64__) || defined(__i386__)
+    if (peaks.isa == "avx512")
+      return fma_avx512(FMA_ITERATIONS, sinks[t]);
+    if (peaks.isa == "avx2")
+      return fma_avx2(FMA_ITERATIONS, sinks[t]);
+#endif
+    return fma_generic(FMA_ITERATIONS, sinks[t]);
+  });
+  peaks.gflops = flops_per_second / 1e9;
+
+  // Every thread streams its own arrays, together 4x the last level cache
+  size_t elements = std::max<uint64_t>(
+      CacheEvictor::last_level_cache_bytes() * 4 /
+          (3 * sizeof(double) * peaks.threads),
+      1 << 20);
+  std::vector<std::vector<double>> arrays(3 * peaks.threads);
+  double best = 0.0;
+  for (int r = 0; r < TRIAD_REPETITIONS; r++)
+    best = std::max(best, run_pinned(first_cpu, peaks.threads, [&](int t) {
+                      std::vector<double> &a = arrays[3 * t];
+                      std::vector<double> &b = arrays[3 * t + 1];
+                      std::vector<double> &c = arrays[3 * t + 2];
+                      // First touch on the thread's own node. The page
+                      // faults slow the first repetition, best of is kept
+                      if (a.empty()) {
+                        a.assign(elements, 0.0);
+                        b.assign(elements, 1.0);
+                        c.assign(elements, 2.0);
+                      }
+                      return triad(a.data(), b.data(), c.data(), elements);
+                    }));
+  peaks.bandwidth_gbs = best / 1e9;
+
+  std::cout << "Machine peaks on " << peaks.threads << " thread(s): "
+            << peaks.gflops << " GFLOP/s (" << peaks.isa << " FMA), "
+            << peaks.bandwidth_gbs << " GB/s (triad)\n";
+  return peaks;
+}
+
+bool Roofline::write_peaks(const MachinePeaks &peaks,
+                           const fs::path &filepath) {
+  std::ofstream file(filepath);
+  if (!file.is_open()) {
+    std::cerr << "Error: Could not open " << filepath << " for writing.\n";
+    return false;
+  }
+  file << json{{"gflops", peaks.gflops},
+               {"bandwidth_gbs", peaks.bandwidth_gbs},
+               {"ridge_point", peaks.bandwidth_gbs > 0.0
+                                   ? peaks.gflops / peaks.bandwidth_gbs
+                                   : 0.0},
+               {"threads", peaks.threads},
+               {"isa", peaks.isa}}
+              .dump(2)
+       << "\n";
+  return true;
+}
+
+bool Roofline::read_peaks(const fs::path &filepath, MachinePeaks &peaks) {
+  std::ifstream file(filepath);
+  if (!file.is_open())
+    return false;
+  try {
+    json data = json::parse(file);
+    peaks.gflops = data.at("gflops").get<double>();
+    peaks.bandwidth_gbs = data.at("bandwidth_gbs").get<double>();
+    peaks.threads = data.value("threads", 1);
+    peaks.isa = data.value("isa", std::string("unknown"));
+  } catch (const std::exception &err) {
+    std::cerr << "Invalid machine peaks in " << filepath << ": " << err.what()
+              << "\n";
+    return false;
+  }
+  return true;
+}
+
+namespace {
+struct KernelPoint {
+  std::string op_type;
+  std::string kernel;
+  double arith_intensity = 0.0;
+  double gflops = 0.0;
+  double attainable = 0.0;
+  // --dram-traffic runs, measured at the memory controllers
+  bool has_dram = false;
+  double dram_intensity = 0.0;
+  double dram_bandwidth_gbs = 0.0;
+};
+} // namespace
+
+// Column averages of a kernel's timings CSV
+static std::map<std::string, double> average_columns(const fs::path &csv) {
+  std::ifstream file(csv);
+  std::string line;
+  std::vector<std::string> header;
+  if (std::getline(file, line)) {
+    std::stringstream ss(line);
+    for (std::string column; std::getline(ss, column, ',');)
+      header.push_back(column);
+  }
+
+  std::map<std::string, double> sums;
+  size_t rows = 0;
+  while (std::getline(file, line)) {
+    std::stringstream ss(line);
+    std::string cell;
+    for (size_t c = 0; c < header.size() && std::getline(ss, cell, ','); c++)
+      try {
+        sums[header[c]] += std::stod(cell);
+      } catch (const std::exception &) {
+        // Annotation columns aren't numeric
+      }
+    rows++;
+  }
+  for (auto &[column, sum] : sums)
+    sum /= double(std::max<size_t>(1, rows));
+  return sums;
+}
+
+size_t Roofline::write_roofline(const fs::path &output_dir,
+                                const MachinePeaks &peaks) {
+  // The results store, or the timings CSVs of older and --csv-export runs
+  std::vector<StoredKernel> kernels;
+  if (!ResultsStore::load_averages(output_dir, kernels)) {
+    fs::path timings = fs::path(output_dir).append("timings");
+    if (!fs::is_directory(timings)) {
+      std::cerr << "No results in " << output_dir << ", skipped\n";
+      return 0;
+    }
+    for (const auto &op_dir : fs::directory_iterator(timings)) {
+      if (!op_dir.is_directory())
+        continue;
+      for (const auto &entry : fs::directory_iterator(op_dir.path())) {
+        // Variants (.cold.csv, .layout-<l>.csv, ...) carry a second extension
+        fs::path csv = entry.path();
+        if (csv.extension() != ".csv" || csv.stem().has_extension())
+          continue;
+        StoredKernel stored;
+        stored.op_type = op_dir.path().filename().string();
+        stored.kernel = csv.stem().string();
+        stored.averages = average_columns(csv);
+        kernels.push_back(stored);
+      }
+    }
+  }
+
+  std::vector<KernelPoint> points;
+  for (StoredKernel &kernel : kernels) {
+    std::map<std::string, double> &averages = kernel.averages;
+    // Kernels whose FLOPs are not modelled have NaN rates
+    if (!averages.count("gflops") || !averages.count("arith_intensity") ||
+        std::isnan(averages["arith_intensity"]))
+      continue;
+    KernelPoint point;
+    point.op_type = kernel.op_type;
+    point.kernel = kernel.kernel;
+    point.arith_intensity = averages["arith_intensity"];
+    point.gflops = averages["gflops"];
+    point.attainable =
+        std::min(peaks.gflops, point.arith_intensity * peaks.bandwidth_gbs);
+    // Data movement only, there is no compute roof to compare against
+    if (point.attainable <= 0.0)
+      continue;
+    if (averages.count("dram_bytes") && averages["dram_bytes"] > 0.0) {
+      point.has_dram = true;
+      point.dram_intensity = averages["dram_intensity"];
+      point.dram_bandwidth_gbs = averages["dram_bandwidth_gbs"];
+    }
+    points.push_back(point);
+  }
+
+  auto percent = [](const KernelPoint &p) {
+    return p.attainable > 0.0 ? 100.0 * p.gflops / p.attainable : 0.0;
+  };
+  std::sort(points.begin(), points.end(),
+            [&](const KernelPoint &a, const KernelPoint &b) {
+              return percent(a) < percent(b);
+            });
+
+  fs::path csv_filepath = fs::path(output_dir).append("roofline.csv");
+  std::ofstream csv(csv_filepath);
+  if (!csv.is_open()) {
+    std::cerr << "Error: Could not open " << csv_filepath << " for writing.\n";
+    return 0;
+  }
+  double ridge =
+      peaks.bandwidth_gbs > 0.0 ? peaks.gflops / peaks.bandwidth_gbs : 0.0;
+  // With DRAM traffic, the roof a kernel uses the larger share of, "cache"
+  // when it uses less than half of either
+  auto bound = [&](const KernelPoint &p) -> std::string {
+    if (!p.has_dram)
+      return p.arith_intensity < ridge ? "memory" : "compute";
+    double compute_share = peaks.gflops > 0.0 ? p.gflops / peaks.gflops : 0.0;
+    double dram_share = peaks.bandwidth_gbs > 0.0
+                            ? p.dram_bandwidth_gbs / peaks.bandwidth_gbs
+                            : 0.0;
+    if (std::max(compute_share, dram_share) < BOUND_SHARE)
+      return "cache";
+    return dram_share >= compute_share ? "dram" : "compute";
+  };
+  csv << "op_type,kernel,arith_intensity,gflops,attainable_gflops,"
+         "percent_of_peak,bound,dram_intensity,dram_bandwidth_gbs,"
+         "dram_percent_of_peak\n";
+  for (const KernelPoint &p : points) {
+    csv << p.op_type << "," << p.kernel << "," << p.arith_intensity << ","
+        << p.gflops << "," << p.attainable << "," << percent(p) << ","
+        << bound(p) << ",";
+    if (p.has_dram)
+      csv << p.dram_intensity << "," << p.dram_bandwidth_gbs << ","
+          << (peaks.bandwidth_gbs > 0.0
+                  ? 100.0 * p.dram_bandwidth_gbs / peaks.bandwidth_gbs
+                  : 0.0);
+    else
+      csv << ",,";
+    csv << "\n";
+  }
+  write_peaks(peaks, fs::path(output_dir).append("machine_peaks.json"));
+
+  std::cout << points.size() << " kernels placed in " << csv_filepath << "\n";
+  return points.size();
+}
@@ -0,0 +1,99 @@
+#include "scratch_space.h"
+
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <iostream>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+fs::path ScratchSpace::create(const std::string &root) {
+  fs::path base = root;
+  if (root == "memory")
+    base = fs::is_directory("/dev/shm") ? fs::path("/dev/shm")
+                                        : fs::temp_directory_path();
+  fs::path folder =
+      fs::path(base).append("mlir-bench-scratch-" + std::to_string(getpid()));
+  std::error_code ec;
+  fs::create_directories(folder, ec);
+  if (ec) {
+    std::cerr << "Could not create the scratch directory " << folder << ": "
+              << ec.message() << "\n";
+    return fs::path();
+  }
+  return folder;
+}
+
+bool ScratchSpace::is_build_artifact(const fs::path &filepath) {
+  static const std::string_view BUILD_SUFFIXES[] = {
+      ".mlir", ".mlirbc", ".mlir.json", ".ll",  ".so",
+      ".o",    ".metric", ".log",       ".tmp"};
+  std::string name = filepath.filename().string();
+  for (std::string_view ending : BUILD_SUFFIXES) {
+    if (name.size() >= ending.size() &&
+        name.compare(name.size() - ending.size(), ending.size(), ending) == 0)
+      return true;
+  }
+  return false;
+}
+
+size_t ScratchSpace::persist(const fs::path &scratch_folder,
+                             const fs::path &output_folder) {
+  size_t copied = 0;
+  std::error_code ec;
+  for (auto it = fs::recursive_directory_iterator(scratch_folder, ec);
+       it != fs::recursive_directory_iterator(); it.increment(ec)) {
+    if (ec)
+      break;
+    if (!it->is_regular_file() || ScratchSpace::is_build_artifact(it->path()))
+      continue;
+    fs::path target = fs::path(output_folder)
+                          .append(fs::relative(it->path(), scratch_folder)
+                                      .generic_string());
+    std::error_code copy_error;
+    fs::create_directories(target.parent_path(), copy_error);
+    fs::copy_file(it->path(), target, fs::copy_options::overwrite_existing,
+                  copy_error);
+    if (copy_error)
+      std::cerr << "Could not keep " << it->path() << ": "
+                << copy_error.message() << "\n";
+    else
+      copied++;
+  }
+  return copied;
+}
+
+void *ScratchSpace::dlopen_from_memory(const fs::path &so_filepath,
+                                       int flags) {
+  int in = open(so_filepath.c_str(), O_RDONLY | O_CLOEXEC);
+  if (in < 0)
+    return dlopen(so_filepath.c_str(), flags);
+  struct stat status;
+  int fd = memfd_create(so_filepath.filename().c_str(), MFD_CLOEXEC);
+  bool copied = fd >= 0 && fstat(in, &status) == 0;
+  for (off_t offset = 0; copied && offset < status.st_size;) {
+    ssize_t sent = sendfile(fd, in, &offset, status.st_size - offset);
+    copied = sent > 0;
+  }
+  close(in);
+  if (!copied) {
+    if (fd >= 0)
+      close(fd);
+    return dlopen(so_filepath.c_str(), flags);
+  }
+
+  // The loader's mappings keep the memfd alive
+  void *handle =
+      dlopen(("/proc/self/fd/" + std::to_string(fd)).c_str(), flags);
+  close(fd);
+  return handle;
+}
+
+ScopedDirectory::~ScopedDirectory() {
+  if (m_folder.empty())
+    return;
+  std::error_code ec;
+  fs::remove_all(m_folder, ec);
+}
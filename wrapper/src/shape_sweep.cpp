@@ -0,0 +1,281 @@
+#include "shape_sweep.h"
+#include "element_type.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <regex>
+#include <sstream>
+
+// Dimension list of a torch value tensor type, !torch.vtensor<[1,3,224,224],
+static const std::regex VTENSOR_DIMS(R"(!torch\.vtensor<\[([^\]]*)\])");
+
+static bool parse_dims(const std::string &list, std::vector<uint64_t> &dims) {
+  dims.clear();
+  std::stringstream ss(list);
+  std::string dim;
+  while (std::getline(ss, dim, ',')) {
+    if (dim.empty() ||
+        dim.find_first_not_of("0123456789 ") != std::string::npos)
+      return false;
+    dims.push_back(std::stoull(dim));
+  }
+  return true;
+}
+
+/*
+ * Arguments scaled along with the first one: the same shape, or the same
+ * rank and leading dimension
+ */
+static bool is_activation(const std::vector<uint64_t> &dims,
+                          const std::vector<uint64_t> &first) {
+  return dims == first || (dims.size() >= 2 && dims.size() == first.size() &&
+                           dims[0] == first[0]);
+}
+
+static uint64_t scale_dim(uint64_t dim, double factor) {
+  return std::max<int64_t>(1, std::llround(double(dim) * factor));
+}
+
+static std::vector<uint64_t> shape_of(const json &argument) {
+  return argument["shape"].get<std::vector<uint64_t>>();
+}
+
+static uint64_t bytes_of(const json &argument) {
+  uint64_t bytes = ElementTypes::size(
+      ElementTypes::parse(argument["dtype"].get<std::string>()));
+  for (uint64_t dim : shape_of(argument))
+    bytes *= dim;
+  return bytes;
+}
+
+static std::string join_dims(const std::vector<std::string> &dims) {
+  std::string joined;
+  for (size_t i = 0; i < dims.size(); i++)
+    joined += (i ? "," : "") + dims[i];
+  return joined;
+}
+
+std::vector<ShapeScale> ShapeSweep::parse(const std::string &spec) {
+  std::vector<ShapeScale> scales;
+  std::stringstream axes(spec);
+  std::string axis;
+  while (std::getline(axes, axis, ';')) {
+    size_t equals = axis.find('=');
+    std::string name = axis.substr(0, equals);
+    if (equals == std::string::npos || (name != "batch" && name != "hw")) {
+      std::cerr << "Invalid --shape-sweep axis '" << axis
+                << "', expected batch=... or hw=...\n";
+      continue;
+    }
+
+    std::stringstream factors(axis.substr(equals + 1));
+    std::string factor;
+    while (std::getline(factors, factor, ',')) {
+      try {
+        ShapeScale scale;
+        if (name == "batch") {
+          int batch = std::stoi(factor);
+          if (batch < 1)
+            throw std::out_of_range(factor);
+          scale.batch = double(batch);
+        } else {
+          scale.spatial = std::stod(factor);
+          if (!(scale.spatial > 0.0))
+            throw std::out_of_range(factor);
+        }
+        if (scale.batch == 1 && scale.spatial == 1.0)
+          continue;
+        std::ostringstream variant;
+        variant << name << "-"
+                << (name == "batch" ? scale.batch : scale.spatial);
+        scale.name = variant.str();
+        scales.push_back(scale);
+      } catch (const std::exception &) {
+        std::cerr << "Invalid " << name << " factor '" << factor
+                  << "', skipping it\n";
+      }
+    }
+  }
+  return scales;
+}
+
+/*
+ * The kernel with its activations scaled by `scale`, or with the dimensions
+ * a scale would change made dynamic if there is none. Every other tensor
+ * type becomes dynamic with the same rank.
+ */
+static bool rewrite_signature(const std::string &mlir_text,
+                              const ShapeScale *scale,
+                              std::string &rewritten) {
+  size_t func_pos = mlir_text.find("@kernel_call(");
+  if (func_pos == std::string::npos)
+    return false;
+  size_t args_open = mlir_text.find('(', func_pos);
+  size_t args_close = args_open;
+  for (int depth = 0; args_close < mlir_text.size(); args_close++) {
+    if (mlir_text[args_close] == '(')
+      depth++;
+    else if (mlir_text[args_close] == ')' && --depth == 0)
+      break;
+  }
+  if (args_close >= mlir_text.size())
+    return false;
+
+  rewritten.clear();
+  size_t copied = 0;
+  size_t arg_index = 0;
+  std::vector<uint64_t> first_shape;
+  bool changed = false;
+
+  for (auto it = std::sregex_iterator(mlir_text.begin(), mlir_text.end(),
+                                      VTENSOR_DIMS);
+       it != std::sregex_iterator(); ++it) {
+    size_t pos = it->position(0);
+    size_t dims_pos = it->position(1);
+    std::string dims_text = (*it)[1].str();
+    if (pos < args_open)
+      continue;
+
+    std::vector<std::string> new_dims;
+    if (pos < args_close) {
+      // kernel_call argument
+      std::vector<uint64_t> dims;
+      if (!parse_dims(dims_text, dims))
+        return false;
+      if (arg_index++ == 0)
+        first_shape = dims;
+
+      bool activation = is_activation(dims, first_shape) && !dims.empty();
+      bool spatial = dims.size() == 4 && dims == first_shape;
+      if (!scale) {
+        for (uint64_t dim : dims)
+          new_dims.push_back(std::to_string(dim));
+        if (activation)
+          new_dims[0] = "?";
+        if (spatial)
+          new_dims[2] = new_dims[3] = "?";
+        changed |= activation;
+      } else {
+        std::vector<uint64_t> scaled = dims;
+        if (activation)
+          scaled[0] = scale_dim(dims[0], scale->batch);
+        if (spatial)
+          for (size_t d : {2, 3})
+            scaled[d] = scale_dim(dims[d], scale->spatial);
+        changed |= scaled != dims;
+        for (uint64_t dim : scaled)
+          new_dims.push_back(std::to_string(dim));
+      }
+    } else {
+      // Results and intermediates keep their rank, shapes are refined.
+      // Literals have to match their attribute and are left alone.
+      size_t line_start = mlir_text.rfind('\n', pos);
+      line_start = line_start == std::string::npos ? 0 : line_start;
+      size_t line_end = mlir_text.find('\n', pos);
+      std::string line = mlir_text.substr(line_start, line_end - line_start);
+      if (dims_text.empty() || line.find("torch.vtensor.literal") !=
+                                   std::string::npos)
+        continue;
+      size_t rank = std::count(dims_text.begin(), dims_text.end(), ',') + 1;
+      new_dims.assign(rank, "?");
+    }
+
+    rewritten += mlir_text.substr(copied, dims_pos - copied);
+    rewritten += join_dims(new_dims);
+    copied = dims_pos + dims_text.size();
+  }
+  rewritten += mlir_text.substr(copied);
+  return changed;
+}
+
+bool ShapeSweep::rewrite_kernel(const std::string &mlir_text,
+                                const ShapeScale &scale,
+                                std::string &rewritten) {
+  return rewrite_signature(mlir_text, &scale, rewritten);
+}
+
+bool ShapeSweep::relax_kernel(const std::string &mlir_text,
+                              std::string &rewritten) {
+  return rewrite_signature(mlir_text, nullptr, rewritten);
+}
+
+std::vector<ShapeScale>
+ShapeSweep::for_working_sets(const json &metadata,
+                             const std::vector<CacheLevel> &caches) {
+  std::vector<ShapeScale> scales;
+  if (!metadata.contains("kernel_call") ||
+      metadata["kernel_call"]["args"].empty())
+    return scales;
+  const json &args = metadata["kernel_call"]["args"];
+  const json &returns = metadata["kernel_call"]["returns"];
+
+  // Working set = fixed + variable * f, with f the area factor for H and W
+  std::vector<uint64_t> first = shape_of(args[0]);
+  bool spatial = first.size() == 4;
+  double fixed = 0.0, variable = 0.0;
+  for (const json &arg : args) {
+    std::vector<uint64_t> dims = shape_of(arg);
+    bool scaled = spatial ? dims == first : is_activation(dims, first);
+    (scaled ? variable : fixed) += bytes_of(arg);
+  }
+  for (const json &result : returns)
+    variable += bytes_of(result);
+  if (variable <= 0.0)
+    return scales;
+
+  for (const CacheLevel &cache : caches)
+    for (const auto &[side, factor] :
+         {std::pair<const char *, double>{"below", 0.75}, {"above", 1.5}}) {
+      double target = double(cache.bytes) * factor;
+      double f = (target - fixed) / variable;
+      if (f <= 0.0)
+        continue;
+
+      ShapeScale scale;
+      scale.name = "ws-l" + std::to_string(cache.level) + "-" + side;
+      scale.cache_level = cache.level;
+      scale.target_bytes = static_cast<uint64_t>(target);
+      bool unchanged;
+      if (spatial) {
+        scale.spatial = std::sqrt(f);
+        unchanged = scale_dim(first[2], scale.spatial) == first[2] &&
+                    scale_dim(first[3], scale.spatial) == first[3];
+      } else {
+        scale.batch = f;
+        unchanged = scale_dim(first[0], f) == first[0];
+      }
+      // The model's own shapes are measured already
+      if (!unchanged)
+        scales.push_back(scale);
+    }
+  return scales;
+}
+
+uint64_t ShapeSweep::input_elements(const fs::path &json_filepath) {
+  json metadata = load_json_from_file(json_filepath);
+  if (!metadata.contains("kernel_call"))
+    return 0;
+
+  uint64_t total = 0;
+  for (const json &arg : metadata["kernel_call"]["args"]) {
+    uint64_t elements = 1;
+    for (const json &dim : arg["shape"])
+      elements *= dim.get<uint64_t>();
+    total += elements;
+  }
+  return total;
+}
+
+uint64_t ShapeSweep::working_set_bytes(const fs::path &json_filepath) {
+  json metadata = load_json_from_file(json_filepath);
+  if (!metadata.contains("kernel_call"))
+    return 0;
+
+  uint64_t total = 0;
+  for (const char *group : {"args", "returns"})
+    for (const json &argument : metadata["kernel_call"][group])
+      total += bytes_of(argument);
+  return total;
+}
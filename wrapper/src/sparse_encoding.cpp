@@ -0,0 +1,362 @@
+#include "sparse_encoding.h"
+#include "constant_args.h"
+
+#include <cctype>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string_view>
+
+static constexpr unsigned int DEFAULT_BSR_BLOCK = 4;
+
+bool SparseEncoding::parse_format(const std::string &name,
+                                  SparseArgument &argument) {
+  argument = SparseArgument();
+  if (name == "csr") {
+    argument.format = SparseFormat::CSR;
+    return true;
+  }
+  if (name == "coo") {
+    argument.format = SparseFormat::COO;
+    return true;
+  }
+  if (name.rfind("bsr", 0) != 0)
+    return false;
+  argument.format = SparseFormat::BSR;
+  argument.block = DEFAULT_BSR_BLOCK;
+  if (name.size() == 3)
+    return true;
+  size_t end = 0;
+  try {
+    argument.block = std::stoul(name.substr(3), &end);
+  } catch (const std::exception &) {
+    return false;
+  }
+  return end == name.size() - 3 && argument.block > 0;
+}
+
+std::string SparseEncoding::describe(const SparseArgument &argument) {
+  switch (argument.format) {
+  case SparseFormat::COO:
+    return "coo";
+  case SparseFormat::BSR:
+    return "bsr" + std::to_string(argument.block);
+  default:
+    return "csr";
+  }
+}
+
+bool SparseEncoding::parse(const std::string &spec,
+                           std::map<size_t, SparseArgument> &arguments) {
+  std::stringstream ss(spec);
+  for (std::string entry; std::getline(ss, entry, ',');) {
+    if (entry.empty())
+      continue;
+    size_t colon = entry.find(':');
+    if (colon == std::string::npos)
+      return false;
+    size_t index = 0, end = 0;
+    try {
+      index = std::stoul(entry.substr(0, colon), &end);
+    } catch (const std::exception &) {
+      return false;
+    }
+    if (end != colon ||
+        !SparseEncoding::parse_format(entry.substr(colon + 1),
+                                      arguments[index]))
+      return false;
+  }
+  return true;
+}
+
+std::string SparseEncoding::encoding(const SparseArgument &argument,
+                                     const std::vector<uint64_t> &shape) {
+  size_t rank = shape.size();
+  if (rank == 0)
+    return "";
+  std::string dims, levels;
+  for (size_t d = 0; d < rank; d++)
+    dims += (d ? ", d" : "d") + std::to_string(d);
+
+  if (argument.format == SparseFormat::BSR) {
+    unsigned int b = argument.block;
+    if (rank != 2 || b == 0 || shape[0] % b || shape[1] % b)
+      return "";
+    std::string block = std::to_string(b);
+    levels = "d0 floordiv " + block + " : dense, d1 floordiv " + block +
+             " : compressed, d0 mod " + block + " : dense, d1 mod " + block +
+             " : dense";
+  } else {
+    for (size_t d = 0; d < rank; d++) {
+      std::string level;
+      if (argument.format == SparseFormat::CSR)
+        level = d + 1 < rank ? "dense" : "compressed";
+      else if (d == 0)
+        level = rank > 1 ? "compressed(nonunique)" : "compressed";
+      else
+        level = d + 1 < rank ? "singleton(nonunique, soa)" : "singleton(soa)";
+      levels += (d ? ", d" : "d") + std::to_string(d) + " : " + level;
+    }
+  }
+  return "#sparse_tensor.encoding<{ map = (" + dims + ") -> (" + levels +
+         ") }>";
+}
+
+static std::string_view trim(std::string_view text) {
+  size_t begin = text.find_first_not_of(" \t");
+  if (begin == std::string_view::npos)
+    return {};
+  return text.substr(begin, text.find_last_not_of(" \t") - begin + 1);
+}
+
+// Splits at the commas outside of <>, (), [] and {}
+static std::vector<std::string> split_types(std::string_view types) {
+  std::vector<std::string> parts;
+  int depth = 0;
+  size_t begin = 0;
+  for (size_t i = 0; i < types.size(); i++) {
+    char c = types[i];
+    if (c == '<' || c == '(' || c == '[' || c == '{')
+      depth++;
+    else if (c == '>' || c == ')' || c == ']' || c == '}')
+      depth--;
+    else if (c == ',' && depth == 0) {
+      parts.emplace_back(trim(types.substr(begin, i - begin)));
+      begin = i + 1;
+    }
+  }
+  parts.emplace_back(trim(types.substr(begin)));
+  return parts;
+}
+
+/*
+ * Retypes the operands named `name` of an op line,
+ *    %0 = torch.aten.mm %arg0, %arg1 : T0, T1 -> R loc(#loc1)
+ *    %0 = "torch.aten.mm"(%arg0, %arg1) : (T0, T1) -> R
+ * whose type is `type`. False if the line has none.
+ */
+static bool retype_operand(std::string &line, const std::string &name,
+                           const std::string &type,
+                           const std::string &encoded) {
+  size_t colon = line.find(" : ");
+  if (colon == std::string::npos)
+    return false;
+  size_t assign = line.find(" = ");
+  size_t operands_begin =
+      assign != std::string::npos && assign < colon ? assign + 3 : 0;
+  std::vector<std::string> operands;
+  for (size_t i = line.find('%', operands_begin); i < colon;
+       i = line.find('%', i + 1)) {
+    size_t end = i + 1;
+    while (end < colon && (std::isalnum(static_cast<unsigned char>(
+                               line[end])) ||
+                           line[end] == '_' || line[end] == '.'))
+      end++;
+    operands.push_back(line.substr(i, end - i));
+  }
+
+  size_t types_begin = colon + 3;
+  size_t types_end = line.rfind(" -> ");
+  if (types_end == std::string::npos || types_end < types_begin)
+    types_end = std::min(line.size(), line.find(" loc(", types_begin));
+  std::string_view types =
+      trim(std::string_view(line).substr(types_begin, types_end - types_begin));
+  bool parenthesised = types.size() >= 2 && types.front() == '(' &&
+                       types.back() == ')';
+  if (parenthesised)
+    types = types.substr(1, types.size() - 2);
+  std::vector<std::string> parts = split_types(types);
+  if (parts.size() != operands.size())
+    return false;
+
+  bool retyped = false;
+  for (size_t k = 0; k < operands.size(); k++)
+    if (operands[k] == name && parts[k] == type) {
+      parts[k] = encoded;
+      retyped = true;
+    }
+  if (!retyped)
+    return false;
+  std::string joined;
+  for (const std::string &part : parts)
+    joined += (joined.empty() ? "" : ", ") + part;
+  if (parenthesised)
+    joined = "(" + joined + ")";
+  line = line.substr(0, types_begin) + joined +
+         (types_end < line.size() ? " " + line.substr(types_end + 1) : "");
+  return true;
+}
+
+bool SparseEncoding::annotate(const std::string &kernel_text,
+                              const std::vector<std::vector<uint64_t>> &shapes,
+                              std::map<size_t, SparseArgument> &arguments,
+                              std::string &annotated) {
+  std::vector<std::string> types = ConstantArgs::argument_types(kernel_text);
+  size_t signature = kernel_text.find("@kernel_call(");
+  if (signature == std::string::npos)
+    return false;
+  size_t body = kernel_text.find('\n', signature);
+  if (body == std::string::npos)
+    return false;
+  std::string header = kernel_text.substr(0, body + 1);
+
+  std::map<std::string, std::string> aliases;
+  std::map<std::string, std::pair<std::string, std::string>> retyped;
+  for (auto it = arguments.begin(); it != arguments.end();) {
+    size_t index = it->first;
+    std::string name = "%arg" + std::to_string(index);
+    std::string encoded_as =
+        index < shapes.size()
+            ? SparseEncoding::encoding(it->second, shapes[index])
+            : "";
+    size_t declared =
+        index < types.size() ? header.find(name + ": " + types[index])
+                             : std::string::npos;
+    if (encoded_as.empty() || declared == std::string::npos ||
+        types[index].rfind("!torch.vtensor<", 0) != 0) {
+      std::cerr << "Argument " << index << " can't be stored as "
+                << SparseEncoding::describe(it->second)
+                << ", keeping it dense\n";
+      it = arguments.erase(it);
+      continue;
+    }
+    std::string alias = "#sparse_" + SparseEncoding::describe(it->second) +
+                        "_" + std::to_string(shapes[index].size()) + "d";
+    aliases[alias] = encoded_as;
+    const std::string &type = types[index];
+    std::string encoded = type.substr(0, type.size() - 1) + "," + alias + ">";
+    header.replace(declared + name.size() + 2, type.size(), encoded);
+    retyped[name] = {type, encoded};
+    ++it;
+  }
+  if (arguments.empty())
+    return false;
+
+  std::ostringstream result;
+  for (const auto &[alias, encoding] : aliases)
+    result << alias << " = " << encoding << "\n";
+  result << header;
+  std::stringstream lines(kernel_text.substr(body + 1));
+  for (std::string line; std::getline(lines, line);) {
+    for (const auto &[name, types] : retyped)
+      if (line.find(name) != std::string::npos)
+        retype_operand(line, name, types.first, types.second);
+    result << line << "\n";
+  }
+  annotated = result.str();
+  return true;
+}
+
+size_t SparseEncoding::buffer_count(const SparseArgument &argument,
+                                    size_t rank) {
+  return argument.format == SparseFormat::COO ? 2 + rank : 3;
+}
+
+bool SparseEncoding::is_sparse_kernel(const fs::path &mlir_filepath) {
+  std::ifstream kernel_file(mlir_filepath);
+  // Aliases come first, the encodings are at the top of the file
+  for (std::string line; std::getline(kernel_file, line);) {
+    if (line.find("#sparse_tensor.encoding") != std::string::npos)
+      return true;
+    if (line.find("func.func") != std::string::npos)
+      return false;
+  }
+  return false;
+}
+
+static void append(SparseBuffer &buffer, const void *element, size_t bytes) {
+  const uint8_t *data = static_cast<const uint8_t *>(element);
+  buffer.data.insert(buffer.data.end(), data, data + bytes);
+  buffer.count++;
+}
+
+static void append_index(SparseBuffer &buffer, int64_t index) {
+  append(buffer, &index, sizeof(index));
+}
+
+bool SparseEncoding::compress(const SparseArgument &argument,
+                              const std::vector<uint64_t> &shape,
+                              ElementType type, const void *dense,
+                              std::vector<SparseBuffer> &buffers) {
+  buffers.clear();
+  if (SparseEncoding::encoding(argument, shape).empty())
+    return false;
+  size_t rank = shape.size();
+  size_t elem_size = ElementTypes::size(type);
+  const uint8_t *bytes = static_cast<const uint8_t *>(dense);
+  auto element = [&](uint64_t i) { return bytes + i * elem_size; };
+  auto nonzero = [&](uint64_t i) {
+    return ElementTypes::load(dense, static_cast<int64_t>(i), type) != 0.0;
+  };
+  SparseBuffer values;
+  values.type = type;
+
+  if (argument.format == SparseFormat::BSR) {
+    uint64_t b = argument.block;
+    uint64_t rows = shape[0], cols = shape[1];
+    SparseBuffer positions, coordinates;
+    append_index(positions, 0);
+    for (uint64_t block_row = 0; block_row < rows / b; block_row++) {
+      for (uint64_t block_col = 0; block_col < cols / b; block_col++) {
+        bool stored = false;
+        for (uint64_t i = 0; i < b && !stored; i++)
+          for (uint64_t j = 0; j < b && !stored; j++)
+            stored = nonzero((block_row * b + i) * cols + block_col * b + j);
+        if (!stored)
+          continue;
+        append_index(coordinates, static_cast<int64_t>(block_col));
+        for (uint64_t i = 0; i < b; i++)
+          for (uint64_t j = 0; j < b; j++)
+            append(values,
+                   element((block_row * b + i) * cols + block_col * b + j),
+                   elem_size);
+      }
+      append_index(positions, static_cast<int64_t>(coordinates.count));
+    }
+    buffers = {std::move(values), std::move(positions),
+               std::move(coordinates)};
+    return true;
+  }
+
+  uint64_t cols = shape[rank - 1];
+  uint64_t rows = 1;
+  for (size_t d = 0; d + 1 < rank; d++)
+    rows *= shape[d];
+
+  if (argument.format == SparseFormat::CSR || rank == 1) {
+    SparseBuffer positions, coordinates;
+    append_index(positions, 0);
+    for (uint64_t row = 0; row < rows; row++) {
+      for (uint64_t col = 0; col < cols; col++) {
+        if (!nonzero(row * cols + col))
+          continue;
+        append(values, element(row * cols + col), elem_size);
+        append_index(coordinates, static_cast<int64_t>(col));
+      }
+      append_index(positions, static_cast<int64_t>(coordinates.count));
+    }
+    buffers = {std::move(values), std::move(positions),
+               std::move(coordinates)};
+    return true;
+  }
+
+  // COO: one coordinate array per dimension, in row major order
+  std::vector<SparseBuffer> coordinates(rank);
+  uint64_t elements = rows * cols;
+  for (uint64_t i = 0; i < elements; i++) {
+    if (!nonzero(i))
+      continue;
+    append(values, element(i), elem_size);
+    uint64_t rest = i;
+    for (size_t d = rank; d-- > 0; rest /= shape[d])
+      append_index(coordinates[d], static_cast<int64_t>(rest % shape[d]));
+  }
+  SparseBuffer positions;
+  append_index(positions, 0);
+  append_index(positions, static_cast<int64_t>(values.count));
+  buffers.push_back(std::move(values));
+  buffers.push_back(std::move(positions));
+  for (SparseBuffer &coordinate : coordinates)
+    buffers.push_back(std::move(coordinate));
+  return true;
+}
@@ -0,0 +1,342 @@
+#include "statistics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <random>
+
+double Statistics::mean(const std::vector<double> &values) {
+  if (values.empty())
+    return 0.0;
+  return std::accumulate(values.begin(), values.end(), 0.0) / values.size();
+}
+
+double Statistics::stddev(const std::vector<double> &values) {
+  if (values.size() < 2)
+    return 0.0;
+
+  double avg = Statistics::mean(values);
+  double squares = 0.0;
+  for (double v : values)
+    squares += (v - avg) * (v - avg);
+  return std::sqrt(squares / (values.size() - 1));
+}
+
+double Statistics::coefficient_of_variation(const std::vector<double> &values) {
+  double avg = Statistics::mean(values);
+  return avg == 0.0 ? 0.0 : Statistics::stddev(values) / std::fabs(avg);
+}
+
+double Statistics::window_cv(const std::vector<double> &values,
+                             size_t window) {
+  if (values.size() <= window)
+    return Statistics::coefficient_of_variation(values);
+  return Statistics::coefficient_of_variation(
+      std::vector<double>(values.end() - window, values.end()));
+}
+
+double Statistics::t_critical_95(size_t degrees) {
+  // Tabulated up to 30 degrees of freedom, normal approximation afterwards
+  static const double table[] = {
+      0.0,    12.706, 4.303,  3.182,  2.776,  2.571,  2.447,  2.365,
+      2.306,  2.262,  2.228,  2.201,  2.179,  2.160,  2.145,  2.131,
+      2.120,  2.110,  2.101,  2.093,  2.086,  2.080,  2.074,  2.069,
+      2.064,  2.060,  2.056,  2.052,  2.048,  2.045,  2.042};
+  if (degrees == 0)
+    return std::numeric_limits<double>::infinity();
+  if (degrees <= 30)
+    return table[degrees];
+  return 1.960;
+}
+
+double Statistics::relative_ci_95(const std::vector<double> &values) {
+  if (values.size() < 2)
+    return std::numeric_limits<double>::infinity();
+
+  double avg = Statistics::mean(values);
+  if (avg == 0.0)
+    return 0.0;
+
+  double half_width = Statistics::t_critical_95(values.size() - 1) *
+                      Statistics::stddev(values) / std::sqrt(values.size());
+  return half_width / std::fabs(avg);
+}
+
+double Statistics::median(const std::vector<double> &values) {
+  return Statistics::percentile(values, 0.5);
+}
+
+double Statistics::percentile(const std::vector<double> &values,
+                              double fraction) {
+  if (values.empty())
+    return 0.0;
+  std::vector<double> sorted(values);
+  std::sort(sorted.begin(), sorted.end());
+  double position = std::clamp(fraction, 0.0, 1.0) * (sorted.size() - 1);
+  size_t below = static_cast<size_t>(position);
+  size_t above = std::min(below + 1, sorted.size() - 1);
+  return sorted[below] + (position - below) * (sorted[above] - sorted[below]);
+}
+
+double Statistics::mad(const std::vector<double> &values) {
+  double center = Statistics::median(values);
+  std::vector<double> deviations;
+  deviations.reserve(values.size());
+  for (double v : values)
+    deviations.push_back(std::fabs(v - center));
+  return Statistics::median(deviations);
+}
+
+void Statistics::bootstrap_ci_95(const std::vector<double> &values,
+                                 unsigned int resamples, double &low,
+                                 double &high) {
+  low = high = Statistics::mean(values);
+  if (values.size() < 2 || resamples == 0)
+    return;
+
+  std::mt19937_64 rng(1);
+  std::uniform_int_distribution<size_t> pick(0, values.size() - 1);
+  std::vector<double> means(resamples);
+  for (double &resampled_mean : means) {
+    double sum = 0.0;
+    for (size_t i = 0; i < values.size(); i++)
+      sum += values[pick(rng)];
+    resampled_mean = sum / values.size();
+  }
+  low = Statistics::percentile(means, 0.025);
+  high = Statistics::percentile(means, 0.975);
+}
+
+SampleSummary Statistics::summarize(const std::vector<double> &values,
+                                    unsigned int bootstrap_resamples) {
+  SampleSummary summary;
+  summary.count = values.size();
+  if (values.empty())
+    return summary;
+  auto [min, max] = std::minmax_element(values.begin(), values.end());
+  summary.mean = Statistics::mean(values);
+  summary.median = Statistics::median(values);
+  summary.min = *min;
+  summary.max = *max;
+  summary.p90 = Statistics::percentile(values, 0.90);
+  summary.p99 = Statistics::percentile(values, 0.99);
+  summary.stddev = Statistics::stddev(values);
+  summary.mad = Statistics::mad(values);
+  Statistics::bootstrap_ci_95(values, bootstrap_resamples, summary.ci95_low,
+                              summary.ci95_high);
+  return summary;
+}
+
+std::vector<bool> Statistics::find_outliers(const std::vector<double> &values,
+                                            const OutlierConfig &config) {
+  std::vector<bool> rejected(values.size(), false);
+  if (config.method == OutlierMethod::NONE || values.size() < 4)
+    return rejected;
+
+  if (config.method == OutlierMethod::MAD) {
+    double threshold = config.threshold > 0.0 ? config.threshold : 3.5;
+    double center = Statistics::median(values);
+    // 0.6745 / MAD estimates 1 / sigma. More than half the samples equal
+    // to the median leave MAD at 0, the mean absolute deviation (sigma /
+    // 1.2533) takes over then. Without any spread nothing is rejected.
+    double inverse_scale = 0.0;
+    if (double mad = Statistics::mad(values); mad > 0.0) {
+      inverse_scale = 0.6745 / mad;
+    } else {
+      double mean_deviation = 0.0;
+      for (double value : values)
+        mean_deviation += std::fabs(value - center);
+      mean_deviation /= values.size();
+      if (mean_deviation > 0.0)
+        inverse_scale = 1.0 / (1.2533 * mean_deviation);
+    }
+    if (inverse_scale == 0.0)
+      return rejected;
+    for (size_t i = 0; i < values.size(); i++)
+      rejected[i] = std::fabs(values[i] - center) * inverse_scale > threshold;
+  } else {
+    double k = config.threshold > 0.0 ? config.threshold : 1.5;
+    double q1 = Statistics::percentile(values, 0.25);
+    double q3 = Statistics::percentile(values, 0.75);
+    double iqr = q3 - q1;
+    for (size_t i = 0; i < values.size(); i++)
+      rejected[i] = values[i] < q1 - k * iqr || values[i] > q3 + k * iqr;
+  }
+
+  if (2 * static_cast<size_t>(
+              std::count(rejected.begin(), rejected.end(), true)) >
+      values.size())
+    std::fill(rejected.begin(), rejected.end(), false);
+  return rejected;
+}
+
+std::string Statistics::describe(OutlierMethod method) {
+  switch (method) {
+  case OutlierMethod::MAD:
+    return "mad";
+  case OutlierMethod::IQR:
+    return "iqr";
+  default:
+    return "none";
+  }
+}
+
+bool Statistics::parse(const std::string &name, OutlierMethod &method) {
+  for (OutlierMethod candidate :
+       {OutlierMethod::NONE, OutlierMethod::MAD, OutlierMethod::IQR})
+    if (Statistics::describe(candidate) == name) {
+      method = candidate;
+      return true;
+    }
+  return false;
+}
+
+double Statistics::mann_whitney_p(const std::vector<double> &a,
+                                  const std::vector<double> &b, double &u) {
+  u = 0.0;
+  size_t n1 = a.size(), n2 = b.size(), n = n1 + n2;
+  if (!n1 || !n2)
+    return 1.0;
+
+  // Average ranks over the pooled values, tied groups share their mean rank
+  std::vector<std::pair<double, bool>> pooled;
+  pooled.reserve(n);
+  for (double v : a)
+    pooled.emplace_back(v, true);
+  for (double v : b)
+    pooled.emplace_back(v, false);
+  std::sort(pooled.begin(), pooled.end(),
+            [](const auto &x, const auto &y) { return x.first < y.first; });
+  double rank_sum = 0.0, tie_term = 0.0;
+  for (size_t i = 0; i < n;) {
+    size_t j = i;
+    while (j < n && pooled[j].first == pooled[i].first)
+      j++;
+    double rank = (i + 1 + j) / 2.0;
+    for (size_t k = i; k < j; k++)
+      if (pooled[k].second)
+        rank_sum += rank;
+    double ties = static_cast<double>(j - i);
+    tie_term += ties * ties * ties - ties;
+    i = j;
+  }
+  u = rank_sum - n1 * (n1 + 1) / 2.0;
+
+  double mean = n1 * n2 / 2.0;
+  double variance =
+      n1 * n2 / 12.0 * ((n + 1) - tie_term / (static_cast<double>(n) * (n - 1)));
+  if (variance <= 0.0)
+    return 1.0; // every value equal
+  double z = std::max(0.0, std::fabs(u - mean) - 0.5) / std::sqrt(variance);
+  return std::erfc(z / std::sqrt(2.0));
+}
+
+double Statistics::bootstrap_p(const std::vector<double> &a,
+                               const std::vector<double> &b,
+                               unsigned int resamples) {
+  if (a.empty() || b.empty() || resamples == 0)
+    return 1.0;
+
+  std::mt19937_64 rng(1);
+  auto resample_median = [&rng](const std::vector<double> &values) {
+    std::uniform_int_distribution<size_t> pick(0, values.size() - 1);
+    std::vector<double> drawn(values.size());
+    for (double &v : drawn)
+      v = values[pick(rng)];
+    return Statistics::median(drawn);
+  };
+  size_t above = 0, below = 0;
+  for (unsigned int r = 0; r < resamples; r++) {
+    double difference = resample_median(a) - resample_median(b);
+    above += difference >= 0.0;
+    below += difference <= 0.0;
+  }
+  return std::min(1.0, 2.0 * std::min(above, below) / resamples);
+}
+
+// Indices of p_values, smallest p first
+static std::vector<size_t> ascending_order(const std::vector<double> &p) {
+  std::vector<size_t> order(p.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(),
+                   [&p](size_t a, size_t b) { return p[a] < p[b]; });
+  return order;
+}
+
+std::vector<double> Statistics::holm(const std::vector<double> &p_values) {
+  std::vector<size_t> order = ascending_order(p_values);
+  std::vector<double> adjusted(p_values.size());
+  double running = 0.0;
+  for (size_t rank = 0; rank < order.size(); rank++) {
+    double p = p_values[order[rank]] * double(order.size() - rank);
+    running = std::max(running, std::min(1.0, p));
+    adjusted[order[rank]] = running;
+  }
+  return adjusted;
+}
+
+std::vector<double>
+Statistics::benjamini_hochberg(const std::vector<double> &p_values) {
+  std::vector<size_t> order = ascending_order(p_values);
+  std::vector<double> adjusted(p_values.size());
+  double running = 1.0;
+  for (size_t rank = order.size(); rank-- > 0;) {
+    double p = p_values[order[rank]] * double(order.size()) / double(rank + 1);
+    running = std::min(running, p);
+    adjusted[order[rank]] = running;
+  }
+  return adjusted;
+}
+
+double Statistics::cliffs_delta(const std::vector<double> &a,
+                                const std::vector<double> &b) {
+  if (a.empty() || b.empty())
+    return 0.0;
+  double u = 0.0;
+  Statistics::mann_whitney_p(a, b, u);
+  return 2.0 * u / (static_cast<double>(a.size()) * b.size()) - 1.0;
+}
+
+double Statistics::pearson(const std::vector<double> &x,
+                           const std::vector<double> &y) {
+  size_t n = std::min(x.size(), y.size());
+  if (n < 2)
+    return 0.0;
+  double mean_x = std::accumulate(x.begin(), x.begin() + n, 0.0) / n;
+  double mean_y = std::accumulate(y.begin(), y.begin() + n, 0.0) / n;
+  double sxy = 0.0, sxx = 0.0, syy = 0.0;
+  for (size_t i = 0; i < n; i++) {
+    sxy += (x[i] - mean_x) * (y[i] - mean_y);
+    sxx += (x[i] - mean_x) * (x[i] - mean_x);
+    syy += (y[i] - mean_y) * (y[i] - mean_y);
+  }
+  if (sxx <= 0.0 || syy <= 0.0)
+    return 0.0;
+  return sxy / std::sqrt(sxx * syy);
+}
+
+static std::vector<double> ranks(const std::vector<double> &values) {
+  std::vector<size_t> order(values.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(),
+            [&](size_t a, size_t b) { return values[a] < values[b]; });
+  std::vector<double> ranked(values.size());
+  for (size_t i = 0; i < order.size();) {
+    size_t j = i;
+    while (j + 1 < order.size() && values[order[j + 1]] == values[order[i]])
+      j++;
+    for (size_t k = i; k <= j; k++)
+      ranked[order[k]] = (i + j) / 2.0 + 1.0;
+    i = j + 1;
+  }
+  return ranked;
+}
+
+double Statistics::spearman(const std::vector<double> &x,
+                            const std::vector<double> &y) {
+  size_t n = std::min(x.size(), y.size());
+  return Statistics::pearson(
+      ranks(std::vector<double>(x.begin(), x.begin() + n)),
+      ranks(std::vector<double>(y.begin(), y.begin() + n)));
+}
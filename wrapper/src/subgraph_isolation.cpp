@@ -0,0 +1,771 @@
+#include "subgraph_isolation.h"
+#include "kernel_metadata.h"
+#include "model_layers.h"
+#include "model_source.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <regex>
+#include <sstream>
+#include <string_view>
+
+static const std::regex VALUE(R"(%[A-Za-z0-9_$.\-]+(#[0-9]+)?)");
+static const std::regex RESULT_OP(
+    R"(^\s*(%[A-Za-z0-9_$.\-]+)(?::([0-9]+))?\s*=\s*([A-Za-z0-9_.]+)(.*)$)");
+static const std::regex PLAIN_OP(R"(^\s*([A-Za-z0-9_.]+)(.*)$)");
+static const std::regex FUNC_ARG(
+    R"((%[A-Za-z0-9_$.\-]+)\s*:\s*(!torch\.vtensor<[^>]*>))");
+
+bool SubgraphIsolation::parse(const std::string &spec, FusionSpec &fusion) {
+  fusion = FusionSpec();
+  if (spec.empty() || spec == "op")
+    return true;
+  if (spec == "pair") {
+    fusion.granularity = FusionGranularity::PAIR;
+    return true;
+  }
+  if (spec.rfind("window:", 0) == 0) {
+    std::string size = spec.substr(7);
+    if (size.empty() || size.find_first_not_of("0123456789") !=
+                            std::string::npos ||
+        std::stoul(size) < 2) {
+      std::cerr << "--isolate-granularity window:<k> takes a k of 2 or more, "
+                   "not \""
+                << size << "\"\n";
+      return false;
+    }
+    fusion.granularity = FusionGranularity::WINDOW;
+    fusion.window = std::stoul(size);
+    return true;
+  }
+  if (spec.rfind("pattern:", 0) == 0) {
+    std::stringstream patterns(spec.substr(8));
+    for (std::string pattern; std::getline(patterns, pattern, ',');) {
+      std::vector<std::string> chain;
+      std::stringstream ops(pattern);
+      for (std::string op; std::getline(ops, op, '+');)
+        if (!op.empty())
+          chain.push_back(op);
+      if (chain.size() >= 2)
+        fusion.patterns.push_back(chain);
+      else
+        std::cerr << "Pattern \"" << pattern
+                  << "\" has fewer than two ops, skipping it\n";
+    }
+    if (fusion.patterns.empty()) {
+      std::cerr << "--isolate-granularity pattern: lists no usable pattern\n";
+      return false;
+    }
+    fusion.granularity = FusionGranularity::PATTERN;
+    return true;
+  }
+  std::cerr << "Unknown --isolate-granularity \"" << spec
+            << "\", expected op, pair, window:<k> or pattern:<a+b>\n";
+  return false;
+}
+
+std::string SubgraphIsolation::describe(const FusionSpec &fusion) {
+  switch (fusion.granularity) {
+  case FusionGranularity::PAIR:
+    return "pair";
+  case FusionGranularity::WINDOW:
+    return "window:" + std::to_string(fusion.window);
+  case FusionGranularity::PATTERN: {
+    std::string patterns;
+    for (const std::vector<std::string> &chain : fusion.patterns) {
+      std::string pattern;
+      for (const std::string &op : chain)
+        pattern += (pattern.empty() ? "" : "+") + op;
+      patterns += (patterns.empty() ? "" : ",") + pattern;
+    }
+    return "pattern:" + patterns;
+  }
+  default:
+    return "op";
+  }
+}
+
+fs::path SubgraphIsolation::manifest_filepath(const fs::path &lowering_folder) {
+  return fs::path(lowering_folder).append("subgraphs.json");
+}
+
+namespace {
+// One op of the forward function, ops with regions are kept opaque
+struct ModelOp {
+  std::string name; // aten.convolution, prim.ListConstruct, return
+  std::string body; // everything after the op name, without its loc(...)
+  std::string result;
+  unsigned int result_count = 0;
+  std::vector<std::string> results;
+  std::vector<std::string> result_types;
+  std::vector<std::string> operands;
+  bool compute = false;
+  bool opaque = false;
+};
+
+struct ForwardFunction {
+  std::vector<ModelOp> ops;
+  std::map<std::string, std::string> types; // value -> type, where known
+  std::map<std::string, size_t> definitions;
+  std::map<std::string, std::vector<size_t>> uses;
+};
+} // namespace
+
+// Position of `token` in `text` outside of (), <>, [] and {}
+static size_t find_top_level(const std::string &text, const std::string &token,
+                             size_t from = 0) {
+  int depth = 0;
+  for (size_t i = from; i < text.size(); i++) {
+    char c = text[i];
+    if (depth == 0 && text.compare(i, token.size(), token) == 0)
+      return i;
+    if (c == '(' || c == '<' || c == '[' || c == '{')
+      depth++;
+    else if ((c == ')' || c == '>' || c == ']' || c == '}') && depth > 0)
+      depth--;
+  }
+  return std::string::npos;
+}
+
+static std::vector<std::string> split_types(std::string types) {
+  while (!types.empty() && types.front() == ' ')
+    types.erase(0, 1);
+  while (!types.empty() && types.back() == ' ')
+    types.pop_back();
+  if (!types.empty() && types.front() == '(' && types.back() == ')')
+    types = types.substr(1, types.size() - 2);
+  std::vector<std::string> split;
+  size_t begin = 0;
+  while (begin <= types.size()) {
+    size_t comma = find_top_level(types, ",", begin);
+    std::string type = types.substr(
+        begin, comma == std::string::npos ? std::string::npos : comma - begin);
+    type.erase(0, std::min(type.find_first_not_of(' '), type.size()));
+    if (!type.empty())
+      split.push_back(type);
+    if (comma == std::string::npos)
+      break;
+    begin = comma + 1;
+  }
+  return split;
+}
+
+static bool is_tensor(const std::string &type) {
+  return type.rfind("!torch.vtensor<", 0) == 0;
+}
+
+static std::vector<std::string> values_in(const std::string &text) {
+  std::vector<std::string> values;
+  for (std::sregex_iterator it(text.begin(), text.end(), VALUE), end;
+       it != end; ++it)
+    values.push_back(it->str());
+  return values;
+}
+
+/*
+ * The ops of the first function of the model (its forward), one per line as
+ * torch-mlir prints them. Values are keyed as written, %5#1 for the second
+ * result of %5:2.
+ */
+static bool parse_forward(std::string_view text,
+                          const std::set<std::string> &op_types,
+                          ForwardFunction &function) {
+  int depth = 0, function_depth = -1;
+  size_t region_op = 0;
+  for (size_t begin = 0; begin < text.size();) {
+    size_t end = std::min(text.find('\n', begin), text.size());
+    std::string line(text.substr(begin, end - begin));
+    begin = end + 1;
+    if (line.rfind("{-#", 0) == 0 || line.rfind("#loc", 0) == 0)
+      continue;
+
+    // The op's trailing loc(...) would need the model's #loc aliases
+    size_t loc = line.rfind(" loc(");
+    if (loc != std::string::npos)
+      line.erase(loc);
+    int opens = std::count(line.begin(), line.end(), '{') -
+                std::count(line.begin(), line.end(), '}');
+
+    if (function_depth < 0) {
+      if (line.find("func.func") != std::string::npos) {
+        for (std::sregex_iterator it(line.begin(), line.end(), FUNC_ARG), e;
+             it != e; ++it)
+          function.types[(*it)[1].str()] = (*it)[2].str();
+        function_depth = depth + 1;
+      }
+      depth += opens;
+      continue;
+    }
+
+    // Inside a region: its values are the region op's uses
+    if (depth > function_depth) {
+      if (function.ops.empty()) {
+        depth += opens;
+        continue;
+      }
+      for (const std::string &value : values_in(line))
+        if (std::find(function.ops[region_op].operands.begin(),
+                      function.ops[region_op].operands.end(),
+                      value) == function.ops[region_op].operands.end())
+          function.ops[region_op].operands.push_back(value);
+      depth += opens;
+      continue;
+    }
+    if (line.find_first_not_of(" \t") == std::string::npos) {
+      depth += opens;
+      continue;
+    }
+    // The function's closing brace
+    if (opens < 0 && line.find_first_not_of(" \t}") == std::string::npos)
+      break;
+
+    ModelOp op;
+    std::smatch match;
+    if (std::regex_match(line, match, RESULT_OP)) {
+      op.result = match[1].str();
+      op.result_count = match[2].matched ? std::stoul(match[2].str()) : 1;
+      op.name = match[3].str();
+      op.body = match[4].str();
+    } else if (std::regex_match(line, match, PLAIN_OP)) {
+      op.name = match[1].str();
+      op.body = match[2].str();
+    } else {
+      depth += opens;
+      continue;
+    }
+    if (op.name.rfind("torch.", 0) == 0)
+      op.name = op.name.substr(6);
+    op.compute = op_types.count(op.name) > 0;
+    op.opaque = opens > 0;
+
+    for (unsigned int r = 0; r < op.result_count; r++)
+      op.results.push_back(op.result_count == 1
+                               ? op.result
+                               : op.result + "#" + std::to_string(r));
+
+    // Operands precede the top level " : ", result types follow its "->"
+    size_t colon = find_top_level(op.body, " : ");
+    op.operands =
+        values_in(colon == std::string::npos ? op.body
+                                             : op.body.substr(0, colon));
+    if (colon != std::string::npos) {
+      std::string types = op.body.substr(colon + 3);
+      size_t arrow = find_top_level(types, "->");
+      op.result_types =
+          split_types(arrow == std::string::npos ? types
+                                                 : types.substr(arrow + 2));
+    }
+    if (op.result_types.size() == op.results.size())
+      for (size_t r = 0; r < op.results.size(); r++)
+        function.types[op.results[r]] = op.result_types[r];
+
+    size_t index = function.ops.size();
+    for (const std::string &result : op.results)
+      function.definitions[result] = index;
+    if (op.opaque)
+      region_op = index;
+    function.ops.push_back(op);
+    depth += opens;
+  }
+
+  for (size_t i = 0; i < function.ops.size(); i++)
+    for (const std::string &operand : function.ops[i].operands)
+      function.uses[operand].push_back(i);
+  return !function.ops.empty();
+}
+
+// A value's base name, %5 of %5#1
+static std::string base_of(const std::string &value) {
+  return value.substr(0, value.find('#'));
+}
+
+/*
+ * Arguments of the subgraph `members` in the order kernel_call takes them:
+ * tensors from outside, by first use. The non-tensor ops building its
+ * operands go to `copied`. False if it needs a non-tensor value of an
+ * isolated or opaque op.
+ */
+static bool gather_inputs(const ForwardFunction &function,
+                          const std::set<size_t> &member_set,
+                          std::set<size_t> &copied,
+                          std::vector<std::string> &inputs) {
+  std::function<bool(const std::string &)> provide =
+      [&](const std::string &value) {
+        auto definition = function.definitions.find(value);
+        if (definition != function.definitions.end() &&
+            member_set.count(definition->second))
+          return true;
+        auto type = function.types.find(value);
+        if (type != function.types.end() && is_tensor(type->second)) {
+          if (std::find(inputs.begin(), inputs.end(), value) == inputs.end())
+            inputs.push_back(value);
+          return true;
+        }
+        // Non-tensor function arguments or results of isolated ops
+        if (definition == function.definitions.end())
+          return false;
+        const ModelOp &op = function.ops[definition->second];
+        if (op.compute || op.opaque)
+          return false;
+        if (copied.insert(definition->second).second)
+          for (const std::string &operand : op.operands)
+            if (!provide(operand))
+              return false;
+        return true;
+      };
+  for (size_t member : member_set) {
+    if (function.ops[member].opaque)
+      return false;
+    for (const std::string &operand : function.ops[member].operands)
+      if (!provide(operand))
+        return false;
+  }
+  return true;
+}
+
+/*
+ * kernel_call of the ops `members` (indices, in model order), false if the
+ * subgraph can't be cut out on its own
+ */
+static bool emit_subgraph(const ForwardFunction &function,
+                          const std::vector<size_t> &members,
+                          std::string &kernel) {
+  std::set<size_t> member_set(members.begin(), members.end());
+  std::set<size_t> copied;
+  std::vector<std::string> inputs;
+  if (!gather_inputs(function, member_set, copied, inputs))
+    return false;
+
+  // Results read after the subgraph, and dead ones so the ops stay alive
+  std::vector<std::string> outputs;
+  for (size_t member : members)
+    for (const std::string &result : function.ops[member].results) {
+      auto uses = function.uses.find(result);
+      bool escapes = uses == function.uses.end() ||
+                     std::any_of(uses->second.begin(), uses->second.end(),
+                                 [&](size_t user) {
+                                   return !member_set.count(user);
+                                 });
+      if (!escapes)
+        continue;
+      auto type = function.types.find(result);
+      if (type == function.types.end() || !is_tensor(type->second))
+        return false;
+      outputs.push_back(result);
+    }
+  if (outputs.empty())
+    return false;
+
+  // Values renamed in order, so that identical subgraphs print identically
+  std::map<std::string, std::string> names;
+  std::string signature;
+  for (size_t i = 0; i < inputs.size(); i++) {
+    names[inputs[i]] = "%arg" + std::to_string(i);
+    signature += (i ? ", " : "") + names[inputs[i]] + ": " +
+                 function.types.at(inputs[i]);
+  }
+  std::set<size_t> emitted(copied.begin(), copied.end());
+  emitted.insert(members.begin(), members.end());
+  size_t next = 0;
+  auto rename = [&names](const std::string &text) {
+    std::string renamed;
+    std::string::const_iterator begin = text.cbegin();
+    std::smatch match;
+    while (std::regex_search(begin, text.cend(), match, VALUE)) {
+      renamed.append(begin, match[0].first);
+      std::string value = match[0].str();
+      auto full = names.find(value);
+      auto base = names.find(base_of(value));
+      renamed += full != names.end() ? full->second
+                 : base != names.end()
+                     ? base->second + value.substr(base_of(value).size())
+                     : value;
+      begin = match[0].second;
+    }
+    renamed.append(begin, text.cend());
+    return renamed;
+  };
+
+  std::string body;
+  for (size_t index : emitted) {
+    const ModelOp &op = function.ops[index];
+    std::string line = "    ";
+    if (!op.result.empty()) {
+      std::string name = "%" + std::to_string(next++);
+      line += name + (op.result_count > 1
+                          ? ":" + std::to_string(op.result_count)
+                          : "") +
+              " = ";
+      names[op.result] = name;
+    }
+    body += line + "torch." + op.name + rename(op.body) + "\n";
+  }
+
+  std::string values, types;
+  for (size_t i = 0; i < outputs.size(); i++) {
+    values += (i ? ", " : "") + rename(outputs[i]);
+    types += (i ? ", " : "") + function.types.at(outputs[i]);
+  }
+  kernel = "module {\n  func.func @kernel_call(" + signature + ") -> " +
+           (outputs.size() > 1 ? "(" + types + ")" : types) + " {\n" + body +
+           "    return " + values + " : " + types + "\n  }\n}\n";
+  return true;
+}
+
+// aten.add.Tensor is matched by "add", "add.Tensor" and "aten.add.Tensor"
+static bool matches(const std::string &op, const std::string &pattern) {
+  std::string name = op.rfind("aten.", 0) == 0 ? op.substr(5) : op;
+  return op == pattern || name == pattern ||
+         name.rfind(pattern + ".", 0) == 0;
+}
+
+// Member sets of the forward function under `fusion`, in model order
+static std::vector<std::vector<size_t>>
+find_subgraphs(const ForwardFunction &function, const FusionSpec &fusion) {
+  std::vector<size_t> compute;
+  for (size_t i = 0; i < function.ops.size(); i++)
+    if (function.ops[i].compute)
+      compute.push_back(i);
+  // Isolated ops consuming a result of op `i`
+  auto consumers = [&function](size_t i) {
+    std::set<size_t> users;
+    for (const std::string &result : function.ops[i].results) {
+      auto uses = function.uses.find(result);
+      if (uses != function.uses.end())
+        for (size_t user : uses->second)
+          if (function.ops[user].compute)
+            users.insert(user);
+    }
+    return users;
+  };
+
+  std::vector<std::vector<size_t>> subgraphs;
+  switch (fusion.granularity) {
+  case FusionGranularity::PAIR:
+    for (size_t producer : compute)
+      for (size_t consumer : consumers(producer))
+        subgraphs.push_back({producer, consumer});
+    break;
+  case FusionGranularity::WINDOW:
+    for (size_t start = 0; start + fusion.window <= compute.size(); start++) {
+      std::vector<size_t> window(compute.begin() + start,
+                                 compute.begin() + start + fusion.window);
+      bool connected = true;
+      for (size_t k = 1; k < window.size() && connected; k++)
+        connected = std::any_of(window.begin(), window.begin() + k,
+                                [&](size_t earlier) {
+                                  return consumers(earlier).count(window[k]);
+                                });
+      if (connected)
+        subgraphs.push_back(window);
+    }
+    break;
+  case FusionGranularity::PATTERN:
+    for (const std::vector<std::string> &pattern : fusion.patterns)
+      for (size_t first : compute) {
+        if (!matches(function.ops[first].name, pattern[0]))
+          continue;
+        // The first consumer of each link that continues the chain
+        std::vector<size_t> chain = {first};
+        for (size_t k = 1; k < pattern.size(); k++) {
+          for (size_t user : consumers(chain.back()))
+            if (matches(function.ops[user].name, pattern[k])) {
+              chain.push_back(user);
+              break;
+            }
+          if (chain.size() != k + 1)
+            break;
+        }
+        if (chain.size() == pattern.size())
+          subgraphs.push_back(chain);
+      }
+    break;
+  default:
+    break;
+  }
+  return subgraphs;
+}
+
+std::vector<KernelTask>
+SubgraphIsolation::isolate(const fs::path &model_text_filepath,
+                           const std::set<std::string> &op_types,
+                           const FusionSpec &fusion,
+                           const fs::path &lowering_folder) {
+  std::vector<KernelTask> tasks;
+  if (fusion.granularity == FusionGranularity::OP)
+    return tasks;
+
+  ForwardFunction function;
+  {
+    MappedFile model_text(model_text_filepath);
+    if (!model_text.valid() ||
+        !parse_forward(model_text.view(), op_types, function)) {
+      std::cerr << "No forward function in " << model_text_filepath
+                << ", no subgraphs are isolated\n";
+      return tasks;
+    }
+  }
+
+  // Occurrence of each isolated op among the ops of its type
+  std::map<size_t, size_t> occurrence;
+  {
+    std::map<std::string, size_t> counts;
+    for (size_t i = 0; i < function.ops.size(); i++)
+      if (function.ops[i].compute)
+        occurrence[i] = counts[function.ops[i].name]++;
+  }
+
+  std::map<std::string, size_t> by_text; // kernel text -> task
+  std::map<std::string, size_t> per_name;
+  json subgraphs = json::array();
+  size_t skipped = 0;
+  for (const std::vector<size_t> &members :
+       find_subgraphs(function, fusion)) {
+    std::string kernel;
+    if (!emit_subgraph(function, members, kernel)) {
+      skipped++;
+      continue;
+    }
+    json occurrence_ops = json::array();
+    for (size_t member : members)
+      occurrence_ops.push_back({{"op", "torch." + function.ops[member].name},
+                                {"occurrence", occurrence[member]}});
+
+    auto known = by_text.find(kernel);
+    if (known != by_text.end()) {
+      tasks[known->second].multiplicity++;
+      subgraphs[known->second]["occurrences"].push_back(occurrence_ops);
+      continue;
+    }
+
+    std::string name, op_type;
+    json ops = json::array();
+    for (size_t member : members) {
+      const std::string &op = function.ops[member].name;
+      name += (name.empty() ? "" : "+") +
+              (op.rfind("aten.", 0) == 0 ? op.substr(5) : op);
+      op_type += (op_type.empty() ? "" : "+") + op;
+      ops.push_back(op);
+    }
+    fs::path folder =
+        fs::path(lowering_folder).append("subgraphs").append(name);
+    std::error_code ec;
+    fs::create_directories(folder, ec);
+
+    KernelTask task;
+    task.op_type = op_type;
+    task.mlir_filepath =
+        fs::path(folder).append(std::to_string(per_name[name]++) + ".mlir");
+    task.json_filepath = fs::path(task.mlir_filepath).concat(".json");
+    std::ofstream(task.mlir_filepath) << kernel;
+    json metadata;
+    if (!KernelMetadata::extract_from_kernel(task.mlir_filepath, metadata)) {
+      skipped++;
+      continue;
+    }
+    std::ofstream(task.json_filepath) << metadata.dump(2);
+    task.metadata_ready = true;
+    task.shape_variant = "fused";
+    task.fused = true;
+
+    by_text[kernel] = tasks.size();
+    tasks.push_back(task);
+    subgraphs.push_back(
+        {{"kernel", task.mlir_filepath.lexically_relative(lowering_folder)
+                        .generic_string()},
+         {"ops", ops},
+         {"occurrences", json::array({occurrence_ops})}});
+  }
+
+  fs::path manifest = SubgraphIsolation::manifest_filepath(lowering_folder);
+  std::ofstream(manifest) << json({{"granularity",
+                                    SubgraphIsolation::describe(fusion)},
+                                   {"subgraphs", subgraphs}})
+                                 .dump(2)
+                          << "\n";
+  if (skipped)
+    std::cout << skipped
+              << " subgraphs pass non-tensor values across their boundary "
+                 "and were skipped\n";
+  return tasks;
+}
+
+std::vector<std::vector<KernelInput>>
+SubgraphIsolation::kernel_inputs(const fs::path &model_text_filepath,
+                                 const std::set<std::string> &op_types) {
+  std::vector<std::vector<KernelInput>> layers;
+  ForwardFunction function;
+  {
+    MappedFile model_text(model_text_filepath);
+    if (!model_text.valid() ||
+        !parse_forward(model_text.view(), op_types, function)) {
+      std::cerr << "No forward function in " << model_text_filepath
+                << ", no kernel inputs are traced\n";
+      return layers;
+    }
+  }
+
+  // Layer index of each isolated op
+  std::map<size_t, long> layer_of;
+  for (size_t i = 0; i < function.ops.size(); i++)
+    if (function.ops[i].compute)
+      layer_of[i] = static_cast<long>(layer_of.size());
+
+  for (const auto &[index, layer] : layer_of) {
+    std::set<size_t> copied;
+    std::vector<std::string> values;
+    std::vector<KernelInput> inputs;
+    if (gather_inputs(function, {index}, copied, values))
+      for (const std::string &value : values) {
+        KernelInput input;
+        input.value = value;
+        auto definition = function.definitions.find(value);
+        if (definition != function.definitions.end() &&
+            function.ops[definition->second].compute) {
+          const ModelOp &producer = function.ops[definition->second];
+          input.producer = layer_of.at(definition->second);
+          input.result = std::find(producer.results.begin(),
+                                   producer.results.end(), value) -
+                         producer.results.begin();
+        }
+        inputs.push_back(input);
+      }
+    layers.push_back(inputs);
+  }
+  return layers;
+}
+
+bool SubgraphIsolation::write_opportunities(
+    const std::vector<KernelTask> &tasks,
+    const std::vector<KernelTask> &variants, const std::string &metric,
+    const fs::path &lowering_folder, const fs::path &csv_filepath) {
+  fs::path manifest_filepath =
+      SubgraphIsolation::manifest_filepath(lowering_folder);
+  fs::path layers_filepath = ModelLayers::filepath(lowering_folder);
+  if (!fs::exists(manifest_filepath) || !fs::exists(layers_filepath)) {
+    std::cerr << "No subgraph manifest or model layers, fusion "
+                 "opportunities are not ranked\n";
+    return false;
+  }
+  json manifest = load_json_from_file(manifest_filepath);
+  json model_layers = load_json_from_file(layers_filepath);
+
+  // Measured value of every kernel file, duplicates share their
+  // representative's
+  std::map<std::string, double> values;
+  auto relative = [&lowering_folder](const fs::path &filepath) {
+    return filepath.lexically_relative(lowering_folder).generic_string();
+  };
+  auto record = [&](const KernelTask &task) {
+    auto value = task.average_metrics.find(metric);
+    if (value == task.average_metrics.end())
+      return;
+    values[relative(task.mlir_filepath)] = value->second;
+    for (const fs::path &duplicate : task.duplicate_filepaths)
+      values[relative(duplicate)] = value->second;
+  };
+  for (const KernelTask &task : tasks)
+    record(task);
+  for (const KernelTask &task : variants)
+    if (task.fused)
+      record(task);
+
+  // Kernel and name of the n-th layer of every op type
+  std::map<std::string, std::pair<std::string, std::string>> layers;
+  {
+    std::map<std::string, size_t> counts;
+    for (const json &layer : model_layers.value("layers", json::array())) {
+      std::string op = layer.value("op", "");
+      layers[op + "#" + std::to_string(counts[op]++)] = {
+          layer.value("kernel", ""), layer.value("name", "")};
+    }
+  }
+
+  struct Row {
+    std::string subgraph, kernel, layers;
+    size_t occurrences = 0;
+    double fused = 0.0, parts = 0.0;
+    double saved() const { return parts - fused; }
+    double saved_total() const { return saved() * occurrences; }
+  };
+  std::vector<Row> rows;
+  for (const json &subgraph : manifest.value("subgraphs", json::array())) {
+    Row row;
+    row.kernel = subgraph.value("kernel", "");
+    auto fused = values.find(row.kernel);
+    if (fused == values.end())
+      continue;
+    row.fused = fused->second;
+    for (const json &op : subgraph.value("ops", json::array()))
+      row.subgraph += (row.subgraph.empty() ? "" : "+") + op.get<std::string>();
+
+    double parts = 0.0;
+    for (const json &occurrence :
+         subgraph.value("occurrences", json::array())) {
+      double sum = 0.0;
+      std::string names;
+      bool complete = true;
+      for (const json &member : occurrence) {
+        auto layer = layers.find(
+            member.value("op", "") + "#" +
+            std::to_string(member.value("occurrence", size_t(0))));
+        auto value = layer == layers.end() ? values.end()
+                                           : values.find(layer->second.first);
+        if (value == values.end()) {
+          complete = false;
+          break;
+        }
+        sum += value->second;
+        names += (names.empty() ? "" : "+") + layer->second.second;
+      }
+      if (!complete)
+        continue;
+      if (row.layers.empty())
+        row.layers = names;
+      parts += sum;
+      row.occurrences++;
+    }
+    if (!row.occurrences)
+      continue;
+    row.parts = parts / row.occurrences;
+    rows.push_back(row);
+  }
+  if (rows.empty()) {
+    std::cerr << "No subgraph has measurements for itself and its ops, "
+                 "fusion opportunities are not ranked\n";
+    return false;
+  }
+  std::stable_sort(rows.begin(), rows.end(), [](const Row &a, const Row &b) {
+    return a.saved_total() > b.saved_total();
+  });
+
+  std::ofstream csv(csv_filepath);
+  if (!csv.is_open()) {
+    std::cerr << "Error: Could not open " << csv_filepath
+              << " for writing.\n";
+    return false;
+  }
+  csv << "rank,subgraph,kernel,occurrences,layers,metric,fused,parts,saved,"
+         "saved_total,speedup\n";
+  for (size_t r = 0; r < rows.size(); r++) {
+    const Row &row = rows[r];
+    csv << (r + 1) << "," << row.subgraph << "," << row.kernel << ","
+        << row.occurrences << "," << row.layers << "," << metric << ","
+        << row.fused << "," << row.parts << "," << row.saved() << ","
+        << row.saved_total() << ","
+        << (row.fused > 0.0 ? row.parts / row.fused : 1.0) << "\n";
+  }
+
+  std::cout << "Top fusion opportunities by " << metric << " saved:\n";
+  for (size_t r = 0; r < std::min<size_t>(rows.size(), 5); r++)
+    std::cout << "  " << (r + 1) << ". " << rows[r].subgraph << " ("
+              << rows[r].layers << ", x" << rows[r].occurrences
+              << "): " << std::fixed << std::setprecision(1)
+              << rows[r].saved_total() << std::defaultfloat << "\n";
+  return true;
+}
@@ -0,0 +1,137 @@
+#include "target_spec.h"
+
+#include <iostream>
+#include <sstream>
+#include <sys/utsname.h>
+
+TargetSpec TargetInfo::from_pipeline_json(const json &pipeline) {
+  TargetSpec target;
+  if (pipeline.contains("target_cpu"))
+    target.requested_cpu = pipeline["target_cpu"].get<std::string>();
+  target.cpu = target.requested_cpu;
+
+  if (pipeline.contains("target_features")) {
+    std::stringstream ss(pipeline["target_features"].get<std::string>());
+    std::string feature;
+    while (std::getline(ss, feature, ',')) {
+      if (feature.empty())
+        continue;
+      // Accept both "avx2" and "+avx2"
+      if (feature.front() != '+' && feature.front() != '-')
+        feature = "+" + feature;
+      target.features.push_back(feature);
+    }
+  }
+
+  if (pipeline.contains("vector_width"))
+    target.vector_width = pipeline["vector_width"].get<unsigned int>();
+  if (pipeline.contains("target_triple"))
+    target.triple = pipeline["target_triple"].get<std::string>();
+  if (pipeline.contains("gpu_chip"))
+    target.gpu_chip = pipeline["gpu_chip"].get<std::string>();
+  return target;
+}
+
+std::string
+TargetInfo::parse_driver_target_cpu(const std::string &driver_output) {
+  const std::string marker = "\"-target-cpu\" \"";
+  size_t pos = driver_output.find(marker);
+  if (pos == std::string::npos)
+    return "";
+  pos += marker.size();
+  size_t end = driver_output.find('"', pos);
+  if (end == std::string::npos)
+    return "";
+  return driver_output.substr(pos, end - pos);
+}
+
+// Triple spellings of the same architecture
+static std::string normalize_architecture(const std::string &architecture) {
+  if (architecture == "arm64")
+    return "aarch64";
+  if (architecture == "amd64")
+    return "x86_64";
+  return architecture;
+}
+
+std::string TargetInfo::host_architecture() {
+  struct utsname system;
+  if (uname(&system) != 0)
+    return "";
+  return normalize_architecture(system.machine);
+}
+
+std::string TargetInfo::architecture(const TargetSpec &target) {
+  if (target.triple.empty())
+    return TargetInfo::host_architecture();
+  return normalize_architecture(
+      target.triple.substr(0, target.triple.find('-')));
+}
+
+bool TargetInfo::is_cross(const TargetSpec &target) {
+  return !target.triple.empty() &&
+         TargetInfo::architecture(target) != TargetInfo::host_architecture();
+}
+
+bool TargetInfo::has_x86_vector_extensions(const TargetSpec &target) {
+  std::string architecture = TargetInfo::architecture(target);
+  if (architecture != "x86_64" && architecture != "i386" &&
+      architecture != "i686")
+    return false;
+  for (const std::string &feature : target.features) {
+    if (feature == "-avx2" || feature == "-avx512f")
+      return false;
+    if (feature == "+avx2" || feature.rfind("+avx512", 0) == 0)
+      return true;
+  }
+
+#if defined(__x86_64__) || defined(__i386__)
+  if (target.requested_cpu == "native" && !TargetInfo::is_cross(target))
+    return __builtin_cpu_supports("avx2") || __builtin_cpu_supports("avx512f");
+#endif
+  return false;
+}
+
+std::string TargetInfo::compile_flags(const TargetSpec &target) {
+  std::string flags;
+  if (!target.triple.empty())
+    flags += " --target=" + target.triple;
+  // AArch64 names CPUs with -mcpu, -march there takes an ISA version
+  bool aarch64 = TargetInfo::architecture(target) == "aarch64";
+  if (!(TargetInfo::is_cross(target) && target.cpu == "native"))
+    flags += (aarch64 ? " -mcpu=" : " -march=") + target.cpu;
+  if (target.vector_width)
+    flags += " -mprefer-vector-width=" + std::to_string(target.vector_width);
+  // Passed to cc1 directly, the driver has no generic feature flag
+  for (const std::string &feature : target.features)
+    flags += " -Xclang -target-feature -Xclang " + feature;
+  return flags;
+}
+
+void TargetInfo::apply_to_pass_list(const TargetSpec &target,
+                                    std::vector<std::string> &pass_list) {
+  std::string option;
+  if (TargetInfo::has_x86_vector_extensions(target))
+    option = "enable-x86vector";
+  else if (TargetInfo::architecture(target) == "aarch64")
+    for (const std::string &feature : target.features)
+      if (feature == "+sve")
+        option = "enable-arm-sve";
+  if (option.empty())
+    return;
+
+  // Passes with explicit options are left as the pipeline author wrote them
+  for (std::string &pass : pass_list)
+    if (pass == "convert-vector-to-llvm")
+      pass = "convert-vector-to-llvm=\"" + option + "\"";
+}
+
+std::string TargetInfo::features_string(const TargetSpec &target) {
+  if (target.features.empty())
+    return "default";
+
+  std::string features;
+  for (const std::string &feature : target.features)
+    features += (features.empty() ? "" : ";") + feature;
+  return features;
+}
@@ -0,0 +1,461 @@
+#include "telemetry.h"
+#include "compile_cache.h"
+#include "fork_gate.h"
+#include "utils.h"
+
+#include "nlohmann/json.hpp"
+
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
+using json = nlohmann::json;
+using steady_clock = std::chrono::steady_clock;
+
+namespace {
+
+std::atomic<bool> running{false};
+std::atomic<size_t> total{0};
+std::atomic<size_t> measured{0};
+std::atomic<size_t> failed{0};
+std::atomic<size_t> compile_failed{0};
+std::atomic<size_t> reused{0};
+std::atomic<size_t> skipped{0};
+std::atomic<size_t> compiled_ok{0};
+std::atomic<size_t> samples{0};
+
+std::string run_name;
+double interval_seconds = 10.0;
+steady_clock::time_point started;
+// Elapsed seconds at the first kernel to finish, the ETA's rate starts there
+std::atomic<double> first_done{-1.0};
+
+// Sinks and the latest progress object, under sink_mutex
+std::mutex sink_mutex;
+std::ofstream progress_file;
+int progress_socket = -1;
+std::string current_stage;
+json last_progress = json::object();
+
+int listen_fd = -1;
+std::thread emitter;
+std::thread listener;
+std::mutex wake_mutex;
+std::condition_variable wake;
+bool stopping = false;
+
+double elapsed_seconds() {
+  return std::chrono::duration<double>(steady_clock::now() - started).count();
+}
+
+// Caller holds sink_mutex
+void emit_locked(const json &event) {
+  std::string line = event.dump() + "\n";
+  if (progress_file.is_open())
+    progress_file << line << std::flush;
+  if (progress_socket >= 0 &&
+      send(progress_socket, line.data(), line.size(), MSG_NOSIGNAL) < 0) {
+    std::cerr << "Progress socket closed: " << std::strerror(errno)
+              << ", no more progress events there\n";
+    close(progress_socket);
+    progress_socket = -1;
+  }
+}
+
+void emit(const json &event) {
+  std::lock_guard<std::mutex> lock(sink_mutex);
+  emit_locked(event);
+}
+
+size_t done() {
+  return measured + failed + compile_failed + reused + skipped;
+}
+
+double hit_rate(uint64_t hits, uint64_t misses) {
+  return hits + misses ? static_cast<double>(hits) / (hits + misses) : 0.0;
+}
+
+// Throughput against the previous call, emitter thread only
+json progress(double &previous_time, size_t &previous_compiled,
+              size_t &previous_measured, size_t &previous_samples) {
+  double now = elapsed_seconds();
+  double window = std::max(now - previous_time, 1e-9);
+  size_t compiled_now = compiled_ok + compile_failed;
+  size_t measured_now = measured + failed;
+  size_t samples_now = samples;
+
+  json eta = nullptr;
+  size_t finished = done(), left = total > finished ? total - finished : 0;
+  if (first_done >= 0.0) {
+    double since_first = now - first_done;
+    // Kernels finished after the first one, over the time they took
+    size_t timed = finished - reused - skipped;
+    size_t after_first = timed > 1 ? timed - 1 : 0;
+    if (after_first > 0 && since_first > 0.0)
+      eta = left * since_first / after_first;
+  }
+  if (left == 0 && total > 0)
+    eta = 0.0;
+
+  CompileCacheCounts cache = CompileCache::counts();
+  json event = {
+      {"event", "progress"},
+      {"time", get_timestamp_string()},
+      {"elapsed", now},
+      {"stage", current_stage},
+      {"kernels",
+       {{"total", total.load()},
+        {"done", finished},
+        {"measured", measured.load()},
+        {"failed", failed.load()},
+        {"compile_failed", compile_failed.load()},
+        {"reused", reused.load()},
+        {"skipped_budget", skipped.load()},
+        {"compiled", compiled_ok.load()}}},
+      {"samples", samples_now},
+      {"rates",
+       {{"compiled_per_s", (compiled_now - previous_compiled) / window},
+        {"measured_per_s", (measured_now - previous_measured) / window},
+        {"samples_per_s", (samples_now - previous_samples) / window}}},
+      {"eta_seconds", eta},
+      {"compile_cache",
+       {{"lowering_hits", cache.lowering_hits},
+        {"lowering_misses", cache.lowering_misses},
+        {"lowering_hit_rate",
+         hit_rate(cache.lowering_hits, cache.lowering_misses)},
+        {"object_hits", cache.object_hits},
+        {"object_misses", cache.object_misses},
+        {"object_hit_rate",
+         hit_rate(cache.object_hits, cache.object_misses)}}}};
+  previous_time = now;
+  previous_compiled = compiled_now;
+  previous_measured = measured_now;
+  previous_samples = samples_now;
+  return event;
+}
+
+void publish(json event) {
+  std::lock_guard<std::mutex> lock(sink_mutex);
+  last_progress = event;
+  emit_locked(event);
+}
+
+void emit_loop() {
+  double previous_time = 0.0;
+  size_t previous_compiled = 0, previous_measured = 0, previous_samples = 0;
+  std::unique_lock<std::mutex> lock(wake_mutex);
+  while (!stopping) {
+    wake.wait_for(lock, std::chrono::duration<double>(interval_seconds),
+                  [] { return stopping; });
+    if (stopping)
+      break;
+    lock.unlock();
+    {
+      ForkGate::Section section;
+      publish(progress(previous_time, previous_compiled, previous_measured,
+                       previous_samples));
+    }
+    lock.lock();
+  }
+  lock.unlock();
+  publish(progress(previous_time, previous_compiled, previous_measured,
+                   previous_samples));
+}
+
+// Prometheus text exposition format
+std::string metrics_text() {
+  std::ostringstream text;
+  auto metric = [&](const char *name, const char *type, const char *help) {
+    text << "# HELP mlir_bench_" << name << " " << help << "\n"
+         << "# TYPE mlir_bench_" << name << " " << type << "\n";
+  };
+  std::string run;
+  json last;
+  {
+    std::lock_guard<std::mutex> lock(sink_mutex);
+    run = run_name;
+    last = last_progress;
+  }
+  std::string label = "run=\"" + run + "\"";
+
+  metric("kernels_total", "gauge", "Kernels of the run");
+  text << "mlir_bench_kernels_total{" << label << "} " << total << "\n";
+  metric("kernels_done", "gauge", "Finished kernels by status");
+  for (auto [status, count] :
+       {std::pair<const char *, size_t>{"measured", measured},
+        {"failed", failed},
+        {"compile_failed", compile_failed},
+        {"reused", reused},
+        {"skipped_budget", skipped}})
+    text << "mlir_bench_kernels_done{" << label << ",status=\"" << status
+         << "\"} " << count << "\n";
+  metric("kernels_compiled_total", "counter", "Kernels compiled");
+  text << "mlir_bench_kernels_compiled_total{" << label << "} "
+       << compiled_ok << "\n";
+  metric("samples_total", "counter", "Samples collected");
+  text << "mlir_bench_samples_total{" << label << "} " << samples << "\n";
+  metric("elapsed_seconds", "gauge", "Seconds since the run started");
+  text << "mlir_bench_elapsed_seconds{" << label << "} " << elapsed_seconds()
+       << "\n";
+  if (last.contains("eta_seconds") && last["eta_seconds"].is_number()) {
+    metric("eta_seconds", "gauge", "Estimated seconds left");
+    text << "mlir_bench_eta_seconds{" << label << "} "
+         << last["eta_seconds"].get<double>() << "\n";
+  }
+  if (last.contains("rates")) {
+    metric("throughput", "gauge",
+           "Per stage throughput over the last progress interval");
+    for (const auto &[rate, value] : last["rates"].items())
+      text << "mlir_bench_throughput{" << label << ",rate=\"" << rate
+           << "\"} " << value.get<double>() << "\n";
+  }
+  CompileCacheCounts cache = CompileCache::counts();
+  metric("compile_cache_hits_total", "counter", "Compile cache hits");
+  text << "mlir_bench_compile_cache_hits_total{" << label
+       << ",cache=\"lowering\"} " << cache.lowering_hits << "\n"
+       << "mlir_bench_compile_cache_hits_total{" << label
+       << ",cache=\"object\"} " << cache.object_hits << "\n";
+  metric("compile_cache_misses_total", "counter", "Compile cache misses");
+  text << "mlir_bench_compile_cache_misses_total{" << label
+       << ",cache=\"lowering\"} " << cache.lowering_misses << "\n"
+       << "mlir_bench_compile_cache_misses_total{" << label
+       << ",cache=\"object\"} " << cache.object_misses << "\n";
+  return text.str();
+}
+
+// One request per connection, answered and closed
+void serve_connection(int fd) {
+  timeval timeout{1, 0};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  char buffer[2048];
+  ssize_t length = recv(fd, buffer, sizeof(buffer) - 1, 0);
+  std::string request = length > 0 ? std::string(buffer, length) : "";
+  std::string status = "200 OK", type, body;
+  if (request.rfind("GET /metrics", 0) == 0) {
+    type = "text/plain; version=0.0.4";
+    body = metrics_text();
+  } else if (request.rfind("GET /progress", 0) == 0) {
+    type = "application/json";
+    std::lock_guard<std::mutex> lock(sink_mutex);
+    body = last_progress.dump() + "\n";
+  } else {
+    status = "404 Not Found";
+    type = "text/plain";
+    body = "GET /metrics or /progress\n";
+  }
+  std::string response = "HTTP/1.0 " + status + "\r\nContent-Type: " + type +
+                         "\r\nContent-Length: " +
+                         std::to_string(body.size()) +
+                         "\r\nConnection: close\r\n\r\n" + body;
+  send(fd, response.data(), response.size(), MSG_NOSIGNAL);
+  close(fd);
+}
+
+void listen_loop() {
+  while (running) {
+    pollfd pending{listen_fd, POLLIN, 0};
+    if (poll(&pending, 1, 200) <= 0)
+      continue;
+    int fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+    if (fd >= 0) {
+      ForkGate::Section section;
+      serve_connection(fd);
+    }
+  }
+}
+
+bool open_listener(const std::string &listen) {
+  std::string host = "127.0.0.1", port = listen;
+  size_t colon = listen.rfind(':');
+  if (colon != std::string::npos) {
+    host = listen.substr(0, colon);
+    port = listen.substr(colon + 1);
+  }
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  char *end = nullptr;
+  long port_number = std::strtol(port.c_str(), &end, 10);
+  if (port.empty() || *end || port_number <= 0 || port_number > 65535 ||
+      inet_pton(AF_INET, host.c_str(), &address.sin_addr) != 1) {
+    std::cerr << "Invalid --metrics-listen " << listen
+              << ", expected [ipv4-address:]port\n";
+    return false;
+  }
+  address.sin_port = htons(static_cast<uint16_t>(port_number));
+
+  listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  int reuse = 1;
+  setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+  if (listen_fd < 0 ||
+      bind(listen_fd, reinterpret_cast<sockaddr *>(&address),
+           sizeof(address)) != 0 ||
+      ::listen(listen_fd, 8) != 0) {
+    std::cerr << "Could not listen on " << listen << ": "
+              << std::strerror(errno) << "\n";
+    if (listen_fd >= 0)
+      close(listen_fd);
+    listen_fd = -1;
+    return false;
+  }
+  std::cout << "Metrics at http://" << host << ":" << port_number
+            << "/metrics\n";
+  return true;
+}
+
+bool open_progress(const std::string &progress) {
+  if (progress.rfind("unix:", 0) != 0) {
+    progress_file.open(progress, std::ios::app);
+    if (!progress_file.is_open()) {
+      std::cerr << "Error: Could not open " << progress
+                << " for progress events.\n";
+      return false;
+    }
+    return true;
+  }
+
+  std::string path = progress.substr(5);
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(address.sun_path)) {
+    std::cerr << "Progress socket path too long: " << path << "\n";
+    return false;
+  }
+  std::strcpy(address.sun_path, path.c_str());
+  progress_socket = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (progress_socket < 0 ||
+      connect(progress_socket, reinterpret_cast<sockaddr *>(&address),
+              sizeof(address)) != 0) {
+    std::cerr << "Could not connect to progress socket " << path << ": "
+              << std::strerror(errno) << "\n";
+    if (progress_socket >= 0)
+      close(progress_socket);
+    progress_socket = -1;
+    return false;
+  }
+  return true;
+}
+
+} // namespace
+
+bool Telemetry::start(const TelemetryConfig &config, int reserved_cpu,
+                      const std::string &run) {
+  if (running || (config.progress.empty() && config.metrics_listen.empty()))
+    return true;
+
+  total = measured = failed = compile_failed = reused = skipped =
+      compiled_ok = samples = 0;
+  first_done = -1.0;
+  started = steady_clock::now();
+  run_name = run;
+  current_stage.clear();
+  last_progress = json::object();
+  interval_seconds = config.interval_seconds > 0.0 ? config.interval_seconds
+                                                   : 10.0;
+  stopping = false;
+
+  bool ok = true;
+  if (!config.progress.empty())
+    ok &= open_progress(config.progress);
+  if (!config.metrics_listen.empty())
+    ok &= open_listener(config.metrics_listen);
+  if (!progress_file.is_open() && progress_socket < 0 && listen_fd < 0)
+    return false;
+
+  running = true;
+  emit({{"event", "start"}, {"run", run}, {"time", get_timestamp_string()}});
+  emitter = std::thread([reserved_cpu]() {
+    pin_current_thread_excluding(reserved_cpu);
+    emit_loop();
+  });
+  if (listen_fd >= 0)
+    listener = std::thread([reserved_cpu]() {
+      pin_current_thread_excluding(reserved_cpu);
+      listen_loop();
+    });
+  return ok;
+}
+
+void Telemetry::stop(const std::string &status) {
+  if (!running)
+    return;
+  {
+    std::lock_guard<std::mutex> lock(wake_mutex);
+    stopping = true;
+  }
+  wake.notify_all();
+  emitter.join();
+  emit({{"event", "finished"},
+        {"status", status},
+        {"elapsed", elapsed_seconds()}});
+
+  running = false;
+  if (listener.joinable())
+    listener.join();
+  if (listen_fd >= 0)
+    close(listen_fd);
+  listen_fd = -1;
+  std::lock_guard<std::mutex> lock(sink_mutex);
+  if (progress_file.is_open())
+    progress_file.close();
+  if (progress_socket >= 0)
+    close(progress_socket);
+  progress_socket = -1;
+}
+
+bool Telemetry::is_running() { return running; }
+
+void Telemetry::stage(const std::string &name) {
+  if (!running)
+    return;
+  std::lock_guard<std::mutex> lock(sink_mutex);
+  current_stage = name;
+  emit_locked({{"event", "stage"},
+               {"stage", name},
+               {"time", get_timestamp_string()},
+               {"elapsed", elapsed_seconds()}});
+}
+
+void Telemetry::set_total(size_t kernels) { total = kernels; }
+
+void Telemetry::compiled(bool ok) {
+  if (ok)
+    compiled_ok++;
+  else
+    compile_failed++;
+}
+
+void Telemetry::kernel_done(const KernelTask &task, const std::string &status,
+                            size_t sample_count) {
+  if (status == "measured")
+    measured++;
+  else if (status == "reused")
+    reused++;
+  else if (status == "failed")
+    failed++;
+  else if (status == "skipped_budget")
+    skipped++;
+  samples += sample_count;
+  if (!running)
+    return;
+  double unset = -1.0;
+  if (status != "reused" && status != "skipped_budget")
+    first_done.compare_exchange_strong(unset, elapsed_seconds());
+  emit({{"event", "kernel"},
+        {"kernel", task.mlir_filepath.filename().string()},
+        {"op_type", task.op_type},
+        {"status", status},
+        {"samples", sample_count},
+        {"elapsed", elapsed_seconds()}});
+}
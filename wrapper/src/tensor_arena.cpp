@@ -0,0 +1,165 @@
+#include "tensor_arena.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#include <sys/mman.h>
+
+static const uint64_t HUGE_PAGE_BYTES = 2ull << 20;
+static const uint64_t MIN_SLAB_BYTES = 64ull << 20;
+
+static uint64_t round_up(uint64_t value, uint64_t multiple) {
+  return (value + multiple - 1) / multiple * multiple;
+}
+
+TensorArena::TensorArena(const ArenaConfig &config) : m_config(config) {
+  if (m_config.alignment == 0 ||
+      (m_config.alignment & (m_config.alignment - 1)) != 0) {
+    std::cerr << "Buffer alignment " << m_config.alignment
+              << " is not a power of two, using 64 bytes\n";
+    m_config.alignment = 64;
+  }
+  // Slabs start on a huge page boundary, nothing larger can be honoured
+  m_config.alignment = std::min(m_config.alignment, HUGE_PAGE_BYTES);
+}
+
+TensorArena::~TensorArena() {
+  for (Slab &slab : m_slabs)
+    munmap(slab.mapping, slab.mapping_bytes);
+  release_untouched();
+}
+
+bool TensorArena::add_slab(uint64_t min_bytes) {
+  Slab slab;
+  slab.size = round_up(std::max(min_bytes, MIN_SLAB_BYTES), HUGE_PAGE_BYTES);
+
+  if (m_config.huge_pages == HugePageMode::HUGETLB) {
+    slab.mapping = mmap(nullptr, slab.size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (slab.mapping != MAP_FAILED) {
+      slab.mapping_bytes = slab.size;
+      slab.base = static_cast<uint8_t *>(slab.mapping);
+    } else {
+      std::cerr << "MAP_HUGETLB failed (" << std::strerror(errno)
+                << "), is vm.nr_hugepages set? Using regular pages\n";
+      m_config.huge_pages = HugePageMode::NONE;
+    }
+  }
+
+  if (!slab.base) {
+    // Over-map so that the slab itself can start on a huge page boundary
+    slab.mapping_bytes = slab.size + HUGE_PAGE_BYTES;
+    slab.mapping = mmap(nullptr, slab.mapping_bytes, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (slab.mapping == MAP_FAILED) {
+      std::cerr << "Failed to map a " << (slab.size >> 20)
+                << " MiB tensor slab: " << std::strerror(errno) << "\n";
+      return false;
+    }
+    uintptr_t start = reinterpret_cast<uintptr_t>(slab.mapping);
+    slab.base = reinterpret_cast<uint8_t *>(round_up(start, HUGE_PAGE_BYTES));
+#ifdef MADV_HUGEPAGE
+    if (m_config.huge_pages == HugePageMode::THP)
+      madvise(slab.base, slab.size, MADV_HUGEPAGE);
+#endif
+  }
+
+  NumaPlacement::bind(slab.base, slab.size, m_config.numa_policy,
+                      m_config.numa_nodes);
+
+  m_slabs.push_back(slab);
+  return true;
+}
+
+void *TensorArena::allocate(uint64_t bytes) {
+  bytes = std::max<uint64_t>(bytes, 1);
+  for (; m_current < m_slabs.size(); m_current++) {
+    Slab &slab = m_slabs[m_current];
+    uint64_t offset = round_up(slab.used, m_config.alignment);
+    if (offset + bytes <= slab.size) {
+      slab.used = offset + bytes;
+      return slab.base + offset;
+    }
+  }
+
+  // Slabs are huge page aligned, so a fresh one satisfies any alignment up to
+  // 2 MiB right away
+  if (!add_slab(round_up(bytes, m_config.alignment)))
+    return nullptr;
+  m_current = m_slabs.size() - 1;
+  Slab &slab = m_slabs.back();
+  slab.used = bytes;
+  return slab.base;
+}
+
+void *TensorArena::allocate_untouched(uint64_t bytes) {
+  Slab region;
+  region.size = round_up(std::max<uint64_t>(bytes, 1), HUGE_PAGE_BYTES);
+  // Page aligned already, alignments above a page need some slack
+  region.mapping_bytes =
+      region.size + (m_config.alignment > 4096 ? m_config.alignment : 0);
+  region.mapping = mmap(nullptr, region.mapping_bytes, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (region.mapping == MAP_FAILED) {
+    std::cerr << "Failed to map " << (region.size >> 20)
+              << " MiB of untouched zero pages: " << std::strerror(errno)
+              << "\n";
+    return nullptr;
+  }
+  uintptr_t start = reinterpret_cast<uintptr_t>(region.mapping);
+  region.base = reinterpret_cast<uint8_t *>(
+      round_up(start, std::max<uint64_t>(m_config.alignment, 1)));
+  region.used = bytes;
+#ifdef MADV_HUGEPAGE
+  if (m_config.huge_pages != HugePageMode::NONE)
+    madvise(region.base, region.size, MADV_HUGEPAGE);
+#endif
+
+  // The policy applies to the pages the kernel faults in later
+  NumaPlacement::bind(region.base, region.size, m_config.numa_policy,
+                      m_config.numa_nodes);
+
+  m_untouched.push_back(region);
+  return region.base;
+}
+
+void TensorArena::release_untouched() {
+  for (Slab &region : m_untouched)
+    munmap(region.mapping, region.mapping_bytes);
+  m_untouched.clear();
+}
+
+void TensorArena::reset() {
+  for (Slab &slab : m_slabs)
+    slab.used = 0;
+  m_current = 0;
+  release_untouched();
+}
+
+bool TensorArena::contains(const void *ptr) const {
+  const uint8_t *address = static_cast<const uint8_t *>(ptr);
+  for (const std::vector<Slab> *slabs : {&m_slabs, &m_untouched})
+    for (const Slab &slab : *slabs)
+      if (address >= slab.base && address < slab.base + slab.size)
+        return true;
+  return false;
+}
+
+uint64_t TensorArena::reserved_bytes() const {
+  uint64_t total = 0;
+  for (const Slab &slab : m_slabs)
+    total += slab.size;
+  return total;
+}
+
+std::string TensorArena::describe(HugePageMode mode) {
+  switch (mode) {
+  case HugePageMode::THP:
+    return "thp";
+  case HugePageMode::HUGETLB:
+    return "hugetlb";
+  default:
+    return "none";
+  }
+}
@@ -0,0 +1,178 @@
+#include "tensor_dump.h"
+#include "thread_pool.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <unistd.h>
+
+DumpCompression TensorDump::compression = DumpCompression::UNCOMPRESSED;
+int TensorDump::reserved_cpu = -1;
+
+namespace {
+/*
+ * Background writer of the current process. A forked measurement worker must
+ * not touch the writer it inherited (its mutex may be held by a thread which
+ * doesn't exist in the child), so each process starts its own.
+ */
+struct DumpWriter {
+  std::unique_ptr<ThreadPool> pool;
+  pid_t owner = 0;
+};
+
+DumpWriter &dump_writer() {
+  static DumpWriter writer;
+  return writer;
+}
+
+ThreadPool &writer_pool(int reserved_cpu) {
+  DumpWriter &writer = dump_writer();
+  if (writer.owner != getpid()) {
+    // Leaked on purpose, see above
+    writer.pool.release();
+    writer.pool = std::make_unique<ThreadPool>(1, reserved_cpu);
+    writer.owner = getpid();
+  }
+  return *writer.pool;
+}
+} // namespace
+
+DumpedTensor DumpedTensor::from(const std::string &name, MemRefArg &tensor) {
+  DumpedTensor dumped;
+  dumped.name = name;
+  dumped.type = tensor.m_elem_type;
+  dumped.shape.assign(tensor.m_desc->dimension,
+                      tensor.m_desc->dimension + tensor.get_tensor_rank());
+  dumped.strides.assign(tensor.m_desc->strides,
+                        tensor.m_desc->strides + tensor.get_tensor_rank());
+  dumped.offset = tensor.m_desc->offset;
+  dumped.data = tensor.dense_copy();
+  return dumped;
+}
+
+void TensorDump::configure(DumpCompression compression, int reserved_cpu) {
+  TensorDump::compression = compression;
+  TensorDump::reserved_cpu = reserved_cpu;
+}
+
+void TensorDump::submit(const fs::path &directory, const std::string &kernel,
+                        std::vector<DumpedTensor> tensors) {
+  auto shared_tensors =
+      std::make_shared<std::vector<DumpedTensor>>(std::move(tensors));
+  writer_pool(TensorDump::reserved_cpu)
+      .submit([directory, kernel, shared_tensors]() {
+        TensorDump::write_dump(directory, kernel, *shared_tensors);
+      });
+}
+
+void TensorDump::flush() {
+  DumpWriter &writer = dump_writer();
+  if (writer.pool && writer.owner == getpid())
+    writer.pool->wait();
+}
+
+std::string TensorDump::npy_descr(ElementType type) {
+  switch (type) {
+  case ElementType::F16:
+    return "<f2";
+  case ElementType::BF16:
+    return "<u2";
+  case ElementType::F64:
+    return "<f8";
+  case ElementType::I1:
+    return "|b1";
+  case ElementType::I8:
+    return "|i1";
+  case ElementType::U8:
+    return "|u1";
+  case ElementType::I16:
+    return "<i2";
+  case ElementType::I32:
+    return "<i4";
+  case ElementType::I64:
+    return "<i8";
+  default:
+    return "<f4";
+  }
+}
+
+std::string TensorDump::describe(DumpCompression compression) {
+  switch (compression) {
+  case DumpCompression::GZIP:
+    return "gzip";
+  case DumpCompression::ZSTD:
+    return "zstd";
+  default:
+    return "none";
+  }
+}
+
+bool TensorDump::write_npy(const fs::path &filepath,
+                           const DumpedTensor &tensor) {
+  // Python tuple: (), (4,) or (2, 3)
+  std::string shape = "(";
+  for (size_t i = 0; i < tensor.shape.size(); i++)
+    shape += (i ? ", " : "") + std::to_string(tensor.shape[i]);
+  if (tensor.shape.size() == 1)
+    shape += ",";
+  shape += ")";
+
+  std::string header = "{'descr': '" + TensorDump::npy_descr(tensor.type) +
+                       "', 'fortran_order': False, 'shape': " + shape + ", }";
+  // Magic (6) + version (2) + length (2) + header, padded to 64 bytes with a
+  // trailing newline
+  size_t unpadded = 10 + header.size() + 1;
+  header.append((64 - unpadded % 64) % 64, ' ');
+  header += '\n';
+
+  std::ofstream npy(filepath, std::ios::binary | std::ios::trunc);
+  npy.write("\x93NUMPY\x01\x00", 8);
+  uint16_t header_length = header.size();
+  char length_bytes[2] = {char(header_length & 0xff),
+                          char(header_length >> 8)};
+  npy.write(length_bytes, 2);
+  npy << header;
+  npy.write(reinterpret_cast<const char *>(tensor.data.data()),
+            tensor.data.size());
+  return npy.good();
+}
+
+void TensorDump::write_dump(const fs::path &directory,
+                            const std::string &kernel,
+                            const std::vector<DumpedTensor> &tensors) {
+  std::error_code ec;
+  fs::create_directories(directory, ec);
+
+  static const char *suffixes[] = {"", ".gz", ".zst"};
+  json manifest = {{"kernel", kernel},
+                   {"compression",
+                    TensorDump::describe(TensorDump::compression)},
+                   {"tensors", json::array()}};
+
+  for (const DumpedTensor &tensor : tensors) {
+    fs::path npy_filepath = fs::path(directory).append(tensor.name + ".npy");
+    if (!TensorDump::write_npy(npy_filepath, tensor)) {
+      std::cerr << "Failed to write " << npy_filepath << "\n";
+      continue;
+    }
+
+    std::string quoted = "'" + npy_filepath.generic_string() + "'";
+    if (TensorDump::compression == DumpCompression::GZIP)
+      std::system(("gzip -f " + quoted).c_str());
+    else if (TensorDump::compression == DumpCompression::ZSTD)
+      std::system(("zstd -q -f --rm " + quoted).c_str());
+
+    manifest["tensors"].push_back(
+        {{"name", tensor.name},
+         {"file", tensor.name + ".npy" + suffixes[TensorDump::compression]},
+         {"dtype", ElementTypes::describe(tensor.type)},
+         {"shape", tensor.shape},
+         {"strides", tensor.strides},
+         {"offset", tensor.offset}});
+  }
+
+  std::ofstream manifest_stream(fs::path(directory).append("manifest.json"));
+  manifest_stream << manifest.dump(2) << "\n";
+}
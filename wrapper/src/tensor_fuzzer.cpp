@@ -1,18 +1,57 @@
 #pragma once
 #include "tensor_fuzzer.h"
+#include "numa_placement.h"
+#include "utils.h"
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
 #include <chrono>
 #include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <type_traits>
 #include <iostream>
+#include <limits>
 
-void applyTimeSeed() {
+unsigned int TensorFuzzer::worker_count = 1;
+int TensorFuzzer::reserved_cpu = -1;
 
-  // Returns the current no of clock ticks based on current time since last
-  // epoch
-  unsigned int current_clock =
-      std::chrono::system_clock::now().time_since_epoch().count();
+// Elements generated per vectorised block, and per worker at the very least
+static const uint64_t BLOCK_ELEMS = 1024;
+static const uint64_t MIN_ELEMS_PER_WORKER = 1ull << 20;
+// Largest unit count pruned to an exact density
+static const uint64_t MAX_EXACT_UNITS = 1ull << 24;
+// Counter of the pruning stream, next to the value stream of the same key
+static const uint64_t SPARSITY_STREAM = 0x5350415253450000ULL;
 
-  // We use this as a psuedo-random seed
-  std::srand(current_clock);
+/*
+ * Key of a tensor's random stream. Fixed seeds make inputs identical across
+ * runs (e.g. for verification), 0 draws a fresh key from the clock.
+ */
+static uint64_t stream_key(const uint64_t &seed) {
+  if (seed != 0)
+    return seed;
+
+  // Tensors generated within the same clock tick still get distinct streams
+  static std::atomic<uint64_t> stream_counter{0};
+  return std::chrono::system_clock::now().time_since_epoch().count() ^
+         (++stream_counter * 0xD1B54A32D192ED03ULL);
+}
+
+/*
+ * SplitMix64 finaliser over (key, counter): a bijective mix, so consecutive
+ * counters give independent looking 64 bit values
+ */
+static inline uint64_t counter_hash(uint64_t key, uint64_t counter) {
+  uint64_t x = key + counter * 0x9E3779B97F4A7C15ULL;
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+  return x ^ (x >> 31);
+}
+
+// Uniform in [0, 1) with the 24 bits of precision a float holds
+static inline float uniform_at(uint64_t key, uint64_t counter) {
+  return static_cast<float>(counter_hash(key, counter) >> 40) * 0x1p-24f;
 }
 
 /*
@@ -24,13 +63,9 @@ void applyTimeSeed() {
 DataFormatInfo::DataFormatInfo(const DataProfile &profile,
                                const float &sparsity_percentage) {
   m_profile = profile;
-
-  // NOTE: Not applicable as of now
-  // if (profile == DataProfile::SPARSE) {
-  //   SparsityProfile sp;
-  //   sp.sparsity_percentage = sparsity_percentage;
-  //   // sp.distribution_type =
-  // }
+  m_sp_profile.sparsity_percentage = sparsity_percentage;
+  // RANDOM draws from [-1, 1) unless a range is set
+  setRange(-1.f, 1.f);
 }
 
 DataFormatInfo::F32Range DataFormatInfo::getRange() {
@@ -46,83 +81,661 @@ void DataFormatInfo::setElemCount(const uint64_t &elem_count) {
   m_elem_count = elem_count;
 }
 
+void DataFormatInfo::setElemType(const ElementType &elem_type) {
+  m_elem_type = elem_type;
+}
+
+void DataFormatInfo::setRowLength(const uint64_t &row_length) {
+  m_row_length = row_length;
+}
+
+void DataFormatInfo::setSeed(const uint64_t &seed) { m_seed = seed; }
+
+void DataFormatInfo::setProfile(const DataProfile &profile) {
+  m_profile = profile;
+}
+
+void DataFormatInfo::setSparsity(const SparsityProfile &sparsity) {
+  m_sp_profile = sparsity;
+}
+
+void DataFormatInfo::setInputProfile(const InputProfile &input) {
+  setProfile(input.profile);
+  setSparsity(input.sparsity);
+}
+
+void DataFormatInfo::setDataOrder(const DataOrder &order,
+                                  const std::vector<uint64_t> &stored_dims) {
+  m_order = order;
+  m_stored_dims = stored_dims;
+}
+
+void DataFormatInfo::setStats(const std::shared_ptr<const TensorStats> &stats) {
+  m_stats = stats;
+}
+
+/*
+ * -----------------------------------
+ * Element conversions
+ * -----------------------------------
+ */
+namespace {
+// Storage tags for the 16 bit float formats
+struct Half {
+  uint16_t bits;
+};
+struct BFloat16 {
+  uint16_t bits;
+};
+struct Bool {
+  uint8_t value;
+};
+
+const float INTEGER_NORM_RANGE = 16.f;
+
+template <typename T> T to_element(float value) {
+  if constexpr (std::is_floating_point_v<T>)
+    return static_cast<T>(value);
+  else
+    return static_cast<T>(std::lround(value));
+}
+template <> Half to_element<Half>(float value) {
+  return Half{ElementTypes::float_to_half(value)};
+}
+template <> BFloat16 to_element<BFloat16>(float value) {
+  return BFloat16{ElementTypes::float_to_bfloat16(value)};
+}
+template <> Bool to_element<Bool>(float value) {
+  return Bool{static_cast<uint8_t>(value >= 0.5f)};
+}
+
+// Special values are built in double, f64 inputs keep their full range
+template <typename T> T to_storage(double value) {
+  if constexpr (std::is_same_v<T, double>)
+    return value;
+  else
+    return to_element<T>(static_cast<float>(value));
+}
+
+// Largest finite and smallest normal magnitude of the float storage types
+template <typename T> struct FloatLimits {
+  static constexpr bool is_float = false;
+};
+template <> struct FloatLimits<float> {
+  static constexpr bool is_float = true;
+  static constexpr double max = FLT_MAX, min_normal = FLT_MIN;
+};
+template <> struct FloatLimits<double> {
+  static constexpr bool is_float = true;
+  static constexpr double max = DBL_MAX, min_normal = DBL_MIN;
+};
+template <> struct FloatLimits<Half> {
+  static constexpr bool is_float = true;
+  static constexpr double max = 65504.0, min_normal = 0x1p-14;
+};
+template <> struct FloatLimits<BFloat16> {
+  static constexpr bool is_float = true;
+  static constexpr double max = 0x1.fep127, min_normal = FLT_MIN;
+};
+} // namespace
+
 /*
  * -----------------------------------
  * TensorFuzzer definitions
  * -----------------------------------
  */
-float *TensorFuzzer::generate_zero_data(DataFormatInfo info) {
-  uint64_t elem_count = info.m_elem_count;
-  float *array = (float *)calloc(elem_count, sizeof(float));
-  return array;
+void TensorFuzzer::generate_zero_data(DataFormatInfo info, void *array) {
+  // Written (and faulted in) by the node's workers, like the random data
+  uint64_t elem_size = ElementTypes::size(info.m_elem_type);
+  uint8_t *bytes = static_cast<uint8_t *>(array);
+  parallel_fill(info.m_elem_count, [&](uint64_t begin, uint64_t end) {
+    std::memset(bytes + begin * elem_size, 0, (end - begin) * elem_size);
+  });
 }
 
-float *TensorFuzzer::generate_random_data(DataFormatInfo info) {
-  uint64_t elem_count = info.m_elem_count;
+/*
+ * Values of [begin, end) as range_min + range_length * U[0, 1). Drawn a block
+ * at a time, so the hash loop vectorises independently of the conversion.
+ */
+template <typename T>
+static void fill_uniform(T *array, uint64_t key, uint64_t begin, uint64_t end,
+                         float range_min, float range_length) {
+  float values[BLOCK_ELEMS];
+  for (uint64_t block = begin; block < end; block += BLOCK_ELEMS) {
+    uint64_t count = std::min(BLOCK_ELEMS, end - block);
+    for (uint64_t j = 0; j < count; j++)
+      values[j] = range_min + range_length * uniform_at(key, block + j);
+    for (uint64_t j = 0; j < count; j++)
+      array[block + j] = to_element<T>(values[j]);
+  }
+}
+
+template <typename T>
+void TensorFuzzer::generate_random_data(DataFormatInfo info, T *array) {
   float range_min = info.getRange().min_val;
   float range_max = info.getRange().max_val;
-
   float range_length = range_max - range_min;
+  uint64_t key = stream_key(info.m_seed);
 
-  float *array = (float *)malloc(elem_count * sizeof(float));
-  applyTimeSeed(); // Initialises the Psuedo Random Generator
+  TensorFuzzer::parallel_fill(
+      info.m_elem_count, [&](uint64_t begin, uint64_t end) {
+        fill_uniform(array, key, begin, end, range_min, range_length);
+      });
+}
 
-  for (int i = 0; i < elem_count; i++) {
-    float norm_scale = (float)std::rand() / RAND_MAX;
-    float value = range_min + (range_length * norm_scale);
-    array[i] = value;
+/*
+ * Generates data with values in the range of 0 - 1 (0 - 16 for integers)
+ */
+template <typename T>
+void TensorFuzzer::generate_random_data_norm(DataFormatInfo info, T *array) {
+  float scale = std::is_integral_v<T> ? INTEGER_NORM_RANGE : 1.f;
+  uint64_t key = stream_key(info.m_seed);
+
+  TensorFuzzer::parallel_fill(info.m_elem_count,
+                              [&](uint64_t begin, uint64_t end) {
+                                fill_uniform(array, key, begin, end, 0.f,
+                                             scale);
+                              });
+}
+
+/*
+ * Unit of element i and the unit count of a pattern, see SparsityProfile
+ */
+struct SparsityUnits {
+  SparsityDist distribution;
+  uint64_t block;
+  uint64_t row_length;
+  uint64_t col_units; // Column blocks per row of tiles
+
+  uint64_t unit_of(uint64_t i) const {
+    uint64_t row = i / row_length, col = i % row_length;
+    switch (distribution) {
+    case STRUCTURED_ROW_WISE:
+      return row / block;
+    case STRUCTURED_COL_WISE:
+      return col / block;
+    case UNSTRUCTURED_TILE_1D:
+      return i / block;
+    case UNSTRUCTURED_TILE_2D:
+      return (row / block) * col_units + col / block;
+    case UNSTRUCTURED_DIAGONALS:
+      return ((col + row_length - row % row_length) % row_length) / block;
+    case UNSTRUCTURED_PURE:
+    default:
+      return i;
+    }
   }
-  return array;
+
+  uint64_t count(uint64_t elem_count) const {
+    uint64_t rows = (elem_count + row_length - 1) / row_length;
+    switch (distribution) {
+    case STRUCTURED_ROW_WISE:
+      return (rows + block - 1) / block;
+    case STRUCTURED_COL_WISE:
+    case UNSTRUCTURED_DIAGONALS:
+      return col_units;
+    case UNSTRUCTURED_TILE_1D:
+      return (elem_count + block - 1) / block;
+    case UNSTRUCTURED_TILE_2D:
+      return (rows + block - 1) / block * col_units;
+    case UNSTRUCTURED_PURE:
+    default:
+      return elem_count;
+    }
+  }
+};
+
+/*
+ * Exactly round(sparsity * unit_count) units, the ones with the smallest
+ * hashes, so the density is exact even for a handful of rows
+ */
+static std::vector<uint8_t>
+select_pruned_units(uint64_t unit_count, float sparsity, uint64_t key) {
+  std::vector<uint64_t> order(unit_count);
+  for (uint64_t u = 0; u < unit_count; u++)
+    order[u] = u;
+  uint64_t pruned = std::min<uint64_t>(
+      unit_count, std::llround(double(sparsity) * unit_count));
+  std::nth_element(order.begin(), order.begin() + pruned, order.end(),
+                   [key](uint64_t a, uint64_t b) {
+                     return counter_hash(key, a) < counter_hash(key, b);
+                   });
+
+  std::vector<uint8_t> mask(unit_count, 0);
+  for (uint64_t u = 0; u < pruned; u++)
+    mask[order[u]] = 1;
+  return mask;
 }
 
 /*
- * Generates f32 data with values in the range of 0 - 1
+ * Dense normalised values, then the units of the distribution are zeroed
  */
-float *TensorFuzzer::generate_random_data_norm(DataFormatInfo info) {
-  uint64_t elem_count = info.m_elem_count;
+template <typename T>
+void TensorFuzzer::generate_sparse_data(DataFormatInfo info, T *array) {
+  // Values and pruning share one key, so a fixed seed fixes both
+  uint64_t key = stream_key(info.m_seed) | 1;
+  info.m_seed = key;
+  TensorFuzzer::generate_random_data_norm(info, array);
 
-  float *array = (float *)malloc(elem_count * sizeof(float));
-  applyTimeSeed(); // Initialises the Psuedo Random Generator
+  const SparsityProfile &sp = info.m_sp_profile;
+  float sparsity = std::clamp(sp.sparsity_percentage, 0.f, 1.f);
+  SparsityUnits units;
+  units.distribution = sp.distribution_type;
+  units.block = std::max<uint64_t>(1, sp.row_block_size);
+  units.row_length = info.m_row_length
+                         ? info.m_row_length
+                         : std::max<uint64_t>(1, info.m_elem_count);
+  units.col_units = (units.row_length + units.block - 1) / units.block;
 
-  for (int i = 0; i < elem_count; i++) {
-    float norm_scale = (float)std::rand() / RAND_MAX;
-    array[i] = norm_scale;
+  uint64_t prune_key = counter_hash(key, SPARSITY_STREAM);
+  uint64_t unit_count = units.count(info.m_elem_count);
+  std::vector<uint8_t> mask;
+  if (unit_count <= MAX_EXACT_UNITS)
+    mask = select_pruned_units(unit_count, sparsity, prune_key);
+
+  const T zero = to_element<T>(0.f);
+  TensorFuzzer::parallel_fill(
+      info.m_elem_count, [&](uint64_t begin, uint64_t end) {
+        for (uint64_t i = begin; i < end; i++) {
+          uint64_t unit = units.unit_of(i);
+          bool pruned = mask.empty() ? uniform_at(prune_key, unit) < sparsity
+                                     : mask[unit] != 0;
+          if (pruned)
+            array[i] = zero;
+        }
+      });
+}
+
+/*
+ * DENORMAL, MIXED_SPECIAL and LARGE_MAGNITUDE values. One hash per element:
+ * bit 0 is the sign, bits 1-6 select special values and the top 53 bits are
+ * the uniform draw.
+ */
+template <typename T>
+void TensorFuzzer::generate_special_data(DataFormatInfo info, T *array) {
+  using Limits = FloatLimits<T>;
+  if constexpr (!Limits::is_float) {
+    TensorFuzzer::generate_random_data_norm(info, array);
+  } else {
+    const DataProfile profile = info.m_profile;
+    const uint64_t key = stream_key(info.m_seed);
+
+    TensorFuzzer::parallel_fill(
+        info.m_elem_count, [&](uint64_t begin, uint64_t end) {
+          for (uint64_t i = begin; i < end; i++) {
+            uint64_t hash = counter_hash(key, i);
+            double sign = (hash & 1) ? -1.0 : 1.0;
+            double u = static_cast<double>(hash >> 11) * 0x1p-53;
+            double value = 0.0;
+
+            switch (profile) {
+            case DENORMAL:
+              value = sign * Limits::min_normal * u;
+              break;
+            case LARGE_MAGNITUDE:
+              value = sign * Limits::max * std::exp2(-8.0 * u);
+              break;
+            default: // MIXED_SPECIAL
+              switch ((hash >> 1) & 63) {
+              case 0:
+                value = std::numeric_limits<double>::quiet_NaN();
+                break;
+              case 1:
+                value = std::numeric_limits<double>::infinity();
+                break;
+              case 2:
+                value = -std::numeric_limits<double>::infinity();
+                break;
+              case 3:
+                value = -0.0;
+                break;
+              case 4:
+              case 5:
+                value = sign * Limits::min_normal * u;
+                break;
+              default:
+                value = u;
+              }
+            }
+            array[i] = to_storage<T>(value);
+          }
+        });
   }
-  return array;
 }
 
-float *TensorFuzzer::generate_test_data(DataFormatInfo info) {
-  uint64_t elem_count = info.m_elem_count;
+/*
+ * FROM_STATS values. One hash per element: the low 24 bits decide zeros at
+ * the recorded zero fraction, the top 40 bits invert the histogram's CDF
+ * (uniform within a bin).
+ */
+template <typename T>
+void TensorFuzzer::generate_stats_data(DataFormatInfo info, T *array) {
+  if (!info.m_stats) {
+    TensorFuzzer::generate_random_data_norm(info, array);
+    return;
+  }
+  const TensorStats &stats = *info.m_stats;
+  const uint64_t key = stream_key(info.m_seed);
+
+  std::vector<double> cdf;
+  double total = 0.0;
+  for (double count : stats.histogram)
+    cdf.push_back(total += std::max(0.0, count));
+  double width = cdf.empty() ? 0.0
+                             : (stats.histogram_max - stats.histogram_min) /
+                                   double(cdf.size());
 
-  float *array = (float *)malloc(elem_count * sizeof(float));
-  applyTimeSeed(); // Initialises the Psuedo Random Generator
+  TensorFuzzer::parallel_fill(
+      info.m_elem_count, [&](uint64_t begin, uint64_t end) {
+        for (uint64_t i = begin; i < end; i++) {
+          uint64_t hash = counter_hash(key, i);
+          double zero_draw = static_cast<double>(hash & 0xFFFFFF) * 0x1p-24;
+          double u = static_cast<double>(hash >> 24) * 0x1p-40;
+          if (zero_draw < stats.zero_fraction) {
+            array[i] = to_storage<T>(0.0);
+            continue;
+          }
+
+          double value;
+          if (total > 0.0) {
+            double target = u * total;
+            size_t bin = std::min<size_t>(
+                std::upper_bound(cdf.begin(), cdf.end(), target) -
+                    cdf.begin(),
+                cdf.size() - 1);
+            double bin_start = cdf[bin] - stats.histogram[bin];
+            double within = stats.histogram[bin] > 0.0
+                                ? (target - bin_start) / stats.histogram[bin]
+                                : 0.5;
+            value = stats.histogram_min + (double(bin) + within) * width;
+          } else {
+            value = stats.min + u * (stats.max - stats.min);
+          }
+          array[i] = to_storage<T>(value);
+        }
+      });
+}
+
+template <typename T>
+void TensorFuzzer::generate_test_data(DataFormatInfo info, T *array) {
+  uint64_t elem_count = info.m_elem_count;
 
-  for (int i = 0; i < elem_count; i++) {
+  for (uint64_t i = 0; i < elem_count; i++) {
 
     float norm_scale = 2;
     // std::cout << norm_scale << " ";
-    array[i] = norm_scale;
+    array[i] = to_element<T>(norm_scale);
   }
-  return array;
 }
 
 // float *TensorFuzzer::generate_sparse_data(DataFormatInfo info) {}
 
-/*
- * Interface function for fuzzer:
- * Creates data based on the specified profile
- */
-float *TensorFuzzer::generate_data(DataFormatInfo dataInfo) {
+template <typename T>
+bool TensorFuzzer::fill_typed(DataFormatInfo dataInfo, T *array) {
   switch (dataInfo.m_profile) {
   case TEST:
-    return generate_random_data(dataInfo);
+    generate_random_data(dataInfo, array);
+    return true;
   case RANDOM:
-    return generate_random_data(dataInfo);
+    generate_random_data(dataInfo, array);
+    return true;
   case RANDOM_NORM:
-    return generate_random_data_norm(dataInfo);
-  case ZEROS:
+    generate_random_data_norm(dataInfo, array);
+    return true;
+  case ZEROS: // Buffers which can't be left untouched
+  case ZEROS_PREFAULTED:
+    generate_zero_data(dataInfo, array);
+    return true;
   case SPARSE:
+    generate_sparse_data(dataInfo, array);
+    return true;
+  case DENORMAL:
+  case MIXED_SPECIAL:
+  case LARGE_MAGNITUDE:
+    generate_special_data(dataInfo, array);
+    return true;
+  case FROM_STATS:
+    generate_stats_data(dataInfo, array);
+    return true;
   default:
+    return false;
+  }
+}
+
+uint64_t TensorFuzzer::stream_seed(uint64_t run_seed, uint64_t kernel_hash,
+                                   size_t arg_index) {
+  if (run_seed == 0)
+    return 0;
+  uint64_t seed = counter_hash(counter_hash(run_seed, kernel_hash), arg_index);
+  // 0 would mean "seed from the clock"
+  return seed ? seed : 1;
+}
+
+void TensorFuzzer::configure(unsigned int threads, int reserved_cpu) {
+  TensorFuzzer::reserved_cpu = reserved_cpu;
+  if (threads == 0 && reserved_cpu >= 0)
+    threads = NumaPlacement::cpus_of_node(
+                  NumaPlacement::node_of_cpu(reserved_cpu))
+                  .size();
+  TensorFuzzer::worker_count = std::max(1u, threads);
+}
+
+void TensorFuzzer::parallel_fill(
+    uint64_t count, const std::function<void(uint64_t, uint64_t)> &fill) {
+  uint64_t workers = std::min<uint64_t>(TensorFuzzer::worker_count,
+                                        count / MIN_ELEMS_PER_WORKER);
+  if (workers <= 1) {
+    fill(0, count);
+    return;
+  }
+
+  // Block aligned chunks, the calling thread takes the last one
+  uint64_t chunk =
+      (count / workers + BLOCK_ELEMS - 1) / BLOCK_ELEMS * BLOCK_ELEMS;
+  std::vector<int> node_cpus;
+  if (TensorFuzzer::reserved_cpu >= 0) {
+    node_cpus = NumaPlacement::cpus_of_node(
+        NumaPlacement::node_of_cpu(TensorFuzzer::reserved_cpu));
+    node_cpus.erase(std::remove(node_cpus.begin(), node_cpus.end(),
+                                TensorFuzzer::reserved_cpu),
+                    node_cpus.end());
+  }
+
+  std::vector<std::thread> threads;
+  for (uint64_t w = 0; w + 1 < workers; w++) {
+    uint64_t begin = w * chunk;
+    uint64_t end = std::min(count, begin + chunk);
+    if (begin >= end)
+      break;
+    threads.emplace_back([&fill, &node_cpus, begin, end]() {
+      // Spawned threads inherit the measurement CPU, move them off it
+      if (!node_cpus.empty())
+        pin_current_thread_to(node_cpus);
+      fill(begin, end);
+    });
+  }
+  uint64_t last_begin = std::min(count, (workers - 1) * chunk);
+  fill(last_begin, count);
+
+  for (std::thread &thread : threads)
+    thread.join();
+}
+
+/*
+ * Interface function for fuzzer:
+ * Fills the buffer based on the specified profile and element type
+ */
+bool TensorFuzzer::fill_data(DataFormatInfo dataInfo, void *array) {
+  if (!array)
+    return false;
+
+  // Reordered tensors: generated in NCHW, then scattered into their order.
+  // Padded buffers hold more than the tensor and are filled as they are.
+  std::vector<uint64_t> logical;
+  if (dataInfo.m_order != DataOrder::NCHW &&
+      DataOrders::logical_shape(dataInfo.m_order, dataInfo.m_stored_dims,
+                                logical) &&
+      logical[0] * logical[1] * logical[2] * logical[3] ==
+          dataInfo.m_elem_count) {
+    DataFormatInfo logical_info = dataInfo;
+    logical_info.setDataOrder(DataOrder::NCHW, {});
+    logical_info.setRowLength(logical[3]);
+    uint64_t elem_size = ElementTypes::size(dataInfo.m_elem_type);
+    std::vector<uint8_t> logical_data(dataInfo.m_elem_count * elem_size);
+    if (!TensorFuzzer::fill_data(logical_info, logical_data.data()))
+      return false;
+
+    uint8_t *stored = static_cast<uint8_t *>(array);
+    uint64_t C = logical[1], H = logical[2], W = logical[3];
+    TensorFuzzer::parallel_fill(
+        dataInfo.m_elem_count, [&](uint64_t begin, uint64_t end) {
+          for (uint64_t i = begin; i < end; i++) {
+            uint64_t w = i % W, h = (i / W) % H, c = (i / (W * H)) % C;
+            uint64_t n = i / (W * H * C);
+            uint64_t j =
+                DataOrders::stored_index(dataInfo.m_order, logical, n, c, h, w);
+            std::memcpy(stored + j * elem_size,
+                        logical_data.data() + i * elem_size, elem_size);
+          }
+        });
+    return true;
+  }
+
+  switch (dataInfo.m_elem_type) {
+  case ElementType::F16:
+    return fill_typed(dataInfo, static_cast<Half *>(array));
+  case ElementType::BF16:
+    return fill_typed(dataInfo, static_cast<BFloat16 *>(array));
+  case ElementType::F64:
+    return fill_typed(dataInfo, static_cast<double *>(array));
+  case ElementType::I1:
+    return fill_typed(dataInfo, static_cast<Bool *>(array));
+  case ElementType::I8:
+    return fill_typed(dataInfo, static_cast<int8_t *>(array));
+  case ElementType::U8:
+    return fill_typed(dataInfo, static_cast<uint8_t *>(array));
+  case ElementType::I16:
+    return fill_typed(dataInfo, static_cast<int16_t *>(array));
+  case ElementType::I32:
+    return fill_typed(dataInfo, static_cast<int32_t *>(array));
+  case ElementType::I64:
+    return fill_typed(dataInfo, static_cast<int64_t *>(array));
+  default:
+    return fill_typed(dataInfo, static_cast<float *>(array));
+  }
+}
+
+bool TensorFuzzer::is_untouched(DataProfile profile) {
+  return profile == DataProfile::ZEROS;
+}
+
+bool TensorFuzzer::parse_profile(const std::string &name,
+                                 DataProfile &profile) {
+  for (DataProfile candidate :
+       {DataProfile::RANDOM_NORM, DataProfile::RANDOM, DataProfile::ZEROS,
+        DataProfile::ZEROS_PREFAULTED, DataProfile::SPARSE,
+        DataProfile::DENORMAL, DataProfile::MIXED_SPECIAL,
+        DataProfile::LARGE_MAGNITUDE, DataProfile::FROM_STATS})
+    if (TensorFuzzer::describe(candidate) == name) {
+      profile = candidate;
+      return true;
+    }
+  return false;
+}
+
+bool TensorFuzzer::parse_distribution(const std::string &name,
+                                      SparsityDist &distribution) {
+  for (SparsityDist candidate :
+       {SparsityDist::UNSTRUCTURED_PURE, SparsityDist::STRUCTURED_ROW_WISE,
+        SparsityDist::STRUCTURED_COL_WISE, SparsityDist::UNSTRUCTURED_TILE_1D,
+        SparsityDist::UNSTRUCTURED_TILE_2D,
+        SparsityDist::UNSTRUCTURED_DIAGONALS})
+    if (TensorFuzzer::describe(candidate) == name) {
+      distribution = candidate;
+      return true;
+    }
+  return false;
+}
+
+std::string TensorFuzzer::describe(DataProfile profile) {
+  switch (profile) {
+  case DataProfile::TEST:
+    return "test";
+  case DataProfile::RANDOM:
+    return "random";
+  case DataProfile::ZEROS:
+    return "zeros";
+  case DataProfile::ZEROS_PREFAULTED:
+    return "zeros-prefaulted";
+  case DataProfile::DENORMAL:
+    return "denormal";
+  case DataProfile::MIXED_SPECIAL:
+    return "mixed-special";
+  case DataProfile::LARGE_MAGNITUDE:
+    return "large-magnitude";
+  case DataProfile::FROM_STATS:
+    return "from-stats";
+  case DataProfile::SPARSE:
+    return "sparse";
+  case DataProfile::RANDOM_NORM:
+  default:
+    return "random-norm";
+  }
+}
+
+std::string TensorFuzzer::describe(SparsityDist distribution) {
+  switch (distribution) {
+  case SparsityDist::STRUCTURED_ROW_WISE:
+    return "row";
+  case SparsityDist::STRUCTURED_COL_WISE:
+    return "col";
+  case SparsityDist::UNSTRUCTURED_TILE_1D:
+    return "tile1d";
+  case SparsityDist::UNSTRUCTURED_TILE_2D:
+    return "tile2d";
+  case SparsityDist::UNSTRUCTURED_DIAGONALS:
+    return "diagonal";
+  case SparsityDist::UNSTRUCTURED_PURE:
+  default:
+    return "unstructured";
+  }
+}
+
+InputProfile TensorFuzzer::from_pipeline_json(const json &pipeline) {
+  InputProfile input;
+  if (!pipeline.contains("inputs"))
+    return input;
+
+  const json &inputs = pipeline["inputs"];
+  if (inputs.contains("profile") &&
+      !TensorFuzzer::parse_profile(inputs["profile"].get<std::string>(),
+                                   input.profile))
+    std::cerr << "Unknown inputs profile '"
+              << inputs["profile"].get<std::string>() << "', using "
+              << TensorFuzzer::describe(input.profile) << "\n";
+  if (inputs.contains("density"))
+    input.sparsity.sparsity_percentage =
+        1.f - inputs["density"].get<float>();
+  if (inputs.contains("distribution") &&
+      !TensorFuzzer::parse_distribution(
+          inputs["distribution"].get<std::string>(),
+          input.sparsity.distribution_type))
+    std::cerr << "Unknown inputs distribution '"
+              << inputs["distribution"].get<std::string>() << "', using "
+              << TensorFuzzer::describe(input.sparsity.distribution_type)
+              << "\n";
+  if (inputs.contains("block"))
+    input.sparsity.row_block_size =
+        std::clamp(inputs["block"].get<int>(), 1, 255);
+  return input;
+}
+
+void *TensorFuzzer::generate_data(DataFormatInfo dataInfo) {
+  void *array =
+      malloc(dataInfo.m_elem_count * ElementTypes::size(dataInfo.m_elem_type));
+  if (!TensorFuzzer::fill_data(dataInfo, array)) {
+    free(array);
     return nullptr;
   }
+  return array;
 }
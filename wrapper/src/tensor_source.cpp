@@ -0,0 +1,255 @@
+#include "tensor_source.h"
+#include "memref_layout.h"
+
+#include <cstring>
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// numpy dtype descriptors (without byte order) of the supported types
+static bool npy_element_type(const std::string &descr, ElementType &type) {
+  // '<' little endian, '|' not applicable, '=' native
+  if (descr.size() < 2 || descr[0] == '>')
+    return false;
+  std::string kind = descr.substr(1);
+  if (kind == "f4")
+    type = ElementType::F32;
+  else if (kind == "f2")
+    type = ElementType::F16;
+  else if (kind == "f8")
+    type = ElementType::F64;
+  else if (kind == "b1")
+    type = ElementType::I1;
+  else if (kind == "i1")
+    type = ElementType::I8;
+  else if (kind == "u1")
+    type = ElementType::U8;
+  else if (kind == "i2")
+    type = ElementType::I16;
+  else if (kind == "i4")
+    type = ElementType::I32;
+  else if (kind == "i8")
+    type = ElementType::I64;
+  else
+    return false;
+  return true;
+}
+
+static bool safetensors_element_type(const std::string &dtype,
+                                     ElementType &type) {
+  static const std::vector<std::pair<std::string, ElementType>> types = {
+      {"F32", ElementType::F32}, {"F16", ElementType::F16},
+      {"BF16", ElementType::BF16}, {"F64", ElementType::F64},
+      {"BOOL", ElementType::I1}, {"I8", ElementType::I8},
+      {"U8", ElementType::U8},   {"I16", ElementType::I16},
+      {"I32", ElementType::I32}, {"I64", ElementType::I64}};
+  for (const auto &[name, element_type] : types)
+    if (name == dtype) {
+      type = element_type;
+      return true;
+    }
+  return false;
+}
+
+// Value of 'key': ... in the python dict literal of an .npy header
+static std::string npy_header_field(const std::string &header,
+                                    const std::string &key) {
+  size_t pos = header.find("'" + key + "'");
+  if (pos == std::string::npos)
+    return "";
+  pos = header.find(':', pos);
+  if (pos == std::string::npos)
+    return "";
+  pos = header.find_first_not_of(' ', pos + 1);
+  if (pos == std::string::npos)
+    return "";
+
+  char open = header[pos];
+  size_t end = open == '(' ? header.find(')', pos) + 1
+             : open == '\'' ? header.find('\'', pos + 1) + 1
+                            : header.find_first_of(",}", pos);
+  return header.substr(pos, end - pos);
+}
+
+TensorSource::TensorSource(const fs::path &directory)
+    : m_directory(directory) {}
+
+TensorSource::~TensorSource() {
+  for (auto &[filepath, mapping] : m_mappings)
+    if (mapping.address)
+      munmap(mapping.address, mapping.bytes);
+}
+
+const TensorSource::Mapping *TensorSource::map_file(const fs::path &filepath) {
+  for (const auto &[mapped_path, mapping] : m_mappings)
+    if (mapped_path == filepath)
+      return mapping.address ? &mapping : nullptr;
+
+  Mapping mapping;
+  int fd = open(filepath.c_str(), O_RDONLY);
+  struct stat file_stat;
+  if (fd >= 0 && fstat(fd, &file_stat) == 0 && file_stat.st_size > 0) {
+    mapping.bytes = file_stat.st_size;
+    // Private mapping: pages are shared with the page cache until written
+    mapping.address = mmap(nullptr, mapping.bytes, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE, fd, 0);
+    if (mapping.address == MAP_FAILED) {
+      std::cerr << "Failed to map " << filepath << ": "
+                << std::strerror(errno) << "\n";
+      mapping.address = nullptr;
+    }
+  }
+  if (fd >= 0)
+    close(fd);
+
+  if (mapping.address)
+    m_mapped_bytes += mapping.bytes;
+  m_mappings.emplace_back(filepath, mapping);
+  return mapping.address ? &m_mappings.back().second : nullptr;
+}
+
+bool TensorSource::parse_npy(const Mapping &mapping, MappedTensor &tensor,
+                             std::string &error) {
+  const uint8_t *bytes = static_cast<const uint8_t *>(mapping.address);
+  if (mapping.bytes < 10 || std::memcmp(bytes, "\x93NUMPY", 6) != 0) {
+    error = "not an .npy file";
+    return false;
+  }
+
+  // Version 1 has a 2 byte header length, later versions 4 bytes
+  uint8_t major = bytes[6];
+  uint64_t header_offset = major == 1 ? 10 : 12;
+  uint64_t header_length =
+      major == 1 ? bytes[8] | (bytes[9] << 8)
+                 : bytes[8] | (bytes[9] << 8) | (bytes[10] << 16) |
+                       ((uint64_t)bytes[11] << 24);
+  if (header_offset + header_length > mapping.bytes) {
+    error = "truncated header";
+    return false;
+  }
+  std::string header(reinterpret_cast<const char *>(bytes) + header_offset,
+                     header_length);
+
+  std::string descr = npy_header_field(header, "descr");
+  if (descr.size() < 2 ||
+      !npy_element_type(descr.substr(1, descr.size() - 2), tensor.type)) {
+    error = "unsupported dtype " + descr;
+    return false;
+  }
+  if (npy_header_field(header, "fortran_order") != "False") {
+    error = "Fortran ordered arrays are not supported";
+    return false;
+  }
+
+  // (2, 3) or (4,) or () for scalars
+  std::string shape = npy_header_field(header, "shape");
+  tensor.shape.clear();
+  for (size_t pos = 1; pos < shape.size();) {
+    size_t end = shape.find_first_of(",)", pos);
+    std::string dim = shape.substr(pos, end - pos);
+    if (dim.find_first_not_of(' ') != std::string::npos)
+      tensor.shape.push_back(std::stoull(dim));
+    pos = end + 1;
+  }
+
+  uint64_t data_offset = header_offset + header_length;
+  tensor.data = const_cast<uint8_t *>(bytes) + data_offset;
+  tensor.bytes = mapping.bytes - data_offset;
+  return true;
+}
+
+bool TensorSource::parse_safetensors(const Mapping &mapping,
+                                     const std::string &name,
+                                     MappedTensor &tensor,
+                                     std::string &error) {
+  const uint8_t *bytes = static_cast<const uint8_t *>(mapping.address);
+  uint64_t header_length = 0;
+  if (mapping.bytes < 8) {
+    error = "not a .safetensors file";
+    return false;
+  }
+  std::memcpy(&header_length, bytes, sizeof(header_length));
+  if (8 + header_length > mapping.bytes) {
+    error = "truncated header";
+    return false;
+  }
+
+  json header = json::parse(reinterpret_cast<const char *>(bytes) + 8,
+                            reinterpret_cast<const char *>(bytes) + 8 +
+                                header_length,
+                            nullptr, false);
+  if (header.is_discarded() || !header.contains(name))
+    return false;
+
+  const json &entry = header[name];
+  if (!safetensors_element_type(entry.value("dtype", ""), tensor.type)) {
+    error = "unsupported dtype " + entry.value("dtype", "");
+    return false;
+  }
+  tensor.shape = entry.at("shape").get<std::vector<uint64_t>>();
+  std::vector<uint64_t> offsets =
+      entry.at("data_offsets").get<std::vector<uint64_t>>();
+  if (offsets.size() != 2 || 8 + header_length + offsets[1] > mapping.bytes) {
+    error = "data offsets out of range";
+    return false;
+  }
+
+  tensor.data = const_cast<uint8_t *>(bytes) + 8 + header_length + offsets[0];
+  tensor.bytes = offsets[1] - offsets[0];
+  return true;
+}
+
+bool TensorSource::bind(const std::string &kernel, size_t index,
+                        const JSONArgument &expected, MappedTensor &tensor) {
+  std::string name = "arg" + std::to_string(index);
+  fs::path npy_filepath =
+      fs::path(m_directory).append(kernel).append(name + ".npy");
+  fs::path safetensors_filepath =
+      fs::path(m_directory).append(kernel + ".safetensors");
+
+  std::string error;
+  bool found = false;
+  fs::path source;
+  if (fs::exists(npy_filepath)) {
+    source = npy_filepath;
+    const Mapping *mapping = map_file(npy_filepath);
+    found = mapping && TensorSource::parse_npy(*mapping, tensor, error);
+  } else if (fs::exists(safetensors_filepath)) {
+    source = safetensors_filepath;
+    const Mapping *mapping = map_file(safetensors_filepath);
+    found = mapping && TensorSource::parse_safetensors(*mapping, name, tensor,
+                                                       error);
+  }
+  if (!found) {
+    if (!error.empty())
+      std::cerr << "Ignoring " << source << " for " << name << ": " << error
+                << "\n";
+    return false;
+  }
+
+  ElementType expected_type = ElementTypes::parse(expected.dtype);
+  uint64_t elem_count = 1;
+  for (uint64_t dim : expected.shape)
+    elem_count *= dim;
+
+  if (tensor.type != expected_type)
+    error = "dtype " + ElementTypes::describe(tensor.type) + ", expected " +
+            expected.dtype;
+  else if (tensor.shape != expected.shape)
+    error = "shape does not match the kernel signature";
+  else if (tensor.bytes < elem_count * ElementTypes::size(expected_type))
+    error = "file holds fewer elements than its shape";
+  else if ((!expected.strides.empty() &&
+            expected.strides != MemRefLayout::dense_strides(expected.shape)) ||
+           expected.offset != 0)
+    error = "only dense layouts can be bound to a file";
+  if (!error.empty()) {
+    std::cerr << "Ignoring " << source << " for " << name << ": " << error
+              << "\n";
+    return false;
+  }
+  return true;
+}
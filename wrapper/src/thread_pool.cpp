@@ -0,0 +1,69 @@
+#include "thread_pool.h"
+#include "fork_gate.h"
+#include "utils.h"
+
+ThreadPool::ThreadPool(unsigned int worker_count, int reserved_cpu) {
+  if (worker_count == 0)
+    worker_count = 1;
+
+  for (unsigned int i = 0; i < worker_count; i++)
+    m_workers.emplace_back(&ThreadPool::worker_loop, this, reserved_cpu);
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stopping = true;
+  }
+  m_task_available.notify_all();
+
+  for (std::thread &worker : m_workers)
+    worker.join();
+}
+
+void ThreadPool::worker_loop(int reserved_cpu) {
+  if (reserved_cpu >= 0)
+    pin_current_thread_excluding(reserved_cpu);
+
+  while (true) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_task_available.wait(lock,
+                            [this]() { return m_stopping || !m_tasks.empty(); });
+      if (m_tasks.empty())
+        return; // Stopping and fully drained
+
+      task = std::move(m_tasks.front());
+      m_tasks.pop();
+    }
+
+    {
+      // Measurement workers are never forked in the middle of a task
+      ForkGate::Section section;
+      task();
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_pending--;
+    }
+    m_all_done.notify_all();
+  }
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_tasks.push(std::move(task));
+    m_pending++;
+  }
+  m_task_available.notify_one();
+}
+
+void ThreadPool::wait() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_all_done.wait(lock, [this]() { return m_pending == 0; });
+}
+
+unsigned int ThreadPool::size() const { return m_workers.size(); }
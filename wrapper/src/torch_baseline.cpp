@@ -0,0 +1,134 @@
+#include "torch_baseline.h"
+
+#include <Python.h>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <sstream>
+
+// Helpers run once in __main__ of the embedded interpreter. Tensors view the
+// harness buffers in place, nothing is copied.
+static const char *BINDING_CODE = R"(
+def _torch_baseline_bind(op_json, args_json, compile_op, threads):
+    import ctypes, json, torch
+    dtypes = {'f32': torch.float32, 'f16': torch.float16,
+              'bf16': torch.bfloat16, 'f64': torch.float64,
+              'i1': torch.bool, 'i8': torch.int8, 'ui8': torch.uint8,
+              'i16': torch.int16, 'i32': torch.int32, 'i64': torch.int64}
+    torch.set_num_threads(threads)
+    tensors = []
+    for arg in json.loads(args_json):
+        dtype = dtypes[arg['dtype']]
+        itemsize = torch.empty((), dtype=dtype).element_size()
+        buffer = (ctypes.c_char * (arg['elements'] * itemsize)).from_address(
+            arg['address'])
+        tensors.append(torch.frombuffer(buffer, dtype=dtype).as_strided(
+            arg['shape'], arg['strides'], arg['offset']))
+    op = json.loads(op_json)
+    target = torch.ops
+    for part in op['name'].split('.'):
+        target = getattr(target, part)
+    operands = [tensors[o['arg']] if isinstance(o, dict) else o
+                for o in op['operands']]
+    if compile_op:
+        compiled = torch.compile(lambda *a: target(*a), dynamic=False)
+        call = lambda: compiled(*operands)
+    else:
+        call = lambda: target(*operands)
+    call()
+    return call
+)";
+
+bool TorchCall::parse(const std::string &list, std::vector<TorchMode> &modes) {
+  modes.clear();
+  std::stringstream ss(list);
+  for (std::string name; std::getline(ss, name, ',');) {
+    if (name.empty() || name == "none")
+      continue;
+    if (name == "eager")
+      modes.push_back(TorchMode::EAGER);
+    else if (name == "compile")
+      modes.push_back(TorchMode::COMPILE);
+    else
+      return false;
+  }
+  return true;
+}
+
+std::string TorchCall::describe(TorchMode mode) {
+  return mode == TorchMode::COMPILE ? "torch-compile" : "torch-eager";
+}
+
+std::unique_ptr<TorchCall>
+TorchCall::bind(const json &op, TorchMode mode,
+                const std::vector<MemRefArg *> &args, unsigned int threads) {
+  if (!op.is_object() || !op.contains("name")) {
+    std::cerr << "No torch op recorded for the kernel, skipping the "
+              << TorchCall::describe(mode) << " baseline\n";
+    return nullptr;
+  }
+
+  json arguments = json::array();
+  for (MemRefArg *arg : args) {
+    std::vector<int64_t> shape, strides;
+    for (int64_t d = 0; d < arg->get_tensor_rank(); d++) {
+      shape.push_back(arg->m_desc->dimension[d]);
+      strides.push_back(arg->m_desc->strides[d]);
+    }
+    arguments.push_back(
+        {{"dtype", ElementTypes::describe(arg->m_elem_type)},
+         {"address", reinterpret_cast<uintptr_t>(arg->getDataAligned())},
+         {"elements", arg->m_desc->offset + arg->get_buffer_elem_count()},
+         {"shape", shape},
+         {"strides", strides},
+         {"offset", arg->m_desc->offset}});
+  }
+
+  // The interpreter stays up, torch's thread pools don't survive finalising
+  if (!Py_IsInitialized())
+    Py_Initialize();
+  std::unique_ptr<TorchCall> call(new TorchCall());
+  call->m_gil_state = PyGILState_Ensure();
+
+  auto bind_start = std::chrono::steady_clock::now();
+  PyObject *main_module = PyImport_AddModule("__main__");
+  PyObject *globals = PyModule_GetDict(main_module);
+  PyObject *binder = PyDict_GetItemString(globals, "_torch_baseline_bind");
+  if (!binder) {
+    if (PyRun_SimpleString(BINDING_CODE) != 0) {
+      std::cerr << "Failed to set up the torch baseline\n";
+      return nullptr;
+    }
+    binder = PyDict_GetItemString(globals, "_torch_baseline_bind");
+  }
+
+  PyObject *callable = PyObject_CallFunction(
+      binder, "ssiI", op.dump().c_str(), arguments.dump().c_str(),
+      mode == TorchMode::COMPILE ? 1 : 0, std::max(threads, 1u));
+  if (!callable) {
+    std::cerr << "Failed to bind torch.ops." << op["name"].get<std::string>()
+              << " (" << TorchCall::describe(mode) << "):\n";
+    PyErr_Print();
+    return nullptr;
+  }
+  call->m_callable = callable;
+  call->m_compile_seconds = std::chrono::duration<double>(
+                                std::chrono::steady_clock::now() - bind_start)
+                                .count();
+  return call;
+}
+
+TorchCall::~TorchCall() {
+  Py_XDECREF(static_cast<PyObject *>(m_callable));
+  PyGILState_Release(static_cast<PyGILState_STATE>(m_gil_state));
+}
+
+bool TorchCall::call() {
+  PyObject *result = PyObject_CallNoArgs(static_cast<PyObject *>(m_callable));
+  if (!result) {
+    PyErr_Print();
+    return false;
+  }
+  Py_DECREF(result);
+  return true;
+}
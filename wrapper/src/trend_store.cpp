@@ -0,0 +1,422 @@
+#include "trend_store.h"
+#include "kernel_dedup.h"
+#include "result_compare.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <regex>
+#include <set>
+#include <sqlite3.h>
+#include <sstream>
+
+static const char *SCHEMA = R"sql(
+CREATE TABLE IF NOT EXISTS runs (
+  run INTEGER PRIMARY KEY AUTOINCREMENT,
+  date TEXT, output_dir TEXT, model TEXT, torch_mlir_commit TEXT,
+  torch_mlir_branch TEXT, llvm_commit TEXT, pipeline TEXT,
+  pipeline_hash TEXT, host TEXT, host_fingerprint TEXT,
+  primary_metric TEXT);
+CREATE TABLE IF NOT EXISTS kernels (
+  run INTEGER, op_type TEXT, kernel TEXT, hash TEXT, multiplicity INTEGER,
+  metric TEXT, samples INTEGER, mean REAL, median REAL, ci95_low REAL,
+  ci95_high REAL);
+CREATE INDEX IF NOT EXISTS kernels_run ON kernels (run, metric);
+)sql";
+
+static std::string trim(std::string text) {
+  text.erase(text.find_last_not_of(" \t\r\n") + 1);
+  text.erase(0, text.find_first_not_of(" \t\r\n"));
+  return text;
+}
+
+static std::string column_text(sqlite3_stmt *statement, int column) {
+  const unsigned char *text = sqlite3_column_text(statement, column);
+  return text ? reinterpret_cast<const char *>(text) : "";
+}
+
+static std::string git(const fs::path &dir, const std::string &arguments) {
+  if (!fs::exists(fs::path(dir).append(".git")))
+    return "";
+  std::string command =
+      "git -C '" + dir.string() + "' " + arguments + " 2>/dev/null";
+  FILE *pipe = popen(command.c_str(), "r");
+  if (!pipe)
+    return "";
+  std::string output;
+  char buffer[256];
+  while (fgets(buffer, sizeof(buffer), pipe))
+    output += buffer;
+  pclose(pipe);
+  return trim(output);
+}
+
+static std::string git_commit(const fs::path &dir) {
+  std::string commit = git(dir, "rev-parse HEAD");
+  if (!commit.empty() &&
+      !git(dir, "status --porcelain --untracked-files=no").empty())
+    commit += "-dirty";
+  return commit;
+}
+
+// <KEY>:<TYPE>=<value> of the build's CMakeCache.txt
+static std::string cmake_cache_value(const fs::path &build_path,
+                                     const std::string &key) {
+  std::ifstream cache(fs::path(build_path).append("CMakeCache.txt"));
+  for (std::string line; std::getline(cache, line);)
+    if (line.rfind(key + ":", 0) == 0 && line.find('=') != std::string::npos)
+      return trim(line.substr(line.find('=') + 1));
+  return "";
+}
+
+void TrendStore::read_toolchain(const fs::path &build_path, TrendRun &run) {
+  // Out of tree builds have torch-mlir as the top project, LLVM_EXTERNAL_*
+  // builds have LLVM
+  std::string top_source = cmake_cache_value(build_path, "CMAKE_HOME_DIRECTORY");
+  std::string torch_source = cmake_cache_value(
+      build_path, "LLVM_EXTERNAL_TORCH_MLIR_SOURCE_DIR");
+  if (torch_source.empty())
+    torch_source = top_source;
+
+  run.torch_mlir_commit = git_commit(torch_source);
+  run.torch_mlir_branch = git(torch_source, "rev-parse --abbrev-ref HEAD");
+
+  fs::path llvm_source = fs::path(torch_source).append("externals")
+                             .append("llvm-project");
+  run.llvm_commit = git_commit(llvm_source);
+  if (run.llvm_commit.empty() && top_source != torch_source)
+    run.llvm_commit = git_commit(top_source);
+  if (run.llvm_commit.empty()) {
+    // Stamped into the build even without the sources around
+    std::ifstream revision(fs::path(build_path)
+                               .append("include")
+                               .append("llvm")
+                               .append("Support")
+                               .append("VCSRevision.h"));
+    std::stringstream contents;
+    contents << revision.rdbuf();
+    std::smatch match;
+    std::string text = contents.str();
+    if (std::regex_search(text, match,
+                          std::regex(R"(LLVM_REVISION\s+"([0-9a-f]+)\")")))
+      run.llvm_commit = match[1].str();
+  }
+
+  for (std::string *value :
+       {&run.torch_mlir_commit, &run.torch_mlir_branch, &run.llvm_commit})
+    if (value->empty())
+      *value = "unknown";
+}
+
+bool TrendStore::record(const fs::path &db_filepath, const TrendRun &run,
+                        const std::vector<KernelTask> &tasks,
+                        const std::vector<std::string> &metrics) {
+  std::error_code ec;
+  if (db_filepath.has_parent_path())
+    fs::create_directories(db_filepath.parent_path(), ec);
+  sqlite3 *db = nullptr;
+  char *error = nullptr;
+  if (sqlite3_open(db_filepath.c_str(), &db) != SQLITE_OK ||
+      sqlite3_exec(db, SCHEMA, nullptr, nullptr, &error) != SQLITE_OK ||
+      sqlite3_exec(db, "BEGIN;", nullptr, nullptr, &error) != SQLITE_OK) {
+    std::cerr << "Could not record the run in the trend store " << db_filepath
+              << ": " << (error ? error : sqlite3_errmsg(db)) << "\n";
+    sqlite3_free(error);
+    sqlite3_close(db);
+    return false;
+  }
+
+  sqlite3_stmt *insert = nullptr;
+  sqlite3_prepare_v2(db,
+                     "INSERT INTO runs (date, output_dir, model, "
+                     "torch_mlir_commit, torch_mlir_branch, llvm_commit, "
+                     "pipeline, pipeline_hash, host, host_fingerprint, "
+                     "primary_metric) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)",
+                     -1, &insert, nullptr);
+  int column = 1;
+  for (const std::string *value :
+       {&run.date, &run.output_dir, &run.model, &run.torch_mlir_commit,
+        &run.torch_mlir_branch, &run.llvm_commit, &run.pipeline,
+        &run.pipeline_hash, &run.host, &run.host_fingerprint,
+        &run.primary_metric})
+    sqlite3_bind_text(insert, column++, value->c_str(), -1, SQLITE_TRANSIENT);
+  sqlite3_step(insert);
+  sqlite3_finalize(insert);
+  long long run_id = sqlite3_last_insert_rowid(db);
+
+  sqlite3_prepare_v2(db,
+                     "INSERT INTO kernels VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, "
+                     "?, ?)",
+                     -1, &insert, nullptr);
+  size_t recorded = 0;
+  for (const KernelTask &task : tasks) {
+    if (!task.measured || !task.failure.empty())
+      continue;
+    std::string kernel =
+        fs::path(task.mlir_filepath).replace_extension().filename().string();
+    std::string hash = task.kernel_hash.empty()
+                           ? KernelDedup::kernel_signature(task)
+                           : task.kernel_hash;
+    for (const std::string &metric : metrics) {
+      // Resumed kernels only kept their averages
+      SampleSummary summary;
+      auto stats = task.sample_summaries.find(metric);
+      auto average = task.average_metrics.find(metric);
+      if (stats != task.sample_summaries.end())
+        summary = stats->second;
+      else if (average != task.average_metrics.end())
+        summary.mean = summary.median = summary.ci95_low =
+            summary.ci95_high = average->second;
+      else
+        continue;
+      sqlite3_bind_int64(insert, 1, run_id);
+      sqlite3_bind_text(insert, 2, task.op_type.c_str(), -1,
+                        SQLITE_TRANSIENT);
+      sqlite3_bind_text(insert, 3, kernel.c_str(), -1, SQLITE_TRANSIENT);
+      sqlite3_bind_text(insert, 4, hash.c_str(), -1, SQLITE_TRANSIENT);
+      sqlite3_bind_int(insert, 5, task.multiplicity);
+      sqlite3_bind_text(insert, 6, metric.c_str(), -1, SQLITE_TRANSIENT);
+      sqlite3_bind_int64(insert, 7, summary.count);
+      sqlite3_bind_double(insert, 8, summary.mean);
+      sqlite3_bind_double(insert, 9, summary.median);
+      sqlite3_bind_double(insert, 10, summary.ci95_low);
+      sqlite3_bind_double(insert, 11, summary.ci95_high);
+      sqlite3_step(insert);
+      sqlite3_reset(insert);
+    }
+    recorded++;
+  }
+  sqlite3_finalize(insert);
+  bool committed =
+      sqlite3_exec(db, "COMMIT;", nullptr, nullptr, nullptr) == SQLITE_OK;
+  sqlite3_close(db);
+  if (committed)
+    std::cout << "Trend store: " << db_filepath << " (run " << run_id << ", "
+              << recorded << " kernels at torch-mlir "
+              << run.torch_mlir_commit.substr(0, 12) << ")\n";
+  return committed;
+}
+
+namespace {
+
+// One commit pair of the trend, from its latest run
+struct TrendPoint {
+  long long run;
+  std::string date;
+  std::string commit;
+  std::string llvm_commit;
+  // hash -> op_type, kernel, multiplicity, median
+  struct Kernel {
+    std::string op_type;
+    std::string kernel;
+    int multiplicity;
+    double median;
+  };
+  std::map<std::string, Kernel> kernels;
+};
+
+// Slowdown of current against previous, positive is worse
+double slowdown(const std::string &metric, double previous, double current) {
+  bool higher = ResultCompare::higher_is_better(metric);
+  double better = higher ? current : previous;
+  return better == 0.0 ? 0.0 : (higher ? previous : current) / better - 1.0;
+}
+
+std::string short_commit(const std::string &commit) {
+  bool dirty = commit.size() > 6 &&
+               commit.compare(commit.size() - 6, 6, "-dirty") == 0;
+  return commit.substr(0, 12) + (dirty ? "*" : "");
+}
+
+} // namespace
+
+bool TrendStore::report(const fs::path &db_filepath, const TrendQuery &query,
+                        const fs::path &output_dir) {
+  sqlite3 *db = nullptr;
+  if (!fs::exists(db_filepath) ||
+      sqlite3_open_v2(db_filepath.c_str(), &db, SQLITE_OPEN_READONLY,
+                      nullptr) != SQLITE_OK) {
+    std::cerr << "No trend store at " << db_filepath << "\n";
+    sqlite3_close(db);
+    return false;
+  }
+
+  // Filters default to the latest run's
+  sqlite3_stmt *statement = nullptr;
+  sqlite3_prepare_v2(db,
+                     "SELECT model, host, pipeline_hash, primary_metric FROM "
+                     "runs ORDER BY run DESC LIMIT 1",
+                     -1, &statement, nullptr);
+  if (sqlite3_step(statement) != SQLITE_ROW) {
+    std::cerr << "No runs in " << db_filepath << "\n";
+    sqlite3_finalize(statement);
+    sqlite3_close(db);
+    return false;
+  }
+  std::string model = query.model.empty() ? column_text(statement, 0)
+                                          : query.model;
+  std::string host = query.host.empty() ? column_text(statement, 1)
+                                        : query.host;
+  std::string pipeline_hash = query.pipeline_hash.empty()
+                                  ? column_text(statement, 2)
+                                  : query.pipeline_hash;
+  std::string metric = query.metric.empty() ? column_text(statement, 3)
+                                            : query.metric;
+  sqlite3_finalize(statement);
+
+  // In the order the commit pairs were first measured, each from its latest
+  // run
+  sqlite3_prepare_v2(
+      db,
+      "SELECT run, date, torch_mlir_commit, llvm_commit FROM runs WHERE "
+      "(?1 = 'all' OR model = ?1) AND (?2 = 'all' OR host = ?2) AND "
+      "(?3 = 'all' OR pipeline_hash = ?3) ORDER BY run",
+      -1, &statement, nullptr);
+  sqlite3_bind_text(statement, 1, model.c_str(), -1, SQLITE_TRANSIENT);
+  sqlite3_bind_text(statement, 2, host.c_str(), -1, SQLITE_TRANSIENT);
+  sqlite3_bind_text(statement, 3, pipeline_hash.c_str(), -1,
+                    SQLITE_TRANSIENT);
+  std::vector<TrendPoint> points;
+  std::map<std::string, size_t> point_index;
+  while (sqlite3_step(statement) == SQLITE_ROW) {
+    TrendPoint point;
+    point.run = sqlite3_column_int64(statement, 0);
+    point.date = column_text(statement, 1);
+    point.commit = column_text(statement, 2);
+    point.llvm_commit = column_text(statement, 3);
+    auto [it, inserted] = point_index.emplace(
+        point.commit + " " + point.llvm_commit, points.size());
+    if (inserted)
+      points.push_back(point);
+    else
+      points[it->second] = point;
+  }
+  sqlite3_finalize(statement);
+
+  sqlite3_prepare_v2(db,
+                     "SELECT op_type, kernel, hash, multiplicity, median FROM "
+                     "kernels WHERE run = ? AND metric = ?",
+                     -1, &statement, nullptr);
+  for (TrendPoint &point : points) {
+    sqlite3_bind_int64(statement, 1, point.run);
+    sqlite3_bind_text(statement, 2, metric.c_str(), -1, SQLITE_TRANSIENT);
+    while (sqlite3_step(statement) == SQLITE_ROW) {
+      std::string op_type = column_text(statement, 0);
+      if (!query.op_type.empty() && op_type != query.op_type)
+        continue;
+      point.kernels[column_text(statement, 2)] = {
+          op_type, column_text(statement, 1), sqlite3_column_int(statement, 3),
+          sqlite3_column_double(statement, 4)};
+    }
+    sqlite3_reset(statement);
+  }
+  sqlite3_finalize(statement);
+  sqlite3_close(db);
+
+  std::cout << "Trend of " << metric << " for model " << model << ", host "
+            << host << ", pipeline " << pipeline_hash.substr(0, 12) << ": "
+            << points.size() << " commits\n";
+  if (points.empty())
+    return false;
+
+  // Op type and model totals, weighted by multiplicity
+  std::vector<std::map<std::string, double>> totals(points.size());
+  std::set<std::string> op_types;
+  for (size_t p = 0; p < points.size(); p++)
+    for (const auto &[hash, kernel] : points[p].kernels) {
+      totals[p][kernel.op_type] += kernel.median * kernel.multiplicity;
+      totals[p]["total"] += kernel.median * kernel.multiplicity;
+      op_types.insert(kernel.op_type);
+    }
+
+  std::cout << std::left << std::setw(14) << "Commit" << std::setw(14)
+            << "LLVM" << std::setw(21) << "Date" << std::right
+            << std::setw(16) << "Total" << std::setw(10) << "Step";
+  for (const std::string &op_type : op_types)
+    std::cout << std::setw(16) << op_type;
+  std::cout << "\n";
+  for (size_t p = 0; p < points.size(); p++) {
+    std::cout << std::left << std::setw(14) << short_commit(points[p].commit)
+              << std::setw(14) << short_commit(points[p].llvm_commit)
+              << std::setw(21) << points[p].date << std::right
+              << std::setw(16) << totals[p]["total"];
+    if (p == 0)
+      std::cout << std::setw(10) << "";
+    else
+      std::cout << std::setw(9) << std::fixed << std::setprecision(1)
+                << slowdown(metric, totals[p - 1]["total"],
+                            totals[p]["total"]) *
+                       100.0
+                << "%" << std::defaultfloat << std::setprecision(6);
+    for (const std::string &op_type : op_types)
+      std::cout << std::setw(16) << totals[p][op_type];
+    std::cout << "\n";
+  }
+
+  // Kernel steps between consecutive commits, matched by hash
+  struct Step {
+    std::string op_type, kernel, from, to;
+    double before, after, change;
+  };
+  std::vector<Step> steps;
+  for (size_t p = 1; p < points.size(); p++)
+    for (const auto &[hash, kernel] : points[p].kernels) {
+      auto previous = points[p - 1].kernels.find(hash);
+      if (previous == points[p - 1].kernels.end())
+        continue;
+      steps.push_back({kernel.op_type, kernel.kernel,
+                       short_commit(points[p - 1].commit),
+                       short_commit(points[p].commit),
+                       previous->second.median, kernel.median,
+                       slowdown(metric, previous->second.median,
+                                kernel.median)});
+    }
+  std::stable_sort(steps.begin(), steps.end(),
+                   [](const Step &a, const Step &b) {
+                     return a.change > b.change;
+                   });
+  if (!steps.empty() && query.top_kernels) {
+    std::cout << "Largest kernel slowdowns between consecutive commits:\n";
+    for (size_t s = 0; s < std::min(query.top_kernels, steps.size()); s++) {
+      if (steps[s].change <= 0.0)
+        break;
+      std::cout << "  " << std::left << std::setw(40)
+                << steps[s].op_type + "/" + steps[s].kernel << steps[s].from
+                << " -> " << steps[s].to << std::right << std::setw(14)
+                << steps[s].before << " -> " << steps[s].after << " (+"
+                << std::fixed << std::setprecision(1)
+                << steps[s].change * 100.0 << "%)" << std::defaultfloat
+                << std::setprecision(6) << "\n";
+    }
+  }
+
+  std::error_code ec;
+  fs::create_directories(output_dir, ec);
+  std::ofstream op_csv(fs::path(output_dir).append("trend_op_types.csv"));
+  std::ofstream kernel_csv(fs::path(output_dir).append("trend_kernels.csv"));
+  if (!op_csv.is_open() || !kernel_csv.is_open()) {
+    std::cerr << "Error: Could not write the trend CSVs to " << output_dir
+              << "\n";
+    return false;
+  }
+  op_csv << "commit,llvm_commit,date,op_type," << metric << "\n";
+  kernel_csv << "commit,llvm_commit,date,op_type,kernel,hash,multiplicity,"
+             << metric << "\n";
+  for (size_t p = 0; p < points.size(); p++) {
+    const TrendPoint &point = points[p];
+    std::string prefix =
+        point.commit + "," + point.llvm_commit + "," + point.date + ",";
+    for (const auto &[op_type, total] : totals[p])
+      op_csv << prefix << op_type << "," << total << "\n";
+    for (const auto &[hash, kernel] : point.kernels)
+      kernel_csv << prefix << kernel.op_type << "," << kernel.kernel << ","
+                 << hash << "," << kernel.multiplicity << "," << kernel.median
+                 << "\n";
+  }
+  std::cout << "Trend written to " << fs::path(output_dir).append("trend_*.csv")
+            << "\n";
+  return true;
+}
@@ -0,0 +1,54 @@
+#include "tsc_clock.h"
+
+#include <thread>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+bool TscClock::invariant() {
+#if defined(__x86_64__) || defined(__i386__)
+  // CPUID 0x80000007, EDX bit 8: the TSC runs at a constant rate in all
+  // ACPI P-, C- and T-states
+  unsigned int eax, ebx, ecx, edx;
+  if (__get_cpuid_max(0x80000000, nullptr) < 0x80000007)
+    return false;
+  __cpuid(0x80000007, eax, ebx, ecx, edx);
+  return edx & (1u << 8);
+#else
+  return true;
+#endif
+}
+
+static double calibrate() {
+#if defined(__x86_64__) || defined(__i386__)
+  // Best of a few short windows, the one least disturbed by preemption
+  // between the paired reads
+  double best = 0.0;
+  for (int window = 0; window < 3; window++) {
+    auto steady_start = std::chrono::steady_clock::now();
+    uint64_t tsc_start = TscClock::start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    uint64_t tsc_stop = TscClock::stop();
+    auto steady_stop = std::chrono::steady_clock::now();
+    double ns = std::chrono::duration<double, std::nano>(steady_stop -
+                                                         steady_start)
+                    .count();
+    double ns_per_tick = ns / static_cast<double>(tsc_stop - tsc_start);
+    if (best == 0.0 || ns_per_tick < best)
+      best = ns_per_tick;
+  }
+  return best;
+#elif defined(__aarch64__)
+  uint64_t frequency;
+  asm volatile("mrs %0, cntfrq_el0" : "=r"(frequency));
+  return 1e9 / static_cast<double>(frequency);
+#else
+  return 1.0;
+#endif
+}
+
+double TscClock::ns_per_tick() {
+  static const double calibrated = calibrate();
+  return calibrated;
+}
@@ -1,9 +1,19 @@
 #pragma once
 
 #include "utils.h"
+#include <algorithm>
 #include <cassert>
 #include <cstdint>
+#include <cstring>
+#include <iomanip>
 #include <sstream>
+#include <thread>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#endif
 
 using std::ostringstream;
 
@@ -13,6 +23,16 @@ void from_json(const json &j, JSONArgument &a) {
   j.at("dtype").get_to(a.dtype);
   j.at("rank").get_to(a.rank);
   j.at("shape").get_to(a.shape);
+  if (j.contains("strides"))
+    j.at("strides").get_to(a.strides);
+  if (j.contains("offset"))
+    j.at("offset").get_to(a.offset);
+  if (j.contains("layout"))
+    j.at("layout").get_to(a.layout);
+  if (j.contains("data_order"))
+    j.at("data_order").get_to(a.data_order);
+  if (j.contains("sparse"))
+    j.at("sparse").get_to(a.sparse_format);
 }
 
 json load_json_from_file(const fs::path &filePath) {
@@ -28,6 +48,8 @@ json load_json_from_file(const fs::path &filePath) {
  */
 MemRefArg::MemRefArg(const int &tensor_rank) {
   this->m_tensor_rank = tensor_rank;
+  this->m_tensor_elem_count = 0;
+  this->m_buffer_elem_count = 0;
   this->m_desc = new MemRefDescriptor();
 }
 
@@ -55,22 +77,25 @@ MemRefArg::MemRefArg(std::initializer_list<uint64_t> dimension_list) {
   }
 
   this->m_tensor_elem_count = accum;
+  this->m_buffer_elem_count = accum;
 
   this->m_desc->dimension = dimension_data;
   this->m_desc->strides = stride_data;
   this->m_desc->offset = 0;
 
   // Data has to be explicitly set
-  this->m_desc->base_ptr = malloc(sizeof(float) * m_tensor_elem_count);
-  this->m_desc->aligned_ptr = malloc(sizeof(float) * m_tensor_elem_count);
+  this->m_desc->base_ptr = nullptr;
+  this->m_desc->aligned_ptr = nullptr;
 }
 
 // Loading MemRefArg structure details based on JSON Argument loaded, and
 // allocating required buffers
 MemRefArg::MemRefArg(const JSONArgument &argument_data) {
-  assert(argument_data.shape.size() > 0);
+  // Rank 0 tensors (scalars) have an empty shape
+  assert(argument_data.shape.size() == argument_data.rank);
 
   this->m_tensor_rank = argument_data.rank;
+  this->m_elem_type = ElementTypes::parse(argument_data.dtype);
   this->m_desc = new MemRefDescriptor();
 
   int64_t *dimension_data =
@@ -89,17 +114,36 @@ MemRefArg::MemRefArg(const JSONArgument &argument_data) {
   }
   this->m_tensor_elem_count = accum;
 
+  // Explicit layouts replace the row major strides
+  if (argument_data.strides.size() == argument_data.shape.size())
+    for (size_t i = 0; i < argument_data.shape.size(); i++)
+      stride_data[i] = argument_data.strides[i];
+
   this->m_desc->dimension = dimension_data;
   this->m_desc->strides = stride_data;
-  this->m_desc->offset = 0;
+  this->m_desc->offset = argument_data.offset;
+
+  int64_t last = argument_data.offset;
+  for (size_t i = 0; i < argument_data.shape.size(); i++)
+    last += (dimension_data[i] > 0 ? dimension_data[i] - 1 : 0) *
+            stride_data[i];
+  this->m_buffer_elem_count = accum > 0 ? last + 1 : 0;
 
   // Data has to be explicitly set
-  this->m_desc->base_ptr = malloc(sizeof(float) * m_tensor_elem_count);
-  this->m_desc->aligned_ptr = malloc(sizeof(float) * m_tensor_elem_count);
+  this->m_desc->base_ptr = nullptr;
+  this->m_desc->aligned_ptr = nullptr;
   m_desc_size = -1;     // Unknown
   m_desc_alignment = 8; // Assuming by default
 }
 
+MemRefArg::~MemRefArg() {
+  if (m_owns_data)
+    free(m_desc->base_ptr);
+  free(m_desc->dimension);
+  free(m_desc->strides);
+  delete m_desc;
+}
+
 void MemRefArg::printState() {
   std::cout << "Tensor Rank: " << m_tensor_rank << std::endl;
 
@@ -121,7 +165,9 @@ void MemRefArg::printState() {
   if (m_desc->base_ptr != nullptr) {
     std::cout << "Data Values: [";
     for (int i = 0; i < m_tensor_elem_count; i++) {
-      std::cout << ((float *)m_desc->base_ptr)[i] << ",";
+      std::cout << ElementTypes::load(m_desc->aligned_ptr,
+                                      get_element_position(i), m_elem_type)
+                << ",";
     }
   }
 }
@@ -151,7 +197,10 @@ bool MemRefArg::extractDescFromFFIPtr(void *ffi_returned_ptr) {
     return false;
   }
 
-  this->setData((float *)(*desc_ptr), *offset_ptr);
+  // Kernel owned buffer: base, aligned and offset are kept as returned
+  this->setData((void *)desc_ptr[0]);
+  m_desc->aligned_ptr = (void *)desc_ptr[1];
+  m_desc->offset = *offset_ptr;
 
   // Pointer to first dimension value returned
   int64_t *iterator_ptr = (desc_ptr + 3);
@@ -166,11 +215,48 @@ bool MemRefArg::extractDescFromFFIPtr(void *ffi_returned_ptr) {
   return true;
 }
 
-void MemRefArg::setData(void *data_ptr, const uint64_t &offset) {
-  if (m_desc->base_ptr)
+bool MemRefArg::validate_descriptor(
+    const std::vector<uint64_t> &expected_shape, std::string &error) {
+  if (expected_shape.size() != static_cast<size_t>(m_tensor_rank)) {
+    error = "rank mismatch";
+    return false;
+  }
+  for (int i = 0; i < m_tensor_rank; i++) {
+    if (m_desc->dimension[i] != (int64_t)expected_shape[i]) {
+      error = "dimension " + std::to_string(i) + " is " +
+              std::to_string(m_desc->dimension[i]) + ", expected " +
+              std::to_string(expected_shape[i]);
+      return false;
+    }
+    if (m_desc->strides[i] < 0) {
+      error = "negative stride in dimension " + std::to_string(i);
+      return false;
+    }
+  }
+
+  // Empty tensors are allowed to come back without a buffer
+  if (m_tensor_elem_count == 0)
+    return true;
+  if (m_desc->base_ptr == nullptr || m_desc->aligned_ptr == nullptr) {
+    error = "null buffer pointer";
+    return false;
+  }
+  if (m_desc->aligned_ptr < m_desc->base_ptr) {
+    error = "aligned pointer precedes the allocation";
+    return false;
+  }
+  if (m_desc->offset < 0) {
+    error = "negative offset";
+    return false;
+  }
+  return true;
+}
+
+void MemRefArg::setData(void *data_ptr, const uint64_t &offset,
+                        bool take_ownership) {
+  if (m_owns_data && m_desc->base_ptr != data_ptr)
     free(m_desc->base_ptr);
-  if (m_desc->aligned_ptr)
-    free(m_desc->aligned_ptr);
+  m_owns_data = take_ownership;
 
   m_desc->base_ptr = data_ptr;
   m_desc->aligned_ptr = (void *)((char *)data_ptr + offset);
@@ -188,8 +274,50 @@ void *MemRefArg::getDataAligned() { return m_desc->aligned_ptr; }
 
 int MemRefArg::get_tensor_elem_count() { return m_tensor_elem_count; }
 
+int64_t MemRefArg::get_buffer_elem_count() { return m_buffer_elem_count; }
+
+size_t MemRefArg::get_elem_size() { return ElementTypes::size(m_elem_type); }
+
 int64_t MemRefArg::get_tensor_rank() { return m_tensor_rank; }
 
+int64_t MemRefArg::get_element_position(int64_t linear_index) {
+  int64_t position = m_desc->offset;
+  for (int i = m_tensor_rank - 1; i >= 0; i--) {
+    int64_t dim = m_desc->dimension[i];
+    if (dim <= 0)
+      break;
+    position += (linear_index % dim) * m_desc->strides[i];
+    linear_index /= dim;
+  }
+  return position;
+}
+
+std::vector<uint8_t> MemRefArg::dense_copy() {
+  size_t elem_size = get_elem_size();
+  std::vector<uint8_t> dense(m_tensor_elem_count * elem_size);
+  const uint8_t *data = static_cast<const uint8_t *>(m_desc->aligned_ptr);
+  if (!data || dense.empty())
+    return dense;
+
+  // Dense tensors are a single copy
+  bool is_dense = true;
+  int64_t expected_stride = 1;
+  for (int i = m_tensor_rank - 1; i >= 0 && is_dense; i--) {
+    is_dense =
+        m_desc->dimension[i] <= 1 || m_desc->strides[i] == expected_stride;
+    expected_stride *= m_desc->dimension[i];
+  }
+  if (is_dense) {
+    std::memcpy(dense.data(), data + m_desc->offset * elem_size, dense.size());
+    return dense;
+  }
+
+  for (int64_t i = 0; i < m_tensor_elem_count; i++)
+    std::memcpy(dense.data() + i * elem_size,
+                data + get_element_position(i) * elem_size, elem_size);
+  return dense;
+}
+
 std::string get_timestamp_string() {
   auto now = std::chrono::system_clock::now();
   auto now_time_t = std::chrono::system_clock::to_time_t(now);
@@ -202,3 +330,173 @@ std::string get_timestamp_string() {
       local_tm, "%Y-%m-%d_%H%M%S"); // Example format: YYYY-MM-DD HH:MM:SS
   return oss.str();
 }
+
+uint64_t hash_string(const std::string &data, uint64_t seed) {
+  uint64_t hash = seed;
+  for (unsigned char c : data) {
+    hash ^= c;
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+uint64_t hash_file_contents(const fs::path &filepath, uint64_t seed) {
+  std::ifstream f(filepath, std::ios::binary);
+  std::ostringstream contents;
+  contents << f.rdbuf();
+  return hash_string(contents.str(), seed);
+}
+
+double parse_duration(const std::string &text) {
+  size_t used = 0;
+  double value;
+  try {
+    value = std::stod(text, &used);
+  } catch (const std::exception &) {
+    return -1.0;
+  }
+  std::string unit = text.substr(used);
+  if (unit.empty() || unit == "s")
+    return value;
+  if (unit == "m")
+    return value * 60.0;
+  if (unit == "h")
+    return value * 3600.0;
+  return -1.0;
+}
+
+std::string hash_to_hex(uint64_t hash) {
+  std::ostringstream oss;
+  oss << std::hex << std::setw(16) << std::setfill('0') << hash;
+  return oss.str();
+}
+
+int get_online_cpu_count() {
+  unsigned int count = std::thread::hardware_concurrency();
+  return count ? count : 1;
+}
+
+std::vector<int> get_online_cpus() {
+  std::vector<int> cpus;
+#ifdef __linux__
+  try {
+    cpus = parse_cpu_list(read_line("/sys/devices/system/cpu/online"));
+  } catch (const std::exception &) {
+    cpus.clear();
+  }
+#endif
+  if (cpus.empty())
+    for (int cpu = 0; cpu < get_online_cpu_count(); cpu++)
+      cpus.push_back(cpu);
+  return cpus;
+}
+
+bool pin_current_thread(int cpu) {
+#ifdef __linux__
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  CPU_SET(cpu, &cpu_set);
+  return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpu_set) ==
+         0;
+#else
+  return false;
+#endif
+}
+
+bool pin_current_thread_excluding(int cpu) {
+#ifdef __linux__
+  std::vector<int> cpus = get_online_cpus();
+  if (cpus.size() < 2)
+    return false;
+
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  for (int online : cpus) {
+    if (online != cpu)
+      CPU_SET(online, &cpu_set);
+  }
+  return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpu_set) ==
+         0;
+#else
+  return false;
+#endif
+}
+
+bool pin_current_thread_range(int first_cpu, int count) {
+#ifdef __linux__
+  std::vector<int> cpus = get_online_cpus();
+  if (cpus.empty() || count < 1)
+    return false;
+
+  // Offline and missing ids are skipped, not wrapped into
+  size_t first = std::lower_bound(cpus.begin(), cpus.end(), first_cpu) -
+                 cpus.begin();
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  for (size_t i = 0; i < std::min<size_t>(count, cpus.size()); i++)
+    CPU_SET(cpus[(first + i) % cpus.size()], &cpu_set);
+  return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpu_set) ==
+         0;
+#else
+  return false;
+#endif
+}
+
+bool pin_current_thread_to(const std::vector<int> &cpus) {
+#ifdef __linux__
+  if (cpus.empty())
+    return false;
+
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  for (int cpu : cpus)
+    CPU_SET(cpu, &cpu_set);
+  return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpu_set) ==
+         0;
+#else
+  return false;
+#endif
+}
+
+std::string read_line(const fs::path &filepath) {
+  std::ifstream file(filepath);
+  std::string line;
+  std::getline(file, line);
+  return line;
+}
+
+int package_of(int cpu) {
+  std::string id = read_line("/sys/devices/system/cpu/cpu" +
+                             std::to_string(cpu) +
+                             "/topology/physical_package_id");
+  return id.empty() ? 0 : std::stoi(id);
+}
+
+std::vector<int> parse_cpu_list(const std::string &list) {
+  std::vector<int> cpus;
+  std::stringstream stream(list);
+  for (std::string range; std::getline(stream, range, ',');) {
+    if (range.empty())
+      continue;
+    size_t dash = range.find('-');
+    int first = std::stoi(range.substr(0, dash));
+    int last = dash == std::string::npos ? first
+                                         : std::stoi(range.substr(dash + 1));
+    for (int cpu = first; cpu <= last; cpu++)
+      cpus.push_back(cpu);
+  }
+  return cpus;
+}
+
+uint64_t current_rss_bytes() {
+#ifdef __linux__
+  // Second field of statm: resident pages
+  std::ifstream statm("/proc/self/statm");
+  uint64_t total_pages = 0, resident_pages = 0;
+  if (!(statm >> total_pages >> resident_pages))
+    return 0;
+  return resident_pages * static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+#else
+  return 0;
+#endif
+}
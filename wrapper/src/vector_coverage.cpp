@@ -0,0 +1,289 @@
+#include "vector_coverage.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <regex>
+#include <sstream>
+
+// "%5 = fmul contract <8 x float> %3, %4", "fneg double %x"
+static const std::regex IR_FP_OP(
+    R"(\b(fadd|fsub|fmul|fdiv|frem|fneg)\s+(?:[a-z]+\s+)*(<(\d+) x (half|bfloat|float|double)>|half|bfloat|float|double)(?![a-z0-9]))");
+// "call fast <4 x double> @llvm.fmuladd.v4f64(", "call float @llvm.fma.f32("
+static const std::regex IR_FP_CALL(
+    R"(\bcall\s+(?:[a-z]+\s+)*(<(\d+) x (half|bfloat|float|double)>|half|bfloat|float|double)\s+@llvm\.)");
+// "load <8 x float>, ptr", "store <8 x float> %v, ptr"
+static const std::regex IR_VECTOR_MEMORY(
+    R"(\b(?:load|store)\s+(?:volatile\s+)?<(\d+) x [a-z0-9]+>)");
+
+// One line of objdump -d: "    1a40:\tvfmadd231ps %ymm1,%ymm2,%ymm0"
+static const std::regex OBJDUMP_LINE(
+    R"(^\s*([0-9a-f]+):\s+([a-z][a-z0-9.]*)\s*(.*)$)");
+// SSE/AVX arithmetic: <op><p|s><s|d|h>, with or without the VEX v
+static const std::regex X86_FP(
+    R"(^v?(add|sub|mul|div|min|max|sqrt|rcp\d*|rsqrt\d*|round|rndscale|dp|hadd|hsub|addsub|f[n]?m(add|sub)(sub|add)?\d*)(p|s)(s|d|h)$)");
+static const std::regex AARCH64_FP(
+    R"(^f(add|sub|mul|div|mla|mls|madd|msub|nmadd|nmsub|max|min|maxnm|minnm|sqrt|neg|abs|addp|mulx)$)");
+// AArch64 NEON lanes "v3.4s" and SVE "z3.s"
+static const std::regex NEON_REGISTER(R"(\bv\d+\.(\d+)([bhsd])\b)");
+static const std::regex SVE_REGISTER(R"(\bz\d+\.[bhsd]\b)");
+static const std::regex BRANCH_TARGET(R"(^\s*([0-9a-f]+)\b)");
+
+static int element_bits(const std::string &type) {
+  if (type == "double" || type == "d")
+    return 64;
+  if (type == "half" || type == "bfloat" || type == "h")
+    return 16;
+  if (type == "b")
+    return 8;
+  return 32;
+}
+
+fs::path VectorCoverage::filepath(const fs::path &ll_filepath) {
+  return fs::path(ll_filepath).replace_extension(".vectorization.json");
+}
+
+json VectorCoverage::analyse_ir(const std::string &ll_text) {
+  size_t vector_fp = 0, scalar_fp = 0, vector_memory = 0;
+  int max_bits = 0;
+  std::stringstream lines(ll_text);
+  std::smatch match;
+  for (std::string line; std::getline(lines, line);) {
+    // Declarations of intrinsics are not ops
+    if (line.rfind("declare", 0) == 0)
+      continue;
+    bool fp = std::regex_search(line, match, IR_FP_OP);
+    // Groups of the call pattern are one to the left
+    size_t offset = 0;
+    if (!fp && std::regex_search(line, match, IR_FP_CALL)) {
+      fp = true;
+      offset = 1;
+    }
+    if (fp) {
+      if (match[3 - offset].matched) {
+        vector_fp++;
+        max_bits = std::max(max_bits,
+                            std::stoi(match[3 - offset].str()) *
+                                element_bits(match[4 - offset].str()));
+      } else {
+        scalar_fp++;
+      }
+    }
+    if (std::regex_search(line, match, IR_VECTOR_MEMORY))
+      vector_memory++;
+  }
+  return {{"vector_fp", vector_fp},
+          {"scalar_fp", scalar_fp},
+          {"vector_memory", vector_memory},
+          {"max_vector_bits", max_bits}};
+}
+
+namespace {
+struct Instruction {
+  uint64_t address = 0;
+  std::string mnemonic;
+  std::string operands;
+  bool vector_fp = false, scalar_fp = false;
+  bool vector_register = false, memory = false;
+  int vector_bits = 0;
+  int64_t branch_target = -1; // Direct branches only
+};
+} // namespace
+
+static Instruction classify(uint64_t address, const std::string &mnemonic,
+                            const std::string &operands) {
+  Instruction instruction{address, mnemonic, operands};
+  // x86-64 in AT&T syntax, widest register named
+  for (auto [name, bits] : {std::pair<const char *, int>{"%zmm", 512},
+                            {"%ymm", 256},
+                            {"%xmm", 128}})
+    if (operands.find(name) != std::string::npos) {
+      instruction.vector_register = true;
+      instruction.vector_bits = bits;
+      break;
+    }
+  std::smatch match;
+  if (std::regex_search(operands, match, NEON_REGISTER)) {
+    instruction.vector_register = true;
+    instruction.vector_bits =
+        std::stoi(match[1].str()) * element_bits(match[2].str());
+  } else if (std::regex_search(operands, SVE_REGISTER)) {
+    // Vector length agnostic, 128 bits at least
+    instruction.vector_register = true;
+    instruction.vector_bits = 128;
+  }
+  instruction.memory = operands.find('(') != std::string::npos ||
+                       operands.find('[') != std::string::npos;
+
+  if (std::regex_match(mnemonic, match, X86_FP)) {
+    instruction.vector_fp = match[4].str() == "p";
+    instruction.scalar_fp = !instruction.vector_fp;
+  } else if (std::regex_match(mnemonic, AARCH64_FP)) {
+    instruction.vector_fp = instruction.vector_register;
+    instruction.scalar_fp = !instruction.vector_register;
+  }
+  // Scalar SSE ops name xmm registers without using their width
+  if (instruction.scalar_fp)
+    instruction.vector_bits = 0;
+
+  bool branch = mnemonic[0] == 'j' || mnemonic == "b" ||
+                mnemonic.rfind("b.", 0) == 0 || mnemonic == "cbz" ||
+                mnemonic == "cbnz" || mnemonic == "tbz" || mnemonic == "tbnz";
+  if (branch && std::regex_search(operands, match, BRANCH_TARGET))
+    instruction.branch_target = std::stoll(match[1].str(), nullptr, 16);
+  return instruction;
+}
+
+json VectorCoverage::analyse_object(const std::string &disassembly) {
+  std::vector<Instruction> instructions;
+  std::stringstream lines(disassembly);
+  std::smatch match;
+  for (std::string line; std::getline(lines, line);)
+    if (std::regex_match(line, match, OBJDUMP_LINE))
+      instructions.push_back(classify(std::stoull(match[1].str(), nullptr, 16),
+                                      match[2].str(), match[3].str()));
+
+  size_t vector_fp = 0, scalar_fp = 0;
+  int max_bits = 0;
+  for (const Instruction &instruction : instructions) {
+    vector_fp += instruction.vector_fp;
+    scalar_fp += instruction.scalar_fp;
+    if (instruction.vector_register && !instruction.scalar_fp)
+      max_bits = std::max(max_bits, instruction.vector_bits);
+  }
+  json object = {{"vector_fp", vector_fp},
+                 {"scalar_fp", scalar_fp},
+                 {"max_vector_bits", max_bits},
+                 {"instructions", instructions.size()}};
+
+  // Loops: backward branches, [target, branch]. The innermost ones hold no
+  // other back edge, the hot one is the innermost with the most FP work.
+  std::vector<std::pair<size_t, size_t>> loops;
+  for (size_t i = 0; i < instructions.size(); i++) {
+    int64_t target = instructions[i].branch_target;
+    if (target < 0 || uint64_t(target) > instructions[i].address)
+      continue;
+    size_t first = i;
+    while (first > 0 && instructions[first - 1].address >= uint64_t(target))
+      first--;
+    loops.emplace_back(first, i);
+  }
+  auto innermost = [&](const std::pair<size_t, size_t> &loop) {
+    for (const auto &other : loops)
+      if (other != loop && other.first >= loop.first &&
+          other.second < loop.second)
+        return false;
+    return true;
+  };
+  const std::pair<size_t, size_t> *hot = nullptr;
+  size_t hot_fp = 0;
+  for (const auto &loop : loops) {
+    if (!innermost(loop))
+      continue;
+    size_t fp = 0;
+    for (size_t i = loop.first; i <= loop.second; i++)
+      fp += instructions[i].vector_fp + instructions[i].scalar_fp;
+    if (!hot || fp > hot_fp) {
+      hot = &loop;
+      hot_fp = fp;
+    }
+  }
+
+  json hot_loop = nullptr;
+  if (hot) {
+    std::map<std::string, size_t> mix = {
+        {"vector_fp", 0},     {"scalar_fp", 0}, {"vector_memory", 0},
+        {"scalar_memory", 0}, {"branch", 0},    {"other", 0}};
+    for (size_t i = hot->first; i <= hot->second; i++) {
+      const Instruction &instruction = instructions[i];
+      if (instruction.vector_fp)
+        mix["vector_fp"]++;
+      else if (instruction.scalar_fp)
+        mix["scalar_fp"]++;
+      else if (instruction.memory)
+        mix[instruction.vector_register ? "vector_memory" : "scalar_memory"]++;
+      else if (instruction.branch_target >= 0)
+        mix["branch"]++;
+      else
+        mix["other"]++;
+    }
+    std::ostringstream start, end;
+    start << std::hex << instructions[hot->first].address;
+    end << std::hex << instructions[hot->second].address;
+    hot_loop = {{"start", start.str()},
+                {"end", end.str()},
+                {"instructions", hot->second - hot->first + 1},
+                {"mix", mix}};
+  }
+  object["hot_loop"] = hot_loop;
+  return object;
+}
+
+bool VectorCoverage::write(const fs::path &ll_filepath,
+                           const std::string &disassembly) {
+  std::ifstream ll_file(ll_filepath);
+  if (!ll_file.is_open()) {
+    std::cerr << "No LLVM IR at " << ll_filepath
+              << ", no vectorization report\n";
+    return false;
+  }
+  std::stringstream ll_text;
+  ll_text << ll_file.rdbuf();
+
+  json report = {{"ir", VectorCoverage::analyse_ir(ll_text.str())},
+                 {"object", nullptr}};
+  if (!disassembly.empty())
+    report["object"] = VectorCoverage::analyse_object(disassembly);
+
+  fs::path json_filepath = VectorCoverage::filepath(ll_filepath);
+  std::ofstream file(json_filepath);
+  if (!file.is_open()) {
+    std::cerr << "Error: Could not open " << json_filepath
+              << " for writing.\n";
+    return false;
+  }
+  file << report.dump(1) << "\n";
+  return true;
+}
+
+std::map<std::string, double>
+VectorCoverage::columns(const fs::path &ll_filepath) {
+  std::ifstream file(VectorCoverage::filepath(ll_filepath));
+  if (!file.is_open())
+    return {};
+  json report = json::parse(file, nullptr, false);
+  if (!report.is_object())
+    return {};
+
+  std::map<std::string, double> columns;
+  for (const std::string &name : VectorCoverage::column_names())
+    columns[name] = 0.0;
+  const json &ir = report["ir"];
+  columns["vec_ir_vector_fp"] = ir.value("vector_fp", 0.0);
+  columns["vec_ir_scalar_fp"] = ir.value("scalar_fp", 0.0);
+  columns["vec_ir_max_bits"] = ir.value("max_vector_bits", 0.0);
+  double vector_fp = columns["vec_ir_vector_fp"];
+  double scalar_fp = columns["vec_ir_scalar_fp"];
+  const json &object = report["object"];
+  if (object.is_object()) {
+    columns["vec_obj_vector_fp"] = vector_fp = object.value("vector_fp", 0.0);
+    columns["vec_obj_scalar_fp"] = scalar_fp = object.value("scalar_fp", 0.0);
+    columns["vec_obj_max_bits"] = object.value("max_vector_bits", 0.0);
+    const json &hot_loop = object["hot_loop"];
+    if (hot_loop.is_object()) {
+      columns["vec_loop_vector_fp"] = hot_loop["mix"].value("vector_fp", 0.0);
+      columns["vec_loop_scalar_fp"] = hot_loop["mix"].value("scalar_fp", 0.0);
+      columns["vec_loop_instructions"] = hot_loop.value("instructions", 0.0);
+    }
+  }
+  columns["vec_fraction"] =
+      vector_fp + scalar_fp > 0.0 ? vector_fp / (vector_fp + scalar_fp) : 0.0;
+  return columns;
+}
+
+std::vector<std::string> VectorCoverage::column_names() {
+  return {"vec_ir_vector_fp",   "vec_ir_scalar_fp",   "vec_ir_max_bits",
+          "vec_obj_vector_fp",  "vec_obj_scalar_fp",  "vec_obj_max_bits",
+          "vec_fraction",       "vec_loop_vector_fp", "vec_loop_scalar_fp",
+          "vec_loop_instructions"};
+}
@@ -1,264 +1,10 @@
-#include "nlohmann/json_fwd.hpp"
-#include <Python.h>
-#include <argparse/argparse.hpp>
-#include <cassert>
-#include <cstdint>
-#include <cstdlib>
-#include <exception>
-#include <filesystem>
-#include <fstream>
-#include <initializer_list>
-#include <iostream>
-#include <nlohmann/json.hpp>
-// #include <numpy/arrayobject.h>
-// #include <numpy/ndarraytypes.h>
-#include <sstream>
-#include <string>
-
-#include "command_manager.h"
-#include "utils.h"
-
-namespace fs = std::filesystem;
+#include "benchmark_session.h"
 
-// Type Alias
-using json = nlohmann::json;
+#include <string>
+#include <vector>
 
 int main(int argc, char **args) {
-  // Take argument as model name
-  // Input: <model-mlir-file>
-
-  std::cout << "We're entering here? " << std::endl;
-  argparse::ArgumentParser program("torch-metric-collector");
-
-  program.add_argument("-B", "--build-path")
-      .help("Path to a Torch MLIR build")
-      .required();
-
-  program.add_argument("--output-dir")
-      .help("Folder path to contain the output produced by the tool. "
-            "Must be an absolute path")
-      .default_value(fs::current_path().append(get_timestamp_string()));
-
-  program.add_argument("--pass-logs")
-      .help("Enables Pass lowering output in temp folder")
-      .default_value(false);
-
-  program.add_argument("--sample-count")
-      .help("No of sample runs for each kernel for aggregation")
-      .default_value(8);
-
-  program.add_argument("--sample-metrics")
-      .help("List of metrics to be collected for sample runs")
-      .default_value(std::vector<std::string>(
-          {"seconds", "cycles", "instructions", "cache-misses"}));
-
-  program.add_argument("--output-logs")
-      .help("Enables output logs for each kernel run")
-      .default_value(false);
-  // program.add_argument("--torch-mlir-build-path")
-  // .help("Path to a Torch MLIR build")
-  // .required();
-
-  program.add_argument("--cc")
-      .help("Path to compiler to be used for object file generation")
-      .default_value("/usr/bin/clang++");
-
-  program.add_argument("--pipeline")
-      .help("Path to pipeline specified in JSON file")
-      .default_value(fs::current_path().append("pipeline.json"));
-
-  program.add_argument("model-file")
-      .help("Torch-MLIR file for the model to be benchmarked")
-      .required();
-
-  try {
-    program.parse_args(argc, args);
-  } catch (const std::exception &err) {
-    std::cerr << err.what() << std::endl;
-    std::cerr << program;
-    return 1;
-  }
-
-  // For now, the torch and llvm setup are being built into the same build, so
-  // seperation at the interface level can be skipped for now
-  std::string buildPath = program.get<std::string>("--build-path");
-  std::vector<std::string> perf_metrics =
-      program.get<std::vector<std::string>>("--sample-metrics");
-  std::string pipelineJsonPath = program.get<std::string>("--pipeline");
-
-  std::string outputFolderPath = program.get<std::string>("--output-dir");
-
-  int sample_run_count = program.get<int>("--sample-count");
-  std::string compiler_path = program.get<std::string>("--cc");
-  std::string model_file = program.get<std::string>("model-file");
-
-  // Setting up the Command Manager
-  CommandManager::set_llvm_install_path(buildPath);
-  CommandManager::set_torch_install_path(buildPath);
-  CommandManager::set_compiler_executable(compiler_path);
-  CommandManager::set_output_folder(outputFolderPath);
-  CommandManager::set_pipeline_json_filepath(pipelineJsonPath);
-  CommandManager::set_perf_sample_run_count(sample_run_count);
-  CommandManager::set_perf_metrics(perf_metrics);
-  CommandManager::initialise_environment();
-
-  std::cout << "Pipeline path: " << pipelineJsonPath << std::endl;
-
-  // Lowering the model
-  CommandManager::isolate_torch_kernels(model_file);
-
-  // Test
-  std::vector<std::string> operation_types =
-      CommandManager::get_operation_types();
-  for (auto s : operation_types)
-    std::cout << "Operation Types: " << s << std::endl;
-
-  // Iterate over operator types detected in the source program
-  for (auto op_type : operation_types) {
-    // std::string op_type = fs::path(op_relative_path).filename();
-    // fs::path folder_path(fs::current_path().append("lowerings/" + op_type));
-    fs::path folder_path(CommandManager::get_lowering_folder().append(op_type));
-
-    // Get the list of outlined files
-    std::vector<std::string> kernel_vec =
-        CommandManager::get_file_list(folder_path);
-
-    // Iterate over all lowered files in the current operator type folder
-    // Tasks
-    //  1. Extract argument metadata
-    //  2. Lower to LLVM-IR
-    //  3. Create executable
-    //  4. Execute and Time it
-    //  5. Detect the corresponding python kernel and time it
-    //  6. Generate aggregate and comparative results
-
-    for (auto &kernel_file : kernel_vec) {
-      // std::cout << "This is kernel vec: " << kernel_file << std::endl;
-
-      fs::path mlirFilePath = fs::path(folder_path).append(kernel_file);
-      fs::path output_json =
-          fs::path(folder_path).append(kernel_file + ".json");
-
-      // Log file path for debugging purposes (just in case)
-      fs::path log_file = fs::path(folder_path)
-                              .parent_path()
-                              .append(std::string("gen_log_") +
-                                      mlirFilePath.filename().c_str() + ".log");
-
-      std::cout << "Generating Metadata: " << mlirFilePath << "\n";
-      CommandManager::generate_metadata_json(mlirFilePath, output_json);
-
-      // Lower the file to .ll format
-      fs::path ll_object = CommandManager::generate_ll_file(mlirFilePath);
-      // fs::path llvm_dialect_filepath =
-      //     CommandManager::lower_to_llvm_dialect(mlir_file_path);
-      //
-      // fs::path ll_object =
-      //     CommandManager::compile_llvm_dialect(llvm_dialect_filepath);
-
-      std::cout << "Starting Execution: \n";
-      std::vector<std::map<std::string, double>> results =
-          CommandManager::execute_with_parameters(ll_object, output_json);
-
-      // Each run
-
-      std::cout << std::left << std::setw(6) << "Run";
-      for (const auto &e : perf_metrics)
-        std::cout << std::setw(20) << e;
-      std::cout << "\n";
-
-      for (size_t i = 0; i < results.size(); ++i) {
-        std::cout << std::left << std::setw(6) << (i + 1);
-        for (const auto &e : perf_metrics) {
-          double val = results[i].count(e) ? results[i].at(e) : 0.0;
-          std::cout << std::setw(20) << val;
-        }
-        std::cout << "\n";
-      }
-
-      // --- Compute and print averages ---
-      std::cout << std::string(6 + 20 * perf_metrics.size(), '-') << "\n";
-      std::cout << std::left << std::setw(6) << "Avg";
-
-      std::map<std::string, double> sums;
-      for (const auto &r : results)
-        for (const auto &kv : r)
-          sums[kv.first] += kv.second;
-
-      for (const auto &e : perf_metrics)
-        std::cout << std::setw(20) << (sums[e] / sample_run_count);
-      std::cout << "\n";
-
-      // --- Write results to CSV ---
-      fs::path csvOutputPath = fs::path(outputFolderPath)
-                                   .append("timings")
-                                   .append(op_type)
-                                   .append(fs::path(mlirFilePath)
-                                               .replace_extension()
-                                               .filename()
-                                               .generic_string())
-                                   .replace_extension(".csv");
-      // Create path if it doesnt exist
-      if (!fs::is_directory(fs::path(csvOutputPath).parent_path())) {
-        fs::create_directories(fs::path(csvOutputPath).parent_path());
-        // std::cout << "Created output directory" << std::endl;
-      }
-
-      // std::cout << "CSV Path: " << csvOutputPath.generic_string() <<
-      // std::endl;
-      std::ofstream csv(csvOutputPath.generic_string());
-      if (!csv.is_open()) {
-        std::cerr << "Error: Could not open " + csvOutputPath.generic_string() +
-                         " for writing.\n";
-        return 1;
-      }
-
-      // Header
-      csv << "Run";
-      for (const auto &e : perf_metrics)
-        csv << "," << e;
-      csv << "\n";
-
-      // Data rows
-      for (size_t i = 0; i < results.size(); ++i) {
-        csv << (i + 1);
-        for (const auto &e : perf_metrics) {
-          double val = results[i].count(e) ? results[i].at(e) : 0.0;
-          csv << "," << val;
-        }
-        csv << "\n";
-      }
-
-      // Average row
-      csv << "Average";
-      for (const auto &e : perf_metrics)
-        csv << "," << (sums[e] / sample_run_count);
-      csv << "\n";
-
-      csv.close();
-      std::cout << "\nResults written to " + csvOutputPath.generic_string() +
-                       " ✅\n";
-      std::cout << "\n\n";
-
-      // auto aggregate_metrics = [&]() -> std::vector<float> {
-      //   for (auto &run_metrics : time_metrics) {
-      //   }
-      // };
-
-      // mlir_output, mlir_metrics =
-      // CommandManager::execute_with_parameters(ll_filepath, json_filename)
-      //
-      // py_output, python_metrics =
-      // CommandManager::execute_py_kernel(op_type)
-      //
-      // verifyOutputs(mlir_output, py_output)
-      //
-      // CommandManager::generate_comparative_results(mlir_metrics,
-      // python_metrics)
-    }
-    // Dump the aggregated output into a file
-  }
-
-  // Lowering command follows file structure
-  // lowerings/<type-of-op>/<kernel-name>.mlir
+  return BenchmarkSession(std::vector<std::string>(args + 1, args + argc),
+                          args[0])
+      .run();
 }
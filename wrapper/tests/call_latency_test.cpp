@@ -0,0 +1,69 @@
+#include "call_latency.h"
+#include "harness_tests.h"
+
+#include <cstdint>
+#include <limits>
+#include <string>
+
+HARNESS_TEST(call_latency, small_values_are_exact) {
+  LatencyHistogram histogram;
+  CHECK_EQ(histogram.count(), uint64_t(0));
+  CHECK_EQ(histogram.percentile(0.5), uint64_t(0));
+  for (uint64_t value : {5, 7, 9, 200})
+    histogram.record(value);
+  CHECK_EQ(histogram.count(), uint64_t(4));
+  CHECK_EQ(histogram.min(), uint64_t(5));
+  CHECK_EQ(histogram.max(), uint64_t(200));
+  CHECK_NEAR(histogram.mean(), 55.25, 1e-12);
+  CHECK_EQ(histogram.percentile(0.25), uint64_t(5));
+  CHECK_EQ(histogram.percentile(0.5), uint64_t(7));
+  CHECK_EQ(histogram.percentile(0.75), uint64_t(9));
+  CHECK_EQ(histogram.percentile(1.0), uint64_t(200));
+}
+
+/*
+ * 1000 has 10 bits, the top 8 select its bucket: [1000, 1003]. 5000 falls
+ * in [4992, 5023], reported up to the exact maximum.
+ */
+HARNESS_TEST(call_latency, bucket_edges) {
+  LatencyHistogram histogram;
+  for (uint64_t value : {1000, 1001, 1003, 5000})
+    histogram.record(value);
+  CHECK_EQ(histogram.percentile(0.5), uint64_t(1003));
+  CHECK_EQ(histogram.percentile(0.75), uint64_t(1003));
+  CHECK_EQ(histogram.percentile(0.99), uint64_t(5000));
+  CHECK_EQ(histogram.to_csv(),
+           std::string("low_ns,high_ns,count,percentile\n"
+                       "1000,1003,3,0.75\n"
+                       "4992,5000,1,1\n"));
+
+  std::map<std::string, double> summary = histogram.summary();
+  CHECK_EQ(summary.size(), LatencyHistogram::columns().size());
+  CHECK_NEAR(summary["call_p50_ns"], 1003.0, 0.0);
+  CHECK_NEAR(summary["call_max_ns"], 5000.0, 0.0);
+  CHECK_NEAR(summary["call_latency_calls"], 4.0, 0.0);
+}
+
+// A bucket is never wider than 1/128 of its values, up to the largest
+HARNESS_TEST(call_latency, relative_bucket_width) {
+  for (uint64_t value = 256; value < (uint64_t(1) << 40);
+       value = value * 3 + 1) {
+    LatencyHistogram histogram;
+    histogram.record(value);
+    histogram.record(value);
+    histogram.record(std::numeric_limits<uint64_t>::max());
+    uint64_t edge = histogram.percentile(0.5);
+    CHECK(edge >= value);
+    CHECK(edge - value <= value / 128);
+  }
+
+  LatencyHistogram largest;
+  largest.record(std::numeric_limits<uint64_t>::max());
+  CHECK_EQ(largest.percentile(0.5), std::numeric_limits<uint64_t>::max());
+  CHECK_EQ(largest.percentile(1.0), std::numeric_limits<uint64_t>::max());
+}
+
+HARNESS_TEST(call_latency, histogram_path) {
+  CHECK(LatencyHistogram::histogram_path("out", "linalg.matmul", "k0") ==
+        fs::path("out/call_latency/linalg.matmul/k0.hist.csv"));
+}
@@ -0,0 +1,114 @@
+/*
+ * Behaviour tests of the harness' logic, one <module>_test.cpp per module
+ *
+ * Runs every registered case (or those whose "group/case" name contains
+ * --filter) and exits with status 1 if any of them failed. Cases that need
+ * a tool this machine doesn't have report SKIP with the reason.
+ */
+#include "harness_tests.h"
+#include "argparse/argparse.hpp"
+
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+struct TestCase {
+  std::string name; // group/case
+  harness_tests::TestFn fn;
+};
+
+struct Skipped {
+  std::string reason;
+};
+
+std::vector<TestCase> &registry() {
+  static std::vector<TestCase> cases;
+  return cases;
+}
+
+size_t failures = 0;
+std::string current_scratch;
+} // namespace
+
+harness_tests::Registration::Registration(const char *group, const char *name,
+                                          TestFn fn) {
+  registry().push_back({std::string(group) + "/" + name, fn});
+}
+
+void harness_tests::fail(const char *file, int line,
+                         const std::string &message) {
+  failures++;
+  std::cerr << "  " << fs::path(file).filename().string() << ":" << line
+            << ": " << message << "\n";
+}
+
+void harness_tests::skip(const std::string &reason) { throw Skipped{reason}; }
+
+const std::string &harness_tests::scratch() {
+  if (current_scratch.empty()) {
+    current_scratch =
+        (fs::temp_directory_path() /
+         ("harness_tests_" + std::to_string(getpid())))
+            .string();
+    fs::create_directories(current_scratch);
+  }
+  return current_scratch;
+}
+
+int main(int argc, char **args) {
+  argparse::ArgumentParser program("HarnessTests");
+
+  program.add_argument("--filter")
+      .help("Only the cases whose group/case name contains this")
+      .default_value(std::string(""));
+
+  try {
+    program.parse_args(argc, args);
+  } catch (const std::exception &err) {
+    std::cerr << err.what() << std::endl;
+    std::cerr << program;
+    return 1;
+  }
+  std::string filter = program.get<std::string>("--filter");
+
+  size_t passed = 0, failed = 0, skipped = 0;
+  for (const TestCase &test : registry()) {
+    if (test.name.find(filter) == std::string::npos)
+      continue;
+    size_t failures_before = failures;
+    std::string outcome = "PASS";
+    try {
+      test.fn();
+    } catch (const Skipped &skip) {
+      outcome = "SKIP (" + skip.reason + ")";
+    } catch (const std::exception &err) {
+      harness_tests::fail(__FILE__, __LINE__,
+                          std::string("exception: ") + err.what());
+    }
+    if (failures > failures_before)
+      outcome = "FAIL";
+    std::printf("%-48s %s\n", test.name.c_str(), outcome.c_str());
+    if (outcome == "PASS")
+      passed++;
+    else if (outcome == "FAIL")
+      failed++;
+    else
+      skipped++;
+
+    if (!current_scratch.empty()) {
+      std::error_code ec;
+      fs::remove_all(current_scratch, ec);
+      current_scratch.clear();
+    }
+  }
+
+  std::printf("%zu passed, %zu failed, %zu skipped\n", passed, failed,
+              skipped);
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cmath>
+#include <sstream>
+#include <string>
+
+/*
+ * Behaviour tests of the harness (HarnessTests, tests/harness_tests.cpp)
+ *
+ * Each <module>_test.cpp registers its cases with HARNESS_TEST(group, case).
+ * CHECK and CHECK_NEAR record a failure and let the case carry on, skip()
+ * ends a case that needs a tool this machine doesn't have.
+ */
+namespace harness_tests {
+using TestFn = void (*)();
+
+struct Registration {
+  Registration(const char *group, const char *name, TestFn fn);
+};
+
+void fail(const char *file, int line, const std::string &message);
+
+// Ends the current case as skipped
+[[noreturn]] void skip(const std::string &reason);
+
+// A fresh directory of the current case, removed after it
+const std::string &scratch();
+
+template <typename A, typename B>
+std::string describe(const char *expression, const A &actual,
+                     const B &expected) {
+  std::ostringstream out;
+  out.precision(17);
+  out << expression << ": got " << actual << ", expected " << expected;
+  return out.str();
+}
+} // namespace harness_tests
+
+#define HARNESS_TEST(group, name)                                            \
+  static void group##_##name();                                              \
+  static harness_tests::Registration group##_##name##_registration(          \
+      #group, #name, group##_##name);                                        \
+  static void group##_##name()
+
+#define CHECK(condition)                                                     \
+  do {                                                                       \
+    if (!(condition))                                                        \
+      harness_tests::fail(__FILE__, __LINE__, #condition);                   \
+  } while (0)
+
+#define CHECK_EQ(actual, expected)                                           \
+  do {                                                                       \
+    auto actual_value = (actual);                                            \
+    auto expected_value = (expected);                                        \
+    if (!(actual_value == expected_value))                                   \
+      harness_tests::fail(__FILE__, __LINE__,                                \
+                          harness_tests::describe(#actual, actual_value,     \
+                                                  expected_value));          \
+  } while (0)
+
+#define CHECK_NEAR(actual, expected, tolerance)                              \
+  do {                                                                       \
+    double actual_value = (actual);                                          \
+    double expected_value = (expected);                                      \
+    if (!(std::fabs(actual_value - expected_value) <= (tolerance)))          \
+      harness_tests::fail(__FILE__, __LINE__,                                \
+                          harness_tests::describe(#actual, actual_value,     \
+                                                  expected_value));          \
+  } while (0)
@@ -0,0 +1,158 @@
+#include "harness_tests.h"
+#include "kernel_sampling.h"
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+static SampledKernel sampled(const std::string &stratum, const char *kernel,
+                             double size, bool measure) {
+  SampledKernel sample;
+  sample.op_type = stratum.substr(0, stratum.find('|'));
+  sample.kernel = kernel;
+  sample.stratum = stratum;
+  sample.size = size;
+  sample.sampled = measure;
+  return sample;
+}
+
+static KernelTask measured(const char *kernel, double seconds) {
+  KernelTask task;
+  task.mlir_filepath = kernel;
+  task.average_metrics["seconds"] = seconds;
+  return task;
+}
+
+// Elementwise kernel with one argument and result of `shape`
+static KernelTask relu(const std::string &name,
+                       const std::vector<uint64_t> &shape) {
+  fs::path folder = fs::path(harness_tests::scratch());
+  KernelTask task;
+  task.op_type = "relu";
+  task.mlir_filepath = folder / (name + ".mlir");
+  task.json_filepath = folder / (name + ".mlir.json");
+  task.metadata_ready = true;
+  std::ofstream(task.mlir_filepath) << "func.func @" << name << "()\n";
+  json tensor = {{"shape", shape}, {"dtype", "f32"}};
+  std::ofstream(task.json_filepath)
+      << json({{"kernel_call", {{"args", {tensor}}, {"returns", {tensor}}}}})
+             .dump();
+  return task;
+}
+
+HARNESS_TEST(kernel_sampling, parse_budget) {
+  double fraction = 0.0;
+  size_t count = 0;
+  CHECK(KernelSampling::parse("0.2", fraction, count));
+  CHECK_NEAR(fraction, 0.2, 0.0);
+  CHECK_EQ(count, size_t(0));
+  CHECK(KernelSampling::parse("40", fraction, count));
+  CHECK_NEAR(fraction, 0.0, 0.0);
+  CHECK_EQ(count, size_t(40));
+  CHECK(KernelSampling::parse("", fraction, count));
+  CHECK(!KernelSampling::parse("1.5", fraction, count));
+  CHECK(!KernelSampling::parse("-3", fraction, count));
+  CHECK(!KernelSampling::parse("ten", fraction, count));
+}
+
+/*
+ * Every stratum gets one kernel, the rest follow weight. A kernel heavier
+ * than an even share of its stratum is measured with certainty.
+ */
+HARNESS_TEST(kernel_sampling, plan_allocates_by_stratum) {
+  std::vector<KernelTask> tasks = {
+      relu("heavy", {1, 1000}), relu("small_a", {1, 1}),
+      relu("small_b", {1, 1}), relu("small_c", {1, 1}),
+      relu("rank4", {1, 1, 1, 5})};
+  SamplePlan plan = KernelSampling::plan(tasks, 0.0, 3);
+  CHECK_EQ(plan.kernels.size(), tasks.size());
+  CHECK_EQ(plan.strata, size_t(2));
+  CHECK_EQ(plan.sampled, size_t(3));
+  if (plan.kernels.size() != tasks.size())
+    return;
+  CHECK(plan.kernels[0].sampled && plan.kernels[0].certain);
+  CHECK(plan.kernels[4].sampled);
+  CHECK(plan.kernels[0].stratum != plan.kernels[4].stratum);
+  CHECK_EQ(plan.kernels[1].stratum, plan.kernels[0].stratum);
+  size_t small_sampled = 0;
+  for (size_t k = 1; k < 4; k++) {
+    small_sampled += plan.kernels[k].sampled;
+    CHECK(!plan.kernels[k].certain);
+  }
+  CHECK_EQ(small_sampled, size_t(1));
+
+  // The same model gets the same sample
+  SamplePlan again = KernelSampling::plan(tasks, 0.0, 3);
+  for (size_t k = 0; k < tasks.size(); k++)
+    CHECK_EQ(again.kernels[k].sampled, plan.kernels[k].sampled);
+
+  std::vector<KernelTask> kept = tasks;
+  CHECK_EQ(KernelSampling::apply(plan, kept), size_t(2));
+  CHECK_EQ(kept.size(), size_t(3));
+
+  // A fraction rounds up, and never samples less than one kernel
+  CHECK_EQ(KernelSampling::plan(tasks, 0.5, 0).sampled, size_t(3));
+  CHECK_EQ(KernelSampling::plan(tasks, 0.01, 0).sampled, size_t(1));
+  CHECK_EQ(KernelSampling::plan(tasks, 0.0, 100).sampled, tasks.size());
+}
+
+/*
+ * Ratio estimate: a stratum measured at 10 s per unit of size totals 10
+ * times its size. A stratum without measurements borrows its op type's
+ * ratio, a certain kernel counts exactly.
+ */
+HARNESS_TEST(kernel_sampling, extrapolates_ratio_estimates) {
+  SamplePlan plan;
+  plan.kernels = {sampled("matmul|a", "k1", 1.0, false),
+                  sampled("matmul|a", "k2", 2.0, true),
+                  sampled("matmul|a", "k3", 3.0, false),
+                  sampled("matmul|a", "k4", 4.0, true),
+                  sampled("matmul|b", "k5", 5.0, false),
+                  sampled("conv|c", "k6", 100.0, true)};
+  plan.kernels.back().certain = true;
+  std::vector<KernelTask> tasks = {measured("k2", 20.0),
+                                   measured("k4", 40.0),
+                                   measured("k6", 7.0)};
+
+  std::vector<Extrapolation> totals =
+      KernelSampling::extrapolate(plan, tasks, "seconds");
+  CHECK(!totals.empty());
+  if (totals.empty())
+    return;
+  const Extrapolation &model = totals.front();
+  CHECK_EQ(model.scope, std::string("model"));
+  CHECK_EQ(model.kernels, size_t(6));
+  CHECK_EQ(model.measured, size_t(3));
+  CHECK_NEAR(model.estimate, 100.0 + 50.0 + 7.0, 1e-9);
+  // The measurements fit the ratio exactly, nothing is uncertain
+  CHECK_NEAR(model.low, model.estimate, 1e-9);
+  CHECK_NEAR(model.high, model.estimate, 1e-9);
+  CHECK(model.bounded);
+
+  for (const Extrapolation &total : totals) {
+    if (total.scope == "matmul")
+      CHECK_NEAR(total.estimate, 150.0, 1e-9);
+    else if (total.scope == "matmul|b")
+      CHECK_NEAR(total.estimate, 50.0, 1e-9);
+    else if (total.scope == "conv|c")
+      CHECK_NEAR(total.estimate, 7.0, 1e-9);
+  }
+}
+
+// Scattered measurements widen the bounds around the estimate
+HARNESS_TEST(kernel_sampling, residuals_give_bounds) {
+  SamplePlan plan;
+  for (const char *kernel : {"k1", "k2", "k3", "k4", "k5", "k6"})
+    plan.kernels.push_back(sampled("matmul|a", kernel, 1.0, true));
+  plan.kernels[4].sampled = plan.kernels[5].sampled = false;
+  std::vector<KernelTask> tasks = {measured("k1", 1.0), measured("k2", 3.0),
+                                   measured("k3", 1.0), measured("k4", 3.0)};
+  std::vector<Extrapolation> totals =
+      KernelSampling::extrapolate(plan, tasks, "seconds");
+  CHECK(!totals.empty());
+  if (totals.empty())
+    return;
+  CHECK_NEAR(totals[0].estimate, 12.0, 1e-9);
+  CHECK(totals[0].low < 12.0 && totals[0].high > 12.0);
+  CHECK_NEAR(12.0 - totals[0].low, totals[0].high - 12.0, 1e-9);
+}
@@ -0,0 +1,138 @@
+#include "harness_tests.h"
+#include "pass_prefix_cache.h"
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+static const std::vector<std::string> TILED = {"canonicalize", "cse",
+                                               "tile", "vectorize"};
+static const std::vector<std::string> FUSED = {"canonicalize", "cse",
+                                               "tile", "fuse"};
+static const std::vector<std::string> SHORT = {"canonicalize", "lower"};
+
+static fs::path kernel_file() {
+  fs::path kernel = fs::path(harness_tests::scratch()) / "kernel.mlir";
+  std::ofstream(kernel) << "func.func @kernel() { return }\n";
+  return kernel;
+}
+
+static fs::path nodes_folder() {
+  return fs::path(harness_tests::scratch()) / "prefixes";
+}
+
+static std::vector<size_t> store_depths(const PassPrefixCache::Plan &plan) {
+  std::vector<size_t> depths;
+  for (const PassPrefixCache::Plan::Store &store : plan.stores)
+    depths.push_back(store.depth);
+  return depths;
+}
+
+// Writes the IR of every stored node, as a lowering would
+static void lower(const PassPrefixCache::Plan &plan) {
+  for (const PassPrefixCache::Plan::Store &store : plan.stores)
+    std::ofstream(store.staging) << "ir at depth " << store.depth;
+  PassPrefixCache::commit(plan, true);
+}
+
+static void register_pipelines() {
+  PassPrefixCache::reset();
+  PassPrefixCache::add_pipeline(TILED);
+  PassPrefixCache::add_pipeline(FUSED);
+  PassPrefixCache::add_pipeline(SHORT);
+  // Registering one again changes nothing
+  PassPrefixCache::add_pipeline(TILED);
+}
+
+/*
+ *   root ─ canonicalize ─┬─ cse ─ tile ─┬─ vectorize
+ *          (3 pipelines)  │  (2)    (2)   └─ fuse
+ *                         └─ lower
+ * Only the branch points are stored: after canonicalize (3 -> 2) and after
+ * tile (2 -> 1). cse carries both of its pipelines on to tile.
+ */
+HARNESS_TEST(pass_prefix_cache, stores_branch_points_only) {
+  register_pipelines();
+  fs::path kernel = kernel_file();
+  PassPrefixCache::Plan plan =
+      PassPrefixCache::plan(kernel, TILED, "toolchain", nodes_folder());
+  CHECK(plan.start.empty());
+  CHECK_EQ(plan.start_depth, size_t(0));
+  CHECK(store_depths(plan) == std::vector<size_t>({1, 3}));
+
+  PassPrefixCache::Plan short_plan =
+      PassPrefixCache::plan(kernel, SHORT, "toolchain", nodes_folder());
+  CHECK(store_depths(short_plan) == std::vector<size_t>({1}));
+  // The same prefix, the same node
+  if (!short_plan.stores.empty() && !plan.stores.empty())
+    CHECK(short_plan.stores[0].filepath == plan.stores[0].filepath);
+  PassPrefixCache::reset();
+}
+
+// Later lowerings start from the deepest node on their path
+HARNESS_TEST(pass_prefix_cache, reuses_deepest_node) {
+  register_pipelines();
+  fs::path kernel = kernel_file();
+  lower(PassPrefixCache::plan(kernel, TILED, "toolchain", nodes_folder()));
+
+  PassPrefixCache::Plan fused =
+      PassPrefixCache::plan(kernel, FUSED, "toolchain", nodes_folder());
+  CHECK_EQ(fused.start_depth, size_t(3));
+  CHECK(fs::exists(fused.start));
+  CHECK(fused.stores.empty());
+
+  PassPrefixCache::Plan short_plan =
+      PassPrefixCache::plan(kernel, SHORT, "toolchain", nodes_folder());
+  CHECK_EQ(short_plan.start_depth, size_t(1));
+  CHECK(short_plan.stores.empty());
+
+  // Another toolchain never reads IR of the first
+  PassPrefixCache::Plan other =
+      PassPrefixCache::plan(kernel, FUSED, "other", nodes_folder());
+  CHECK(other.start.empty());
+  CHECK(store_depths(other) == std::vector<size_t>({1, 3}));
+  PassPrefixCache::reset();
+}
+
+HARNESS_TEST(pass_prefix_cache, failed_lowering_publishes_nothing) {
+  register_pipelines();
+  fs::path kernel = kernel_file();
+  PassPrefixCache::Plan plan =
+      PassPrefixCache::plan(kernel, TILED, "toolchain", nodes_folder());
+  for (const PassPrefixCache::Plan::Store &store : plan.stores)
+    std::ofstream(store.staging) << "partial";
+  PassPrefixCache::commit(plan, false);
+  for (const PassPrefixCache::Plan::Store &store : plan.stores) {
+    CHECK(!fs::exists(store.filepath));
+    CHECK(!fs::exists(store.staging));
+  }
+  CHECK(PassPrefixCache::plan(kernel, FUSED, "toolchain", nodes_folder())
+            .start.empty());
+  PassPrefixCache::reset();
+}
+
+HARNESS_TEST(pass_prefix_cache, single_pipeline_or_disabled_plans_nothing) {
+  PassPrefixCache::reset();
+  fs::path kernel = kernel_file();
+  PassPrefixCache::add_pipeline(TILED);
+  PassPrefixCache::Plan plan =
+      PassPrefixCache::plan(kernel, TILED, "toolchain", nodes_folder());
+  CHECK(plan.start.empty() && plan.stores.empty());
+
+  register_pipelines();
+  PassPrefixCache::set_enabled(false);
+  plan = PassPrefixCache::plan(kernel, TILED, "toolchain", nodes_folder());
+  CHECK(plan.start.empty() && plan.stores.empty());
+  PassPrefixCache::reset();
+  CHECK(PassPrefixCache::is_enabled());
+}
+
+// A pass list that was never registered leaves the trie where it departs
+HARNESS_TEST(pass_prefix_cache, unregistered_list_stores_departure) {
+  register_pipelines();
+  std::vector<std::string> unknown = {"canonicalize", "cse", "inline"};
+  PassPrefixCache::Plan plan = PassPrefixCache::plan(
+      kernel_file(), unknown, "toolchain", nodes_folder());
+  CHECK(store_depths(plan) == std::vector<size_t>({1, 2}));
+  PassPrefixCache::reset();
+}
@@ -0,0 +1,118 @@
+#include "harness_tests.h"
+#include "pgo_profile.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <dlfcn.h>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+// Tools of the check, overridable for toolchains outside PATH
+static std::string tool(const char *variable, const char *fallback) {
+  const char *value = std::getenv(variable);
+  return value && *value ? value : fallback;
+}
+
+static bool succeeds(const std::string &command) {
+  return std::system((command + " > /dev/null 2>&1").c_str()) == 0;
+}
+
+// Sum of 0 .. n-1, a loop for the profile to count
+static const char *KERNEL_IR = R"(
+define i64 @pgo_test_kernel(i64 %n) {
+entry:
+  br label %loop
+loop:
+  %i = phi i64 [ 0, %entry ], [ %next, %loop ]
+  %sum = phi i64 [ 0, %entry ], [ %acc, %loop ]
+  %acc = add i64 %sum, %i
+  %next = add i64 %i, 1
+  %done = icmp sge i64 %next, %n
+  br i1 %done, label %exit, label %loop
+exit:
+  ret i64 %acc
+}
+)";
+
+/*
+ * The round trip of --pgo: an instrumented object is trained, the counters
+ * written through the exported hook become a .profdata, and the object is
+ * rebuilt with it
+ */
+HARNESS_TEST(pgo_profile, training_writes_profdata) {
+  std::string clang = tool("CLANG", "clang");
+  std::string profdata = tool("LLVM_PROFDATA", "llvm-profdata");
+  if (!succeeds(clang + " --version"))
+    harness_tests::skip("no " + clang);
+  if (!succeeds(profdata + " --version"))
+    harness_tests::skip("no " + profdata);
+
+  fs::path ll = fs::path(harness_tests::scratch()) / "kernel.llvm.ll";
+  std::ofstream(ll) << KERNEL_IR;
+  fs::path so = fs::path(ll).replace_extension(".so");
+  std::string build = clang + " -fPIC -shared -O1 -Wno-everything -o " +
+                      so.string() + " " + ll.string();
+
+  CHECK(PgoProfile::write_hook(ll));
+  std::string generate = PgoProfile::compile_flags(ll);
+  CHECK(generate.find("-fprofile-generate=") != std::string::npos);
+  if (!succeeds(build + generate))
+    harness_tests::skip("no profile runtime for " + clang);
+
+  void *handle = dlopen(so.c_str(), RTLD_NOW | RTLD_LOCAL);
+  CHECK(handle != nullptr);
+  if (!handle)
+    return;
+  using KernelFn = int64_t (*)(int64_t);
+  auto kernel =
+      reinterpret_cast<KernelFn>(dlsym(handle, "pgo_test_kernel"));
+  CHECK(kernel != nullptr);
+  for (unsigned int c = 0; kernel && c < PgoProfile::TRAINING_CALLS; c++)
+    CHECK_EQ(kernel(100), int64_t(4950));
+  CHECK(PgoProfile::write_raw(handle, ll));
+  dlclose(handle);
+
+  CHECK(!fs::is_empty(PgoProfile::raw_folder(ll)));
+  CHECK(succeeds(PgoProfile::merge_command(profdata, ll)));
+  CHECK(PgoProfile::is_current(ll));
+  CHECK(fs::exists(PgoProfile::profile_path(ll)) &&
+        fs::file_size(PgoProfile::profile_path(ll)) > 0);
+
+  std::string use = PgoProfile::compile_flags(ll);
+  CHECK(use.find("-fprofile-use=") != std::string::npos);
+  CHECK(succeeds(build + use));
+}
+
+// Without a profile, or with one older than the kernel, it is trained again
+HARNESS_TEST(pgo_profile, stale_profile_is_not_current) {
+  fs::path ll = fs::path(harness_tests::scratch()) / "kernel.llvm.ll";
+  std::ofstream(ll) << KERNEL_IR;
+  CHECK(!PgoProfile::is_current(ll));
+
+  fs::path profile = PgoProfile::profile_path(ll);
+  std::ofstream(profile) << "profile";
+  fs::last_write_time(profile, fs::last_write_time(ll) -
+                                   std::chrono::seconds(10));
+  CHECK(!PgoProfile::is_current(ll));
+  fs::last_write_time(profile, fs::last_write_time(ll) +
+                                   std::chrono::seconds(10));
+  CHECK(PgoProfile::is_current(ll));
+}
+
+// Only write_hook() writes the hook, the flags just name it
+HARNESS_TEST(pgo_profile, flags_write_nothing) {
+  fs::path ll = fs::path(harness_tests::scratch()) / "kernel.llvm.ll";
+  std::ofstream(ll) << KERNEL_IR;
+  fs::path hook = PgoProfile::hook_path(ll);
+  std::string generate = PgoProfile::compile_flags(ll);
+  CHECK(generate.find(hook.generic_string()) != std::string::npos);
+  CHECK(!fs::exists(hook));
+
+  CHECK(PgoProfile::write_hook(ll));
+  std::ifstream ir(hook);
+  std::string contents((std::istreambuf_iterator<char>(ir)),
+                       std::istreambuf_iterator<char>());
+  CHECK(contents.find(std::string("@") + PgoProfile::DUMP_SYMBOL) !=
+        std::string::npos);
+}
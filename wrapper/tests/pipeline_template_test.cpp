@@ -0,0 +1,130 @@
+#include "harness_tests.h"
+#include "pipeline_template.h"
+
+#include <fstream>
+#include <set>
+#include <string>
+#include <vector>
+
+static bool load(PipelineTemplate &pipeline, const json &contents) {
+  fs::path filepath = fs::path(harness_tests::scratch()) / "template.json";
+  std::ofstream(filepath) << contents.dump(2);
+  std::mt19937_64 rng(42);
+  return pipeline.load(filepath, rng);
+}
+
+static const json TEMPLATE = json::parse(R"({
+  "name": "tile ${tile}",
+  "parameters": {"fusion": [true, false], "tile": [32, 64]},
+  "pass": [
+    "linalg-tile{size=${tile}}",
+    {"pass": "affine-loop-fusion", "if": "fusion"},
+    {"permute": ["cse", "canonicalize"]}
+  ]
+})");
+
+HARNESS_TEST(pipeline_template, dimensions_and_grid) {
+  PipelineTemplate pipeline;
+  CHECK(load(pipeline, TEMPLATE));
+  const auto &dimensions = pipeline.dimensions();
+  CHECK_EQ(dimensions.size(), size_t(3));
+  if (dimensions.size() != 3)
+    return;
+  CHECK_EQ(dimensions[0].name, std::string("fusion"));
+  CHECK_EQ(dimensions[1].name, std::string("tile"));
+  CHECK_EQ(dimensions[2].name, std::string("order.0"));
+  CHECK_EQ(dimensions[2].values.size(), size_t(2));
+
+  CHECK_EQ(pipeline.size(), size_t(8));
+  std::vector<std::vector<size_t>> grid = pipeline.grid();
+  CHECK_EQ(grid.size(), size_t(8));
+  // The last dimension varies fastest
+  CHECK(grid[0] == std::vector<size_t>({0, 0, 0}));
+  CHECK(grid[1] == std::vector<size_t>({0, 0, 1}));
+  CHECK(grid[2] == std::vector<size_t>({0, 1, 0}));
+  CHECK(grid[7] == std::vector<size_t>({1, 1, 1}));
+}
+
+HARNESS_TEST(pipeline_template, render_expands_passes) {
+  PipelineTemplate pipeline;
+  CHECK(load(pipeline, TEMPLATE));
+
+  json fused = pipeline.render({0, 1, 1});
+  CHECK(!fused.contains("parameters"));
+  CHECK_EQ(fused["name"].get<std::string>(), std::string("tile 64"));
+  std::vector<std::string> passes = fused["pass"];
+  CHECK(passes == std::vector<std::string>({"linalg-tile{size=64}",
+                                            "affine-loop-fusion",
+                                            "canonicalize", "cse"}));
+
+  json unfused = pipeline.render({1, 0, 0});
+  passes = unfused["pass"].get<std::vector<std::string>>();
+  CHECK(passes == std::vector<std::string>(
+                      {"linalg-tile{size=32}", "cse", "canonicalize"}));
+}
+
+HARNESS_TEST(pipeline_template, descriptions_and_labels) {
+  PipelineTemplate pipeline;
+  CHECK(load(pipeline, TEMPLATE));
+  CHECK_EQ(pipeline.describe({0, 0, 1}),
+           std::string("fusion=true tile=32 order.0=1-0"));
+  CHECK_EQ(pipeline.label({0, 0, 1}),
+           std::string("fusion-true_tile-32_order.0-1-0"));
+  CHECK(pipeline.values({1, 1, 0}) ==
+        std::vector<std::string>({"false", "64", "0-1"}));
+
+  // Every label of the grid is distinct already
+  std::vector<std::string> labels = pipeline.labels(pipeline.grid());
+  CHECK_EQ(std::set<std::string>(labels.begin(), labels.end()).size(),
+           labels.size());
+}
+
+// Values that read the same once file name safe get numbered
+HARNESS_TEST(pipeline_template, colliding_labels_are_numbered) {
+  PipelineTemplate pipeline;
+  CHECK(load(pipeline, json::parse(R"({
+    "parameters": {"tile": [[4, 4], "4-4", "4/4"]},
+    "pass": ["linalg-tile{sizes=${tile}}"]
+  })")));
+  std::vector<std::string> labels = pipeline.labels(pipeline.grid());
+  CHECK(labels == std::vector<std::string>(
+                      {"tile-4-4", "tile-4-4_2", "tile-4-4_3"}));
+  CHECK_EQ(pipeline.render({0})["pass"][0].get<std::string>(),
+           std::string("linalg-tile{sizes=[4,4]}"));
+
+  PipelineTemplate plain;
+  CHECK(load(plain, json::parse(R"({"pass": ["cse"]})")));
+  CHECK_EQ(plain.size(), size_t(1));
+  CHECK_EQ(plain.label({}), std::string("template"));
+}
+
+// Beyond 5 passes the orders are sampled, the original one first
+HARNESS_TEST(pipeline_template, long_permutations_are_sampled) {
+  PipelineTemplate pipeline;
+  CHECK(load(pipeline, json::parse(R"({
+    "pass": [{"permute": ["a", "b", "c", "d", "e", "f"]}]
+  })")));
+  CHECK_EQ(pipeline.dimensions().size(), size_t(1));
+  if (pipeline.dimensions().empty())
+    return;
+  const std::vector<json> &orders = pipeline.dimensions()[0].values;
+  CHECK_EQ(orders.size(), size_t(120));
+  CHECK(orders[0].get<std::vector<size_t>>() ==
+        std::vector<size_t>({0, 1, 2, 3, 4, 5}));
+  std::set<std::vector<size_t>> distinct;
+  for (const json &order : orders)
+    distinct.insert(order.get<std::vector<size_t>>());
+  CHECK_EQ(distinct.size(), orders.size());
+}
+
+HARNESS_TEST(pipeline_template, rejects_invalid_templates) {
+  PipelineTemplate pipeline;
+  CHECK(!load(pipeline, json::parse(R"({"parameters": {"tile": [32]}})")));
+  CHECK(!load(pipeline, json::parse(R"({
+    "parameters": {"tile": []},
+    "pass": ["cse"]
+  })")));
+  std::mt19937_64 rng(42);
+  CHECK(!pipeline.load(fs::path(harness_tests::scratch()) / "missing.json",
+                       rng));
+}
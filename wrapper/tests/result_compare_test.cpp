@@ -0,0 +1,150 @@
+#include "harness_tests.h"
+#include "result_compare.h"
+
+#include <string>
+#include <vector>
+
+static StoredKernel kernel(const std::string &name, const std::string &hash,
+                           const std::vector<double> &seconds) {
+  StoredKernel stored;
+  stored.op_type = "linalg.matmul";
+  stored.kernel = name;
+  stored.hash = hash;
+  stored.samples["seconds"] = seconds;
+  return stored;
+}
+
+static std::vector<double> around(double center) {
+  std::vector<double> samples;
+  for (int i = -5; i <= 5; i++)
+    samples.push_back(center * (1.0 + 0.001 * i));
+  return samples;
+}
+
+static const KernelComparison *find(const std::vector<KernelComparison> &all,
+                                    const std::string &hash) {
+  for (const KernelComparison &comparison : all)
+    if (comparison.hash == hash)
+      return &comparison;
+  return nullptr;
+}
+
+// Kernels match by hash whatever their names, one verdict each
+HARNESS_TEST(result_compare, verdicts) {
+  StoredRun baseline, candidate;
+  baseline.primary_metric = "seconds";
+  baseline.kernels = {kernel("a", "h1", around(1.0)),
+                      kernel("b", "h2", around(1.0)),
+                      kernel("c", "h3", around(1.0)),
+                      kernel("gone", "h4", around(1.0))};
+  candidate.kernels = {kernel("a_renamed", "h1", around(1.5)),
+                       kernel("b", "h2", around(0.5)),
+                       kernel("c", "h3", around(1.0)),
+                       kernel("new", "h5", around(1.0))};
+
+  CompareConfig config;
+  std::vector<KernelComparison> comparisons =
+      ResultCompare::compare(baseline, candidate, config);
+  CHECK_EQ(comparisons.size(), size_t(3));
+
+  const KernelComparison *slower = find(comparisons, "h1");
+  CHECK(slower != nullptr);
+  if (slower) {
+    CHECK_EQ(slower->verdict, std::string("regression"));
+    CHECK_EQ(slower->candidate_kernel, std::string("a_renamed"));
+    CHECK_NEAR(slower->change, 0.5, 1e-9);
+    CHECK(slower->adjusted_p >= slower->p_value);
+    CHECK_NEAR(slower->effect, 1.0, 1e-12);
+  }
+  const KernelComparison *faster = find(comparisons, "h2");
+  CHECK(faster != nullptr);
+  if (faster) {
+    CHECK_EQ(faster->verdict, std::string("speedup"));
+    CHECK_NEAR(faster->change, -0.5, 1e-9);
+  }
+  const KernelComparison *same = find(comparisons, "h3");
+  CHECK(same != nullptr);
+  if (same)
+    CHECK_EQ(same->verdict, std::string("unchanged"));
+
+  // Worst change first, and only the regression beyond the threshold fails
+  CHECK_EQ(comparisons.front().hash, std::string("h1"));
+  CHECK_EQ(ResultCompare::count_failures(comparisons, config), size_t(1));
+  config.threshold = 0.6;
+  CHECK_EQ(ResultCompare::count_failures(comparisons, config), size_t(0));
+}
+
+// For throughputs a drop is the regression
+HARNESS_TEST(result_compare, higher_is_better_metrics) {
+  CHECK(ResultCompare::higher_is_better("gflops"));
+  CHECK(ResultCompare::higher_is_better("ipc"));
+  CHECK(ResultCompare::higher_is_better("l2_bandwidth_gbs"));
+  CHECK(ResultCompare::higher_is_better("calls_per_s"));
+  CHECK(!ResultCompare::higher_is_better("seconds"));
+  CHECK(!ResultCompare::higher_is_better("cycles"));
+
+  StoredKernel base = kernel("a", "h1", {});
+  base.samples["gflops"] = around(100.0);
+  StoredKernel cand = kernel("a", "h1", {});
+  cand.samples["gflops"] = around(50.0);
+  StoredRun baseline{"gflops", "", {base}};
+  StoredRun candidate{"gflops", "", {cand}};
+  std::vector<KernelComparison> comparisons =
+      ResultCompare::compare(baseline, candidate, CompareConfig());
+  CHECK_EQ(comparisons.size(), size_t(1));
+  if (!comparisons.empty()) {
+    CHECK_EQ(comparisons[0].metric, std::string("gflops"));
+    CHECK_EQ(comparisons[0].verdict, std::string("regression"));
+    CHECK_NEAR(comparisons[0].change, 1.0, 1e-9);
+    CHECK(comparisons[0].effect > 0.0);
+  }
+}
+
+/*
+ * A change significant on its own but not across the family: one real
+ * shift among many kernels that didn't move. Holm keeps the family wise
+ * error, so only the correction decides the verdict here.
+ */
+HARNESS_TEST(result_compare, corrections_adjust_across_kernels) {
+  StoredRun baseline, candidate;
+  baseline.primary_metric = "seconds";
+  // Samples interleaved, the candidate slightly above: p about 0.017
+  std::vector<double> base, cand;
+  for (int i = 0; i < 10; i++) {
+    base.push_back(1.0 + 0.01 * i);
+    cand.push_back(base.back() + 0.04);
+  }
+  baseline.kernels.push_back(kernel("shifted", "shifted", base));
+  candidate.kernels.push_back(kernel("shifted", "shifted", cand));
+  for (int k = 0; k < 20; k++) {
+    std::string hash = "still" + std::to_string(k);
+    baseline.kernels.push_back(kernel(hash, hash, base));
+    candidate.kernels.push_back(kernel(hash, hash, base));
+  }
+
+  CompareConfig config;
+  config.correction = PCorrection::NONE;
+  std::vector<KernelComparison> raw =
+      ResultCompare::compare(baseline, candidate, config);
+  const KernelComparison *uncorrected = find(raw, "shifted");
+  CHECK(uncorrected != nullptr);
+  if (!uncorrected)
+    return;
+  CHECK(uncorrected->p_value < config.alpha);
+  CHECK_NEAR(uncorrected->adjusted_p, uncorrected->p_value, 0.0);
+  CHECK_EQ(uncorrected->verdict, std::string("regression"));
+
+  for (PCorrection correction :
+       {PCorrection::HOLM, PCorrection::BENJAMINI_HOCHBERG}) {
+    config.correction = correction;
+    std::vector<KernelComparison> adjusted =
+        ResultCompare::compare(baseline, candidate, config);
+    const KernelComparison *shifted = find(adjusted, "shifted");
+    CHECK(shifted != nullptr);
+    if (!shifted)
+      continue;
+    CHECK_NEAR(shifted->p_value, uncorrected->p_value, 0.0);
+    CHECK(shifted->adjusted_p > shifted->p_value);
+    CHECK_EQ(shifted->verdict, std::string("unchanged"));
+  }
+}
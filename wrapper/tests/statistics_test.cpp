@@ -0,0 +1,145 @@
+#include "harness_tests.h"
+#include "statistics.h"
+
+#include <vector>
+
+static OutlierConfig outliers(OutlierMethod method, double threshold = 0.0) {
+  OutlierConfig config;
+  config.method = method;
+  config.threshold = threshold;
+  return config;
+}
+
+// A descheduled sample far above a tight cluster
+HARNESS_TEST(statistics, mad_rejects_far_sample) {
+  std::vector<double> samples = {10.0, 10.1, 9.9, 10.0, 10.2, 9.8, 10.0, 50.0};
+  CHECK_NEAR(Statistics::median(samples), 10.0, 1e-12);
+  CHECK_NEAR(Statistics::mad(samples), 0.1, 1e-12);
+
+  std::vector<bool> rejected =
+      Statistics::find_outliers(samples, outliers(OutlierMethod::MAD));
+  std::vector<bool> expected(samples.size(), false);
+  expected.back() = true;
+  CHECK(rejected == expected);
+
+  // 10.2 scores 0.6745 * 0.2 / 0.1 = 1.349
+  rejected =
+      Statistics::find_outliers(samples, outliers(OutlierMethod::MAD, 1.3));
+  CHECK(rejected[4] && rejected[5] && rejected.back());
+  CHECK(!rejected[0] && !rejected[1] && !rejected[2]);
+}
+
+// More than half the samples on the median leave MAD at 0, the mean
+// absolute deviation scales the scores then
+HARNESS_TEST(statistics, mad_falls_back_to_mean_deviation) {
+  std::vector<double> samples = {5.0, 5.0, 5.0, 5.0, 5.0, 9.0};
+  CHECK_NEAR(Statistics::mad(samples), 0.0, 0.0);
+  std::vector<bool> rejected =
+      Statistics::find_outliers(samples, outliers(OutlierMethod::MAD));
+  std::vector<bool> expected = {false, false, false, false, false, true};
+  CHECK(rejected == expected);
+}
+
+HARNESS_TEST(statistics, nothing_rejected_without_grounds) {
+  std::vector<double> constant(8, 3.0);
+  std::vector<double> few = {1.0, 1.0, 100.0};
+  std::vector<double> spread = {1.0, 2.0, 3.0, 100.0};
+  for (OutlierMethod method : {OutlierMethod::MAD, OutlierMethod::IQR}) {
+    CHECK(Statistics::find_outliers(constant, outliers(method)) ==
+          std::vector<bool>(constant.size(), false));
+    CHECK(Statistics::find_outliers(few, outliers(method)) ==
+          std::vector<bool>(few.size(), false));
+  }
+  CHECK(Statistics::find_outliers(spread, outliers(OutlierMethod::NONE)) ==
+        std::vector<bool>(spread.size(), false));
+  // A threshold that would reject most of the samples rejects none
+  CHECK(Statistics::find_outliers(spread,
+                                  outliers(OutlierMethod::MAD, 0.01)) ==
+        std::vector<bool>(spread.size(), false));
+}
+
+HARNESS_TEST(statistics, iqr_fences) {
+  // Q1 = 2.25, Q3 = 4.75, upper fence 4.75 + 1.5 * 2.5 = 8.5
+  std::vector<double> samples = {1.0, 2.0, 3.0, 4.0, 5.0, 100.0};
+  CHECK_NEAR(Statistics::percentile(samples, 0.25), 2.25, 1e-12);
+  CHECK_NEAR(Statistics::percentile(samples, 0.75), 4.75, 1e-12);
+  std::vector<bool> rejected =
+      Statistics::find_outliers(samples, outliers(OutlierMethod::IQR));
+  std::vector<bool> expected = {false, false, false, false, false, true};
+  CHECK(rejected == expected);
+}
+
+HARNESS_TEST(statistics, outlier_method_names) {
+  for (OutlierMethod method :
+       {OutlierMethod::NONE, OutlierMethod::MAD, OutlierMethod::IQR}) {
+    OutlierMethod parsed = OutlierMethod::NONE;
+    CHECK(Statistics::parse(Statistics::describe(method), parsed));
+    CHECK(parsed == method);
+  }
+  OutlierMethod parsed;
+  CHECK(!Statistics::parse("zscore", parsed));
+}
+
+HARNESS_TEST(statistics, holm_step_down) {
+  std::vector<double> p = {0.01, 0.04, 0.03, 0.005};
+  // Sorted: 0.005 * 4, 0.01 * 3, 0.03 * 2, 0.04 * 1, kept monotone
+  std::vector<double> adjusted = Statistics::holm(p);
+  CHECK_EQ(adjusted.size(), p.size());
+  CHECK_NEAR(adjusted[3], 0.02, 1e-12);
+  CHECK_NEAR(adjusted[0], 0.03, 1e-12);
+  CHECK_NEAR(adjusted[2], 0.06, 1e-12);
+  CHECK_NEAR(adjusted[1], 0.06, 1e-12);
+
+  std::vector<double> large = Statistics::holm({0.5, 0.6});
+  CHECK_NEAR(large[0], 1.0, 0.0);
+  CHECK_NEAR(large[1], 1.0, 0.0);
+  CHECK(Statistics::holm({}).empty());
+}
+
+HARNESS_TEST(statistics, benjamini_hochberg_step_up) {
+  std::vector<double> p = {0.01, 0.04, 0.03, 0.005};
+  // Sorted: 0.005 * 4 / 1, 0.01 * 4 / 2, 0.03 * 4 / 3, 0.04 * 4 / 4, the
+  // minimum of those above
+  std::vector<double> adjusted = Statistics::benjamini_hochberg(p);
+  CHECK_EQ(adjusted.size(), p.size());
+  CHECK_NEAR(adjusted[3], 0.02, 1e-12);
+  CHECK_NEAR(adjusted[0], 0.02, 1e-12);
+  CHECK_NEAR(adjusted[2], 0.04, 1e-12);
+  CHECK_NEAR(adjusted[1], 0.04, 1e-12);
+
+  // Never above 1, never below the raw p-value
+  std::vector<double> raw = {0.9, 0.8, 0.001};
+  std::vector<double> capped = Statistics::benjamini_hochberg(raw);
+  for (size_t i = 0; i < raw.size(); i++)
+    CHECK(capped[i] <= 1.0 && capped[i] >= raw[i]);
+}
+
+HARNESS_TEST(statistics, summary_and_intervals) {
+  std::vector<double> samples = {1.0, 2.0, 3.0, 4.0, 5.0};
+  SampleSummary summary = Statistics::summarize(samples, 500);
+  CHECK_EQ(summary.count, size_t(5));
+  CHECK_NEAR(summary.mean, 3.0, 1e-12);
+  CHECK_NEAR(summary.median, 3.0, 1e-12);
+  CHECK_NEAR(summary.min, 1.0, 0.0);
+  CHECK_NEAR(summary.max, 5.0, 0.0);
+  CHECK_NEAR(summary.stddev, 1.5811388300841898, 1e-12);
+  CHECK(summary.ci95_low <= summary.mean && summary.mean <= summary.ci95_high);
+
+  // The bootstrap has a fixed seed, reruns report the same interval
+  double low = 0.0, high = 0.0;
+  Statistics::bootstrap_ci_95(samples, 500, low, high);
+  CHECK_NEAR(low, summary.ci95_low, 0.0);
+  CHECK_NEAR(high, summary.ci95_high, 0.0);
+}
+
+HARNESS_TEST(statistics, rank_tests) {
+  std::vector<double> fast = {1.0, 1.1, 1.2, 1.3, 1.4, 1.5, 1.6, 1.7};
+  std::vector<double> slow = {2.0, 2.1, 2.2, 2.3, 2.4, 2.5, 2.6, 2.7};
+  double u = 0.0;
+  CHECK(Statistics::mann_whitney_p(slow, fast, u) < 0.01);
+  CHECK_NEAR(u, 64.0, 0.0);
+  CHECK_NEAR(Statistics::cliffs_delta(slow, fast), 1.0, 1e-12);
+  CHECK_NEAR(Statistics::cliffs_delta(fast, slow), -1.0, 1e-12);
+  CHECK(Statistics::mann_whitney_p(fast, fast, u) > 0.5);
+  CHECK_NEAR(Statistics::mann_whitney_p({}, fast, u), 1.0, 0.0);
+}